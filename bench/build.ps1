@@ -0,0 +1,50 @@
+# Builds launch_bench, the startup-latency suite for every launch path. On
+# Windows it times the launchers' own executables (build them first, or point
+# /bin at them); on Linux CI it links the sandbox library for the stand-ins
+# listed in launch_bench.cc.
+
+$scriptDir = Split-Path -Path $MyInvocation.MyCommand.Path
+$outDir = Join-Path -Path $scriptDir -ChildPath "out"
+$sandboxDir = Join-Path (Split-Path -Path $scriptDir) "sandbox"
+
+$SandboxSources = @(
+    "grant_backend.cc",
+    "grant_plan.cc",
+    "launcher.cc",
+    "runtime_env.cc",
+    "trace.cc",
+    "worker_pool.cc"
+)
+
+$compilerFlags = @("-std=c++17", "-O2", "-g")
+if ($env:SANDBOX_TRACE) {
+    $compilerFlags += "-DSANDBOX_TRACE"
+}
+$linkFlags = @()
+if ($IsLinux -or $IsMacOS) {
+    $compilerFlags += "-pthread"
+    $exeSuffix = ""
+} else {
+    $linkFlags += @("-luserenv", "-ladvapi32")
+    $exeSuffix = ".exe"
+}
+
+New-Item -ItemType Directory -Force -Path $outDir | Out-Null
+
+$sourcePaths = @(Join-Path $scriptDir "launch_bench.cc")
+$sourcePaths += $SandboxSources | ForEach-Object { Join-Path $sandboxDir $_ }
+$outputPath = Join-Path $outDir "launch_bench$exeSuffix"
+Write-Host "Compiling launch_bench..." -ForegroundColor Yellow
+
+& clang++ @compilerFlags @sourcePaths -o $outputPath @linkFlags
+
+if ($LASTEXITCODE -ne 0) {
+    Write-Error "Compilation of launch_bench failed with exit code $LASTEXITCODE"
+    exit $LASTEXITCODE
+}
+
+# The probes and the pool worker are started from the copies next to the tool.
+Copy-Item -Path (Join-Path $scriptDir "launch_probe.py") -Destination $outDir -Force
+Copy-Item -Path (Join-Path $sandboxDir "python_worker.py") -Destination $outDir -Force
+
+Write-Host "Successfully compiled to $outputPath" -ForegroundColor Green
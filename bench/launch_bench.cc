@@ -0,0 +1,942 @@
+// Measures startup latency of every launch path in the repo, cold and warm:
+//
+//   main              main.cpp (hello-msix.exe): a plain native process
+//   launch_container  launch_container.exe: a native process in the sandbox
+//   python_container  python_container.exe: Python in the sandbox
+//   python_pool       python_container.exe --pool: Python on a warm worker
+//   python_msix       python-msix launch.exe: a supervised Python process
+//
+// On Windows each path runs the real executable from /bin, so the numbers
+// include everything the launcher itself does. The executables are Windows
+// only; on Linux, so that CI can run the suite, each path is a stand-in
+// that takes the same steps in-process: SandboxLauncher's
+// namespace/Landlock/seccomp backend for the sandboxed paths, a WorkerPool
+// whose zygote is started through it for the pool, and posix_spawn for the
+// plain processes.
+//
+// Each launch records, relative to the moment the harness starts it:
+//   create  the spawn call returned (the process exists)
+//   first   the child's main() ran (native probes: this binary with --probe)
+//   import  Python user code reached its first import (launch_probe.py)
+//   exit    the harness saw the process exit
+//
+// "cold" launches include all one-time setup (sandbox launcher, worker pool)
+// and, with /dropcaches on Linux, an empty page cache. "warm" launches reuse
+// the setup after /warmup untimed launches.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "../sandbox/launcher.h"
+#include "../sandbox/worker_pool.h"
+
+#ifndef _WIN32
+extern char** environ;
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const char* const kMetrics[] = {"create", "first", "import", "exit"};
+constexpr int kMetricCount = 4;
+
+// Milliseconds after launch start; negative when the path has no such step.
+struct Sample {
+    double values[kMetricCount] = {-1, -1, -1, -1};
+};
+
+int64_t NowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               Clock::now().time_since_epoch())
+        .count();
+}
+
+double MillisecondsSince(int64_t start, int64_t end) { return (end - start) / 1e6; }
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "Options:\n"
+              << "  /n <runs>           Timed launches per path and mode (default: 20)\n"
+              << "  /warmup <runs>      Untimed launches before warm runs (default: 2)\n"
+              << "  /paths <a,b,...>    Subset of: main, launch_container, python_container,\n"
+              << "                      python_pool, python_msix (default: all)\n"
+              << "  /modes <a,b>        Subset of: cold, warm (default: both)\n"
+              << "  /python <exe>       Interpreter for the Python paths (default: python3)\n"
+              << "  /read <dir>         Extra directory readable inside the sandbox\n"
+              << "  /bin <dir>          Where to find hello-msix.exe, launch_container.exe,\n"
+              << "                      python_container.exe and launch.exe (Windows,\n"
+              << "                      repeatable; default: the repo's build outputs)\n"
+              << "  /dropcaches         Drop the page cache before each cold launch (Linux,\n"
+              << "                      needs root)\n"
+              << "  /label <text>       Stored with each CSV row, e.g. the commit id\n"
+              << "  /csv <file>         Append results as CSV\n"
+              << "  /json <file>        Write results and histograms as JSON\n"
+              << "  /baseline <file>    CSV from an earlier run; exit with 2 when a p50\n"
+              << "                      grew by more than /threshold (default: 1.25)\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+double Percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+std::string SelfPath(const char* argv0) {
+#ifdef _WIN32
+    wchar_t buffer[MAX_PATH];
+    DWORD length = GetModuleFileNameW(NULL, buffer, MAX_PATH);
+    std::string path;
+    for (DWORD i = 0; i < length; i++) {
+        path += static_cast<char>(buffer[i]);  // the bench dir is expected to be ASCII
+    }
+    return path;
+#else
+    char buffer[4096];
+    ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+    return length > 0 ? std::string(buffer, length) : std::string(argv0);
+#endif
+}
+
+std::string Directory(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+void SetEnvironment(const char* name, const std::string& value) {
+#ifdef _WIN32
+    _putenv_s(name, value.c_str());
+#else
+    setenv(name, value.c_str(), 1);
+#endif
+}
+
+// Timestamps the children append to the file named by LAUNCH_BENCH_TIMES.
+class TimesFile {
+public:
+    explicit TimesFile(std::string path) : path_(std::move(path)) {}
+
+    const std::string& Path() const { return path_; }
+
+    void Reset() const { std::ofstream(path_, std::ios::trunc); }
+
+    void Read(int64_t start, Sample* sample) const {
+        std::ifstream in(path_);
+        std::string name;
+        int64_t nanoseconds = 0;
+        while (in >> name >> nanoseconds) {
+            if (name == "first") {
+                sample->values[1] = MillisecondsSince(start, nanoseconds);
+            } else if (name == "import") {
+                sample->values[2] = MillisecondsSince(start, nanoseconds);
+            }
+        }
+    }
+
+private:
+    std::string path_;
+};
+
+// --- plain processes -------------------------------------------------------
+
+#ifdef _WIN32
+// Quotes one argument for CommandLineToArgvW: backslashes are literal except
+// in front of a quote.
+std::string QuoteArgument(const std::string& argument) {
+    std::string quoted = "\"";
+    size_t backslashes = 0;
+    for (char c : argument) {
+        if (c == '\\') {
+            backslashes++;
+            continue;
+        }
+        quoted.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+        backslashes = 0;
+        quoted += c;
+    }
+    quoted.append(backslashes * 2, '\\');
+    return quoted + "\"";
+}
+
+// The first of dirs that holds name, or name alone for PATH to resolve.
+std::string FindExecutable(const std::vector<std::string>& dirs, const std::string& name) {
+    for (const std::string& dir : dirs) {
+        std::string path = dir + "\\" + name;
+        if (GetFileAttributesA(path.c_str()) != INVALID_FILE_ATTRIBUTES) {
+            return path;
+        }
+    }
+    return name;
+}
+
+std::string CommandLine(const std::vector<std::string>& argv) {
+    std::string commandLine;
+    for (const std::string& argument : argv) {
+        commandLine += (commandLine.empty() ? "" : " ") + QuoteArgument(argument);
+    }
+    return commandLine;
+}
+#endif
+
+bool RunPlain(const std::vector<std::string>& argv, int64_t start, Sample* sample,
+              std::string* error) {
+#ifdef _WIN32
+    std::string commandLine = CommandLine(argv);
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION info = {};
+    if (!CreateProcessA(NULL, &commandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup,
+                        &info)) {
+        *error = "CreateProcess failed with error " + std::to_string(GetLastError());
+        return false;
+    }
+    sample->values[0] = MillisecondsSince(start, NowNanoseconds());
+    WaitForSingleObject(info.hProcess, INFINITE);
+    sample->values[3] = MillisecondsSince(start, NowNanoseconds());
+    CloseHandle(info.hThread);
+    CloseHandle(info.hProcess);
+    return true;
+#else
+    std::vector<char*> args;
+    for (const std::string& argument : argv) {
+        args.push_back(const_cast<char*>(argument.c_str()));
+    }
+    args.push_back(nullptr);
+    pid_t pid = 0;
+    int result = posix_spawnp(&pid, args[0], nullptr, nullptr, args.data(), environ);
+    if (result != 0) {
+        *error = std::string("posix_spawn failed: ") + strerror(result);
+        return false;
+    }
+    sample->values[0] = MillisecondsSince(start, NowNanoseconds());
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    sample->values[3] = MillisecondsSince(start, NowNanoseconds());
+    return true;
+#endif
+}
+
+// --- launch paths ----------------------------------------------------------
+
+class LaunchPath {
+public:
+    explicit LaunchPath(std::string name) : name_(std::move(name)) {}
+    virtual ~LaunchPath() = default;
+
+    const std::string& Name() const { return name_; }
+
+    // One-time state kept across warm launches.
+    virtual bool Setup(std::string*) { return true; }
+    virtual void Teardown() {}
+    virtual bool Launch(int64_t start, Sample* sample, std::string* error) = 0;
+
+private:
+    std::string name_;
+};
+
+class PlainPath : public LaunchPath {
+public:
+    PlainPath(std::string name, std::vector<std::string> argv)
+        : LaunchPath(std::move(name)), argv_(std::move(argv)) {}
+
+    bool Launch(int64_t start, Sample* sample, std::string* error) override {
+        return RunPlain(argv_, start, sample, error);
+    }
+
+private:
+    std::vector<std::string> argv_;
+};
+
+class SandboxedPath : public LaunchPath {
+public:
+    SandboxedPath(std::string name, std::vector<std::string> argv, sandbox::SandboxPolicy policy)
+        : LaunchPath(std::move(name)), argv_(std::move(argv)), policy_(std::move(policy)) {}
+
+    bool Setup(std::string* error) override {
+        if (!launcher_) {
+            launcher_ = sandbox::SandboxLauncher::Create(policy_, error);
+        }
+        return launcher_ != nullptr;
+    }
+
+    void Teardown() override { launcher_.reset(); }
+
+    bool Launch(int64_t start, Sample* sample, std::string* error) override {
+        sandbox::LaunchCommand command;
+        command.argv = argv_;
+        sandbox::LaunchedProcess process;
+        if (!launcher_->Spawn(command, &process, error)) {
+            return false;
+        }
+        sample->values[0] = MillisecondsSince(start, NowNanoseconds());
+        int exitCode = 0;
+        if (!launcher_->Wait(&process, &exitCode, error)) {
+            return false;
+        }
+        sample->values[3] = MillisecondsSince(start, NowNanoseconds());
+        if (exitCode != 0) {
+            *error = Name() + " child exited with code " + std::to_string(exitCode);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    std::vector<std::string> argv_;
+    sandbox::SandboxPolicy policy_;
+    std::unique_ptr<sandbox::SandboxLauncher> launcher_;
+};
+
+#ifdef _WIN32
+// python_container.exe --pool, driven the way a user drives it: one script
+// path per line on its stdin, one "exited with code" line back on its
+// stdout. A pool launch creates no process, so it has no create or first
+// time.
+class ContainerPoolPath : public LaunchPath {
+public:
+    ContainerPoolPath(std::string name, std::vector<std::string> argv, std::string script)
+        : LaunchPath(std::move(name)), argv_(std::move(argv)), script_(std::move(script)) {}
+
+    ~ContainerPoolPath() override { Teardown(); }
+
+    bool Setup(std::string* error) override {
+        if (process_ != NULL) {
+            return true;
+        }
+        SECURITY_ATTRIBUTES inheritable = {sizeof(inheritable), NULL, TRUE};
+        HANDLE inputRead = NULL, outputWrite = NULL;
+        if (!CreatePipe(&inputRead, &input_, &inheritable, 0) ||
+            !CreatePipe(&output_, &outputWrite, &inheritable, 0)) {
+            *error = "CreatePipe failed with error " + std::to_string(GetLastError());
+            if (inputRead != NULL) {
+                CloseHandle(inputRead);
+            }
+            Teardown();
+            return false;
+        }
+        SetHandleInformation(input_, HANDLE_FLAG_INHERIT, 0);
+        SetHandleInformation(output_, HANDLE_FLAG_INHERIT, 0);
+        STARTUPINFOA startup = {};
+        startup.cb = sizeof(startup);
+        startup.dwFlags = STARTF_USESTDHANDLES;
+        startup.hStdInput = inputRead;
+        startup.hStdOutput = outputWrite;
+        startup.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+        std::string commandLine = CommandLine(argv_);
+        PROCESS_INFORMATION info = {};
+        BOOL created = CreateProcessA(NULL, &commandLine[0], NULL, NULL, TRUE, 0, NULL, NULL,
+                                      &startup, &info);
+        CloseHandle(inputRead);
+        CloseHandle(outputWrite);
+        if (!created) {
+            *error = "CreateProcess failed with error " + std::to_string(GetLastError());
+            Teardown();
+            return false;
+        }
+        CloseHandle(info.hThread);
+        process_ = info.hProcess;
+        std::string line;
+        if (!ReadLineWith("Worker pool ready", &line, error)) {
+            Teardown();
+            return false;
+        }
+        return true;
+    }
+
+    // Closing its stdin ends the pool's read loop.
+    void Teardown() override {
+        if (input_ != NULL) {
+            CloseHandle(input_);
+            input_ = NULL;
+        }
+        if (process_ != NULL) {
+            WaitForSingleObject(process_, INFINITE);
+            CloseHandle(process_);
+            process_ = NULL;
+        }
+        if (output_ != NULL) {
+            CloseHandle(output_);
+            output_ = NULL;
+        }
+    }
+
+    bool Launch(int64_t start, Sample* sample, std::string* error) override {
+        std::string request = script_ + "\n";
+        DWORD written = 0;
+        if (!WriteFile(input_, request.data(), static_cast<DWORD>(request.size()), &written,
+                       NULL) ||
+            written != request.size()) {
+            *error = "python_container.exe stopped reading scripts";
+            return false;
+        }
+        const char kExited[] = "exited with code: ";
+        std::string line;
+        if (!ReadLineWith(kExited, &line, error)) {
+            return false;
+        }
+        sample->values[3] = MillisecondsSince(start, NowNanoseconds());
+        int exitCode = atoi(line.c_str() + line.find(kExited) + sizeof(kExited) - 1);
+        if (exitCode != 0) {
+            *error = Name() + " job exited with code " + std::to_string(exitCode);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    // Reads the pool's stdout up to the first line containing `text`.
+    bool ReadLineWith(const char* text, std::string* line, std::string* error) {
+        line->clear();
+        for (;;) {
+            char c = 0;
+            DWORD bytesRead = 0;
+            if (!ReadFile(output_, &c, 1, &bytesRead, NULL) || bytesRead == 0) {
+                *error = "python_container.exe --pool exited";
+                return false;
+            }
+            if (c != '\n') {
+                *line += c;
+            } else if (line->find(text) != std::string::npos) {
+                return true;
+            } else {
+                line->clear();
+            }
+        }
+    }
+
+    std::vector<std::string> argv_;
+    std::string script_;
+    HANDLE process_ = NULL;
+    HANDLE input_ = NULL;
+    HANDLE output_ = NULL;
+};
+#else
+// Stand-in for python_container --pool: the same WorkerPool, its zygote
+// started through a SandboxLauncher. A pool launch creates no process, so
+// it has no create or first time.
+class PoolPath : public LaunchPath {
+public:
+    PoolPath(std::string name, sandbox::WorkerPoolOptions options, sandbox::SandboxPolicy policy,
+             std::string script)
+        : LaunchPath(std::move(name)),
+          options_(std::move(options)),
+          policy_(std::move(policy)),
+          script_(std::move(script)) {}
+
+    bool Setup(std::string* error) override {
+        if (!pool_) {
+            launcher_ = sandbox::SandboxLauncher::Create(policy_, error);
+            if (!launcher_) {
+                return false;
+            }
+            options_.launcher = launcher_.get();
+            pool_.reset(new sandbox::WorkerPool());
+            if (!pool_->Start(options_, error)) {
+                pool_.reset();
+                launcher_.reset();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Teardown() override {
+        if (pool_) {
+            pool_->Stop();
+            pool_.reset();
+        }
+        launcher_.reset();
+    }
+
+    bool Launch(int64_t start, Sample* sample, std::string* error) override {
+        sandbox::PythonJob job;
+        job.script = script_;
+        sandbox::PythonJobResult result;
+        if (!pool_->Run(job, &result, error)) {
+            return false;
+        }
+        sample->values[3] = MillisecondsSince(start, NowNanoseconds());
+        if (result.exitCode != 0) {
+            *error = Name() + " job exited with code " + std::to_string(result.exitCode);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    sandbox::WorkerPoolOptions options_;
+    sandbox::SandboxPolicy policy_;
+    std::string script_;
+    std::unique_ptr<sandbox::SandboxLauncher> launcher_;
+    std::unique_ptr<sandbox::WorkerPool> pool_;
+};
+#endif
+
+void DropPageCache() {
+#ifdef __linux__
+    static bool warned = false;
+    sync();
+    std::ofstream out("/proc/sys/vm/drop_caches");
+    out << "3";
+    out.flush();
+    if (!out && !warned) {
+        std::cerr << "Cannot drop the page cache (needs root); cold runs keep it." << std::endl;
+        warned = true;
+    }
+#endif
+}
+
+// Asks the interpreter for its real executable and prefix; the sandbox needs
+// the prefix readable and the launchers need a path rather than a shim.
+bool DescribePython(const std::string& python, std::string* executable, std::string* prefix) {
+    std::string command =
+        "\"" + python + "\" -c \"import sys; print(sys.executable); print(sys.prefix)\"";
+#ifdef _WIN32
+    FILE* pipe = _popen(command.c_str(), "r");
+#else
+    FILE* pipe = popen(command.c_str(), "r");
+#endif
+    if (pipe == nullptr) {
+        return false;
+    }
+    char line[4096];
+    std::vector<std::string> lines;
+    while (fgets(line, sizeof(line), pipe) != nullptr) {
+        std::string text = line;
+        while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) {
+            text.pop_back();
+        }
+        lines.push_back(text);
+    }
+#ifdef _WIN32
+    _pclose(pipe);
+#else
+    pclose(pipe);
+#endif
+    if (lines.size() < 2) {
+        return false;
+    }
+    *executable = lines[0];
+    *prefix = lines[1];
+    return true;
+}
+
+// --- reporting -------------------------------------------------------------
+
+struct Result {
+    std::string path;
+    std::string mode;
+    std::string metric;
+    std::vector<double> values;
+};
+
+// Power-of-two microsecond buckets; the last one is open-ended.
+std::vector<std::pair<double, size_t>> Histogram(const std::vector<double>& milliseconds) {
+    std::vector<std::pair<double, size_t>> buckets;
+    for (double upper = 16; upper <= (1 << 24); upper *= 2) {
+        buckets.emplace_back(upper, 0);
+    }
+    for (double value : milliseconds) {
+        double microseconds = value * 1000;
+        size_t i = 0;
+        while (i + 1 < buckets.size() && microseconds > buckets[i].first) {
+            i++;
+        }
+        buckets[i].second++;
+    }
+    while (!buckets.empty() && buckets.back().second == 0) {
+        buckets.pop_back();
+    }
+    return buckets;
+}
+
+bool WriteCsv(const std::string& path, const std::string& label,
+              const std::vector<Result>& results) {
+    bool exists = std::ifstream(path).good();
+    std::ofstream out(path, std::ios::app);
+    if (!exists) {
+        out << "label,path,mode,metric,runs,p50_ms,p95_ms,p99_ms,min_ms,max_ms\n";
+    }
+    char line[512];
+    for (const Result& result : results) {
+        auto range = std::minmax_element(result.values.begin(), result.values.end());
+        snprintf(line, sizeof(line), "%s,%s,%s,%s,%zu,%.4f,%.4f,%.4f,%.4f,%.4f\n", label.c_str(),
+                 result.path.c_str(), result.mode.c_str(), result.metric.c_str(),
+                 result.values.size(), Percentile(result.values, 0.5),
+                 Percentile(result.values, 0.95), Percentile(result.values, 0.99), *range.first,
+                 *range.second);
+        out << line;
+    }
+    return static_cast<bool>(out);
+}
+
+bool WriteJson(const std::string& path, const std::string& label,
+               const std::vector<Result>& results) {
+    std::ofstream out(path, std::ios::trunc);
+    out << "{\n  \"label\": \"" << label << "\",\n  \"results\": [\n";
+    char number[64];
+    for (size_t r = 0; r < results.size(); r++) {
+        const Result& result = results[r];
+        out << "    {\"path\": \"" << result.path << "\", \"mode\": \"" << result.mode
+            << "\", \"metric\": \"" << result.metric << "\", \"runs\": " << result.values.size();
+        for (double fraction : {0.5, 0.95, 0.99}) {
+            snprintf(number, sizeof(number), "%.4f", Percentile(result.values, fraction));
+            out << ", \"p" << static_cast<int>(fraction * 100) << "_ms\": " << number;
+        }
+        out << ", \"histogram_us\": [";
+        std::vector<std::pair<double, size_t>> buckets = Histogram(result.values);
+        for (size_t b = 0; b < buckets.size(); b++) {
+            out << (b > 0 ? ", " : "") << "{\"le\": " << static_cast<long long>(buckets[b].first)
+                << ", \"count\": " << buckets[b].second << "}";
+        }
+        out << "]}" << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+// Compares p50s against the last matching rows of an earlier CSV and
+// returns how many regressed by more than `threshold`.
+int CompareWithBaseline(const std::string& path, double threshold,
+                        const std::vector<Result>& results) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot read baseline " << path << std::endl;
+        return 0;
+    }
+    std::map<std::string, double> baseline;
+    std::string line;
+    std::getline(in, line);  // header
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, ',')) {
+            fields.push_back(field);
+        }
+        if (fields.size() >= 6) {
+            baseline[fields[1] + "/" + fields[2] + "/" + fields[3]] = atof(fields[5].c_str());
+        }
+    }
+    int regressions = 0;
+    for (const Result& result : results) {
+        auto it = baseline.find(result.path + "/" + result.mode + "/" + result.metric);
+        double current = Percentile(result.values, 0.5);
+        if (it != baseline.end() && it->second > 0 && current > it->second * threshold) {
+            fprintf(stderr, "REGRESSION %s %s %s: p50 %.3f ms, baseline %.3f ms\n",
+                    result.path.c_str(), result.mode.c_str(), result.metric.c_str(), current,
+                    it->second);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int Probe() {
+    int64_t now = NowNanoseconds();
+    const char* path = getenv("LAUNCH_BENCH_TIMES");
+    if (path != nullptr) {
+        std::ofstream(path, std::ios::app) << "first " << now << "\n";
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    // Native probe: the child side of the native launch paths.
+    if (argc >= 2 && strcmp(argv[1], "--probe") == 0) {
+        return Probe();
+    }
+
+    int runs = 20;
+    int warmupRuns = 2;
+    std::vector<std::string> pathNames = {"main", "launch_container", "python_container",
+                                          "python_pool", "python_msix"};
+    std::vector<std::string> modes = {"cold", "warm"};
+    std::string python = "python3";
+    std::vector<std::string> readPaths;
+    std::vector<std::string> binDirs;
+    bool dropCaches = false;
+    std::string label;
+    std::string csvPath;
+    std::string jsonPath;
+    std::string baselinePath;
+    double threshold = 1.25;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "n") && hasValue) {
+            runs = atoi(argv[++i]);
+        } else if (IsFlag(arg, "warmup") && hasValue) {
+            warmupRuns = atoi(argv[++i]);
+        } else if (IsFlag(arg, "paths") && hasValue) {
+            pathNames = SplitList(argv[++i]);
+        } else if (IsFlag(arg, "modes") && hasValue) {
+            modes = SplitList(argv[++i]);
+        } else if (IsFlag(arg, "python") && hasValue) {
+            python = argv[++i];
+        } else if (IsFlag(arg, "read") && hasValue) {
+            readPaths.push_back(argv[++i]);
+        } else if (IsFlag(arg, "bin") && hasValue) {
+            binDirs.push_back(argv[++i]);
+        } else if (IsFlag(arg, "dropcaches")) {
+            dropCaches = true;
+        } else if (IsFlag(arg, "label") && hasValue) {
+            label = argv[++i];
+        } else if (IsFlag(arg, "csv") && hasValue) {
+            csvPath = argv[++i];
+        } else if (IsFlag(arg, "json") && hasValue) {
+            jsonPath = argv[++i];
+        } else if (IsFlag(arg, "baseline") && hasValue) {
+            baselinePath = argv[++i];
+        } else if (IsFlag(arg, "threshold") && hasValue) {
+            threshold = atof(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (runs <= 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::string self = SelfPath(argv[0]);
+    std::string benchDir = Directory(self);
+#ifdef _WIN32
+    if (binDirs.empty()) {
+        // bench\out, then where build-container.ps1, build-msix.ps1 and
+        // python-msix\build.ps1 put their executables.
+        std::string repo = Directory(Directory(benchDir));
+        binDirs = {benchDir, repo + "\\out", repo + "\\PackageFiles",
+                   repo + "\\python-msix\\out\\dist"};
+    }
+#endif
+    std::string probeScript = benchDir + "/launch_probe.py";
+#ifdef _WIN32
+    char tempDir[MAX_PATH];
+    GetTempPathA(MAX_PATH, tempDir);
+    std::string workDir = std::string(tempDir) + "launch_bench";
+    CreateDirectoryA(workDir.c_str(), NULL);
+#else
+    std::string workDir = "/tmp/launch_bench." + std::to_string(getpid());
+    mkdir(workDir.c_str(), 0700);
+#endif
+    TimesFile times(workDir + "/times.txt");
+    SetEnvironment("LAUNCH_BENCH_TIMES", times.Path());
+
+    std::string pythonExecutable;
+    std::string pythonPrefix;
+    if (!DescribePython(python, &pythonExecutable, &pythonPrefix)) {
+        std::cerr << "Cannot run " << python << "; Python paths are skipped." << std::endl;
+    }
+
+    sandbox::SandboxPolicy policy;
+    policy.name = "LaunchBench";
+#ifdef _WIN32
+    policy.readPaths.push_back(benchDir);
+#else
+    for (const char* path : {"/usr", "/lib", "/lib64", "/bin", "/etc"}) {
+        if (access(path, F_OK) == 0) {
+            policy.readPaths.push_back(path);
+        }
+    }
+    policy.readPaths.push_back(benchDir);
+#endif
+    if (!pythonPrefix.empty()) {
+        policy.readPaths.push_back(pythonPrefix);
+    }
+    policy.readPaths.insert(policy.readPaths.end(), readPaths.begin(), readPaths.end());
+    policy.writePaths.push_back(workDir);
+
+    std::vector<std::string> nativeProbe = {self, "--probe"};
+    std::vector<std::string> pythonProbe = {pythonExecutable, probeScript};
+    std::vector<std::unique_ptr<LaunchPath>> paths;
+    for (const std::string& name : pathNames) {
+        bool needsPython = name.compare(0, 7, "python_") == 0;
+        if (needsPython && pythonExecutable.empty()) {
+            continue;
+        }
+#ifdef _WIN32
+        // launch_container.exe's AppContainer gets no grants, so its probe
+        // cannot record a first time; the unsandboxed probe it starts after
+        // it does. python_container.exe is granted workDir for the probes'
+        // timestamps, and the /read directories.
+        std::vector<std::string> containerDirs = {workDir};
+        containerDirs.insert(containerDirs.end(), readPaths.begin(), readPaths.end());
+        if (name == "main") {
+            paths.emplace_back(new PlainPath(
+                name, {FindExecutable(binDirs, "hello-msix.exe"), "/nowait", benchDir}));
+        } else if (name == "launch_container") {
+            paths.emplace_back(new PlainPath(
+                name, {FindExecutable(binDirs, "launch_container.exe"), CommandLine(nativeProbe)}));
+        } else if (name == "python_container") {
+            std::vector<std::string> command = {FindExecutable(binDirs, "python_container.exe"),
+                                                pythonExecutable, probeScript};
+            command.insert(command.end(), containerDirs.begin(), containerDirs.end());
+            paths.emplace_back(new PlainPath(name, command));
+        } else if (name == "python_pool") {
+            std::vector<std::string> command = {FindExecutable(binDirs, "python_container.exe"),
+                                                "--pool", "1", pythonExecutable,
+                                                benchDir + "\\python_worker.py", benchDir};
+            command.insert(command.end(), containerDirs.begin(), containerDirs.end());
+            paths.emplace_back(new ContainerPoolPath(name, command, probeScript));
+        } else if (name == "python_msix") {
+            paths.emplace_back(new PlainPath(name, {FindExecutable(binDirs, "launch.exe"),
+                                                    "--command", CommandLine(pythonProbe)}));
+        } else {
+            std::cerr << "Unknown launch path " << name << std::endl;
+            return 1;
+        }
+#else
+        if (name == "main") {
+            paths.emplace_back(new PlainPath(name, nativeProbe));
+        } else if (name == "launch_container") {
+            paths.emplace_back(new SandboxedPath(name, nativeProbe, policy));
+        } else if (name == "python_container") {
+            paths.emplace_back(new SandboxedPath(name, pythonProbe, policy));
+        } else if (name == "python_pool") {
+            sandbox::WorkerPoolOptions options;
+            options.python = pythonExecutable;
+            options.workerScript = benchDir + "/python_worker.py";
+            options.workers = 1;
+            paths.emplace_back(new PoolPath(name, options, policy, probeScript));
+        } else if (name == "python_msix") {
+            paths.emplace_back(new PlainPath(name, pythonProbe));
+        } else {
+            std::cerr << "Unknown launch path " << name << std::endl;
+            return 1;
+        }
+#endif
+    }
+
+    std::vector<Result> results;
+    for (const std::unique_ptr<LaunchPath>& path : paths) {
+        for (const std::string& mode : modes) {
+            bool cold = mode == "cold";
+            if (!cold && mode != "warm") {
+                std::cerr << "Unknown mode " << mode << std::endl;
+                return 1;
+            }
+            std::string error;
+            if (!cold) {
+                if (!path->Setup(&error)) {
+                    std::cerr << path->Name() << ": " << error << std::endl;
+                    return 1;
+                }
+                for (int i = 0; i < warmupRuns; i++) {
+                    Sample ignored;
+                    times.Reset();
+                    if (!path->Launch(NowNanoseconds(), &ignored, &error)) {
+                        std::cerr << path->Name() << ": " << error << std::endl;
+                        return 1;
+                    }
+                }
+            }
+            std::vector<Sample> samples;
+            for (int run = 0; run < runs; run++) {
+                if (cold) {
+                    path->Teardown();
+                    if (dropCaches) {
+                        DropPageCache();
+                    }
+                }
+                times.Reset();
+                Sample sample;
+                int64_t start = NowNanoseconds();
+                if ((cold && !path->Setup(&error)) || !path->Launch(start, &sample, &error)) {
+                    std::cerr << path->Name() << ": " << error << std::endl;
+                    return 1;
+                }
+                times.Read(start, &sample);
+                samples.push_back(sample);
+            }
+            path->Teardown();
+
+            for (int metric = 0; metric < kMetricCount; metric++) {
+                Result result;
+                result.path = path->Name();
+                result.mode = mode;
+                result.metric = kMetrics[metric];
+                for (const Sample& sample : samples) {
+                    if (sample.values[metric] >= 0) {
+                        result.values.push_back(sample.values[metric]);
+                    }
+                }
+                if (!result.values.empty()) {
+                    results.push_back(std::move(result));
+                }
+            }
+        }
+    }
+
+    fprintf(stderr, "%d runs per path and mode; ms after launch start\n", runs);
+    fprintf(stderr, "%-18s %-5s %-7s %9s %9s %9s\n", "path", "mode", "metric", "p50", "p95",
+            "p99");
+    for (const Result& result : results) {
+        fprintf(stderr, "%-18s %-5s %-7s %9.3f %9.3f %9.3f\n", result.path.c_str(),
+                result.mode.c_str(), result.metric.c_str(), Percentile(result.values, 0.5),
+                Percentile(result.values, 0.95), Percentile(result.values, 0.99));
+    }
+
+    // Compare before appending, so the baseline may be the CSV history itself.
+    int exitCode = 0;
+    if (!baselinePath.empty() && CompareWithBaseline(baselinePath, threshold, results) > 0) {
+        exitCode = 2;
+    }
+    if (!csvPath.empty() && !WriteCsv(csvPath, label, results)) {
+        std::cerr << "Failed to write " << csvPath << std::endl;
+        exitCode = 1;
+    }
+    if (!jsonPath.empty() && !WriteJson(jsonPath, label, results)) {
+        std::cerr << "Failed to write " << jsonPath << std::endl;
+        exitCode = 1;
+    }
+    std::remove(times.Path().c_str());
+#ifdef _WIN32
+    RemoveDirectoryA(workDir.c_str());
+#else
+    rmdir(workDir.c_str());
+#endif
+    return exitCode;
+}
@@ -0,0 +1,14 @@
+"""Python side of launch_bench: records when user code reaches its first import.
+
+The timestamp is time.perf_counter_ns(), which reads the same clock as the
+harness's std::chrono::steady_clock (CLOCK_MONOTONIC on Linux, QPC on
+Windows), so the harness can subtract its own launch start from it.
+"""
+import os
+import time
+
+_reached = time.perf_counter_ns()
+import json  # noqa: E402,F401 - the first real import a typical script does
+
+with open(os.environ["LAUNCH_BENCH_TIMES"], "a") as f:
+    f.write(f"import {_reached}\n")
@@ -0,0 +1,30 @@
+# Per-commit startup check: builds and runs launch_bench, appends the results
+# to out/launch_history.csv labelled with the current commit, and fails when
+# a p50 regressed against the previous entry in that history.
+param(
+    [int]$Runs = 20,
+    [double]$Threshold = 1.25
+)
+
+$scriptDir = Split-Path -Path $MyInvocation.MyCommand.Path
+$outDir = Join-Path -Path $scriptDir -ChildPath "out"
+
+& (Join-Path $scriptDir "build.ps1")
+if ($LASTEXITCODE -ne 0) {
+    exit $LASTEXITCODE
+}
+
+$commit = (& git -C $scriptDir rev-parse --short HEAD 2>$null)
+if (-not $commit) {
+    $commit = "unknown"
+}
+$exeSuffix = if ($IsLinux -or $IsMacOS) { "" } else { ".exe" }
+$history = Join-Path $outDir "launch_history.csv"
+$arguments = @("/n", $Runs, "/label", $commit, "/csv", $history,
+               "/json", (Join-Path $outDir "launch_bench.json"))
+if (Test-Path $history) {
+    $arguments += @("/baseline", $history, "/threshold", $Threshold)
+}
+
+& (Join-Path $outDir "launch_bench$exeSuffix") @arguments
+exit $LASTEXITCODE
@@ -4,6 +4,10 @@
 $PackageDir = "ignore/ComfyPackage"
 $OutputFile = "ComfyPackage.msix"
 $CertName = "dproy-cert"
+# Multithreaded replacement for MakeAppx, used when msix\build.ps1 has been run
+$MsixPack = Join-Path $PSScriptRoot "msix\out\msixpack.exe"
+# Encoded files from earlier builds, so a manifest bump doesn't recompress the venv
+$PackCacheDir = "ignore/ComfyPackage.packcache"
 $ManifestFile = Join-Path $PackageDir "AppxManifest.xml"
 $TopLevelManifest = "ComfyAppxManifest.xml"
 
@@ -57,7 +61,11 @@ Write-Host "Building MSIX package..." -ForegroundColor Green
 
 try {
     # Create the MSIX package
-    & MakeAppx.exe pack /d $PackageDir /p $OutputFile /o
+    if (Test-Path $MsixPack) {
+        & $MsixPack pack /d $PackageDir /p $OutputFile /o /cache $PackCacheDir
+    } else {
+        & MakeAppx.exe pack /d $PackageDir /p $OutputFile /o
+    }
     if ($LASTEXITCODE -ne 0) {
         Write-Error "MakeAppx failed with exit code $LASTEXITCODE"
         exit $LASTEXITCODE
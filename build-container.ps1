@@ -11,13 +11,29 @@ Write-Host "Compiling AppContainer test programs..." -ForegroundColor Green
 # Create output directory if it doesn't exist
 New-Item -ItemType Directory -Force -Path "out" | Out-Null
 
+# Shared sources linked into the programs that use them
+$ExtraSources = @{
+    "launch_container.cc" = @("sandbox/launcher.cc", "sandbox/runtime_env.cc", "sandbox/grant_plan.cc", "sandbox/grant_backend.cc", "sandbox/resource_group.cc", "sandbox/trace.cc")
+    "python_container.cc" = @("sandbox/worker_pool.cc", "sandbox/launcher.cc", "sandbox/output_relay.cc", "sandbox/runtime_env.cc", "sandbox/grant_plan.cc", "sandbox/grant_backend.cc", "sandbox/job_scheduler.cc", "sandbox/supervisor.cc", "sandbox/resource_group.cc", "sandbox/trace.cc")
+}
+
+# $env:SANDBOX_TRACE builds in launch tracing (--trace, see sandbox/trace.h)
+$TraceFlags = @()
+if ($env:SANDBOX_TRACE) {
+    $TraceFlags = @("-DSANDBOX_TRACE")
+}
+
 # Compile each source file
 foreach ($SourceFile in $SourceFiles) {
     $OutputFile = "out/$([System.IO.Path]::GetFileNameWithoutExtension($SourceFile)).exe"
     Write-Host "Compiling $SourceFile..." -ForegroundColor Yellow
+    $Extra = @()
+    if ($ExtraSources.ContainsKey($SourceFile)) {
+        $Extra = $ExtraSources[$SourceFile]
+    }
     
     # Compile with clang++
-    & clang++ -std=c++17 -g $SourceFile -o $OutputFile -luserenv -ladvapi32
+    & clang++ -std=c++17 -g @TraceFlags $SourceFile @Extra -o $OutputFile -luserenv -ladvapi32 -lws2_32 -lpsapi
 
     if ($LASTEXITCODE -ne 0) {
         Write-Error "Compilation of $SourceFile failed with exit code $LASTEXITCODE"
@@ -27,4 +43,9 @@ foreach ($SourceFile in $SourceFiles) {
     Write-Host "Successfully compiled to $OutputFile" -ForegroundColor Green
 }
 
+# The pool mode of python_container.exe starts this script in each worker
+Copy-Item -Path "sandbox/python_worker.py" -Destination "out/" -Force
+# A traced python_container.exe puts this import hook on PYTHONPATH
+Copy-Item -Path "sandbox/trace_hook" -Destination "out/" -Recurse -Force
+
 Write-Host "All compilations completed successfully." -ForegroundColor Green 
\ No newline at end of file
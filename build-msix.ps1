@@ -4,6 +4,8 @@
 $PackageDir = "PackageFiles"
 $OutputFile = "HelloMSIX.msix"
 $CertName = "dproy-cert"
+# Multithreaded replacement for MakeAppx, used when msix\build.ps1 has been run
+$MsixPack = Join-Path $PSScriptRoot "msix\out\msixpack.exe"
 $ManifestFile = Join-Path $PackageDir "AppxManifest.xml"
 
 # Function to increment version number
@@ -45,7 +47,13 @@ if ($manifestContent -match '<Identity[^>]*Version="([^"]+)"') {
 
 Write-Host "Compiling C++ application..." -ForegroundColor Green
 # Compile the C++ application
-& clang++ -std=c++17 -g .\main.cpp -o "$PackageDir\hello-msix.exe" -lShell32 -ladvapi32
+# $env:SANDBOX_TRACE builds in launch tracing (sandbox\trace.h); the
+# listing then joins the trace of a traced launcher that starts it.
+$TraceFlags = @()
+if ($env:SANDBOX_TRACE) {
+    $TraceFlags = @("-DSANDBOX_TRACE")
+}
+& clang++ -std=c++17 -g @TraceFlags .\main.cpp .\sandbox\dir_scan.cc .\sandbox\runtime_env.cc .\sandbox\trace.cc -o "$PackageDir\hello-msix.exe" -lShell32 -ladvapi32
 if ($LASTEXITCODE -ne 0) {
     Write-Error "C++ compilation failed with exit code $LASTEXITCODE"
     exit $LASTEXITCODE
@@ -56,7 +64,11 @@ Write-Host "Building MSIX package..." -ForegroundColor Green
 
 try {
     # Create the MSIX package
-    & MakeAppx.exe pack /d $PackageDir /p $OutputFile /o
+    if (Test-Path $MsixPack) {
+        & $MsixPack pack /d $PackageDir /p $OutputFile /o
+    } else {
+        & MakeAppx.exe pack /d $PackageDir /p $OutputFile /o
+    }
     if ($LASTEXITCODE -ne 0) {
         Write-Error "MakeAppx failed with exit code $LASTEXITCODE"
         exit $LASTEXITCODE
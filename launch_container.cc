@@ -1,12 +1,20 @@
 #include <windows.h>
 #include <stdio.h>
+#include <string.h>
 #include <tchar.h>
 #include <userenv.h>
 #include <sddl.h>
 #include <iostream>
+#include <memory>
+#include <string>
+
+#include "sandbox/launcher.h"
+#include "sandbox/resource_group.h"
+#include "sandbox/trace.h"
 
 // Function to get the SID for a specific AppContainer
 BOOL GetSpecificAppContainerSid(LPCWSTR containerName, PSID* ppsid) {
+  TRACE_SPAN("AppContainer SID");
   HRESULT hr;
   LPCWSTR displayName = L"My App Container";
   
@@ -83,107 +91,70 @@ HANDLE GetAccessToken() {
   return hToken;
 }
 
-HANDLE CreateAppContainerToken(HANDLE primaryToken, PSID pAppContainerSid) {
-  HANDLE hToken = nullptr;
-  // SecurityImpersonation: I want to create a new process with this token. 
-  // https://learn.microsoft.com/en-us/windows/win32/api/winnt/ne-winnt-security_impersonation_level
-  // TokenPrimary: The new token will be a primary token for the new process.
-  // TOKEN_ALL_ACCESS: Probably can have less access but we're going to make a bunch of
-  // changes to this token so let's just grab everything for this POC.
-  if (!DuplicateTokenEx(
-          /*hExistingToken HANDLE*/ primaryToken,
-          /*dwDesiredAccess DWORD*/ TOKEN_ALL_ACCESS,
-          /*lpTokenAttributes LPSECURITY_ATTRIBUTES*/ nullptr,
-          /*ImpersonationLevel SECURITY_IMPERSONATION_LEVEL*/ SecurityImpersonation,
-          /*TokenType TOKEN_TYPE*/ TokenPrimary,
-          /*phNewToken PHANDLE*/ &hToken)) {
-    printf("Failed to duplicate token.\n");
-    PrintLastError();
-    exit(1);
+// The launcher prepares the AppContainer (SID, capabilities, attribute list)
+// once; each launch is then a single CreateProcessW with no token to
+// duplicate. With limits the process starts inside a Job Object of its own
+// and is waited for, so the job's accounting covers its whole run.
+BOOL CreateAppContainerProcess(sandbox::SandboxLauncher& launcher, LPSTR lpCommandLine,
+                               const sandbox::ResourceLimits* limits) {
+  int length = MultiByteToWideChar(CP_ACP, 0, lpCommandLine, -1, nullptr, 0);
+  sandbox::LaunchCommand command;
+  command.commandLine.resize(length > 0 ? length - 1 : 0);
+  MultiByteToWideChar(CP_ACP, 0, lpCommandLine, -1, &command.commandLine[0], length);
+
+  std::string error;
+  std::unique_ptr<sandbox::ResourceGroup> group;
+  if (limits != nullptr) {
+    group = sandbox::ResourceGroup::Create("container", *limits, std::string(), &error);
+    if (!group) {
+      printf("Failed to set up resource limits: %s\n", error.c_str());
+      return FALSE;
+    }
+    for (const std::string& reason : group->Unapplied()) {
+      printf("Limit not applied: %s\n", reason.c_str());
+    }
+    group->Attach(&command);
   }
 
-  return hToken;
-} 
-
-BOOL CreateAppContainerProcess(HANDLE hToken, PSID pAppContainerSid, LPSTR lpCommandLine) {
-  // Set up the security capabilities
-  SECURITY_CAPABILITIES secCaps = {};
-  secCaps.AppContainerSid = pAppContainerSid;
-  secCaps.Capabilities = nullptr;
-  secCaps.CapabilityCount = 0;
-
-  // Set it on StartupInfo
-  STARTUPINFOEX siEx{};
-  siEx.StartupInfo.cb = sizeof(siEx);
-
-  SIZE_T attributeListSize;
-  InitializeProcThreadAttributeList(
-      /*lpAttributeList LPPROC_THREAD_ATTRIBUTE_LIST*/ nullptr,
-      /*dwAttributeCount DWORD*/ 1,
-      /*dwFlags DWORD*/ 0,
-      /*lpSize PSIZE_T*/ &attributeListSize
-  );
-
-  siEx.lpAttributeList = (LPPROC_THREAD_ATTRIBUTE_LIST)HeapAlloc(
-      /*hHeap HANDLE*/ GetProcessHeap(),
-      /*dwFlags DWORD*/ 0,
-      /*dwBytes SIZE_T*/ attributeListSize
-  );
-
-  if (!siEx.lpAttributeList) {
-    printf("Failed to allocate attribute list.\n");
-    exit(1);
+  // Print the command line
+  printf("Command line: %s\n", lpCommandLine);
+  sandbox::LaunchedProcess process;
+  if (!launcher.Spawn(command, &process, &error)) {
+    printf("Failed to create process: %s\n", error.c_str());
+    return FALSE;
   }
-
-  if (!InitializeProcThreadAttributeList(
-      /*lpAttributeList LPPROC_THREAD_ATTRIBUTE_LIST*/ siEx.lpAttributeList,
-      /*dwAttributeCount DWORD*/ 1,
-      /*dwFlags DWORD*/ 0,
-      /*lpSize PSIZE_T*/ &attributeListSize
-  )) {
-    printf("Failed to initialize attribute list.\n");
-    exit(1);
+  if (!group) {
+    CloseHandle(process.process);
+    return TRUE;
   }
 
-  if (!UpdateProcThreadAttribute(
-      /*lpAttributeList LPPROC_THREAD_ATTRIBUTE_LIST*/ siEx.lpAttributeList,
-      /*dwFlags DWORD*/ 0,
-      /*Attribute DWORD*/ PROC_THREAD_ATTRIBUTE_SECURITY_CAPABILITIES,
-      /*lpValue PVOID*/ &secCaps,
-      /*cbSize SIZE_T*/ sizeof(secCaps),
-      nullptr, nullptr)) {
-    printf("Failed to update attribute list.\n");
-    exit(1);
-  } 
-
-  PROCESS_INFORMATION pi;
-  // Print the command line
-  printf("Command line: %s\n", lpCommandLine);
-  if (!CreateProcessAsUser(
-      /*hToken HANDLE*/ hToken,
-      /*lpApplicationName LPCTSTR*/ nullptr,
-      /*lpCommandLine LPSTR*/ lpCommandLine,
-      /*lpProcessAttributes LPSECURITY_ATTRIBUTES*/ nullptr,
-      /*lpThreadAttributes LPSECURITY_ATTRIBUTES*/ nullptr,
-      /*bInheritHandles BOOL*/ FALSE,
-      /*dwCreationFlags DWORD*/ EXTENDED_STARTUPINFO_PRESENT,
-      /*lpEnvironment LPVOID*/ nullptr,
-      /*lpCurrentDirectory LPCTSTR*/ nullptr,
-      /*lpStartupInfo LPSTARTUPINFO*/ &siEx.StartupInfo,
-      /*lpProcessInformation LPPROCESS_INFORMATION*/ &pi)) {
-    printf("Failed to create process.\n");
-    PrintLastError();
+  TRACE_SPAN("Wait for container");
+  int exitCode = 0;
+  sandbox::ResourceUsage usage;
+  if (!launcher.Wait(&process, &exitCode, &error) || !group->ReadUsage(&usage, &error)) {
+    printf("%s\n", error.c_str());
     return FALSE;
   }
-  printf("AppContainer Token: %p\n", hToken);
-  PrintTokenInformation(hToken);
-  
+  printf("Exit code %d, %s\n", exitCode, sandbox::FormatResourceUsage(usage).c_str());
   return TRUE;
 }
 
 
 int _tmain( int argc, TCHAR *argv[] )
 {
+  // [--trace <file.json>] writes a Chrome trace of the launch
+  // (sandbox/trace.h; needs a -DSANDBOX_TRACE build).
+  if (argc >= 3 && strcmp(argv[1], "--trace") == 0) {
+    std::string error;
+    if (!sandbox::StartTrace(argv[2], &error)) {
+      printf("%s\n", error.c_str());
+      return 1;
+    }
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  }
+
   PSID pAppContainerSid = nullptr;
   if (!GetSpecificAppContainerSid(L"My App Container", &pAppContainerSid)) {
     printf("Failed to get AppContainer SID.\n");
@@ -199,7 +170,17 @@ int _tmain( int argc, TCHAR *argv[] )
   printf("AppContainer SID: %s\n", pszAppContainerSid);
 
   HANDLE hToken = GetAccessToken();    
-  HANDLE hAppContainerToken = CreateAppContainerToken(hToken, pAppContainerSid);
+  CloseHandle(hToken);
+
+  sandbox::SandboxPolicy policy;
+  policy.name = "My App Container";
+  std::string error;
+  std::unique_ptr<sandbox::SandboxLauncher> launcher =
+      sandbox::SandboxLauncher::Create(policy, &error);
+  if (!launcher) {
+    printf("Failed to set up the AppContainer: %s\n", error.c_str());
+    return 1;
+  }
 
   STARTUPINFO si;
   PROCESS_INFORMATION pi;
@@ -208,13 +189,29 @@ int _tmain( int argc, TCHAR *argv[] )
   si.cb = sizeof(si);
   ZeroMemory( &pi, sizeof(pi) );
 
+  // [--limits <list>] takes the limits of resource_group.h, e.g.
+  // memory=2G,cpu=1,pids=64; the launch fails when one cannot be applied,
+  // unless the list includes besteffort.
+  sandbox::ResourceLimits limits;
+  bool limited = false;
+  if (argc == 4 && strcmp(argv[1], "--limits") == 0) {
+    if (!sandbox::ParseResourceLimits(argv[2], &limits, &error)) {
+      printf("%s\n", error.c_str());
+      return 1;
+    }
+    limited = true;
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+  }
+
   if( argc != 2 )
   {
-    printf("Usage: %s [cmdline]\n", argv[0]);
+    printf("Usage: %s [--trace <file.json>] [--limits <list>] [cmdline]\n", argv[0]);
     return 1;
   }
 
-  if (!CreateAppContainerProcess(hAppContainerToken, pAppContainerSid, argv[1])) {
+  if (!CreateAppContainerProcess(*launcher, argv[1], limited ? &limits : nullptr)) {
     printf("Failed to create app container process.\n");
     // return 1;
   } else {
@@ -224,6 +221,7 @@ int _tmain( int argc, TCHAR *argv[] )
   // Start the child process.
   // Print the command line
   printf("Command line: %s\n", argv[1]);
+  TRACE_SPAN("Unsandboxed process");
   if( !CreateProcess( NULL,   // No module name (use command line)
     argv[1],        // Command line
     NULL,           // Process handle not inheritable
@@ -3,69 +3,60 @@
 #include <string>
 #include <thread>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <windows.h>
-#include <appmodel.h>
-#include <shlobj.h>
+
+#include "sandbox/dir_scan.h"
+#include "sandbox/runtime_env.h"
+#include "sandbox/trace.h"
 
 namespace fs = std::filesystem;
 
+// Both checks read the cached runtime environment descriptor: the one the
+// launcher passed down if there is one, otherwise a single probe of package
+// identity and the token.
 bool IsRunningAsUwp() {
-    // Method 1: Check if GetCurrentPackageFullName is available and returns a package name
-    UINT32 length = 0;
-    LONG result = GetCurrentPackageFullName(&length, nullptr);
-    
-    if (result == APPMODEL_ERROR_NO_PACKAGE) {
-        return false;  // Not running as UWP/Desktop Bridge
-    }
-    
-    // Method 2: Check for UWP-specific environment variable
-    char* uwpPath = nullptr;
-    size_t pathSize;
-    _dupenv_s(&uwpPath, &pathSize, "PACKAGE_FAMILY_NAME");
-    if (uwpPath != nullptr) {
-        free(uwpPath);
-        return true;
-    }
-
-    // Method 3: Check for Windows Apps directory
-    wchar_t programFilesPath[MAX_PATH];
-    if (SUCCEEDED(SHGetFolderPathW(nullptr, CSIDL_PROGRAM_FILES | CSIDL_FLAG_CREATE,
-                                  nullptr, 0, programFilesPath))) {
-        std::wstring windowsAppsPath = std::wstring(programFilesPath) + L"\\WindowsApps";
-        if (GetFileAttributesW(windowsAppsPath.c_str()) != INVALID_FILE_ATTRIBUTES) {
-            return true;
-        }
-    }
-
-    return false;
+    TRACE_SPAN("Runtime environment");
+    return sandbox::CurrentEnvironment().Has(sandbox::kEnvPackaged);
 }
 
 bool IsRunningAsAppContainer() {
-    HANDLE tokenHandle{};
-    DWORD isAppContainer{};
-    DWORD tokenInformationLength{ sizeof(DWORD) };
-    if (!::OpenProcessToken(
-        GetCurrentProcess(),
-        TOKEN_QUERY,
-        &tokenHandle)) {
-        return false;
-    }
-
-    if (!::GetTokenInformation(
-        tokenHandle,
-        TOKEN_INFORMATION_CLASS::TokenIsAppContainer,
-        &isAppContainer,
-        tokenInformationLength,
-        &tokenInformationLength
-    )) {
-        return false;
-    }
+    return sandbox::CurrentEnvironment().Has(sandbox::kEnvAppContainer);
+}
 
-    return isAppContainer != 0;
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
 }
 
+// Usage: hello-msix [directory] [/depth n] [/filter glob] [/json] [/j threads]
+//                   [/nowait]
+// Without /depth only the directory itself is listed, as before. /nowait
+// skips the closing pause, so launch_bench can time the run to its exit.
+// Started by a traced launcher (sandbox/trace.h), the listing joins the
+// launch trace.
+int main(int argc, char* argv[]) {    
+    sandbox::ScanOptions options;
+    options.maxDepth = 0;
+    std::string directory;
+    bool wait = true;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(argv[i], "depth") && hasValue) {
+            options.maxDepth = atoi(argv[++i]);
+        } else if (IsFlag(argv[i], "filter") && hasValue) {
+            options.filter = argv[++i];
+        } else if (IsFlag(argv[i], "json")) {
+            options.json = true;
+        } else if (IsFlag(argv[i], "j") && hasValue) {
+            options.threads = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(argv[i], "nowait")) {
+            wait = false;
+        } else {
+            directory = argv[i];
+        }
+    }
 
-int main() {    
     if (IsRunningAsUwp()) {
         std::cout << "Application is running as Desktop Bridge/UWP" << std::endl;
     } else {
@@ -78,9 +69,10 @@ int main() {
         std::cout << "Application is running as classic Win32" << std::endl;
     }
     
-    std::string directory;
-    std::cout << "Enter directory path: ";
-    std::getline(std::cin, directory);
+    if (directory.empty()) {
+        std::cout << "Enter directory path: ";
+        std::getline(std::cin, directory);
+    }
     std::cout << "Attempting to access: " << directory << std::endl;
 
     // Print out the absolute path we're trying to access
@@ -113,19 +105,31 @@ int main() {
 
     std::cout << "Directory exists." << std::endl;
 
-    // List all files in the specified directory
-    std::cout << "\nListing contents of " << directory << ":\n";
+    // List the specified directory; subdirectories we are denied show up as
+    // "!denied" lines instead of ending the walk.
+    std::cout << "\nListing contents of " << directory << ":\n" << std::flush;
 
-    for (const auto& entry : fs::directory_iterator(directory)) {
-        std::cout << entry.path().filename().string();
-        if (entry.is_directory()) {
-            std::cout << "/";
-        }
-        std::cout << std::endl;
+    sandbox::ScanStats stats;
+    std::string error;
+    bool scanned;
+    {
+        TRACE_SPAN("Scan directory");
+        scanned = sandbox::ScanTree(directory, options, stdout, &stats, &error);
+    }
+    if (!scanned) {
+        std::cout << error << std::endl;
+        std::cin.get();
+        return 1;
+    }
+    fflush(stdout);
+    std::cout << "\n" << stats.directories << " directories, " << stats.entries << " entries, "
+              << stats.denied << " denied, " << stats.errors << " errors in " << stats.seconds
+              << " s" << std::endl;
+
+    if (wait) {
+        std::cout << "\nWaiting for 3 seconds..." << std::endl;
+        std::this_thread::sleep_for(std::chrono::seconds(3));
     }
-
-    std::cout << "\nWaiting for 3 seconds..." << std::endl;
-    std::this_thread::sleep_for(std::chrono::seconds(3));
     
     return 0;
 } 
\ No newline at end of file
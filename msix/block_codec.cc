@@ -0,0 +1,101 @@
+#include "block_codec.h"
+
+#include <zlib.h>
+
+namespace msix {
+
+namespace {
+
+// One deflate state per worker thread, reset between blocks instead of
+// paying deflateInit's allocations for every 64 KB.
+struct DeflateContext {
+    z_stream stream = {};
+    int level = 0;
+    bool initialized = false;
+
+    ~DeflateContext() {
+        if (initialized) {
+            deflateEnd(&stream);
+        }
+    }
+
+    bool Prepare(int wantedLevel) {
+        if (initialized && level == wantedLevel) {
+            return deflateReset(&stream) == Z_OK;
+        }
+        if (initialized) {
+            deflateEnd(&stream);
+            initialized = false;
+        }
+        stream = {};
+        if (deflateInit2(&stream, wantedLevel, Z_DEFLATED, -MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            return false;
+        }
+        level = wantedLevel;
+        initialized = true;
+        return true;
+    }
+};
+
+}  // namespace
+
+EncodedBlock EncodeBlock(const uint8_t* dictionary, size_t dictionaryLength,
+                         const uint8_t* block, size_t blockLength,
+                         bool compress, bool lastBlock, int level) {
+    EncodedBlock result;
+    result.size = static_cast<uint32_t>(blockLength);
+    result.hash = Sha256Hash(block, blockLength);
+    result.crc = static_cast<uint32_t>(crc32(0L, block, static_cast<uInt>(blockLength)));
+
+    if (!compress) {
+        result.data.assign(block, block + blockLength);
+        result.ok = true;
+        return result;
+    }
+
+    thread_local DeflateContext context;
+    if (!context.Prepare(level)) {
+        return result;
+    }
+    z_stream& stream = context.stream;
+
+    if (dictionaryLength > 0 &&
+        deflateSetDictionary(&stream, dictionary, static_cast<uInt>(dictionaryLength)) != Z_OK) {
+        return result;
+    }
+
+    // Room for the worst case plus the empty stored block a sync flush emits.
+    result.data.resize(deflateBound(&stream, static_cast<uLong>(blockLength)) + 16);
+    stream.next_in = const_cast<Bytef*>(block);
+    stream.avail_in = static_cast<uInt>(blockLength);
+    stream.next_out = result.data.data();
+    stream.avail_out = static_cast<uInt>(result.data.size());
+
+    int flush = lastBlock ? Z_FINISH : Z_SYNC_FLUSH;
+    for (;;) {
+        int status = deflate(&stream, flush);
+        if (status == Z_STREAM_ERROR) {
+            return result;
+        }
+        bool done = lastBlock ? status == Z_STREAM_END
+                              : (stream.avail_in == 0 && stream.avail_out > 0);
+        if (done) {
+            break;
+        }
+        size_t used = result.data.size() - stream.avail_out;
+        result.data.resize(result.data.size() * 2);
+        stream.next_out = result.data.data() + used;
+        stream.avail_out = static_cast<uInt>(result.data.size() - used);
+    }
+    result.data.resize(result.data.size() - stream.avail_out);
+    result.ok = true;
+    return result;
+}
+
+uint32_t CombineCrc(uint32_t crc, uint32_t nextCrc, uint64_t nextLength) {
+    return static_cast<uint32_t>(
+        crc32_combine(crc, nextCrc, static_cast<z_off_t>(nextLength)));
+}
+
+}  // namespace msix
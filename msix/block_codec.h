@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "sha256.h"
+
+namespace msix {
+
+// Deflate window. A block is primed with this much of the data that precedes
+// it so parallel compression loses almost nothing against a serial stream.
+constexpr size_t kDictionarySize = 32 * 1024;
+
+struct EncodedBlock {
+    std::vector<uint8_t> data;  // bytes as they appear in the archive
+    Sha256Digest hash;          // over the uncompressed block
+    uint32_t crc = 0;           // CRC-32 of the uncompressed block
+    uint32_t size = 0;          // uncompressed length
+    bool ok = false;
+};
+
+// Encodes one 64 KB block of a file, pigz-style: the block is deflated as a
+// raw stream primed with the preceding dictionary bytes and ended with a sync
+// flush, or with Z_FINISH when it is the file's last block. Concatenating the
+// blocks of a file in order yields a single valid deflate stream. When
+// compress is false the block is copied verbatim (stored entries).
+EncodedBlock EncodeBlock(const uint8_t* dictionary, size_t dictionaryLength,
+                         const uint8_t* block, size_t blockLength,
+                         bool compress, bool lastBlock, int level);
+
+// Folds the CRC of a following block into a running CRC.
+uint32_t CombineCrc(uint32_t crc, uint32_t nextCrc, uint64_t nextLength);
+
+}  // namespace msix
@@ -0,0 +1,346 @@
+#include "block_map.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace msix {
+
+namespace {
+
+void AppendXmlEscaped(std::string& out, const std::string& text) {
+    for (char c : text) {
+        switch (c) {
+            case '&': out += "&amp;"; break;
+            case '<': out += "&lt;"; break;
+            case '>': out += "&gt;"; break;
+            case '"': out += "&quot;"; break;
+            case '\'': out += "&apos;"; break;
+            default: out += c; break;
+        }
+    }
+}
+
+// Minimal reader for the flat element structure of a block map: finds the
+// next "<Tag" start and collects its attributes, unescaping the standard
+// XML entities.
+class TagScanner {
+public:
+    TagScanner(const char* xml, size_t length) : p_(xml), end_(xml + length) {}
+
+    // Advances to the next element named File, Block or the closing
+    // </File>. Returns false at the end of the document.
+    bool Next(std::string* tag) {
+        for (;;) {
+            const char* open = static_cast<const char*>(memchr(p_, '<', end_ - p_));
+            if (open == nullptr) {
+                return false;
+            }
+            tagStart_ = open;
+            p_ = open + 1;
+            const char* nameEnd = p_;
+            while (nameEnd < end_ && *nameEnd != ' ' && *nameEnd != '>' && *nameEnd != '/' &&
+                   *nameEnd != '\t' && *nameEnd != '\r' && *nameEnd != '\n') {
+                nameEnd++;
+            }
+            if (p_ < end_ && *p_ == '/') {
+                nameEnd = p_ + 1;
+                while (nameEnd < end_ && *nameEnd != '>') {
+                    nameEnd++;
+                }
+            }
+            std::string name(p_, nameEnd);
+            // Drop any namespace prefix.
+            size_t colon = name.find(':');
+            if (colon != std::string::npos) {
+                name = (name[0] == '/' ? "/" : "") + name.substr(colon + 1);
+            }
+            p_ = nameEnd;
+            if (name == "File" || name == "Block" || name == "/File") {
+                *tag = name;
+                return true;
+            }
+        }
+    }
+
+    // Start of the current tag, and the position just past whatever has been
+    // read of it.
+    const char* TagStart() const { return tagStart_; }
+    const char* Position() const { return p_; }
+
+    // Reads attributes up to the end of the current tag.
+    bool Attributes(std::vector<std::pair<std::string, std::string>>* attributes) {
+        attributes->clear();
+        for (;;) {
+            while (p_ < end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n')) {
+                p_++;
+            }
+            if (p_ >= end_) {
+                return false;
+            }
+            if (*p_ == '>' || *p_ == '/') {
+                const char* close = static_cast<const char*>(memchr(p_, '>', end_ - p_));
+                if (close == nullptr) {
+                    return false;
+                }
+                p_ = close + 1;
+                return true;
+            }
+            const char* eq = static_cast<const char*>(memchr(p_, '=', end_ - p_));
+            if (eq == nullptr || eq + 1 >= end_ || (eq[1] != '"' && eq[1] != '\'')) {
+                return false;
+            }
+            std::string name(p_, eq);
+            while (!name.empty() && name.back() == ' ') {
+                name.pop_back();
+            }
+            char quote = eq[1];
+            const char* valueStart = eq + 2;
+            const char* valueEnd =
+                static_cast<const char*>(memchr(valueStart, quote, end_ - valueStart));
+            if (valueEnd == nullptr) {
+                return false;
+            }
+            attributes->emplace_back(name, Unescape(valueStart, valueEnd));
+            p_ = valueEnd + 1;
+        }
+    }
+
+private:
+    static std::string Unescape(const char* begin, const char* end) {
+        std::string out;
+        out.reserve(end - begin);
+        for (const char* p = begin; p < end; p++) {
+            if (*p != '&') {
+                out += *p;
+                continue;
+            }
+            const char* semi = static_cast<const char*>(memchr(p, ';', end - p));
+            if (semi == nullptr) {
+                out += *p;
+                continue;
+            }
+            std::string entity(p + 1, semi);
+            if (entity == "amp") out += '&';
+            else if (entity == "lt") out += '<';
+            else if (entity == "gt") out += '>';
+            else if (entity == "quot") out += '"';
+            else if (entity == "apos") out += '\'';
+            else if (!entity.empty() && entity[0] == '#') {
+                unsigned long code = entity.size() > 1 && entity[1] == 'x'
+                                         ? strtoul(entity.c_str() + 2, nullptr, 16)
+                                         : strtoul(entity.c_str() + 1, nullptr, 10);
+                // Encode as UTF-8.
+                if (code < 0x80) {
+                    out += char(code);
+                } else if (code < 0x800) {
+                    out += char(0xC0 | (code >> 6));
+                    out += char(0x80 | (code & 0x3F));
+                } else if (code < 0x10000) {
+                    out += char(0xE0 | (code >> 12));
+                    out += char(0x80 | ((code >> 6) & 0x3F));
+                    out += char(0x80 | (code & 0x3F));
+                } else {
+                    out += char(0xF0 | (code >> 18));
+                    out += char(0x80 | ((code >> 12) & 0x3F));
+                    out += char(0x80 | ((code >> 6) & 0x3F));
+                    out += char(0x80 | (code & 0x3F));
+                }
+            } else {
+                out.append(p, semi + 1);
+            }
+            p = semi;
+        }
+        return out;
+    }
+
+    const char* p_;
+    const char* end_;
+    const char* tagStart_ = nullptr;
+};
+
+}  // namespace
+
+std::string Base64Encode(const uint8_t* data, size_t length) {
+    static const char kAlphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((length + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < length; i += 3) {
+        uint32_t v = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8) | data[i + 2];
+        out += kAlphabet[(v >> 18) & 63];
+        out += kAlphabet[(v >> 12) & 63];
+        out += kAlphabet[(v >> 6) & 63];
+        out += kAlphabet[v & 63];
+    }
+    if (i + 1 == length) {
+        uint32_t v = uint32_t(data[i]) << 16;
+        out += kAlphabet[(v >> 18) & 63];
+        out += kAlphabet[(v >> 12) & 63];
+        out += "==";
+    } else if (i + 2 == length) {
+        uint32_t v = (uint32_t(data[i]) << 16) | (uint32_t(data[i + 1]) << 8);
+        out += kAlphabet[(v >> 18) & 63];
+        out += kAlphabet[(v >> 12) & 63];
+        out += kAlphabet[(v >> 6) & 63];
+        out += '=';
+    }
+    return out;
+}
+
+bool Base64Decode(const std::string& text, std::vector<uint8_t>* out) {
+    out->clear();
+    uint32_t accumulator = 0;
+    int bits = 0;
+    for (char c : text) {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '+') value = 62;
+        else if (c == '/') value = 63;
+        else if (c == '=') break;
+        else return false;
+        accumulator = (accumulator << 6) | uint32_t(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out->push_back(uint8_t(accumulator >> bits));
+        }
+    }
+    return true;
+}
+
+std::string BuildBlockMapXml(const std::vector<BlockMapFile>& files) {
+    std::string xml;
+    xml.reserve(256 + files.size() * 160);
+    xml += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n";
+    xml += "<BlockMap xmlns=\"http://schemas.microsoft.com/appx/2010/blockmap\" "
+           "HashMethod=\"http://www.w3.org/2001/04/xmlenc#sha256\">";
+    for (const BlockMapFile& file : files) {
+        xml += "<File Name=\"";
+        AppendXmlEscaped(xml, file.name);
+        xml += "\" Size=\"" + std::to_string(file.size) + "\" LfhSize=\"" +
+               std::to_string(file.localFileHeaderSize) + "\">";
+        for (const BlockMapBlock& block : file.blocks) {
+            xml += "<Block Hash=\"" + Base64Encode(block.hash.data(), block.hash.size()) + "\"";
+            if (file.compressed) {
+                xml += " Size=\"" + std::to_string(block.compressedSize) + "\"";
+            }
+            xml += "/>";
+        }
+        xml += "</File>";
+    }
+    xml += "</BlockMap>";
+    return xml;
+}
+
+bool ParseBlockMapXml(const char* xml, size_t length, std::vector<BlockMapFile>* files,
+                      std::string* error) {
+    files->clear();
+    TagScanner scanner(xml, length);
+    std::vector<std::pair<std::string, std::string>> attributes;
+    std::string tag;
+    BlockMapFile* current = nullptr;
+    while (scanner.Next(&tag)) {
+        if (tag == "/File") {
+            current = nullptr;
+            continue;
+        }
+        if (!scanner.Attributes(&attributes)) {
+            *error = "Malformed AppxBlockMap.xml";
+            return false;
+        }
+        if (tag == "File") {
+            files->emplace_back();
+            current = &files->back();
+            current->compressed = false;
+            for (const auto& attribute : attributes) {
+                if (attribute.first == "Name") {
+                    current->name = attribute.second;
+                } else if (attribute.first == "Size") {
+                    current->size = strtoull(attribute.second.c_str(), nullptr, 10);
+                } else if (attribute.first == "LfhSize") {
+                    current->localFileHeaderSize =
+                        static_cast<uint32_t>(strtoul(attribute.second.c_str(), nullptr, 10));
+                }
+            }
+        } else if (tag == "Block") {
+            if (current == nullptr) {
+                *error = "Block outside of File in AppxBlockMap.xml";
+                return false;
+            }
+            BlockMapBlock block;
+            bool haveHash = false;
+            for (const auto& attribute : attributes) {
+                if (attribute.first == "Hash") {
+                    std::vector<uint8_t> hash;
+                    if (!Base64Decode(attribute.second, &hash) || hash.size() != block.hash.size()) {
+                        *error = "Bad block hash for " + current->name;
+                        return false;
+                    }
+                    std::copy(hash.begin(), hash.end(), block.hash.begin());
+                    haveHash = true;
+                } else if (attribute.first == "Size") {
+                    block.compressedSize =
+                        static_cast<uint32_t>(strtoul(attribute.second.c_str(), nullptr, 10));
+                    current->compressed = true;
+                }
+            }
+            if (!haveHash) {
+                *error = "Block without hash for " + current->name;
+                return false;
+            }
+            current->blocks.push_back(block);
+        }
+    }
+    for (const BlockMapFile& file : *files) {
+        if (file.blocks.size() != BlockCount(file.size)) {
+            *error = "Block count does not match size for " + file.name;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IndexBlockMapXml(const char* xml, size_t length, std::vector<BlockMapFileSpan>* spans,
+                      std::string* error) {
+    spans->clear();
+    TagScanner scanner(xml, length);
+    std::vector<std::pair<std::string, std::string>> attributes;
+    std::string tag;
+    size_t open = SIZE_MAX;  // index of the File element not closed yet
+    while (scanner.Next(&tag)) {
+        // Block attributes hold no '<', so Next() steps over them unparsed.
+        if (tag == "Block") {
+            continue;
+        }
+        const char* start = scanner.TagStart();
+        if (!scanner.Attributes(&attributes)) {
+            *error = "Malformed AppxBlockMap.xml";
+            return false;
+        }
+        size_t end = static_cast<size_t>(scanner.Position() - xml);
+        if (tag == "/File") {
+            if (open != SIZE_MAX) {
+                (*spans)[open].length = end - (*spans)[open].offset;
+                open = SIZE_MAX;
+            }
+            continue;
+        }
+        BlockMapFileSpan span;
+        span.offset = static_cast<size_t>(start - xml);
+        span.length = end - span.offset;
+        for (const auto& attribute : attributes) {
+            if (attribute.first == "Name") {
+                span.name = attribute.second;
+            }
+        }
+        spans->push_back(span);
+        // A self-closing <File/> (an empty file) is complete already.
+        open = scanner.Position()[-2] == '/' ? SIZE_MAX : spans->size() - 1;
+    }
+    return true;
+}
+
+}  // namespace msix
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sha256.h"
+
+namespace msix {
+
+// AppxBlockMap.xml splits every payload file into 64 KB blocks of
+// uncompressed data and records a SHA-256 for each one.
+constexpr size_t kBlockSize = 64 * 1024;
+
+struct BlockMapBlock {
+    Sha256Digest hash;
+    // Size of the block's bytes in the archive. Only meaningful (and only
+    // written) for deflated files.
+    uint32_t compressedSize = 0;
+};
+
+struct BlockMapFile {
+    std::string name;  // package-relative path with backslash separators
+    uint64_t size = 0;
+    uint32_t localFileHeaderSize = 0;
+    bool compressed = true;
+    std::vector<BlockMapBlock> blocks;
+};
+
+std::string BuildBlockMapXml(const std::vector<BlockMapFile>& files);
+
+// Parses the File/Block elements of an AppxBlockMap.xml. LfhSize is optional
+// as in the schema; a file whose blocks carry no Size attribute is treated
+// as stored.
+bool ParseBlockMapXml(const char* xml, size_t length, std::vector<BlockMapFile>* files,
+                      std::string* error);
+
+// Where each File element of an AppxBlockMap.xml starts and ends, without
+// parsing its blocks. Passing one span to ParseBlockMapXml parses just that
+// file, for readers that only ever need a few of them.
+struct BlockMapFileSpan {
+    std::string name;  // as in the XML: backslash separators
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+bool IndexBlockMapXml(const char* xml, size_t length, std::vector<BlockMapFileSpan>* spans,
+                      std::string* error);
+
+std::string Base64Encode(const uint8_t* data, size_t length);
+bool Base64Decode(const std::string& text, std::vector<uint8_t>* out);
+
+inline uint64_t BlockCount(uint64_t fileSize) {
+    return (fileSize + kBlockSize - 1) / kBlockSize;
+}
+
+}  // namespace msix
@@ -0,0 +1,151 @@
+# Builds the native MSIX tools. Works on Windows (clang++ + zlib) and on Linux
+# under pwsh. After building, packcheck packs a generated fixture tree, reads
+# and extracts it again and compares every byte and AppxBlockMap hash; the
+# build fails if the round trip does not match.
+#
+# On Windows, point $env:ZLIB_DIR at a zlib install (e.g. vcpkg's
+# installed\x64-windows) so that include\zlib.h and lib\zlib.lib are found.
+#
+# stdlibpack repacks python3XY.zip into stored, page-aligned entries, e.g.
+# out\stdlibpack /i ..\python-msix\src\python\python313.zip /o python313.zip
+#
+# contentstore keeps staging directories and packages in one deduplicated
+# store and installs them as hardlinks into it (see content_store.h).
+# msixdelta diffs two package versions by block map and applies the patch.
+# install_bench times `msixpack install` on a synthetic 5 GB package per
+# thread count, with and without io_uring writes.
+# msixvfs reads files straight out of a package (see package_vfs.h); on Linux
+# it can also mount one read-only when libfuse3 is found through pkg-config.
+# onefilepack appends a Python application to the onefile_boot bootloader
+# (see onefile.h); the bootloader links libpython and is only built when the
+# Python development files are found.
+
+$scriptDir = Split-Path -Path $MyInvocation.MyCommand.Path
+$outDir = Join-Path -Path $scriptDir -ChildPath "out"
+
+$LibrarySources = @(
+    "block_codec.cc",
+    "block_map.cc",
+    "file_io.cc",
+    "footprint.cc",
+    "pack_cache.cc",
+    "package_reader.cc",
+    "packer.cc",
+    "sha256.cc",
+    "sha256_x86.cc",
+    "stdlib_zip.cc",
+    "content_store.cc",
+    "package_delta.cc",
+    "write_queue.cc",
+    "installer.cc",
+    "package_vfs.cc",
+    "onefile.cc"
+)
+
+$Tools = @(
+    "msixpack",
+    "sha256_bench",
+    "stdlibpack",
+    "contentstore",
+    "msixdelta",
+    "install_bench",
+    "msixvfs",
+    "onefilepack",
+    "packcheck"
+)
+
+$compilerFlags = @("-std=c++17", "-O2", "-g")
+$linkFlags = @()
+if ($IsLinux -or $IsMacOS) {
+    $compilerFlags += "-pthread"
+    $linkFlags += "-lz"
+    $exeSuffix = ""
+} else {
+    if ($env:ZLIB_DIR) {
+        $compilerFlags += "-I$env:ZLIB_DIR\include"
+        $linkFlags += "-L$env:ZLIB_DIR\lib"
+    }
+    $linkFlags += "-lzlib"
+    $exeSuffix = ".exe"
+}
+
+New-Item -ItemType Directory -Force -Path $outDir | Out-Null
+
+$librarySourcePaths = $LibrarySources | ForEach-Object { Join-Path $scriptDir $_ }
+
+foreach ($tool in $Tools) {
+    $sourcePath = Join-Path $scriptDir "$tool.cc"
+    $outputPath = Join-Path $outDir "$tool$exeSuffix"
+    Write-Host "Compiling $tool..." -ForegroundColor Yellow
+
+    & clang++ @compilerFlags $sourcePath @librarySourcePaths -o $outputPath @linkFlags
+
+    if ($LASTEXITCODE -ne 0) {
+        Write-Error "Compilation of $tool failed with exit code $LASTEXITCODE"
+        exit $LASTEXITCODE
+    }
+    Write-Host "Successfully compiled to $outputPath" -ForegroundColor Green
+}
+
+# Rebuild msixvfs with the FUSE frontend where libfuse3 is available.
+if ($IsLinux -and (Get-Command pkg-config -ErrorAction SilentlyContinue)) {
+    & pkg-config --exists fuse3
+    if ($LASTEXITCODE -eq 0) {
+        $fuseFlags = (& pkg-config --cflags fuse3) -split " "
+        $fuseLinkFlags = (& pkg-config --libs fuse3) -split " "
+        $outputPath = Join-Path $outDir "msixvfs$exeSuffix"
+        Write-Host "Compiling msixvfs with FUSE..." -ForegroundColor Yellow
+        & clang++ @compilerFlags "-DMSIX_HAVE_FUSE" @fuseFlags (Join-Path $scriptDir "msixvfs.cc") @librarySourcePaths -o $outputPath @linkFlags @fuseLinkFlags
+        if ($LASTEXITCODE -ne 0) {
+            Write-Error "Compilation of msixvfs failed with exit code $LASTEXITCODE"
+            exit $LASTEXITCODE
+        }
+        Write-Host "Successfully compiled to $outputPath" -ForegroundColor Green
+    } else {
+        Write-Host "libfuse3 not found; msixvfs is built without mount." -ForegroundColor Yellow
+    }
+}
+
+# onefile_boot embeds the interpreter: python3-config on Linux and macOS,
+# the import library of the python on PATH on Windows, where pythonXY.dll is
+# delay-loaded so that it comes from the bootloader's native cache. The
+# bootloader records that Python version, and onefilepack refuses to pack
+# an interpreter of another one.
+$pythonFlags = @()
+$pythonLinkFlags = @()
+if ($IsLinux -or $IsMacOS) {
+    if (Get-Command python3-config -ErrorAction SilentlyContinue) {
+        $pythonFlags = (& python3-config --includes) -split " "
+        $pythonLinkFlags = (& python3-config --ldflags --embed) -split " "
+    }
+} elseif ($python = Get-Command python -ErrorAction SilentlyContinue) {
+    $pythonInclude = & $python.Source -c "import sysconfig; print(sysconfig.get_paths()['include'])"
+    $pythonLibs = & $python.Source -c "import os, sys; print(os.path.join(sys.base_prefix, 'libs'))"
+    $pythonLib = & $python.Source -c "import sys; print('python%d%d' % sys.version_info[:2])"
+    if (Test-Path (Join-Path $pythonInclude "Python.h")) {
+        $pythonFlags = @("-I$pythonInclude")
+        $pythonLinkFlags = @("-L$pythonLibs", "-l$pythonLib", "-Wl,/DELAYLOAD:$pythonLib.dll", "-ldelayimp")
+    }
+}
+if ($pythonFlags.Count -gt 0) {
+    $outputPath = Join-Path $outDir "onefile_boot$exeSuffix"
+    Write-Host "Compiling onefile_boot..." -ForegroundColor Yellow
+    $bootSources = @("onefile_boot.cc", "../sandbox/embedded_python.cc", "../sandbox/runtime_env.cc") | ForEach-Object { Join-Path $scriptDir $_ }
+    & clang++ @compilerFlags @pythonFlags @bootSources @librarySourcePaths -o $outputPath @linkFlags @pythonLinkFlags
+    if ($LASTEXITCODE -ne 0) {
+        Write-Error "Compilation of onefile_boot failed with exit code $LASTEXITCODE"
+        exit $LASTEXITCODE
+    }
+    Write-Host "Successfully compiled to $outputPath" -ForegroundColor Green
+} else {
+    Write-Host "Python development files not found; skipping onefile_boot." -ForegroundColor Yellow
+}
+
+Write-Host "Running the pack/unpack round-trip check..." -ForegroundColor Yellow
+& (Join-Path $outDir "packcheck$exeSuffix")
+if ($LASTEXITCODE -ne 0) {
+    Write-Error "Round-trip check failed"
+    exit $LASTEXITCODE
+}
+
+Write-Host "All MSIX tools built." -ForegroundColor Green
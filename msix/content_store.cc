@@ -0,0 +1,741 @@
+#include "content_store.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <unordered_map>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+#include "block_map.h"
+#include "file_io.h"
+#include "package_reader.h"
+#include "thread_pool.h"
+#include "zip_format.h"
+
+namespace fs = std::filesystem;
+
+namespace msix {
+
+namespace {
+
+constexpr size_t kRecipeEntrySize = 36;
+
+std::string HexEncode(const uint8_t* data, size_t length) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(length * 2);
+    for (size_t i = 0; i < length; i++) {
+        out += kHex[data[i] >> 4];
+        out += kHex[data[i] & 15];
+    }
+    return out;
+}
+
+// Gear table for the rolling hash: fixed pseudo-random values, so chunk
+// boundaries are the same on every machine and in every version.
+struct GearTable {
+    uint64_t values[256];
+
+    GearTable() {
+        uint64_t state = 0x6d7369782d636463;  // "msix-cdc"
+        for (uint64_t& value : values) {
+            // splitmix64
+            state += 0x9e3779b97f4a7c15;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            value = z ^ (z >> 31);
+        }
+    }
+};
+
+const GearTable kGear;
+
+unsigned Log2(uint32_t value) {
+    unsigned bits = 0;
+    while ((1u << (bits + 1)) <= value) {
+        bits++;
+    }
+    return bits;
+}
+
+// Length of the next chunk of data (FastCDC). The gear hash shifts left, so
+// its top bits depend on the last 64 bytes; the masks test those. Below the
+// average size a stricter mask (two more bits) makes a cut less likely,
+// above it a looser one more likely, which keeps chunk sizes close to the
+// average.
+size_t NextChunk(const uint8_t* data, size_t length, const ChunkingOptions& options) {
+    if (length <= options.minSize) {
+        return length;
+    }
+    unsigned bits = Log2(options.averageSize);
+    uint64_t strictMask = ~0ull << (64 - (bits + 2));
+    uint64_t looseMask = ~0ull << (64 - (bits > 2 ? bits - 2 : 1));
+    size_t normal = std::min<size_t>(options.averageSize, length);
+    size_t end = std::min<size_t>(options.maxSize, length);
+    uint64_t hash = 0;
+    size_t i = options.minSize;
+    for (; i < normal; i++) {
+        hash = (hash << 1) + kGear.values[data[i]];
+        if ((hash & strictMask) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < end; i++) {
+        hash = (hash << 1) + kGear.values[data[i]];
+        if ((hash & looseMask) == 0) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+std::vector<Sha256Digest> BlockHashes(const uint8_t* data, uint64_t size) {
+    size_t count = static_cast<size_t>(BlockCount(size));
+    std::vector<const uint8_t*> messages(count);
+    std::vector<size_t> lengths(count);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t offset = uint64_t(i) * kBlockSize;
+        messages[i] = data + offset;
+        lengths[i] = static_cast<size_t>(std::min<uint64_t>(kBlockSize, size - offset));
+    }
+    std::vector<Sha256Digest> hashes(count);
+    Sha256HashMany(messages.data(), lengths.data(), hashes.data(), count);
+    return hashes;
+}
+
+bool WriteFileAtomically(const std::string& tempPath, const std::string& path,
+                         const void* data, size_t length) {
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    OutputFile file;
+    if (!file.Open(tempPath) || !file.Write(data, length) || !file.Close()) {
+        fs::remove(tempPath, ec);
+        return false;
+    }
+    // Another thread or process may have stored the same content meanwhile;
+    // either copy will do.
+    if (fs::exists(path, ec)) {
+        fs::remove(tempPath, ec);
+        return true;
+    }
+    fs::rename(tempPath, path, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        return fs::exists(path, ec);
+    }
+    return true;
+}
+
+// Tree names become file names under trees/.
+bool IsValidTreeName(const std::string& name) {
+    return !name.empty() && name != "." && name != ".." &&
+           name.find_first_of("/\\:\t\n") == std::string::npos;
+}
+
+bool Reflink(const std::string& source, const std::string& target) {
+#ifdef __linux__
+    int in = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        return false;
+    }
+    int out = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = out >= 0 && ioctl(out, FICLONE, in) == 0;
+    if (out >= 0) {
+        close(out);
+    }
+    close(in);
+    if (!ok) {
+        unlink(target.c_str());
+    }
+    return ok;
+#else
+    (void)source;
+    (void)target;
+    return false;
+#endif
+}
+
+// Pool files are hardlinked into installs, so a write through any of them
+// would change every install and every later one. They are made read-only
+// (FILE_ATTRIBUTE_READONLY on Windows) and only reused while they still
+// are, with their size and content still matching their key.
+constexpr fs::perms kWritable =
+    fs::perms::owner_write | fs::perms::group_write | fs::perms::others_write;
+
+bool IsIntactPoolFile(const std::string& path, const std::string& key, uint64_t size) {
+    std::error_code ec;
+    fs::file_status status = fs::status(fs::u8path(path), ec);
+    if (ec || !fs::is_regular_file(status) || (status.permissions() & kWritable) != fs::perms::none) {
+        return false;
+    }
+    MappedFile file;
+    return file.Open(path) && file.Size() == size &&
+           ContentStore::FileKey(size, BlockHashes(file.Data(), size)) == key;
+}
+
+struct SharedStats {
+    std::mutex mutex;
+    std::string error;
+    std::vector<StoreStats> perTask;
+
+    void Fail(const std::string& message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error.empty()) {
+            error = message;
+        }
+    }
+};
+
+void Merge(const StoreStats& from, StoreStats* to) {
+    to->files += from.files;
+    to->bytes += from.bytes;
+    to->newFiles += from.newFiles;
+    to->newFileBytes += from.newFileBytes;
+    to->chunks += from.chunks;
+    to->newChunks += from.newChunks;
+    to->newChunkBytes += from.newChunkBytes;
+    to->skippedDecode += from.skippedDecode;
+    to->hardlinks += from.hardlinks;
+    to->reflinks += from.reflinks;
+    to->copies += from.copies;
+    to->pooledFiles += from.pooledFiles;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+bool ContentStore::Open(const std::string& directory, const ChunkingOptions& chunking,
+                        std::string* error) {
+    if (chunking.minSize == 0 || chunking.minSize > chunking.averageSize ||
+        chunking.averageSize > chunking.maxSize) {
+        *error = "Chunk sizes must satisfy 0 < min <= average <= max";
+        return false;
+    }
+    directory_ = directory;
+    chunking_ = chunking;
+    std::error_code ec;
+    for (const char* sub : {"chunks", "recipes", "files", "trees", "tmp"}) {
+        fs::create_directories(fs::u8path(directory) / sub, ec);
+        if (ec) {
+            *error = "Failed to create " + directory + "/" + sub + ": " + ec.message();
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string ContentStore::FileKey(uint64_t size, const std::vector<Sha256Digest>& blockHashes) {
+    Sha256 hasher;
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = uint8_t(size >> (8 * i));
+    }
+    hasher.Update(bytes, sizeof(bytes));
+    for (const Sha256Digest& hash : blockHashes) {
+        hasher.Update(hash.data(), hash.size());
+    }
+    Sha256Digest digest = hasher.Finish();
+    return HexEncode(digest.data(), digest.size());
+}
+
+std::string ContentStore::ObjectPath(const char* kind, const std::string& key) const {
+    return (fs::u8path(directory_) / kind / key.substr(0, 2) / key).u8string();
+}
+
+std::string ContentStore::TempPath() {
+    static const uint32_t processTag = std::random_device()();
+    return (fs::u8path(directory_) / "tmp" /
+            (std::to_string(processTag) + "-" + std::to_string(tempCounter_++)))
+        .u8string();
+}
+
+bool ContentStore::HasFile(const std::string& key) const {
+    std::error_code ec;
+    return fs::exists(ObjectPath("recipes", key), ec);
+}
+
+bool ContentStore::AddContent(const std::string& key, const uint8_t* data, uint64_t size,
+                              StoreStats* stats, std::string* error) {
+    std::vector<uint8_t> recipe;
+    zip::ByteWriter writer(recipe);
+    std::error_code ec;
+    for (uint64_t offset = 0; offset < size;) {
+        size_t length = NextChunk(data + offset,
+                                  static_cast<size_t>(std::min<uint64_t>(size - offset, SIZE_MAX)),
+                                  chunking_);
+        Sha256Digest hash = Sha256Hash(data + offset, length);
+        std::string chunkKey = HexEncode(hash.data(), hash.size());
+        std::string path = ObjectPath("chunks", chunkKey);
+        stats->chunks++;
+        if (!fs::exists(path, ec)) {
+            if (!WriteFileAtomically(TempPath(), path, data + offset, length)) {
+                *error = "Failed to write chunk " + path;
+                return false;
+            }
+            stats->newChunks++;
+            stats->newChunkBytes += length;
+        }
+        recipe.insert(recipe.end(), hash.begin(), hash.end());
+        writer.U32(static_cast<uint32_t>(length));
+        offset += length;
+    }
+    if (!WriteFileAtomically(TempPath(), ObjectPath("recipes", key), recipe.data(),
+                             recipe.size())) {
+        *error = "Failed to write recipe for " + key;
+        return false;
+    }
+    stats->newFiles++;
+    stats->newFileBytes += size;
+    return true;
+}
+
+bool ContentStore::WriteTree(const std::string& name, const std::vector<TreeEntry>& entries,
+                             std::string* error) {
+    std::string text;
+    for (const TreeEntry& entry : entries) {
+        text += entry.key + "\t" + std::to_string(entry.size) + "\t" + entry.path + "\n";
+    }
+    std::string path = (fs::u8path(directory_) / "trees" / fs::u8path(name)).u8string();
+    std::string temp = TempPath();
+    std::error_code ec;
+    OutputFile file;
+    if (!file.Open(temp) || !file.Write(text.data(), text.size()) || !file.Close()) {
+        fs::remove(temp, ec);
+        *error = "Failed to write tree " + name;
+        return false;
+    }
+    fs::rename(temp, path, ec);
+    if (ec) {
+        fs::remove(temp, ec);
+        *error = "Failed to write tree " + name + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+bool ContentStore::ReadTree(const std::string& name, std::vector<TreeEntry>* entries,
+                            std::string* error) const {
+    std::ifstream file(fs::u8path(directory_) / "trees" / fs::u8path(name));
+    if (!file) {
+        *error = "No tree named " + name;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t first = line.find('\t');
+        size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+        if (second == std::string::npos) {
+            *error = "Damaged tree " + name;
+            return false;
+        }
+        TreeEntry entry;
+        entry.key = line.substr(0, first);
+        entry.size = std::stoull(line.substr(first + 1, second - first - 1));
+        entry.path = line.substr(second + 1);
+        entries->push_back(std::move(entry));
+    }
+    return true;
+}
+
+bool ContentStore::AddDirectory(const std::string& sourceDir, const std::string& name,
+                                unsigned threads, StoreStats* stats, std::string* error) {
+    auto startTime = std::chrono::steady_clock::now();
+    *stats = StoreStats();
+    if (!IsValidTreeName(name)) {
+        *error = "Invalid tree name " + name;
+        return false;
+    }
+    std::error_code ec;
+    fs::path root = fs::u8path(sourceDir);
+    std::vector<TreeEntry> entries;
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file(ec)) {
+            TreeEntry entry;
+            entry.path = it->path().lexically_relative(root).generic_u8string();
+            entries.push_back(std::move(entry));
+        }
+    }
+    if (ec) {
+        *error = "Failed to list " + sourceDir + ": " + ec.message();
+        return false;
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const TreeEntry& a, const TreeEntry& b) { return a.path < b.path; });
+
+    ThreadPool pool(threads);
+    SharedStats shared;
+    shared.perTask.resize(entries.size());
+    std::vector<std::future<void>> pending;
+    for (size_t i = 0; i < entries.size(); i++) {
+        pending.push_back(pool.Submit([this, &entries, &shared, &root, i] {
+            TreeEntry& entry = entries[i];
+            StoreStats& local = shared.perTask[i];
+            std::string path = (root / fs::u8path(entry.path)).u8string();
+            MappedFile file;
+            if (!file.Open(path)) {
+                shared.Fail("Failed to read " + path);
+                return;
+            }
+            entry.size = file.Size();
+            entry.key = FileKey(entry.size, BlockHashes(file.Data(), entry.size));
+            local.files = 1;
+            local.bytes = entry.size;
+            std::string error;
+            if (!HasFile(entry.key) &&
+                !AddContent(entry.key, file.Data(), entry.size, &local, &error)) {
+                shared.Fail(error);
+            }
+        }));
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+    if (!shared.error.empty()) {
+        *error = shared.error;
+        return false;
+    }
+    for (const StoreStats& local : shared.perTask) {
+        Merge(local, stats);
+    }
+    if (!WriteTree(name, entries, error)) {
+        return false;
+    }
+    stats->seconds = SecondsSince(startTime);
+    return true;
+}
+
+bool ContentStore::AddPackage(PackageReader& reader, const std::string& name, unsigned threads,
+                              StoreStats* stats, std::string* error) {
+    auto startTime = std::chrono::steady_clock::now();
+    *stats = StoreStats();
+    if (!IsValidTreeName(name)) {
+        *error = "Invalid tree name " + name;
+        return false;
+    }
+    // Without a block map every entry is inflated and checked by CRC.
+    std::string mapError;
+    reader.LoadBlockMap(&mapError);
+
+    std::vector<const PackageEntry*> files;
+    for (const PackageEntry& entry : reader.Entries()) {
+        if (!entry.name.empty() && entry.name.back() != '/') {
+            files.push_back(&entry);
+        }
+    }
+    std::vector<TreeEntry> entries(files.size());
+    ThreadPool pool(threads);
+    SharedStats shared;
+    shared.perTask.resize(files.size());
+    std::vector<std::future<void>> pending;
+    for (size_t i = 0; i < files.size(); i++) {
+        pending.push_back(pool.Submit([this, &reader, &files, &entries, &shared, i] {
+            const PackageEntry& source = *files[i];
+            TreeEntry& entry = entries[i];
+            StoreStats& local = shared.perTask[i];
+            entry.path = source.name;
+            entry.size = source.uncompressedSize;
+            local.files = 1;
+            local.bytes = entry.size;
+            const BlockMapFile* map = reader.FindBlockMapFile(source);
+            if (map != nullptr && map->blocks.size() == BlockCount(entry.size)) {
+                std::vector<Sha256Digest> hashes;
+                for (const BlockMapBlock& block : map->blocks) {
+                    hashes.push_back(block.hash);
+                }
+                entry.key = FileKey(entry.size, hashes);
+                if (HasFile(entry.key)) {
+                    local.skippedDecode = 1;
+                    return;
+                }
+            }
+            std::vector<uint8_t> data;
+            std::string error;
+            if (!reader.ReadEntry(source, &data, &error)) {
+                shared.Fail(error);
+                return;
+            }
+            if (entry.key.empty()) {
+                entry.key = FileKey(entry.size, BlockHashes(data.data(), data.size()));
+            }
+            if (!HasFile(entry.key) &&
+                !AddContent(entry.key, data.data(), data.size(), &local, &error)) {
+                shared.Fail(error);
+            }
+        }));
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+    if (!shared.error.empty()) {
+        *error = shared.error;
+        return false;
+    }
+    for (const StoreStats& local : shared.perTask) {
+        Merge(local, stats);
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const TreeEntry& a, const TreeEntry& b) { return a.path < b.path; });
+    if (!WriteTree(name, entries, error)) {
+        return false;
+    }
+    stats->seconds = SecondsSince(startTime);
+    return true;
+}
+
+bool ContentStore::EnsurePooled(const TreeEntry& entry, bool* assembled, std::string* error) {
+    *assembled = false;
+    std::string path = ObjectPath("files", entry.key);
+    std::error_code ec;
+    if (fs::exists(path, ec)) {
+        if (IsIntactPoolFile(path, entry.key, entry.size)) {
+            return true;
+        }
+        // Installs already linked to it keep the damaged inode; new ones
+        // get a fresh file.
+        fs::permissions(fs::u8path(path), kWritable, fs::perm_options::add, ec);
+        fs::remove(fs::u8path(path), ec);
+    }
+    std::ifstream recipeFile(ObjectPath("recipes", entry.key), std::ios::binary);
+    std::vector<uint8_t> recipe((std::istreambuf_iterator<char>(recipeFile)),
+                                std::istreambuf_iterator<char>());
+    if (!recipeFile.is_open() || recipe.size() % kRecipeEntrySize != 0) {
+        *error = "Missing or damaged recipe for " + entry.path;
+        return false;
+    }
+
+    std::string temp = TempPath();
+    WritableFile out;
+    if (!out.Create(temp, entry.size)) {
+        *error = "Failed to create " + temp;
+        return false;
+    }
+    uint64_t offset = 0;
+    bool ok = true;
+    for (size_t i = 0; ok && i < recipe.size(); i += kRecipeEntrySize) {
+        Sha256Digest hash;
+        std::copy(recipe.begin() + i, recipe.begin() + i + 32, hash.begin());
+        uint32_t length = zip::ReadU32(recipe.data() + i + 32);
+        MappedFile chunk;
+        std::string chunkPath = ObjectPath("chunks", HexEncode(hash.data(), hash.size()));
+        if (!chunk.Open(chunkPath) || chunk.Size() != length ||
+            offset + length > entry.size) {
+            *error = "Missing or damaged chunk " + chunkPath;
+            ok = false;
+        } else if (Sha256Hash(chunk.Data(), length) != hash) {
+            *error = "Chunk " + chunkPath + " does not match its hash";
+            ok = false;
+        } else if (!out.WriteAt(offset, chunk.Data(), length)) {
+            *error = "Failed to write " + temp;
+            ok = false;
+        }
+        offset += length;
+    }
+    if (ok && offset != entry.size) {
+        *error = "Recipe for " + entry.path + " does not add up to its size";
+        ok = false;
+    }
+    if (!out.Close() && ok) {
+        *error = "Failed to write " + temp;
+        ok = false;
+    }
+    if (ok) {
+        fs::permissions(temp, kWritable, fs::perm_options::remove, ec);
+        if (ec) {
+            *error = "Failed to make " + temp + " read-only: " + ec.message();
+            ok = false;
+        }
+    }
+    if (!ok) {
+        fs::permissions(temp, kWritable, fs::perm_options::add, ec);
+        fs::remove(temp, ec);
+        return false;
+    }
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    fs::rename(temp, path, ec);
+    if (ec) {
+        fs::permissions(temp, kWritable, fs::perm_options::add, ec);
+        fs::remove(temp, ec);
+        if (!fs::exists(path, ec)) {
+            *error = "Failed to add " + path + " to the pool";
+            return false;
+        }
+    }
+    *assembled = true;
+    return true;
+}
+
+bool ContentStore::Install(const std::string& name, const std::string& targetDir,
+                           LinkMode mode, unsigned threads, StoreStats* stats,
+                           std::string* error) {
+    auto startTime = std::chrono::steady_clock::now();
+    *stats = StoreStats();
+    std::vector<TreeEntry> entries;
+    if (!IsValidTreeName(name) || !ReadTree(name, &entries, error)) {
+        if (error->empty()) {
+            *error = "Invalid tree name " + name;
+        }
+        return false;
+    }
+
+    fs::path root = fs::u8path(targetDir);
+    std::set<fs::path> directories;
+    std::unordered_map<std::string, const TreeEntry*> unique;
+    for (const TreeEntry& entry : entries) {
+        if (!IsSafePackagePath(entry.path)) {
+            *error = "Refusing to install unsafe path " + entry.path;
+            return false;
+        }
+        directories.insert((root / fs::u8path(entry.path)).parent_path());
+        unique.emplace(entry.key, &entry);
+    }
+    std::error_code ec;
+    for (const fs::path& directory : directories) {
+        fs::create_directories(directory, ec);
+        if (ec) {
+            *error = "Failed to create " + directory.u8string() + ": " + ec.message();
+            return false;
+        }
+    }
+
+    ThreadPool pool(threads);
+    SharedStats shared;
+    std::atomic<uint64_t> pooled{0};
+    std::vector<std::future<void>> pending;
+    for (const auto& item : unique) {
+        const TreeEntry* entry = item.second;
+        pending.push_back(pool.Submit([this, entry, &shared, &pooled] {
+            bool assembled = false;
+            std::string error;
+            if (!EnsurePooled(*entry, &assembled, &error)) {
+                shared.Fail(error);
+            } else if (assembled) {
+                pooled++;
+            }
+        }));
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+    if (!shared.error.empty()) {
+        *error = shared.error;
+        return false;
+    }
+
+    pending.clear();
+    shared.perTask.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        pending.push_back(pool.Submit([this, &entries, &shared, &root, mode, i] {
+            const TreeEntry& entry = entries[i];
+            StoreStats& local = shared.perTask[i];
+            std::string source = ObjectPath("files", entry.key);
+            fs::path target = root / fs::u8path(entry.path);
+            std::error_code ec;
+            fs::permissions(target, kWritable, fs::perm_options::add, ec);
+            fs::remove(target, ec);
+            local.files = 1;
+            local.bytes = entry.size;
+            if (mode == LinkMode::kHardlink) {
+                fs::create_hard_link(fs::u8path(source), target, ec);
+                if (!ec) {
+                    local.hardlinks = 1;
+                    return;
+                }
+            }
+            if (mode != LinkMode::kCopy && Reflink(source, target.u8string())) {
+                local.reflinks = 1;
+                return;
+            }
+            // A copy shares nothing, so it need not stay read-only.
+            fs::copy_file(fs::u8path(source), target, fs::copy_options::overwrite_existing, ec);
+            if (!ec) {
+                fs::permissions(target, fs::perms::owner_write, fs::perm_options::add, ec);
+            }
+            if (ec) {
+                shared.Fail("Failed to install " + target.u8string() + ": " + ec.message());
+                return;
+            }
+            local.copies = 1;
+        }));
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+    if (!shared.error.empty()) {
+        *error = shared.error;
+        return false;
+    }
+    for (const StoreStats& local : shared.perTask) {
+        Merge(local, stats);
+    }
+    stats->pooledFiles = pooled;
+    stats->seconds = SecondsSince(startTime);
+    return true;
+}
+
+bool ContentStore::Report(StoreReport* report, std::string* error) const {
+    *report = StoreReport();
+    std::error_code ec;
+    std::unordered_map<std::string, uint64_t> uniqueFiles;
+    for (fs::directory_iterator it(fs::u8path(directory_) / "trees", ec), end; !ec && it != end;
+         it.increment(ec)) {
+        std::vector<TreeEntry> entries;
+        if (!ReadTree(it->path().filename().u8string(), &entries, error)) {
+            return false;
+        }
+        report->trees++;
+        for (const TreeEntry& entry : entries) {
+            report->logicalFiles++;
+            report->logicalBytes += entry.size;
+            uniqueFiles.emplace(entry.key, entry.size);
+        }
+    }
+    if (ec) {
+        *error = "Failed to list trees: " + ec.message();
+        return false;
+    }
+    for (const auto& file : uniqueFiles) {
+        report->uniqueFiles++;
+        report->uniqueFileBytes += file.second;
+    }
+    struct {
+        const char* kind;
+        uint64_t* count;
+        uint64_t* bytes;
+    } objects[] = {
+        {"chunks", &report->chunks, &report->chunkBytes},
+        {"files", &report->poolFiles, &report->poolBytes},
+    };
+    for (const auto& object : objects) {
+        fs::path dir = fs::u8path(directory_) / object.kind;
+        for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end;
+             it.increment(ec)) {
+            if (it->is_regular_file(ec)) {
+                (*object.count)++;
+                *object.bytes += it->file_size(ec);
+            }
+        }
+        if (ec) {
+            *error = "Failed to list " + dir.u8string() + ": " + ec.message();
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace msix
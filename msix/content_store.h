@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sha256.h"
+
+// Deduplicating content store shared by packaging and installs.
+//
+// The packages built here (ComfyPackage, py-package, python-msix) each
+// carry their own python.exe, runtime DLLs and venv wheels, and every
+// version carries them again. The store keeps the content once:
+//
+//  - Files are cut into content-defined chunks (FastCDC: gear hash with
+//    normalized chunking), so an edit only changes the chunks around it and
+//    a shifted file still shares the rest. Chunks are stored once by SHA-256.
+//  - A file is identified by the SHA-256 of its size and its 64 KB block
+//    hashes, the same hashes AppxBlockMap.xml records. A package entry the
+//    store already holds is therefore recognized from the block map without
+//    inflating it.
+//  - A tree (one package version or staging directory) is a list of
+//    (file key, size, path).
+//  - Installs materialize each file once in a pool inside the store and
+//    then hardlink (or reflink, or copy) it into the target, so installs of
+//    several packages and versions share their disk blocks. Hardlinked
+//    files share the pool's inode, so pool files are read-only, as an MSIX
+//    install directory is, and one is only reused after its size and
+//    content have been checked against its key; a damaged one is replaced.
+//
+// Layout under the store directory:
+//   chunks/xx/<sha256>   chunk bytes
+//   recipes/xx/<key>     chunk list of a file: 32-byte hash + u32 length each
+//   files/xx/<key>       materialized file (hardlink source, read-only)
+//   trees/<name>         "<key>\t<size>\t<path>" per line
+//   tmp/                 objects being written
+namespace msix {
+
+class PackageReader;
+
+struct ChunkingOptions {
+    uint32_t minSize = 16 * 1024;
+    uint32_t averageSize = 64 * 1024;
+    uint32_t maxSize = 256 * 1024;
+};
+
+enum class LinkMode {
+    kHardlink,  // falls back to reflink, then copy, across volumes
+    kReflink,   // FICLONE on Linux; a copy elsewhere
+    kCopy,
+};
+
+struct StoreStats {
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    // Files and chunks that were not in the store yet.
+    uint64_t newFiles = 0;
+    uint64_t newFileBytes = 0;
+    uint64_t chunks = 0;
+    uint64_t newChunks = 0;
+    uint64_t newChunkBytes = 0;
+    // Package entries recognized from the block map without inflating.
+    uint64_t skippedDecode = 0;
+    // Install: how each file got into the target, and pool files assembled.
+    uint64_t hardlinks = 0;
+    uint64_t reflinks = 0;
+    uint64_t copies = 0;
+    uint64_t pooledFiles = 0;
+    double seconds = 0;
+};
+
+struct StoreReport {
+    uint64_t trees = 0;
+    // Every file of every tree, as if installed side by side without the
+    // store.
+    uint64_t logicalFiles = 0;
+    uint64_t logicalBytes = 0;
+    // After whole-file deduplication.
+    uint64_t uniqueFiles = 0;
+    uint64_t uniqueFileBytes = 0;
+    // After chunk deduplication: what the store holds on disk for content.
+    uint64_t chunks = 0;
+    uint64_t chunkBytes = 0;
+    // Materialized install sources.
+    uint64_t poolFiles = 0;
+    uint64_t poolBytes = 0;
+};
+
+class ContentStore {
+public:
+    bool Open(const std::string& directory, const ChunkingOptions& chunking, std::string* error);
+
+    // Adds every file under sourceDir and records them as tree `name`.
+    bool AddDirectory(const std::string& sourceDir, const std::string& name, unsigned threads,
+                      StoreStats* stats, std::string* error);
+
+    // Adds every entry of a package, verified against its block map or
+    // CRC, and records them as tree `name`.
+    bool AddPackage(PackageReader& reader, const std::string& name, unsigned threads,
+                    StoreStats* stats, std::string* error);
+
+    // Recreates tree `name` under targetDir.
+    bool Install(const std::string& name, const std::string& targetDir, LinkMode mode,
+                 unsigned threads, StoreStats* stats, std::string* error);
+
+    bool Report(StoreReport* report, std::string* error) const;
+
+    // File key for content with these 64 KB block hashes.
+    static std::string FileKey(uint64_t size, const std::vector<Sha256Digest>& blockHashes);
+
+private:
+    struct TreeEntry {
+        std::string key;
+        uint64_t size = 0;
+        std::string path;
+    };
+
+    std::string ObjectPath(const char* kind, const std::string& key) const;
+    std::string TempPath();
+    bool HasFile(const std::string& key) const;
+    // Chunks data and writes the chunks the store lacks and the recipe.
+    bool AddContent(const std::string& key, const uint8_t* data, uint64_t size,
+                    StoreStats* stats, std::string* error);
+    bool EnsurePooled(const TreeEntry& entry, bool* assembled, std::string* error);
+    bool WriteTree(const std::string& name, const std::vector<TreeEntry>& entries,
+                   std::string* error);
+    bool ReadTree(const std::string& name, std::vector<TreeEntry>* entries,
+                  std::string* error) const;
+
+    std::string directory_;
+    ChunkingOptions chunking_;
+    std::atomic<uint64_t> tempCounter_{0};
+};
+
+}  // namespace msix
@@ -0,0 +1,161 @@
+// Front end for ContentStore: adds staging directories and packages to a
+// shared deduplicating store, installs them back as links into its file
+// pool, and reports how much the deduplication saves.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "content_store.h"
+#include "package_reader.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " add /s <store> /n <name> (/d <dir> | /p <package>)\n"
+              << "       " << program
+              << " install /s <store> /n <name> /d <target_dir> [/mode hardlink|reflink|copy]\n"
+              << "       " << program << " report /s <store>\n"
+              << "Options:\n"
+              << "  /j <threads>  Worker threads (default: all hardware threads)\n"
+              << "  /avg <bytes>  Average chunk size for add (default: 65536; min avg/4,\n"
+              << "                max avg*4)\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+double Megabytes(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+double Ratio(uint64_t logical, uint64_t stored) {
+    return stored > 0 ? double(logical) / stored : 0.0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    std::string command = argv[1];
+    std::string storeDir;
+    std::string name;
+    std::string dir;
+    std::string packagePath;
+    msix::LinkMode mode = msix::LinkMode::kHardlink;
+    msix::ChunkingOptions chunking;
+    unsigned threads = 0;
+    for (int i = 2; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "s") && hasValue) {
+            storeDir = argv[++i];
+        } else if (IsFlag(arg, "n") && hasValue) {
+            name = argv[++i];
+        } else if (IsFlag(arg, "d") && hasValue) {
+            dir = argv[++i];
+        } else if (IsFlag(arg, "p") && hasValue) {
+            packagePath = argv[++i];
+        } else if (IsFlag(arg, "j") && hasValue) {
+            threads = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "avg") && hasValue) {
+            chunking.averageSize = static_cast<uint32_t>(atoi(argv[++i]));
+            chunking.minSize = chunking.averageSize / 4;
+            chunking.maxSize = chunking.averageSize * 4;
+        } else if (IsFlag(arg, "mode") && hasValue) {
+            std::string value = argv[++i];
+            if (value == "hardlink") {
+                mode = msix::LinkMode::kHardlink;
+            } else if (value == "reflink") {
+                mode = msix::LinkMode::kReflink;
+            } else if (value == "copy") {
+                mode = msix::LinkMode::kCopy;
+            } else {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (storeDir.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    msix::ContentStore store;
+    std::string error;
+    if (!store.Open(storeDir, chunking, &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    msix::StoreStats stats;
+    if (command == "add" && !name.empty() && (dir.empty() != packagePath.empty())) {
+        bool ok;
+        if (!dir.empty()) {
+            ok = store.AddDirectory(dir, name, threads, &stats, &error);
+        } else {
+            msix::PackageReader reader;
+            ok = reader.Open(packagePath, &error) &&
+                 store.AddPackage(reader, name, threads, &stats, &error);
+        }
+        if (!ok) {
+            std::cerr << "Failed to add: " << error << std::endl;
+            return 1;
+        }
+        printf("Added %llu files (%.2f MB) as %s\n", (unsigned long long)stats.files,
+               Megabytes(stats.bytes), name.c_str());
+        printf("New: %llu files (%.2f MB), %llu of %llu chunks (%.2f MB)\n",
+               (unsigned long long)stats.newFiles, Megabytes(stats.newFileBytes),
+               (unsigned long long)stats.newChunks, (unsigned long long)stats.chunks,
+               Megabytes(stats.newChunkBytes));
+        if (!packagePath.empty()) {
+            printf("Recognized from the block map: %llu files\n",
+                   (unsigned long long)stats.skippedDecode);
+        }
+        printf("Time: %.2f s\n", stats.seconds);
+        return 0;
+    }
+    if (command == "install" && !name.empty() && !dir.empty()) {
+        if (!store.Install(name, dir, mode, threads, &stats, &error)) {
+            std::cerr << "Failed to install: " << error << std::endl;
+            return 1;
+        }
+        printf("Installed %llu files (%.2f MB) to %s\n", (unsigned long long)stats.files,
+               Megabytes(stats.bytes), dir.c_str());
+        printf("Hardlinks %llu, reflinks %llu, copies %llu; %llu files added to the pool\n",
+               (unsigned long long)stats.hardlinks, (unsigned long long)stats.reflinks,
+               (unsigned long long)stats.copies, (unsigned long long)stats.pooledFiles);
+        printf("Time: %.2f s\n", stats.seconds);
+        return 0;
+    }
+    if (command == "report") {
+        msix::StoreReport report;
+        if (!store.Report(&report, &error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        printf("Trees:          %llu\n", (unsigned long long)report.trees);
+        printf("Logical:        %llu files, %.2f MB\n", (unsigned long long)report.logicalFiles,
+               Megabytes(report.logicalBytes));
+        printf("Unique files:   %llu files, %.2f MB (%.2fx)\n",
+               (unsigned long long)report.uniqueFiles, Megabytes(report.uniqueFileBytes),
+               Ratio(report.logicalBytes, report.uniqueFileBytes));
+        printf("Unique chunks:  %llu chunks, %.2f MB (%.2fx)\n",
+               (unsigned long long)report.chunks, Megabytes(report.chunkBytes),
+               Ratio(report.logicalBytes, report.chunkBytes));
+        printf("File pool:      %llu files, %.2f MB\n", (unsigned long long)report.poolFiles,
+               Megabytes(report.poolBytes));
+        return 0;
+    }
+    PrintUsage(argv[0]);
+    return 1;
+}
@@ -0,0 +1,429 @@
+#include "file_io.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace msix {
+
+InputFile::~InputFile() {
+    Close();
+}
+
+#ifdef _WIN32
+
+bool InputFile::Open(const std::string& path) {
+    Close();
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+        CloseHandle(handle);
+        return false;
+    }
+    handle_ = handle;
+    size_ = static_cast<uint64_t>(size.QuadPart);
+    return true;
+}
+
+void InputFile::Close() {
+    if (handle_ != nullptr) {
+        CloseHandle(static_cast<HANDLE>(handle_));
+        handle_ = nullptr;
+    }
+    size_ = 0;
+}
+
+bool InputFile::ReadAt(uint64_t offset, void* buffer, size_t length) const {
+    char* out = static_cast<char*>(buffer);
+    while (length > 0) {
+        OVERLAPPED overlapped = {0};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD chunk = length > 0x40000000 ? 0x40000000 : static_cast<DWORD>(length);
+        DWORD bytesRead = 0;
+        if (!ReadFile(static_cast<HANDLE>(handle_), out, chunk, &bytesRead, &overlapped) ||
+            bytesRead == 0) {
+            return false;
+        }
+        out += bytesRead;
+        offset += bytesRead;
+        length -= bytesRead;
+    }
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    size_ = static_cast<uint64_t>(size.QuadPart);
+    if (size_ == 0) {
+        return true;
+    }
+    mapping_ = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_ == NULL) {
+        Close();
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data_ != nullptr) {
+        UnmapViewOfFile(data_);
+        data_ = nullptr;
+    }
+    if (mapping_ != nullptr) {
+        CloseHandle(mapping_);
+        mapping_ = nullptr;
+    }
+    if (file_ != nullptr) {
+        CloseHandle(file_);
+        file_ = nullptr;
+    }
+    size_ = 0;
+}
+
+WritableFile::~WritableFile() {
+    Close();
+}
+
+bool WritableFile::Create(const std::string& path, uint64_t size) {
+    Close();
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    handle_ = handle;
+    if (size > 0) {
+        FILE_ALLOCATION_INFO allocation = {};
+        allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+        SetFileInformationByHandle(handle, FileAllocationInfo, &allocation, sizeof(allocation));
+        FILE_END_OF_FILE_INFO endOfFile = {};
+        endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFileInformationByHandle(handle, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile))) {
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WritableFile::WriteAt(uint64_t offset, const void* data, size_t length) const {
+    const char* in = static_cast<const char*>(data);
+    while (length > 0) {
+        OVERLAPPED overlapped = {0};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD chunk = length > 0x40000000 ? 0x40000000 : static_cast<DWORD>(length);
+        DWORD written = 0;
+        if (!WriteFile(static_cast<HANDLE>(handle_), in, chunk, &written, &overlapped) ||
+            written == 0) {
+            return false;
+        }
+        in += written;
+        offset += written;
+        length -= written;
+    }
+    return true;
+}
+
+bool WritableFile::Sync() const {
+    return FlushFileBuffers(static_cast<HANDLE>(handle_)) != 0;
+}
+
+bool WritableFile::Close() {
+    if (handle_ == nullptr) {
+        return true;
+    }
+    bool ok = CloseHandle(static_cast<HANDLE>(handle_)) != 0;
+    handle_ = nullptr;
+    return ok;
+}
+
+#else
+
+bool InputFile::Open(const std::string& path) {
+    Close();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    fd_ = fd;
+    size_ = static_cast<uint64_t>(st.st_size);
+    return true;
+}
+
+void InputFile::Close() {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+}
+
+bool InputFile::ReadAt(uint64_t offset, void* buffer, size_t length) const {
+    char* out = static_cast<char*>(buffer);
+    while (length > 0) {
+        ssize_t bytesRead = pread(fd_, out, length, static_cast<off_t>(offset));
+        if (bytesRead <= 0) {
+            return false;
+        }
+        out += bytesRead;
+        offset += static_cast<uint64_t>(bytesRead);
+        length -= static_cast<size_t>(bytesRead);
+    }
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path) {
+    Close();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+    if (size_ > 0) {
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            size_ = 0;
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(mapping);
+    }
+    // The mapping keeps the file alive on its own.
+    close(fd);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (data_ != nullptr) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+        data_ = nullptr;
+    }
+    size_ = 0;
+}
+
+WritableFile::~WritableFile() {
+    Close();
+}
+
+bool WritableFile::Create(const std::string& path, uint64_t size) {
+    Close();
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    fd_ = fd;
+    if (size > 0) {
+#ifdef __linux__
+        int status = posix_fallocate(fd, 0, static_cast<off_t>(size));
+        // Filesystems without fallocate support just get a sized sparse file.
+        if (status != 0 && status != EOPNOTSUPP && status != EINVAL) {
+            Close();
+            return false;
+        }
+#endif
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool WritableFile::WriteAt(uint64_t offset, const void* data, size_t length) const {
+    const char* in = static_cast<const char*>(data);
+    while (length > 0) {
+        ssize_t written = pwrite(fd_, in, length, static_cast<off_t>(offset));
+        if (written <= 0) {
+            return false;
+        }
+        in += written;
+        offset += static_cast<uint64_t>(written);
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool WritableFile::Sync() const {
+#ifdef __linux__
+    return fdatasync(fd_) == 0;
+#else
+    return fsync(fd_) == 0;
+#endif
+}
+
+bool WritableFile::Close() {
+    if (fd_ < 0) {
+        return true;
+    }
+    bool ok = close(fd_) == 0;
+    fd_ = -1;
+    return ok;
+}
+
+#endif
+
+OutputFile::~OutputFile() {
+    if (file_ != nullptr) {
+        std::fclose(file_);
+    }
+}
+
+bool OutputFile::Open(const std::string& path) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+        return false;
+    }
+    // Large stdio buffer so small headers and 64 KB blocks coalesce into big writes.
+    std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+    offset_ = 0;
+    return true;
+}
+
+bool OutputFile::Write(const void* data, size_t length) {
+    if (length == 0) {
+        return true;
+    }
+    if (std::fwrite(data, 1, length, file_) != length) {
+        return false;
+    }
+    offset_ += length;
+    return true;
+}
+
+bool OutputFile::Truncate(uint64_t offset) {
+    if (std::fflush(file_) != 0) {
+        return false;
+    }
+#ifdef _WIN32
+    if (_chsize_s(_fileno(file_), static_cast<__int64>(offset)) != 0 ||
+        _fseeki64(file_, static_cast<__int64>(offset), SEEK_SET) != 0) {
+        return false;
+    }
+#else
+    if (ftruncate(fileno(file_), static_cast<off_t>(offset)) != 0 ||
+        fseeko(file_, static_cast<off_t>(offset), SEEK_SET) != 0) {
+        return false;
+    }
+#endif
+    offset_ = offset;
+    return true;
+}
+
+bool OutputFile::Close() {
+    if (file_ == nullptr) {
+        return true;
+    }
+    bool ok = std::fclose(file_) == 0;
+    file_ = nullptr;
+    return ok;
+}
+
+bool ReadWholeFile(const std::filesystem::path& path, std::vector<uint8_t>* out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    out->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool WriteWholeFile(const std::filesystem::path& path, const std::vector<uint8_t>& data) {
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+    OutputFile file;
+    return file.Open(path.u8string()) && file.Write(data.data(), data.size()) && file.Close();
+}
+
+std::filesystem::path ScratchDirectory(const char* purpose) {
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    return std::filesystem::temp_directory_path() /
+           (std::string(purpose) + "-" + std::to_string(stamp));
+}
+
+std::string Quote(const std::string& text) {
+    return "\"" + text + "\"";
+}
+
+std::string ShellCommand(const std::string& command) {
+#ifdef _WIN32
+    return "\"" + command + "\"";
+#else
+    return command;
+#endif
+}
+
+bool ReadCommandOutput(const std::string& command, std::string* output) {
+    output->clear();
+#ifdef _WIN32
+    FILE* pipe = _popen(command.c_str(), "r");
+#else
+    FILE* pipe = popen(command.c_str(), "r");
+#endif
+    if (pipe == nullptr) {
+        return false;
+    }
+    char buffer[4096];
+    size_t length;
+    while ((length = std::fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+        output->append(buffer, length);
+    }
+#ifdef _WIN32
+    return _pclose(pipe) == 0;
+#else
+    return pclose(pipe) == 0;
+#endif
+}
+
+}  // namespace msix
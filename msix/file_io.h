@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace msix {
+
+// Read-only file that supports positioned reads from many threads at once
+// (pread on POSIX, overlapped-offset ReadFile on Windows).
+class InputFile {
+public:
+    InputFile() = default;
+    ~InputFile();
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    uint64_t Size() const { return size_; }
+
+    // Reads exactly length bytes at offset. Returns false on error or short read.
+    bool ReadAt(uint64_t offset, void* buffer, size_t length) const;
+
+private:
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+    uint64_t size_ = 0;
+};
+
+// Buffered sequential writer that tracks how many bytes it has written.
+class OutputFile {
+public:
+    OutputFile() = default;
+    ~OutputFile();
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    bool Open(const std::string& path);
+    bool Write(const void* data, size_t length);
+    // Discards everything written from offset on; later writes continue
+    // there.
+    bool Truncate(uint64_t offset);
+    bool Close();
+
+    uint64_t Offset() const { return offset_; }
+
+private:
+    std::FILE* file_ = nullptr;
+    uint64_t offset_ = 0;
+};
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path);
+    void Close();
+
+    const uint8_t* Data() const { return data_; }
+    uint64_t Size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    uint64_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+// Output file written at explicit offsets, possibly from several threads.
+// The full size is reserved up front (posix_fallocate / FileAllocationInfo)
+// so parallel writers don't fragment it or fail halfway on a full disk.
+class WritableFile {
+public:
+    WritableFile() = default;
+    ~WritableFile();
+
+    WritableFile(const WritableFile&) = delete;
+    WritableFile& operator=(const WritableFile&) = delete;
+
+    bool Create(const std::string& path, uint64_t size);
+    bool WriteAt(uint64_t offset, const void* data, size_t length) const;
+    // Flushes the file's data to stable storage (fdatasync / FlushFileBuffers).
+    bool Sync() const;
+    bool Close();
+
+private:
+    friend class WriteQueue;
+
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+// Whole-file helpers for small files (block maps, bytecode, bootloaders).
+bool ReadWholeFile(const std::filesystem::path& path, std::vector<uint8_t>* out);
+// Creates the parent directories first.
+bool WriteWholeFile(const std::filesystem::path& path, const std::vector<uint8_t>& data);
+
+// A fresh path under the temp directory for a tool's scratch files; the
+// caller creates and removes it.
+std::filesystem::path ScratchDirectory(const char* purpose);
+
+// Command lines for std::system and popen. Paths passed here never contain
+// quotes, so wrapping them is enough.
+std::string Quote(const std::string& text);
+// cmd.exe strips the outermost quotes of a command line that starts with
+// one, so the whole line gets an extra pair there.
+std::string ShellCommand(const std::string& command);
+// Runs command (already passed through ShellCommand) and collects what it
+// prints. Returns false when it cannot be started or exits with an error.
+bool ReadCommandOutput(const std::string& command, std::string* output);
+
+}  // namespace msix
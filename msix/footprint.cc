@@ -0,0 +1,169 @@
+#include "footprint.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <set>
+
+namespace msix {
+
+namespace {
+
+std::string LowerExtension(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) ||
+        dot + 1 == path.size()) {
+        return "";
+    }
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return char(std::tolower(c)); });
+    return ext;
+}
+
+bool IsAllowedInPartName(unsigned char c) {
+    if (std::isalnum(c)) {
+        return true;
+    }
+    switch (c) {
+        case '-': case '.': case '_': case '~': case '!': case '$': case '&':
+        case '\'': case '(': case ')': case '*': case '+': case ',': case ';':
+        case '=': case ':': case '@': case '/':
+            return true;
+        default:
+            return false;
+    }
+}
+
+int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+const std::map<std::string, std::string>& KnownContentTypes() {
+    static const std::map<std::string, std::string> types = {
+        {"bmp", "image/bmp"},
+        {"cat", "application/vnd.ms-pki.seccat"},
+        {"css", "text/css"},
+        {"dll", "application/x-msdownload"},
+        {"exe", "application/x-msdownload"},
+        {"gif", "image/gif"},
+        {"htm", "text/html"},
+        {"html", "text/html"},
+        {"ico", "image/vnd.microsoft.icon"},
+        {"jpeg", "image/jpeg"},
+        {"jpg", "image/jpeg"},
+        {"js", "application/x-javascript"},
+        {"json", "application/json"},
+        {"pdf", "application/pdf"},
+        {"png", "image/png"},
+        {"py", "text/plain"},
+        {"pyd", "application/x-msdownload"},
+        {"svg", "image/svg+xml"},
+        {"txt", "text/plain"},
+        {"xml", "application/xml"},
+        {"zip", "application/x-zip-compressed"},
+    };
+    return types;
+}
+
+}  // namespace
+
+bool IsGeneratedFootprintFile(const std::string& relativePath) {
+    return relativePath == kBlockMapName || relativePath == kContentTypesName ||
+           relativePath == kSignatureName;
+}
+
+std::string EncodeZipItemName(const std::string& relativePath) {
+    // The content types stream is not an OPC part and keeps its brackets.
+    if (relativePath == kContentTypesName) {
+        return relativePath;
+    }
+    static const char kHex[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(relativePath.size());
+    for (unsigned char c : relativePath) {
+        if (IsAllowedInPartName(c)) {
+            out += char(c);
+        } else {
+            out += '%';
+            out += kHex[c >> 4];
+            out += kHex[c & 15];
+        }
+    }
+    return out;
+}
+
+std::string DecodeZipItemName(const std::string& zipItemName) {
+    std::string out;
+    out.reserve(zipItemName.size());
+    for (size_t i = 0; i < zipItemName.size(); i++) {
+        if (zipItemName[i] == '%' && i + 2 < zipItemName.size()) {
+            int hi = HexValue(zipItemName[i + 1]);
+            int lo = HexValue(zipItemName[i + 2]);
+            if (hi >= 0 && lo >= 0) {
+                out += char(hi * 16 + lo);
+                i += 2;
+                continue;
+            }
+        }
+        out += zipItemName[i];
+    }
+    return out;
+}
+
+std::string ToBlockMapName(const std::string& relativePath) {
+    std::string out = relativePath;
+    std::replace(out.begin(), out.end(), '/', '\\');
+    return out;
+}
+
+bool ShouldCompress(const std::string& relativePath) {
+    static const std::set<std::string> kAlreadyCompressed = {
+        "7z", "avi", "cab", "docx", "gif", "gz", "jpeg", "jpg", "m4a", "mp3", "mp4",
+        "msix", "appx", "png", "rar", "whl", "xlsx", "xz", "zip", "zst",
+    };
+    return kAlreadyCompressed.count(LowerExtension(relativePath)) == 0;
+}
+
+std::string BuildContentTypesXml(const std::vector<std::string>& zipItemNames) {
+    std::set<std::string> defaults;
+    std::vector<std::string> overrides;
+    for (const std::string& name : zipItemNames) {
+        if (name == kManifestName) {
+            continue;
+        }
+        std::string ext = LowerExtension(name);
+        if (ext.empty()) {
+            overrides.push_back(name);
+        } else {
+            defaults.insert(ext);
+        }
+    }
+
+    std::string xml;
+    xml += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\r\n";
+    xml += "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">";
+    for (const std::string& ext : defaults) {
+        auto known = KnownContentTypes().find(ext);
+        std::string type =
+            known != KnownContentTypes().end() ? known->second : "application/octet-stream";
+        xml += "<Default Extension=\"" + ext + "\" ContentType=\"" + type + "\"/>";
+    }
+    for (const std::string& name : overrides) {
+        xml += "<Override PartName=\"/" + name + "\" ContentType=\"application/octet-stream\"/>";
+    }
+    xml += "<Override PartName=\"/AppxManifest.xml\" "
+           "ContentType=\"application/vnd.ms-appx.manifest+xml\"/>";
+    xml += "<Override PartName=\"/AppxBlockMap.xml\" "
+           "ContentType=\"application/vnd.ms-appx.blockmap+xml\"/>";
+    xml += "<Override PartName=\"/AppxSignature.p7x\" "
+           "ContentType=\"application/vnd.ms-appx.signature\"/>";
+    xml += "</Types>";
+    return xml;
+}
+
+}  // namespace msix
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Naming rules and the generated footprint files ([Content_Types].xml and
+// friends) that every MSIX carries next to its payload.
+namespace msix {
+
+constexpr const char* kManifestName = "AppxManifest.xml";
+constexpr const char* kBlockMapName = "AppxBlockMap.xml";
+constexpr const char* kContentTypesName = "[Content_Types].xml";
+constexpr const char* kSignatureName = "AppxSignature.p7x";
+
+// Files the packer generates (or SignTool adds later) and therefore never
+// takes from the staging directory.
+bool IsGeneratedFootprintFile(const std::string& relativePath);
+
+// OPC part name for a '/'-separated relative path, percent-encoding every
+// byte that is not allowed verbatim in a part name.
+std::string EncodeZipItemName(const std::string& relativePath);
+
+// Inverse of EncodeZipItemName.
+std::string DecodeZipItemName(const std::string& zipItemName);
+
+// AppxBlockMap.xml names files with '\' separators and no encoding.
+std::string ToBlockMapName(const std::string& relativePath);
+
+// Whether a payload file should be deflated. Formats that are already
+// compressed are stored, as MakeAppx does.
+bool ShouldCompress(const std::string& relativePath);
+
+std::string BuildContentTypesXml(const std::vector<std::string>& zipItemNames);
+
+}  // namespace msix
@@ -0,0 +1,208 @@
+// Measures staged-install throughput against worker threads: builds a
+// synthetic, compressible package (5 GB by default), then installs it with
+// 1, 2, 4, ... threads up to the hardware thread count, with writes issued
+// from the inflating threads and through an io_uring, and prints MB/s.
+//
+// The package is read through the page cache after the first install, so
+// the numbers are inflate + verify + write; /sync adds the flush to disk.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "installer.h"
+#include "package_reader.h"
+#include "packer.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char kManifest[] =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+    "<Package xmlns=\"http://schemas.microsoft.com/appx/manifest/foundation/windows10\">\n"
+    "  <Identity Name=\"InstallBench\" Publisher=\"CN=InstallBench\" Version=\"1.0.0.0\" />\n"
+    "</Package>\n";
+
+void PrintUsage(const char* program) {
+    printf("Usage: %s [/w <work_dir>] [/size <megabytes>] [/file <megabytes>] [/prime]\n"
+           "       [/sync] [/keep]\n"
+           "  /w     Directory for the package and installs (default: install_bench)\n"
+           "  /size  Payload size (default: 5120)\n"
+           "  /file  Size of each payload file (default: 64)\n"
+           "  /prime Pack with dictionary priming, which makes large files inflate serially\n"
+           "  /sync  Flush every install to disk before committing it\n"
+           "  /keep  Reuse the package from an earlier run and keep it afterwards\n",
+           program);
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+// Text-like data from a small vocabulary: deflates about 3:1, so inflating
+// costs about as much as it does for real payloads.
+bool WriteSyntheticFile(const fs::path& path, uint64_t size, uint64_t seed) {
+    static const char* const kWords[] = {
+        "import ", "def ", "return ", "self", ".", "(", ")", ":\n", "    ", "value", "index",
+        "torch", "tensor", "model", "weight", "bias", "=", " ", ",", "0", "1", "None", "True",
+        "for ", "in ", "if ", "else", "class ", "layer", "config", "\n",
+    };
+    const size_t wordCount = sizeof(kWords) / sizeof(kWords[0]);
+    std::ofstream out(path, std::ios::binary);
+    std::string buffer;
+    buffer.reserve(1 << 20);
+    uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+    uint64_t written = 0;
+    while (written < size && out) {
+        buffer.clear();
+        while (buffer.size() < (1u << 20)) {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            buffer += kWords[state % wordCount];
+        }
+        size_t length = static_cast<size_t>(std::min<uint64_t>(buffer.size(), size - written));
+        out.write(buffer.data(), static_cast<std::streamsize>(length));
+        written += length;
+    }
+    return static_cast<bool>(out);
+}
+
+bool BuildPackage(const fs::path& workDir, uint64_t payloadBytes, uint64_t fileBytes, bool prime,
+                  const fs::path& packagePath, std::string* error) {
+    fs::path staging = workDir / "staging";
+    std::error_code ec;
+    fs::remove_all(staging, ec);
+    fs::create_directories(staging / "payload", ec);
+    if (ec) {
+        *error = "Failed to create " + staging.u8string() + ": " + ec.message();
+        return false;
+    }
+    std::ofstream(staging / "AppxManifest.xml", std::ios::binary) << kManifest;
+    uint64_t index = 0;
+    for (uint64_t offset = 0; offset < payloadBytes; offset += fileBytes, index++) {
+        char name[32];
+        snprintf(name, sizeof(name), "data%05llu.bin", (unsigned long long)index);
+        if (!WriteSyntheticFile(staging / "payload" / name,
+                                std::min(fileBytes, payloadBytes - offset), index)) {
+            *error = std::string("Failed to write ") + name;
+            return false;
+        }
+    }
+
+    msix::PackOptions options;
+    options.sourceDir = staging.u8string();
+    options.outputPath = packagePath.u8string();
+    options.compressionLevel = 1;
+    options.primeDictionary = prime;
+    options.overwrite = true;
+    msix::PackStats stats;
+    if (!msix::PackDirectory(options, &stats, error)) {
+        return false;
+    }
+    printf("Packed %.0f MB into %.0f MB in %.1f s\n", stats.uncompressedBytes / (1024.0 * 1024.0),
+           stats.archiveBytes / (1024.0 * 1024.0), stats.seconds);
+    fs::remove_all(staging, ec);
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    fs::path workDir = "install_bench";
+    uint64_t payloadMb = 5120;
+    uint64_t fileMb = 64;
+    bool prime = false;
+    bool durable = false;
+    bool keep = false;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "w") && hasValue) {
+            workDir = fs::u8path(argv[++i]);
+        } else if (IsFlag(arg, "size") && hasValue) {
+            payloadMb = strtoull(argv[++i], nullptr, 10);
+        } else if (IsFlag(arg, "file") && hasValue) {
+            fileMb = strtoull(argv[++i], nullptr, 10);
+        } else if (IsFlag(arg, "prime")) {
+            prime = true;
+        } else if (IsFlag(arg, "sync")) {
+            durable = true;
+        } else if (IsFlag(arg, "keep")) {
+            keep = true;
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (payloadMb == 0 || fileMb == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::error_code ec;
+    fs::create_directories(workDir, ec);
+    fs::path packagePath = workDir / "bench.msix";
+    std::string error;
+    if (!(keep && fs::exists(packagePath, ec)) &&
+        !BuildPackage(workDir, payloadMb << 20, fileMb << 20, prime, packagePath, &error)) {
+        fprintf(stderr, "Failed to build the package: %s\n", error.c_str());
+        return 1;
+    }
+
+    msix::PackageReader reader;
+    if (!reader.Open(packagePath.u8string(), &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<unsigned> threadCounts;
+    for (unsigned threads = 1; threads < hardwareThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(hardwareThreads);
+
+    msix::InstallOptions options;
+    options.targetDir = (workDir / "installed").u8string();
+    options.durable = durable;
+    msix::InstallStats stats;
+    // Warm-up: faults the package into the page cache and creates the
+    // target, so every measured run also exercises the replace path.
+    if (!msix::InstallPackage(reader, options, &stats, &error)) {
+        fprintf(stderr, "Failed to install: %s\n", error.c_str());
+        return 1;
+    }
+    double mb = stats.extract.bytes / (1024.0 * 1024.0);
+    printf("Payload %.0f MB in %llu files; io_uring %s\n", mb,
+           (unsigned long long)stats.extract.fileCount,
+           stats.extract.ioUring ? "available" : "unavailable");
+    printf("%8s %14s %14s\n", "threads", "sync MB/s", "io_uring MB/s");
+    for (unsigned threads : threadCounts) {
+        double rates[2] = {0, 0};
+        for (int async = 0; async < 2; async++) {
+            options.threads = threads;
+            options.asyncWrites = async != 0;
+            if (!msix::InstallPackage(reader, options, &stats, &error)) {
+                fprintf(stderr, "Failed to install: %s\n", error.c_str());
+                return 1;
+            }
+            rates[async] = stats.seconds > 0 ? mb / stats.seconds : 0.0;
+        }
+        printf("%8u %14.1f %14.1f\n", threads, rates[0], rates[1]);
+    }
+    printf("Commits replaced the previous install by %s\n",
+           stats.exchanged ? "RENAME_EXCHANGE" : "two renames");
+
+    fs::remove_all(workDir / "installed", ec);
+    if (!keep) {
+        fs::remove(packagePath, ec);
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+#include "installer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace msix {
+namespace {
+
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+const char kStagingInfix[] = ".staging-";
+const char kOldInfix[] = ".old-";
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string UniqueTag() {
+    auto ticks = std::chrono::system_clock::now().time_since_epoch().count();
+    char tag[32];
+    snprintf(tag, sizeof(tag), "%llx", static_cast<unsigned long long>(ticks));
+    return tag;
+}
+
+// Removes "<target>.staging-*" and "<target>.old-*" left by installs that
+// did not finish. An old tree without a target is the previous version from
+// a crash between the two renames of Commit; it is put back instead.
+void RemoveLeftovers(const fs::path& target) {
+    std::string name = target.filename().u8string();
+    std::string staging = name + kStagingInfix;
+    std::string old = name + kOldInfix;
+    std::error_code ec;
+    bool haveTarget = fs::exists(target, ec);
+    std::vector<fs::path> leftovers;
+    for (fs::directory_iterator it(target.parent_path(), ec), end; !ec && it != end;
+         it.increment(ec)) {
+        std::string entry = it->path().filename().u8string();
+        if (entry.compare(0, staging.size(), staging) == 0) {
+            leftovers.push_back(it->path());
+        } else if (entry.compare(0, old.size(), old) == 0) {
+            std::error_code renameError;
+            if (!haveTarget) {
+                fs::rename(it->path(), target, renameError);
+                haveTarget = !renameError;
+                if (haveTarget) {
+                    continue;
+                }
+            }
+            leftovers.push_back(it->path());
+        }
+    }
+    for (const fs::path& path : leftovers) {
+        std::error_code removeError;
+        fs::remove_all(path, removeError);
+    }
+}
+
+bool SyncDirectory(const fs::path& directory) {
+#ifdef _WIN32
+    // NTFS journals directory changes; there is no directory fsync.
+    (void)directory;
+    return true;
+#else
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+#endif
+}
+
+bool SyncTree(const fs::path& root) {
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_directory(ec) && !SyncDirectory(it->path())) {
+            return false;
+        }
+    }
+    return !ec && SyncDirectory(root);
+}
+
+// Atomically swaps two existing directories. False when the platform or the
+// filesystem cannot.
+bool ExchangePaths(const fs::path& a, const fs::path& b) {
+#if defined(__linux__) && defined(SYS_renameat2)
+    return syscall(SYS_renameat2, AT_FDCWD, a.c_str(), AT_FDCWD, b.c_str(), RENAME_EXCHANGE) == 0;
+#else
+    (void)a;
+    (void)b;
+    return false;
+#endif
+}
+
+bool Commit(const fs::path& staging, const fs::path& target, const std::string& tag,
+            bool* replaced, bool* exchanged, std::string* error) {
+    std::error_code ec;
+    if (!fs::exists(target, ec)) {
+        fs::rename(staging, target, ec);
+        if (ec) {
+            *error = "Failed to move " + staging.u8string() + " to " + target.u8string() + ": " +
+                     ec.message();
+            return false;
+        }
+        return true;
+    }
+    *replaced = true;
+    if (ExchangePaths(staging, target)) {
+        // The staging path now holds the previous version.
+        *exchanged = true;
+        fs::remove_all(staging, ec);
+        return true;
+    }
+    fs::path old = target;
+    old += kOldInfix + tag;
+    fs::rename(target, old, ec);
+    if (ec) {
+        *error = "Failed to move " + target.u8string() + " aside: " + ec.message();
+        return false;
+    }
+    fs::rename(staging, target, ec);
+    if (ec) {
+        *error = "Failed to move " + staging.u8string() + " to " + target.u8string() + ": " +
+                 ec.message();
+        std::error_code restoreError;
+        fs::rename(old, target, restoreError);
+        return false;
+    }
+    fs::remove_all(old, ec);
+    return true;
+}
+
+}  // namespace
+
+StagedTree::~StagedTree() {
+    if (!staging_.empty()) {
+        std::error_code ec;
+        fs::remove_all(fs::u8path(staging_), ec);
+    }
+}
+
+bool StagedTree::Begin(const std::string& targetDir, std::string* error) {
+    fs::path target = fs::absolute(fs::u8path(targetDir)).lexically_normal();
+    if (target.filename().empty()) {
+        target = target.parent_path();
+    }
+    std::error_code ec;
+    fs::create_directories(target.parent_path(), ec);
+    if (ec) {
+        *error = "Failed to create " + target.parent_path().u8string() + ": " + ec.message();
+        return false;
+    }
+    RemoveLeftovers(target);
+
+    tag_ = UniqueTag();
+    fs::path staging = target;
+    staging += kStagingInfix + tag_;
+    if (!fs::create_directory(staging, ec)) {
+        *error = "Failed to create " + staging.u8string() + ": " +
+                 (ec ? ec.message() : std::string("already exists"));
+        return false;
+    }
+    target_ = target.u8string();
+    staging_ = staging.u8string();
+    return true;
+}
+
+bool StagedTree::Commit(bool durable, std::string* error) {
+    fs::path staging = fs::u8path(staging_);
+    fs::path target = fs::u8path(target_);
+    if (durable && !SyncTree(staging)) {
+        *error = "Failed to flush " + staging_;
+        return false;
+    }
+    if (!msix::Commit(staging, target, tag_, &replaced_, &exchanged_, error)) {
+        return false;
+    }
+    staging_.clear();
+    if (durable && !SyncDirectory(target.parent_path())) {
+        *error = "Failed to flush " + target.parent_path().u8string();
+        return false;
+    }
+    return true;
+}
+
+bool InstallPackage(PackageReader& reader, const InstallOptions& options, InstallStats* stats,
+                    std::string* error) {
+    auto startTime = std::chrono::steady_clock::now();
+    *stats = InstallStats();
+
+    StagedTree staged;
+    if (!staged.Begin(options.targetDir, error)) {
+        return false;
+    }
+    ExtractOptions extract;
+    extract.outputDir = staged.Path();
+    extract.threads = options.threads;
+    extract.verify = options.verify;
+    extract.asyncWrites = options.asyncWrites;
+    extract.syncFiles = options.durable;
+    if (!ExtractPackage(reader, extract, &stats->extract, error)) {
+        return false;
+    }
+
+    auto commitStart = std::chrono::steady_clock::now();
+    bool committed = staged.Commit(options.durable, error);
+    stats->replaced = staged.Replaced();
+    stats->exchanged = staged.Exchanged();
+    if (!committed) {
+        return false;
+    }
+    stats->commitSeconds = SecondsSince(commitStart);
+    stats->seconds = SecondsSince(startTime);
+    return true;
+}
+
+}  // namespace msix
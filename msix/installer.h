@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+
+#include "package_reader.h"
+
+// Staged package install: the package is extracted next to the target (in
+// "<target>.staging-<tag>", so on the same volume) with the parallel
+// extractor, every block verified against AppxBlockMap.xml while the pool
+// inflates the next ones and an io_uring writes the previous ones. Only a
+// complete, verified tree is committed, by rename, so the target is always
+// either the old version or the new one:
+//
+//  - Linux: renameat2(RENAME_EXCHANGE) swaps the staging tree and the
+//    current target in one step.
+//  - Elsewhere, or when the filesystem refuses the exchange, the target is
+//    renamed aside to "<target>.old-<tag>" and the staging tree renamed into
+//    place; after a crash between the two renames, the next install first
+//    moves the old tree back.
+//
+// The replaced tree is removed afterwards. Leftovers of interrupted installs
+// (staging and old trees) are removed before a new one starts, so installs
+// into the same target must not run concurrently.
+namespace msix {
+
+struct InstallOptions {
+    std::string targetDir;
+    unsigned threads = 0;  // 0 = one per hardware thread
+    bool verify = true;
+    bool asyncWrites = true;
+    // Flush files and directories to stable storage before the commit, so a
+    // power loss after it cannot expose a partly written tree.
+    bool durable = false;
+};
+
+struct InstallStats {
+    ExtractStats extract;
+    bool exchanged = false;  // committed with a single RENAME_EXCHANGE
+    bool replaced = false;   // a previous install was replaced
+    double commitSeconds = 0;
+    double seconds = 0;
+};
+
+bool InstallPackage(PackageReader& reader, const InstallOptions& options, InstallStats* stats,
+                    std::string* error);
+
+// The staging and commit steps of InstallPackage, for anything else that
+// writes a whole tree into a target (ApplyDelta). Begin() removes the
+// leftovers of interrupted installs and creates the empty staging
+// directory; Commit() moves it into place as described above. A staging
+// directory that is not committed is removed by the destructor.
+class StagedTree {
+public:
+    StagedTree() = default;
+    ~StagedTree();
+
+    StagedTree(const StagedTree&) = delete;
+    StagedTree& operator=(const StagedTree&) = delete;
+
+    bool Begin(const std::string& targetDir, std::string* error);
+
+    // Where to write the new tree.
+    const std::string& Path() const { return staging_; }
+
+    // With durable, the staged tree is flushed before the rename and the
+    // target's parent directory after it.
+    bool Commit(bool durable, std::string* error);
+
+    bool Replaced() const { return replaced_; }
+    bool Exchanged() const { return exchanged_; }
+
+private:
+    std::string target_;
+    std::string staging_;
+    std::string tag_;
+    bool replaced_ = false;
+    bool exchanged_ = false;
+};
+
+}  // namespace msix
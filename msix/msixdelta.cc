@@ -0,0 +1,105 @@
+// Block-level package updates: `diff` writes the blocks a new package
+// version adds over the old one, `apply` rebuilds the new version from the
+// old one plus that patch and, with /pack, packs it again.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "package_delta.h"
+#include "packer.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " diff /old <old.msix|dir|AppxBlockMap.xml>"
+              << " /new <new.msix> /patch <file>\n"
+              << "       " << program
+              << " apply /old <old.msix|dir> /patch <file> /d <output_dir> [/pack <new.msix>]\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+double Megabytes(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    std::string command = argv[1];
+    std::string oldPath;
+    std::string newPath;
+    std::string patchPath;
+    std::string outputDir;
+    std::string packPath;
+    for (int i = 2; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "old") && hasValue) {
+            oldPath = argv[++i];
+        } else if (IsFlag(arg, "new") && hasValue) {
+            newPath = argv[++i];
+        } else if (IsFlag(arg, "patch") && hasValue) {
+            patchPath = argv[++i];
+        } else if (IsFlag(arg, "d") && hasValue) {
+            outputDir = argv[++i];
+        } else if (IsFlag(arg, "pack") && hasValue) {
+            packPath = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    msix::DeltaStats stats;
+    std::string error;
+    if (command == "diff" && !oldPath.empty() && !newPath.empty() && !patchPath.empty()) {
+        if (!msix::CreateDelta(oldPath, newPath, patchPath, &stats, &error)) {
+            std::cerr << "Failed to diff: " << error << std::endl;
+            return 1;
+        }
+        printf("%llu files, %llu blocks: %llu from the old version, %llu new (%.2f MB)\n",
+               (unsigned long long)stats.files, (unsigned long long)stats.blocks,
+               (unsigned long long)stats.copiedBlocks, (unsigned long long)stats.literalBlocks,
+               Megabytes(stats.literalBytes));
+        printf("Patch: %.2f MB for a %.2f MB payload\n", Megabytes(stats.patchBytes),
+               Megabytes(stats.newBytes));
+        printf("Time: %.2f s\n", stats.seconds);
+        return 0;
+    }
+    if (command == "apply" && !oldPath.empty() && !patchPath.empty() && !outputDir.empty()) {
+        if (!msix::ApplyDelta(oldPath, patchPath, outputDir, &stats, &error)) {
+            std::cerr << "Failed to apply: " << error << std::endl;
+            return 1;
+        }
+        printf("Rebuilt %llu files (%.2f MB) in %s, every block verified\n",
+               (unsigned long long)stats.files, Megabytes(stats.newBytes), outputDir.c_str());
+        printf("Blocks: %llu from the old version, %llu from the patch\n",
+               (unsigned long long)stats.copiedBlocks, (unsigned long long)stats.literalBlocks);
+        printf("Time: %.2f s\n", stats.seconds);
+        if (!packPath.empty()) {
+            msix::PackOptions options;
+            options.sourceDir = outputDir;
+            options.outputPath = packPath;
+            options.overwrite = true;
+            msix::PackStats packStats;
+            if (!msix::PackDirectory(options, &packStats, &error)) {
+                std::cerr << "Failed to pack: " << error << std::endl;
+                return 1;
+            }
+            printf("Packed %s (unsigned)\n", packPath.c_str());
+        }
+        return 0;
+    }
+    PrintUsage(argv[0]);
+    return 1;
+}
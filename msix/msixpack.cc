@@ -0,0 +1,259 @@
+// Drop-in replacement for `MakeAppx.exe pack /d <dir> /p <file> /o` and
+// `MakeAppx.exe unpack /p <file> /d <dir>` that compresses, inflates and
+// hashes on every core, plus `install`, which stages a package and swaps it
+// into place atomically (see installer.h).
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "installer.h"
+#include "package_reader.h"
+#include "packer.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " pack /d <staging_dir> /p <output.msix> [options]\n"
+              << "       " << program
+              << " unpack /p <input.msix> /d <output_dir> [/j <threads>] [/noverify]\n"
+              << "       " << program
+              << " install /p <input.msix> /d <target_dir> [/j <threads>] [/noverify]\n"
+              << "         [/sync] [/noasync]\n"
+              << "       " << program << " list /p <input.msix>\n"
+              << "       " << program << " cat /p <input.msix> /f <name>\n"
+              << "Pack options:\n"
+              << "  /o            Overwrite the output file if it exists\n"
+              << "  /j <threads>  Worker threads (default: all hardware threads)\n"
+              << "  /l <level>    Deflate level 0-9 (default: 6)\n"
+              << "  /noprime      Compress every block independently (no dictionary priming)\n"
+              << "  /cache <dir>  Reuse encoded files from (and save them to) a repack cache\n"
+              << "Install options:\n"
+              << "  /sync         Flush the staged tree to disk before committing it\n"
+              << "  /noasync      Write from the inflating threads instead of an io_uring\n";
+}
+
+// Accepts both MakeAppx-style /flags and -flags.
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+int Pack(int argc, char* argv[]) {
+    msix::PackOptions options;
+    for (int i = 2; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "d") && hasValue) {
+            options.sourceDir = argv[++i];
+        } else if (IsFlag(arg, "p") && hasValue) {
+            options.outputPath = argv[++i];
+        } else if (IsFlag(arg, "o")) {
+            options.overwrite = true;
+        } else if (IsFlag(arg, "j") && hasValue) {
+            options.threads = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "l") && hasValue) {
+            options.compressionLevel = atoi(argv[++i]);
+        } else if (IsFlag(arg, "noprime")) {
+            options.primeDictionary = false;
+        } else if (IsFlag(arg, "cache") && hasValue) {
+            options.cacheDir = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.sourceDir.empty() || options.outputPath.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (options.compressionLevel < 0 || options.compressionLevel > 9) {
+        std::cerr << "Compression level must be between 0 and 9." << std::endl;
+        return 1;
+    }
+
+    msix::PackStats stats;
+    std::string error;
+    if (!msix::PackDirectory(options, &stats, &error)) {
+        std::cerr << "Failed to pack: " << error << std::endl;
+        return 1;
+    }
+
+    double mb = stats.uncompressedBytes / (1024.0 * 1024.0);
+    printf("Packed %llu files (%llu blocks) into %s\n",
+           (unsigned long long)stats.fileCount, (unsigned long long)stats.blockCount,
+           options.outputPath.c_str());
+    printf("Payload: %.2f MB -> %.2f MB, archive %.2f MB\n", mb,
+           stats.compressedBytes / (1024.0 * 1024.0), stats.archiveBytes / (1024.0 * 1024.0));
+    if (!options.cacheDir.empty()) {
+        printf("Cache: %llu files (%.2f MB) reused, %llu files (%.2f MB) recompressed\n",
+               (unsigned long long)stats.cacheHitFiles, stats.cacheHitBytes / (1024.0 * 1024.0),
+               (unsigned long long)stats.cacheMissFiles, stats.cacheMissBytes / (1024.0 * 1024.0));
+    }
+    printf("Time: %.2f s (%.1f MB/s)\n", stats.seconds,
+           stats.seconds > 0 ? mb / stats.seconds : 0.0);
+    return 0;
+}
+
+int Unpack(int argc, char* argv[]) {
+    std::string packagePath;
+    msix::ExtractOptions options;
+    for (int i = 2; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "p") && hasValue) {
+            packagePath = argv[++i];
+        } else if (IsFlag(arg, "d") && hasValue) {
+            options.outputDir = argv[++i];
+        } else if (IsFlag(arg, "j") && hasValue) {
+            options.threads = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "noverify")) {
+            options.verify = false;
+        } else if (IsFlag(arg, "o")) {
+            // MakeAppx compatibility; existing files are always overwritten.
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (packagePath.empty() || options.outputDir.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    msix::PackageReader reader;
+    msix::ExtractStats stats;
+    std::string error;
+    if (!reader.Open(packagePath, &error) || !msix::ExtractPackage(reader, options, &stats, &error)) {
+        std::cerr << "Failed to unpack: " << error << std::endl;
+        return 1;
+    }
+    double mb = stats.bytes / (1024.0 * 1024.0);
+    printf("Extracted %llu files (%.2f MB, %llu block-parallel) to %s%s\n",
+           (unsigned long long)stats.fileCount, mb, (unsigned long long)stats.blockParallelFiles,
+           options.outputDir.c_str(), options.verify ? ", verified" : "");
+    printf("Time: %.2f s (%.1f MB/s)\n", stats.seconds,
+           stats.seconds > 0 ? mb / stats.seconds : 0.0);
+    return 0;
+}
+
+int Install(int argc, char* argv[]) {
+    std::string packagePath;
+    msix::InstallOptions options;
+    for (int i = 2; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "p") && hasValue) {
+            packagePath = argv[++i];
+        } else if (IsFlag(arg, "d") && hasValue) {
+            options.targetDir = argv[++i];
+        } else if (IsFlag(arg, "j") && hasValue) {
+            options.threads = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "noverify")) {
+            options.verify = false;
+        } else if (IsFlag(arg, "sync")) {
+            options.durable = true;
+        } else if (IsFlag(arg, "noasync")) {
+            options.asyncWrites = false;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (packagePath.empty() || options.targetDir.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    msix::PackageReader reader;
+    msix::InstallStats stats;
+    std::string error;
+    if (!reader.Open(packagePath, &error) || !msix::InstallPackage(reader, options, &stats, &error)) {
+        std::cerr << "Failed to install: " << error << std::endl;
+        return 1;
+    }
+    double mb = stats.extract.bytes / (1024.0 * 1024.0);
+    printf("Installed %llu files (%.2f MB) to %s%s\n", (unsigned long long)stats.extract.fileCount,
+           mb, options.targetDir.c_str(),
+           !stats.replaced ? "" : stats.exchanged ? ", exchanged with the previous tree"
+                                                  : ", replaced the previous tree");
+    printf("Writes: %s; commit %.3f s\n", stats.extract.ioUring ? "io_uring" : "synchronous",
+           stats.commitSeconds);
+    printf("Time: %.2f s (%.1f MB/s)\n", stats.seconds,
+           stats.seconds > 0 ? mb / stats.seconds : 0.0);
+    return 0;
+}
+
+// list and cat: random access through the central directory index.
+int Inspect(int argc, char* argv[], bool list) {
+    std::string packagePath;
+    std::string name;
+    for (int i = 2; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "p") && hasValue) {
+            packagePath = argv[++i];
+        } else if (IsFlag(arg, "f") && hasValue && !list) {
+            name = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (packagePath.empty() || (!list && name.empty())) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    msix::PackageReader reader;
+    std::string error;
+    if (!reader.Open(packagePath, &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    if (list) {
+        for (const msix::PackageEntry& entry : reader.Entries()) {
+            printf("%12llu %12llu  %s  %s\n", (unsigned long long)entry.uncompressedSize,
+                   (unsigned long long)entry.compressedSize,
+                   entry.method == 0 ? "stored  " : "deflated", entry.name.c_str());
+        }
+        return 0;
+    }
+
+    const msix::PackageEntry* entry = reader.Find(name);
+    if (entry == nullptr) {
+        std::cerr << name << " not found in " << packagePath << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    if (!reader.LoadBlockMap(&error) || !reader.ReadEntry(*entry, &data, &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    fwrite(data.data(), 1, data.size(), stdout);
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "pack") == 0) {
+        return Pack(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "unpack") == 0) {
+        return Unpack(argc, argv);
+    }
+    if (argc >= 2 && strcmp(argv[1], "install") == 0) {
+        return Install(argc, argv);
+    }
+    if (argc >= 2 && (strcmp(argv[1], "list") == 0 || strcmp(argv[1], "cat") == 0)) {
+        return Inspect(argc, argv, strcmp(argv[1], "list") == 0);
+    }
+    PrintUsage(argv[0]);
+    return 1;
+}
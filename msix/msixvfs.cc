@@ -0,0 +1,304 @@
+// Serves a package's files without extracting it (see package_vfs.h): lists
+// and reads them, measures how long it takes to get to the first byte, and,
+// when built against libfuse3 (MSIX_HAVE_FUSE), mounts the package
+// read-only.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "package_vfs.h"
+
+#ifdef MSIX_HAVE_FUSE
+#define FUSE_USE_VERSION 31
+#include <fuse.h>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " ls /p <input.msix> [/f <dir>]\n"
+              << "       " << program << " cat /p <input.msix> /f <name>\n"
+              << "       " << program << " bench /p <input.msix> [/f <name>]...\n"
+#ifdef MSIX_HAVE_FUSE
+              << "       " << program << " mount /p <input.msix> /d <mountpoint> [/fg]\n"
+#endif
+              << "Options:\n"
+              << "  /cache <MB>     Decompressed block cache size (default: 256)\n"
+              << "  /prefetch <n>   Blocks read ahead on sequential reads (default: 8, 0 = off)\n"
+              << "bench opens the package, then reads the given files (default: all) and\n"
+              << "reports the time to the first byte and the cache behaviour.\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+// Reads a whole file through the VFS in 1 MB pieces, handing each to sink.
+template <class Sink>
+bool ReadAll(msix::PackageVfs& vfs, const std::string& name, Sink&& sink, std::string* error) {
+    std::unique_ptr<msix::VfsFile> file = vfs.OpenFile(name);
+    if (file == nullptr) {
+        *error = name + " is not a file in the package";
+        return false;
+    }
+    std::vector<uint8_t> buffer(1 << 20);
+    for (uint64_t offset = 0;;) {
+        int64_t count = file->Read(offset, buffer.data(), buffer.size(), error);
+        if (count < 0) {
+            return false;
+        }
+        if (count == 0) {
+            return true;
+        }
+        sink(buffer.data(), static_cast<size_t>(count));
+        offset += static_cast<uint64_t>(count);
+    }
+}
+
+void ListFiles(const msix::PackageVfs& vfs, const std::string& dir,
+               std::vector<std::string>* files) {
+    std::vector<msix::VfsDirEntry> entries;
+    if (!vfs.ReadDir(dir, &entries)) {
+        return;
+    }
+    for (const msix::VfsDirEntry& entry : entries) {
+        std::string path = dir.empty() ? entry.name : dir + "/" + entry.name;
+        if (entry.directory) {
+            ListFiles(vfs, path, files);
+        } else {
+            files->push_back(path);
+        }
+    }
+}
+
+int Bench(msix::PackageVfs& vfs, std::vector<std::string> names, double openMs) {
+    if (names.empty()) {
+        ListFiles(vfs, "", &names);
+    }
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    double firstByteMs = -1;
+    uint64_t bytes = 0;
+    for (const std::string& name : names) {
+        bool ok = ReadAll(
+            vfs, name,
+            [&](const uint8_t*, size_t length) {
+                if (firstByteMs < 0) {
+                    firstByteMs = MillisecondsSince(start);
+                }
+                bytes += length;
+            },
+            &error);
+        if (!ok) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+    double readMs = MillisecondsSince(start);
+    msix::VfsCacheStats stats = vfs.CacheStats();
+    printf("Open: %.2f ms; first byte after %.2f ms more\n", openMs,
+           firstByteMs < 0 ? 0.0 : firstByteMs);
+    printf("Read %zu files (%.2f MB) in %.1f ms (%.1f MB/s)\n", names.size(),
+           bytes / (1024.0 * 1024.0), readMs,
+           readMs > 0 ? bytes / (1024.0 * 1024.0) / (readMs / 1000) : 0.0);
+    printf("Cache: %llu hits, %llu misses, %llu blocks inflated (%llu prefetched), "
+           "%llu evicted, %.2f MB held\n",
+           (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+           (unsigned long long)stats.inflatedBlocks, (unsigned long long)stats.prefetchedBlocks,
+           (unsigned long long)stats.evictedBlocks, stats.cachedBytes / (1024.0 * 1024.0));
+    return 0;
+}
+
+#ifdef MSIX_HAVE_FUSE
+
+msix::PackageVfs* MountedVfs() {
+    return static_cast<msix::PackageVfs*>(fuse_get_context()->private_data);
+}
+
+int FuseGetattr(const char* path, struct stat* st, struct fuse_file_info*) {
+    msix::VfsStat stat;
+    if (!MountedVfs()->Stat(path, &stat)) {
+        return -ENOENT;
+    }
+    memset(st, 0, sizeof(*st));
+    st->st_mode = stat.directory ? (S_IFDIR | 0555) : (S_IFREG | 0444);
+    st->st_nlink = stat.directory ? 2 : 1;
+    st->st_size = static_cast<off_t>(stat.size);
+    return 0;
+}
+
+int FuseReaddir(const char* path, void* buffer, fuse_fill_dir_t filler, off_t,
+                struct fuse_file_info*, enum fuse_readdir_flags) {
+    std::vector<msix::VfsDirEntry> entries;
+    if (!MountedVfs()->ReadDir(path, &entries)) {
+        return -ENOENT;
+    }
+    filler(buffer, ".", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+    filler(buffer, "..", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+    for (const msix::VfsDirEntry& entry : entries) {
+        if (filler(buffer, entry.name.c_str(), nullptr, 0, static_cast<fuse_fill_dir_flags>(0))) {
+            break;
+        }
+    }
+    return 0;
+}
+
+int FuseOpen(const char* path, struct fuse_file_info* info) {
+    if ((info->flags & O_ACCMODE) != O_RDONLY) {
+        return -EROFS;
+    }
+    std::unique_ptr<msix::VfsFile> file = MountedVfs()->OpenFile(path);
+    if (file == nullptr) {
+        msix::VfsStat stat;
+        return MountedVfs()->Stat(path, &stat) ? -EISDIR : -ENOENT;
+    }
+    info->fh = reinterpret_cast<uint64_t>(file.release());
+    // The package never changes under the mount.
+    info->keep_cache = 1;
+    return 0;
+}
+
+int FuseRead(const char*, char* buffer, size_t size, off_t offset, struct fuse_file_info* info) {
+    msix::VfsFile* file = reinterpret_cast<msix::VfsFile*>(info->fh);
+    std::string error;
+    int64_t count = file->Read(static_cast<uint64_t>(offset), buffer, size, &error);
+    if (count < 0) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return -EIO;
+    }
+    return static_cast<int>(count);
+}
+
+int FuseRelease(const char*, struct fuse_file_info* info) {
+    delete reinterpret_cast<msix::VfsFile*>(info->fh);
+    return 0;
+}
+
+void* FuseInit(struct fuse_conn_info*, struct fuse_config* config) {
+    config->kernel_cache = 1;
+    return fuse_get_context()->private_data;
+}
+
+int Mount(msix::PackageVfs& vfs, const std::string& mountPoint, bool foreground) {
+    struct fuse_operations operations;
+    memset(&operations, 0, sizeof(operations));
+    operations.getattr = FuseGetattr;
+    operations.readdir = FuseReaddir;
+    operations.open = FuseOpen;
+    operations.read = FuseRead;
+    operations.release = FuseRelease;
+    operations.init = FuseInit;
+
+    std::vector<std::string> args = {"msixvfs", mountPoint, "-o",
+                                     "ro,fsname=msix,default_permissions"};
+    if (foreground) {
+        args.push_back("-f");
+    }
+    std::vector<char*> argv;
+    for (std::string& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    return fuse_main(static_cast<int>(argv.size()), argv.data(), &operations, &vfs);
+}
+
+#endif
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    std::string command = argv[1];
+    std::string packagePath;
+    std::string mountPoint;
+    std::vector<std::string> names;
+    msix::VfsOptions options;
+    bool foreground = false;
+    for (int i = 2; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "p") && hasValue) {
+            packagePath = argv[++i];
+        } else if (IsFlag(arg, "f") && hasValue) {
+            names.push_back(argv[++i]);
+        } else if (IsFlag(arg, "d") && hasValue) {
+            mountPoint = argv[++i];
+        } else if (IsFlag(arg, "cache") && hasValue) {
+            options.cacheBytes = strtoull(argv[++i], nullptr, 10) << 20;
+        } else if (IsFlag(arg, "prefetch") && hasValue) {
+            options.prefetchBlocks = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "fg")) {
+            foreground = true;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (packagePath.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    msix::PackageVfs vfs;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!vfs.Open(packagePath, options, &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    double openMs = MillisecondsSince(start);
+
+    if (command == "ls" && names.size() <= 1) {
+        std::vector<msix::VfsDirEntry> entries;
+        if (!vfs.ReadDir(names.empty() ? "" : names[0], &entries)) {
+            std::cerr << "No such directory" << std::endl;
+            return 1;
+        }
+        for (const msix::VfsDirEntry& entry : entries) {
+            if (entry.directory) {
+                printf("%12s  %s/\n", "", entry.name.c_str());
+            } else {
+                printf("%12llu  %s\n", (unsigned long long)entry.size, entry.name.c_str());
+            }
+        }
+        return 0;
+    }
+    if (command == "cat" && names.size() == 1) {
+        bool ok = ReadAll(
+            vfs, names[0],
+            [](const uint8_t* data, size_t length) { fwrite(data, 1, length, stdout); }, &error);
+        if (!ok) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (command == "bench") {
+        return Bench(vfs, names, openMs);
+    }
+#ifdef MSIX_HAVE_FUSE
+    if (command == "mount" && !mountPoint.empty()) {
+        return Mount(vfs, mountPoint, foreground);
+    }
+#else
+    (void)foreground;
+#endif
+    PrintUsage(argv[0]);
+    return 1;
+}
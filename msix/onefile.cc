@@ -0,0 +1,630 @@
+#include "onefile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "file_io.h"
+#include "sha256.h"
+#include "stdlib_zip.h"
+#include "zip_format.h"
+
+namespace fs = std::filesystem;
+
+namespace msix {
+
+namespace {
+
+const char kBootstrapName[] = "__main__.py";
+const char kManifestName[] = "onefile/natives";
+// Written last into a native cache directory; see IsCompleteCache.
+const char kCompleteName[] = ".complete";
+const char kPythonPrefix[] = "py/";
+const char kNativePrefix[] = "native/";
+
+// Stdlib directories that an application never imports.
+const std::set<std::string> kSkipStdlibDirectories = {
+    "__pycache__", "site-packages", "lib-dynload", "test", "tests", "idle_test",
+};
+
+// One archive entry, read when the archive is written so that large trees
+// are never held in memory at once.
+struct Source {
+    fs::path path;                        // a file on disk, or
+    const PackageEntry* entry = nullptr;  // an entry of the stdlib zip, or
+    std::vector<uint8_t> bytes;           // generated content
+};
+
+struct Contents {
+    // Sorted by name, which is also the central directory order.
+    std::map<std::string, Source> files;
+    // Extension modules below the native root, by module name.
+    std::map<std::string, std::string> nativeModules;
+};
+
+bool EndsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string HexDigest(const Sha256Digest& digest) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string text;
+    for (uint8_t byte : digest) {
+        text += kHex[byte >> 4];
+        text += kHex[byte & 15];
+    }
+    return text;
+}
+
+bool IsExtensionModule(const std::string& name) {
+    return EndsWith(name, ".pyd") || EndsWith(name, ".so");
+}
+
+// Files the loader has to map from disk: extension modules and the shared
+// libraries they (or the interpreter) link, including versioned libfoo.so.1.
+bool IsNative(const std::string& name) {
+    return IsExtensionModule(name) || EndsWith(name, ".dll") || EndsWith(name, ".dylib") ||
+           name.find(".so.") != std::string::npos;
+}
+
+// "pkg/sub/mod.cp313-win_amd64.pyd" -> "pkg.sub.mod".
+std::string ModuleName(const std::string& relative) {
+    size_t slash = relative.rfind('/');
+    size_t start = slash == std::string::npos ? 0 : slash + 1;
+    std::string name = relative.substr(0, relative.find('.', start));
+    for (char& c : name) {
+        if (c == '/') {
+            c = '.';
+        }
+    }
+    return name;
+}
+
+void AddFile(Contents* contents, const std::string& name, const fs::path& path) {
+    // The first source of a name wins: application, libraries, stdlib.
+    if (contents->files.count(name) == 0) {
+        contents->files[name].path = path;
+    }
+}
+
+// Adds a directory tree: Python files and data under py/, native files
+// under native/ at the same relative path.
+bool AddTree(Contents* contents, const fs::path& root, const std::set<std::string>& skip,
+             std::string* error) {
+    std::error_code ec;
+    fs::recursive_directory_iterator it(root, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        std::string leaf = it->path().filename().u8string();
+        if (it->is_directory(ec)) {
+            // config-3.X-<triplet> holds the static libpython of a POSIX build.
+            if (leaf == "__pycache__" || skip.count(leaf) != 0 ||
+                (!skip.empty() && leaf.compare(0, 7, "config-") == 0)) {
+                it.disable_recursion_pending();
+            }
+            continue;
+        }
+        if (!it->is_regular_file(ec)) {
+            continue;
+        }
+        std::string relative = it->path().lexically_relative(root).generic_u8string();
+        if (IsNative(relative)) {
+            AddFile(contents, kNativePrefix + relative, it->path());
+            if (IsExtensionModule(relative) && relative.find('/') != std::string::npos) {
+                contents->nativeModules.emplace(ModuleName(relative), relative);
+            }
+        } else if (!EndsWith(relative, ".pyc")) {
+            AddFile(contents, kPythonPrefix + relative, it->path());
+        }
+    }
+    if (ec) {
+        *error = "Cannot read " + root.u8string() + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+// Files given with /native, and the native files directly inside the
+// directories given with it, go to the root of the native cache.
+bool AddNatives(Contents* contents, const std::string& input, std::string* error) {
+    fs::path path = fs::u8path(input);
+    std::error_code ec;
+    if (fs::is_regular_file(path, ec)) {
+        AddFile(contents, kNativePrefix + path.filename().u8string(), path);
+        return true;
+    }
+    fs::directory_iterator it(path, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        std::string leaf = it->path().filename().u8string();
+        if (it->is_regular_file(ec) && IsNative(leaf)) {
+            AddFile(contents, kNativePrefix + leaf, it->path());
+        }
+    }
+    if (ec) {
+        *error = "Cannot read " + input + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+// Compiles the .py files taken from disk; files that do not compile stay
+// as source.
+bool CompileSources(const std::string& python, Contents* contents, uint64_t* compiled,
+                    std::string* error) {
+    std::vector<std::string> names;
+    std::vector<PythonSource> sources;
+    for (const auto& file : contents->files) {
+        if (EndsWith(file.first, ".py") && !file.second.path.empty()) {
+            names.push_back(file.first);
+            sources.push_back({file.second.path.u8string(),
+                               file.first.substr(strlen(kPythonPrefix))});
+        }
+    }
+    std::vector<std::vector<uint8_t>> bytecode;
+    if (!CompileSourceless(python, sources, &bytecode, error)) {
+        return false;
+    }
+    for (size_t i = 0; i < names.size(); i++) {
+        if (bytecode[i].empty()) {
+            continue;
+        }
+        contents->files[names[i] + "c"].bytes = std::move(bytecode[i]);
+        contents->files.erase(names[i]);
+        (*compiled)++;
+    }
+    return true;
+}
+
+std::vector<uint8_t> BootstrapScript(const std::string& mainModule,
+                                     const std::map<std::string, std::string>& nativeModules) {
+    std::ostringstream script;
+    script << "# Generated by onefilepack. Runs " << mainModule
+           << " from this executable; see msix/onefile.h.\n"
+              "import os\n"
+              "import sys\n"
+              "from importlib.machinery import ExtensionFileLoader\n"
+              "from importlib.util import spec_from_file_location\n"
+              "\n"
+              "_NATIVE_DIR = os.environ.pop('MSIX_ONEFILE_NATIVE', '')\n"
+              "_NATIVE_MODULES = {\n";
+    for (const auto& module : nativeModules) {
+        script << "    '" << module.first << "': '" << module.second << "',\n";
+    }
+    script << "}\n"
+              "\n"
+              "\n"
+              "class _NativeFinder:\n"
+              "    \"\"\"Extension modules of packages that are imported from the archive.\"\"\"\n"
+              "\n"
+              "    @staticmethod\n"
+              "    def find_spec(name, path=None, target=None):\n"
+              "        relative = _NATIVE_MODULES.get(name)\n"
+              "        if relative is None:\n"
+              "            return None\n"
+              "        location = os.path.join(_NATIVE_DIR, *relative.split('/'))\n"
+              "        return spec_from_file_location(\n"
+              "            name, location, loader=ExtensionFileLoader(name, location))\n"
+              "\n"
+              "\n"
+              "sys.meta_path.append(_NativeFinder)\n"
+              "if hasattr(os, 'add_dll_directory') and _NATIVE_DIR:\n"
+              "    _DLL_DIRECTORY = os.add_dll_directory(_NATIVE_DIR)\n"
+              "\n"
+              "import runpy\n"
+              "\n"
+              "runpy.run_module('"
+           << mainModule << "', run_name='__main__', alter_sys=True)\n";
+    std::string text = script.str();
+    return std::vector<uint8_t>(text.begin(), text.end());
+}
+
+// The "X.Y" that follows kOnefilePythonMarker in the bootloader. The bare
+// marker also appears among the bootloader's strings, so only an occurrence
+// followed by a version counts.
+bool BootloaderPythonVersion(const std::vector<uint8_t>& bootloader, std::string* version) {
+    const char* begin = reinterpret_cast<const char*>(bootloader.data());
+    const char* end = begin + bootloader.size();
+    size_t markerLength = strlen(kOnefilePythonMarker);
+    for (const char* p = begin; (p = std::search(p, end, kOnefilePythonMarker,
+                                                  kOnefilePythonMarker + markerLength)) != end;
+         p++) {
+        const char* digits = p + markerLength;
+        const char* q = digits;
+        while (q < end && (isdigit(static_cast<unsigned char>(*q)) || *q == '.')) {
+            q++;
+        }
+        std::string text(digits, q);
+        size_t dot = text.find('.');
+        if (dot != std::string::npos && dot > 0 && dot + 1 < text.size()) {
+            *version = text;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool InterpreterVersion(const std::string& python, std::string* version, std::string* error) {
+    std::string command = ShellCommand(
+        Quote(python) + " -I -S -c \"import sys; print('%d.%d' % sys.version_info[:2])\"");
+    if (!ReadCommandOutput(command, version)) {
+        *error = "Cannot run " + python;
+        return false;
+    }
+    version->erase(version->find_last_not_of("\r\n") + 1);
+    return true;
+}
+
+// "X.Y" of an interpreter library among the native files, e.g. 3.13 for
+// python313.dll or libpython3.13.so.1.0; empty for other files (including
+// the stable-ABI python3.dll).
+std::string LibraryPythonVersion(const std::string& leaf) {
+    std::string name = leaf;
+    for (char& c : name) {
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+    if (name.compare(0, 9, "libpython") == 0) {
+        size_t end = name.find_first_not_of("0123456789.", 9);
+        std::string version = name.substr(9, end == std::string::npos ? end : end - 9);
+        while (!version.empty() && version.back() == '.') {
+            version.pop_back();
+        }
+        return version.find('.') != std::string::npos ? version : std::string();
+    }
+    if (name.compare(0, 6, "python") == 0 && EndsWith(name, ".dll")) {
+        std::string digits = name.substr(6, name.size() - 10);
+        if (digits.size() >= 2 && digits.find_first_not_of("0123456789") == std::string::npos) {
+            return digits.substr(0, 1) + "." + digits.substr(1);
+        }
+    }
+    return std::string();
+}
+
+// Refuses an interpreter or interpreter library that does not match the
+// version the bootloader embeds.
+bool CheckPythonVersion(const OnefileOptions& options, const Contents& contents,
+                        const std::string& version, std::string* error) {
+    if (!options.python.empty()) {
+        std::string pythonVersion;
+        if (!InterpreterVersion(options.python, &pythonVersion, error)) {
+            return false;
+        }
+        if (pythonVersion != version) {
+            *error = options.python + " is Python " + pythonVersion +
+                     ", but the bootloader embeds Python " + version;
+            return false;
+        }
+    }
+    for (const auto& file : contents.files) {
+        if (file.first.compare(0, strlen(kNativePrefix), kNativePrefix) != 0) {
+            continue;
+        }
+        std::string libraryVersion =
+            LibraryPythonVersion(file.first.substr(file.first.rfind('/') + 1));
+        if (!libraryVersion.empty() && libraryVersion != version) {
+            *error = file.first + " is Python " + libraryVersion +
+                     ", but the bootloader embeds Python " + version;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LoadSource(const PackageReader& stdlib, const Source& source, std::vector<uint8_t>* data,
+                std::string* error) {
+    if (source.entry != nullptr) {
+        return stdlib.ReadEntry(*source.entry, data, error);
+    }
+    if (!source.path.empty()) {
+        if (!ReadWholeFile(source.path, data)) {
+            *error = "Cannot read " + source.path.u8string();
+            return false;
+        }
+        return true;
+    }
+    *data = source.bytes;
+    return true;
+}
+
+// The native manifest; each native file is read once here to be hashed.
+bool BuildManifest(const PackageReader& stdlib, Contents* contents, OnefileStats* stats,
+                   std::string* error) {
+    std::string manifest;
+    std::vector<uint8_t> data;
+    for (const auto& file : contents->files) {
+        if (file.first.compare(0, strlen(kNativePrefix), kNativePrefix) != 0) {
+            continue;
+        }
+        if (!LoadSource(stdlib, file.second, &data, error)) {
+            return false;
+        }
+        manifest += HexDigest(Sha256Hash(data.data(), data.size())) + "\t" +
+                    std::to_string(data.size()) + "\t" +
+                    file.first.substr(strlen(kNativePrefix)) + "\n";
+        stats->nativeFiles++;
+        stats->nativeBytes += data.size();
+    }
+    contents->files[kManifestName].bytes.assign(manifest.begin(), manifest.end());
+    return true;
+}
+
+bool WriteArchive(const OnefileOptions& options, const std::vector<uint8_t>& bootloader,
+                  const PackageReader& stdlib, const Contents& contents, OnefileStats* stats,
+                  std::string* error) {
+    OutputFile output;
+    if (!output.Open(options.outputPath)) {
+        *error = "Cannot create " + options.outputPath;
+        return false;
+    }
+    if (!output.Write(bootloader.data(), bootloader.size())) {
+        *error = "Write to " + options.outputPath + " failed";
+        return false;
+    }
+
+    // Offsets count from the start of the executable, so both zipimport and
+    // PackageReader open it as an ordinary zip.
+    StoredZipWriter writer(&output, options.outputPath, options.alignment);
+    std::vector<uint8_t> data;
+    for (const auto& file : contents.files) {
+        if (!LoadSource(stdlib, file.second, &data, error) ||
+            !writer.Add(file.first, data, error)) {
+            return false;
+        }
+    }
+    if (!writer.Finish(error)) {
+        return false;
+    }
+    stats->archiveBytes = output.Offset() - bootloader.size();
+    if (!output.Close()) {
+        *error = "Write to " + options.outputPath + " failed";
+        return false;
+    }
+#ifndef _WIN32
+    std::error_code ec;
+    fs::permissions(fs::u8path(options.outputPath),
+                    fs::perms::owner_exec | fs::perms::group_exec | fs::perms::others_exec,
+                    fs::perm_options::add, ec);
+#endif
+    return true;
+}
+
+struct NativeFile {
+    std::string digest;
+    uint64_t size = 0;
+    std::string relative;
+};
+
+bool ParseManifest(const uint8_t* manifest, size_t manifestSize, std::vector<NativeFile>* files,
+                   std::string* error) {
+    std::istringstream lines(std::string(reinterpret_cast<const char*>(manifest), manifestSize));
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t tab1 = line.find('\t');
+        size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+        if (tab2 == std::string::npos) {
+            *error = std::string("Damaged ") + kManifestName;
+            return false;
+        }
+        NativeFile file;
+        file.digest = line.substr(0, tab1);
+        file.size = strtoull(line.c_str() + tab1 + 1, nullptr, 10);
+        file.relative = line.substr(tab2 + 1);
+        files->push_back(std::move(file));
+    }
+    return true;
+}
+
+// A cache directory is complete when it holds kCompleteName with the full
+// manifest hash, written after every native file, and each native file
+// still has its size. Anything else (an interrupted copy from before the
+// marker existed, files deleted by a cleaner) is extracted again.
+bool IsCompleteCache(const fs::path& dir, const std::string& manifestHash,
+                     const std::vector<NativeFile>& files) {
+    std::vector<uint8_t> marker;
+    if (!ReadWholeFile(dir / kCompleteName, &marker) ||
+        std::string(marker.begin(), marker.end()) != manifestHash) {
+        return false;
+    }
+    std::error_code ec;
+    for (const NativeFile& file : files) {
+        if (fs::file_size(dir / fs::u8path(file.relative), ec) != file.size || ec) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool BuildOnefile(const OnefileOptions& options, OnefileStats* stats, std::string* error) {
+    auto start = std::chrono::steady_clock::now();
+    *stats = OnefileStats();
+    if (options.alignment > 0x8000) {
+        *error = "Alignment must be at most 32 KB";
+        return false;
+    }
+    std::vector<uint8_t> bootloader;
+    if (!ReadWholeFile(fs::u8path(options.bootloader), &bootloader) || bootloader.empty()) {
+        *error = "Cannot read the bootloader " + options.bootloader;
+        return false;
+    }
+    std::string version;
+    if (!BootloaderPythonVersion(bootloader, &version)) {
+        *error = options.bootloader + " does not name its Python version; rebuild it";
+        return false;
+    }
+
+    Contents contents;
+    std::error_code ec;
+    fs::path app = fs::u8path(options.app);
+    std::string mainModule = options.mainModule;
+    if (fs::is_regular_file(app, ec)) {
+        AddFile(&contents, kPythonPrefix + app.filename().u8string(), app);
+        if (mainModule.empty()) {
+            mainModule = app.stem().u8string();
+        }
+    } else if (fs::is_directory(app, ec)) {
+        if (!AddTree(&contents, app, {}, error)) {
+            return false;
+        }
+    } else {
+        *error = "Cannot find the application " + options.app;
+        return false;
+    }
+    if (mainModule.empty()) {
+        *error = "The main module must be named when the application is a directory";
+        return false;
+    }
+    for (const std::string& library : options.libraries) {
+        if (!AddTree(&contents, fs::u8path(library), {}, error)) {
+            return false;
+        }
+    }
+
+    PackageReader stdlib;
+    if (fs::is_directory(fs::u8path(options.stdlib), ec)) {
+        if (!AddTree(&contents, fs::u8path(options.stdlib), kSkipStdlibDirectories, error)) {
+            return false;
+        }
+    } else if (!options.stdlib.empty()) {
+        if (!stdlib.Open(options.stdlib, error)) {
+            return false;
+        }
+        for (const PackageEntry& entry : stdlib.Entries()) {
+            std::string name = kPythonPrefix + entry.name;
+            if (!EndsWith(name, "/") && contents.files.count(name) == 0) {
+                contents.files[name].entry = &entry;
+            }
+        }
+    }
+    for (const std::string& native : options.natives) {
+        if (!AddNatives(&contents, native, error)) {
+            return false;
+        }
+    }
+
+    if (!CheckPythonVersion(options, contents, version, error)) {
+        return false;
+    }
+    contents.files[kOnefilePythonEntry].bytes.assign(version.begin(), version.end());
+
+    if (!options.python.empty() &&
+        !CompileSources(options.python, &contents, &stats->compiledFiles, error)) {
+        return false;
+    }
+    for (const auto& file : contents.files) {
+        if (EndsWith(file.first, ".py") || EndsWith(file.first, ".pyc")) {
+            stats->pythonFiles++;
+        }
+    }
+    contents.files[kBootstrapName].bytes = BootstrapScript(mainModule, contents.nativeModules);
+    if (!BuildManifest(stdlib, &contents, stats, error)) {
+        return false;
+    }
+    if (contents.files.size() > 0xFFFF) {
+        *error = "Too many entries for a plain zip archive";
+        return false;
+    }
+    if (!WriteArchive(options, bootloader, stdlib, contents, stats, error)) {
+        return false;
+    }
+    stats->seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+bool PrepareNativeCache(const PackageReader& reader, const std::string& cacheRoot,
+                        std::string* nativeDir, uint64_t* extracted, std::string* error) {
+    *extracted = 0;
+    const PackageEntry* manifestEntry = reader.Find(kManifestName);
+    const uint8_t* manifest = manifestEntry != nullptr ? reader.EntryData(*manifestEntry) : nullptr;
+    if (manifest == nullptr || manifestEntry->method != zip::kMethodStored) {
+        *error = "The executable carries no onefile archive";
+        return false;
+    }
+    size_t manifestSize = static_cast<size_t>(manifestEntry->uncompressedSize);
+    std::vector<NativeFile> files;
+    if (!ParseManifest(manifest, manifestSize, &files, error)) {
+        return false;
+    }
+    std::string manifestHash = HexDigest(Sha256Hash(manifest, manifestSize));
+    std::string key = manifestHash.substr(0, 16);
+    fs::path root = fs::u8path(cacheRoot);
+    fs::path target = root / key;
+    *nativeDir = target.u8string();
+    std::error_code ec;
+    if (IsCompleteCache(target, manifestHash, files)) {
+        return true;
+    }
+
+    auto stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+    fs::path staging = root / (key + ".tmp-" + std::to_string(stamp));
+    fs::create_directories(staging, ec);
+    if (ec) {
+        *error = "Cannot create " + staging.u8string() + ": " + ec.message();
+        return false;
+    }
+    bool ok = true;
+    for (const NativeFile& file : files) {
+        const PackageEntry* entry = reader.Find(kNativePrefix + file.relative);
+        const uint8_t* data = entry != nullptr ? reader.EntryData(*entry) : nullptr;
+        if (data == nullptr || entry->method != zip::kMethodStored ||
+            entry->uncompressedSize != file.size ||
+            HexDigest(Sha256Hash(data, static_cast<size_t>(file.size))) != file.digest) {
+            *error = "Native file " + file.relative + " is missing or damaged";
+            ok = false;
+            break;
+        }
+        fs::path path = staging / fs::u8path(file.relative);
+        fs::create_directories(path.parent_path(), ec);
+        OutputFile output;
+        if (!output.Open(path.u8string()) ||
+            !output.Write(data, static_cast<size_t>(file.size)) || !output.Close()) {
+            *error = "Cannot write " + path.u8string();
+            ok = false;
+            break;
+        }
+        (*extracted)++;
+    }
+    if (ok && !WriteWholeFile(staging / kCompleteName,
+                              std::vector<uint8_t>(manifestHash.begin(), manifestHash.end()))) {
+        *error = "Cannot write " + (staging / kCompleteName).u8string();
+        ok = false;
+    }
+    // Publishing by rename: whichever first run renames first wins, and the
+    // others find the directory in place and drop their own copy. A damaged
+    // directory is moved aside first, unless a concurrent run has just
+    // replaced it.
+    if (ok) {
+        std::error_code existing;
+        if (fs::exists(target, existing) && !IsCompleteCache(target, manifestHash, files)) {
+            fs::path damaged = root / (key + ".old-" + std::to_string(stamp));
+            fs::rename(target, damaged, ec);
+            if (!ec) {
+                fs::remove_all(damaged, ec);
+            }
+        }
+        fs::rename(staging, target, ec);
+        if (ec && IsCompleteCache(target, manifestHash, files)) {
+            ec.clear();
+        } else if (ec && fs::exists(target, existing)) {
+            // The damaged directory could not be moved aside (its DLLs are
+            // loaded by a running copy on Windows); this run uses its own.
+            *nativeDir = staging.u8string();
+            return true;
+        } else if (ec) {
+            *error = "Cannot create " + target.u8string() + ": " + ec.message();
+            ok = false;
+        }
+    }
+    fs::remove_all(staging, ec);
+    return ok;
+}
+
+}  // namespace msix
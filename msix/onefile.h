@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "package_reader.h"
+
+// Single-file Python applications that run without unpacking themselves.
+//
+// `pyinstaller --onefile` appends an archive to its bootloader and extracts
+// all of it into a fresh temp directory on every launch. Here the appended
+// archive is a zip with stored entries, data aligned to pages and offsets
+// counted from the start of the executable, so it can be used in place:
+//
+//   __main__.py       bootstrap: installs the finder for native modules and
+//                     runs the application's main module
+//   py/...            application, libraries and stdlib (.pyc or .py),
+//                     imported by zipimport straight from the executable
+//   native/...        extension modules and DLLs, which the loader can only
+//                     take from a file
+//   onefile/natives   "<sha256>\t<size>\t<path>" for every native/ file
+//   onefile/python    "X.Y", the Python version of the bootloader
+//
+// Native files are copied once into a persistent cache directory named
+// after the hash of onefile/natives, so later launches (and later builds
+// that leave the native set alone) find them with one stat per file. The
+// bootloader (onefile_boot.cc) runs the interpreter in-process through
+// sandbox/embedded_python.h with sys.path = [<exe>/py, <cache dir>].
+// Data files stay in py/: importlib.resources reads them, code that opens
+// paths next to __file__ does not.
+//
+// The bootloader carries kOnefilePythonMarker followed by the "X.Y" of the
+// Python headers it was compiled with. BuildOnefile reads it from there and
+// refuses a /python interpreter or a packed interpreter library (pythonXY.dll,
+// libpythonX.Y.so) of another version.
+namespace msix {
+
+constexpr char kOnefilePythonMarker[] = "msix-onefile-python=";
+constexpr char kOnefilePythonEntry[] = "onefile/python";
+
+struct OnefileOptions {
+    std::string bootloader;  // executable the archive is appended to
+    std::string outputPath;
+    // A script or a directory, stored under py/. mainModule names the module
+    // run as __main__; empty uses the script's name.
+    std::string app;
+    std::string mainModule;
+    // site-packages style trees, stored under py/. Extension modules in them
+    // go to native/ and are imported through the bootstrap's finder.
+    std::vector<std::string> libraries;
+    // A pythonXY.zip or a Lib directory (tests, site-packages, lib-dynload,
+    // config-* and __pycache__ are left out).
+    std::string stdlib;
+    // Files, or directories taken without recursion, whose DLLs and
+    // extension modules go to the root of the native cache: the interpreter
+    // DLL and its runtime, DLLs\, lib-dynload.
+    std::vector<std::string> natives;
+    // Interpreter that byte-compiles .py files from directories into
+    // unchecked-hash .pyc (as stdlibpack does); empty stores sources. It
+    // must be the version the bootloader embeds.
+    std::string python;
+    uint32_t alignment = 4096;
+};
+
+struct OnefileStats {
+    uint64_t pythonFiles = 0;
+    uint64_t compiledFiles = 0;
+    uint64_t nativeFiles = 0;
+    uint64_t nativeBytes = 0;
+    uint64_t archiveBytes = 0;
+    double seconds = 0;
+};
+
+bool BuildOnefile(const OnefileOptions& options, OnefileStats* stats, std::string* error);
+
+// Makes sure the native files of the onefile open in reader are present
+// under cacheRoot and sets *nativeDir to their directory. On the first run
+// they are copied out of the archive, checked against their SHA-256, and the
+// directory is renamed into place, so a crashed or concurrent first run never
+// leaves a partial one behind. A directory whose completion marker (the
+// manifest hash) is missing or whose files are gone or resized is extracted
+// again and replaced. *extracted counts the files copied by this call (0
+// when the cache was warm).
+bool PrepareNativeCache(const PackageReader& reader, const std::string& cacheRoot,
+                        std::string* nativeDir, uint64_t* extracted, std::string* error);
+
+}  // namespace msix
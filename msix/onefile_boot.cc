@@ -0,0 +1,159 @@
+// Bootloader of a single-file Python application (see onefile.h). Opens
+// its own executable as a zip, makes sure the native files are in the
+// persistent cache, and runs the archive's __main__.py in-process.
+//
+// On Windows the interpreter DLL is delay-loaded (-Wl,/DELAYLOAD), so it is
+// resolved from the native cache, which SetDllDirectoryW puts on the DLL
+// search path before the first Python call.
+#include <patchlevel.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../sandbox/embedded_python.h"
+#include "onefile.h"
+#include "package_reader.h"
+#include "zip_format.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <limits.h>
+#include <unistd.h>
+#endif
+
+#define ONEFILE_STRING(x) #x
+#define ONEFILE_VERSION(major, minor) ONEFILE_STRING(major) "." ONEFILE_STRING(minor)
+
+namespace {
+
+// kOnefilePythonMarker and the version of the Python headers (and so of the
+// interpreter library) this bootloader is built against; onefilepack reads
+// it from the executable.
+const char kPythonMarker[] =
+    "msix-onefile-python=" ONEFILE_VERSION(PY_MAJOR_VERSION, PY_MINOR_VERSION);
+
+// The version onefilepack recorded, which must match the bootloader's own:
+// an archive appended to another bootloader would load the wrong library.
+bool CheckPythonVersion(const msix::PackageReader& reader, std::string* error) {
+    const char* version = kPythonMarker + strlen(msix::kOnefilePythonMarker);
+    const msix::PackageEntry* entry = reader.Find(msix::kOnefilePythonEntry);
+    const uint8_t* data = entry != nullptr ? reader.EntryData(*entry) : nullptr;
+    std::string packed;
+    if (data != nullptr && entry->method == msix::zip::kMethodStored) {
+        packed.assign(reinterpret_cast<const char*>(data),
+                      static_cast<size_t>(entry->uncompressedSize));
+    }
+    if (packed != version) {
+        *error = "The archive was packed for Python " + (packed.empty() ? "?" : packed) +
+                 ", but this bootloader embeds Python " + version;
+        return false;
+    }
+    return true;
+}
+
+#ifdef _WIN32
+const char kSeparator = '\\';
+
+std::string Narrow(const wchar_t* text) {
+    int length = WideCharToMultiByte(CP_UTF8, 0, text, -1, NULL, 0, NULL, NULL);
+    std::string narrow(length > 0 ? length - 1 : 0, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text, -1, &narrow[0], length, NULL, NULL);
+    return narrow;
+}
+
+std::wstring Widen(const std::string& text) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, NULL, 0);
+    std::wstring wide(length > 0 ? length - 1 : 0, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, &wide[0], length);
+    return wide;
+}
+
+std::string ExecutablePath() {
+    std::vector<wchar_t> path(MAX_PATH);
+    for (;;) {
+        DWORD length = GetModuleFileNameW(NULL, path.data(), static_cast<DWORD>(path.size()));
+        if (length == 0) {
+            return std::string();
+        }
+        if (length < path.size()) {
+            return Narrow(path.data());
+        }
+        path.resize(path.size() * 2);
+    }
+}
+
+std::string CacheRoot() {
+    const wchar_t* base = _wgetenv(L"LOCALAPPDATA");
+    return base != nullptr ? Narrow(base) + "\\MSIXPython\\onefile" : std::string();
+}
+#else
+const char kSeparator = '/';
+
+std::string ExecutablePath() {
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    return length > 0 ? std::string(path, static_cast<size_t>(length)) : std::string();
+}
+
+std::string CacheRoot() {
+    if (const char* base = getenv("XDG_CACHE_HOME")) {
+        return std::string(base) + "/msix-onefile";
+    }
+    const char* home = getenv("HOME");
+    return home != nullptr ? std::string(home) + "/.cache/msix-onefile" : std::string();
+}
+#endif
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string self = ExecutablePath();
+    std::string cacheRoot = CacheRoot();
+    if (self.empty() || cacheRoot.empty()) {
+        fprintf(stderr, "Cannot locate the executable or its cache directory\n");
+        return 1;
+    }
+
+    msix::PackageReader reader;
+    std::string nativeDir;
+    uint64_t extracted = 0;
+    std::string error;
+    if (!reader.Open(self, &error) || !CheckPythonVersion(reader, &error) ||
+        !msix::PrepareNativeCache(reader, cacheRoot, &nativeDir, &extracted, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    // Read (and removed) by the bootstrap, which loads packaged extension
+    // modules from there.
+#ifdef _WIN32
+    std::wstring wideNativeDir = Widen(nativeDir);
+    SetEnvironmentVariableW(L"MSIX_ONEFILE_NATIVE", wideNativeDir.c_str());
+    _wputenv_s(L"MSIX_ONEFILE_NATIVE", wideNativeDir.c_str());
+    SetDllDirectoryW(wideNativeDir.c_str());
+#else
+    setenv("MSIX_ONEFILE_NATIVE", nativeDir.c_str(), 1);
+#endif
+
+    // The executable itself is argv[0]: the interpreter runs a zip's
+    // __main__.py and puts the zip first on sys.path.
+    sandbox::EmbeddedPythonOptions options;
+    options.home = nativeDir;
+    options.searchPaths = {self + kSeparator + "py", nativeDir};
+    options.importSite = false;
+    options.isolated = true;
+    options.safePath = true;
+    options.argv.push_back(self);
+    options.argv.insert(options.argv.end(), argv + 1, argv + argc);
+
+    int status = sandbox::RunEmbeddedPython(options, &error);
+    if (status < 0) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,85 @@
+// Builds a single-file Python application that runs without unpacking
+// itself (see onefile.h): appends the application, its libraries, the
+// stdlib and the interpreter's native files to the onefile_boot bootloader.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "onefile.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " /boot <onefile_boot> /app <script|dir> /o <output>"
+              << " [options]\n"
+              << "Options:\n"
+              << "  /main <module>   Module run as __main__ (default: the script's name)\n"
+              << "  /lib <dir>       site-packages style tree (repeatable)\n"
+              << "  /stdlib <path>   pythonXY.zip or Lib directory\n"
+              << "  /native <path>   DLL or extension module, or a directory of them, for the\n"
+              << "                   root of the native cache (repeatable)\n"
+              << "  /python <exe>    Compile .py files with this interpreter, which must be\n"
+              << "                   the version the bootloader embeds\n"
+              << "  /align <bytes>   Entry data alignment (default: 4096, 0 = none)\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+double Megabytes(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    msix::OnefileOptions options;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "boot") && hasValue) {
+            options.bootloader = argv[++i];
+        } else if (IsFlag(arg, "app") && hasValue) {
+            options.app = argv[++i];
+        } else if (IsFlag(arg, "o") && hasValue) {
+            options.outputPath = argv[++i];
+        } else if (IsFlag(arg, "main") && hasValue) {
+            options.mainModule = argv[++i];
+        } else if (IsFlag(arg, "lib") && hasValue) {
+            options.libraries.push_back(argv[++i]);
+        } else if (IsFlag(arg, "stdlib") && hasValue) {
+            options.stdlib = argv[++i];
+        } else if (IsFlag(arg, "native") && hasValue) {
+            options.natives.push_back(argv[++i]);
+        } else if (IsFlag(arg, "python") && hasValue) {
+            options.python = argv[++i];
+        } else if (IsFlag(arg, "align") && hasValue) {
+            options.alignment = static_cast<uint32_t>(atoi(argv[++i]));
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.bootloader.empty() || options.app.empty() || options.outputPath.empty()) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    msix::OnefileStats stats;
+    std::string error;
+    if (!msix::BuildOnefile(options, &stats, &error)) {
+        std::cerr << "Failed to build " << options.outputPath << ": " << error << std::endl;
+        return 1;
+    }
+    printf("Built %s in %.2f s: %llu Python files (%llu compiled), %llu native files "
+           "(%.2f MB)\n",
+           options.outputPath.c_str(), stats.seconds, (unsigned long long)stats.pythonFiles,
+           (unsigned long long)stats.compiledFiles, (unsigned long long)stats.nativeFiles,
+           Megabytes(stats.nativeBytes));
+    printf("Archive: %.2f MB appended to the bootloader\n", Megabytes(stats.archiveBytes));
+    return 0;
+}
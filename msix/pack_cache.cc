@@ -0,0 +1,288 @@
+#include "pack_cache.h"
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "file_io.h"
+#include "zip_format.h"
+
+namespace fs = std::filesystem;
+
+namespace msix {
+
+namespace {
+
+constexpr uint32_t kObjectMagic = 0x4350584d;  // "MXPC"
+constexpr size_t kFooterSize = 32;
+constexpr size_t kTableEntrySize = 36;
+constexpr uint32_t kFlagCompressed = 1;
+
+std::string HexEncode(const uint8_t* data, size_t length) {
+    static const char kHex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(length * 2);
+    for (size_t i = 0; i < length; i++) {
+        out += kHex[data[i] >> 4];
+        out += kHex[data[i] & 15];
+    }
+    return out;
+}
+
+void HashSize(Sha256& hasher, uint64_t size) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = uint8_t(size >> (8 * i));
+    }
+    hasher.Update(bytes, sizeof(bytes));
+}
+
+}  // namespace
+
+PackCache::ObjectWriter::ObjectWriter(PackCache& cache, std::string tempPath, std::FILE* file,
+                                      uint64_t size, bool compressed)
+    : cache_(cache), tempPath_(std::move(tempPath)), file_(file), size_(size),
+      compressed_(compressed) {
+    HashSize(keyHasher_, size);
+}
+
+PackCache::ObjectWriter::~ObjectWriter() {
+    if (file_ != nullptr) {
+        std::fclose(file_);
+        std::error_code ec;
+        fs::remove(tempPath_, ec);
+    }
+}
+
+bool PackCache::ObjectWriter::Append(const void* data, size_t length, const Sha256Digest& hash) {
+    keyHasher_.Update(hash.data(), hash.size());
+    blocks_.push_back({hash, static_cast<uint32_t>(length)});
+    if (ok_ && length > 0 && std::fwrite(data, 1, length, file_) != length) {
+        ok_ = false;
+    }
+    return ok_;
+}
+
+std::string PackCache::ObjectWriter::Commit(uint32_t crc) {
+    std::vector<uint8_t> trailer;
+    zip::ByteWriter w(trailer);
+    uint64_t encodedSize = 0;
+    for (const BlockMapBlock& block : blocks_) {
+        trailer.insert(trailer.end(), block.hash.begin(), block.hash.end());
+        w.U32(block.compressedSize);
+        encodedSize += block.compressedSize;
+    }
+    w.U64(size_);
+    w.U64(encodedSize);
+    w.U32(crc);
+    w.U32(static_cast<uint32_t>(blocks_.size()));
+    w.U32(compressed_ ? kFlagCompressed : 0);
+    w.U32(kObjectMagic);
+
+    if (ok_ && std::fwrite(trailer.data(), 1, trailer.size(), file_) != trailer.size()) {
+        ok_ = false;
+    }
+    if (std::fclose(file_) != 0) {
+        ok_ = false;
+    }
+    file_ = nullptr;
+
+    std::error_code ec;
+    std::string key = cache_.KeyFromContentHash(keyHasher_.Finish(), compressed_);
+    std::string objectPath = cache_.ObjectPath(key);
+    if (ok_) {
+        fs::create_directories(fs::path(objectPath).parent_path(), ec);
+        fs::rename(tempPath_, objectPath, ec);
+    }
+    if (!ok_ || ec) {
+        fs::remove(tempPath_, ec);
+        return "";
+    }
+    return key;
+}
+
+bool PackCache::Open(const std::string& directory, int compressionLevel, bool primeDictionary,
+                     std::string* error) {
+    directory_ = directory;
+    encodingTag_ = "d" + std::to_string(compressionLevel) + (primeDictionary ? "p" : "i");
+
+    std::error_code ec;
+    fs::create_directories(fs::path(directory_) / "objects", ec);
+    fs::create_directories(fs::path(directory_) / "tmp", ec);
+    if (ec) {
+        *error = "Failed to create cache directory " + directory_ + ": " + ec.message();
+        return false;
+    }
+
+    std::ifstream in(fs::path(directory_) / "index");
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        IndexEntry entry;
+        std::string path;
+        if (fields >> entry.modifiedTime >> entry.size >> entry.key && fields.get() == '\t' &&
+            std::getline(fields, path)) {
+            index_[path] = entry;
+        }
+    }
+    return true;
+}
+
+std::string PackCache::ObjectPath(const std::string& key) const {
+    return (fs::path(directory_) / "objects" / key.substr(0, 2) / key).u8string();
+}
+
+std::string PackCache::KeyFromContentHash(Sha256Digest contentHash, bool compressed) const {
+    return HexEncode(contentHash.data(), contentHash.size()) + "-" +
+           (compressed ? encodingTag_ : std::string("s"));
+}
+
+std::shared_ptr<const CachedObject> PackCache::LoadObject(const std::string& key, uint64_t size) {
+    std::string path = ObjectPath(key);
+    InputFile file;
+    if (!file.Open(path) || file.Size() < kFooterSize) {
+        return nullptr;
+    }
+    uint8_t footer[kFooterSize];
+    if (!file.ReadAt(file.Size() - kFooterSize, footer, kFooterSize) ||
+        zip::ReadU32(footer + 28) != kObjectMagic || zip::ReadU64(footer) != size) {
+        return nullptr;
+    }
+
+    auto object = std::make_shared<CachedObject>();
+    object->key = key;
+    object->path = path;
+    object->size = size;
+    object->encodedSize = zip::ReadU64(footer + 8);
+    object->crc = zip::ReadU32(footer + 16);
+    uint32_t blockCount = zip::ReadU32(footer + 20);
+    object->compressed = (zip::ReadU32(footer + 24) & kFlagCompressed) != 0;
+
+    uint64_t tableSize = uint64_t(blockCount) * kTableEntrySize;
+    if (blockCount != BlockCount(size) ||
+        object->encodedSize + tableSize + kFooterSize != file.Size()) {
+        return nullptr;
+    }
+    std::vector<uint8_t> table(tableSize);
+    if (!file.ReadAt(object->encodedSize, table.data(), table.size())) {
+        return nullptr;
+    }
+    object->blocks.resize(blockCount);
+    for (uint32_t i = 0; i < blockCount; i++) {
+        const uint8_t* entry = table.data() + i * kTableEntrySize;
+        std::copy(entry, entry + 32, object->blocks[i].hash.begin());
+        object->blocks[i].compressedSize = zip::ReadU32(entry + 32);
+    }
+    return object;
+}
+
+std::shared_ptr<const CachedObject> PackCache::LookupByPath(const std::string& path,
+                                                            uint64_t size, int64_t modifiedTime,
+                                                            bool compressed) {
+    std::string key;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(path);
+        if (it == index_.end() || it->second.size != size ||
+            it->second.modifiedTime != modifiedTime) {
+            return nullptr;
+        }
+        key = it->second.key;
+    }
+    auto object = LoadObject(key, size);
+    if (object == nullptr || object->compressed != compressed ||
+        (compressed && key.compare(key.size() - encodingTag_.size(), encodingTag_.size(),
+                                   encodingTag_) != 0)) {
+        return nullptr;
+    }
+    return object;
+}
+
+bool PackCache::HasPathWithSize(const std::string& path, uint64_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    return it != index_.end() && it->second.size == size;
+}
+
+std::shared_ptr<const CachedObject> PackCache::LookupByContent(const std::string& path,
+                                                               uint64_t size, bool compressed) {
+    InputFile file;
+    if (!file.Open(path) || file.Size() != size) {
+        return nullptr;
+    }
+    Sha256 keyHasher;
+    HashSize(keyHasher, size);
+
+    // Eight blocks per read so the multi-buffer backends get full batches.
+    constexpr size_t kBatch = 8;
+    std::vector<uint8_t> buffer(kBatch * kBlockSize);
+    const uint8_t* messages[kBatch];
+    size_t lengths[kBatch];
+    Sha256Digest hashes[kBatch];
+    for (uint64_t offset = 0; offset < size; offset += buffer.size()) {
+        size_t length = static_cast<size_t>(std::min<uint64_t>(buffer.size(), size - offset));
+        if (!file.ReadAt(offset, buffer.data(), length)) {
+            return nullptr;
+        }
+        size_t count = 0;
+        for (size_t start = 0; start < length; start += kBlockSize, count++) {
+            messages[count] = buffer.data() + start;
+            lengths[count] = std::min(kBlockSize, length - start);
+        }
+        Sha256HashMany(messages, lengths, hashes, count);
+        for (size_t i = 0; i < count; i++) {
+            keyHasher.Update(hashes[i].data(), hashes[i].size());
+        }
+    }
+    return LoadObject(KeyFromContentHash(keyHasher.Finish(), compressed), size);
+}
+
+std::unique_ptr<PackCache::ObjectWriter> PackCache::BeginObject(uint64_t size, bool compressed) {
+    uint64_t counter;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        counter = tempCounter_++;
+    }
+    static const uint32_t processTag = std::random_device()();
+    std::string tempPath = (fs::path(directory_) / "tmp" /
+                            (std::to_string(processTag) + "-" + std::to_string(counter)))
+                               .u8string();
+    std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+    return std::unique_ptr<ObjectWriter>(new ObjectWriter(*this, tempPath, file, size, compressed));
+}
+
+void PackCache::Record(const std::string& path, uint64_t size, int64_t modifiedTime,
+                       const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    index_[path] = IndexEntry{modifiedTime, size, key};
+}
+
+bool PackCache::SaveIndex(std::string* error) {
+    fs::path indexPath = fs::path(directory_) / "index";
+    fs::path tempPath = fs::path(directory_) / "index.tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& item : index_) {
+            out << item.second.modifiedTime << '\t' << item.second.size << '\t'
+                << item.second.key << '\t' << item.first << '\n';
+        }
+        if (!out) {
+            *error = "Failed to write " + tempPath.u8string();
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tempPath, indexPath, ec);
+    if (ec) {
+        *error = "Failed to replace " + indexPath.u8string() + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+}  // namespace msix
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "block_map.h"
+#include "sha256.h"
+
+namespace msix {
+
+// Encoded form of one file as it was last packed: the compressed (or stored)
+// bytes exactly as they go into the archive, plus the block map entries and
+// CRC needed to write its headers without touching the source again.
+struct CachedObject {
+    std::string key;
+    std::string path;  // object file in the cache
+    uint64_t size = 0;
+    uint64_t encodedSize = 0;
+    uint32_t crc = 0;
+    bool compressed = true;
+    std::vector<BlockMapBlock> blocks;
+};
+
+// Persistent, content-addressed cache of encoded files for incremental
+// repacks. Objects are keyed by a hash of the file's block hashes and the
+// encoding parameters, so identical content is stored once no matter how
+// many paths or packages it appears under. A per-path index remembers the
+// size and mtime each key was computed for; when those still match, a file
+// is resolved without reading it at all.
+//
+// Layout under the cache directory:
+//   index             "<mtime>\t<size>\t<key>\t<path>" per line
+//   objects/xx/<key>  encoded bytes, block table, fixed footer
+//   tmp/              objects being written
+class PackCache {
+public:
+    // Streams a freshly encoded file into the cache; the object only becomes
+    // visible under its key once Commit succeeds.
+    class ObjectWriter {
+    public:
+        ~ObjectWriter();
+        bool Append(const void* data, size_t length, const Sha256Digest& hash);
+        // Returns the content key, or an empty string on failure.
+        std::string Commit(uint32_t crc);
+
+    private:
+        friend class PackCache;
+        ObjectWriter(PackCache& cache, std::string tempPath, std::FILE* file, uint64_t size,
+                     bool compressed);
+
+        PackCache& cache_;
+        std::string tempPath_;
+        std::FILE* file_;
+        uint64_t size_;
+        bool compressed_;
+        std::vector<BlockMapBlock> blocks_;
+        Sha256 keyHasher_;
+        bool ok_ = true;
+    };
+
+    bool Open(const std::string& directory, int compressionLevel, bool primeDictionary,
+              std::string* error);
+
+    // Fast path: returns the cached object if this path was recorded with the
+    // same size and mtime and the object is still present. Thread-safe.
+    std::shared_ptr<const CachedObject> LookupByPath(const std::string& path, uint64_t size,
+                                                     int64_t modifiedTime, bool compressed);
+
+    // Whether the index knows this path at the given size, meaning a content
+    // probe is worth doing even though the mtime moved. Thread-safe.
+    bool HasPathWithSize(const std::string& path, uint64_t size);
+
+    // Slow path: hashes the file's blocks to derive its key and returns the
+    // object for that content, if any. Thread-safe.
+    std::shared_ptr<const CachedObject> LookupByContent(const std::string& path, uint64_t size,
+                                                        bool compressed);
+
+    std::unique_ptr<ObjectWriter> BeginObject(uint64_t size, bool compressed);
+
+    // Remembers which key a path resolved to. Thread-safe.
+    void Record(const std::string& path, uint64_t size, int64_t modifiedTime,
+                const std::string& key);
+
+    bool SaveIndex(std::string* error);
+
+private:
+    struct IndexEntry {
+        int64_t modifiedTime = 0;
+        uint64_t size = 0;
+        std::string key;
+    };
+
+    std::string ObjectPath(const std::string& key) const;
+    std::string KeyFromContentHash(Sha256Digest contentHash, bool compressed) const;
+    std::shared_ptr<const CachedObject> LoadObject(const std::string& key, uint64_t size);
+
+    std::string directory_;
+    std::string encodingTag_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, IndexEntry> index_;
+    uint64_t tempCounter_ = 0;
+};
+
+}  // namespace msix
@@ -0,0 +1,580 @@
+#include "package_delta.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "block_map.h"
+#include "file_io.h"
+#include "footprint.h"
+#include "installer.h"
+#include "package_reader.h"
+#include "zip_format.h"
+
+namespace fs = std::filesystem;
+
+namespace msix {
+
+namespace {
+
+constexpr uint32_t kPatchMagic = 0x5044584d;  // "MXDP"
+constexpr uint32_t kPatchVersion = 1;
+constexpr uint8_t kCopyBlock = 0;
+constexpr uint8_t kLiteralBlock = 1;
+
+struct DigestHash {
+    size_t operator()(const Sha256Digest& digest) const {
+        size_t value;
+        memcpy(&value, digest.data(), sizeof(value));
+        return value;
+    }
+};
+
+struct BlockLocation {
+    uint32_t file;
+    uint32_t block;
+};
+
+std::string SlashName(std::string name) {
+    std::replace(name.begin(), name.end(), '\\', '/');
+    return name;
+}
+
+// The old version's block map, from a package, an installed tree or the
+// XML file itself.
+bool LoadBlockMapFrom(const std::string& path, std::vector<BlockMapFile>* files,
+                      std::string* error) {
+    fs::path source = fs::u8path(path);
+    std::vector<uint8_t> xml;
+    std::error_code ec;
+    if (fs::is_directory(source, ec)) {
+        if (!ReadWholeFile(source / kBlockMapName, &xml)) {
+            *error = path + " has no " + kBlockMapName;
+            return false;
+        }
+    } else if (source.extension() == ".xml") {
+        if (!ReadWholeFile(source, &xml)) {
+            *error = "Cannot read " + path;
+            return false;
+        }
+    } else {
+        PackageReader reader;
+        if (!reader.Open(path, error)) {
+            return false;
+        }
+        const PackageEntry* entry = reader.Find(kBlockMapName);
+        if (entry == nullptr) {
+            *error = path + " has no " + kBlockMapName;
+            return false;
+        }
+        if (!reader.ReadEntry(*entry, &xml, error)) {
+            return false;
+        }
+    }
+    return ParseBlockMapXml(reinterpret_cast<const char*>(xml.data()), xml.size(), files, error);
+}
+
+bool Deflate(const uint8_t* data, size_t length, std::vector<uint8_t>* out) {
+    uLongf bound = compressBound(static_cast<uLong>(length));
+    out->resize(bound);
+    if (compress2(out->data(), &bound, data, static_cast<uLong>(length), 6) != Z_OK) {
+        return false;
+    }
+    out->resize(bound);
+    return true;
+}
+
+bool Inflate(const uint8_t* data, size_t length, size_t expected, std::vector<uint8_t>* out) {
+    out->resize(expected);
+    uLongf produced = static_cast<uLongf>(expected);
+    return uncompress(out->data(), &produced, data, static_cast<uLong>(length)) == Z_OK &&
+           produced == expected;
+}
+
+// Sequential patch output, flushed to disk in large pieces.
+class PatchWriter {
+public:
+    bool Open(const std::string& path) { return file_.Open(path); }
+
+    void U8(uint8_t v) { buffer_.push_back(v); }
+    void U16(uint16_t v) { zip::ByteWriter(buffer_).U16(v); }
+    void U32(uint32_t v) { zip::ByteWriter(buffer_).U32(v); }
+    void U64(uint64_t v) { zip::ByteWriter(buffer_).U64(v); }
+    void Name(const std::string& name) {
+        U16(static_cast<uint16_t>(name.size()));
+        buffer_.insert(buffer_.end(), name.begin(), name.end());
+    }
+    void Bytes(const std::vector<uint8_t>& data) {
+        buffer_.insert(buffer_.end(), data.begin(), data.end());
+        if (buffer_.size() >= (1u << 20)) {
+            Flush();
+        }
+    }
+
+    bool Close() {
+        Flush();
+        return ok_ && file_.Close();
+    }
+    uint64_t Size() const { return file_.Offset() + buffer_.size(); }
+
+private:
+    void Flush() {
+        if (!buffer_.empty() && !file_.Write(buffer_.data(), buffer_.size())) {
+            ok_ = false;
+        }
+        buffer_.clear();
+    }
+
+    OutputFile file_;
+    std::vector<uint8_t> buffer_;
+    bool ok_ = true;
+};
+
+// Bounds-checked reader over the mapped patch.
+class PatchReader {
+public:
+    PatchReader(const uint8_t* data, uint64_t size) : p_(data), end_(data + size) {}
+
+    bool U8(uint8_t* v) { return Fixed(1) && (*v = p_[-1], true); }
+    bool U16(uint16_t* v) { return Fixed(2) && (*v = zip::ReadU16(p_ - 2), true); }
+    bool U32(uint32_t* v) { return Fixed(4) && (*v = zip::ReadU32(p_ - 4), true); }
+    bool U64(uint64_t* v) { return Fixed(8) && (*v = zip::ReadU64(p_ - 8), true); }
+    bool Name(std::string* name) {
+        uint16_t length;
+        if (!U16(&length) || !Fixed(length)) {
+            return false;
+        }
+        name->assign(reinterpret_cast<const char*>(p_ - length), length);
+        return true;
+    }
+    // Points data at the next length bytes.
+    bool Bytes(uint32_t length, const uint8_t** data) {
+        if (!Fixed(length)) {
+            return false;
+        }
+        *data = p_ - length;
+        return true;
+    }
+
+private:
+    bool Fixed(size_t length) {
+        if (static_cast<size_t>(end_ - p_) < length) {
+            return false;
+        }
+        p_ += length;
+        return true;
+    }
+
+    const uint8_t* p_;
+    const uint8_t* end_;
+};
+
+// Blocks of the old version, read from its installed tree or inflated from
+// its package, one file and one block at a time.
+class OldVersion {
+public:
+    bool Open(const std::string& path, std::string* error) {
+        std::error_code ec;
+        if (fs::is_directory(fs::u8path(path), ec)) {
+            root_ = fs::u8path(path);
+            return true;
+        }
+        package_.reset(new PackageReader());
+        return package_->Open(path, error);
+    }
+
+    void AddFile(const std::string& name, uint64_t size) {
+        names_.push_back(name);
+        sizes_.push_back(size);
+    }
+
+    bool ReadBlock(uint32_t file, uint32_t block, size_t length, std::vector<uint8_t>* out,
+                   std::string* error) {
+        if (file >= names_.size() ||
+            uint64_t(block) * kBlockSize + length > sizes_[file]) {
+            *error = "Patch refers to a block the old version does not have";
+            return false;
+        }
+        uint64_t offset = uint64_t(block) * kBlockSize;
+        out->resize(length);
+        // Copies mostly run through a file in order, so one file is kept
+        // open (or inflated) at a time.
+        if (package_ == nullptr) {
+            if (openFile_ != file) {
+                std::string path = (root_ / fs::u8path(names_[file])).u8string();
+                openFile_ = UINT32_MAX;
+                if (!open_.Open(path) || open_.Size() != sizes_[file]) {
+                    *error = path + " is missing or differs from the old version";
+                    return false;
+                }
+                openFile_ = file;
+            }
+            if (!open_.ReadAt(offset, out->data(), length)) {
+                *error = "Read of " + names_[file] + " failed";
+                return false;
+            }
+            return true;
+        }
+        if (blocksFile_ != file) {
+            const PackageEntry* entry = package_->Find(names_[file]);
+            blocksFile_ = UINT32_MAX;
+            if (entry == nullptr || entry->uncompressedSize != sizes_[file]) {
+                *error = names_[file] + " is missing or differs in the old package";
+                return false;
+            }
+            blocks_.reset(new EntryBlockReader());
+            if (!blocks_->Open(*package_, *entry, error)) {
+                return false;
+            }
+            blocksFile_ = file;
+        }
+        const uint8_t* data = nullptr;
+        size_t available = 0;
+        if (!blocks_->Read(block, &data, &available, error)) {
+            return false;
+        }
+        memcpy(out->data(), data, length);
+        return true;
+    }
+
+    // Releases the old version, which may be the tree about to be replaced
+    // (Windows cannot rename a directory with a file open in it).
+    void Close() {
+        open_.Close();
+        openFile_ = UINT32_MAX;
+        blocks_.reset();
+        blocksFile_ = UINT32_MAX;
+        package_.reset();
+    }
+
+private:
+    fs::path root_;
+    std::unique_ptr<PackageReader> package_;
+    std::vector<std::string> names_;
+    std::vector<uint64_t> sizes_;
+    InputFile open_;
+    uint32_t openFile_ = UINT32_MAX;
+    std::unique_ptr<EntryBlockReader> blocks_;
+    uint32_t blocksFile_ = UINT32_MAX;
+};
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+bool CreateDelta(const std::string& oldBlockMap, const std::string& newPackage,
+                 const std::string& patchPath, DeltaStats* stats, std::string* error) {
+    auto startTime = std::chrono::steady_clock::now();
+    *stats = DeltaStats();
+    std::vector<BlockMapFile> oldFiles;
+    if (!LoadBlockMapFrom(oldBlockMap, &oldFiles, error)) {
+        return false;
+    }
+    std::unordered_map<Sha256Digest, BlockLocation, DigestHash> oldBlocks;
+    for (uint32_t file = 0; file < oldFiles.size(); file++) {
+        for (uint32_t block = 0; block < oldFiles[file].blocks.size(); block++) {
+            oldBlocks.emplace(oldFiles[file].blocks[block].hash, BlockLocation{file, block});
+        }
+    }
+
+    PackageReader reader;
+    if (!reader.Open(newPackage, error) || !reader.LoadBlockMap(error)) {
+        return false;
+    }
+    const PackageEntry* blockMapEntry = reader.Find(kBlockMapName);
+    std::vector<uint8_t> blockMapXml;
+    std::vector<uint8_t> deflated;
+    if (blockMapEntry == nullptr || !reader.ReadEntry(*blockMapEntry, &blockMapXml, error) ||
+        !Deflate(blockMapXml.data(), blockMapXml.size(), &deflated)) {
+        if (error->empty()) {
+            *error = "Cannot read the block map of " + newPackage;
+        }
+        return false;
+    }
+
+    PatchWriter patch;
+    if (!patch.Open(patchPath)) {
+        *error = "Cannot create " + patchPath;
+        return false;
+    }
+    patch.U32(kPatchMagic);
+    patch.U32(kPatchVersion);
+    patch.U32(static_cast<uint32_t>(oldFiles.size()));
+    for (const BlockMapFile& file : oldFiles) {
+        patch.Name(SlashName(file.name));
+        patch.U64(file.size);
+    }
+    patch.U32(static_cast<uint32_t>(blockMapXml.size()));
+    patch.U32(static_cast<uint32_t>(deflated.size()));
+    patch.Bytes(deflated);
+
+    std::vector<const PackageEntry*> payload;
+    std::vector<const PackageEntry*> extras;
+    for (const PackageEntry& entry : reader.Entries()) {
+        if (entry.name.empty() || entry.name.back() == '/' || entry.name == kBlockMapName) {
+            continue;
+        }
+        const BlockMapFile* map = reader.FindBlockMapFile(entry);
+        if (map != nullptr && map->blocks.size() == BlockCount(entry.uncompressedSize)) {
+            payload.push_back(&entry);
+        } else {
+            extras.push_back(&entry);
+        }
+    }
+
+    patch.U32(static_cast<uint32_t>(payload.size()));
+    std::vector<uint8_t> data;
+    for (const PackageEntry* entry : payload) {
+        const BlockMapFile* map = reader.FindBlockMapFile(*entry);
+        patch.Name(entry->name);
+        patch.U64(entry->uncompressedSize);
+        patch.U32(static_cast<uint32_t>(map->blocks.size()));
+        stats->files++;
+        stats->newBytes += entry->uncompressedSize;
+        EntryBlockReader blocks;
+        bool opened = false;
+        for (uint32_t block = 0; block < map->blocks.size(); block++) {
+            stats->blocks++;
+            auto old = oldBlocks.find(map->blocks[block].hash);
+            if (old != oldBlocks.end()) {
+                patch.U8(kCopyBlock);
+                patch.U32(old->second.file);
+                patch.U32(old->second.block);
+                stats->copiedBlocks++;
+                continue;
+            }
+            if (!opened && !blocks.Open(reader, *entry, error)) {
+                return false;
+            }
+            opened = true;
+            const uint8_t* literal = nullptr;
+            size_t length = 0;
+            if (!blocks.Read(block, &literal, &length, error)) {
+                return false;
+            }
+            if (!Deflate(literal, length, &deflated)) {
+                *error = "Deflate failed";
+                return false;
+            }
+            patch.U8(kLiteralBlock);
+            patch.U32(static_cast<uint32_t>(deflated.size()));
+            patch.Bytes(deflated);
+            stats->literalBlocks++;
+            stats->literalBytes += length;
+        }
+    }
+
+    patch.U32(static_cast<uint32_t>(extras.size()));
+    for (const PackageEntry* entry : extras) {
+        if (!reader.ReadEntry(*entry, &data, error) ||
+            !Deflate(data.data(), data.size(), &deflated)) {
+            if (error->empty()) {
+                *error = "Deflate failed";
+            }
+            return false;
+        }
+        patch.Name(entry->name);
+        patch.U32(static_cast<uint32_t>(data.size()));
+        patch.U32(static_cast<uint32_t>(deflated.size()));
+        patch.Bytes(deflated);
+    }
+
+    stats->patchBytes = patch.Size();
+    if (!patch.Close()) {
+        *error = "Write to " + patchPath + " failed";
+        return false;
+    }
+    stats->seconds = SecondsSince(startTime);
+    return true;
+}
+
+bool ApplyDelta(const std::string& oldVersion, const std::string& patchPath,
+                const std::string& outputDir, DeltaStats* stats, std::string* error) {
+    auto startTime = std::chrono::steady_clock::now();
+    *stats = DeltaStats();
+    MappedFile patchFile;
+    if (!patchFile.Open(patchPath)) {
+        *error = "Cannot open " + patchPath;
+        return false;
+    }
+    stats->patchBytes = patchFile.Size();
+    PatchReader patch(patchFile.Data(), patchFile.Size());
+    const std::string damaged = patchPath + " is damaged";
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    if (!patch.U32(&magic) || magic != kPatchMagic || !patch.U32(&version) ||
+        version != kPatchVersion) {
+        *error = patchPath + " is not a package delta";
+        return false;
+    }
+    OldVersion old;
+    if (!old.Open(oldVersion, error)) {
+        return false;
+    }
+    uint32_t oldCount = 0;
+    if (!patch.U32(&oldCount)) {
+        *error = damaged;
+        return false;
+    }
+    for (uint32_t i = 0; i < oldCount; i++) {
+        std::string name;
+        uint64_t size;
+        if (!patch.Name(&name) || !patch.U64(&size) || !IsSafePackagePath(name)) {
+            *error = damaged;
+            return false;
+        }
+        old.AddFile(name, size);
+    }
+
+    uint32_t xmlLength = 0;
+    uint32_t deflatedLength = 0;
+    const uint8_t* deflatedXml = nullptr;
+    std::vector<uint8_t> blockMapXml;
+    std::vector<BlockMapFile> newFiles;
+    if (!patch.U32(&xmlLength) || !patch.U32(&deflatedLength) ||
+        !patch.Bytes(deflatedLength, &deflatedXml) ||
+        !Inflate(deflatedXml, deflatedLength, xmlLength, &blockMapXml) ||
+        !ParseBlockMapXml(reinterpret_cast<const char*>(blockMapXml.data()), blockMapXml.size(),
+                          &newFiles, error)) {
+        if (error->empty()) {
+            *error = damaged;
+        }
+        return false;
+    }
+    std::unordered_map<std::string, const BlockMapFile*> newMap;
+    for (const BlockMapFile& file : newFiles) {
+        newMap.emplace(SlashName(file.name), &file);
+    }
+
+    // Built next to outputDir and committed by rename like an install, so
+    // outputDir may be the old version itself and is never left half
+    // written.
+    StagedTree staged;
+    if (!staged.Begin(outputDir, error)) {
+        return false;
+    }
+    fs::path root = fs::u8path(staged.Path());
+    std::error_code ec;
+    if (!WriteWholeFile(root / kBlockMapName, blockMapXml)) {
+        *error = "Failed to write " + (root / kBlockMapName).u8string();
+        return false;
+    }
+
+    uint32_t fileCount = 0;
+    if (!patch.U32(&fileCount)) {
+        *error = damaged;
+        return false;
+    }
+    std::vector<uint8_t> block;
+    for (uint32_t i = 0; i < fileCount; i++) {
+        std::string name;
+        uint64_t size = 0;
+        uint32_t blockCount = 0;
+        if (!patch.Name(&name) || !patch.U64(&size) || !patch.U32(&blockCount)) {
+            *error = damaged;
+            return false;
+        }
+        auto expected = newMap.find(name);
+        if (!IsSafePackagePath(name) || expected == newMap.end() || expected->second->size != size ||
+            expected->second->blocks.size() != blockCount || blockCount != BlockCount(size)) {
+            *error = name + " in the patch does not match the new block map";
+            return false;
+        }
+        fs::path path = root / fs::u8path(name);
+        fs::create_directories(path.parent_path(), ec);
+        WritableFile out;
+        if (!out.Create(path.u8string(), size)) {
+            *error = "Failed to create " + path.u8string();
+            return false;
+        }
+        for (uint32_t index = 0; index < blockCount; index++) {
+            uint64_t offset = uint64_t(index) * kBlockSize;
+            size_t length = static_cast<size_t>(std::min<uint64_t>(kBlockSize, size - offset));
+            uint8_t kind = 0;
+            if (!patch.U8(&kind)) {
+                *error = damaged;
+                return false;
+            }
+            if (kind == kCopyBlock) {
+                uint32_t oldFile = 0;
+                uint32_t oldBlock = 0;
+                if (!patch.U32(&oldFile) || !patch.U32(&oldBlock)) {
+                    *error = damaged;
+                    return false;
+                }
+                if (!old.ReadBlock(oldFile, oldBlock, length, &block, error)) {
+                    return false;
+                }
+                stats->copiedBlocks++;
+            } else if (kind == kLiteralBlock) {
+                uint32_t literalLength = 0;
+                const uint8_t* literal = nullptr;
+                if (!patch.U32(&literalLength) || !patch.Bytes(literalLength, &literal) ||
+                    !Inflate(literal, literalLength, length, &block)) {
+                    *error = damaged;
+                    return false;
+                }
+                stats->literalBlocks++;
+                stats->literalBytes += length;
+            } else {
+                *error = damaged;
+                return false;
+            }
+            if (Sha256Hash(block.data(), length) != expected->second->blocks[index].hash) {
+                *error = "Block " + std::to_string(index) + " of " + name +
+                         " does not match the new block map";
+                return false;
+            }
+            if (!out.WriteAt(offset, block.data(), length)) {
+                *error = "Failed to write " + path.u8string();
+                return false;
+            }
+            stats->blocks++;
+        }
+        if (!out.Close()) {
+            *error = "Failed to write " + path.u8string();
+            return false;
+        }
+        stats->files++;
+        stats->newBytes += size;
+    }
+
+    uint32_t extraCount = 0;
+    if (!patch.U32(&extraCount)) {
+        *error = damaged;
+        return false;
+    }
+    for (uint32_t i = 0; i < extraCount; i++) {
+        std::string name;
+        uint32_t length = 0;
+        uint32_t compressedLength = 0;
+        const uint8_t* compressed = nullptr;
+        if (!patch.Name(&name) || !patch.U32(&length) || !patch.U32(&compressedLength) ||
+            !patch.Bytes(compressedLength, &compressed) || !IsSafePackagePath(name) ||
+            !Inflate(compressed, compressedLength, length, &block)) {
+            *error = damaged;
+            return false;
+        }
+        if (!WriteWholeFile(root / fs::u8path(name), block)) {
+            *error = "Failed to write " + name;
+            return false;
+        }
+    }
+    old.Close();
+    if (!staged.Commit(false, error)) {
+        return false;
+    }
+    stats->seconds = SecondsSince(startTime);
+    return true;
+}
+
+}  // namespace msix
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Block-level differential updates between two versions of a package.
+//
+// Both versions describe their payload in AppxBlockMap.xml as SHA-256
+// hashes of 64 KB blocks. The delta of the new version against the old one
+// lists, for every new file, which of its blocks already exist somewhere in
+// the old version (by hash, so renamed and moved files are found too) and
+// carries only the blocks that do not, deflated. Generating it needs the old
+// version's block map and the new package; applying it needs the old
+// version, either as its installed tree or as its .msix.
+//
+// Blocks are fixed-size, so bytes inserted in the middle of a file change
+// every block after them; the store in content_store.h handles that case
+// with content-defined chunks instead.
+//
+// Patch layout (little-endian):
+//   "MXDP" u32 version
+//   u32 old file count, then per file: u16 name length, name, u64 size
+//   u32 block map length, u32 deflated length, deflated AppxBlockMap.xml
+//   u32 new file count, then per file: u16 name length, name, u64 size,
+//     u32 block count, then per block: u8 kind and
+//       kind 0 (copy):    u32 old file index, u32 old block index
+//       kind 1 (literal): u32 deflated length, deflated block
+//   u32 extra file count (footprint files outside the block map), then per
+//     file: u16 name length, name, u32 length, u32 deflated length, data
+namespace msix {
+
+struct DeltaStats {
+    uint64_t files = 0;
+    uint64_t blocks = 0;
+    uint64_t copiedBlocks = 0;
+    uint64_t literalBlocks = 0;
+    uint64_t literalBytes = 0;  // uncompressed
+    uint64_t newBytes = 0;      // size of the new version's payload
+    uint64_t patchBytes = 0;
+    double seconds = 0;
+};
+
+// oldBlockMap is the old version's .msix, its installed directory, or its
+// AppxBlockMap.xml. Writes the delta that turns it into newPackage.
+bool CreateDelta(const std::string& oldBlockMap, const std::string& newPackage,
+                 const std::string& patchPath, DeltaStats* stats, std::string* error);
+
+// Rebuilds the new version's tree under outputDir from the old version (an
+// installed directory or an .msix) and the patch. Every block is checked
+// against the new block map before it is written. The tree is built in a
+// staging directory and committed like an install (see installer.h), so
+// outputDir may be the old version's directory: it is replaced in place.
+bool ApplyDelta(const std::string& oldVersion, const std::string& patchPath,
+                const std::string& outputDir, DeltaStats* stats, std::string* error);
+
+}  // namespace msix
@@ -0,0 +1,795 @@
+#include "package_reader.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+
+#include "footprint.h"
+#include "thread_pool.h"
+#include "write_queue.h"
+#include "zip_format.h"
+
+namespace fs = std::filesystem;
+
+namespace msix {
+
+namespace {
+
+// One raw-inflate state per worker thread, reset between uses.
+struct InflateContext {
+    z_stream stream = {};
+    bool initialized = false;
+
+    ~InflateContext() {
+        if (initialized) {
+            inflateEnd(&stream);
+        }
+    }
+
+    bool Prepare() {
+        if (initialized) {
+            return inflateReset(&stream) == Z_OK;
+        }
+        stream = {};
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+            return false;
+        }
+        initialized = true;
+        return true;
+    }
+};
+
+// Inflates one block-map block on its own. Succeeds only if the block's
+// bytes decode to exactly expectedLength bytes without any reference to
+// data before the block, which is the case when the packer did not prime
+// the block with a dictionary. A back-reference out of the block fails with
+// Z_DATA_ERROR, so a successful result is always the real content.
+bool InflateBlock(const uint8_t* in, size_t inLength, size_t expectedLength,
+                  std::vector<uint8_t>* out) {
+    thread_local InflateContext context;
+    if (!context.Prepare()) {
+        return false;
+    }
+    // One spare byte so a block that decodes too long is detected.
+    out->resize(expectedLength + 1);
+    z_stream& stream = context.stream;
+    stream.next_in = const_cast<Bytef*>(in);
+    stream.avail_in = static_cast<uInt>(inLength);
+    stream.next_out = out->data();
+    stream.avail_out = static_cast<uInt>(out->size());
+    int status = inflate(&stream, Z_SYNC_FLUSH);
+    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+        return false;
+    }
+    if (stream.avail_in != 0 || stream.total_out != expectedLength) {
+        return false;
+    }
+    out->resize(expectedLength);
+    return true;
+}
+
+std::string NormalizeName(const std::string& name) {
+    std::string normalized = name;
+    std::replace(normalized.begin(), normalized.end(), '\\', '/');
+    return normalized;
+}
+
+// Checks consecutive 64 KB blocks of one entry as they are produced, against
+// the block map when the entry has one and against the CRC-32 otherwise.
+class BlockVerifier {
+public:
+    BlockVerifier(const PackageEntry& entry, const BlockMapFile* map, bool enabled)
+        : entry_(entry), map_(enabled ? map : nullptr), checkCrc_(enabled && map == nullptr) {}
+
+    bool Block(uint64_t index, const uint8_t* data, size_t length, std::string* error) {
+        if (map_ != nullptr) {
+            if (index >= map_->blocks.size() ||
+                Sha256Hash(data, length) != map_->blocks[index].hash) {
+                *error = "Block " + std::to_string(index) + " of " + entry_.name +
+                         " does not match AppxBlockMap.xml";
+                return false;
+            }
+        }
+        if (checkCrc_) {
+            crc_ = crc32(crc_, data, static_cast<uInt>(length));
+        }
+        return true;
+    }
+
+    bool Finish(std::string* error) {
+        if (checkCrc_ && crc_ != entry_.crc) {
+            *error = "CRC mismatch in " + entry_.name;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    const PackageEntry& entry_;
+    const BlockMapFile* map_;
+    bool checkCrc_;
+    uLong crc_ = crc32(0L, Z_NULL, 0);
+};
+
+// Streams one entry through inflate in 64 KB blocks, handing each block to
+// sink(index, data, length) as soon as it is complete.
+template <class Sink>
+bool DecodeEntry(const PackageEntry& entry, const uint8_t* data, Sink&& sink,
+                 std::string* error) {
+    if (entry.method == zip::kMethodStored) {
+        if (entry.compressedSize != entry.uncompressedSize) {
+            *error = "Stored entry " + entry.name + " has mismatched sizes";
+            return false;
+        }
+        for (uint64_t offset = 0, index = 0; offset < entry.uncompressedSize;
+             offset += kBlockSize, index++) {
+            size_t length =
+                static_cast<size_t>(std::min<uint64_t>(kBlockSize, entry.uncompressedSize - offset));
+            if (!sink(index, data + offset, length)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (entry.method != zip::kMethodDeflated) {
+        *error = "Unsupported compression method in " + entry.name;
+        return false;
+    }
+
+    thread_local InflateContext context;
+    thread_local std::vector<uint8_t> block;
+    if (!context.Prepare()) {
+        *error = "inflateInit failed";
+        return false;
+    }
+    block.resize(kBlockSize);
+    z_stream& stream = context.stream;
+    const uint8_t* in = data;
+    uint64_t inRemaining = entry.compressedSize;
+    uint64_t produced = 0;
+    uint64_t index = 0;
+    for (;;) {
+        size_t wanted =
+            static_cast<size_t>(std::min<uint64_t>(kBlockSize, entry.uncompressedSize - produced));
+        stream.next_out = block.data();
+        stream.avail_out = static_cast<uInt>(wanted);
+        int status = Z_OK;
+        while (stream.avail_out > 0 && status != Z_STREAM_END) {
+            if (stream.avail_in == 0 && inRemaining > 0) {
+                uInt chunk = static_cast<uInt>(std::min<uint64_t>(inRemaining, 1u << 30));
+                stream.next_in = const_cast<Bytef*>(in);
+                stream.avail_in = chunk;
+                in += chunk;
+                inRemaining -= chunk;
+            }
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END) {
+                *error = "Corrupt deflate data in " + entry.name;
+                return false;
+            }
+        }
+        size_t length = wanted - stream.avail_out;
+        if (length != wanted) {
+            *error = "Entry " + entry.name + " is shorter than its recorded size";
+            return false;
+        }
+        if (length > 0 && !sink(index++, block.data(), length)) {
+            return false;
+        }
+        produced += length;
+        if (produced == entry.uncompressedSize) {
+            // Everything is out; the stream must end here.
+            if (status != Z_STREAM_END) {
+                if (stream.avail_in == 0 && inRemaining > 0) {
+                    stream.next_in = const_cast<Bytef*>(in);
+                    stream.avail_in = static_cast<uInt>(std::min<uint64_t>(inRemaining, 1u << 30));
+                }
+                stream.next_out = block.data();
+                stream.avail_out = 1;
+                status = inflate(&stream, Z_NO_FLUSH);
+                if (status != Z_STREAM_END || stream.avail_out != 1) {
+                    *error = "Entry " + entry.name + " is longer than its recorded size";
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+}
+
+// Extraction state for one output file. Block tasks of the same file share
+// it, so errors go through the mutex.
+struct FileJob {
+    const PackageEntry* entry = nullptr;
+    const BlockMapFile* map = nullptr;
+    const uint8_t* data = nullptr;
+    std::string outputPath;
+    std::vector<uint64_t> blockOffsets;  // set for block-parallel jobs
+    std::unique_ptr<WritableFile> out;
+    WriteQueue* queue = nullptr;
+    bool sync = false;
+    // Block-parallel jobs: blocks not yet written. The last one to finish
+    // closes the file, so a package may hold more files than the process
+    // may have open.
+    std::atomic<uint64_t> blocksLeft{0};
+    std::atomic<bool> inflateFailed{false};
+    std::mutex mutex;
+    std::string error;
+
+    void Fail(const std::string& message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error.empty()) {
+            error = message;
+        }
+    }
+
+    // Creates the output on first use, from whichever thread gets there.
+    bool Open() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (out == nullptr) {
+            out.reset(new WritableFile());
+            if (!out->Create(outputPath, entry->uncompressedSize)) {
+                error = "Failed to create " + outputPath;
+                out.reset();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Waits for the file's queued writes and closes it.
+    void Finish() {
+        if (out == nullptr) {
+            return;
+        }
+        bool ok = queue->Drain(*out) && (!sync || out->Sync());
+        if (!out->Close() || !ok) {
+            Fail("Failed to write " + outputPath);
+        }
+    }
+};
+
+// Serial path: one pass of inflate over the whole entry.
+void ExtractFile(FileJob* job, bool verify) {
+    if (!job->Open()) {
+        return;
+    }
+    BlockVerifier verifier(*job->entry, job->map, verify);
+    std::string error;
+    bool ok = DecodeEntry(
+        *job->entry, job->data,
+        [&](uint64_t index, const uint8_t* block, size_t length) {
+            if (!verifier.Block(index, block, length, &error)) {
+                return false;
+            }
+            if (!job->queue->Write(*job->out, index * kBlockSize, block, length)) {
+                error = "Failed to write " + job->outputPath;
+                return false;
+            }
+            return true;
+        },
+        &error);
+    if (!ok || !verifier.Finish(&error)) {
+        job->Fail(error);
+    }
+    job->Finish();
+}
+
+// Parallel path: block `index` of a stored or independently deflated file.
+void WriteBlock(FileJob* job, uint64_t index, bool verify) {
+    if (!job->Open()) {
+        return;
+    }
+    const PackageEntry& entry = *job->entry;
+    uint64_t offset = index * kBlockSize;
+    size_t length = static_cast<size_t>(std::min<uint64_t>(kBlockSize, entry.uncompressedSize - offset));
+    const uint8_t* in = job->data + job->blockOffsets[index];
+    const uint8_t* block = in;
+    thread_local std::vector<uint8_t> inflated;
+    if (entry.method == zip::kMethodDeflated) {
+        size_t inLength = static_cast<size_t>(job->blockOffsets[index + 1] - job->blockOffsets[index]);
+        if (!InflateBlock(in, inLength, length, &inflated)) {
+            job->inflateFailed = true;
+            return;
+        }
+        block = inflated.data();
+    }
+    if (verify && (index >= job->map->blocks.size() ||
+                   Sha256Hash(block, length) != job->map->blocks[index].hash)) {
+        job->Fail("Block " + std::to_string(index) + " of " + entry.name +
+                  " does not match AppxBlockMap.xml");
+        return;
+    }
+    if (!job->queue->Write(*job->out, offset, block, length)) {
+        job->Fail("Failed to write " + job->outputPath);
+    }
+}
+
+// A file that has to be redone serially is left open for ExtractFile().
+void ExtractBlock(FileJob* job, uint64_t index, bool verify) {
+    WriteBlock(job, index, verify);
+    if (job->blocksLeft.fetch_sub(1) == 1 && !job->inflateFailed) {
+        job->Finish();
+    }
+}
+
+// Works out where each block starts inside the entry's data and whether the
+// blocks can be inflated independently. Deflated files need per-block sizes
+// from the block map; a primed stream is detected by trying block 1 alone.
+bool PlanBlockParallel(FileJob* job) {
+    const PackageEntry& entry = *job->entry;
+    uint64_t blockCount = BlockCount(entry.uncompressedSize);
+    if (blockCount < 2 || job->map == nullptr || job->map->blocks.size() != blockCount) {
+        return false;
+    }
+    job->blockOffsets.resize(blockCount + 1);
+    if (entry.method == zip::kMethodStored) {
+        for (uint64_t i = 0; i <= blockCount; i++) {
+            job->blockOffsets[i] = std::min<uint64_t>(i * kBlockSize, entry.uncompressedSize);
+        }
+        return true;
+    }
+    if (entry.method != zip::kMethodDeflated || !job->map->compressed) {
+        return false;
+    }
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < blockCount; i++) {
+        job->blockOffsets[i] = offset;
+        offset += job->map->blocks[i].compressedSize;
+    }
+    job->blockOffsets[blockCount] = offset;
+    if (offset != entry.compressedSize) {
+        return false;
+    }
+    std::vector<uint8_t> probe;
+    size_t probeLength =
+        static_cast<size_t>(std::min<uint64_t>(kBlockSize, entry.uncompressedSize - kBlockSize));
+    return InflateBlock(job->data + job->blockOffsets[1],
+                        static_cast<size_t>(job->blockOffsets[2] - job->blockOffsets[1]),
+                        probeLength, &probe);
+}
+
+}  // namespace
+
+bool PackageReader::Open(const std::string& path, std::string* error) {
+    path_ = path;
+    entries_.clear();
+    index_.clear();
+    blockMap_.clear();
+    blockMapIndex_.clear();
+    if (!file_.Open(path)) {
+        *error = "Failed to open " + path;
+        return false;
+    }
+    return ReadCentralDirectory(error);
+}
+
+bool PackageReader::ReadCentralDirectory(std::string* error) {
+    const uint8_t* data = file_.Data();
+    uint64_t size = file_.Size();
+    if (size < zip::kEndOfCentralDirectorySize) {
+        *error = path_ + " is not a zip archive";
+        return false;
+    }
+
+    // The EOCD is followed only by a comment of at most 64 KB.
+    uint64_t eocd = size - zip::kEndOfCentralDirectorySize;
+    uint64_t searchEnd = eocd > 0xFFFF ? eocd - 0xFFFF : 0;
+    for (;; eocd--) {
+        if (zip::ReadU32(data + eocd) == zip::kEndOfCentralDirectorySignature) {
+            break;
+        }
+        if (eocd == searchEnd) {
+            *error = path_ + " has no end of central directory record";
+            return false;
+        }
+    }
+
+    uint64_t entryCount = zip::ReadU16(data + eocd + 10);
+    uint64_t directorySize = zip::ReadU32(data + eocd + 12);
+    uint64_t directoryOffset = zip::ReadU32(data + eocd + 16);
+    uint64_t locator = eocd - zip::kZip64EndOfCentralDirectoryLocatorSize;
+    if (eocd >= zip::kZip64EndOfCentralDirectoryLocatorSize &&
+        zip::ReadU32(data + locator) == zip::kZip64EndOfCentralDirectoryLocatorSignature) {
+        uint64_t record = zip::ReadU64(data + locator + 8);
+        if (record + zip::kZip64EndOfCentralDirectorySize > size ||
+            zip::ReadU32(data + record) != zip::kZip64EndOfCentralDirectorySignature) {
+            *error = path_ + " has a damaged ZIP64 end of central directory";
+            return false;
+        }
+        entryCount = zip::ReadU64(data + record + 32);
+        directorySize = zip::ReadU64(data + record + 40);
+        directoryOffset = zip::ReadU64(data + record + 48);
+    }
+    if (directoryOffset > size || directorySize > size - directoryOffset) {
+        *error = path_ + " has a central directory outside the file";
+        return false;
+    }
+
+    entries_.reserve(static_cast<size_t>(std::min<uint64_t>(entryCount, directorySize / 46)));
+    const uint8_t* p = data + directoryOffset;
+    const uint8_t* end = p + directorySize;
+    for (uint64_t i = 0; i < entryCount; i++) {
+        if (end - p < static_cast<ptrdiff_t>(zip::kCentralDirectoryFixedSize) ||
+            zip::ReadU32(p) != zip::kCentralDirectorySignature) {
+            *error = path_ + " has a damaged central directory";
+            return false;
+        }
+        uint16_t nameLength = zip::ReadU16(p + 28);
+        uint16_t extraLength = zip::ReadU16(p + 30);
+        uint16_t commentLength = zip::ReadU16(p + 32);
+        size_t recordSize = zip::kCentralDirectoryFixedSize + nameLength + extraLength + commentLength;
+        if (static_cast<size_t>(end - p) < recordSize) {
+            *error = path_ + " has a damaged central directory";
+            return false;
+        }
+
+        PackageEntry entry;
+        entry.method = zip::ReadU16(p + 10);
+        entry.crc = zip::ReadU32(p + 16);
+        entry.compressedSize = zip::ReadU32(p + 20);
+        entry.uncompressedSize = zip::ReadU32(p + 24);
+        entry.localHeaderOffset = zip::ReadU32(p + 42);
+        std::string zipName(reinterpret_cast<const char*>(p + 46), nameLength);
+
+        // The ZIP64 extra field carries only the values whose 32-bit slot
+        // is saturated, in this fixed order.
+        const uint8_t* extra = p + 46 + nameLength;
+        const uint8_t* extraEnd = extra + extraLength;
+        while (extraEnd - extra >= 4) {
+            uint16_t id = zip::ReadU16(extra);
+            uint16_t length = zip::ReadU16(extra + 2);
+            const uint8_t* field = extra + 4;
+            if (extraEnd - field < length) {
+                break;
+            }
+            if (id == zip::kZip64ExtraFieldId) {
+                const uint8_t* fieldEnd = field + length;
+                uint64_t* values[] = {&entry.uncompressedSize, &entry.compressedSize,
+                                      &entry.localHeaderOffset};
+                for (uint64_t* value : values) {
+                    if (*value == 0xFFFFFFFF && fieldEnd - field >= 8) {
+                        *value = zip::ReadU64(field);
+                        field += 8;
+                    }
+                }
+            }
+            extra += 4 + length;
+        }
+
+        // '%5C' decodes to a backslash, which Windows treats as a separator:
+        // names are compared and checked in their '/' form only.
+        entry.name = NormalizeName(DecodeZipItemName(zipName));
+        index_.emplace(entry.name, entries_.size());
+        entries_.push_back(std::move(entry));
+        p += recordSize;
+    }
+    return true;
+}
+
+struct EntryBlockReader::State {
+    const PackageEntry* entry = nullptr;
+    const BlockMapFile* map = nullptr;
+    const uint8_t* data = nullptr;
+    InflateContext context;
+    const uint8_t* in = nullptr;
+    uint64_t inRemaining = 0;
+    uint64_t next = 0;  // block the stream produces next
+    std::vector<uint8_t> block;
+
+    bool Restart() {
+        in = data;
+        inRemaining = entry->compressedSize;
+        next = 0;
+        if (!context.Prepare()) {
+            return false;
+        }
+        context.stream.avail_in = 0;
+        return true;
+    }
+};
+
+EntryBlockReader::EntryBlockReader() : state_(new State()) {}
+
+EntryBlockReader::~EntryBlockReader() = default;
+
+bool EntryBlockReader::Open(const PackageReader& reader, const PackageEntry& entry,
+                            std::string* error) {
+    State& state = *state_;
+    state.entry = &entry;
+    state.data = reader.EntryData(entry);
+    if (state.data == nullptr) {
+        *error = "Damaged local header for " + entry.name;
+        return false;
+    }
+    state.map = reader.FindBlockMapFile(entry);
+    if (state.map != nullptr && state.map->blocks.size() != BlockCount(entry.uncompressedSize)) {
+        state.map = nullptr;
+    }
+    if (entry.method == zip::kMethodStored) {
+        if (entry.compressedSize != entry.uncompressedSize) {
+            *error = "Stored entry " + entry.name + " has mismatched sizes";
+            return false;
+        }
+        return true;
+    }
+    if (entry.method != zip::kMethodDeflated) {
+        *error = "Unsupported compression method in " + entry.name;
+        return false;
+    }
+    state.block.resize(kBlockSize);
+    if (!state.Restart()) {
+        *error = "inflateInit failed";
+        return false;
+    }
+    return true;
+}
+
+bool EntryBlockReader::Read(uint64_t index, const uint8_t** block, size_t* length,
+                            std::string* error) {
+    State& state = *state_;
+    const PackageEntry& entry = *state.entry;
+    if (index >= BlockCount(entry.uncompressedSize)) {
+        *error = entry.name + " has no block " + std::to_string(index);
+        return false;
+    }
+    uint64_t offset = index * kBlockSize;
+    *length = static_cast<size_t>(std::min<uint64_t>(kBlockSize, entry.uncompressedSize - offset));
+    if (entry.method == zip::kMethodStored) {
+        *block = state.data + offset;
+    } else {
+        if (index < state.next && !state.Restart()) {
+            *error = "inflateReset failed";
+            return false;
+        }
+        z_stream& stream = state.context.stream;
+        for (; state.next <= index; state.next++) {
+            size_t wanted = static_cast<size_t>(
+                std::min<uint64_t>(kBlockSize, entry.uncompressedSize - state.next * kBlockSize));
+            stream.next_out = state.block.data();
+            stream.avail_out = static_cast<uInt>(wanted);
+            int status = Z_OK;
+            while (stream.avail_out > 0 && status != Z_STREAM_END) {
+                if (stream.avail_in == 0 && state.inRemaining > 0) {
+                    uInt chunk = static_cast<uInt>(std::min<uint64_t>(state.inRemaining, 1u << 30));
+                    stream.next_in = const_cast<Bytef*>(state.in);
+                    stream.avail_in = chunk;
+                    state.in += chunk;
+                    state.inRemaining -= chunk;
+                }
+                status = inflate(&stream, Z_NO_FLUSH);
+                if (status != Z_OK && status != Z_STREAM_END) {
+                    *error = "Corrupt deflate data in " + entry.name;
+                    state.next = UINT64_MAX;
+                    return false;
+                }
+            }
+            if (stream.avail_out != 0) {
+                *error = "Entry " + entry.name + " is shorter than its recorded size";
+                state.next = UINT64_MAX;
+                return false;
+            }
+        }
+        *block = state.block.data();
+    }
+    if (state.map != nullptr && Sha256Hash(*block, *length) != state.map->blocks[index].hash) {
+        *error = "Block " + std::to_string(index) + " of " + entry.name +
+                 " does not match AppxBlockMap.xml";
+        return false;
+    }
+    return true;
+}
+
+bool IsSafePackagePath(const std::string& name) {
+    if (name.empty() || name[0] == '/' || name[0] == '\\') {
+        return false;
+    }
+    size_t start = 0;
+    while (start <= name.size()) {
+        size_t end = name.find_first_of("/\\", start);
+        if (end == std::string::npos) {
+            end = name.size();
+        }
+        std::string segment = name.substr(start, end - start);
+        // Empty and dot-only segments (Windows also drops trailing dots and
+        // spaces, so ".. " is ".."); ':' makes a drive or a stream name.
+        if (segment.find_first_not_of(". ") == std::string::npos) {
+            return false;
+        }
+        for (unsigned char c : segment) {
+            if (c < 0x20 || c == ':') {
+                return false;
+            }
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+const PackageEntry* PackageReader::Find(const std::string& name) const {
+    auto it = index_.find(NormalizeName(name));
+    return it == index_.end() ? nullptr : &entries_[it->second];
+}
+
+const uint8_t* PackageReader::EntryData(const PackageEntry& entry) const {
+    const uint8_t* data = file_.Data();
+    uint64_t size = file_.Size();
+    uint64_t header = entry.localHeaderOffset;
+    if (header > size || size - header < zip::kLocalFileHeaderFixedSize ||
+        zip::ReadU32(data + header) != zip::kLocalFileHeaderSignature) {
+        return nullptr;
+    }
+    uint64_t start = header + zip::kLocalFileHeaderFixedSize + zip::ReadU16(data + header + 26) +
+                     zip::ReadU16(data + header + 28);
+    if (start > size || size - start < entry.compressedSize) {
+        return nullptr;
+    }
+    return data + start;
+}
+
+bool PackageReader::ReadEntry(const PackageEntry& entry, std::vector<uint8_t>* out,
+                              std::string* error) const {
+    const uint8_t* data = EntryData(entry);
+    if (data == nullptr) {
+        *error = "Damaged local header for " + entry.name;
+        return false;
+    }
+    out->resize(static_cast<size_t>(entry.uncompressedSize));
+    BlockVerifier verifier(entry, FindBlockMapFile(entry), true);
+    bool ok = DecodeEntry(
+        entry, data,
+        [&](uint64_t index, const uint8_t* block, size_t length) {
+            if (!verifier.Block(index, block, length, error)) {
+                return false;
+            }
+            memcpy(out->data() + index * kBlockSize, block, length);
+            return true;
+        },
+        error);
+    return ok && verifier.Finish(error);
+}
+
+bool PackageReader::LoadBlockMap(std::string* error) {
+    const PackageEntry* entry = Find(kBlockMapName);
+    if (entry == nullptr) {
+        *error = path_ + " has no " + kBlockMapName;
+        return false;
+    }
+    std::vector<uint8_t> xml;
+    if (!ReadEntry(*entry, &xml, error) ||
+        !ParseBlockMapXml(reinterpret_cast<const char*>(xml.data()), xml.size(), &blockMap_,
+                          error)) {
+        return false;
+    }
+    blockMapIndex_.clear();
+    for (size_t i = 0; i < blockMap_.size(); i++) {
+        blockMapIndex_.emplace(NormalizeName(blockMap_[i].name), i);
+    }
+    return true;
+}
+
+const BlockMapFile* PackageReader::FindBlockMapFile(const PackageEntry& entry) const {
+    auto it = blockMapIndex_.find(entry.name);
+    if (it == blockMapIndex_.end()) {
+        return nullptr;
+    }
+    const BlockMapFile* file = &blockMap_[it->second];
+    return file->size == entry.uncompressedSize ? file : nullptr;
+}
+
+bool ExtractPackage(PackageReader& reader, const ExtractOptions& options, ExtractStats* stats,
+                    std::string* error) {
+    auto startTime = std::chrono::steady_clock::now();
+    *stats = ExtractStats();
+
+    std::string mapError;
+    if (!reader.LoadBlockMap(&mapError) && options.verify) {
+        *error = mapError;
+        return false;
+    }
+
+    std::vector<std::unique_ptr<FileJob>> jobs;
+    std::set<fs::path> directories;
+    fs::path root = fs::u8path(options.outputDir);
+    for (const PackageEntry& entry : reader.Entries()) {
+        bool directory = !entry.name.empty() && entry.name.back() == '/';
+        if (!IsSafePackagePath(directory ? entry.name.substr(0, entry.name.size() - 1)
+                                         : entry.name)) {
+            *error = "Refusing to extract unsafe path " + entry.name;
+            return false;
+        }
+        if (directory) {
+            directories.insert(root / fs::u8path(entry.name));
+            continue;
+        }
+        std::unique_ptr<FileJob> job(new FileJob());
+        job->entry = &entry;
+        job->map = reader.FindBlockMapFile(entry);
+        job->data = reader.EntryData(entry);
+        if (job->data == nullptr) {
+            *error = "Damaged local header for " + entry.name;
+            return false;
+        }
+        if (options.verify && job->map == nullptr && !IsGeneratedFootprintFile(entry.name)) {
+            *error = entry.name + " is missing from " + kBlockMapName;
+            return false;
+        }
+        fs::path output = root / fs::u8path(entry.name);
+        directories.insert(output.parent_path());
+        job->outputPath = output.u8string();
+        stats->bytes += entry.uncompressedSize;
+        jobs.push_back(std::move(job));
+    }
+    for (const fs::path& directory : directories) {
+        std::error_code ec;
+        fs::create_directories(directory, ec);
+        if (ec) {
+            *error = "Failed to create " + directory.u8string() + ": " + ec.message();
+            return false;
+        }
+    }
+
+    // Declared before the pool so that it outlives every task.
+    WriteQueue queue(options.asyncWrites ? 128 : 0);
+    stats->ioUring = queue.UsesIoUring();
+    ThreadPool pool(options.threads);
+    std::vector<std::future<void>> pending;
+    for (auto& owned : jobs) {
+        FileJob* job = owned.get();
+        job->queue = &queue;
+        job->sync = options.syncFiles;
+        bool verify = options.verify;
+        if (PlanBlockParallel(job)) {
+            stats->blockParallelFiles++;
+            job->blocksLeft = job->blockOffsets.size() - 1;
+            for (uint64_t i = 0; i + 1 < job->blockOffsets.size(); i++) {
+                pending.push_back(pool.Submit([job, i, verify] { ExtractBlock(job, i, verify); }));
+            }
+        } else {
+            pending.push_back(pool.Submit([job, verify] { ExtractFile(job, verify); }));
+        }
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+
+    // A block that needed its predecessor's window after all (the probe only
+    // looks at block 1): redo the file as one stream.
+    pending.clear();
+    for (auto& owned : jobs) {
+        FileJob* job = owned.get();
+        if (job->inflateFailed && job->error.empty()) {
+            stats->blockParallelFiles--;
+            bool verify = options.verify;
+            pending.push_back(pool.Submit([job, verify] { ExtractFile(job, verify); }));
+        }
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+
+    bool written = queue.Drain();
+    for (auto& job : jobs) {
+        if (job->error.empty() && !written) {
+            job->error = "Failed to write " + job->outputPath;
+        }
+        if (!job->error.empty()) {
+            *error = job->error;
+            return false;
+        }
+    }
+    stats->fileCount = jobs.size();
+    stats->seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    return true;
+}
+
+}  // namespace msix
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "block_map.h"
+#include "file_io.h"
+
+namespace msix {
+
+struct PackageEntry {
+    std::string name;  // decoded, '/'-separated
+    uint16_t method = 0;
+    uint32_t crc = 0;
+    uint64_t compressedSize = 0;
+    uint64_t uncompressedSize = 0;
+    uint64_t localHeaderOffset = 0;
+};
+
+// Random access to an .msix/.appx. The archive is mapped once and its ZIP64
+// central directory indexed by name, so any file can be served without
+// walking the local headers.
+class PackageReader {
+public:
+    bool Open(const std::string& path, std::string* error);
+
+    const std::vector<PackageEntry>& Entries() const { return entries_; }
+
+    // Accepts '/' or '\' separators.
+    const PackageEntry* Find(const std::string& name) const;
+
+    // The entry's bytes as stored in the archive, or null if the local
+    // header is damaged.
+    const uint8_t* EntryData(const PackageEntry& entry) const;
+
+    // Inflates an entry into memory and checks it against its block map
+    // hashes (payload) or its CRC-32 (footprint files).
+    bool ReadEntry(const PackageEntry& entry, std::vector<uint8_t>* out,
+                   std::string* error) const;
+
+    // Parses AppxBlockMap.xml. Until this has succeeded, reads fall back to
+    // CRC-32 verification.
+    bool LoadBlockMap(std::string* error);
+    const BlockMapFile* FindBlockMapFile(const PackageEntry& entry) const;
+
+private:
+    bool ReadCentralDirectory(std::string* error);
+
+    std::string path_;
+    MappedFile file_;
+    std::vector<PackageEntry> entries_;
+    std::unordered_map<std::string, size_t> index_;
+    std::vector<BlockMapFile> blockMap_;
+    std::unordered_map<std::string, size_t> blockMapIndex_;  // keyed by '/' name
+};
+
+// Reads the 64 KB blocks of one entry in any order while holding a single
+// block and the inflate state, so memory does not grow with the file. A
+// primed stream cannot be entered in the middle: a later block is inflated
+// forward from the current position and an earlier one starts over, which
+// makes in-order reads the cheap case. Blocks are checked against the block
+// map when the entry is in it.
+class EntryBlockReader {
+public:
+    EntryBlockReader();
+    ~EntryBlockReader();
+
+    EntryBlockReader(const EntryBlockReader&) = delete;
+    EntryBlockReader& operator=(const EntryBlockReader&) = delete;
+
+    // The reader must outlive this object.
+    bool Open(const PackageReader& reader, const PackageEntry& entry, std::string* error);
+
+    // Block `index`; *block stays valid until the next Read().
+    bool Read(uint64_t index, const uint8_t** block, size_t* length, std::string* error);
+
+private:
+    struct State;
+
+    std::unique_ptr<State> state_;
+};
+
+// Whether a package-relative name stays inside the directory it is extracted
+// to on every platform: no root or drive, no '..', '.' or empty segments,
+// no ':' or control characters. Both separators are checked.
+bool IsSafePackagePath(const std::string& name);
+
+struct ExtractOptions {
+    std::string outputDir;
+    unsigned threads = 0;  // 0 = one per hardware thread
+    bool verify = true;
+    // Queue file writes on an io_uring (see write_queue.h) instead of
+    // writing from the inflating threads.
+    bool asyncWrites = true;
+    // Flush every file to stable storage before closing it.
+    bool syncFiles = false;
+};
+
+struct ExtractStats {
+    uint64_t fileCount = 0;
+    uint64_t bytes = 0;
+    // Files whose blocks were inflated in parallel (stored files, or deflated
+    // files packed without dictionary priming).
+    uint64_t blockParallelFiles = 0;
+    bool ioUring = false;  // writes went through an io_uring
+    double seconds = 0;
+};
+
+// Extracts every entry under outputDir. Output files are preallocated and
+// written at their final offsets from a worker pool; each 64 KB block is
+// verified against AppxBlockMap.xml as soon as it is inflated.
+bool ExtractPackage(PackageReader& reader, const ExtractOptions& options, ExtractStats* stats,
+                    std::string* error);
+
+}  // namespace msix
@@ -0,0 +1,578 @@
+#include "package_vfs.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <map>
+#include <mutex>
+
+#include "block_codec.h"
+#include "footprint.h"
+#include "thread_pool.h"
+#include "zip_format.h"
+
+namespace msix {
+
+namespace {
+
+// One raw-inflate state per thread, reset between blocks.
+struct InflateContext {
+    z_stream stream = {};
+    bool initialized = false;
+
+    ~InflateContext() {
+        if (initialized) {
+            inflateEnd(&stream);
+        }
+    }
+
+    bool Prepare() {
+        if (initialized) {
+            return inflateReset(&stream) == Z_OK;
+        }
+        stream = {};
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+            return false;
+        }
+        initialized = true;
+        return true;
+    }
+};
+
+// Inflates one sync-flushed block, primed with the bytes that precede it
+// when dictionaryLength > 0. Fails unless the block decodes to exactly
+// expectedLength bytes; without a dictionary, a back-reference out of the
+// block fails too.
+bool InflateRaw(const uint8_t* in, size_t inLength, const uint8_t* dictionary,
+                size_t dictionaryLength, size_t expectedLength, std::vector<uint8_t>* out) {
+    thread_local InflateContext context;
+    if (!context.Prepare()) {
+        return false;
+    }
+    z_stream& stream = context.stream;
+    if (dictionaryLength > 0 &&
+        inflateSetDictionary(&stream, dictionary, static_cast<uInt>(dictionaryLength)) != Z_OK) {
+        return false;
+    }
+    // One spare byte so a block that decodes too long is detected.
+    out->resize(expectedLength + 1);
+    stream.next_in = const_cast<Bytef*>(in);
+    stream.avail_in = static_cast<uInt>(inLength);
+    stream.next_out = out->data();
+    stream.avail_out = static_cast<uInt>(out->size());
+    int status = inflate(&stream, Z_SYNC_FLUSH);
+    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR) {
+        return false;
+    }
+    if (stream.avail_in != 0 || stream.total_out != expectedLength) {
+        return false;
+    }
+    out->resize(expectedLength);
+    return true;
+}
+
+std::string NormalizePath(const std::string& path) {
+    std::string normalized = path;
+    std::replace(normalized.begin(), normalized.end(), '\\', '/');
+    size_t start = normalized.find_first_not_of('/');
+    if (start == std::string::npos) {
+        return std::string();
+    }
+    normalized.erase(0, start);
+    while (!normalized.empty() && normalized.back() == '/') {
+        normalized.pop_back();
+    }
+    return normalized;
+}
+
+uint64_t CacheKey(size_t entry, uint64_t index) {
+    return (static_cast<uint64_t>(entry) << 32) | index;
+}
+
+// How a deflated entry's blocks relate to each other, learned on first use.
+enum Priming : uint8_t { kPrimingUnknown, kIndependent, kPrimed };
+
+}  // namespace
+
+struct PackageVfs::Layout {
+    enum Kind { kStored, kBlocks, kWhole };
+
+    std::once_flag resolved;  // kind and map are set by ResolveLayout
+    Kind kind = kWhole;
+    const uint8_t* data = nullptr;
+    std::unique_ptr<BlockMapFile> map;
+    uint64_t size = 0;
+    std::vector<uint64_t> blockOffsets;  // kBlocks: start of each block, plus the end
+    std::atomic<uint8_t> priming{kPrimingUnknown};
+    // kStored: blocks already checked against the block map (or the whole
+    // entry against its CRC when it has no block map entry).
+    std::unique_ptr<std::atomic<bool>[]> checked;
+    std::mutex wholeMutex;  // kWhole: one inflate of the entry at a time
+
+    uint64_t BlockLength(uint64_t index) const {
+        return std::min<uint64_t>(kBlockSize, size - index * kBlockSize);
+    }
+};
+
+// AppxBlockMap.xml, inflated once and indexed by File element.
+struct PackageVfs::LazyBlockMap {
+    std::once_flag loaded;
+    std::vector<uint8_t> xml;
+    std::unordered_map<std::string, BlockMapFileSpan> spans;  // by '/' name
+};
+
+struct PackageVfs::Directory {
+    std::vector<VfsDirEntry> children;
+};
+
+// LRU of decompressed blocks, split into shards with a lock each so that
+// readers of different files rarely contend.
+struct PackageVfs::Cache {
+    struct Shard {
+        std::mutex mutex;
+        std::list<std::pair<uint64_t, Block>> lru;  // most recent first
+        std::unordered_map<uint64_t, std::list<std::pair<uint64_t, Block>>::iterator> index;
+        uint64_t bytes = 0;
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    unsigned shardCount = 1;
+    uint64_t shardCapacity = 0;
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evicted{0};
+
+    Cache(uint64_t capacity, unsigned count) {
+        shardCount = std::max(1u, count);
+        shards.reset(new Shard[shardCount]);
+        shardCapacity = std::max<uint64_t>(capacity / shardCount, kBlockSize);
+    }
+
+    Shard& ShardFor(uint64_t key) {
+        return shards[((key * 0x9E3779B97F4A7C15ull) >> 40) % shardCount];
+    }
+
+    // countStats is false for probes that are not reads (prefetch, the walk
+    // back to a cached predecessor).
+    Block Find(uint64_t key, bool countStats) {
+        Shard& shard = ShardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            if (countStats) {
+                misses++;
+            }
+            return nullptr;
+        }
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        if (countStats) {
+            hits++;
+        }
+        return it->second->second;
+    }
+
+    void Insert(uint64_t key, const Block& block) {
+        Shard& shard = ShardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.index.count(key) != 0) {
+            return;
+        }
+        shard.lru.emplace_front(key, block);
+        shard.index.emplace(key, shard.lru.begin());
+        shard.bytes += block->size();
+        while (shard.bytes > shardCapacity && shard.lru.size() > 1) {
+            auto& oldest = shard.lru.back();
+            shard.bytes -= oldest.second->size();
+            shard.index.erase(oldest.first);
+            shard.lru.pop_back();
+            evicted++;
+        }
+    }
+
+    uint64_t Bytes() {
+        uint64_t total = 0;
+        for (unsigned i = 0; i < shardCount; i++) {
+            std::lock_guard<std::mutex> lock(shards[i].mutex);
+            total += shards[i].bytes;
+        }
+        return total;
+    }
+};
+
+PackageVfs::PackageVfs() = default;
+
+PackageVfs::~PackageVfs() {
+    prefetchPool_.reset();
+}
+
+bool PackageVfs::Open(const std::string& packagePath, const VfsOptions& options,
+                      std::string* error) {
+    prefetchPool_.reset();
+    options_ = options;
+    if (!reader_.Open(packagePath, error)) {
+        return false;
+    }
+    const std::vector<PackageEntry>& entries = reader_.Entries();
+    layouts_.reset(new Layout[entries.size()]);
+    std::map<std::string, std::map<std::string, VfsDirEntry>> tree;
+    tree[""];
+    for (size_t i = 0; i < entries.size(); i++) {
+        const PackageEntry& entry = entries[i];
+        std::string name = NormalizePath(entry.name);
+        bool isDirectory = !entry.name.empty() && entry.name.back() == '/';
+        // Register the entry and every ancestor with its parent.
+        for (std::string path = name; !path.empty();) {
+            size_t slash = path.rfind('/');
+            std::string parent = slash == std::string::npos ? std::string() : path.substr(0, slash);
+            VfsDirEntry child;
+            child.name = path.substr(slash == std::string::npos ? 0 : slash + 1);
+            child.directory = path != name || isDirectory;
+            child.size = child.directory ? 0 : entry.uncompressedSize;
+            tree[parent].emplace(child.name, child);
+            if (child.directory) {
+                tree[path];
+            }
+            path = parent;
+        }
+
+        layouts_[i].size = entry.uncompressedSize;
+        layouts_[i].data = isDirectory ? nullptr : reader_.EntryData(entry);
+    }
+
+    directories_.clear();
+    directoryIndex_.clear();
+    for (auto& directory : tree) {
+        Directory flat;
+        for (auto& child : directory.second) {
+            flat.children.push_back(child.second);
+        }
+        directoryIndex_.emplace(directory.first, directories_.size());
+        directories_.push_back(std::move(flat));
+    }
+
+    blockMap_.reset(new LazyBlockMap());
+    cache_.reset(new Cache(options.cacheBytes, options.cacheShards));
+    return true;
+}
+
+const PackageVfs::Directory* PackageVfs::FindDirectory(const std::string& path) const {
+    auto it = directoryIndex_.find(NormalizePath(path));
+    return it == directoryIndex_.end() ? nullptr : &directories_[it->second];
+}
+
+bool PackageVfs::Stat(const std::string& path, VfsStat* stat) const {
+    if (FindDirectory(path) != nullptr) {
+        stat->directory = true;
+        stat->size = 0;
+        return true;
+    }
+    const PackageEntry* entry = reader_.Find(NormalizePath(path));
+    if (entry == nullptr) {
+        return false;
+    }
+    stat->directory = false;
+    stat->size = entry->uncompressedSize;
+    return true;
+}
+
+bool PackageVfs::ReadDir(const std::string& path, std::vector<VfsDirEntry>* entries) const {
+    const Directory* directory = FindDirectory(path);
+    if (directory == nullptr) {
+        return false;
+    }
+    *entries = directory->children;
+    return true;
+}
+
+std::unique_ptr<VfsFile> PackageVfs::OpenFile(const std::string& path) const {
+    std::string name = NormalizePath(path);
+    const PackageEntry* entry = reader_.Find(name);
+    if (entry == nullptr || FindDirectory(name) != nullptr) {
+        return nullptr;
+    }
+    size_t index = static_cast<size_t>(entry - reader_.Entries().data());
+    return std::unique_ptr<VfsFile>(new VfsFile(const_cast<PackageVfs*>(this), index));
+}
+
+VfsCacheStats PackageVfs::CacheStats() const {
+    VfsCacheStats stats;
+    if (cache_ == nullptr) {
+        return stats;
+    }
+    stats.hits = cache_->hits;
+    stats.misses = cache_->misses;
+    stats.evictedBlocks = cache_->evicted;
+    stats.cachedBytes = cache_->Bytes();
+    stats.inflatedBlocks = inflated_;
+    stats.prefetchedBlocks = prefetched_;
+    return stats;
+}
+
+void PackageVfs::ResolveLayout(size_t entry) {
+    Layout& layout = layouts_[entry];
+    std::call_once(layout.resolved, [&] {
+        const PackageEntry& info = reader_.Entries()[entry];
+        if (layout.data == nullptr || info.uncompressedSize == 0) {
+            return;
+        }
+        std::call_once(blockMap_->loaded, [&] {
+            const PackageEntry* mapEntry = reader_.Find(kBlockMapName);
+            std::vector<BlockMapFileSpan> spans;
+            std::string error;
+            // Without a readable block map, entries are checked by CRC-32.
+            if (mapEntry == nullptr || !reader_.ReadEntry(*mapEntry, &blockMap_->xml, &error) ||
+                !IndexBlockMapXml(reinterpret_cast<const char*>(blockMap_->xml.data()),
+                                  blockMap_->xml.size(), &spans, &error)) {
+                return;
+            }
+            for (BlockMapFileSpan& span : spans) {
+                std::string name = NormalizePath(span.name);
+                blockMap_->spans.emplace(std::move(name), std::move(span));
+            }
+        });
+        auto span = blockMap_->spans.find(info.name);
+        std::vector<BlockMapFile> files;
+        std::string error;
+        if (span != blockMap_->spans.end() &&
+            ParseBlockMapXml(
+                reinterpret_cast<const char*>(blockMap_->xml.data()) + span->second.offset,
+                span->second.length, &files, &error) &&
+            files.size() == 1 && files[0].size == info.uncompressedSize) {
+            layout.map.reset(new BlockMapFile(std::move(files[0])));
+        }
+
+        uint64_t blockCount = BlockCount(info.uncompressedSize);
+        if (info.method == zip::kMethodStored && info.compressedSize == info.uncompressedSize) {
+            layout.kind = Layout::kStored;
+            layout.checked.reset(new std::atomic<bool>[blockCount]());
+        } else if (info.method == zip::kMethodDeflated && layout.map != nullptr &&
+                   layout.map->compressed && layout.map->blocks.size() == blockCount) {
+            layout.blockOffsets.resize(blockCount + 1);
+            uint64_t offset = 0;
+            for (uint64_t b = 0; b < blockCount; b++) {
+                layout.blockOffsets[b] = offset;
+                offset += layout.map->blocks[b].compressedSize;
+            }
+            layout.blockOffsets[blockCount] = offset;
+            if (offset == info.compressedSize) {
+                layout.kind = Layout::kBlocks;
+            }
+        }
+    });
+}
+
+const uint8_t* PackageVfs::StoredBlock(size_t entry, uint64_t index, std::string* error) {
+    Layout& layout = layouts_[entry];
+    if (layout.map != nullptr) {
+        if (!layout.checked[index]) {
+            if (index >= layout.map->blocks.size() ||
+                Sha256Hash(layout.data + index * kBlockSize, layout.BlockLength(index)) !=
+                    layout.map->blocks[index].hash) {
+                *error = "Block " + std::to_string(index) + " of " +
+                         reader_.Entries()[entry].name + " does not match AppxBlockMap.xml";
+                return nullptr;
+            }
+            layout.checked[index] = true;
+        }
+    } else if (!layout.checked[0]) {
+        const PackageEntry& info = reader_.Entries()[entry];
+        uLong crc = crc32(0L, Z_NULL, 0);
+        for (uint64_t offset = 0; offset < layout.size; offset += 1u << 30) {
+            crc = crc32(crc, layout.data + offset,
+                        static_cast<uInt>(std::min<uint64_t>(1u << 30, layout.size - offset)));
+        }
+        if (crc != info.crc) {
+            *error = "CRC mismatch in " + info.name;
+            return nullptr;
+        }
+        layout.checked[0] = true;
+    }
+    return layout.data + index * kBlockSize;
+}
+
+PackageVfs::Block PackageVfs::GetBlock(size_t entry, uint64_t index, std::string* error) {
+    Block block = cache_->Find(CacheKey(entry, index), true);
+    if (block != nullptr) {
+        return block;
+    }
+    if (layouts_[entry].kind == Layout::kBlocks) {
+        return InflateBlock(entry, index, error);
+    }
+    return InflateWhole(entry, index, error);
+}
+
+PackageVfs::Block PackageVfs::InflateBlock(size_t entry, uint64_t index, std::string* error) {
+    Layout& layout = layouts_[entry];
+    const std::string& name = reader_.Entries()[entry].name;
+    auto decode = [&](uint64_t b, const uint8_t* dictionary, size_t dictionaryLength,
+                      std::vector<uint8_t>* out) {
+        const uint8_t* in = layout.data + layout.blockOffsets[b];
+        size_t inLength = static_cast<size_t>(layout.blockOffsets[b + 1] - layout.blockOffsets[b]);
+        return InflateRaw(in, inLength, dictionary, dictionaryLength,
+                          static_cast<size_t>(layout.BlockLength(b)), out) &&
+               Sha256Hash(out->data(), out->size()) == layout.map->blocks[b].hash;
+    };
+    auto publish = [&](uint64_t b, std::vector<uint8_t>&& data) {
+        Block block = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+        cache_->Insert(CacheKey(entry, b), block);
+        inflated_++;
+        return block;
+    };
+
+    // Most packages here are packed without priming, and then every block
+    // decodes on its own. Try that first until a block proves otherwise.
+    std::vector<uint8_t> out;
+    if (index == 0 || layout.priming != kPrimed) {
+        if (decode(index, nullptr, 0, &out)) {
+            if (index > 0) {
+                uint8_t unknown = kPrimingUnknown;
+                layout.priming.compare_exchange_strong(unknown, kIndependent);
+            }
+            return publish(index, std::move(out));
+        }
+        if (index == 0) {
+            *error = "Block 0 of " + name + " is corrupt or does not match AppxBlockMap.xml";
+            return nullptr;
+        }
+        layout.priming = kPrimed;
+    }
+
+    // Primed: block i needs the tail of block i - 1. Walk back to the
+    // nearest cached block (or the start) and decode forward from there.
+    uint64_t start = index - 1;
+    Block previous;
+    while ((previous = cache_->Find(CacheKey(entry, start), false)) == nullptr && start > 0) {
+        start--;
+    }
+    if (previous == nullptr) {
+        previous = InflateBlock(entry, 0, error);
+        if (previous == nullptr) {
+            return nullptr;
+        }
+    }
+    for (uint64_t b = start + 1; b <= index; b++) {
+        size_t dictionaryLength = std::min(previous->size(), kDictionarySize);
+        if (!decode(b, previous->data() + previous->size() - dictionaryLength, dictionaryLength,
+                    &out)) {
+            *error = "Block " + std::to_string(b) + " of " + name +
+                     " is corrupt or does not match AppxBlockMap.xml";
+            return nullptr;
+        }
+        previous = publish(b, std::move(out));
+        out = std::vector<uint8_t>();
+    }
+    return previous;
+}
+
+PackageVfs::Block PackageVfs::InflateWhole(size_t entry, uint64_t index, std::string* error) {
+    Layout& layout = layouts_[entry];
+    std::lock_guard<std::mutex> lock(layout.wholeMutex);
+    // Another reader may have inflated it while this one waited.
+    Block block = cache_->Find(CacheKey(entry, index), false);
+    if (block != nullptr) {
+        return block;
+    }
+    std::vector<uint8_t> data;
+    if (layout.data == nullptr) {
+        *error = "Damaged local header for " + reader_.Entries()[entry].name;
+        return nullptr;
+    }
+    if (!reader_.ReadEntry(reader_.Entries()[entry], &data, error)) {
+        return nullptr;
+    }
+    for (uint64_t b = 0, offset = 0; offset < data.size(); b++, offset += kBlockSize) {
+        auto begin = data.begin() + static_cast<ptrdiff_t>(offset);
+        auto end = data.begin() + static_cast<ptrdiff_t>(offset + layout.BlockLength(b));
+        Block part = std::make_shared<const std::vector<uint8_t>>(begin, end);
+        cache_->Insert(CacheKey(entry, b), part);
+        inflated_++;
+        if (b == index) {
+            block = part;
+        }
+    }
+    return block;
+}
+
+void PackageVfs::Prefetch(size_t entry, uint64_t first, uint64_t end) {
+    if (options_.prefetchThreads == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(prefetchMutex_);
+    if (prefetchPool_ == nullptr) {
+        prefetchPool_.reset(new ThreadPool(options_.prefetchThreads));
+    }
+    prefetchPool_->Submit([this, entry, first, end] {
+        std::string error;
+        for (uint64_t b = first; b < end; b++) {
+            if (cache_->Find(CacheKey(entry, b), false) != nullptr) {
+                continue;
+            }
+            if (InflateBlock(entry, b, &error) == nullptr) {
+                return;  // the read that needs it will report the error
+            }
+            prefetched_++;
+        }
+    });
+}
+
+uint64_t VfsFile::Size() const {
+    return vfs_->layouts_[entry_].size;
+}
+
+int64_t VfsFile::Read(uint64_t offset, void* buffer, size_t length, std::string* error) {
+    PackageVfs::Layout& layout = vfs_->layouts_[entry_];
+    if (offset >= layout.size || length == 0) {
+        return 0;
+    }
+    length = static_cast<size_t>(std::min<uint64_t>(length, layout.size - offset));
+    vfs_->ResolveLayout(entry_);
+    if (layout.data == nullptr) {
+        *error = "Damaged local header for " + vfs_->reader_.Entries()[entry_].name;
+        return -1;
+    }
+
+    uint8_t* out = static_cast<uint8_t*>(buffer);
+    uint64_t firstBlock = offset / kBlockSize;
+    uint64_t block = firstBlock;
+    size_t copied = 0;
+    while (copied < length) {
+        uint64_t within = (offset + copied) - block * kBlockSize;
+        size_t chunk = static_cast<size_t>(
+            std::min<uint64_t>(length - copied, layout.BlockLength(block) - within));
+        if (layout.kind == PackageVfs::Layout::kStored) {
+            const uint8_t* data = vfs_->StoredBlock(entry_, block, error);
+            if (data == nullptr) {
+                return -1;
+            }
+            memcpy(out + copied, data + within, chunk);
+        } else {
+            PackageVfs::Block data = vfs_->GetBlock(entry_, block, error);
+            if (data == nullptr) {
+                return -1;
+            }
+            memcpy(out + copied, data->data() + within, chunk);
+        }
+        copied += chunk;
+        if (copied < length) {
+            block++;
+        }
+    }
+
+    // Read-ahead for deflated entries once reads are sequential.
+    uint64_t expected = nextBlock_.exchange(block + 1);
+    if (layout.kind == PackageVfs::Layout::kBlocks && vfs_->options_.prefetchBlocks > 0 &&
+        (firstBlock == expected || firstBlock + 1 == expected)) {
+        uint64_t blockCount = layout.blockOffsets.size() - 1;
+        uint64_t from = std::max(prefetchedTo_.load(), block + 1);
+        uint64_t to = std::min<uint64_t>(block + 1 + vfs_->options_.prefetchBlocks, blockCount);
+        if (from < to) {
+            prefetchedTo_ = to;
+            vfs_->Prefetch(entry_, from, to);
+        }
+    }
+    return static_cast<int64_t>(copied);
+}
+
+}  // namespace msix
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "package_reader.h"
+
+// Read-only filesystem view of a package, served straight from the archive.
+//
+// Nothing is extracted up front: opening a package maps it and indexes its
+// central directory. AppxBlockMap.xml is inflated on the first read and only
+// indexed by File element; a file's blocks are parsed when it is first read.
+// Reads inflate only the 64 KB block-map blocks they touch:
+//  - stored entries are served from the mapping;
+//  - a deflated block starts at a byte boundary (the packer ends every block
+//    with a sync flush, see block_codec.h), so it is inflated on its own,
+//    primed with the last 32 KB of the previous block when the package was
+//    packed with dictionary priming;
+//  - entries without usable block sizes (footprint files, foreign packers)
+//    are inflated whole on first use.
+// Every inflated block is checked against AppxBlockMap.xml (CRC-32 for
+// footprint files) and kept in a sharded LRU cache of decompressed blocks.
+// Sequential reads through a VfsFile prefetch the blocks that follow on a
+// small worker pool.
+namespace msix {
+
+class ThreadPool;
+
+struct VfsOptions {
+    uint64_t cacheBytes = 256ull << 20;
+    unsigned cacheShards = 16;
+    // Blocks read ahead once a file is being read sequentially. 0 disables
+    // prefetching.
+    unsigned prefetchBlocks = 8;
+    unsigned prefetchThreads = 2;
+};
+
+struct VfsStat {
+    bool directory = false;
+    uint64_t size = 0;
+};
+
+struct VfsDirEntry {
+    std::string name;
+    bool directory = false;
+    uint64_t size = 0;
+};
+
+struct VfsCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t inflatedBlocks = 0;
+    uint64_t prefetchedBlocks = 0;
+    uint64_t evictedBlocks = 0;
+    uint64_t cachedBytes = 0;
+};
+
+class PackageVfs;
+
+// An open file. Reads may come from several threads; the sequential-read
+// detection is only a heuristic and tolerates races.
+class VfsFile {
+public:
+    uint64_t Size() const;
+
+    // Reads up to length bytes at offset. Returns the byte count (0 at end of
+    // file) or -1 with *error set.
+    int64_t Read(uint64_t offset, void* buffer, size_t length, std::string* error);
+
+private:
+    friend class PackageVfs;
+    VfsFile(PackageVfs* vfs, size_t entry) : vfs_(vfs), entry_(entry) {}
+
+    PackageVfs* vfs_;
+    size_t entry_;
+    std::atomic<uint64_t> nextBlock_{0};
+    std::atomic<uint64_t> prefetchedTo_{0};
+};
+
+class PackageVfs {
+public:
+    PackageVfs();
+    ~PackageVfs();
+
+    PackageVfs(const PackageVfs&) = delete;
+    PackageVfs& operator=(const PackageVfs&) = delete;
+
+    bool Open(const std::string& packagePath, const VfsOptions& options, std::string* error);
+
+    // Paths are package-relative with '/' or '\' separators; a leading
+    // separator and "" name the root.
+    bool Stat(const std::string& path, VfsStat* stat) const;
+    bool ReadDir(const std::string& path, std::vector<VfsDirEntry>* entries) const;
+    std::unique_ptr<VfsFile> OpenFile(const std::string& path) const;
+
+    VfsCacheStats CacheStats() const;
+
+private:
+    friend class VfsFile;
+    struct Cache;
+    struct Layout;
+    struct Directory;
+    struct LazyBlockMap;
+    using Block = std::shared_ptr<const std::vector<uint8_t>>;
+
+    void ResolveLayout(size_t entry);
+    Block GetBlock(size_t entry, uint64_t index, std::string* error);
+    Block InflateBlock(size_t entry, uint64_t index, std::string* error);
+    Block InflateWhole(size_t entry, uint64_t index, std::string* error);
+    const uint8_t* StoredBlock(size_t entry, uint64_t index, std::string* error);
+    void Prefetch(size_t entry, uint64_t first, uint64_t end);
+    const Directory* FindDirectory(const std::string& path) const;
+
+    PackageReader reader_;
+    VfsOptions options_;
+    std::unique_ptr<Layout[]> layouts_;  // per reader entry
+    std::unique_ptr<LazyBlockMap> blockMap_;
+    std::vector<Directory> directories_;
+    std::unordered_map<std::string, size_t> directoryIndex_;
+    std::unique_ptr<Cache> cache_;
+    std::atomic<uint64_t> inflated_{0};
+    std::atomic<uint64_t> prefetched_{0};
+    // Started by the first prefetch, so a process may fork (FUSE does when
+    // it daemonizes) after Open. Last, so that prefetch tasks finish before
+    // anything they use is gone.
+    std::mutex prefetchMutex_;
+    std::unique_ptr<ThreadPool> prefetchPool_;
+};
+
+}  // namespace msix
@@ -0,0 +1,296 @@
+// Round-trip check for the packer: packs a staging tree, reads it back with
+// PackageReader and compares every file byte for byte, recomputes each
+// block's SHA-256 against AppxBlockMap.xml, and extracts the package to
+// compare the result again. Without /d it generates a fixture tree that
+// covers empty, single-block and multi-block files, incompressible data
+// under a compressible name (which must come out stored) and names that
+// need percent-encoding. Exits non-zero on the first mismatch; build.ps1
+// runs it after building the tools.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "block_map.h"
+#include "footprint.h"
+#include "package_reader.h"
+#include "packer.h"
+#include "sha256.h"
+#include "zip_format.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [/d <staging_dir>] [/w <work_dir>] [/keep]\n"
+              << "  /d <dir>   Staging tree to round-trip (default: a generated fixture)\n"
+              << "  /w <dir>   Where to write the package and extraction (default: temp)\n"
+              << "  /keep      Leave the work directory behind\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+bool WriteFile(const fs::path& path, const std::string& contents) {
+    std::error_code ec;
+    fs::create_directories(path.parent_path(), ec);
+    std::ofstream out(path, std::ios::binary);
+    out.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    return static_cast<bool>(out);
+}
+
+bool ReadFile(const fs::path& path, std::string* contents) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    contents->assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool CreateFixture(const fs::path& root) {
+    std::mt19937_64 random(20240601);
+    auto noise = [&random](size_t length) {
+        std::string bytes(length, '\0');
+        for (char& c : bytes) {
+            c = static_cast<char>(random());
+        }
+        return bytes;
+    };
+    std::string text;
+    for (int line = 0; text.size() < 5 * msix::kBlockSize / 2; line++) {
+        text += "def function_" + std::to_string(line) + "(value):\n    return value * " +
+                std::to_string(line % 97) + "\n";
+    }
+    const std::pair<const char*, std::string> files[] = {
+        {"AppxManifest.xml",
+         "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<Package "
+         "xmlns=\"http://schemas.microsoft.com/appx/manifest/foundation/windows10\">\n"
+         "  <Identity Name=\"PackCheck\" Publisher=\"CN=PackCheck\" Version=\"1.0.0.0\" />\n"
+         "</Package>\n"},
+        {"empty.txt", std::string()},
+        {"small.py", "print('hello')\n"},
+        {"lib/module.py", text},
+        {"lib/exact_block.py", text.substr(0, msix::kBlockSize)},
+        {"lib/block_plus_one.py", text.substr(0, msix::kBlockSize + 1)},
+        // Deflate cannot shrink these, so the packer has to store them.
+        {"data/random.bin", noise(3 * msix::kBlockSize + 123)},
+        {"data/random_small.txt", noise(700)},
+        {"data/archive.zip", noise(msix::kBlockSize / 2)},
+        {"names/with space & percent%.txt", "encoded name\n"},
+        {"names/[brackets].txt", "brackets\n"},
+    };
+    for (const auto& file : files) {
+        if (!WriteFile(root / fs::u8path(file.first), file.second)) {
+            std::cerr << "Failed to write fixture file " << file.first << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Checker {
+    int failures = 0;
+
+    void Fail(const std::string& message) {
+        if (failures++ < 20) {
+            std::cerr << "FAIL: " << message << std::endl;
+        }
+    }
+};
+
+// Every payload file in the staging tree, keyed by '/'-separated name.
+std::map<std::string, fs::path> StagedFiles(const fs::path& root) {
+    std::map<std::string, fs::path> files;
+    for (const fs::directory_entry& entry : fs::recursive_directory_iterator(root)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        std::string relative = entry.path().lexically_relative(root).generic_u8string();
+        if (!msix::IsGeneratedFootprintFile(relative)) {
+            files[relative] = entry.path();
+        }
+    }
+    return files;
+}
+
+void CheckBlockMap(const std::string& name, const std::string& contents,
+                   const msix::BlockMapFile* mapFile, const msix::PackageEntry& entry,
+                   Checker* checker) {
+    if (mapFile == nullptr) {
+        checker->Fail(name + " is missing from AppxBlockMap.xml");
+        return;
+    }
+    if (mapFile->size != contents.size() ||
+        mapFile->blocks.size() != msix::BlockCount(contents.size())) {
+        checker->Fail(name + ": block map size or block count is wrong");
+        return;
+    }
+    if (mapFile->compressed != (entry.method == msix::zip::kMethodDeflated)) {
+        checker->Fail(name + ": block map and ZIP disagree on compression");
+    }
+    for (size_t i = 0; i < mapFile->blocks.size(); i++) {
+        size_t offset = i * msix::kBlockSize;
+        size_t length = std::min<size_t>(msix::kBlockSize, contents.size() - offset);
+        if (msix::Sha256Hash(contents.data() + offset, length) != mapFile->blocks[i].hash) {
+            checker->Fail(name + ": hash of block " + std::to_string(i) + " does not match");
+        }
+    }
+}
+
+void CheckPackage(const fs::path& stagingDir, const fs::path& packagePath,
+                  const fs::path& extractDir, bool fixture, Checker* checker) {
+    msix::PackageReader reader;
+    std::string error;
+    if (!reader.Open(packagePath.u8string(), &error) || !reader.LoadBlockMap(&error)) {
+        checker->Fail(error);
+        return;
+    }
+    std::map<std::string, fs::path> staged = StagedFiles(stagingDir);
+    size_t payloadEntries = 0;
+    for (const msix::PackageEntry& entry : reader.Entries()) {
+        if (!msix::IsGeneratedFootprintFile(entry.name)) {
+            payloadEntries++;
+            if (staged.find(entry.name) == staged.end()) {
+                checker->Fail("Package has " + entry.name + ", which is not in the staging tree");
+            }
+        }
+        if (entry.method == msix::zip::kMethodDeflated &&
+            entry.compressedSize > entry.uncompressedSize) {
+            checker->Fail(entry.name + " is deflated but larger than its contents");
+        }
+    }
+    if (payloadEntries != staged.size()) {
+        checker->Fail("Package has " + std::to_string(payloadEntries) + " payload files, staging tree " +
+                      std::to_string(staged.size()));
+    }
+    for (const char* name : {msix::kBlockMapName, msix::kContentTypesName}) {
+        if (reader.Find(name) == nullptr) {
+            checker->Fail(std::string("Package has no ") + name);
+        }
+    }
+
+    for (const auto& file : staged) {
+        const std::string& name = file.first;
+        std::string expected;
+        if (!ReadFile(file.second, &expected)) {
+            checker->Fail("Cannot read " + file.second.u8string());
+            continue;
+        }
+        const msix::PackageEntry* entry = reader.Find(name);
+        if (entry == nullptr) {
+            checker->Fail(name + " is missing from the package");
+            continue;
+        }
+        std::vector<uint8_t> actual;
+        if (!reader.ReadEntry(*entry, &actual, &error)) {
+            checker->Fail(name + ": " + error);
+            continue;
+        }
+        if (actual.size() != expected.size() ||
+            (!expected.empty() && memcmp(actual.data(), expected.data(), expected.size()) != 0)) {
+            checker->Fail(name + " reads back different bytes");
+        }
+        CheckBlockMap(name, expected, reader.FindBlockMapFile(*entry), *entry, checker);
+        if (fixture && name.compare(0, 5, "data/") == 0 &&
+            entry->method != msix::zip::kMethodStored) {
+            checker->Fail(name + " is incompressible but was not stored");
+        }
+
+        std::string extracted;
+        if (!ReadFile(extractDir / fs::u8path(name), &extracted)) {
+            checker->Fail(name + " was not extracted");
+        } else if (extracted != expected) {
+            checker->Fail(name + " was extracted with different bytes");
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string stagingDir;
+    std::string workDir;
+    bool keep = false;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "d") && hasValue) {
+            stagingDir = argv[++i];
+        } else if (IsFlag(arg, "w") && hasValue) {
+            workDir = argv[++i];
+        } else if (IsFlag(arg, "keep")) {
+            keep = true;
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::error_code ec;
+    fs::path work = workDir.empty()
+                        ? fs::temp_directory_path(ec) / ("packcheck-" + std::to_string(
+                                                                          std::random_device()()))
+                        : fs::u8path(workDir);
+    fs::remove_all(work, ec);
+    fs::create_directories(work, ec);
+    if (ec) {
+        std::cerr << "Cannot create " << work.u8string() << ": " << ec.message() << std::endl;
+        return 1;
+    }
+    bool fixture = stagingDir.empty();
+    fs::path staging = fixture ? work / "staging" : fs::u8path(stagingDir);
+    if (fixture && !CreateFixture(staging)) {
+        return 1;
+    }
+
+    Checker checker;
+    // Primed blocks inflate as one stream; unprimed ones block by block.
+    for (bool prime : {true, false}) {
+        std::string variant = prime ? "primed" : "unprimed";
+        msix::PackOptions options;
+        options.sourceDir = staging.u8string();
+        options.outputPath = (work / (variant + ".msix")).u8string();
+        options.primeDictionary = prime;
+        options.overwrite = true;
+        msix::PackStats packStats;
+        std::string error;
+        if (!msix::PackDirectory(options, &packStats, &error)) {
+            checker.Fail(variant + " pack: " + error);
+            continue;
+        }
+
+        fs::path extractDir = work / (variant + "-extracted");
+        msix::PackageReader reader;
+        msix::ExtractOptions extractOptions;
+        extractOptions.outputDir = extractDir.u8string();
+        msix::ExtractStats extractStats;
+        if (!reader.Open(options.outputPath, &error) || !reader.LoadBlockMap(&error) ||
+            !msix::ExtractPackage(reader, extractOptions, &extractStats, &error)) {
+            checker.Fail(variant + " unpack: " + error);
+            continue;
+        }
+        int before = checker.failures;
+        CheckPackage(staging, options.outputPath, extractDir, fixture, &checker);
+        std::cout << variant << ": " << packStats.fileCount << " files, "
+                  << packStats.uncompressedBytes << " -> " << packStats.archiveBytes << " bytes, "
+                  << (checker.failures == before ? "round-trip OK" : "MISMATCH") << std::endl;
+    }
+
+    if (!keep) {
+        fs::remove_all(work, ec);
+    }
+    if (checker.failures > 0) {
+        std::cerr << checker.failures << " round-trip check(s) failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
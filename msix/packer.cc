@@ -0,0 +1,471 @@
+#include "packer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "block_codec.h"
+#include "block_map.h"
+#include "file_io.h"
+#include "footprint.h"
+#include "pack_cache.h"
+#include "thread_pool.h"
+#include "zip_format.h"
+
+namespace fs = std::filesystem;
+
+namespace msix {
+
+namespace {
+
+// One archive entry, backed either by a file in the staging directory or by
+// a generated in-memory buffer.
+struct EntrySource {
+    std::string relativePath;  // '/'-separated
+    std::string fullPath;
+    std::shared_ptr<const std::string> memory;
+    uint64_t size = 0;
+    int64_t modifiedTime = 0;
+    bool compressed = true;
+    // Set when the repack cache already holds this file's encoded bytes.
+    std::shared_ptr<const CachedObject> cached;
+};
+
+bool CollectStagedFiles(const std::string& sourceDir, std::vector<EntrySource>* entries,
+                        std::string* error) {
+    std::error_code ec;
+    // Absolute, so repack cache index entries don't depend on the cwd.
+    fs::path root = fs::absolute(sourceDir, ec);
+    if (!fs::is_directory(root, ec)) {
+        *error = "Package directory '" + sourceDir + "' not found";
+        return false;
+    }
+
+    bool haveManifest = false;
+    fs::recursive_directory_iterator it(root, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+        std::error_code statEc;
+        if (!it->is_regular_file(statEc)) {
+            continue;
+        }
+        std::string relative = it->path().lexically_relative(root).generic_u8string();
+        if (IsGeneratedFootprintFile(relative)) {
+            continue;
+        }
+        if (relative == kManifestName) {
+            haveManifest = true;
+        }
+        EntrySource entry;
+        entry.relativePath = relative;
+        entry.fullPath = it->path().u8string();
+        entry.size = it->file_size(statEc);
+        if (statEc) {
+            *error = "Failed to stat " + entry.fullPath + ": " + statEc.message();
+            return false;
+        }
+        entry.modifiedTime = it->last_write_time(statEc).time_since_epoch().count();
+        entry.compressed = entry.size > 0 && ShouldCompress(relative);
+        entries->push_back(std::move(entry));
+    }
+    if (ec) {
+        *error = "Failed to scan " + sourceDir + ": " + ec.message();
+        return false;
+    }
+    if (!haveManifest) {
+        *error = "No AppxManifest.xml in '" + sourceDir + "'";
+        return false;
+    }
+
+    // Deterministic order, manifest after the payload as MakeAppx does.
+    std::sort(entries->begin(), entries->end(), [](const EntrySource& a, const EntrySource& b) {
+        bool aManifest = a.relativePath == kManifestName;
+        bool bManifest = b.relativePath == kManifestName;
+        if (aManifest != bManifest) {
+            return bManifest;
+        }
+        return a.relativePath < b.relativePath;
+    });
+    return true;
+}
+
+// Looks every payload file up in the repack cache on the pool. The size and
+// mtime fast path costs one small read of the object's block table; files
+// whose mtime moved but whose size still matches are re-hashed (not
+// re-compressed) to see whether their content actually changed.
+void ResolveCachedEntries(ThreadPool& pool, PackCache& cache, std::vector<EntrySource>* entries) {
+    std::vector<std::future<void>> pending;
+    pending.reserve(entries->size());
+    for (EntrySource& entry : *entries) {
+        if (entry.size == 0) {
+            continue;
+        }
+        EntrySource* target = &entry;
+        pending.push_back(pool.Submit([&cache, target] {
+            target->cached = cache.LookupByPath(target->fullPath, target->size,
+                                                target->modifiedTime, target->compressed);
+            if (target->cached == nullptr &&
+                cache.HasPathWithSize(target->fullPath, target->size)) {
+                target->cached =
+                    cache.LookupByContent(target->fullPath, target->size, target->compressed);
+            }
+        }));
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+}
+
+// Keeps a bounded window of block-encoding tasks in flight on the pool and
+// hands the results back in archive order. Tasks run across file boundaries,
+// so a tree of many small files parallelizes as well as one big file.
+class BlockPipeline {
+public:
+    BlockPipeline(ThreadPool& pool, const std::vector<EntrySource>& entries,
+                  const PackOptions& options)
+        : pool_(pool), entries_(entries), options_(options),
+          window_(std::max<size_t>(pool.Size() * 16, 32)) {}
+
+    EncodedBlock Next() {
+        Fill();
+        if (inflight_.empty()) {
+            return EncodedBlock();
+        }
+        EncodedBlock block = inflight_.front().get();
+        inflight_.pop_front();
+        return block;
+    }
+
+private:
+    void Fill() {
+        while (inflight_.size() < window_ && nextEntry_ < entries_.size()) {
+            const EntrySource& entry = entries_[nextEntry_];
+            uint64_t blockCount = BlockCount(entry.size);
+            if (blockCount == 0 || entry.cached != nullptr) {
+                nextEntry_++;
+                continue;
+            }
+            if (nextBlock_ == 0 && entry.memory == nullptr) {
+                auto file = std::make_shared<InputFile>();
+                currentFile_ = file->Open(entry.fullPath) ? file : nullptr;
+            }
+            Submit(entry, nextBlock_, blockCount);
+            if (++nextBlock_ == blockCount) {
+                nextEntry_++;
+                nextBlock_ = 0;
+                currentFile_ = nullptr;
+            }
+        }
+    }
+
+    void Submit(const EntrySource& entry, uint64_t blockIndex, uint64_t blockCount) {
+        uint64_t offset = blockIndex * kBlockSize;
+        size_t length = static_cast<size_t>(std::min<uint64_t>(kBlockSize, entry.size - offset));
+        size_t dictionaryLength = 0;
+        if (entry.compressed && options_.primeDictionary) {
+            dictionaryLength = static_cast<size_t>(std::min<uint64_t>(kDictionarySize, offset));
+        }
+        bool compress = entry.compressed;
+        bool last = blockIndex + 1 == blockCount;
+        int level = options_.compressionLevel;
+        std::shared_ptr<InputFile> file = currentFile_;
+        std::shared_ptr<const std::string> memory = entry.memory;
+        bool isMemory = memory != nullptr;
+
+        inflight_.push_back(pool_.Submit([=]() {
+            thread_local std::vector<uint8_t> buffer;
+            buffer.resize(dictionaryLength + length);
+            uint64_t start = offset - dictionaryLength;
+            if (isMemory) {
+                memcpy(buffer.data(), memory->data() + start, buffer.size());
+            } else if (file == nullptr || !file->ReadAt(start, buffer.data(), buffer.size())) {
+                return EncodedBlock();
+            }
+            return EncodeBlock(buffer.data(), dictionaryLength, buffer.data() + dictionaryLength,
+                               length, compress, last, level);
+        }));
+    }
+
+    ThreadPool& pool_;
+    const std::vector<EntrySource>& entries_;
+    const PackOptions& options_;
+    const size_t window_;
+    std::deque<std::future<EncodedBlock>> inflight_;
+    size_t nextEntry_ = 0;
+    uint64_t nextBlock_ = 0;
+    std::shared_ptr<InputFile> currentFile_;
+};
+
+class ArchiveWriter {
+public:
+    ArchiveWriter(ThreadPool& pool, const PackOptions& options, PackCache* cache,
+                  PackStats* stats)
+        : pool_(pool), options_(options), cache_(cache), stats_(stats) {}
+
+    bool Open(const std::string& path) { return out_.Open(path); }
+
+    // Writes every entry. Entries recorded in the block map are payload; the
+    // generated footprint files are not.
+    bool WriteEntries(const std::vector<EntrySource>& entries, bool recordInBlockMap,
+                      std::string* error) {
+        BlockPipeline pipeline(pool_, entries, options_);
+        std::vector<uint8_t> header;
+        for (const EntrySource& entry : entries) {
+            zip::CentralDirectoryEntry cd;
+            cd.name = EncodeZipItemName(entry.relativePath);
+            cd.method = entry.compressed ? zip::kMethodDeflated : zip::kMethodStored;
+            cd.uncompressedSize = entry.size;
+            cd.localHeaderOffset = out_.Offset();
+
+            header.clear();
+            zip::AppendLocalFileHeader(header, cd.name, cd.method);
+            if (!out_.Write(header.data(), header.size())) {
+                *error = "Failed to write " + options_.outputPath;
+                return false;
+            }
+
+            BlockMapFile mapFile;
+            mapFile.name = ToBlockMapName(entry.relativePath);
+            mapFile.size = entry.size;
+            mapFile.localFileHeaderSize = static_cast<uint32_t>(header.size());
+            mapFile.compressed = entry.compressed;
+
+            uint64_t blockCount = BlockCount(entry.size);
+            if (entry.cached != nullptr) {
+                if (!SpliceCachedObject(*entry.cached, &cd, &mapFile, error)) {
+                    return false;
+                }
+                cache_->Record(entry.fullPath, entry.size, entry.modifiedTime, entry.cached->key);
+                stats_->cacheHitFiles++;
+                stats_->cacheHitBytes += entry.size;
+                blockCount = 0;
+            }
+
+            std::unique_ptr<PackCache::ObjectWriter> cacheObject;
+            if (cache_ != nullptr && recordInBlockMap && blockCount > 0) {
+                cacheObject = cache_->BeginObject(entry.size, entry.compressed);
+                stats_->cacheMissFiles++;
+                stats_->cacheMissBytes += entry.size;
+            }
+            for (uint64_t i = 0; i < blockCount; i++) {
+                EncodedBlock block = pipeline.Next();
+                if (!block.ok) {
+                    *error = "Failed to read or compress " +
+                             (entry.fullPath.empty() ? entry.relativePath : entry.fullPath);
+                    return false;
+                }
+                if (!out_.Write(block.data.data(), block.data.size())) {
+                    *error = "Failed to write " + options_.outputPath;
+                    return false;
+                }
+                cd.crc = i == 0 ? block.crc : CombineCrc(cd.crc, block.crc, block.size);
+                cd.compressedSize += block.data.size();
+                mapFile.blocks.push_back({block.hash, static_cast<uint32_t>(block.data.size())});
+                if (cacheObject != nullptr) {
+                    cacheObject->Append(block.data.data(), block.data.size(), block.hash);
+                }
+            }
+            // Deflate expands data that is already compressed; such a file
+            // is stored instead, and is not cached in its deflated form.
+            if (blockCount > 0 && entry.compressed && cd.compressedSize > entry.size) {
+                cacheObject.reset();
+                if (!RewriteStored(entry, &cd, &mapFile, error)) {
+                    return false;
+                }
+            }
+            if (cacheObject != nullptr) {
+                // A failed cache write only costs the next build a recompress.
+                std::string key = cacheObject->Commit(cd.crc);
+                if (!key.empty()) {
+                    cache_->Record(entry.fullPath, entry.size, entry.modifiedTime, key);
+                }
+            }
+
+            header.clear();
+            zip::AppendZip64DataDescriptor(header, cd.crc, cd.compressedSize, cd.uncompressedSize);
+            if (!out_.Write(header.data(), header.size())) {
+                *error = "Failed to write " + options_.outputPath;
+                return false;
+            }
+
+            if (recordInBlockMap) {
+                stats_->fileCount++;
+                stats_->blockCount += BlockCount(entry.size);
+                stats_->uncompressedBytes += entry.size;
+                stats_->compressedBytes += cd.compressedSize;
+                payloadNames_.push_back(cd.name);
+                blockMap_.push_back(std::move(mapFile));
+            }
+            directory_.push_back(std::move(cd));
+        }
+        return true;
+    }
+
+    bool WriteFootprint(std::string* error) {
+        std::vector<EntrySource> footprint(2);
+        footprint[0].relativePath = kBlockMapName;
+        footprint[0].memory = std::make_shared<const std::string>(BuildBlockMapXml(blockMap_));
+        footprint[1].relativePath = kContentTypesName;
+        footprint[1].memory =
+            std::make_shared<const std::string>(BuildContentTypesXml(payloadNames_));
+        for (EntrySource& entry : footprint) {
+            entry.size = entry.memory->size();
+        }
+        return WriteEntries(footprint, false, error);
+    }
+
+    bool Finish(std::string* error) {
+        std::vector<uint8_t> tail;
+        uint64_t directoryOffset = out_.Offset();
+        for (const zip::CentralDirectoryEntry& entry : directory_) {
+            zip::AppendCentralDirectoryEntry(tail, entry);
+        }
+        uint64_t directorySize = tail.size();
+        zip::AppendEndOfCentralDirectory(tail, directory_.size(), directoryOffset, directorySize);
+        if (!out_.Write(tail.data(), tail.size()) || !out_.Close()) {
+            *error = "Failed to write " + options_.outputPath;
+            return false;
+        }
+        stats_->archiveBytes = out_.Offset();
+        return true;
+    }
+
+    void Abandon() { out_.Close(); }
+
+private:
+    // Replaces the entry just written, from its local header on, with the
+    // file's bytes stored verbatim. Block hashes and the CRC are over the
+    // uncompressed data and stay as they are.
+    bool RewriteStored(const EntrySource& entry, zip::CentralDirectoryEntry* cd,
+                       BlockMapFile* mapFile, std::string* error) {
+        std::string name = entry.fullPath.empty() ? entry.relativePath : entry.fullPath;
+        cd->method = zip::kMethodStored;
+        cd->compressedSize = entry.size;
+        mapFile->compressed = false;
+        for (BlockMapBlock& block : mapFile->blocks) {
+            block.compressedSize = 0;
+        }
+        std::vector<uint8_t> header;
+        zip::AppendLocalFileHeader(header, cd->name, cd->method);
+        if (!out_.Truncate(cd->localHeaderOffset) || !out_.Write(header.data(), header.size())) {
+            *error = "Failed to write " + options_.outputPath;
+            return false;
+        }
+        if (entry.memory != nullptr) {
+            if (!out_.Write(entry.memory->data(), entry.memory->size())) {
+                *error = "Failed to write " + options_.outputPath;
+                return false;
+            }
+            return true;
+        }
+        InputFile source;
+        if (!source.Open(entry.fullPath)) {
+            *error = "Failed to open " + name;
+            return false;
+        }
+        std::vector<uint8_t> buffer(1 << 20);
+        for (uint64_t offset = 0; offset < entry.size; offset += buffer.size()) {
+            size_t length =
+                static_cast<size_t>(std::min<uint64_t>(buffer.size(), entry.size - offset));
+            if (!source.ReadAt(offset, buffer.data(), length)) {
+                *error = "Failed to read " + name;
+                return false;
+            }
+            if (!out_.Write(buffer.data(), length)) {
+                *error = "Failed to write " + options_.outputPath;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Copies a cached file's encoded bytes into the archive verbatim.
+    bool SpliceCachedObject(const CachedObject& object, zip::CentralDirectoryEntry* cd,
+                            BlockMapFile* mapFile, std::string* error) {
+        InputFile source;
+        if (!source.Open(object.path)) {
+            *error = "Failed to open cache object " + object.path;
+            return false;
+        }
+        std::vector<uint8_t> buffer(1 << 20);
+        for (uint64_t offset = 0; offset < object.encodedSize; offset += buffer.size()) {
+            size_t length =
+                static_cast<size_t>(std::min<uint64_t>(buffer.size(), object.encodedSize - offset));
+            if (!source.ReadAt(offset, buffer.data(), length)) {
+                *error = "Failed to read cache object " + object.path;
+                return false;
+            }
+            if (!out_.Write(buffer.data(), length)) {
+                *error = "Failed to write " + options_.outputPath;
+                return false;
+            }
+        }
+        cd->crc = object.crc;
+        cd->compressedSize = object.encodedSize;
+        mapFile->blocks = object.blocks;
+        return true;
+    }
+
+    ThreadPool& pool_;
+    const PackOptions& options_;
+    PackCache* cache_;
+    PackStats* stats_;
+    OutputFile out_;
+    std::vector<zip::CentralDirectoryEntry> directory_;
+    std::vector<BlockMapFile> blockMap_;
+    std::vector<std::string> payloadNames_;
+};
+
+}  // namespace
+
+bool PackDirectory(const PackOptions& options, PackStats* stats, std::string* error) {
+    auto start = std::chrono::steady_clock::now();
+    *stats = PackStats();
+
+    std::error_code ec;
+    if (!options.overwrite && fs::exists(options.outputPath, ec)) {
+        *error = "Output file '" + options.outputPath + "' already exists (use /o to overwrite)";
+        return false;
+    }
+
+    std::vector<EntrySource> entries;
+    if (!CollectStagedFiles(options.sourceDir, &entries, error)) {
+        return false;
+    }
+
+    ThreadPool pool(options.threads);
+
+    std::unique_ptr<PackCache> cache;
+    if (!options.cacheDir.empty()) {
+        cache = std::make_unique<PackCache>();
+        if (!cache->Open(options.cacheDir, options.compressionLevel, options.primeDictionary,
+                         error)) {
+            return false;
+        }
+        ResolveCachedEntries(pool, *cache, &entries);
+    }
+
+    ArchiveWriter writer(pool, options, cache.get(), stats);
+    if (!writer.Open(options.outputPath)) {
+        *error = "Failed to create " + options.outputPath;
+        return false;
+    }
+    if (!writer.WriteEntries(entries, true, error) || !writer.WriteFootprint(error) ||
+        !writer.Finish(error)) {
+        writer.Abandon();
+        fs::remove(options.outputPath, ec);
+        return false;
+    }
+    if (cache != nullptr && !cache->SaveIndex(error)) {
+        return false;
+    }
+
+    stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+}  // namespace msix
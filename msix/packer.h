@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace msix {
+
+struct PackOptions {
+    std::string sourceDir;   // staging directory, must contain AppxManifest.xml
+    std::string outputPath;  // .msix to write
+    unsigned threads = 0;    // 0 = one per hardware thread
+    int compressionLevel = 6;
+    // Prime each block with the 32 KB before it (pigz-style). Turning this off
+    // makes every block independently inflatable at a small ratio cost.
+    bool primeDictionary = true;
+    bool overwrite = false;
+    // Incremental repack cache (see pack_cache.h). Empty disables it.
+    std::string cacheDir;
+};
+
+struct PackStats {
+    uint64_t fileCount = 0;
+    uint64_t blockCount = 0;
+    uint64_t uncompressedBytes = 0;
+    uint64_t compressedBytes = 0;
+    uint64_t archiveBytes = 0;
+    double seconds = 0;
+    // Payload files spliced from the cache vs. encoded from scratch.
+    uint64_t cacheHitFiles = 0;
+    uint64_t cacheHitBytes = 0;
+    uint64_t cacheMissFiles = 0;
+    uint64_t cacheMissBytes = 0;
+};
+
+// Writes an unsigned MSIX from a staging directory: payload files, the
+// manifest, AppxBlockMap.xml and [Content_Types].xml in a ZIP64 container.
+// Blocks are read, hashed and deflated on a worker pool; a single writer
+// thread lays them out in order.
+bool PackDirectory(const PackOptions& options, PackStats* stats, std::string* error);
+
+}  // namespace msix
@@ -0,0 +1,311 @@
+#include "sha256.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "sha256_internal.h"
+
+#ifdef MSIX_SHA256_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <immintrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace msix {
+
+namespace internal {
+
+const uint32_t kSha256RoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const uint32_t kSha256InitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+namespace {
+
+inline uint32_t RotateRight(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+inline uint32_t LoadBigEndian32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+}  // namespace
+
+void Sha256CompressScalar(uint32_t state[8], const uint8_t* blocks, size_t count) {
+    for (; count > 0; count--, blocks += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = LoadBigEndian32(blocks + i * 4);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + kSha256RoundConstants[i] + w[i];
+            uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+size_t Sha256PadTail(const uint8_t* tail, size_t tailLength, uint64_t totalLength,
+                     uint8_t out[128]) {
+    size_t blocks = tailLength < 56 ? 1 : 2;
+    memset(out, 0, blocks * 64);
+    memcpy(out, tail, tailLength);
+    out[tailLength] = 0x80;
+    uint64_t bitLength = totalLength * 8;
+    for (int i = 0; i < 8; i++) {
+        out[blocks * 64 - 1 - i] = uint8_t(bitLength >> (8 * i));
+    }
+    return blocks;
+}
+
+}  // namespace internal
+
+namespace {
+
+struct CpuFeatures {
+    bool sha = false;
+    bool avx2 = false;
+};
+
+CpuFeatures DetectCpuFeatures() {
+    CpuFeatures features;
+#ifdef MSIX_SHA256_X86
+    unsigned int leaf1[4] = {0, 0, 0, 0};
+    unsigned int leaf7[4] = {0, 0, 0, 0};
+#if defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    int maxLeaf = regs[0];
+    __cpuidex(regs, 1, 0);
+    for (int i = 0; i < 4; i++) leaf1[i] = unsigned(regs[i]);
+    if (maxLeaf >= 7) {
+        __cpuidex(regs, 7, 0);
+        for (int i = 0; i < 4; i++) leaf7[i] = unsigned(regs[i]);
+    }
+#else
+    unsigned int maxLeaf = __get_cpuid_max(0, nullptr);
+    __get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+    if (maxLeaf >= 7) {
+        __get_cpuid_count(7, 0, &leaf7[0], &leaf7[1], &leaf7[2], &leaf7[3]);
+    }
+#endif
+    bool ssse3 = (leaf1[2] >> 9) & 1;
+    bool sse41 = (leaf1[2] >> 19) & 1;
+    bool osxsave = (leaf1[2] >> 27) & 1;
+    bool avx = (leaf1[2] >> 28) & 1;
+
+    // AVX registers are only usable if the OS saves them (XCR0 bits 1 and 2).
+    bool osSavesYmm = false;
+    if (osxsave) {
+#if defined(_MSC_VER) && !defined(__clang__)
+        unsigned long long xcr0 = _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        unsigned long long xcr0 = (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+        osSavesYmm = (xcr0 & 6) == 6;
+    }
+
+    features.sha = ((leaf7[1] >> 29) & 1) && ssse3 && sse41;
+    features.avx2 = ((leaf7[1] >> 5) & 1) && avx && osSavesYmm;
+#endif
+    return features;
+}
+
+const CpuFeatures& Features() {
+    static const CpuFeatures features = DetectCpuFeatures();
+    return features;
+}
+
+// Honors MSIX_SHA256_BACKEND when it names a supported backend.
+bool ForcedBackend(Sha256Backend* backend) {
+    static const int forced = [] {
+        const char* value = std::getenv("MSIX_SHA256_BACKEND");
+        if (value == nullptr) {
+            return -1;
+        }
+        std::string name(value);
+        for (Sha256Backend candidate :
+             {Sha256Backend::kScalar, Sha256Backend::kShaNi, Sha256Backend::kAvx2}) {
+            if (name == Sha256BackendName(candidate) && Sha256BackendSupported(candidate)) {
+                return static_cast<int>(candidate);
+            }
+        }
+        return -1;
+    }();
+    if (forced < 0) {
+        return false;
+    }
+    *backend = static_cast<Sha256Backend>(forced);
+    return true;
+}
+
+}  // namespace
+
+const char* Sha256BackendName(Sha256Backend backend) {
+    switch (backend) {
+        case Sha256Backend::kScalar: return "scalar";
+        case Sha256Backend::kShaNi: return "shani";
+        case Sha256Backend::kAvx2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool Sha256BackendSupported(Sha256Backend backend) {
+    switch (backend) {
+        case Sha256Backend::kScalar: return true;
+        case Sha256Backend::kShaNi: return Features().sha;
+        case Sha256Backend::kAvx2: return Features().avx2;
+    }
+    return false;
+}
+
+Sha256Backend SingleBufferSha256Backend() {
+    Sha256Backend backend;
+    if (ForcedBackend(&backend) && backend != Sha256Backend::kAvx2) {
+        return backend;
+    }
+    return Features().sha ? Sha256Backend::kShaNi : Sha256Backend::kScalar;
+}
+
+Sha256Backend MultiBufferSha256Backend() {
+    Sha256Backend backend;
+    if (ForcedBackend(&backend)) {
+        return backend;
+    }
+    if (Features().sha) {
+        return Sha256Backend::kShaNi;
+    }
+    return Features().avx2 ? Sha256Backend::kAvx2 : Sha256Backend::kScalar;
+}
+
+Sha256::Sha256() : Sha256(SingleBufferSha256Backend()) {}
+
+Sha256::Sha256(Sha256Backend backend) : compress_(internal::Sha256CompressScalar) {
+#ifdef MSIX_SHA256_X86
+    if (backend == Sha256Backend::kShaNi && Sha256BackendSupported(backend)) {
+        compress_ = internal::Sha256CompressShaNi;
+    }
+#else
+    (void)backend;
+#endif
+    memcpy(state_, internal::kSha256InitialState, sizeof(state_));
+}
+
+void Sha256::Update(const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    totalLength_ += length;
+
+    if (bufferLength_ > 0) {
+        size_t take = 64 - bufferLength_;
+        if (take > length) {
+            take = length;
+        }
+        memcpy(buffer_ + bufferLength_, bytes, take);
+        bufferLength_ += take;
+        bytes += take;
+        length -= take;
+        if (bufferLength_ < 64) {
+            return;
+        }
+        compress_(state_, buffer_, 1);
+        bufferLength_ = 0;
+    }
+
+    if (length >= 64) {
+        compress_(state_, bytes, length / 64);
+        bytes += length & ~size_t(63);
+        length &= 63;
+    }
+
+    if (length > 0) {
+        memcpy(buffer_, bytes, length);
+        bufferLength_ = length;
+    }
+}
+
+Sha256Digest Sha256::Finish() {
+    uint8_t padded[128];
+    size_t blocks = internal::Sha256PadTail(buffer_, bufferLength_, totalLength_, padded);
+    compress_(state_, padded, blocks);
+
+    Sha256Digest digest;
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4 + 0] = uint8_t(state_[i] >> 24);
+        digest[i * 4 + 1] = uint8_t(state_[i] >> 16);
+        digest[i * 4 + 2] = uint8_t(state_[i] >> 8);
+        digest[i * 4 + 3] = uint8_t(state_[i]);
+    }
+    return digest;
+}
+
+Sha256Digest Sha256Hash(const void* data, size_t length) {
+    return Sha256Hash(data, length, SingleBufferSha256Backend());
+}
+
+Sha256Digest Sha256Hash(const void* data, size_t length, Sha256Backend backend) {
+    Sha256 hasher(backend);
+    hasher.Update(data, length);
+    return hasher.Finish();
+}
+
+void Sha256HashMany(const uint8_t* const* messages, const size_t* lengths,
+                    Sha256Digest* digests, size_t count) {
+    Sha256HashMany(messages, lengths, digests, count, MultiBufferSha256Backend());
+}
+
+void Sha256HashMany(const uint8_t* const* messages, const size_t* lengths,
+                    Sha256Digest* digests, size_t count, Sha256Backend backend) {
+#ifdef MSIX_SHA256_X86
+    if (backend == Sha256Backend::kAvx2 && Sha256BackendSupported(backend)) {
+        for (size_t i = 0; i < count; i += 8) {
+            size_t group = count - i < 8 ? count - i : 8;
+            internal::Sha256HashEightAvx2(messages + i, lengths + i, digests + i, group);
+        }
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        digests[i] = Sha256Hash(messages[i], lengths[i], backend);
+    }
+}
+
+}  // namespace msix
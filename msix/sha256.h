@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace msix {
+
+using Sha256Digest = std::array<uint8_t, 32>;
+
+// SHA-256 implementations. The best supported one is picked once from CPUID;
+// setting MSIX_SHA256_BACKEND=scalar|shani|avx2 forces a specific one.
+enum class Sha256Backend {
+    kScalar,  // portable C++
+    kShaNi,   // x86 SHA extensions, one message at a time
+    kAvx2,    // eight independent messages per pass (multi-buffer)
+};
+
+const char* Sha256BackendName(Sha256Backend backend);
+bool Sha256BackendSupported(Sha256Backend backend);
+
+// Used by Sha256 and Sha256Hash. AVX2 only helps with batches, so this is
+// SHA-NI when available and scalar otherwise.
+Sha256Backend SingleBufferSha256Backend();
+// Used by Sha256HashMany: SHA-NI, else AVX2 multi-buffer, else scalar.
+Sha256Backend MultiBufferSha256Backend();
+
+// Incremental SHA-256 (FIPS 180-4).
+class Sha256 {
+public:
+    Sha256();
+    explicit Sha256(Sha256Backend backend);
+
+    void Update(const void* data, size_t length);
+    Sha256Digest Finish();
+
+private:
+    using CompressFunction = void (*)(uint32_t state[8], const uint8_t* blocks, size_t count);
+
+    CompressFunction compress_;
+    uint32_t state_[8];
+    uint8_t buffer_[64];
+    size_t bufferLength_ = 0;
+    uint64_t totalLength_ = 0;
+};
+
+// One-shot hash of a buffer.
+Sha256Digest Sha256Hash(const void* data, size_t length);
+Sha256Digest Sha256Hash(const void* data, size_t length, Sha256Backend backend);
+
+// Hashes count independent messages, e.g. all the blocks of a file when
+// building or checking a block map.
+void Sha256HashMany(const uint8_t* const* messages, const size_t* lengths,
+                    Sha256Digest* digests, size_t count);
+void Sha256HashMany(const uint8_t* const* messages, const size_t* lengths,
+                    Sha256Digest* digests, size_t count, Sha256Backend backend);
+
+}  // namespace msix
@@ -0,0 +1,100 @@
+// Reports SHA-256 throughput per backend on block-map-sized (64 KB) blocks,
+// after checking every backend against the scalar reference.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "block_map.h"
+#include "sha256.h"
+
+namespace {
+
+bool CheckKnownAnswer() {
+    // FIPS 180-2 "abc" test vector.
+    static const uint8_t kAbc[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+    };
+    msix::Sha256Digest digest = msix::Sha256Hash("abc", 3, msix::Sha256Backend::kScalar);
+    return memcmp(digest.data(), kAbc, sizeof(kAbc)) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t totalMb = 512;
+    size_t blockSize = msix::kBlockSize;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "/mb") == 0 || strcmp(argv[i], "-mb") == 0) {
+            totalMb = strtoul(argv[i + 1], nullptr, 10);
+        } else if (strcmp(argv[i], "/size") == 0 || strcmp(argv[i], "-size") == 0) {
+            blockSize = strtoul(argv[i + 1], nullptr, 10);
+        }
+    }
+    if (blockSize == 0 || totalMb == 0) {
+        printf("Usage: %s [/mb <megabytes>] [/size <block_bytes>]\n", argv[0]);
+        return 1;
+    }
+
+    if (!CheckKnownAnswer()) {
+        printf("Scalar SHA-256 failed the known-answer test.\n");
+        return 1;
+    }
+
+    // A 64 MB working set, hashed repeatedly until totalMb has been processed.
+    size_t blockCount = (64u << 20) / blockSize;
+    if (blockCount == 0) {
+        blockCount = 1;
+    }
+    std::vector<uint8_t> data(blockCount * blockSize);
+    std::mt19937 random(42);
+    for (auto& byte : data) {
+        byte = uint8_t(random());
+    }
+    std::vector<const uint8_t*> messages(blockCount);
+    std::vector<size_t> lengths(blockCount, blockSize);
+    for (size_t i = 0; i < blockCount; i++) {
+        messages[i] = data.data() + i * blockSize;
+    }
+
+    std::vector<msix::Sha256Digest> reference(blockCount);
+    msix::Sha256HashMany(messages.data(), lengths.data(), reference.data(), blockCount,
+                         msix::Sha256Backend::kScalar);
+
+    size_t passes = (totalMb << 20) / data.size();
+    if (passes == 0) {
+        passes = 1;
+    }
+
+    printf("%-8s %10s %10s\n", "backend", "GB/s", "status");
+    bool allOk = true;
+    for (msix::Sha256Backend backend :
+         {msix::Sha256Backend::kScalar, msix::Sha256Backend::kShaNi, msix::Sha256Backend::kAvx2}) {
+        const char* name = msix::Sha256BackendName(backend);
+        if (!msix::Sha256BackendSupported(backend)) {
+            printf("%-8s %10s %10s\n", name, "-", "n/a");
+            continue;
+        }
+
+        std::vector<msix::Sha256Digest> digests(blockCount);
+        auto start = std::chrono::steady_clock::now();
+        for (size_t pass = 0; pass < passes; pass++) {
+            msix::Sha256HashMany(messages.data(), lengths.data(), digests.data(), blockCount,
+                                 backend);
+        }
+        double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        bool ok = digests == reference;
+        allOk = allOk && ok;
+        double gigabytes = double(passes) * data.size() / 1e9;
+        printf("%-8s %10.2f %10s\n", name, gigabytes / seconds, ok ? "ok" : "MISMATCH");
+    }
+    printf("Default: single-buffer %s, multi-buffer %s\n",
+           msix::Sha256BackendName(msix::SingleBufferSha256Backend()),
+           msix::Sha256BackendName(msix::MultiBufferSha256Backend()));
+    return allOk ? 0 : 1;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+// Shared between the portable SHA-256 code and the x86 backends.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "sha256.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MSIX_SHA256_X86 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define MSIX_TARGET(features)
+#else
+#define MSIX_TARGET(features) __attribute__((target(features)))
+#endif
+
+namespace msix {
+namespace internal {
+
+extern const uint32_t kSha256RoundConstants[64];
+extern const uint32_t kSha256InitialState[8];
+
+void Sha256CompressScalar(uint32_t state[8], const uint8_t* blocks, size_t count);
+
+// Writes the final one or two padded blocks for a message whose unprocessed
+// tail is tail[0..tailLength) and returns how many blocks were written.
+size_t Sha256PadTail(const uint8_t* tail, size_t tailLength, uint64_t totalLength,
+                     uint8_t out[128]);
+
+#ifdef MSIX_SHA256_X86
+void Sha256CompressShaNi(uint32_t state[8], const uint8_t* blocks, size_t count);
+// Hashes up to eight messages at once, one per 32-bit AVX2 lane.
+void Sha256HashEightAvx2(const uint8_t* const* messages, const size_t* lengths,
+                         Sha256Digest* digests, size_t count);
+#endif
+
+}  // namespace internal
+}  // namespace msix
@@ -0,0 +1,231 @@
+// x86 SHA-256 backends: SHA-NI for single messages and an eight-lane AVX2
+// multi-buffer kernel. Each function carries its own target attribute so the
+// file builds without -msha/-mavx2 and only runs after the CPUID check in
+// sha256.cc.
+#include "sha256_internal.h"
+
+#ifdef MSIX_SHA256_X86
+
+#include <immintrin.h>
+
+#include <cstring>
+
+namespace msix {
+namespace internal {
+
+MSIX_TARGET("sha,sse4.1,ssse3")
+void Sha256CompressShaNi(uint32_t state[8], const uint8_t* blocks, size_t count) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The SHA instructions want the state as ABEF / CDGH.
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);                 // CDAB
+    state1 = _mm_shuffle_epi32(state1, 0x1B);           // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);   // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);        // CDGH
+
+    for (; count > 0; count--, blocks += 64) {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+        __m128i msg[4];
+
+        // Sixteen groups of four rounds; the message schedule for later
+        // groups is computed from the four most recent message vectors.
+        for (int group = 0; group < 16; group++) {
+            __m128i& current = msg[group & 3];
+            __m128i& previous = msg[(group + 3) & 3];
+            __m128i& next = msg[(group + 1) & 3];
+            if (group < 4) {
+                current = _mm_shuffle_epi8(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + group * 16)),
+                    byteSwap);
+            }
+            __m128i k = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(&kSha256RoundConstants[group * 4]));
+            __m128i rounds = _mm_add_epi32(current, k);
+            state1 = _mm_sha256rnds2_epu32(state1, state0, rounds);
+            if (group >= 3 && group <= 14) {
+                next = _mm_add_epi32(next, _mm_alignr_epi8(current, previous, 4));
+                next = _mm_sha256msg2_epu32(next, current);
+            }
+            rounds = _mm_shuffle_epi32(rounds, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, rounds);
+            if (group >= 1 && group <= 12) {
+                previous = _mm_sha256msg1_epu32(previous, current);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);        // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);     // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);  // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);     // ABEF
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+namespace {
+
+#define MSIX_AVX2 MSIX_TARGET("avx2")
+
+MSIX_AVX2 inline __m256i Rotr(__m256i x, int bits) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, bits), _mm256_slli_epi32(x, 32 - bits));
+}
+
+MSIX_AVX2 inline __m256i Add(__m256i a, __m256i b) {
+    return _mm256_add_epi32(a, b);
+}
+
+MSIX_AVX2 inline __m256i Xor3(__m256i a, __m256i b, __m256i c) {
+    return _mm256_xor_si256(_mm256_xor_si256(a, b), c);
+}
+
+// rows[i] holds eight consecutive 32-bit words of lane i; afterwards rows[j]
+// holds word j of all eight lanes.
+MSIX_AVX2 inline void Transpose8x8(__m256i rows[8]) {
+    __m256i t0 = _mm256_unpacklo_epi32(rows[0], rows[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(rows[0], rows[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(rows[2], rows[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(rows[2], rows[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(rows[4], rows[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(rows[4], rows[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(rows[6], rows[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(rows[6], rows[7]);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+    rows[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    rows[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    rows[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    rows[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    rows[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    rows[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    rows[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    rows[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+// Per-lane view of a message as its full 64-byte blocks followed by the one
+// or two padded tail blocks.
+struct LaneMessage {
+    const uint8_t* data = nullptr;
+    size_t fullBlocks = 0;
+    size_t totalBlocks = 0;
+    uint8_t tail[128];
+
+    const uint8_t* Block(size_t index) const {
+        return index < fullBlocks ? data + index * 64 : tail + (index - fullBlocks) * 64;
+    }
+};
+
+}  // namespace
+
+MSIX_AVX2
+void Sha256HashEightAvx2(const uint8_t* const* messages, const size_t* lengths,
+                         Sha256Digest* digests, size_t count) {
+    static const uint8_t kZeroBlock[64] = {0};
+    const __m256i byteSwap = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    LaneMessage lanes[8];
+    size_t maxBlocks = 0;
+    for (size_t lane = 0; lane < count; lane++) {
+        LaneMessage& m = lanes[lane];
+        m.data = messages[lane];
+        m.fullBlocks = lengths[lane] / 64;
+        size_t tailLength = lengths[lane] % 64;
+        m.totalBlocks = m.fullBlocks + Sha256PadTail(m.data + m.fullBlocks * 64, tailLength,
+                                                     lengths[lane], m.tail);
+        if (m.totalBlocks > maxBlocks) {
+            maxBlocks = m.totalBlocks;
+        }
+    }
+
+    __m256i state[8];
+    for (int i = 0; i < 8; i++) {
+        state[i] = _mm256_set1_epi32(static_cast<int>(kSha256InitialState[i]));
+    }
+
+    for (size_t block = 0; block < maxBlocks; block++) {
+        // Lanes that have finished (or were never used) hash a zero block
+        // and keep their previous state.
+        alignas(32) int32_t activeMask[8];
+        __m256i w[16];
+        for (size_t lane = 0; lane < 8; lane++) {
+            bool active = lane < count && block < lanes[lane].totalBlocks;
+            activeMask[lane] = active ? -1 : 0;
+            const uint8_t* p = active ? lanes[lane].Block(block) : kZeroBlock;
+            w[lane] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            w[lane + 8] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+        }
+        Transpose8x8(w);
+        Transpose8x8(w + 8);
+        for (int i = 0; i < 16; i++) {
+            w[i] = _mm256_shuffle_epi8(w[i], byteSwap);
+        }
+
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+        __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            if (i >= 16) {
+                __m256i w15 = w[(i - 15) & 15];
+                __m256i w2 = w[(i - 2) & 15];
+                __m256i s0 = Xor3(Rotr(w15, 7), Rotr(w15, 18), _mm256_srli_epi32(w15, 3));
+                __m256i s1 = Xor3(Rotr(w2, 17), Rotr(w2, 19), _mm256_srli_epi32(w2, 10));
+                w[i & 15] = Add(Add(w[i & 15], s0), Add(w[(i - 7) & 15], s1));
+            }
+            __m256i s1 = Xor3(Rotr(e, 6), Rotr(e, 11), Rotr(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i k = _mm256_set1_epi32(static_cast<int>(kSha256RoundConstants[i]));
+            __m256i t1 = Add(Add(Add(h, s1), Add(ch, k)), w[i & 15]);
+            __m256i s0 = Xor3(Rotr(a, 2), Rotr(a, 13), Rotr(a, 22));
+            __m256i maj = Xor3(_mm256_and_si256(a, b), _mm256_and_si256(a, c),
+                               _mm256_and_si256(b, c));
+            __m256i t2 = Add(s0, maj);
+            h = g;
+            g = f;
+            f = e;
+            e = Add(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = Add(t1, t2);
+        }
+
+        __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(activeMask));
+        __m256i updated[8] = {a, b, c, d, e, f, g, h};
+        for (int i = 0; i < 8; i++) {
+            state[i] = _mm256_blendv_epi8(state[i], Add(state[i], updated[i]), mask);
+        }
+    }
+
+    alignas(32) uint32_t words[8][8];
+    for (int i = 0; i < 8; i++) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(words[i]), state[i]);
+    }
+    for (size_t lane = 0; lane < count; lane++) {
+        for (int i = 0; i < 8; i++) {
+            uint32_t v = words[i][lane];
+            digests[lane][i * 4 + 0] = uint8_t(v >> 24);
+            digests[lane][i * 4 + 1] = uint8_t(v >> 16);
+            digests[lane][i * 4 + 2] = uint8_t(v >> 8);
+            digests[lane][i * 4 + 3] = uint8_t(v);
+        }
+    }
+}
+
+#undef MSIX_AVX2
+
+}  // namespace internal
+}  // namespace msix
+
+#endif  // MSIX_SHA256_X86
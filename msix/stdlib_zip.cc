@@ -0,0 +1,312 @@
+#include "stdlib_zip.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "file_io.h"
+#include "package_reader.h"
+#include "zip_format.h"
+
+namespace fs = std::filesystem;
+
+namespace msix {
+
+namespace {
+
+// Stdlib modules whose import does something visible.
+const std::set<std::string> kSkipOnImport = {
+    "__hello__", "__phello__", "antigravity", "this", "idlelib", "turtledemo",
+};
+
+bool EndsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() &&
+           text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Compiles every .py in files to a sourceless .pyc, adding the .pyc
+// entries (and dropping the .py unless keepSource).
+bool CompileSources(const StdlibRepackOptions& options,
+                    std::map<std::string, std::vector<uint8_t>>* files, uint64_t* compiled,
+                    std::string* error) {
+    std::vector<std::string> names;
+    std::vector<PythonSource> sources;
+    fs::path scratch = ScratchDirectory("stdlibpack");
+    std::error_code ec;
+    bool ok = true;
+    for (const auto& file : *files) {
+        if (!EndsWith(file.first, ".py")) {
+            continue;
+        }
+        fs::path path = scratch / fs::u8path(file.first);
+        if (!WriteWholeFile(path, file.second)) {
+            *error = "Cannot write " + path.u8string();
+            ok = false;
+            break;
+        }
+        names.push_back(file.first);
+        sources.push_back({path.u8string(), file.first});
+    }
+    std::vector<std::vector<uint8_t>> bytecode;
+    if (ok && !sources.empty()) {
+        ok = CompileSourceless(options.python, sources, &bytecode, error);
+    }
+    for (size_t i = 0; ok && i < names.size(); i++) {
+        if (bytecode[i].empty()) {
+            continue;  // stays as source
+        }
+        (*files)[names[i] + "c"] = std::move(bytecode[i]);
+        if (!options.keepSource) {
+            files->erase(names[i]);
+        }
+        (*compiled)++;
+    }
+    fs::remove_all(scratch, ec);
+    return ok;
+}
+
+}  // namespace
+
+bool StoredZipWriter::Add(const std::string& name, const std::vector<uint8_t>& data,
+                          std::string* error) {
+    if (data.size() > 0xFFFFFFFFu) {
+        *error = name + " is too large for a plain zip archive";
+        return false;
+    }
+    zip::CentralDirectoryEntry entry;
+    entry.name = name;
+    entry.method = zip::kMethodStored;
+    entry.crc = static_cast<uint32_t>(
+        crc32(crc32(0L, Z_NULL, 0), data.data(), static_cast<uInt>(data.size())));
+    entry.compressedSize = entry.uncompressedSize = data.size();
+    entry.localHeaderOffset = output_->Offset();
+
+    uint16_t padding = zip::AlignmentPadding(output_->Offset(), name.size(), alignment_);
+    header_.clear();
+    zip::AppendPlainLocalFileHeader(header_, name, zip::kMethodStored, entry.crc,
+                                    static_cast<uint32_t>(data.size()),
+                                    static_cast<uint32_t>(data.size()), padding);
+    if (!output_->Write(header_.data(), header_.size()) ||
+        !output_->Write(data.data(), data.size())) {
+        *error = "Write to " + path_ + " failed";
+        return false;
+    }
+    payloadBytes_ += data.size();
+    paddingBytes_ += padding;
+    directory_.push_back(std::move(entry));
+    return true;
+}
+
+bool StoredZipWriter::Finish(std::string* error) {
+    if (directory_.size() > 0xFFFF) {
+        *error = "Too many entries for a plain zip archive";
+        return false;
+    }
+    uint64_t directoryOffset = output_->Offset();
+    std::vector<uint8_t> tail;
+    for (const zip::CentralDirectoryEntry& entry : directory_) {
+        zip::AppendPlainCentralDirectoryEntry(tail, entry);
+    }
+    uint64_t directorySize = tail.size();
+    if (directoryOffset + directorySize > 0xFFFFFFFFu) {
+        *error = "Archive is too large for a plain zip archive";
+        return false;
+    }
+    zip::AppendPlainEndOfCentralDirectory(tail, static_cast<uint16_t>(directory_.size()),
+                                          static_cast<uint32_t>(directoryOffset),
+                                          static_cast<uint32_t>(directorySize));
+    if (!output_->Write(tail.data(), tail.size())) {
+        *error = "Write to " + path_ + " failed";
+        return false;
+    }
+    return true;
+}
+
+bool CompileSourceless(const std::string& python, const std::vector<PythonSource>& sources,
+                       std::vector<std::vector<uint8_t>>* bytecode, std::string* error) {
+    bytecode->assign(sources.size(), {});
+    if (sources.empty()) {
+        return true;
+    }
+    fs::path scratch = ScratchDirectory("pycompile");
+    std::error_code ec;
+    fs::create_directories(scratch, ec);
+    fs::path listPath = scratch / "sources.txt";
+    fs::path scriptPath = scratch / "compile.py";
+    {
+        // source, .pyc and the name shown in tracebacks, one file per line.
+        std::ofstream list(listPath, std::ios::binary);
+        for (size_t i = 0; i < sources.size(); i++) {
+            list << sources[i].path << "\t" << (scratch / (std::to_string(i) + ".pyc")).u8string()
+                 << "\t" << sources[i].displayName << "\n";
+        }
+        std::ofstream script(scriptPath);
+        script << "import py_compile, sys\n"
+                  "mode = py_compile.PycInvalidationMode.UNCHECKED_HASH\n"
+                  "for line in open(sys.argv[1], encoding='utf-8'):\n"
+                  "    source, cfile, dfile = line.rstrip('\\n').split('\\t')\n"
+                  "    try:\n"
+                  "        py_compile.compile(source, cfile, dfile, doraise=True,\n"
+                  "                           invalidation_mode=mode)\n"
+                  "    except Exception:\n"
+                  "        pass\n";
+    }
+    std::string command = Quote(python) + " -I -S " + Quote(scriptPath.u8string()) + " " +
+                          Quote(listPath.u8string());
+    bool ok = std::system(ShellCommand(command).c_str()) == 0;
+    if (!ok) {
+        *error = "Compiling the Python sources failed: " + command;
+    }
+    for (size_t i = 0; ok && i < sources.size(); i++) {
+        ReadWholeFile(scratch / (std::to_string(i) + ".pyc"), &(*bytecode)[i]);
+    }
+    fs::remove_all(scratch, ec);
+    return ok;
+}
+
+bool RepackStdlibArchive(const StdlibRepackOptions& options, StdlibRepackStats* stats,
+                         std::string* error) {
+    *stats = StdlibRepackStats();
+    if (options.alignment > 0x8000) {
+        *error = "Alignment must be at most 32 KB";
+        return false;
+    }
+
+    PackageReader reader;
+    if (!reader.Open(options.inputPath, error)) {
+        return false;
+    }
+    // Sorted by name, which is also the central directory order.
+    std::map<std::string, std::vector<uint8_t>> files;
+    for (const PackageEntry& entry : reader.Entries()) {
+        if (EndsWith(entry.name, "/")) {
+            continue;  // zipimport needs no directory entries
+        }
+        if (!reader.ReadEntry(entry, &files[entry.name], error)) {
+            return false;
+        }
+    }
+    if (!options.python.empty() &&
+        !CompileSources(options, &files, &stats->compiled, error)) {
+        return false;
+    }
+    if (files.size() > 0xFFFF) {
+        *error = "Too many entries for a plain zip archive";
+        return false;
+    }
+
+    OutputFile output;
+    if (!output.Open(options.outputPath)) {
+        *error = "Cannot create " + options.outputPath;
+        return false;
+    }
+    StoredZipWriter writer(&output, options.outputPath, options.alignment);
+    for (const auto& file : files) {
+        if (!writer.Add(file.first, file.second, error)) {
+            return false;
+        }
+    }
+    if (!writer.Finish(error)) {
+        return false;
+    }
+    stats->outputBytes = output.Offset();
+    if (!output.Close()) {
+        *error = "Write to " + options.outputPath + " failed";
+        return false;
+    }
+    stats->entries = writer.Entries();
+    stats->payloadBytes = writer.PayloadBytes();
+    stats->paddingBytes = writer.PaddingBytes();
+
+    std::error_code ec;
+    stats->inputBytes = fs::file_size(options.inputPath, ec);
+    return true;
+}
+
+bool MeasureImportTime(const std::string& python, const std::string& archive, int runs,
+                       double* seconds, std::string* error) {
+    PackageReader reader;
+    if (!reader.Open(archive, error)) {
+        return false;
+    }
+    std::set<std::string> modules;
+    for (const PackageEntry& entry : reader.Entries()) {
+        std::string name = entry.name;
+        size_t slash = name.find('/');
+        if (slash != std::string::npos) {
+            if (!EndsWith(name, "/__init__.pyc") && !EndsWith(name, "/__init__.py")) {
+                continue;
+            }
+            name = name.substr(0, slash);
+            if (name.find('/') != std::string::npos) {
+                continue;
+            }
+        } else if (EndsWith(name, ".pyc")) {
+            name.resize(name.size() - 4);
+        } else if (EndsWith(name, ".py")) {
+            name.resize(name.size() - 3);
+        } else {
+            continue;
+        }
+        if (kSkipOnImport.count(name) == 0) {
+            modules.insert(name);
+        }
+    }
+
+    fs::path scratch = ScratchDirectory("stdlibtime");
+    std::error_code ec;
+    fs::create_directories(scratch, ec);
+    fs::path listPath = scratch / "modules.txt";
+    fs::path scriptPath = scratch / "measure.py";
+    {
+        std::ofstream list(listPath);
+        for (const std::string& name : modules) {
+            list << name << "\n";
+        }
+        // Everything but the archive and extension module directories is
+        // taken off sys.path, so each module comes from the archive.
+        std::ofstream script(scriptPath);
+        script << "import os, sys, time, warnings\n"
+                  "warnings.simplefilter('ignore')\n"
+                  "archive, names = sys.argv[1], open(sys.argv[2]).read().split()\n"
+                  "sys.path[:] = [archive] + [p for p in sys.path if os.path.isdir(p) and\n"
+                  "               not os.path.exists(os.path.join(p, 'os.py'))]\n"
+                  "start = time.perf_counter()\n"
+                  "for name in names:\n"
+                  "    try:\n"
+                  "        __import__(name)\n"
+                  "    except BaseException:\n"
+                  "        pass\n"
+                  "print(time.perf_counter() - start)\n";
+    }
+    std::string command = ShellCommand(Quote(python) + " -I -S " + Quote(scriptPath.string()) +
+                                       " " + Quote(archive) + " " + Quote(listPath.string()));
+
+    std::vector<double> times;
+    bool ok = true;
+    for (int run = 0; run <= runs && ok; run++) {
+        std::string output;
+        if (!ReadCommandOutput(command, &output) || output.empty()) {
+            *error = "Import measurement failed: " + command;
+            ok = false;
+        } else if (run > 0) {
+            times.push_back(std::atof(output.c_str()));
+        }
+    }
+    fs::remove_all(scratch, ec);
+    if (!ok) {
+        return false;
+    }
+    std::sort(times.begin(), times.end());
+    *seconds = times.empty() ? 0 : times[times.size() / 2];
+    return true;
+}
+
+}  // namespace msix
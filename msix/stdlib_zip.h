@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "zip_format.h"
+
+// Repacks a Python stdlib archive (python3XY.zip of the embeddable
+// distribution) for import speed rather than size.
+//
+// The shipped archive is deflated, so zipimport inflates every module it
+// loads on every interpreter start. The repacked archive stores each entry
+// uncompressed, with its data starting on a page boundary and the central
+// directory sorted by name. zipimport then reads module bytes with a plain
+// read from the page cache, and a reader that maps the archive (such as
+// PackageReader) can hand out an entry's pages directly.
+namespace msix {
+
+class OutputFile;
+
+// Writes a plain zip of stored entries for zipimport, each entry's data on
+// an alignment boundary. Offsets count from the start of output, which may
+// already hold a prefix (the onefile bootloader). Entries are added in
+// central directory order.
+class StoredZipWriter {
+public:
+    // path only names the output in error messages.
+    StoredZipWriter(OutputFile* output, const std::string& path, uint32_t alignment)
+        : output_(output), path_(path), alignment_(alignment) {}
+
+    bool Add(const std::string& name, const std::vector<uint8_t>& data, std::string* error);
+    // Writes the central directory; the caller closes output.
+    bool Finish(std::string* error);
+
+    uint64_t Entries() const { return directory_.size(); }
+    uint64_t PayloadBytes() const { return payloadBytes_; }
+    uint64_t PaddingBytes() const { return paddingBytes_; }
+
+private:
+    OutputFile* output_;
+    std::string path_;
+    uint32_t alignment_;
+    std::vector<zip::CentralDirectoryEntry> directory_;
+    std::vector<uint8_t> header_;
+    uint64_t payloadBytes_ = 0;
+    uint64_t paddingBytes_ = 0;
+};
+
+// One source file for CompileSourceless and the name tracebacks show for it.
+struct PythonSource {
+    std::string path;
+    std::string displayName;
+};
+
+// Compiles sources into sourceless unchecked-hash .pyc (zipimport never
+// compares those with a source) in one run of python. (*bytecode)[i] stays
+// empty for a source that does not compile, e.g. lib2to3 test data.
+bool CompileSourceless(const std::string& python, const std::vector<PythonSource>& sources,
+                       std::vector<std::vector<uint8_t>>* bytecode, std::string* error);
+
+struct StdlibRepackOptions {
+    std::string inputPath;
+    std::string outputPath;
+    // Data alignment in bytes; 0 or 1 packs entries back to back.
+    uint32_t alignment = 4096;
+    // Interpreter used to compile .py entries into .pyc with
+    // CompileSourceless. Empty leaves .py entries as they are.
+    std::string python;
+    // Keeps each compiled .py next to its .pyc, for tracebacks with source.
+    bool keepSource = false;
+};
+
+struct StdlibRepackStats {
+    uint64_t entries = 0;
+    uint64_t compiled = 0;      // .py entries replaced by (or paired with) a .pyc
+    uint64_t inputBytes = 0;    // archive sizes
+    uint64_t outputBytes = 0;
+    uint64_t payloadBytes = 0;  // uncompressed entry data
+    uint64_t paddingBytes = 0;  // alignment padding in local headers
+};
+
+bool RepackStdlibArchive(const StdlibRepackOptions& options, StdlibRepackStats* stats,
+                         std::string* error);
+
+// Median wall time, over runs fresh interpreters, of importing every
+// top-level module of archive with only the archive (and the interpreter's
+// extension module directories) on sys.path. One extra warm-up run brings
+// the archive into the page cache first.
+bool MeasureImportTime(const std::string& python, const std::string& archive, int runs,
+                       double* seconds, std::string* error);
+
+}  // namespace msix
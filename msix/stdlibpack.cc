@@ -0,0 +1,92 @@
+// Repacks a Python stdlib zip into stored, page-aligned entries and, with
+// /python, compares import time from the original and the repacked archive.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "stdlib_zip.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " /i <python3XY.zip> /o <output.zip> [options]\n"
+              << "Options:\n"
+              << "  /align <bytes>   Entry data alignment (default: 4096, 0 = none)\n"
+              << "  /python <exe>    Compile .py entries with this interpreter and time\n"
+              << "                   imports from both archives with it\n"
+              << "  /keep-source     Keep compiled .py entries next to their .pyc\n"
+              << "  /runs <n>        Timed interpreter runs per archive (default: 5)\n"
+              << "  /notime          Compile with /python but skip the timing\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+double Megabytes(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    msix::StdlibRepackOptions options;
+    int runs = 5;
+    bool time = true;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "i") && hasValue) {
+            options.inputPath = argv[++i];
+        } else if (IsFlag(arg, "o") && hasValue) {
+            options.outputPath = argv[++i];
+        } else if (IsFlag(arg, "align") && hasValue) {
+            options.alignment = static_cast<uint32_t>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "python") && hasValue) {
+            options.python = argv[++i];
+        } else if (IsFlag(arg, "keep-source")) {
+            options.keepSource = true;
+        } else if (IsFlag(arg, "runs") && hasValue) {
+            runs = atoi(argv[++i]);
+        } else if (IsFlag(arg, "notime")) {
+            time = false;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.inputPath.empty() || options.outputPath.empty() || runs < 1) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    msix::StdlibRepackStats stats;
+    std::string error;
+    if (!msix::RepackStdlibArchive(options, &stats, &error)) {
+        std::cerr << "Failed to repack: " << error << std::endl;
+        return 1;
+    }
+    printf("Repacked %llu entries (%llu compiled) into %s\n", (unsigned long long)stats.entries,
+           (unsigned long long)stats.compiled, options.outputPath.c_str());
+    printf("Archive: %.2f MB -> %.2f MB (%+.0f%%); payload %.2f MB, padding %.2f MB\n",
+           Megabytes(stats.inputBytes), Megabytes(stats.outputBytes),
+           stats.inputBytes > 0 ? 100.0 * stats.outputBytes / stats.inputBytes - 100 : 0.0,
+           Megabytes(stats.payloadBytes), Megabytes(stats.paddingBytes));
+
+    if (options.python.empty() || !time) {
+        return 0;
+    }
+    double before = 0;
+    double after = 0;
+    if (!msix::MeasureImportTime(options.python, options.inputPath, runs, &before, &error) ||
+        !msix::MeasureImportTime(options.python, options.outputPath, runs, &after, &error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    printf("Import time (median of %d): %.1f ms -> %.1f ms (%.2fx)\n", runs, before * 1000,
+           after * 1000, after > 0 ? before / after : 0.0);
+    return 0;
+}
@@ -0,0 +1,357 @@
+#include "write_queue.h"
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace msix {
+
+#ifdef __linux__
+
+namespace {
+
+// How many prepared writes to collect before entering the kernel.
+constexpr unsigned kSubmitBatch = 16;
+
+int IoUringSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+bool PwriteAll(int fd, const uint8_t* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written <= 0) {
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        offset += static_cast<uint64_t>(written);
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+}  // namespace
+
+struct WriteQueue::Ring {
+    struct Slot {
+        std::vector<uint8_t> buffer;
+        int fd = -1;
+        uint64_t offset = 0;
+        bool busy = false;
+    };
+
+    int fd = -1;
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned sqMask = 0;
+    unsigned* sqArray = nullptr;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    std::vector<Slot> slots;
+    std::vector<unsigned> freeSlots;
+    unsigned unsubmitted = 0;
+    unsigned inFlight = 0;
+
+    ~Ring() {
+        if (sqes != nullptr) {
+            munmap(sqes, sqesSize);
+        }
+        if (cqRing != nullptr && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        if (sqRing != nullptr) {
+            munmap(sqRing, sqRingSize);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool Setup(unsigned depth) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = IoUringSetup(depth, &params);
+        if (fd < 0) {
+            return false;
+        }
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap && cqRingSize > sqRingSize) {
+            sqRingSize = cqRingSize;
+        }
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            sqRing = nullptr;
+            return false;
+        }
+        if (singleMap) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                cqRing = nullptr;
+                return false;
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqesMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqesMap == MAP_FAILED) {
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe*>(sqesMap);
+
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // At most sq_entries writes are ever in flight, and the completion
+        // ring is at least that large, so completions cannot overflow.
+        slots.resize(params.sq_entries);
+        for (unsigned i = params.sq_entries; i > 0; i--) {
+            freeSlots.push_back(i - 1);
+        }
+        return true;
+    }
+
+    // Queues one write; the caller has checked that a slot is free.
+    void Prepare(int fileFd, uint64_t offset, std::vector<uint8_t>&& data) {
+        unsigned index = freeSlots.back();
+        freeSlots.pop_back();
+        Slot& slot = slots[index];
+        slot.buffer = std::move(data);
+        slot.fd = fileFd;
+        slot.offset = offset;
+        slot.busy = true;
+
+        unsigned tail = *sqTail;
+        io_uring_sqe* sqe = &sqes[tail & sqMask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = fileFd;
+        sqe->off = offset;
+        sqe->addr = reinterpret_cast<uint64_t>(slot.buffer.data());
+        sqe->len = static_cast<uint32_t>(slot.buffer.size());
+        sqe->user_data = index;
+        sqArray[tail & sqMask] = tail & sqMask;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted++;
+        inFlight++;
+    }
+
+    // Hands prepared writes to the kernel and, with minComplete > 0, waits
+    // for that many to finish. Returns false if the ring itself failed.
+    bool Enter(unsigned minComplete) {
+        while (unsubmitted > 0 || minComplete > 0) {
+            unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+            int result = IoUringEnter(fd, unsubmitted, minComplete, flags);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EBUSY) {
+                    // The kernel is short of resources until completions are
+                    // reaped; wait for one without submitting more.
+                    if (inFlight == unsubmitted) {
+                        return false;
+                    }
+                    if (IoUringEnter(fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                        return false;
+                    }
+                    return true;
+                }
+                return false;
+            }
+            unsubmitted -= static_cast<unsigned>(result);
+            minComplete = 0;
+        }
+        return true;
+    }
+
+    // Retires every posted completion. Writes the kernel finished only
+    // partly, or refused (IORING_OP_WRITE needs Linux 5.6), are completed
+    // with pwrite. Returns false if any write failed.
+    bool Reap() {
+        bool ok = true;
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const io_uring_cqe& cqe = cqes[head & cqMask];
+            unsigned index = static_cast<unsigned>(cqe.user_data);
+            Slot& slot = slots[index];
+            size_t done = cqe.res > 0 ? static_cast<size_t>(cqe.res) : 0;
+            if (cqe.res < 0 && cqe.res != -EINVAL && cqe.res != -EOPNOTSUPP &&
+                cqe.res != -EAGAIN && cqe.res != -EINTR) {
+                ok = false;
+            } else if (done < slot.buffer.size() &&
+                       !PwriteAll(slot.fd, slot.buffer.data() + done, slot.buffer.size() - done,
+                                  slot.offset + done)) {
+                ok = false;
+            }
+            slot.buffer = std::vector<uint8_t>();
+            slot.busy = false;
+            freeSlots.push_back(index);
+            inFlight--;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        return ok;
+    }
+
+    bool Writing(int fileFd) const {
+        for (const Slot& slot : slots) {
+            if (slot.busy && slot.fd == fileFd) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+WriteQueue::WriteQueue(unsigned depth) {
+    std::unique_ptr<Ring> ring(new Ring());
+    if (depth > 0 && ring->Setup(depth)) {
+        ring_ = std::move(ring);
+    }
+}
+
+WriteQueue::~WriteQueue() {
+    Drain();
+}
+
+bool WriteQueue::Write(const WritableFile& file, uint64_t offset, const void* data,
+                       size_t length) {
+    if (ring_ == nullptr || length > 0x7fffffff) {
+        bool ok = file.WriteAt(offset, data, length);
+        if (!ok) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            failed_ = true;
+        }
+        return ok;
+    }
+    // Copy outside the lock so inflating threads only serialize on the ring.
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    std::vector<uint8_t> buffer(in, in + length);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_) {
+        return false;
+    }
+    while (ring_->freeSlots.empty()) {
+        if (!ring_->Enter(1)) {
+            failed_ = true;
+            return false;
+        }
+        if (!ring_->Reap()) {
+            failed_ = true;
+            return false;
+        }
+    }
+    ring_->Prepare(file.fd_, offset, std::move(buffer));
+    if (ring_->unsubmitted >= kSubmitBatch && !ring_->Enter(0)) {
+        failed_ = true;
+    }
+    if (!ring_->Reap()) {
+        failed_ = true;
+    }
+    return !failed_;
+}
+
+bool WriteQueue::Drain() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ring_ == nullptr) {
+        return !failed_;
+    }
+    while (ring_->inFlight > 0) {
+        if (!ring_->Enter(1)) {
+            // The ring is unusable; whatever it still holds is lost and the
+            // caller has to discard the output.
+            failed_ = true;
+            break;
+        }
+        if (!ring_->Reap()) {
+            failed_ = true;
+        }
+    }
+    return !failed_;
+}
+
+bool WriteQueue::Drain(const WritableFile& file) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ring_ == nullptr) {
+        return !failed_;
+    }
+    while (ring_->Writing(file.fd_)) {
+        if (!ring_->Enter(1)) {
+            failed_ = true;
+            break;
+        }
+        if (!ring_->Reap()) {
+            failed_ = true;
+        }
+    }
+    return !failed_;
+}
+
+#else
+
+struct WriteQueue::Ring {};
+
+WriteQueue::WriteQueue(unsigned) {}
+
+WriteQueue::~WriteQueue() = default;
+
+bool WriteQueue::Write(const WritableFile& file, uint64_t offset, const void* data,
+                       size_t length) {
+    bool ok = file.WriteAt(offset, data, length);
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        failed_ = true;
+    }
+    return ok;
+}
+
+bool WriteQueue::Drain() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !failed_;
+}
+
+bool WriteQueue::Drain(const WritableFile&) { return Drain(); }
+
+#endif
+
+}  // namespace msix
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "file_io.h"
+
+namespace msix {
+
+// Positioned writes to WritableFiles that do not hold up the caller. On
+// Linux they are submitted to an io_uring (raw syscalls, IORING_OP_WRITE,
+// kernel 5.6+), batched, and reaped as the ring fills; the kernel's worker
+// threads absorb writes that would block, so inflating threads keep
+// inflating. Where io_uring is missing or refused (older kernels, seccomp
+// profiles, Windows), each write simply happens synchronously.
+//
+// Thread-safe. Data is copied into a buffer the queue owns, so callers can
+// reuse theirs at once. Drain() (all of it or that file) before closing or
+// renaming any file written through the queue.
+class WriteQueue {
+public:
+    // depth 0 makes every write synchronous.
+    explicit WriteQueue(unsigned depth = 128);
+    ~WriteQueue();
+
+    WriteQueue(const WriteQueue&) = delete;
+    WriteQueue& operator=(const WriteQueue&) = delete;
+
+    bool UsesIoUring() const { return ring_ != nullptr; }
+
+    // Returns false once any write has failed.
+    bool Write(const WritableFile& file, uint64_t offset, const void* data, size_t length);
+
+    // Waits for every queued write. Returns false if any of them failed.
+    bool Drain();
+    // Waits for the queued writes to one file only, so it can be closed
+    // while others are still being written. Returns false if any write
+    // has failed.
+    bool Drain(const WritableFile& file);
+
+private:
+    struct Ring;
+
+    std::mutex mutex_;
+    std::unique_ptr<Ring> ring_;
+    bool failed_ = false;
+};
+
+}  // namespace msix
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk ZIP records as MSIX uses them (APPNOTE 6.3). Every entry is written
+// with a data descriptor and a ZIP64 central directory record, which is what
+// MakeAppx produces regardless of file size.
+namespace msix {
+namespace zip {
+
+constexpr uint32_t kLocalFileHeaderSignature = 0x04034b50;
+constexpr uint32_t kDataDescriptorSignature = 0x08074b50;
+constexpr uint32_t kCentralDirectorySignature = 0x02014b50;
+constexpr uint32_t kZip64EndOfCentralDirectorySignature = 0x06064b50;
+constexpr uint32_t kZip64EndOfCentralDirectoryLocatorSignature = 0x07064b50;
+constexpr uint32_t kEndOfCentralDirectorySignature = 0x06054b50;
+
+constexpr uint16_t kVersionZip64 = 45;
+constexpr uint16_t kFlagDataDescriptor = 0x0008;
+constexpr uint16_t kMethodStored = 0;
+constexpr uint16_t kMethodDeflated = 8;
+constexpr uint16_t kZip64ExtraFieldId = 0x0001;
+
+// MakeAppx stamps every entry with the same DOS time; doing the same keeps
+// repacks of identical content byte-for-byte identical.
+constexpr uint16_t kDosTime = 0x0000;
+constexpr uint16_t kDosDate = 0x0021;  // 1980-01-01
+
+constexpr size_t kLocalFileHeaderFixedSize = 30;
+constexpr size_t kZip64DataDescriptorSize = 24;
+constexpr size_t kCentralDirectoryFixedSize = 46;
+constexpr size_t kZip64EndOfCentralDirectorySize = 56;
+constexpr size_t kZip64EndOfCentralDirectoryLocatorSize = 20;
+constexpr size_t kEndOfCentralDirectorySize = 22;
+
+class ByteWriter {
+public:
+    explicit ByteWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    void U16(uint16_t v) {
+        out_.push_back(uint8_t(v));
+        out_.push_back(uint8_t(v >> 8));
+    }
+    void U32(uint32_t v) {
+        U16(uint16_t(v));
+        U16(uint16_t(v >> 16));
+    }
+    void U64(uint64_t v) {
+        U32(uint32_t(v));
+        U32(uint32_t(v >> 32));
+    }
+    void Bytes(const std::string& s) { out_.insert(out_.end(), s.begin(), s.end()); }
+
+private:
+    std::vector<uint8_t>& out_;
+};
+
+inline uint16_t ReadU16(const uint8_t* p) {
+    return uint16_t(p[0] | (p[1] << 8));
+}
+inline uint32_t ReadU32(const uint8_t* p) {
+    return uint32_t(ReadU16(p)) | (uint32_t(ReadU16(p + 2)) << 16);
+}
+inline uint64_t ReadU64(const uint8_t* p) {
+    return uint64_t(ReadU32(p)) | (uint64_t(ReadU32(p + 4)) << 32);
+}
+
+// Local file header with sizes and CRC deferred to the data descriptor.
+inline void AppendLocalFileHeader(std::vector<uint8_t>& out, const std::string& name,
+                                  uint16_t method) {
+    ByteWriter w(out);
+    w.U32(kLocalFileHeaderSignature);
+    w.U16(kVersionZip64);
+    w.U16(kFlagDataDescriptor);
+    w.U16(method);
+    w.U16(kDosTime);
+    w.U16(kDosDate);
+    w.U32(0);  // crc-32
+    w.U32(0);  // compressed size
+    w.U32(0);  // uncompressed size
+    w.U16(uint16_t(name.size()));
+    w.U16(0);  // extra field length
+    w.Bytes(name);
+}
+
+inline void AppendZip64DataDescriptor(std::vector<uint8_t>& out, uint32_t crc,
+                                      uint64_t compressedSize, uint64_t uncompressedSize) {
+    ByteWriter w(out);
+    w.U32(kDataDescriptorSignature);
+    w.U32(crc);
+    w.U64(compressedSize);
+    w.U64(uncompressedSize);
+}
+
+struct CentralDirectoryEntry {
+    std::string name;
+    uint16_t method = kMethodDeflated;
+    uint32_t crc = 0;
+    uint64_t compressedSize = 0;
+    uint64_t uncompressedSize = 0;
+    uint64_t localHeaderOffset = 0;
+};
+
+inline void AppendCentralDirectoryEntry(std::vector<uint8_t>& out,
+                                        const CentralDirectoryEntry& entry) {
+    ByteWriter w(out);
+    w.U32(kCentralDirectorySignature);
+    w.U16(kVersionZip64);  // version made by (MS-DOS host)
+    w.U16(kVersionZip64);  // version needed to extract
+    w.U16(kFlagDataDescriptor);
+    w.U16(entry.method);
+    w.U16(kDosTime);
+    w.U16(kDosDate);
+    w.U32(entry.crc);
+    w.U32(0xFFFFFFFF);  // sizes and offset live in the ZIP64 extra field
+    w.U32(0xFFFFFFFF);
+    w.U16(uint16_t(entry.name.size()));
+    w.U16(28);  // extra field length
+    w.U16(0);   // comment length
+    w.U16(0);   // disk number start
+    w.U16(0);   // internal attributes
+    w.U32(0);   // external attributes
+    w.U32(0xFFFFFFFF);
+    w.Bytes(entry.name);
+    w.U16(kZip64ExtraFieldId);
+    w.U16(24);
+    w.U64(entry.uncompressedSize);
+    w.U64(entry.compressedSize);
+    w.U64(entry.localHeaderOffset);
+}
+
+inline void AppendEndOfCentralDirectory(std::vector<uint8_t>& out, uint64_t entryCount,
+                                        uint64_t directoryOffset, uint64_t directorySize) {
+    ByteWriter w(out);
+    uint64_t zip64RecordOffset = directoryOffset + directorySize;
+
+    w.U32(kZip64EndOfCentralDirectorySignature);
+    w.U64(kZip64EndOfCentralDirectorySize - 12);
+    w.U16(kVersionZip64);
+    w.U16(kVersionZip64);
+    w.U32(0);  // number of this disk
+    w.U32(0);  // disk with the central directory
+    w.U64(entryCount);
+    w.U64(entryCount);
+    w.U64(directorySize);
+    w.U64(directoryOffset);
+
+    w.U32(kZip64EndOfCentralDirectoryLocatorSignature);
+    w.U32(0);
+    w.U64(zip64RecordOffset);
+    w.U32(1);  // total number of disks
+
+    w.U32(kEndOfCentralDirectorySignature);
+    w.U16(0xFFFF);
+    w.U16(0xFFFF);
+    w.U16(0xFFFF);
+    w.U16(0xFFFF);
+    w.U32(0xFFFFFFFF);
+    w.U32(0xFFFFFFFF);
+    w.U16(0);  // comment length
+}
+
+// Plain (non-ZIP64) records with sizes up front, for archives read by
+// zipimport: before Python 3.13 it rejects ZIP64. The padding extra field
+// lets the entry's data start on an aligned offset.
+constexpr uint16_t kVersionDefault = 20;
+constexpr uint16_t kAlignmentExtraFieldId = 0xD935;  // as written by zipalign
+
+// Local header padding that puts the data of an entry whose header starts
+// at offset on an alignment boundary. The padding is an extra field, so it
+// is either 0 or at least its 4-byte header.
+inline uint16_t AlignmentPadding(uint64_t offset, size_t nameLength, uint32_t alignment) {
+    if (alignment <= 1) {
+        return 0;
+    }
+    uint64_t data = offset + kLocalFileHeaderFixedSize + nameLength;
+    uint64_t padding = (alignment - data % alignment) % alignment;
+    while (padding != 0 && padding < 4) {
+        padding += alignment;
+    }
+    return static_cast<uint16_t>(padding);
+}
+
+inline void AppendPlainLocalFileHeader(std::vector<uint8_t>& out, const std::string& name,
+                                       uint16_t method, uint32_t crc, uint32_t compressedSize,
+                                       uint32_t uncompressedSize, uint16_t padding) {
+    ByteWriter w(out);
+    w.U32(kLocalFileHeaderSignature);
+    w.U16(kVersionDefault);
+    w.U16(0);  // flags
+    w.U16(method);
+    w.U16(kDosTime);
+    w.U16(kDosDate);
+    w.U32(crc);
+    w.U32(compressedSize);
+    w.U32(uncompressedSize);
+    w.U16(uint16_t(name.size()));
+    w.U16(padding);
+    w.Bytes(name);
+    if (padding >= 4) {
+        w.U16(kAlignmentExtraFieldId);
+        w.U16(uint16_t(padding - 4));
+        out.resize(out.size() + padding - 4);
+    }
+}
+
+inline void AppendPlainCentralDirectoryEntry(std::vector<uint8_t>& out,
+                                             const CentralDirectoryEntry& entry) {
+    ByteWriter w(out);
+    w.U32(kCentralDirectorySignature);
+    w.U16(kVersionDefault);
+    w.U16(kVersionDefault);
+    w.U16(0);  // flags
+    w.U16(entry.method);
+    w.U16(kDosTime);
+    w.U16(kDosDate);
+    w.U32(entry.crc);
+    w.U32(uint32_t(entry.compressedSize));
+    w.U32(uint32_t(entry.uncompressedSize));
+    w.U16(uint16_t(entry.name.size()));
+    w.U16(0);  // extra field length
+    w.U16(0);  // comment length
+    w.U16(0);  // disk number start
+    w.U16(0);  // internal attributes
+    w.U32(0);  // external attributes
+    w.U32(uint32_t(entry.localHeaderOffset));
+    w.Bytes(entry.name);
+}
+
+inline void AppendPlainEndOfCentralDirectory(std::vector<uint8_t>& out, uint16_t entryCount,
+                                             uint32_t directoryOffset, uint32_t directorySize) {
+    ByteWriter w(out);
+    w.U32(kEndOfCentralDirectorySignature);
+    w.U16(0);  // number of this disk
+    w.U16(0);  // disk with the central directory
+    w.U16(entryCount);
+    w.U16(entryCount);
+    w.U32(directorySize);
+    w.U32(directoryOffset);
+    w.U16(0);  // comment length
+}
+
+}  // namespace zip
+}  // namespace msix
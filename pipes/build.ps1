@@ -0,0 +1,67 @@
+# Builds the shared-memory channel: the shmchannel library that shm_pipe.py
+# loads through ctypes, and ipc_bench, which compares it against the
+# message-mode pipe pipe.py uses. local_bench measures the multi-client
+# local socket server.
+
+$scriptDir = Split-Path -Path $MyInvocation.MyCommand.Path
+$outDir = Join-Path -Path $scriptDir -ChildPath "out"
+
+$LibrarySources = @(
+    "shm_channel.cc",
+    "local_socket.cc",
+    "shared_object.cc"
+)
+
+$Tools = @(
+    "ipc_bench",
+    "local_bench"
+)
+
+$compilerFlags = @("-std=c++17", "-O2", "-g")
+$linkFlags = @()
+if ($IsLinux -or $IsMacOS) {
+    $compilerFlags += "-pthread"
+    $exeSuffix = ""
+    $libraryName = if ($IsMacOS) { "libshmchannel.dylib" } else { "libshmchannel.so" }
+    $sharedFlags = @("-shared", "-fPIC")
+    if ($IsLinux) {
+        $linkFlags += "-lrt"
+    }
+} else {
+    $exeSuffix = ".exe"
+    $libraryName = "shmchannel.dll"
+    $sharedFlags = @("-shared")
+    $linkFlags += @("-lws2_32", "-ladvapi32", "-luserenv")
+}
+
+New-Item -ItemType Directory -Force -Path $outDir | Out-Null
+
+$librarySourcePaths = $LibrarySources | ForEach-Object { Join-Path $scriptDir $_ }
+
+Write-Host "Compiling $libraryName..." -ForegroundColor Yellow
+$libraryPath = Join-Path $outDir $libraryName
+& clang++ @compilerFlags @sharedFlags @librarySourcePaths (Join-Path $scriptDir "shm_channel_c.cc") -o $libraryPath @linkFlags
+if ($LASTEXITCODE -ne 0) {
+    Write-Error "Compilation of $libraryName failed with exit code $LASTEXITCODE"
+    exit $LASTEXITCODE
+}
+Write-Host "Successfully compiled to $libraryPath" -ForegroundColor Green
+
+foreach ($tool in $Tools) {
+    $sourcePath = Join-Path $scriptDir "$tool.cc"
+    $outputPath = Join-Path $outDir "$tool$exeSuffix"
+    Write-Host "Compiling $tool..." -ForegroundColor Yellow
+
+    & clang++ @compilerFlags $sourcePath @librarySourcePaths -o $outputPath @linkFlags
+
+    if ($LASTEXITCODE -ne 0) {
+        Write-Error "Compilation of $tool failed with exit code $LASTEXITCODE"
+        exit $LASTEXITCODE
+    }
+    Write-Host "Successfully compiled to $outputPath" -ForegroundColor Green
+}
+
+# shm_pipe.py finds the library next to itself.
+Copy-Item -Path (Join-Path $scriptDir "shm_pipe.py") -Destination $outDir -Force
+
+Write-Host "All pipe tools built." -ForegroundColor Green
@@ -0,0 +1,408 @@
+// Compares ShmChannel against the message-mode pipe pipe.py uses: streaming
+// throughput and ping-pong round trips to a peer process (this binary
+// re-executed with /peer). On Windows the baseline is a named pipe with the
+// same 64 KB buffers as pipe.py; on POSIX a SOCK_SEQPACKET socketpair, the
+// closest message-mode equivalent.
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shm_channel.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// First byte of every message says what it is.
+constexpr char kData = 'D';
+constexpr char kPing = 'P';
+constexpr char kEnd = 'E';
+constexpr char kQuit = 'Q';
+constexpr size_t kPingSize = 64;
+constexpr size_t kPipeBuffer = 65536;
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "Options:\n"
+              << "  /mode <name>     shm, pipe or all (default: all)\n"
+              << "  /size <bytes>    Streamed message size (default: 65536)\n"
+              << "  /total <MB>      Data streamed per transport (default: 1024)\n"
+              << "  /pings <n>       Round trips measured (default: 100000)\n"
+              << "  /ring <bytes>    Shared-memory ring size (default: 4 MB)\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+class Transport {
+public:
+    virtual ~Transport() = default;
+    virtual bool Send(const void* data, size_t length) = 0;
+    // Returns a pointer to the message, valid until the next Receive().
+    virtual const char* Receive(size_t* length) = 0;
+};
+
+class ShmTransport : public Transport {
+public:
+    explicit ShmTransport(std::unique_ptr<pipes::ShmChannel> channel)
+        : channel_(std::move(channel)) {}
+
+    bool Send(const void* data, size_t length) override {
+        return channel_->Send(data, length, -1) == pipes::ChannelStatus::kOk;
+    }
+
+    const char* Receive(size_t* length) override {
+        pipes::ChannelStatus status;
+        return static_cast<const char*>(channel_->Next(length, -1, &status));
+    }
+
+private:
+    std::unique_ptr<pipes::ShmChannel> channel_;
+};
+
+#ifdef _WIN32
+class PipeTransport : public Transport {
+public:
+    explicit PipeTransport(HANDLE pipe) : pipe_(pipe), buffer_(16 << 20) {}
+    ~PipeTransport() override { CloseHandle(pipe_); }
+
+    bool Send(const void* data, size_t length) override {
+        DWORD written = 0;
+        return WriteFile(pipe_, data, static_cast<DWORD>(length), &written, NULL) &&
+               written == length;
+    }
+
+    const char* Receive(size_t* length) override {
+        DWORD read = 0;
+        if (!ReadFile(pipe_, buffer_.data(), static_cast<DWORD>(buffer_.size()), &read, NULL)) {
+            return nullptr;
+        }
+        *length = read;
+        return buffer_.data();
+    }
+
+private:
+    HANDLE pipe_;
+    std::vector<char> buffer_;
+};
+#else
+class PipeTransport : public Transport {
+public:
+    explicit PipeTransport(int fd) : fd_(fd), buffer_(16 << 20) {}
+    ~PipeTransport() override { close(fd_); }
+
+    bool Send(const void* data, size_t length) override {
+        ssize_t written;
+        do {
+            written = send(fd_, data, length, 0);
+        } while (written < 0 && errno == EINTR);
+        return written == static_cast<ssize_t>(length);
+    }
+
+    const char* Receive(size_t* length) override {
+        ssize_t read;
+        do {
+            read = recv(fd_, buffer_.data(), buffer_.size(), 0);
+        } while (read < 0 && errno == EINTR);
+        if (read <= 0) {
+            return nullptr;
+        }
+        *length = static_cast<size_t>(read);
+        return buffer_.data();
+    }
+
+private:
+    int fd_;
+    std::vector<char> buffer_;
+};
+#endif
+
+// The peer: discards data, echoes pings, acknowledges the end of a stream.
+int RunPeer(Transport& transport) {
+    for (;;) {
+        size_t length = 0;
+        const char* message = transport.Receive(&length);
+        if (message == nullptr || length == 0) {
+            return 1;
+        }
+        switch (message[0]) {
+            case kPing:
+                if (!transport.Send(message, length)) {
+                    return 1;
+                }
+                break;
+            case kEnd:
+                if (!transport.Send(&kEnd, 1)) {
+                    return 1;
+                }
+                break;
+            case kQuit:
+                return 0;
+            default:
+                break;
+        }
+    }
+}
+
+struct Result {
+    double megabytesPerSecond = 0;
+    double messagesPerSecond = 0;
+    std::vector<double> roundTripsUs;
+};
+
+bool Measure(Transport& transport, size_t messageSize, uint64_t totalBytes, unsigned pings,
+             Result* result) {
+    std::vector<char> data(messageSize, 'x');
+    data[0] = kData;
+    uint64_t messages = std::max<uint64_t>(1, totalBytes / messageSize);
+    size_t length = 0;
+
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < messages; i++) {
+        if (!transport.Send(data.data(), data.size())) {
+            return false;
+        }
+    }
+    if (!transport.Send(&kEnd, 1) || transport.Receive(&length) == nullptr) {
+        return false;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result->megabytesPerSecond = messages * messageSize / seconds / (1 << 20);
+    result->messagesPerSecond = messages / seconds;
+
+    char ping[kPingSize] = {kPing};
+    result->roundTripsUs.reserve(pings);
+    for (unsigned i = 0; i < pings; i++) {
+        auto sent = Clock::now();
+        if (!transport.Send(ping, sizeof(ping)) || transport.Receive(&length) == nullptr) {
+            return false;
+        }
+        result->roundTripsUs.push_back(
+            std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+    }
+    return transport.Send(&kQuit, 1);
+}
+
+double Percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()))];
+}
+
+#ifdef _WIN32
+std::wstring Widen(const std::string& text) { return std::wstring(text.begin(), text.end()); }
+
+HANDLE StartPeer(const char* self, const std::string& mode, const std::string& name) {
+    std::wstring commandLine = L"\"" + Widen(self) + L"\" /peer " + Widen(mode) + L" " +
+                               Widen(name);
+    STARTUPINFOW startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION info = {};
+    if (!CreateProcessW(NULL, &commandLine[0], NULL, NULL, FALSE, 0, NULL, NULL, &startup,
+                        &info)) {
+        return NULL;
+    }
+    CloseHandle(info.hThread);
+    return info.hProcess;
+}
+
+void WaitPeer(HANDLE process) {
+    WaitForSingleObject(process, INFINITE);
+    CloseHandle(process);
+}
+
+std::string PipePath(const std::string& name) { return "\\\\.\\pipe\\LOCAL\\" + name; }
+
+std::unique_ptr<Transport> ServePipe(const char* self, const std::string& name, HANDLE* peer) {
+    HANDLE pipe = CreateNamedPipeW(
+        Widen(PipePath(name)).c_str(), PIPE_ACCESS_DUPLEX,
+        PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT, 1, kPipeBuffer, kPipeBuffer, 0,
+        NULL);
+    if (pipe == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    *peer = StartPeer(self, "pipe", name);
+    if (*peer == NULL ||
+        (!ConnectNamedPipe(pipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED)) {
+        CloseHandle(pipe);
+        return nullptr;
+    }
+    return std::unique_ptr<Transport>(new PipeTransport(pipe));
+}
+
+std::unique_ptr<Transport> ConnectPipe(const std::string& name) {
+    HANDLE pipe = CreateFileW(Widen(PipePath(name)).c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                              NULL, OPEN_EXISTING, 0, NULL);
+    if (pipe == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    DWORD mode = PIPE_READMODE_MESSAGE;
+    SetNamedPipeHandleState(pipe, &mode, NULL, NULL);
+    return std::unique_ptr<Transport>(new PipeTransport(pipe));
+}
+
+using PeerHandle = HANDLE;
+constexpr PeerHandle kNoPeer = NULL;
+#else
+pid_t StartPeer(const char* self, const std::string& mode, const std::string& name) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(self, self, "/peer", mode.c_str(), name.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+
+void WaitPeer(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+}
+
+std::unique_ptr<Transport> ServePipe(const char* self, const std::string&, pid_t* peer) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+        return nullptr;
+    }
+    int size = static_cast<int>(kPipeBuffer);
+    for (int fd : fds) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    fcntl(fds[1], F_SETFD, 0);
+    *peer = StartPeer(self, "pipe", std::to_string(fds[1]));
+    close(fds[1]);
+    if (*peer < 0) {
+        close(fds[0]);
+        return nullptr;
+    }
+    return std::unique_ptr<Transport>(new PipeTransport(fds[0]));
+}
+
+std::unique_ptr<Transport> ConnectPipe(const std::string& name) {
+    return std::unique_ptr<Transport>(new PipeTransport(atoi(name.c_str())));
+}
+
+using PeerHandle = pid_t;
+constexpr PeerHandle kNoPeer = -1;
+#endif
+
+std::string ChannelName() {
+#ifdef _WIN32
+    return "ipc_bench_" + std::to_string(GetCurrentProcessId());
+#else
+    return "ipc_bench_" + std::to_string(getpid());
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if (argc == 4 && IsFlag(argv[1], "peer")) {
+        std::unique_ptr<Transport> transport;
+        std::string error;
+        if (strcmp(argv[2], "shm") == 0) {
+            std::unique_ptr<pipes::ShmChannel> channel = pipes::ShmChannel::Open(argv[3], &error);
+            if (channel) {
+                transport.reset(new ShmTransport(std::move(channel)));
+            }
+        } else {
+            transport = ConnectPipe(argv[3]);
+        }
+        if (!transport) {
+            fprintf(stderr, "peer: cannot connect to %s %s\n", argv[2], error.c_str());
+            return 1;
+        }
+        return RunPeer(*transport);
+    }
+
+    std::string onlyMode = "all";
+    size_t messageSize = 65536;
+    uint64_t totalBytes = 1024ull << 20;
+    unsigned pings = 100000;
+    size_t ring = 4 << 20;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "mode") && hasValue) {
+            onlyMode = argv[++i];
+        } else if (IsFlag(arg, "size") && hasValue) {
+            messageSize = std::max<size_t>(8, strtoull(argv[++i], nullptr, 10));
+        } else if (IsFlag(arg, "total") && hasValue) {
+            totalBytes = strtoull(argv[++i], nullptr, 10) << 20;
+        } else if (IsFlag(arg, "pings") && hasValue) {
+            pings = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "ring") && hasValue) {
+            ring = strtoull(argv[++i], nullptr, 10);
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "%zu-byte messages, %llu MB streamed, %u round trips of %zu bytes\n",
+            messageSize, static_cast<unsigned long long>(totalBytes >> 20), pings, kPingSize);
+    fprintf(stderr, "%-6s %10s %12s %10s %10s %10s\n", "mode", "MB/s", "msgs/s", "rtt p50",
+            "rtt p99", "(us)");
+    for (const char* mode : {"shm", "pipe"}) {
+        if (onlyMode != "all" && onlyMode != mode) {
+            continue;
+        }
+        std::string name = ChannelName();
+        std::unique_ptr<Transport> transport;
+        PeerHandle peer = kNoPeer;
+        std::string error;
+        if (strcmp(mode, "shm") == 0) {
+            std::unique_ptr<pipes::ShmChannel> channel =
+                pipes::ShmChannel::Create(name, ring, &error);
+            if (channel && messageSize > channel->MaxMessage()) {
+                error = "message size exceeds the ring's maximum of " +
+                        std::to_string(channel->MaxMessage());
+                channel.reset();
+            }
+            if (channel) {
+                peer = StartPeer(argv[0], mode, name);
+                if (peer != kNoPeer && channel->WaitForPeer(10000)) {
+                    transport.reset(new ShmTransport(std::move(channel)));
+                }
+            }
+        } else {
+            transport = ServePipe(argv[0], name, &peer);
+        }
+        if (!transport) {
+            fprintf(stderr, "%s: setup failed %s\n", mode, error.c_str());
+            return 1;
+        }
+        Result result;
+        bool ok = Measure(*transport, messageSize, totalBytes, pings, &result);
+        transport.reset();
+        WaitPeer(peer);
+        if (!ok) {
+            fprintf(stderr, "%s: transfer failed\n", mode);
+            return 1;
+        }
+        fprintf(stderr, "%-6s %10.0f %12.0f %10.2f %10.2f\n", mode, result.megabytesPerSecond,
+                result.messagesPerSecond, Percentile(result.roundTripsUs, 0.50),
+                Percentile(result.roundTripsUs, 0.99));
+    }
+    return 0;
+}
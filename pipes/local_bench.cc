@@ -0,0 +1,259 @@
+// Exercises LocalServer the way a host serving many sandboxed workers would:
+//
+//   reconnect  a client started before its server; time from the server
+//              publishing its socket to the client being connected (pipe.py's
+//              client takes up to a second here)
+//   fan-in     /clients connections to one event loop, each doing /rounds
+//              echo round trips, with every client in flight at once
+//
+// With /serve <path> it only runs an echo server, for clients in other
+// processes.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "local_socket.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "Options:\n"
+              << "  /clients <n>     Concurrent clients for fan-in (default: 1000)\n"
+              << "  /rounds <n>      Echo round trips per client (default: 100)\n"
+              << "  /size <bytes>    Echo message size (default: 64)\n"
+              << "  /reconnects <n>  Reconnect latency samples (default: 20)\n"
+              << "  /path <path>     Socket path (default: temporary)\n"
+              << "  /serve <path>    Only run an echo server on <path>\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+std::string DefaultPath() {
+#ifdef _WIN32
+    char directory[MAX_PATH];
+    GetTempPathA(MAX_PATH, directory);
+    return std::string(directory) + "local_bench_" + std::to_string(GetCurrentProcessId());
+#else
+    const char* directory = getenv("TMPDIR");
+    return std::string(directory && *directory ? directory : "/tmp") + "/local_bench_" +
+           std::to_string(getpid());
+#endif
+}
+
+// Each fan-in client holds a descriptor on both ends of this process.
+void RaiseDescriptorLimit(size_t clients) {
+#ifdef _WIN32
+    (void)clients;
+#else
+    rlimit limit;
+    rlim_t wanted = static_cast<rlim_t>(clients * 2 + 64);
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < wanted) {
+        limit.rlim_cur = std::min(wanted, limit.rlim_max);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+double Percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(values.size() * fraction))];
+}
+
+double MicrosecondsSince(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// Echoes every message back to its sender, on its own event loop thread.
+class EchoServer {
+public:
+    ~EchoServer() {
+        if (thread_.joinable()) {
+            server_->Stop();
+            thread_.join();
+        }
+    }
+
+    bool Start(const std::string& path, std::string* error) {
+        pipes::LocalServerOptions options;
+        options.onMessage = [this](pipes::ConnectionId id, const char* data, size_t length) {
+            server_->Send(id, data, length);
+        };
+        server_ = pipes::LocalServer::Create(path, options, error);
+        if (!server_) {
+            return false;
+        }
+        thread_ = std::thread([this] {
+            std::string error;
+            if (!server_->Run(&error)) {
+                fprintf(stderr, "server: %s\n", error.c_str());
+            }
+        });
+        return true;
+    }
+
+private:
+    std::unique_ptr<pipes::LocalServer> server_;
+    std::thread thread_;
+};
+
+// Starts a client, then the server it is waiting for, `samples` times.
+bool MeasureReconnect(const std::string& path, unsigned samples, std::vector<double>* latencies) {
+    for (unsigned i = 0; i < samples; i++) {
+        std::atomic<bool> connected{false};
+        Clock::time_point connectedAt;
+        std::string clientError;
+        std::thread client([&] {
+            std::unique_ptr<pipes::LocalClient> connection =
+                pipes::LocalClient::Connect(path, 10000, &clientError);
+            connectedAt = Clock::now();
+            connected.store(connection != nullptr);
+        });
+        // Let the client reach its wait before the server appears.
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        Clock::time_point published = Clock::now();
+        std::string error;
+        std::unique_ptr<pipes::LocalServer> server =
+            pipes::LocalServer::Create(path, pipes::LocalServerOptions(), &error);
+        client.join();
+        if (!server || !connected.load()) {
+            fprintf(stderr, "reconnect: %s%s\n", error.c_str(), clientError.c_str());
+            return false;
+        }
+        // Create() returns after the rename that releases the client, so the
+        // start time is taken before it.
+        latencies->push_back(MicrosecondsSince(published, connectedAt));
+    }
+    return true;
+}
+
+bool MeasureFanIn(const std::string& path, size_t clients, unsigned rounds, size_t messageSize,
+                  double* connectSeconds, double* messagesPerSecond) {
+    EchoServer server;
+    std::string error;
+    if (!server.Start(path, &error)) {
+        fprintf(stderr, "fan-in: %s\n", error.c_str());
+        return false;
+    }
+    Clock::time_point start = Clock::now();
+    std::vector<std::unique_ptr<pipes::LocalClient>> connections;
+    connections.reserve(clients);
+    for (size_t i = 0; i < clients; i++) {
+        connections.push_back(pipes::LocalClient::Connect(path, 10000, &error));
+        if (!connections.back()) {
+            fprintf(stderr, "fan-in: client %zu: %s\n", i, error.c_str());
+            return false;
+        }
+    }
+    Clock::time_point connected = Clock::now();
+    *connectSeconds = std::chrono::duration<double>(connected - start).count();
+
+    // Every client sends before any reads, so the server always has the
+    // whole population of connections ready at once.
+    std::string message(messageSize, 'x');
+    std::string reply;
+    for (unsigned round = 0; round < rounds; round++) {
+        for (auto& connection : connections) {
+            if (!connection->Send(message.data(), message.size())) {
+                fprintf(stderr, "fan-in: send failed\n");
+                return false;
+            }
+        }
+        for (auto& connection : connections) {
+            if (!connection->Receive(&reply) || reply.size() != messageSize) {
+                fprintf(stderr, "fan-in: receive failed\n");
+                return false;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - connected).count();
+    *messagesPerSecond = static_cast<double>(clients) * rounds / seconds;
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    size_t clients = 1000;
+    unsigned rounds = 100;
+    size_t messageSize = 64;
+    unsigned reconnects = 20;
+    std::string path = DefaultPath();
+    bool serveOnly = false;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "clients") && hasValue) {
+            clients = std::max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+        } else if (IsFlag(arg, "rounds") && hasValue) {
+            rounds = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "size") && hasValue) {
+            messageSize = std::max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+        } else if (IsFlag(arg, "reconnects") && hasValue) {
+            reconnects = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "path") && hasValue) {
+            path = argv[++i];
+        } else if (IsFlag(arg, "serve") && hasValue) {
+            path = argv[++i];
+            serveOnly = true;
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (serveOnly) {
+        pipes::LocalServerOptions options;
+        std::unique_ptr<pipes::LocalServer> server;
+        options.onMessage = [&server](pipes::ConnectionId id, const char* data, size_t length) {
+            server->Send(id, data, length);
+        };
+        std::string error;
+        server = pipes::LocalServer::Create(path, options, &error);
+        if (!server || !server->Run(&error)) {
+            fprintf(stderr, "serve: %s\n", error.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    RaiseDescriptorLimit(clients);
+    std::vector<double> latencies;
+    if (reconnects > 0) {
+        if (!MeasureReconnect(path, reconnects, &latencies)) {
+            return 1;
+        }
+        fprintf(stderr, "reconnect: p50 %.1f us, max %.1f us over %u samples\n",
+                Percentile(latencies, 0.50), Percentile(latencies, 1.0), reconnects);
+    }
+    double connectSeconds = 0;
+    double messagesPerSecond = 0;
+    if (!MeasureFanIn(path, clients, rounds, messageSize, &connectSeconds, &messagesPerSecond)) {
+        return 1;
+    }
+    fprintf(stderr, "fan-in: %zu clients connected in %.1f ms, %.0f echoes/s of %zu bytes\n",
+            clients, connectSeconds * 1000, messagesPerSecond, messageSize);
+    return 0;
+}
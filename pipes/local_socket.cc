@@ -0,0 +1,895 @@
+#include "local_socket.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+
+#include "shared_object.h"
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
+#endif
+
+namespace pipes {
+
+namespace {
+
+#ifdef _WIN32
+using Socket = SOCKET;
+const Socket kInvalidSocket = INVALID_SOCKET;
+using PollFd = WSAPOLLFD;
+
+int SocketError() { return WSAGetLastError(); }
+bool WouldBlock(int code) { return code == WSAEWOULDBLOCK; }
+bool Interrupted(int code) { return code == WSAEINTR; }
+void CloseSocket(Socket socket) { closesocket(socket); }
+std::string ErrorText(int code) { return "error " + std::to_string(code); }
+
+bool SetNonBlocking(Socket socket) {
+    u_long on = 1;
+    return ioctlsocket(socket, FIONBIO, &on) == 0;
+}
+
+int PollSockets(PollFd* fds, size_t count, int timeoutMs) {
+    return WSAPoll(fds, static_cast<ULONG>(count), timeoutMs);
+}
+
+bool StartSockets() {
+    static const bool started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+}
+
+// Manual-reset event the server sets while it listens on `path`, named
+// without its namespace (see shared_object.h).
+std::string RendezvousName(const std::string& path) {
+    std::string name = "pipes-local-";
+    for (char c : path) {
+        name += c == '\\' || c == '/' || c == ':' ? '_' : c;
+    }
+    return name;
+}
+#else
+using Socket = int;
+constexpr Socket kInvalidSocket = -1;
+using PollFd = pollfd;
+
+int SocketError() { return errno; }
+bool WouldBlock(int code) { return code == EAGAIN || code == EWOULDBLOCK; }
+bool Interrupted(int code) { return code == EINTR; }
+void CloseSocket(Socket socket) { close(socket); }
+std::string ErrorText(int code) { return strerror(code); }
+
+bool SetNonBlocking(Socket socket) {
+    int flags = fcntl(socket, F_GETFL);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+#ifndef __linux__
+int PollSockets(PollFd* fds, size_t count, int timeoutMs) {
+    return poll(fds, static_cast<nfds_t>(count), timeoutMs);
+}
+#endif
+
+bool StartSockets() { return true; }
+#endif
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+constexpr ConnectionId kListenerId = 0;
+constexpr ConnectionId kWakeId = 1;
+constexpr size_t kFrameHeader = 4;
+constexpr size_t kReadChunk = 64 * 1024;
+// Reads per connection per wakeup, so one busy client cannot starve the rest.
+constexpr int kReadsPerWakeup = 4;
+// Without an eventfd to interrupt it, the poll backend wakes this often to
+// notice Stop().
+constexpr int kPollStopCheckMs = 50;
+
+bool MakeAddress(const std::string& path, sockaddr_un* address, std::string* error) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address->sun_path)) {
+        *error = "Socket path too long: " + path;
+        return false;
+    }
+    memcpy(address->sun_path, path.data(), path.size());
+    return true;
+}
+
+Socket NewSocket() {
+#ifdef SOCK_CLOEXEC
+    return socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+#else
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+#endif
+}
+
+void PutLength(char* out, uint32_t length) {
+    for (int i = 0; i < 4; i++) {
+        out[i] = static_cast<char>(length >> (8 * i));
+    }
+}
+
+uint32_t GetLength(const char* in) {
+    uint32_t length = 0;
+    for (int i = 0; i < 4; i++) {
+        length |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return length;
+}
+
+bool SendAll(Socket socket, const char* data, size_t length) {
+    while (length > 0) {
+        int chunk = static_cast<int>(std::min<size_t>(length, 1 << 30));
+        auto sent = send(socket, data, chunk, kSendFlags);
+        if (sent < 0) {
+            if (Interrupted(SocketError())) {
+                continue;
+            }
+            return false;
+        }
+        data += sent;
+        length -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool ReceiveAll(Socket socket, char* data, size_t length) {
+    while (length > 0) {
+        int chunk = static_cast<int>(std::min<size_t>(length, 1 << 30));
+        auto received = recv(socket, data, chunk, 0);
+        if (received <= 0) {
+            if (received < 0 && Interrupted(SocketError())) {
+                continue;
+            }
+            return false;
+        }
+        data += received;
+        length -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+// One connect attempt; on failure *code says why.
+Socket TryConnect(const std::string& path, int* code, std::string* error) {
+    sockaddr_un address;
+    if (!MakeAddress(path, &address, error)) {
+        *code = 0;
+        return kInvalidSocket;
+    }
+    Socket socket = NewSocket();
+    if (socket == kInvalidSocket) {
+        *code = SocketError();
+        *error = "socket failed: " + ErrorText(*code);
+        return kInvalidSocket;
+    }
+    if (connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        *code = SocketError();
+        *error = "connect to " + path + " failed: " + ErrorText(*code);
+        CloseSocket(socket);
+        return kInvalidSocket;
+    }
+    return socket;
+}
+
+#ifdef __linux__
+// One inotify instance per thread, kept until the thread exits: closing one
+// waits out an RCU grace period (milliseconds), which would otherwise be
+// added to every connect that had to wait.
+int ThreadNotifier() {
+    struct Notifier {
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        ~Notifier() {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    };
+    thread_local Notifier notifier;
+    return notifier.fd;
+}
+
+std::string WatchedDirectory(const std::string& path) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+#endif
+
+// Errors that mean "no server yet" rather than a real failure.
+bool ServerMissing(int code) {
+#ifdef _WIN32
+    return code == WSAECONNREFUSED || code == WSAENETDOWN || code == ERROR_FILE_NOT_FOUND ||
+           code == ERROR_PATH_NOT_FOUND;
+#else
+    return code == ENOENT || code == ECONNREFUSED;
+#endif
+}
+
+// Identity of the socket file a server bound, so it removes only its own:
+// a later server may have replaced the file at the same path since.
+struct SocketFileId {
+#ifdef _WIN32
+    DWORD volume = 0;
+    DWORD indexHigh = 0;
+    DWORD indexLow = 0;
+#else
+    dev_t device = 0;
+    ino_t inode = 0;
+#endif
+};
+
+#ifdef _WIN32
+// The socket file is a reparse point, opened as itself rather than followed.
+HANDLE OpenSocketFile(const std::string& path, DWORD access) {
+    return CreateFileA(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING, FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+}
+
+bool HandleFileId(HANDLE file, SocketFileId* id) {
+    BY_HANDLE_FILE_INFORMATION info;
+    if (!GetFileInformationByHandle(file, &info)) {
+        return false;
+    }
+    id->volume = info.dwVolumeSerialNumber;
+    id->indexHigh = info.nFileIndexHigh;
+    id->indexLow = info.nFileIndexLow;
+    return true;
+}
+
+bool GetSocketFileId(const std::string& path, SocketFileId* id) {
+    HANDLE file = OpenSocketFile(path, FILE_READ_ATTRIBUTES);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    bool ok = HandleFileId(file, id);
+    CloseHandle(file);
+    return ok;
+}
+
+// Checked and deleted through one handle, so the file cannot be swapped in
+// between.
+void RemoveSocketFile(const std::string& path, const SocketFileId& id) {
+    HANDLE file = OpenSocketFile(path, DELETE | FILE_READ_ATTRIBUTES);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    SocketFileId current;
+    if (HandleFileId(file, &current) && current.volume == id.volume &&
+        current.indexHigh == id.indexHigh && current.indexLow == id.indexLow) {
+        FILE_DISPOSITION_INFO disposition = {TRUE};
+        SetFileInformationByHandle(file, FileDispositionInfo, &disposition, sizeof(disposition));
+    }
+    CloseHandle(file);
+}
+#else
+bool GetSocketFileId(const std::string& path, SocketFileId* id) {
+    struct stat info;
+    if (lstat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    id->device = info.st_dev;
+    id->inode = info.st_ino;
+    return true;
+}
+
+void RemoveSocketFile(const std::string& path, const SocketFileId& id) {
+    SocketFileId current;
+    if (GetSocketFileId(path, &current) && current.device == id.device &&
+        current.inode == id.inode) {
+        unlink(path.c_str());
+    }
+}
+#endif
+
+struct Connection {
+    Socket socket = kInvalidSocket;
+    std::string input;
+    size_t inputOffset = 0;
+    std::string output;
+    size_t outputOffset = 0;
+    bool reading = true;
+    bool writing = false;
+    bool closed = false;
+
+    size_t Pending() const { return output.size() - outputOffset; }
+};
+
+}  // namespace
+
+struct LocalServer::State {
+    LocalServerOptions options;
+    std::string path;
+    // The socket file this server bound: its temporary name until it is
+    // published at path. Empty when bind never succeeded.
+    std::string boundPath;
+    SocketFileId boundId;
+    Socket listener = kInvalidSocket;
+    std::unordered_map<ConnectionId, std::unique_ptr<Connection>> connections;
+    // Closed connections, removed (and reported) at the end of a Poll() so
+    // callbacks can close connections that are still being iterated.
+    std::vector<ConnectionId> closed;
+    ConnectionId nextId = 2;
+    std::atomic<bool> stopping{false};
+#ifdef __linux__
+    int epoll = -1;
+    int wake = -1;
+#endif
+#ifdef _WIN32
+    HANDLE rendezvous = NULL;
+#endif
+
+    void UpdateInterest(ConnectionId id, Connection& connection) {
+#ifdef __linux__
+        epoll_event event = {};
+        event.events = (connection.reading ? EPOLLIN : 0u) | (connection.writing ? EPOLLOUT : 0u);
+        event.data.u64 = id;
+        epoll_ctl(epoll, EPOLL_CTL_MOD, connection.socket, &event);
+#else
+        (void)id;
+        (void)connection;
+#endif
+    }
+
+    void MarkClosed(ConnectionId id, Connection& connection) {
+        if (!connection.closed) {
+            connection.closed = true;
+            closed.push_back(id);
+        }
+    }
+
+    void Reap() {
+        for (ConnectionId id : closed) {
+            auto it = connections.find(id);
+            if (it == connections.end()) {
+                continue;
+            }
+            // Closing the socket also removes it from the epoll set.
+            CloseSocket(it->second->socket);
+            connections.erase(it);
+            if (options.onDisconnect) {
+                options.onDisconnect(id);
+            }
+        }
+        closed.clear();
+    }
+
+    void Accept() {
+        for (;;) {
+#ifdef __linux__
+            Socket socket = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+            Socket socket = accept(listener, nullptr, nullptr);
+#endif
+            if (socket == kInvalidSocket) {
+                // EAGAIN once the queue is drained; on EMFILE and the like
+                // the client stays queued until a descriptor frees up.
+                return;
+            }
+#ifndef __linux__
+            SetNonBlocking(socket);
+#endif
+            ConnectionId id = nextId++;
+            std::unique_ptr<Connection> connection(new Connection());
+            connection->socket = socket;
+#ifdef __linux__
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = id;
+            epoll_ctl(epoll, EPOLL_CTL_ADD, socket, &event);
+#endif
+            connections.emplace(id, std::move(connection));
+            if (options.onConnect) {
+                options.onConnect(id);
+            }
+        }
+    }
+
+    // Hands every complete frame to onMessage.
+    void Dispatch(ConnectionId id, Connection& connection) {
+        while (!connection.closed && connection.input.size() - connection.inputOffset >= kFrameHeader) {
+            const char* frame = connection.input.data() + connection.inputOffset;
+            uint32_t length = GetLength(frame);
+            if (length > options.maxMessage) {
+                MarkClosed(id, connection);
+                return;
+            }
+            if (connection.input.size() - connection.inputOffset < kFrameHeader + length) {
+                break;
+            }
+            connection.inputOffset += kFrameHeader + length;
+            if (options.onMessage) {
+                options.onMessage(id, frame + kFrameHeader, length);
+            }
+        }
+        if (connection.inputOffset == connection.input.size()) {
+            connection.input.clear();
+            connection.inputOffset = 0;
+        } else if (connection.inputOffset >= kReadChunk) {
+            connection.input.erase(0, connection.inputOffset);
+            connection.inputOffset = 0;
+        }
+    }
+
+    void HandleRead(ConnectionId id, Connection& connection) {
+        char buffer[kReadChunk];
+        for (int i = 0; i < kReadsPerWakeup && connection.reading && !connection.closed; i++) {
+            auto received = recv(connection.socket, buffer, static_cast<int>(sizeof(buffer)), 0);
+            if (received == 0) {
+                MarkClosed(id, connection);
+                return;
+            }
+            if (received < 0) {
+                int code = SocketError();
+                if (Interrupted(code)) {
+                    continue;
+                }
+                if (!WouldBlock(code)) {
+                    MarkClosed(id, connection);
+                }
+                return;
+            }
+            connection.input.append(buffer, static_cast<size_t>(received));
+            Dispatch(id, connection);
+            if (static_cast<size_t>(received) < sizeof(buffer)) {
+                return;
+            }
+        }
+    }
+
+    // Writes queued output until the socket is full, then adjusts interest:
+    // writable while output is pending, readable again below lowWater.
+    void Flush(ConnectionId id, Connection& connection) {
+        while (connection.Pending() > 0) {
+            int chunk = static_cast<int>(std::min<size_t>(connection.Pending(), 1 << 30));
+            auto sent = send(connection.socket, connection.output.data() + connection.outputOffset,
+                             chunk, kSendFlags);
+            if (sent < 0) {
+                int code = SocketError();
+                if (Interrupted(code)) {
+                    continue;
+                }
+                if (!WouldBlock(code)) {
+                    MarkClosed(id, connection);
+                    return;
+                }
+                break;
+            }
+            connection.outputOffset += static_cast<size_t>(sent);
+        }
+        bool writing = connection.Pending() > 0;
+        bool reading = connection.reading || connection.Pending() < options.lowWater;
+        if (!writing) {
+            connection.output.clear();
+            connection.outputOffset = 0;
+        } else if (connection.outputOffset >= (1u << 20)) {
+            connection.output.erase(0, connection.outputOffset);
+            connection.outputOffset = 0;
+        }
+        if (writing != connection.writing || reading != connection.reading) {
+            connection.writing = writing;
+            connection.reading = reading;
+            UpdateInterest(id, connection);
+        }
+    }
+
+    void HandleEvents(ConnectionId id, bool readable, bool writable, bool hangup) {
+        if (id == kListenerId) {
+            Accept();
+            return;
+        }
+        auto it = connections.find(id);
+        if (it == connections.end() || it->second->closed) {
+            return;
+        }
+        Connection& connection = *it->second;
+        if (writable || (hangup && !connection.reading)) {
+            Flush(id, connection);
+        }
+        if ((readable || hangup) && connection.reading && !connection.closed) {
+            HandleRead(id, connection);
+        }
+        if (hangup && !connection.reading && connection.Pending() == 0) {
+            MarkClosed(id, connection);
+        }
+    }
+};
+
+LocalServer::LocalServer() : state_(new State()) {}
+
+LocalServer::~LocalServer() {
+    for (auto& entry : state_->connections) {
+        CloseSocket(entry.second->socket);
+    }
+    if (state_->listener != kInvalidSocket) {
+        CloseSocket(state_->listener);
+    }
+#ifdef _WIN32
+    if (state_->rendezvous != NULL) {
+        ResetEvent(state_->rendezvous);
+        CloseHandle(state_->rendezvous);
+    }
+#endif
+    if (!state_->boundPath.empty()) {
+        RemoveSocketFile(state_->boundPath, state_->boundId);
+    }
+#ifdef __linux__
+    if (state_->epoll >= 0) {
+        close(state_->epoll);
+    }
+    if (state_->wake >= 0) {
+        close(state_->wake);
+    }
+#endif
+}
+
+std::unique_ptr<LocalServer> LocalServer::Create(const std::string& path,
+                                                 const LocalServerOptions& options,
+                                                 std::string* error) {
+    if (!StartSockets()) {
+        *error = "WSAStartup failed";
+        return nullptr;
+    }
+    std::unique_ptr<LocalServer> server(new LocalServer());
+    State& state = *server->state_;
+    state.options = options;
+    state.path = path;
+
+    // A socket that accepts connections belongs to a running server; only a
+    // stale one is replaced.
+    int code = 0;
+    std::string probeError;
+    Socket probe = TryConnect(path, &code, &probeError);
+    if (probe != kInvalidSocket) {
+        CloseSocket(probe);
+        *error = "Another server is listening on " + path;
+        return nullptr;
+    }
+
+#ifdef _WIN32
+    // Windows AF_UNIX sockets cannot be renamed into place; waiting clients
+    // are released by the rendezvous event instead.
+    std::string bindPath = path;
+    DeleteFileA(path.c_str());
+#else
+    // Bound and listening under a temporary name first, so the socket only
+    // appears at `path` (atomically replacing a stale one) once connects to
+    // it succeed.
+    std::string bindPath = path + "." + std::to_string(getpid()) + ".tmp";
+    unlink(bindPath.c_str());
+#endif
+    sockaddr_un address;
+    if (!MakeAddress(bindPath, &address, error)) {
+        return nullptr;
+    }
+    state.listener = NewSocket();
+    if (state.listener == kInvalidSocket) {
+        *error = "socket failed: " + ErrorText(SocketError());
+        return nullptr;
+    }
+    if (bind(state.listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        *error = "Failed to bind " + path + ": " + ErrorText(SocketError());
+        return nullptr;
+    }
+    if (GetSocketFileId(bindPath, &state.boundId)) {
+        state.boundPath = bindPath;
+    }
+#ifdef _WIN32
+    // Connecting needs write access to the socket file, which the client's
+    // AppContainer and low integrity level do not have by default.
+    SharedObjectSecurity security;
+    if (!security.Init(options.appContainerSid, error) ||
+        (!options.appContainerSid.empty() && !security.ApplyToFile(bindPath, error))) {
+        return nullptr;
+    }
+#endif
+    if (listen(state.listener, options.backlog) != 0 || !SetNonBlocking(state.listener)) {
+        *error = "Failed to listen on " + path + ": " + ErrorText(SocketError());
+        return nullptr;
+    }
+
+#ifdef __linux__
+    state.epoll = epoll_create1(EPOLL_CLOEXEC);
+    state.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = kListenerId;
+    bool ok = state.epoll >= 0 && state.wake >= 0 &&
+              epoll_ctl(state.epoll, EPOLL_CTL_ADD, state.listener, &event) == 0;
+    event.data.u64 = kWakeId;
+    if (!ok || epoll_ctl(state.epoll, EPOLL_CTL_ADD, state.wake, &event) != 0) {
+        *error = std::string("epoll setup failed: ") + strerror(errno);
+        return nullptr;
+    }
+#endif
+
+#ifdef _WIN32
+    std::wstring rendezvousName;
+    if (!SharedObjectName(RendezvousName(path), options.appContainerSid, &rendezvousName, error)) {
+        return nullptr;
+    }
+    state.rendezvous = CreateEventW(security.Attributes(), TRUE, FALSE, rendezvousName.c_str());
+    if (state.rendezvous != NULL) {
+        SetEvent(state.rendezvous);
+    }
+#else
+    if (rename(bindPath.c_str(), path.c_str()) != 0) {
+        *error = "Failed to publish " + path + ": " + strerror(errno);
+        return nullptr;
+    }
+    state.boundPath = path;
+#endif
+    return server;
+}
+
+bool LocalServer::Poll(int timeoutMs, std::string* error) {
+    State& state = *state_;
+    state.Reap();
+#ifdef __linux__
+    epoll_event events[256];
+    int count = epoll_wait(state.epoll, events, 256, timeoutMs);
+    if (count < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        *error = std::string("epoll_wait failed: ") + strerror(errno);
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        ConnectionId id = events[i].data.u64;
+        if (id == kWakeId) {
+            uint64_t value;
+            while (read(state.wake, &value, sizeof(value)) > 0) {
+            }
+            continue;
+        }
+        uint32_t flags = events[i].events;
+        state.HandleEvents(id, (flags & EPOLLIN) != 0, (flags & EPOLLOUT) != 0,
+                           (flags & (EPOLLHUP | EPOLLERR)) != 0);
+    }
+#else
+    // Rebuilt per call: the fallback trades O(connections) per wakeup for
+    // not needing an event API.
+    std::vector<PollFd> fds;
+    std::vector<ConnectionId> ids;
+    fds.reserve(state.connections.size() + 1);
+    PollFd listener = {};
+    listener.fd = state.listener;
+    listener.events = POLLIN;
+    fds.push_back(listener);
+    ids.push_back(kListenerId);
+    for (auto& entry : state.connections) {
+        PollFd fd = {};
+        fd.fd = entry.second->socket;
+        fd.events = static_cast<short>((entry.second->reading ? POLLIN : 0) |
+                                       (entry.second->writing ? POLLOUT : 0));
+        fds.push_back(fd);
+        ids.push_back(entry.first);
+    }
+    int wait = timeoutMs < 0 || timeoutMs > kPollStopCheckMs ? kPollStopCheckMs : timeoutMs;
+    int count = PollSockets(fds.data(), fds.size(), wait);
+    if (count < 0) {
+        int code = SocketError();
+        if (Interrupted(code)) {
+            return true;
+        }
+        *error = "poll failed: " + ErrorText(code);
+        return false;
+    }
+    for (size_t i = 0; i < fds.size() && count > 0; i++) {
+        short revents = fds[i].revents;
+        if (revents == 0) {
+            continue;
+        }
+        count--;
+        state.HandleEvents(ids[i], (revents & POLLIN) != 0, (revents & POLLOUT) != 0,
+                           (revents & (POLLHUP | POLLERR)) != 0);
+    }
+#endif
+    state.Reap();
+    return true;
+}
+
+bool LocalServer::Run(std::string* error) {
+    while (!state_->stopping.load(std::memory_order_acquire)) {
+        if (!Poll(-1, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void LocalServer::Stop() {
+    state_->stopping.store(true, std::memory_order_release);
+#ifdef __linux__
+    uint64_t one = 1;
+    write(state_->wake, &one, sizeof(one));
+#endif
+}
+
+bool LocalServer::Send(ConnectionId id, const void* data, size_t length) {
+    State& state = *state_;
+    auto it = state.connections.find(id);
+    if (it == state.connections.end() || it->second->closed ||
+        it->second->Pending() + kFrameHeader + length > state.options.maxPending) {
+        return false;
+    }
+    Connection& connection = *it->second;
+    char header[kFrameHeader];
+    PutLength(header, static_cast<uint32_t>(length));
+    connection.output.append(header, kFrameHeader);
+    connection.output.append(static_cast<const char*>(data), length);
+    // Written through right away when nothing is queued, so a reply costs
+    // one send() and no extra wakeup.
+    if (!connection.writing) {
+        state.Flush(id, connection);
+    }
+    if (connection.reading && connection.Pending() > state.options.highWater) {
+        connection.reading = false;
+        state.UpdateInterest(id, connection);
+    }
+    return true;
+}
+
+void LocalServer::Close(ConnectionId id) {
+    auto it = state_->connections.find(id);
+    if (it != state_->connections.end()) {
+        state_->MarkClosed(id, *it->second);
+    }
+}
+
+size_t LocalServer::ConnectionCount() const { return state_->connections.size(); }
+
+LocalClient::~LocalClient() {
+    if (socket_ != -1) {
+        CloseSocket(static_cast<Socket>(socket_));
+    }
+}
+
+std::unique_ptr<LocalClient> LocalClient::Connect(const std::string& path, int timeoutMs,
+                                                  std::string* error) {
+    if (!StartSockets()) {
+        *error = "WSAStartup failed";
+        return nullptr;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    auto remainingMs = [&]() -> int {
+        if (timeoutMs < 0) {
+            return -1;
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        return static_cast<int>(std::max<long long>(0, left.count()));
+    };
+
+#ifdef __linux__
+    int notify = ThreadNotifier();
+    int watch = -1;
+#elif defined(_WIN32)
+    std::string rendezvousName = "Local\\" + RendezvousName(path);
+    HANDLE rendezvous = CreateEventA(NULL, TRUE, FALSE, rendezvousName.c_str());
+#endif
+
+    std::unique_ptr<LocalClient> client;
+    int backoffMs = 1;
+    for (;;) {
+        int code = 0;
+        Socket socket = TryConnect(path, &code, error);
+        if (socket != kInvalidSocket) {
+            client.reset(new LocalClient());
+            client->socket_ = static_cast<intptr_t>(socket);
+            break;
+        }
+        if (!ServerMissing(code)) {
+            break;
+        }
+        int remaining = remainingMs();
+        if (remaining == 0) {
+            *error = "Timed out waiting for " + path;
+            break;
+        }
+        bool notified = false;
+#ifdef __linux__
+        // Watched only once the server is found missing, and retried right
+        // after, so a server that appeared in between is not missed.
+        if (notify >= 0 && watch < 0) {
+            watch = inotify_add_watch(notify, WatchedDirectory(path).c_str(),
+                                      IN_CREATE | IN_MOVED_TO | IN_ATTRIB);
+            if (watch >= 0) {
+                continue;
+            }
+        }
+        if (watch >= 0) {
+            pollfd fd = {notify, POLLIN, 0};
+            if (poll(&fd, 1, remaining) > 0) {
+                char events[4096];
+                while (read(notify, events, sizeof(events)) > 0) {
+                }
+            }
+            notified = true;
+        }
+#elif defined(_WIN32)
+        // Still set while a server that died without resetting it is gone;
+        // back off in that case rather than spin.
+        if (rendezvous != NULL &&
+            WaitForSingleObject(rendezvous, remaining < 0 ? INFINITE : remaining) == WAIT_OBJECT_0 &&
+            backoffMs == 1) {
+            notified = true;
+            backoffMs = 2;
+        }
+#endif
+        if (!notified) {
+            int sleepMs = remaining < 0 ? backoffMs : std::min(backoffMs, remaining);
+            std::this_thread::sleep_for(std::chrono::milliseconds(sleepMs));
+            backoffMs = std::min(backoffMs * 2, 50);
+        }
+    }
+#ifdef __linux__
+    if (watch >= 0) {
+        inotify_rm_watch(notify, watch);
+        char events[4096];
+        while (read(notify, events, sizeof(events)) > 0) {
+        }
+    }
+#elif defined(_WIN32)
+    if (rendezvous != NULL) {
+        CloseHandle(rendezvous);
+    }
+#endif
+    return client;
+}
+
+bool LocalClient::Send(const void* data, size_t length) {
+    Socket socket = static_cast<Socket>(socket_);
+    char header[kFrameHeader];
+    PutLength(header, static_cast<uint32_t>(length));
+    // Small messages go out in one send() with their header.
+    if (length <= 4096) {
+        char frame[kFrameHeader + 4096];
+        memcpy(frame, header, kFrameHeader);
+        memcpy(frame + kFrameHeader, data, length);
+        return SendAll(socket, frame, kFrameHeader + length);
+    }
+    return SendAll(socket, header, kFrameHeader) &&
+           SendAll(socket, static_cast<const char*>(data), length);
+}
+
+bool LocalClient::Receive(std::string* message) {
+    Socket socket = static_cast<Socket>(socket_);
+    char header[kFrameHeader];
+    if (!ReceiveAll(socket, header, kFrameHeader)) {
+        return false;
+    }
+    message->resize(GetLength(header));
+    return message->empty() || ReceiveAll(socket, &(*message)[0], message->size());
+}
+
+}  // namespace pipes
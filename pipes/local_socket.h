@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+// Multi-client message server on a local (AF_UNIX) stream socket, for one
+// host process serving many sandboxed workers. It replaces the
+// single-instance named pipe of pipe.py, whose server blocks in
+// ConnectNamedPipe and whose client polls CreateFile once a second.
+//
+// One thread runs the event loop (epoll on Linux, poll / WSAPoll elsewhere)
+// over the listening socket and every connection. Messages are framed with
+// a 4-byte little-endian length. Each connection has its own input and
+// output buffers; a client that stops reading its replies gets no more of
+// its input read once its output passes the high-water mark, so a slow
+// client cannot make the server buffer without bound.
+//
+// Rendezvous: the server binds under a temporary name and renames the
+// socket into place once it listens. A client started first waits for that
+// rename with inotify (Linux) or on a named event the server sets (Windows)
+// instead of sleeping and retrying, so it connects within microseconds of
+// the server appearing.
+namespace pipes {
+
+using ConnectionId = uint64_t;
+
+struct LocalServerOptions {
+    // Larger frames close the connection.
+    size_t maxMessage = 16u << 20;
+    // Reading from a connection pauses while its queued output is above
+    // highWater and resumes below lowWater.
+    size_t highWater = 4u << 20;
+    size_t lowWater = 1u << 20;
+    // Send() fails once a connection has this much output queued.
+    size_t maxPending = 64u << 20;
+    int backlog = 4096;
+    // Windows: AppContainer SID (S-1-15-2-...) of the clients, so the
+    // socket file and the rendezvous event are made reachable from inside
+    // that container (see shared_object.h). Ignored on POSIX, where the
+    // sandbox shares the server's uid.
+    std::string appContainerSid;
+    // Called on the event loop thread.
+    std::function<void(ConnectionId)> onConnect;
+    std::function<void(ConnectionId, const char* data, size_t length)> onMessage;
+    std::function<void(ConnectionId)> onDisconnect;
+};
+
+class LocalServer {
+public:
+    ~LocalServer();
+
+    LocalServer(const LocalServer&) = delete;
+    LocalServer& operator=(const LocalServer&) = delete;
+
+    // Replaces a stale socket at `path`, but fails while another server
+    // accepts connections there. The destructor removes the socket file
+    // only if it is still the one this server bound.
+    static std::unique_ptr<LocalServer> Create(const std::string& path,
+                                               const LocalServerOptions& options,
+                                               std::string* error);
+
+    // Handles whatever is ready, waiting up to timeoutMs (-1: forever).
+    bool Poll(int timeoutMs, std::string* error);
+    // Polls until Stop().
+    bool Run(std::string* error);
+    // May be called from any thread.
+    void Stop();
+
+    // Event loop thread only. Queues one framed message; false when the
+    // connection is gone or has maxPending bytes queued.
+    bool Send(ConnectionId connection, const void* data, size_t length);
+    void Close(ConnectionId connection);
+    size_t ConnectionCount() const;
+
+private:
+    struct State;
+
+    LocalServer();
+
+    std::unique_ptr<State> state_;
+};
+
+// Blocking client end of a LocalServer connection.
+class LocalClient {
+public:
+    ~LocalClient();
+
+    LocalClient(const LocalClient&) = delete;
+    LocalClient& operator=(const LocalClient&) = delete;
+
+    // Connects, waiting up to timeoutMs (-1: forever) for the server to
+    // appear.
+    static std::unique_ptr<LocalClient> Connect(const std::string& path, int timeoutMs,
+                                                std::string* error);
+
+    bool Send(const void* data, size_t length);
+    // False once the server closed the connection.
+    bool Receive(std::string* message);
+
+private:
+    LocalClient() = default;
+
+    intptr_t socket_ = -1;
+};
+
+}  // namespace pipes
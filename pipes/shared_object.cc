@@ -0,0 +1,124 @@
+#include "shared_object.h"
+
+#ifdef _WIN32
+#include <aclapi.h>
+#include <sddl.h>
+#include <userenv.h>
+
+#include <vector>
+#endif
+
+namespace pipes {
+
+#ifdef _WIN32
+namespace {
+
+std::string ErrorText(const char* call) {
+    return std::string(call) + " failed with error " + std::to_string(GetLastError());
+}
+
+std::wstring Widen(const std::string& text) { return std::wstring(text.begin(), text.end()); }
+
+bool CurrentUserSid(std::wstring* sid, std::string* error) {
+    HANDLE token = NULL;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+        *error = ErrorText("OpenProcessToken");
+        return false;
+    }
+    DWORD size = 0;
+    GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+    std::vector<char> buffer(size);
+    LPWSTR text = nullptr;
+    bool ok = size > 0 && GetTokenInformation(token, TokenUser, buffer.data(), size, &size) &&
+              ConvertSidToStringSidW(reinterpret_cast<TOKEN_USER*>(buffer.data())->User.Sid,
+                                     &text);
+    CloseHandle(token);
+    if (!ok) {
+        *error = ErrorText("GetTokenInformation");
+        return false;
+    }
+    *sid = text;
+    LocalFree(text);
+    return true;
+}
+
+}  // namespace
+
+bool SharedObjectName(const std::string& name, const std::string& appContainerSid,
+                      std::wstring* objectName, std::string* error) {
+    if (appContainerSid.empty()) {
+        *objectName = L"Local\\" + Widen(name);
+        return true;
+    }
+    PSID sid = nullptr;
+    if (!ConvertStringSidToSidW(Widen(appContainerSid).c_str(), &sid)) {
+        *error = "Invalid AppContainer SID " + appContainerSid;
+        return false;
+    }
+    wchar_t path[MAX_PATH];
+    ULONG length = 0;
+    BOOL found = GetAppContainerNamedObjectPath(NULL, sid, MAX_PATH, path, &length);
+    LocalFree(sid);
+    if (!found) {
+        *error = ErrorText("GetAppContainerNamedObjectPath");
+        return false;
+    }
+    *objectName = std::wstring(path) + L"\\" + Widen(name);
+    return true;
+}
+
+SharedObjectSecurity::~SharedObjectSecurity() {
+    if (descriptor_ != nullptr) {
+        LocalFree(descriptor_);
+    }
+}
+
+bool SharedObjectSecurity::Init(const std::string& appContainerSid, std::string* error) {
+    std::wstring user;
+    if (!CurrentUserSid(&user, error)) {
+        return false;
+    }
+    // AC is ALL APPLICATION PACKAGES; LW the low integrity level, with
+    // no-write-up so only lower levels are kept from writing.
+    std::wstring sddl = L"D:(A;;GA;;;SY)(A;;GA;;;" + user + L")(A;;GA;;;AC)";
+    if (!appContainerSid.empty()) {
+        sddl += L"(A;;GA;;;" + Widen(appContainerSid) + L")";
+    }
+    sddl += L"S:(ML;;NW;;;LW)";
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl.c_str(), SDDL_REVISION_1,
+                                                              &descriptor_, nullptr)) {
+        *error = ErrorText("ConvertStringSecurityDescriptorToSecurityDescriptor");
+        return false;
+    }
+    attributes_.nLength = sizeof(attributes_);
+    attributes_.lpSecurityDescriptor = descriptor_;
+    attributes_.bInheritHandle = FALSE;
+    return true;
+}
+
+bool SharedObjectSecurity::ApplyToFile(const std::string& path, std::string* error) const {
+    BOOL present = FALSE;
+    BOOL defaulted = FALSE;
+    PACL dacl = nullptr;
+    PACL sacl = nullptr;
+    if (!GetSecurityDescriptorDacl(descriptor_, &present, &dacl, &defaulted) ||
+        !GetSecurityDescriptorSacl(descriptor_, &present, &sacl, &defaulted)) {
+        *error = ErrorText("GetSecurityDescriptorDacl");
+        return false;
+    }
+    std::string mutablePath = path;
+    DWORD result = SetNamedSecurityInfoA(&mutablePath[0], SE_FILE_OBJECT,
+                                         DACL_SECURITY_INFORMATION |
+                                             UNPROTECTED_DACL_SECURITY_INFORMATION |
+                                             LABEL_SECURITY_INFORMATION,
+                                         nullptr, nullptr, dacl, sacl);
+    if (result != ERROR_SUCCESS) {
+        *error = "SetNamedSecurityInfo failed for " + path + " with error " +
+                 std::to_string(result);
+        return false;
+    }
+    return true;
+}
+#endif
+
+}  // namespace pipes
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Names and security for the kernel objects (file mappings, events) and
+// socket files a host shares with clients that may run in an AppContainer.
+//
+// Such a client resolves Local\ names inside its container's own object
+// directory (AppContainerNamedObjects\<SID>), not the session's, and runs
+// at low integrity, so the default DACL and the medium mandatory label of
+// the host's token keep it out of anything the host creates. The host
+// therefore creates each object under the name the client will look up and
+// with a descriptor that grants the container access.
+//
+// Everything here is Windows-only; on POSIX the sandbox shares the host's
+// uid and the objects are reached by path.
+namespace pipes {
+
+#ifdef _WIN32
+// The name `name` has for a client in the AppContainer appContainerSid
+// (S-1-15-2-...). With an empty SID it is Local\<name>, which only clients
+// outside an AppContainer find.
+bool SharedObjectName(const std::string& name, const std::string& appContainerSid,
+                      std::wstring* objectName, std::string* error);
+
+// A descriptor giving full access to the current user, SYSTEM, ALL
+// APPLICATION PACKAGES and, when set, appContainerSid, with a low mandatory
+// label so a low-integrity client may write as well as read.
+class SharedObjectSecurity {
+public:
+    SharedObjectSecurity() = default;
+    ~SharedObjectSecurity();
+
+    SharedObjectSecurity(const SharedObjectSecurity&) = delete;
+    SharedObjectSecurity& operator=(const SharedObjectSecurity&) = delete;
+
+    bool Init(const std::string& appContainerSid, std::string* error);
+
+    // For CreateEventW, CreateFileMappingW and the like.
+    SECURITY_ATTRIBUTES* Attributes() { return &attributes_; }
+
+    // Applies the DACL and label to an existing file, e.g. a bound AF_UNIX
+    // socket, keeping the ACEs it inherits from its directory.
+    bool ApplyToFile(const std::string& path, std::string* error) const;
+
+private:
+    PSECURITY_DESCRIPTOR descriptor_ = nullptr;
+    SECURITY_ATTRIBUTES attributes_ = {};
+};
+#endif
+
+}  // namespace pipes
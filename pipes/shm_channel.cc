@@ -0,0 +1,615 @@
+#include "shm_channel.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include "shared_object.h"
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace pipes {
+
+namespace {
+
+constexpr uint32_t kMagic = 0x4d485350;  // "PSHM"
+constexpr uint32_t kVersion = 1;
+constexpr size_t kMinCapacity = 64 * 1024;
+constexpr size_t kHeaderSpace = 4096;
+
+constexpr uint32_t kRecordMessage = 1;
+// Fills the end of the ring when the next record does not fit before it.
+constexpr uint32_t kRecordWrap = 2;
+
+struct RecordHeader {
+    uint32_t length;
+    uint32_t kind;
+};
+
+size_t RecordSize(size_t length) { return sizeof(RecordHeader) + ((length + 7) & ~size_t(7)); }
+
+// One direction. Producer and consumer fields are on separate cache lines so
+// neither side's stores invalidate the line the other side polls.
+struct RingHeader {
+    alignas(64) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> writerSleeping;
+    std::atomic<uint32_t> spaceSignal;
+    std::atomic<uint32_t> closed;
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> readerSleeping;
+    std::atomic<uint32_t> dataSignal;
+};
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    std::atomic<uint32_t> ready;
+    std::atomic<uint32_t> peerAttached;
+    // 0: server to client, 1: client to server.
+    RingHeader rings[2];
+};
+
+static_assert(sizeof(SegmentHeader) <= kHeaderSpace, "header must fit its page");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+void CpuRelax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Spinning only pays off when the peer can run at the same time.
+unsigned SpinLimit() {
+    static const unsigned limit = std::thread::hardware_concurrency() > 1 ? 20000 : 0;
+    return limit;
+}
+
+// Sleeps until *word no longer holds `expected`, a wake arrives or the
+// timeout passes; spurious returns are fine.
+void SleepOn(std::atomic<uint32_t>* word, uint32_t expected, void* event, int timeoutMs) {
+#if defined(__linux__)
+    (void)event;
+    timespec timeout;
+    timespec* timeoutPointer = nullptr;
+    if (timeoutMs >= 0) {
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        timeoutPointer = &timeout;
+    }
+    // Not FUTEX_PRIVATE: the word is shared with another process.
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, timeoutPointer,
+            nullptr, 0);
+#elif defined(_WIN32)
+    (void)word;
+    (void)expected;
+    WaitForSingleObject(event, timeoutMs < 0 ? INFINITE : static_cast<DWORD>(timeoutMs));
+#else
+    (void)event;
+    if (word->load(std::memory_order_acquire) == expected && timeoutMs != 0) {
+        usleep(50);
+    }
+#endif
+}
+
+void WakeOn(std::atomic<uint32_t>* word, void* event) {
+    word->fetch_add(1, std::memory_order_release);
+#if defined(__linux__)
+    (void)event;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#elif defined(_WIN32)
+    SetEvent(event);
+#else
+    (void)event;
+#endif
+}
+
+// Spins, then announces itself through `sleeping` and sleeps on `signal`
+// until ready() holds or the timeout passes.
+template <typename Ready>
+bool WaitUntil(Ready ready, std::atomic<uint32_t>* sleeping, std::atomic<uint32_t>* signal,
+               void* event, int timeoutMs) {
+    for (unsigned i = 0; i < SpinLimit(); i++) {
+        if (ready()) {
+            return true;
+        }
+        CpuRelax();
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        uint32_t sequence = signal->load(std::memory_order_acquire);
+        if (sleeping != nullptr) {
+            sleeping->store(1, std::memory_order_relaxed);
+        }
+        // Pairs with the fence the waking side runs between publishing and
+        // checking `sleeping`.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ready()) {
+            break;
+        }
+        int remaining = -1;
+        if (timeoutMs >= 0) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) {
+                break;
+            }
+            remaining = static_cast<int>(left.count());
+        }
+        SleepOn(signal, sequence, event, remaining);
+    }
+    if (sleeping != nullptr) {
+        sleeping->store(0, std::memory_order_relaxed);
+    }
+    return ready();
+}
+
+size_t RoundCapacity(size_t capacity) {
+    size_t rounded = kMinCapacity;
+    while (rounded < capacity) {
+        rounded *= 2;
+    }
+    return rounded;
+}
+
+}  // namespace
+
+struct ShmChannel::Mapping {
+    void* base = nullptr;
+    size_t size = 0;
+    bool owner = false;
+    std::string name;
+#ifdef _WIN32
+    HANDLE file = NULL;
+    // Per ring: data, space; then the peer-attached event.
+    HANDLE events[5] = {};
+#endif
+
+    SegmentHeader* header() const { return static_cast<SegmentHeader*>(base); }
+
+    ~Mapping() {
+#ifdef _WIN32
+        if (base != nullptr) {
+            UnmapViewOfFile(base);
+        }
+        if (file != NULL) {
+            CloseHandle(file);
+        }
+        for (HANDLE event : events) {
+            if (event != NULL) {
+                CloseHandle(event);
+            }
+        }
+#else
+        if (base != nullptr) {
+            munmap(base, size);
+        }
+        if (owner) {
+            shm_unlink(name.c_str());
+        }
+#endif
+    }
+};
+
+struct ShmChannel::RingView {
+    RingHeader* ring = nullptr;
+    char* data = nullptr;
+    uint64_t capacity = 0;
+    void* dataEvent = nullptr;
+    void* spaceEvent = nullptr;
+    // Writer: end of committed records. Reader: end of consumed records.
+    uint64_t cursor = 0;
+    // Writer: last published head. Reader: last released tail.
+    uint64_t shared = 0;
+    // Writer: last seen tail. Reader: last seen head.
+    uint64_t cached = 0;
+    size_t reserved = 0;
+    // Reader: the peer broke the ring; see Next().
+    bool corrupt = false;
+};
+
+ShmChannel::ShmChannel() = default;
+
+ShmChannel::~ShmChannel() {
+    if (writer_) {
+        Close();
+    }
+}
+
+namespace {
+
+#ifdef _WIN32
+std::wstring KernelObjectName(const std::string& name, const char* suffix) {
+    std::string full = "Local\\" + name + suffix;
+    return std::wstring(full.begin(), full.end());
+}
+#endif
+
+}  // namespace
+
+std::unique_ptr<ShmChannel> ShmChannel::Create(const std::string& name, size_t capacity,
+                                               std::string* error) {
+    return Create(name, capacity, std::string(), error);
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::Create(const std::string& name, size_t capacity,
+                                               const std::string& appContainerSid,
+                                               std::string* error) {
+    std::unique_ptr<ShmChannel> channel(new ShmChannel());
+    channel->server_ = true;
+    channel->mapping_.reset(new Mapping());
+    Mapping& mapping = *channel->mapping_;
+    capacity = RoundCapacity(capacity);
+    mapping.size = kHeaderSpace + 2 * capacity;
+#ifdef _WIN32
+    SharedObjectSecurity security;
+    std::wstring objectName;
+    if (!security.Init(appContainerSid, error) ||
+        !SharedObjectName(name, appContainerSid, &objectName, error)) {
+        return nullptr;
+    }
+    mapping.file = CreateFileMappingW(INVALID_HANDLE_VALUE, security.Attributes(), PAGE_READWRITE,
+                                      static_cast<DWORD>(static_cast<uint64_t>(mapping.size) >> 32),
+                                      static_cast<DWORD>(mapping.size), objectName.c_str());
+    if (mapping.file == NULL || GetLastError() == ERROR_ALREADY_EXISTS) {
+        *error = "CreateFileMapping failed for " + name + " with error " +
+                 std::to_string(GetLastError());
+        return nullptr;
+    }
+    for (int i = 0; i < 5; i++) {
+        std::wstring eventName = objectName + L"." + std::to_wstring(i);
+        mapping.events[i] = CreateEventW(security.Attributes(), FALSE, FALSE, eventName.c_str());
+        if (mapping.events[i] == NULL) {
+            *error = "CreateEvent failed with error " + std::to_string(GetLastError());
+            return nullptr;
+        }
+    }
+    mapping.base = MapViewOfFile(mapping.file, FILE_MAP_ALL_ACCESS, 0, 0, mapping.size);
+    if (mapping.base == NULL) {
+        mapping.base = nullptr;
+        *error = "MapViewOfFile failed with error " + std::to_string(GetLastError());
+        return nullptr;
+    }
+#else
+    (void)appContainerSid;
+    mapping.name = "/" + name;
+    // A segment left behind by a server that crashed is replaced.
+    shm_unlink(mapping.name.c_str());
+    int fd = shm_open(mapping.name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        *error = "shm_open failed for " + name + ": " + strerror(errno);
+        return nullptr;
+    }
+    mapping.owner = true;
+    if (ftruncate(fd, static_cast<off_t>(mapping.size)) != 0) {
+        *error = std::string("ftruncate failed: ") + strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    void* base = mmap(nullptr, mapping.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        *error = std::string("mmap failed: ") + strerror(errno);
+        return nullptr;
+    }
+    mapping.base = base;
+#endif
+
+    SegmentHeader* header = new (mapping.base) SegmentHeader();
+    header->magic = kMagic;
+    header->version = kVersion;
+    header->capacity = capacity;
+    channel->writer_.reset(new RingView());
+    channel->reader_.reset(new RingView());
+    for (int i = 0; i < 2; i++) {
+        RingView& view = i == 0 ? *channel->writer_ : *channel->reader_;
+        view.ring = &header->rings[i];
+        view.data = static_cast<char*>(mapping.base) + kHeaderSpace + i * capacity;
+        view.capacity = capacity;
+#ifdef _WIN32
+        view.dataEvent = mapping.events[2 * i];
+        view.spaceEvent = mapping.events[2 * i + 1];
+#endif
+    }
+    header->ready.store(1, std::memory_order_release);
+    return channel;
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::Open(const std::string& name, std::string* error) {
+    std::unique_ptr<ShmChannel> channel(new ShmChannel());
+    channel->mapping_.reset(new Mapping());
+    Mapping& mapping = *channel->mapping_;
+#ifdef _WIN32
+    mapping.file = OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, KernelObjectName(name, "").c_str());
+    if (mapping.file == NULL) {
+        *error = "No channel named " + name;
+        return nullptr;
+    }
+    for (int i = 0; i < 5; i++) {
+        std::string suffix = "." + std::to_string(i);
+        mapping.events[i] = OpenEventW(EVENT_MODIFY_STATE | SYNCHRONIZE, FALSE,
+                                       KernelObjectName(name, suffix.c_str()).c_str());
+        if (mapping.events[i] == NULL) {
+            *error = "OpenEvent failed with error " + std::to_string(GetLastError());
+            return nullptr;
+        }
+    }
+    mapping.base = MapViewOfFile(mapping.file, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (mapping.base == NULL) {
+        mapping.base = nullptr;
+        *error = "MapViewOfFile failed with error " + std::to_string(GetLastError());
+        return nullptr;
+    }
+    MEMORY_BASIC_INFORMATION info;
+    VirtualQuery(mapping.base, &info, sizeof(info));
+    mapping.size = info.RegionSize;
+#else
+    mapping.name = "/" + name;
+    int fd = shm_open(mapping.name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        *error = errno == ENOENT ? "No channel named " + name
+                                 : "shm_open failed for " + name + ": " + strerror(errno);
+        return nullptr;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < kHeaderSpace) {
+        *error = "Channel " + name + " is not initialised";
+        close(fd);
+        return nullptr;
+    }
+    mapping.size = static_cast<size_t>(info.st_size);
+    void* base = mmap(nullptr, mapping.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        *error = std::string("mmap failed: ") + strerror(errno);
+        return nullptr;
+    }
+    mapping.base = base;
+#endif
+
+    SegmentHeader* header = mapping.header();
+    if (header->ready.load(std::memory_order_acquire) != 1 || header->magic != kMagic ||
+        header->version != kVersion || kHeaderSpace + 2 * header->capacity > mapping.size) {
+        *error = "Channel " + name + " is not initialised";
+        return nullptr;
+    }
+    uint64_t capacity = header->capacity;
+    channel->writer_.reset(new RingView());
+    channel->reader_.reset(new RingView());
+    for (int i = 0; i < 2; i++) {
+        RingView& view = i == 1 ? *channel->writer_ : *channel->reader_;
+        view.ring = &header->rings[i];
+        view.data = static_cast<char*>(mapping.base) + kHeaderSpace + i * capacity;
+        view.capacity = capacity;
+#ifdef _WIN32
+        view.dataEvent = mapping.events[2 * i];
+        view.spaceEvent = mapping.events[2 * i + 1];
+#endif
+    }
+    // Resume where the previous client stopped, if there was one.
+    channel->writer_->cursor = channel->writer_->shared = channel->writer_->cached =
+        channel->writer_->ring->head.load(std::memory_order_acquire);
+    channel->reader_->cursor = channel->reader_->shared = channel->reader_->cached =
+        channel->reader_->ring->tail.load(std::memory_order_acquire);
+    void* peerEvent = nullptr;
+#ifdef _WIN32
+    peerEvent = mapping.events[4];
+#endif
+    WakeOn(&header->peerAttached, peerEvent);
+    return channel;
+}
+
+bool ShmChannel::WaitForPeer(int timeoutMs) {
+    SegmentHeader* header = mapping_->header();
+    void* peerEvent = nullptr;
+#ifdef _WIN32
+    peerEvent = mapping_->events[4];
+#endif
+    return WaitUntil([header] { return header->peerAttached.load(std::memory_order_acquire) != 0; },
+                     nullptr, &header->peerAttached, peerEvent, timeoutMs);
+}
+
+size_t ShmChannel::MaxMessage() const {
+    // Half the ring, so a record plus the wrap padding before it always fits
+    // once the reader has caught up.
+    return writer_->capacity / 2 - sizeof(RecordHeader);
+}
+
+void* ShmChannel::Reserve(size_t length, int timeoutMs, ChannelStatus* status) {
+    RingView& view = *writer_;
+    if (length > MaxMessage()) {
+        *status = ChannelStatus::kTooLarge;
+        return nullptr;
+    }
+    size_t need = RecordSize(length);
+    uint64_t offset = view.cursor & (view.capacity - 1);
+    uint64_t contiguous = view.capacity - offset;
+    uint64_t total = need <= contiguous ? need : contiguous + need;
+    if (view.cursor + total - view.cached > view.capacity) {
+        view.cached = view.ring->tail.load(std::memory_order_acquire);
+        if (view.cursor + total - view.cached > view.capacity) {
+            // The reader cannot free space for records it has not been shown.
+            Flush();
+            auto hasSpace = [&view, total] {
+                view.cached = view.ring->tail.load(std::memory_order_acquire);
+                return view.cursor + total - view.cached <= view.capacity;
+            };
+            if (!WaitUntil(hasSpace, &view.ring->writerSleeping, &view.ring->spaceSignal,
+                           view.spaceEvent, timeoutMs)) {
+                *status = ChannelStatus::kTimeout;
+                return nullptr;
+            }
+        }
+    }
+    if (need > contiguous) {
+        RecordHeader* wrap = reinterpret_cast<RecordHeader*>(view.data + offset);
+        wrap->length = 0;
+        wrap->kind = kRecordWrap;
+        view.cursor += contiguous;
+    }
+    RecordHeader* record =
+        reinterpret_cast<RecordHeader*>(view.data + (view.cursor & (view.capacity - 1)));
+    record->length = static_cast<uint32_t>(length);
+    record->kind = kRecordMessage;
+    view.reserved = need;
+    *status = ChannelStatus::kOk;
+    return record + 1;
+}
+
+void ShmChannel::Commit() {
+    writer_->cursor += writer_->reserved;
+    writer_->reserved = 0;
+}
+
+void ShmChannel::Flush() {
+    RingView& view = *writer_;
+    if (view.cursor == view.shared) {
+        return;
+    }
+    view.ring->head.store(view.cursor, std::memory_order_release);
+    view.shared = view.cursor;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (view.ring->readerSleeping.load(std::memory_order_relaxed) != 0) {
+        WakeOn(&view.ring->dataSignal, view.dataEvent);
+    }
+}
+
+ChannelStatus ShmChannel::Send(const void* data, size_t length, int timeoutMs) {
+    ChannelStatus status;
+    void* target = Reserve(length, timeoutMs, &status);
+    if (target == nullptr) {
+        return status;
+    }
+    memcpy(target, data, length);
+    Commit();
+    Flush();
+    return ChannelStatus::kOk;
+}
+
+void ShmChannel::Close() {
+    Flush();
+    RingView& view = *writer_;
+    view.ring->closed.store(1, std::memory_order_release);
+    WakeOn(&view.ring->dataSignal, view.dataEvent);
+}
+
+const void* ShmChannel::Next(size_t* length, int timeoutMs, ChannelStatus* status) {
+    RingView& view = *reader_;
+    if (view.corrupt) {
+        *status = ChannelStatus::kCorrupt;
+        return nullptr;
+    }
+    if (view.cursor - view.shared >= view.capacity / 4) {
+        Release();
+    }
+    // Everything the peer wrote is checked before it is used: a head that
+    // is behind us or more than a ring ahead of the tail, and records that
+    // are larger than any Reserve() allows or run past the head or the end
+    // of the ring.
+    auto corrupt = [&view, status] {
+        view.corrupt = true;
+        *status = ChannelStatus::kCorrupt;
+        return nullptr;
+    };
+    auto loadHead = [&view] {
+        view.cached = view.ring->head.load(std::memory_order_acquire);
+        return view.cached - view.shared <= view.capacity &&
+               view.cached - view.shared >= view.cursor - view.shared;
+    };
+    for (;;) {
+        if (view.cursor == view.cached && !loadHead()) {
+            return corrupt();
+        }
+        if (view.cursor == view.cached) {
+            Release();
+            // closed is set after the final flush, so once it is seen the
+            // head read below is final.
+            auto readable = [&view] {
+                return view.ring->closed.load(std::memory_order_acquire) != 0 ||
+                       view.ring->head.load(std::memory_order_acquire) != view.cursor;
+            };
+            if (!WaitUntil(readable, &view.ring->readerSleeping, &view.ring->dataSignal,
+                           view.dataEvent, timeoutMs)) {
+                *status = ChannelStatus::kTimeout;
+                return nullptr;
+            }
+            if (!loadHead()) {
+                return corrupt();
+            }
+            if (view.cursor == view.cached) {
+                *status = ChannelStatus::kClosed;
+                return nullptr;
+            }
+        }
+        uint64_t offset = view.cursor & (view.capacity - 1);
+        const char* record = view.data + offset;
+        // One copy of the header, so the peer cannot change it between the
+        // checks and the use.
+        RecordHeader header;
+        memcpy(&header, record, sizeof(header));
+        uint64_t available = view.cached - view.cursor;
+        if (header.kind == kRecordWrap) {
+            if (view.capacity - offset > available) {
+                return corrupt();
+            }
+            view.cursor += view.capacity - offset;
+            continue;
+        }
+        size_t size = RecordSize(header.length);
+        if (header.kind != kRecordMessage || header.length > MaxMessage() || size > available ||
+            size > view.capacity - offset) {
+            return corrupt();
+        }
+        *length = header.length;
+        view.cursor += size;
+        *status = ChannelStatus::kOk;
+        return record + sizeof(header);
+    }
+}
+
+void ShmChannel::Release() {
+    RingView& view = *reader_;
+    if (view.cursor == view.shared) {
+        return;
+    }
+    view.ring->tail.store(view.cursor, std::memory_order_release);
+    view.shared = view.cursor;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (view.ring->writerSleeping.load(std::memory_order_relaxed) != 0) {
+        WakeOn(&view.ring->spaceSignal, view.spaceEvent);
+    }
+}
+
+ChannelStatus ShmChannel::Receive(std::string* message, int timeoutMs) {
+    size_t length = 0;
+    ChannelStatus status;
+    const void* data = Next(&length, timeoutMs, &status);
+    if (data == nullptr) {
+        return status;
+    }
+    message->assign(static_cast<const char*>(data), length);
+    Release();
+    return ChannelStatus::kOk;
+}
+
+}  // namespace pipes
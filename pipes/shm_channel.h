@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Duplex message channel between the host and a sandboxed process over
+// shared memory, replacing the message-mode named pipe in pipe.py for
+// high-rate traffic (tensors, progress events).
+//
+// Each direction is a single-producer/single-consumer ring of framed
+// messages. Head and tail live on separate cache lines and are only ever
+// written by their owner, so a message costs a memcpy and one release store.
+// Writers append messages to a batch that becomes visible to the reader in
+// one Flush(); readers return everything they consumed in one Release().
+// A side that finds the ring empty (or full) spins briefly on multi-core
+// machines and then sleeps on a futex in the shared header (Linux), on a
+// named event (Windows), or polls elsewhere. Wakeups are only issued when
+// the other side has announced it is sleeping, so a busy stream makes no
+// syscalls at all.
+namespace pipes {
+
+enum class ChannelStatus {
+    kOk,
+    kTimeout,
+    // The peer closed its writing side and every message has been read.
+    kClosed,
+    kTooLarge,
+    // The peer wrote a head or record that cannot be right (a sandboxed
+    // peer controls its side of the segment); the channel stays unusable.
+    kCorrupt,
+};
+
+class ShmChannel {
+public:
+    ~ShmChannel();
+
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    // Server side: creates the named segment with two rings of `capacity`
+    // bytes each (rounded up to a power of two). The segment is removed when
+    // the server is destroyed.
+    static std::unique_ptr<ShmChannel> Create(const std::string& name, size_t capacity,
+                                              std::string* error);
+    // Same, for a client running in the AppContainer appContainerSid: on
+    // Windows the segment and its events are created in that container's
+    // object namespace, where the client's Open() looks them up, and with a
+    // DACL that lets it in (see shared_object.h). Ignored on POSIX.
+    static std::unique_ptr<ShmChannel> Create(const std::string& name, size_t capacity,
+                                              const std::string& appContainerSid,
+                                              std::string* error);
+    // Client side: attaches to a segment a server created.
+    static std::unique_ptr<ShmChannel> Open(const std::string& name, std::string* error);
+
+    // Server: waits for a client to attach, like ConnectNamedPipe.
+    bool WaitForPeer(int timeoutMs);
+
+    // Writing. Reserve() returns space for one message in the current batch,
+    // flushing the batch and waiting for the reader when the ring is full;
+    // fill it in place (no copy for large payloads) and Commit(). Nothing is
+    // visible to the reader until Flush().
+    void* Reserve(size_t length, int timeoutMs, ChannelStatus* status);
+    void Commit();
+    void Flush();
+    ChannelStatus Send(const void* data, size_t length, int timeoutMs);
+    // Marks this side's writing ring closed; the peer reads what is left and
+    // then gets kClosed.
+    void Close();
+
+    // Reading. Next() returns the next message, valid until the following
+    // Next() or Release(). Release() hands everything consumed so far back
+    // to the writer at once; Next() does so itself when the ring is empty
+    // and every quarter ring, so a writer waiting for space is not held up
+    // by a long batch.
+    const void* Next(size_t* length, int timeoutMs, ChannelStatus* status);
+    void Release();
+    ChannelStatus Receive(std::string* message, int timeoutMs);
+
+    // Largest message the rings accept.
+    size_t MaxMessage() const;
+
+private:
+    struct Mapping;
+    struct RingView;
+
+    ShmChannel();
+
+    std::unique_ptr<Mapping> mapping_;
+    std::unique_ptr<RingView> writer_;
+    std::unique_ptr<RingView> reader_;
+    bool server_ = false;
+};
+
+}  // namespace pipes
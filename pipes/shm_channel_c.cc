@@ -0,0 +1,87 @@
+// C interface to ShmChannel for the ctypes binding in shm_pipe.py. Status
+// codes are the ChannelStatus values: 0 ok, 1 timeout, 2 closed, 3 too large.
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "shm_channel.h"
+
+#ifdef _WIN32
+#define SHM_EXPORT extern "C" __declspec(dllexport)
+#else
+#define SHM_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+namespace {
+
+void CopyError(const std::string& error, char* buffer, size_t size) {
+    if (buffer != nullptr && size > 0) {
+        size_t length = error.size() < size - 1 ? error.size() : size - 1;
+        memcpy(buffer, error.data(), length);
+        buffer[length] = '\0';
+    }
+}
+
+pipes::ShmChannel* Channel(void* handle) { return static_cast<pipes::ShmChannel*>(handle); }
+
+}  // namespace
+
+SHM_EXPORT void* shm_channel_create(const char* name, size_t capacity, char* error,
+                                    size_t errorSize) {
+    std::string message;
+    std::unique_ptr<pipes::ShmChannel> channel = pipes::ShmChannel::Create(name, capacity, &message);
+    CopyError(message, error, errorSize);
+    return channel.release();
+}
+
+// shm_channel_create for a client in the AppContainer sid (S-1-15-2-...).
+SHM_EXPORT void* shm_channel_create_for(const char* name, size_t capacity, const char* sid,
+                                        char* error, size_t errorSize) {
+    std::string message;
+    std::unique_ptr<pipes::ShmChannel> channel =
+        pipes::ShmChannel::Create(name, capacity, sid, &message);
+    CopyError(message, error, errorSize);
+    return channel.release();
+}
+
+SHM_EXPORT void* shm_channel_open(const char* name, char* error, size_t errorSize) {
+    std::string message;
+    std::unique_ptr<pipes::ShmChannel> channel = pipes::ShmChannel::Open(name, &message);
+    CopyError(message, error, errorSize);
+    return channel.release();
+}
+
+SHM_EXPORT int shm_channel_wait_peer(void* handle, int timeoutMs) {
+    return Channel(handle)->WaitForPeer(timeoutMs) ? 1 : 0;
+}
+
+SHM_EXPORT int shm_channel_send(void* handle, const void* data, size_t length, int timeoutMs) {
+    return static_cast<int>(Channel(handle)->Send(data, length, timeoutMs));
+}
+
+SHM_EXPORT void* shm_channel_reserve(void* handle, size_t length, int timeoutMs, int* status) {
+    pipes::ChannelStatus result;
+    void* target = Channel(handle)->Reserve(length, timeoutMs, &result);
+    *status = static_cast<int>(result);
+    return target;
+}
+
+SHM_EXPORT void shm_channel_commit(void* handle) { Channel(handle)->Commit(); }
+
+SHM_EXPORT void shm_channel_flush(void* handle) { Channel(handle)->Flush(); }
+
+SHM_EXPORT const void* shm_channel_next(void* handle, size_t* length, int timeoutMs,
+                                        int* status) {
+    pipes::ChannelStatus result;
+    const void* data = Channel(handle)->Next(length, timeoutMs, &result);
+    *status = static_cast<int>(result);
+    return data;
+}
+
+SHM_EXPORT void shm_channel_release(void* handle) { Channel(handle)->Release(); }
+
+SHM_EXPORT void shm_channel_close(void* handle) { Channel(handle)->Close(); }
+
+SHM_EXPORT size_t shm_channel_max_message(void* handle) { return Channel(handle)->MaxMessage(); }
+
+SHM_EXPORT void shm_channel_destroy(void* handle) { delete Channel(handle); }
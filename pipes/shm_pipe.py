@@ -0,0 +1,226 @@
+"""Shared-memory counterpart of pipe.py, backed by the C++ ShmChannel.
+
+The native library (libshmchannel.so / shmchannel.dll, built by build.ps1) is
+looked up in $SHM_CHANNEL_LIBRARY, next to this file and in ./out.
+
+    python shm_pipe.py s      # server: sends messages 0..9
+    python shm_pipe.py c      # client: prints them until the server closes
+
+Messages are bytes. For large payloads (tensors) reserve() hands out a
+writable memoryview into the ring, so the data is written once, in place.
+"""
+import ctypes
+import os
+import sys
+import time
+
+OK, TIMEOUT, CLOSED, TOO_LARGE, CORRUPT = range(5)
+CHANNEL_NAME = "Foo"
+
+
+class ChannelClosed(Exception):
+    pass
+
+
+def _load_library():
+    names = ["shmchannel.dll"] if os.name == "nt" else ["libshmchannel.so", "libshmchannel.dylib"]
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = []
+    if os.environ.get("SHM_CHANNEL_LIBRARY"):
+        candidates.append(os.environ["SHM_CHANNEL_LIBRARY"])
+    for directory in (here, os.path.join(here, "out")):
+        candidates.extend(os.path.join(directory, name) for name in names)
+    for candidate in candidates:
+        if os.path.exists(candidate):
+            break
+    else:
+        raise OSError("shmchannel library not found; run pipes/build.ps1")
+
+    lib = ctypes.CDLL(candidate)
+    handle, size_t, c_int = ctypes.c_void_p, ctypes.c_size_t, ctypes.c_int
+    lib.shm_channel_create.argtypes = [ctypes.c_char_p, size_t, ctypes.c_char_p, size_t]
+    lib.shm_channel_create.restype = handle
+    lib.shm_channel_create_for.argtypes = [ctypes.c_char_p, size_t, ctypes.c_char_p,
+                                           ctypes.c_char_p, size_t]
+    lib.shm_channel_create_for.restype = handle
+    lib.shm_channel_open.argtypes = [ctypes.c_char_p, ctypes.c_char_p, size_t]
+    lib.shm_channel_open.restype = handle
+    lib.shm_channel_wait_peer.argtypes = [handle, c_int]
+    lib.shm_channel_send.argtypes = [handle, ctypes.c_char_p, size_t, c_int]
+    lib.shm_channel_reserve.argtypes = [handle, size_t, c_int, ctypes.POINTER(c_int)]
+    lib.shm_channel_reserve.restype = handle
+    lib.shm_channel_next.argtypes = [handle, ctypes.POINTER(size_t), c_int,
+                                     ctypes.POINTER(c_int)]
+    lib.shm_channel_next.restype = handle
+    lib.shm_channel_max_message.argtypes = [handle]
+    lib.shm_channel_max_message.restype = size_t
+    for name in ("commit", "flush", "release", "close", "destroy"):
+        getattr(lib, "shm_channel_" + name).argtypes = [handle]
+        getattr(lib, "shm_channel_" + name).restype = None
+    return lib
+
+
+_lib = None
+
+
+def _library():
+    global _lib
+    if _lib is None:
+        _lib = _load_library()
+    return _lib
+
+
+class ShmChannel:
+    """One end of a duplex channel. Timeouts are in seconds; None waits forever."""
+
+    def __init__(self, handle):
+        self._handle = handle
+        self._length = ctypes.c_size_t()
+        self._status = ctypes.c_int()
+
+    @classmethod
+    def create(cls, name, capacity=4 << 20, app_container_sid=None):
+        """Creates the server end. Pass the SID of the AppContainer the client
+        runs in (Windows) so it can open the channel."""
+        error = ctypes.create_string_buffer(256)
+        if app_container_sid:
+            handle = _library().shm_channel_create_for(name.encode(), capacity,
+                                                       app_container_sid.encode(), error,
+                                                       len(error))
+        else:
+            handle = _library().shm_channel_create(name.encode(), capacity, error, len(error))
+        if not handle:
+            raise OSError(error.value.decode())
+        return cls(handle)
+
+    @classmethod
+    def open(cls, name):
+        error = ctypes.create_string_buffer(256)
+        handle = _library().shm_channel_open(name.encode(), error, len(error))
+        if not handle:
+            raise FileNotFoundError(error.value.decode())
+        return cls(handle)
+
+    @staticmethod
+    def _ms(timeout):
+        return -1 if timeout is None else int(timeout * 1000)
+
+    def wait_for_peer(self, timeout=None):
+        return bool(_lib.shm_channel_wait_peer(self._handle, self._ms(timeout)))
+
+    def send(self, data, timeout=None):
+        self._check(_lib.shm_channel_send(self._handle, bytes(data), len(data), self._ms(timeout)))
+
+    def send_many(self, messages, timeout=None):
+        """Sends a batch the reader sees at once, with a single wakeup."""
+        for data in messages:
+            view = self.reserve(len(data), timeout)
+            view[:] = data
+            _lib.shm_channel_commit(self._handle)
+        _lib.shm_channel_flush(self._handle)
+
+    def reserve(self, length, timeout=None):
+        """Writable memoryview for one message; call commit() and flush() after filling it."""
+        address = _lib.shm_channel_reserve(self._handle, length, self._ms(timeout),
+                                           ctypes.byref(self._status))
+        if not address:
+            self._check(self._status.value)
+        return memoryview((ctypes.c_char * length).from_address(address)).cast("B")
+
+    def commit(self):
+        _lib.shm_channel_commit(self._handle)
+
+    def flush(self):
+        _lib.shm_channel_flush(self._handle)
+
+    def recv(self, timeout=None):
+        """Next message as bytes; raises ChannelClosed once the peer closed and all was read."""
+        data = self._next(timeout)
+        _lib.shm_channel_release(self._handle)
+        return data
+
+    def recv_many(self, timeout=None):
+        """Every message available now (waiting for the first), copied out and released together."""
+        messages = [self._next(timeout)]
+        while True:
+            address = _lib.shm_channel_next(self._handle, ctypes.byref(self._length), 0,
+                                            ctypes.byref(self._status))
+            if not address:
+                break
+            messages.append(ctypes.string_at(address, self._length.value))
+        _lib.shm_channel_release(self._handle)
+        return messages
+
+    def _next(self, timeout):
+        address = _lib.shm_channel_next(self._handle, ctypes.byref(self._length),
+                                        self._ms(timeout), ctypes.byref(self._status))
+        if not address:
+            self._check(self._status.value)
+        return ctypes.string_at(address, self._length.value)
+
+    @property
+    def max_message(self):
+        return _lib.shm_channel_max_message(self._handle)
+
+    def close(self):
+        if self._handle:
+            _lib.shm_channel_destroy(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    @staticmethod
+    def _check(status):
+        if status == TIMEOUT:
+            raise TimeoutError("shared-memory channel timed out")
+        if status == CLOSED:
+            raise ChannelClosed()
+        if status == TOO_LARGE:
+            raise ValueError("message larger than the channel's ring")
+        if status == CORRUPT:
+            raise ChannelClosed("the peer corrupted the shared-memory channel")
+
+
+def pipe_server():
+    print("shm server")
+    with ShmChannel.create(CHANNEL_NAME) as channel:
+        print("waiting for client")
+        channel.wait_for_peer()
+        print("got client")
+        for count in range(10):
+            print(f"writing message {count}")
+            channel.send(str.encode(f"{count}"))
+        print("finished now")
+
+
+def pipe_client():
+    print("shm client")
+    while True:
+        try:
+            channel = ShmChannel.open(CHANNEL_NAME)
+            break
+        except FileNotFoundError:
+            print("no channel, trying again in a sec")
+            time.sleep(1)
+    with channel:
+        try:
+            while True:
+                for message in channel.recv_many():
+                    print(f"message: {message}")
+        except ChannelClosed:
+            print("channel closed, bye bye")
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print("need s or c as argument")
+    elif sys.argv[1] == "s":
+        pipe_server()
+    elif sys.argv[1] == "c":
+        pipe_client()
+    else:
+        print(f"no can do: {sys.argv[1]}")
@@ -14,6 +14,14 @@ $OutputFile = Join-Path -Path $outDir -ChildPath "Py-Package.msix"
 $CertName = "dproy-cert"
 $ManifestFile = Join-Path $scriptDir "src\AppxManifest.xml"
 $PackageName = "Py-Package"
+# Multithreaded replacement for MakeAppx, used when msix\build.ps1 has been run
+$MsixPack = Join-Path $scriptDir "..\msix\out\msixpack.exe"
+# Single-file build that runs from its own archive instead of unpacking into
+# a temp directory on every launch (msix\onefile.h), used when msix\build.ps1
+# has built the bootloader. onefilepack fails if the venv's Python is not
+# the version the bootloader was built against.
+$OnefilePack = Join-Path $scriptDir "..\msix\out\onefilepack.exe"
+$OnefileBoot = Join-Path $scriptDir "..\msix\out\onefile_boot.exe"
 
 
 
@@ -44,7 +52,11 @@ function Build-MsixPackage {
 
   try {
       # Create the MSIX package
-      & MakeAppx.exe pack /d $PackageDir /p $OutputFile /o
+      if (Test-Path $MsixPack) {
+          & $MsixPack pack /d $PackageDir /p $OutputFile /o
+      } else {
+          & MakeAppx.exe pack /d $PackageDir /p $OutputFile /o
+      }
       if ($LASTEXITCODE -ne 0) {
           Write-Error "MakeAppx failed with exit code $LASTEXITCODE"
           return $false
@@ -130,8 +142,23 @@ New-Item -ItemType Directory -Path $distDir
 Push-Location $scriptDir\out
 Write-Host "Activating venv"
 & $venvDir\Scripts\Activate.ps1
-Write-Host "Building pyinstaller exe"
-pyinstaller --onefile --name py-package $scriptDir\src\app.py --distpath $distDir
+if ((Test-Path $OnefilePack) -and (Test-Path $OnefileBoot)) {
+  Write-Host "Building onefile exe"
+  $python = (Get-Command python).Source
+  $basePrefix = & $python -c "import sys; print(sys.base_prefix)"
+  $sitePackages = & $python -c "import sysconfig; print(sysconfig.get_paths()['purelib'])"
+  # DLLs\ holds the stdlib's extension modules, the prefix itself
+  # pythonXY.dll and the VC runtime
+  $nativeArgs = @("/native", (Join-Path $basePrefix "DLLs"))
+  Get-ChildItem -Path $basePrefix -Filter "*.dll" | ForEach-Object { $nativeArgs += @("/native", $_.FullName) }
+  & $OnefilePack /boot $OnefileBoot /app $scriptDir\src\app.py /lib $sitePackages /stdlib (Join-Path $basePrefix "Lib") @nativeArgs /python $python /o (Join-Path $distDir "py-package.exe")
+  if ($LASTEXITCODE -ne 0) {
+    throw "onefilepack failed with exit code $LASTEXITCODE"
+  }
+} else {
+  Write-Host "Building pyinstaller exe"
+  pyinstaller --onefile --name py-package $scriptDir\src\app.py --distpath $distDir
+}
 deactivate
 Pop-Location
 
@@ -115,6 +115,24 @@ Remove-Item -Recurse -Force $outDir
 New-Item -ItemType Directory -Path $outDir
 New-Item -ItemType Directory -Path $distDir
 
+# --- Launch table ---
+# launch.exe selects what to start from a table generated out of the
+# manifest (see gen_launch_table.py), so it reads no XML at startup and an
+# application renamed in the manifest fails here rather than at launch.
+# Each target is the command line launch.exe runs for that application.
+Write-Host "Generating the launch table..."
+$genDir = Join-Path $outDir "gen"
+New-Item -ItemType Directory -Force -Path $genDir | Out-Null
+$LaunchTargets = @(
+    'App=C:\ProgramData\{PackageFamilyName}\eomfy-env\Scripts\python.exe C:\ProgramData\{PackageFamilyName}\ComfyUI\main.py'
+)
+$targetArgs = $LaunchTargets | ForEach-Object { "--target"; $_ }
+& python (Join-Path $scriptDir "gen_launch_table.py") $ManifestFile (Join-Path $genDir "launch_table.h") @targetArgs
+if ($LASTEXITCODE -ne 0) {
+    Write-Error "Failed to generate the launch table (Exit code: $LASTEXITCODE)"
+    exit 1
+}
+
 # --- C++ Compilation ---
 Write-Host "Compiling C++ source files..."
 $sourceFilesToCompile = @(
@@ -123,6 +141,18 @@ $sourceFilesToCompile = @(
     'winrt-app' # Add winrt-app to the list
 )
 
+# Shared sources linked into the programs that use them; launch supervises
+# the server it starts (see ..\sandbox\supervisor.h). $env:SANDBOX_TRACE
+# builds in launch --trace (..\sandbox\trace.h).
+$sandboxDir = Join-Path $scriptDir "..\sandbox"
+$ExtraSources = @{
+    'launch' = @("supervisor.cc", "launcher.cc", "runtime_env.cc", "grant_plan.cc", "grant_backend.cc", "trace.cc")
+}
+$traceFlags = @()
+if ($env:SANDBOX_TRACE) {
+    $traceFlags = @("/DSANDBOX_TRACE")
+}
+
 foreach ($baseName in $sourceFilesToCompile) {
     $sourcePath = Join-Path $scriptDir "src\$($baseName).cc"
     $outputPath = Join-Path $distDir "$($baseName).exe"
@@ -140,7 +170,12 @@ foreach ($baseName in $sourceFilesToCompile) {
         $compilerFlags += "-I $windowsSdkDir"
     }
     
-    & cl /std:c++17 /EHsc /LIBPATH:$windowsSdkDir windowsapp.lib $sourcePath -o $outputPath @compilerFlags
+    $extra = @()
+    if ($ExtraSources.ContainsKey($baseName)) {
+        $extra = $ExtraSources[$baseName] | ForEach-Object { Join-Path $sandboxDir $_ }
+    }
+    
+    & cl /std:c++17 /EHsc @traceFlags /I$genDir /LIBPATH:$windowsSdkDir windowsapp.lib $sourcePath @extra -o $outputPath @compilerFlags
     
     if ($LASTEXITCODE -ne 0) {
         Write-Error "Failed to compile $baseName.cc (Exit code: $LASTEXITCODE)"
@@ -165,6 +200,10 @@ Copy-Item -Path $scriptDir\..\Assets -Destination $distDir -Recurse
 Write-Host "Copying app.py"
 Copy-Item -Path $scriptDir\src\app.py -Destination $distDir
 
+# A traced launch.exe puts this import hook on the server's PYTHONPATH
+Write-Host "Copying trace_hook"
+Copy-Item -Path $scriptDir\..\sandbox\trace_hook -Destination $distDir -Recurse
+
 Write-Host "Activating Windows SDK"
 . "..\setup-sdk.ps1"
 Update-ManifestVersion -ManifestFile $ManifestFile
@@ -0,0 +1,143 @@
+"""Generates launch_table.h, the launcher's constexpr view of AppxManifest.xml.
+
+Usage:
+    gen_launch_table.py <AppxManifest.xml> <launch_table.h> [--target <Id>=<command>]...
+
+Every <Application> becomes a LaunchEntry (see src/launch_entry.h) with its
+executable, entry point, trust level, runtime behavior and execution
+aliases. --target gives the command line the launcher starts for an
+application; {PackageFamilyName} in it is replaced with the family name
+computed from the manifest's Identity, so paths under the package's
+ProgramData directory follow the publisher. A --target for an Id the
+manifest does not have, or an alias claimed by two applications, is an
+error, so the launcher and the manifest cannot drift apart.
+"""
+import argparse
+import hashlib
+import sys
+import xml.etree.ElementTree as ElementTree
+
+FOUNDATION = "http://schemas.microsoft.com/appx/manifest/foundation/windows10"
+# TrustLevel and RuntimeBehavior were introduced in uap10 and are also
+# accepted from uap18, which added the isolated-Win32 values.
+RUNTIME_NAMESPACES = [
+    "http://schemas.microsoft.com/appx/manifest/uap/windows10/18",
+    "http://schemas.microsoft.com/appx/manifest/uap/windows10/10",
+]
+
+TRUST_LEVELS = {
+    None: "kUnspecified",
+    "mediumIL": "kMediumIL",
+    "appContainer": "kAppContainer",
+}
+RUNTIME_BEHAVIORS = {
+    None: "kUnspecified",
+    "packagedClassicApp": "kPackagedClassicApp",
+    "win32App": "kWin32App",
+    "appSilo": "kAppSilo",
+}
+
+
+def publisher_id(publisher):
+    """The 13-character publisher hash of a package family name: the first
+    8 bytes of SHA-256 over the UTF-16LE publisher, in Crockford base32."""
+    alphabet = "0123456789abcdefghjkmnpqrstvwxyz"
+    digest = hashlib.sha256(publisher.encode("utf-16-le")).digest()[:8]
+    bits = int.from_bytes(digest, "big") << 1  # 64 bits padded to 65
+    return "".join(alphabet[(bits >> (5 * (12 - i))) & 31] for i in range(13))
+
+
+def runtime_attribute(element, name):
+    for namespace in RUNTIME_NAMESPACES:
+        value = element.get("{%s}%s" % (namespace, name))
+        if value is not None:
+            return value
+    return None
+
+
+def local_name(tag):
+    return tag.rsplit("}", 1)[-1]
+
+
+def narrow_literal(text):
+    return '"' + text.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def wide_literal(text):
+    return "L" + narrow_literal(text)
+
+
+def identifier(text):
+    return "".join(c if c.isalnum() else "_" for c in text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("manifest")
+    parser.add_argument("output")
+    parser.add_argument("--target", action="append", default=[], metavar="ID=COMMAND")
+    options = parser.parse_args()
+
+    root = ElementTree.parse(options.manifest).getroot()
+    identity = root.find("{%s}Identity" % FOUNDATION)
+    if identity is None:
+        sys.exit("%s: no <Identity>" % options.manifest)
+    family = "%s_%s" % (identity.get("Name"), publisher_id(identity.get("Publisher")))
+
+    applications = root.findall("{%s}Applications/{%s}Application" % (FOUNDATION, FOUNDATION))
+    ids = [application.get("Id") for application in applications]
+    targets = {}
+    for target in options.target:
+        app_id, separator, command = target.partition("=")
+        if not separator or not command:
+            sys.exit("--target needs <Id>=<command>: %s" % target)
+        if app_id not in ids:
+            sys.exit("%s has no Application Id=\"%s\" (it has %s)"
+                     % (options.manifest, app_id, ", ".join(ids)))
+        targets[app_id] = command.replace("{PackageFamilyName}", family)
+
+    lines = [
+        "// Generated by gen_launch_table.py from %s; do not edit." % options.manifest.replace("\\", "/"),
+        "#pragma once",
+        "",
+        '#include "launch_entry.h"',
+        "",
+        "constexpr std::string_view kPackageFamilyName = %s;" % narrow_literal(family),
+        "",
+    ]
+    entries = []
+    owners = {}
+    for application in applications:
+        app_id = application.get("Id")
+        aliases = [element.get("Alias") for element in application.iter()
+                   if local_name(element.tag) == "ExecutionAlias" and element.get("Alias")]
+        for alias in aliases:
+            if alias.lower() in owners:
+                sys.exit("Alias %s belongs to both %s and %s" % (alias, owners[alias.lower()], app_id))
+            owners[alias.lower()] = app_id
+        trust = runtime_attribute(application, "TrustLevel")
+        behavior = runtime_attribute(application, "RuntimeBehavior")
+        if trust not in TRUST_LEVELS or behavior not in RUNTIME_BEHAVIORS:
+            sys.exit("Application %s: unknown TrustLevel %s or RuntimeBehavior %s"
+                     % (app_id, trust, behavior))
+        alias_array = "nullptr"
+        if aliases:
+            alias_array = "k%sAliases" % identifier(app_id)
+            lines.append("constexpr std::string_view %s[] = {%s};"
+                         % (alias_array, ", ".join(narrow_literal(a) for a in aliases)))
+        entries.append(
+            "    {%s, %s, %s, TrustLevel::%s, RuntimeBehavior::%s, %s, %d,\n     %s},"
+            % (narrow_literal(app_id), narrow_literal(application.get("Executable", "")),
+               narrow_literal(application.get("EntryPoint", "")), TRUST_LEVELS[trust],
+               RUNTIME_BEHAVIORS[behavior], alias_array, len(aliases),
+               wide_literal(targets.get(app_id, ""))))
+    if not entries:
+        sys.exit("%s has no applications" % options.manifest)
+    lines += ["", "constexpr LaunchEntry kLaunchEntries[] = {"] + entries + ["};", ""]
+
+    with open(options.output, "w", newline="\n") as output:
+        output.write("\n".join(lines))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,9 +1,27 @@
 #include <windows.h>
+#include <appmodel.h>
 #include <stdio.h>
+#include <string.h>
 #include <fstream>
 #include <string>
+#include <string_view>
 #include <iostream>
 
+#include "../../sandbox/supervisor.h"
+#include "../../sandbox/trace.h"
+// Generated from AppxManifest.xml at build time (see gen_launch_table.py).
+#include "launch_table.h"
+
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "psapi.lib")
+#pragma comment(lib, "userenv.lib")
+#pragma comment(lib, "advapi32.lib")
+
+// ComfyUI's default port, probed to tell a hung server from a busy one.
+const int kComfyPort = 8188;
+
+sandbox::Supervisor* g_supervisor = nullptr;
+
 void PrintLastError() {
     DWORD error = GetLastError();
     if (error == 0) return;
@@ -27,15 +45,137 @@ void PrintLastError() {
     }
 }
 
-int main() {
-  STARTUPINFO si = { sizeof(si) };
+BOOL WINAPI HandleConsoleControl(DWORD) {
+  if (g_supervisor != nullptr) {
+    g_supervisor->Stop();
+  }
+  return TRUE;
+}
+
+// %LOCALAPPDATA%\MSIXPython\comfyui.prom (redirected into the package's
+// private store when packaged).
+std::string MetricsPath() {
+  char buffer[MAX_PATH];
+  DWORD length = GetEnvironmentVariableA("LOCALAPPDATA", buffer, MAX_PATH);
+  if (length == 0 || length >= MAX_PATH) {
+    return std::string();
+  }
+  std::string directory = std::string(buffer, length) + "\\MSIXPython";
+  CreateDirectoryA(directory.c_str(), NULL);
+  return directory + "\\comfyui.prom";
+}
+
+// Stays with the server instead of exiting: restarts it when it crashes
+// or stops answering on its port, and keeps its resource use in a metrics
+// file.
+int Supervise(const LaunchEntry& entry) {
+  sandbox::SupervisorOptions options;
+  options.restart = sandbox::RestartPolicy::kOnFailure;
+  options.healthPort = kComfyPort;
+  // The first start loads custom nodes and models.
+  options.startupSeconds = 300;
+  options.metricsPath = MetricsPath();
+
+  sandbox::LaunchCommand command;
+  command.commandLine.assign(entry.commandLine.data(), entry.commandLine.size());
+
+  sandbox::Supervisor supervisor(options, nullptr);
+  g_supervisor = &supervisor;
+  SetConsoleCtrlHandler(HandleConsoleControl, TRUE);
+  printf("Supervising %.*s: %ls\n", static_cast<int>(entry.id.size()), entry.id.data(),
+         command.commandLine.c_str());
+  if (!options.metricsPath.empty()) {
+    printf("Metrics: %s\n", options.metricsPath.c_str());
+  }
+  return supervisor.Run(command);
+}
+
+std::string_view FileName(std::string_view path) {
+  size_t slash = path.find_last_of("\\/");
+  return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+// The manifest entry this process runs as: --app <Id> when given, the
+// application id of its AUMID when packaged, else the alias or executable
+// it was started through.
+const LaunchEntry* SelectEntry(const char* appId, const char* argv0) {
+  TRACE_SPAN("Select application");
+  if (appId != nullptr) {
+    return FindLaunchEntryById(kLaunchEntries, appId);
+  }
+  wchar_t aumid[APPLICATION_USER_MODEL_ID_MAX_LENGTH];
+  UINT32 length = APPLICATION_USER_MODEL_ID_MAX_LENGTH;
+  if (GetCurrentApplicationUserModelId(&length, aumid) == ERROR_SUCCESS) {
+    char narrow[APPLICATION_USER_MODEL_ID_MAX_LENGTH];
+    int size = WideCharToMultiByte(CP_UTF8, 0, aumid, -1, narrow, sizeof(narrow), NULL, NULL);
+    std::string_view id(narrow, size > 0 ? size - 1 : 0);
+    size_t bang = id.find('!');
+    if (bang != std::string_view::npos && id.substr(0, bang) == kPackageFamilyName) {
+      return FindLaunchEntryById(kLaunchEntries, id.substr(bang + 1));
+    }
+  }
+  if (const LaunchEntry* entry = FindLaunchEntryByName(kLaunchEntries, FileName(argv0))) {
+    return entry;
+  }
+  char module[MAX_PATH];
+  DWORD size = GetModuleFileNameA(NULL, module, MAX_PATH);
+  if (size == 0 || size >= MAX_PATH) {
+    return nullptr;
+  }
+  return FindLaunchEntryByName(kLaunchEntries, FileName(std::string_view(module, size)));
+}
+
+int main(int argc, char* argv[]) {
+  STARTUPINFOW si = { sizeof(si) };
   PROCESS_INFORMATION pi;
+
+  // --detach: start the server and exit, as before. --app <Id> runs the
+  // entry of another application of the manifest. --command <line> runs
+  // <line> through the same path instead of a manifest entry; launch_bench
+  // times launch.exe with a probe that way. --trace <file.json> writes a
+  // Chrome trace of the launch and of the server's startup and imports once
+  // the supervisor exits (sandbox/trace.h; needs a -DSANDBOX_TRACE build).
+  bool detach = false;
+  const char* appId = nullptr;
+  const char* commandLine = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--detach") == 0) {
+      detach = true;
+    } else if (strcmp(argv[i], "--app") == 0 && i + 1 < argc) {
+      appId = argv[++i];
+    } else if (strcmp(argv[i], "--command") == 0 && i + 1 < argc) {
+      commandLine = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      std::string error;
+      if (!sandbox::StartTrace(argv[++i], &error)) {
+        printf("%s\n", error.c_str());
+        return 1;
+      }
+    }
+  }
+  LaunchEntry commandEntry = {};
+  std::wstring wideCommandLine;
+  if (commandLine != nullptr) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, commandLine, -1, nullptr, 0);
+    wideCommandLine.resize(length > 0 ? length - 1 : 0);
+    MultiByteToWideChar(CP_UTF8, 0, commandLine, -1, &wideCommandLine[0], length);
+    commandEntry.id = "--command";
+    commandEntry.commandLine = wideCommandLine;
+  }
+  const LaunchEntry* entry = commandLine != nullptr ? &commandEntry : SelectEntry(appId, argv[0]);
+  if (entry == nullptr || entry->commandLine.empty()) {
+    printf("No application of the manifest is launched through %s\n", argv[0]);
+    return 1;
+  }
+  if (!detach) {
+    return Supervise(*entry);
+  }
+
+  // CreateProcessW may write to the command line.
+  std::wstring cmd(entry->commandLine);
   
-  
-  const char* cmd = "C:\\ProgramData\\MSIXPython_d90b81feyebxc\\eomfy-env\\Scripts\\python.exe C:\\ProgramData\\MSIXPython_d90b81feyebxc\\ComfyUI\\main.py";
-  
-  if (!CreateProcess(NULL,   // No module name (use command line)
-                    (LPSTR)cmd,  // Command line
+  if (!CreateProcessW(NULL,   // No module name (use command line)
+                    &cmd[0],  // Command line
                     NULL,    // Process handle not inheritable
                     NULL,    // Thread handle not inheritable
                     FALSE,   // Set handle inheritance to FALSE
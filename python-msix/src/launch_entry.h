@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// What the launcher knows about each <Application> of AppxManifest.xml.
+// The table itself (launch_table.h) is generated from the manifest at build
+// time by gen_launch_table.py, so choosing what to start is a lookup in
+// constant data: no XML is read and no path is assembled at startup, and
+// an application renamed or removed in the manifest fails the build instead
+// of the launch.
+
+enum class TrustLevel {
+    kUnspecified,
+    kMediumIL,
+    kAppContainer,
+};
+
+enum class RuntimeBehavior {
+    kUnspecified,
+    kPackagedClassicApp,
+    kWin32App,
+    kAppSilo,
+};
+
+struct LaunchEntry {
+    std::string_view id;          // Application Id, the part after '!' of the AUMID
+    std::string_view executable;  // package-relative Executable
+    std::string_view entryPoint;
+    TrustLevel trustLevel;
+    RuntimeBehavior runtimeBehavior;
+    const std::string_view* aliases;  // appExecutionAlias names
+    size_t aliasCount;
+    // Complete command line the launcher starts for this application; empty
+    // when the manifest starts the executable directly.
+    std::wstring_view commandLine;
+};
+
+constexpr char LowerAscii(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+// Windows file names compare case-insensitively.
+constexpr bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (LowerAscii(a[i]) != LowerAscii(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <size_t N>
+constexpr const LaunchEntry* FindLaunchEntryById(const LaunchEntry (&entries)[N],
+                                                 std::string_view id) {
+    for (const LaunchEntry& entry : entries) {
+        if (entry.id == id) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// `name` is a file name such as argv[0]'s: an execution alias, or the
+// entry's own executable.
+template <size_t N>
+constexpr const LaunchEntry* FindLaunchEntryByName(const LaunchEntry (&entries)[N],
+                                                   std::string_view name) {
+    for (const LaunchEntry& entry : entries) {
+        for (size_t i = 0; i < entry.aliasCount; i++) {
+            if (EqualsIgnoreCase(entry.aliases[i], name)) {
+                return &entry;
+            }
+        }
+    }
+    for (const LaunchEntry& entry : entries) {
+        std::string_view executable = entry.executable;
+        size_t slash = executable.find_last_of("\\/");
+        if (slash != std::string_view::npos) {
+            executable.remove_prefix(slash + 1);
+        }
+        if (EqualsIgnoreCase(executable, name)) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
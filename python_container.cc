@@ -5,6 +5,16 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+#include "sandbox/job_scheduler.h"
+#include "sandbox/launcher.h"
+#include "sandbox/output_relay.h"
+#include "sandbox/resource_group.h"
+#include "sandbox/trace.h"
+#include "sandbox/worker_pool.h"
 
 #pragma comment(lib, "userenv.lib")
 #pragma comment(lib, "advapi32.lib")
@@ -30,207 +40,232 @@ void PrintLastError() {
   }
 }
 
-// Function to create or get an existing AppContainer SID
-BOOL GetOrCreateAppContainerSid(LPCWSTR containerName, PSID* ppSid) {
-    // Try to derive existing AppContainer SID
-    HRESULT hr = DeriveAppContainerSidFromAppContainerName(containerName, ppSid);
-    
-    if (SUCCEEDED(hr)) {
-        std::wcout << L"Found existing AppContainer: " << containerName << std::endl;
-        return TRUE;
-    }
-    
-    // Create a new AppContainer if it doesn't exist
-    hr = CreateAppContainerProfile(
-        containerName,                      // AppContainer name
-        containerName,                      // Display name (same for simplicity)
-        containerName,                      // Description
-        NULL,                               // No capabilities
-        0,                                  // Zero capabilities
-        ppSid);                             // Output SID
-    
-    if (SUCCEEDED(hr)) {
-        std::wcout << L"Created new AppContainer: " << containerName << std::endl;
-        return TRUE;
-    } else {
-        std::cerr << "Failed to create AppContainer profile. HRESULT: 0x" 
-                  << std::hex << hr << std::endl;
-        return FALSE;
+std::string ToUtf8(const std::wstring& text) {
+    if (text.empty()) {
+        return std::string();
     }
+    int length = WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(),
+                                     NULL, 0, NULL, NULL);
+    std::string utf8(length, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text.data(), (int)text.size(),
+                        &utf8[0], length, NULL, NULL);
+    return utf8;
 }
 
-// Function to grant AppContainer access to a directory
-BOOL GrantAppContainerAccess(PSID appContainerSid, const std::wstring& path) {
-    PACL pOldDacl = NULL;
-    PSECURITY_DESCRIPTOR pSD = NULL;
-    
-    // Get the existing DACL
-    DWORD result = GetNamedSecurityInfoW(
-        path.c_str(),                       // Path to the directory
-        SE_FILE_OBJECT,                     // Object type (file/directory)
-        DACL_SECURITY_INFORMATION,          // Get DACL
-        NULL, NULL,                         // No owner or group
-        &pOldDacl,                          // Existing DACL
-        NULL,                               // No SACL
-        &pSD);                              // Security descriptor
-    
-    if (result != ERROR_SUCCESS) {
-        std::cerr << "Failed to get security info. Error: " << result << std::endl;
-        return FALSE;
-    }
-    
-    // Prepare the new access entry
-    EXPLICIT_ACCESSW ea = {0};
-    ea.grfAccessPermissions = FILE_ALL_ACCESS;
-    ea.grfAccessMode = SET_ACCESS;
-    ea.grfInheritance = SUB_CONTAINERS_AND_OBJECTS_INHERIT;
-    ea.Trustee.TrusteeForm = TRUSTEE_IS_SID;
-    ea.Trustee.TrusteeType = TRUSTEE_IS_USER;
-    ea.Trustee.ptstrName = (LPWSTR)appContainerSid;
-    
-    // Create a new DACL with our access entry
-    PACL pNewDacl = NULL;
-    result = SetEntriesInAclW(
-        1,                                  // 1 entry
-        &ea,                                // Our new entry
-        pOldDacl,                           // Existing ACL
-        &pNewDacl);                         // Output new ACL
-    
-    if (result != ERROR_SUCCESS) {
-        std::cerr << "Failed to create new ACL. Error: " << result << std::endl;
-        LocalFree(pSD);
-        return FALSE;
-    }
-    
-    // Apply the new DACL to the directory
-    result = SetNamedSecurityInfoW(
-        (LPWSTR)path.c_str(),               // Path
-        SE_FILE_OBJECT,                     // Object type
-        DACL_SECURITY_INFORMATION,          // Set DACL
-        NULL, NULL,                         // No owner or group
-        pNewDacl,                           // New DACL
-        NULL);                              // No SACL
-    
-    if (result != ERROR_SUCCESS) {
-        std::cerr << "Failed to set security info. Error: " << result << std::endl;
-        LocalFree(pNewDacl);
-        LocalFree(pSD);
-        return FALSE;
+// Grants already applied on an earlier launch are recorded here, so a warm
+// launch checks a file id and change time per directory instead of rewriting
+// the DACL of the whole subtree.
+std::string GrantIndexPath() {
+    wchar_t buffer[MAX_PATH];
+    DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", buffer, MAX_PATH);
+    if (length == 0 || length >= MAX_PATH) {
+        return std::string();
     }
-    
-    std::wcout << L"Granted access to: " << path << std::endl;
-    
-    // Clean up
-    LocalFree(pNewDacl);
-    LocalFree(pSD);
-    
-    return TRUE;
+    return ToUtf8(std::wstring(buffer, length) + L"\\PythonSandbox.grants");
 }
 
 // Launch Python in an AppContainer with restricted access
-BOOL LaunchPythonInAppContainer(PSID appContainerSid, 
+BOOL LaunchPythonInAppContainer(sandbox::SandboxLauncher& launcher,
                                const std::wstring& pythonPath, 
                                const std::wstring& scriptPath,
-                               const std::wstring& args) {
-    // Set up the security capabilities
-    SECURITY_CAPABILITIES secCaps = {0};
-    secCaps.AppContainerSid = appContainerSid;
-    secCaps.CapabilityCount = 0;
-    secCaps.Capabilities = NULL;
-    
-    // Set up the attribute list for the process
-    SIZE_T attrListSize = 0;
-    InitializeProcThreadAttributeList(NULL, 1, 0, &attrListSize);
-    
-    LPPROC_THREAD_ATTRIBUTE_LIST pAttrList = 
-        (LPPROC_THREAD_ATTRIBUTE_LIST)HeapAlloc(
-            GetProcessHeap(), 0, attrListSize);
-    
-    if (!pAttrList) {
-        std::cerr << "Failed to allocate attribute list memory." << std::endl;
-        return FALSE;
+                               const std::wstring& args,
+                               const std::string& logPath,
+                               const sandbox::ResourceLimits* limits) {
+    // Create the command line: python.exe scriptPath args
+    sandbox::LaunchCommand command;
+    command.commandLine = L"\"" + pythonPath + L"\" \"" + scriptPath + L"\" " + args;
+    command.creationFlags = CREATE_NO_WINDOW;   // Don't create a window
+    std::wcout << L"Command: " << command.commandLine << std::endl;
+
+    // With limits the container gets a Job Object of its own, created
+    // before the launch so Python starts inside it.
+    std::string error;
+    std::unique_ptr<sandbox::ResourceGroup> group;
+    if (limits != nullptr) {
+        TRACE_SPAN("Resource group");
+        group = sandbox::ResourceGroup::Create("python", *limits, std::string(), &error);
+        if (!group) {
+            std::cerr << "Failed to set up resource limits. " << error << std::endl;
+            return FALSE;
+        }
+        for (const std::string& reason : group->Unapplied()) {
+            std::cerr << "Limit not applied: " << reason << std::endl;
+        }
+        group->Attach(&command);
     }
-    
-    if (!InitializeProcThreadAttributeList(pAttrList, 1, 0, &attrListSize)) {
-        std::cerr << "Failed to initialize attribute list. Error: " 
-                  << GetLastError() << std::endl;
-        HeapFree(GetProcessHeap(), 0, pAttrList);
+
+    // Without a window the child's output would be lost; the relay echoes
+    // it here and logs it without ever making the child wait on the disk.
+    sandbox::OutputRelayOptions relayOptions;
+    relayOptions.logPath = logPath;
+    std::unique_ptr<sandbox::OutputRelay> relay =
+        sandbox::OutputRelay::Create(relayOptions, &error);
+    if (!relay) {
+        std::cerr << "Failed to set up output relay. " << error << std::endl;
         return FALSE;
     }
-    
-    if (!UpdateProcThreadAttribute(
-        pAttrList,
-        0,
-        PROC_THREAD_ATTRIBUTE_SECURITY_CAPABILITIES,
-        &secCaps,
-        sizeof(secCaps),
-        NULL,
-        NULL)) {
-        std::cerr << "Failed to update attribute list. Error: " 
-                  << GetLastError() << std::endl;
-        DeleteProcThreadAttributeList(pAttrList);
-        HeapFree(GetProcessHeap(), 0, pAttrList);
+    relay->Attach(&command);
+
+    sandbox::LaunchedProcess process;
+    bool started = launcher.Spawn(command, &process, &error);
+    relay->ChildStarted();
+    if (!started) {
+        std::cerr << "Failed to create process. " << error << std::endl;
         return FALSE;
     }
     
-    // Create the command line: python.exe scriptPath args
-    std::wstring cmdLine = L"\"" + pythonPath + L"\" \"" + scriptPath + L"\" " + args;
-    std::wcout << L"Command: " << cmdLine << std::endl;
-    
-    // Buffer for the modifiable command line
-    wchar_t* pCmdLine = new wchar_t[cmdLine.length() + 1];
-    wcscpy_s(pCmdLine, cmdLine.length() + 1, cmdLine.c_str());
-    
-    // Initialize the startup info with the attribute list
-    STARTUPINFOEXW siEx = {0};
-    siEx.StartupInfo.cb = sizeof(siEx);
-    siEx.lpAttributeList = pAttrList;
-    
-    // Initialize the process info
-    PROCESS_INFORMATION pi = {0};
-    
-    // Create the process in the AppContainer
-    BOOL result = CreateProcessW(
-        NULL,                               // No specific application name
-        pCmdLine,                           // Command line
-        NULL, NULL,                         // Default process/thread attributes
-        FALSE,                              // Don't inherit handles
-        EXTENDED_STARTUPINFO_PRESENT |      // Use extended startup info
-        CREATE_NO_WINDOW,                   // Don't create a window
-        NULL,                               // Use parent's environment
-        NULL,                               // Use parent's current directory
-        &siEx.StartupInfo,                  // Startup info
-        &pi);                               // Process info
+    std::wcout << L"Successfully launched Python in AppContainer." << std::endl;
     
-    if (!result) {
-        std::cerr << "Failed to create process. Error: " << GetLastError() << std::endl;
-        PrintLastError();
-        DeleteProcThreadAttributeList(pAttrList);
-        HeapFree(GetProcessHeap(), 0, pAttrList);
-        delete[] pCmdLine;
+    // Wait for the process to finish and get the exit code
+    int exitCode = 0;
+    bool waited;
+    {
+        TRACE_SPAN("Wait for Python");
+        waited = launcher.Wait(&process, &exitCode, &error);
+    }
+    if (!waited) {
+        std::cerr << error << std::endl;
         return FALSE;
     }
-    
-    std::wcout << L"Successfully launched Python in AppContainer." << std::endl;
-    
-    // Wait for the process to finish
-    WaitForSingleObject(pi.hProcess, INFINITE);
-    
-    // Get the exit code
-    DWORD exitCode = 0;
-    GetExitCodeProcess(pi.hProcess, &exitCode);
+    relay->Finish();
     std::wcout << L"Python process exited with code: " << exitCode << std::endl;
-    
-    // Clean up
-    CloseHandle(pi.hThread);
-    CloseHandle(pi.hProcess);
-    DeleteProcThreadAttributeList(pAttrList);
-    HeapFree(GetProcessHeap(), 0, pAttrList);
-    delete[] pCmdLine;
+
+    sandbox::ResourceUsage usage;
+    if (group && group->ReadUsage(&usage, &error)) {
+        std::cout << "Resource use: " << sandbox::FormatResourceUsage(usage) << std::endl;
+    }
     
     return TRUE;
 }
 
+std::wstring ParentDirectory(const std::wstring& path) {
+    return path.substr(0, path.find_last_of(L'\\'));
+}
+
+// Worker-pool mode: keeps `workers` Python interpreters started inside the
+// AppContainer and runs each script path read from stdin on an idle one,
+// instead of paying interpreter startup and sandbox setup per script.
+int RunWorkerPool(sandbox::SandboxLauncher& launcher,
+                  unsigned workers, unsigned jobsPerWorker,
+                  const std::wstring& pythonPath, const std::wstring& workerScript) {
+    std::string error;
+    if (!launcher.AllowPath(ToUtf8(ParentDirectory(workerScript)), true, &error)) {
+        std::cerr << "Failed to grant access: " << error << std::endl;
+    }
+
+    sandbox::WorkerPoolOptions options;
+    options.python = ToUtf8(pythonPath);
+    options.workerScript = ToUtf8(workerScript);
+    options.workers = workers;
+    options.jobsPerWorker = jobsPerWorker;
+    // Only the two pipe ends the worker talks to the pool over are inherited.
+    options.spawnWorker = [&launcher](const std::wstring& commandLine,
+                                      void* const handles[2]) -> void* {
+        sandbox::LaunchCommand command;
+        command.commandLine = commandLine;
+        command.inheritHandles.assign(handles, handles + 2);
+        sandbox::LaunchedProcess process;
+        std::string spawnError;
+        if (!launcher.Spawn(command, &process, &spawnError)) {
+            std::cerr << spawnError << std::endl;
+            return NULL;
+        }
+        return process.process;
+    };
+
+    sandbox::WorkerPool pool;
+    if (!pool.Start(options, &error)) {
+        std::cerr << "Failed to start worker pool: " << error << std::endl;
+        return 1;
+    }
+    std::wcout << L"Worker pool ready (" << workers << L" workers). "
+               << L"Enter script paths, one per line." << std::endl;
+
+    std::wstring line;
+    while (std::getline(std::wcin, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        // The script's directory has to be readable from inside the sandbox;
+        // the planner skips it once it is in the index.
+        if (!launcher.AllowPath(ToUtf8(ParentDirectory(line)), true, &error)) {
+            std::cerr << "Failed to grant access: " << error << std::endl;
+        }
+
+        sandbox::PythonJob job;
+        job.script = ToUtf8(line);
+        sandbox::PythonJobResult result;
+        if (!pool.Run(job, &result, &error)) {
+            std::cerr << error << std::endl;
+            continue;
+        }
+        std::wcout << L"Python process exited with code: " << result.exitCode
+                   << L" (started in " << result.startSeconds * 1000 << L" ms)" << std::endl;
+    }
+    pool.Stop();
+    return 0;
+}
+
+// Batch mode: runs every job of a job file (one per line, see ParseJobSpec
+// in sandbox/job_scheduler.h) in AppContainers, `slots` at a time, instead
+// of one script per invocation, and reports each exit code and run time.
+int RunBatch(const sandbox::SandboxPolicy& policy, unsigned slots,
+             const std::wstring& pythonPath, const std::wstring& jobsFile) {
+    std::ifstream file(jobsFile.c_str());
+    if (!file) {
+        std::wcerr << L"Cannot open " << jobsFile << std::endl;
+        return 1;
+    }
+    sandbox::SchedulerOptions options;
+    options.slots = slots;
+    options.basePolicy = policy;
+    std::mutex printMutex;
+    options.onFinished = [&printMutex](size_t id, const sandbox::JobSpec& spec,
+                                       const sandbox::JobResult& result) {
+        std::lock_guard<std::mutex> lock(printMutex);
+        std::cout << "[" << id << "] " << (spec.name.empty() ? spec.script : spec.name);
+        if (result.outcome == sandbox::JobOutcome::kExited) {
+            std::cout << " exited with code " << result.exitCode;
+        } else if (result.outcome == sandbox::JobOutcome::kTimedOut) {
+            std::cout << " timed out";
+        } else {
+            std::cout << " did not run: " << result.error;
+        }
+        std::cout << " after " << result.runSeconds * 1000 << " ms" << std::endl;
+    };
+
+    sandbox::JobScheduler scheduler;
+    std::string error;
+    if (!scheduler.Start(options, &error)) {
+        std::cerr << "Failed to set up the AppContainer: " << error << std::endl;
+        return 1;
+    }
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++) {
+        sandbox::JobSpec spec;
+        spec.interpreter = ToUtf8(pythonPath);
+        bool empty = false;
+        if (!sandbox::ParseJobSpec(line, &spec, &empty, &error)) {
+            std::cerr << "Line " << number << ": " << error << std::endl;
+            continue;
+        }
+        if (!empty) {
+            scheduler.Submit(std::move(spec));
+        }
+    }
+    std::vector<sandbox::JobResult> results;
+    scheduler.Wait(&results);
+    int failed = 0;
+    for (const sandbox::JobResult& result : results) {
+        if (result.outcome != sandbox::JobOutcome::kExited || result.exitCode != 0) {
+            failed++;
+        }
+    }
+    std::cout << results.size() << " jobs on " << scheduler.Slots() << " slots, " << failed
+              << " failed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
 BOOL TestCreateProcess(const std::wstring& pythonPath, const std::wstring& scriptPath) {
     std::wstring cmdLine = L"\"" + pythonPath + L"\" \"" + scriptPath + L"\"";
     wchar_t* pCmdLine = new wchar_t[cmdLine.length() + 1];
@@ -254,9 +289,99 @@ BOOL TestCreateProcess(const std::wstring& pythonPath, const std::wstring& scrip
 }
 
 int wmain(int argc, wchar_t* argv[]) {
+    // --pool <workers> [--jobs <n>] <python_path> <python_worker.py> [<allowed_dir> ...]
+    if (argc >= 5 && std::wstring(argv[1]) == L"--pool") {
+        unsigned workers = (unsigned)_wtoi(argv[2]);
+        unsigned jobsPerWorker = 1;
+        int next = 3;
+        if (std::wstring(argv[next]) == L"--jobs" && argc >= next + 4) {
+            jobsPerWorker = (unsigned)_wtoi(argv[next + 1]);
+            next += 2;
+        }
+        std::wstring pythonPath = argv[next];
+        std::wstring workerScript = argv[next + 1];
+
+        sandbox::SandboxPolicy policy;
+        policy.grantIndexPath = GrantIndexPath();
+        policy.writePaths.push_back(ToUtf8(ParentDirectory(pythonPath)));
+        for (int i = next + 2; i < argc; i++) {
+            policy.writePaths.push_back(ToUtf8(argv[i]));
+        }
+        std::string error;
+        std::unique_ptr<sandbox::SandboxLauncher> launcher =
+            sandbox::SandboxLauncher::Create(policy, &error);
+        if (!launcher) {
+            std::cerr << "Failed to set up the AppContainer: " << error << std::endl;
+            return 1;
+        }
+        return RunWorkerPool(*launcher, workers, jobsPerWorker, pythonPath, workerScript);
+    }
+
+    // --batch <slots> <python_path> <jobs_file> [<allowed_dir> ...]
+    if (argc >= 5 && std::wstring(argv[1]) == L"--batch") {
+        std::wstring pythonPath = argv[3];
+        sandbox::SandboxPolicy policy;
+        policy.grantIndexPath = GrantIndexPath();
+        policy.writePaths.push_back(ToUtf8(ParentDirectory(pythonPath)));
+        for (int i = 5; i < argc; i++) {
+            policy.writePaths.push_back(ToUtf8(argv[i]));
+        }
+        return RunBatch(policy, (unsigned)_wtoi(argv[2]), pythonPath, argv[4]);
+    }
+
+    // [--log <file>] keeps the Python output in rotated JSON-lines logs.
+    std::string logPath;
+    if (argc >= 3 && std::wstring(argv[1]) == L"--log") {
+        logPath = ToUtf8(argv[2]);
+        wchar_t* program = argv[0];
+        argv += 2;
+        argc -= 2;
+        argv[0] = program;
+    }
+
+    // [--limits <list>] runs the container in a Job Object with the
+    // limits of resource_group.h, e.g. memory=8G,cpu=2,pids=256. It does
+    // not start when one cannot be applied, unless the list has besteffort.
+    sandbox::ResourceLimits limits;
+    bool limited = false;
+    if (argc >= 3 && std::wstring(argv[1]) == L"--limits") {
+        std::string error;
+        if (!sandbox::ParseResourceLimits(ToUtf8(argv[2]), &limits, &error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        limited = true;
+        wchar_t* program = argv[0];
+        argv += 2;
+        argc -= 2;
+        argv[0] = program;
+    }
+
+    // [--trace <file.json>] writes a Chrome trace of the launch, Python's
+    // imports included (sandbox/trace.h; needs a -DSANDBOX_TRACE build).
+    if (argc >= 3 && std::wstring(argv[1]) == L"--trace") {
+        std::string error;
+        if (!sandbox::StartTrace(ToUtf8(argv[2]), &error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        wchar_t* program = argv[0];
+        argv += 2;
+        argc -= 2;
+        argv[0] = program;
+    }
+
     if (argc < 4) {
         std::wcout << L"Usage: " << argv[0] 
-                   << L" <python_path> <script_path> <allowed_dir1> [<allowed_dir2> ...]" 
+                   << L" [--log <file>] [--limits <list>] [--trace <file.json>]"
+                   << L" <python_path> <script_path>"
+                   << L" <allowed_dir1>"
+                   << L" [<allowed_dir2> ...]" << std::endl;
+        std::wcout << L"       " << argv[0]
+                   << L" --pool <workers> [--jobs <n>] <python_path> <python_worker.py>"
+                   << L" [<allowed_dir> ...]" << std::endl;
+        std::wcout << L"       " << argv[0]
+                   << L" --batch <slots> <python_path> <jobs_file> [<allowed_dir> ...]"
                    << std::endl;
         return 1;
     }
@@ -265,57 +390,66 @@ int wmain(int argc, wchar_t* argv[]) {
     std::wstring pythonPath = argv[1];
     std::wstring scriptPath = argv[2];
     
-    // Get the AppContainer SID
-    PSID appContainerSid = NULL;
-    if (!GetOrCreateAppContainerSid(L"PythonSandbox", &appContainerSid)) {
-        std::cerr << "Failed to get or create AppContainer SID." << std::endl;
-        return 1;
-    }
-    
+    // Collect every directory the sandbox needs; the launcher applies them
+    // as one grant plan, so nested entries (the Python install under
+    // C:\Users, for instance) are covered by their inheritable ancestor and
+    // never touched separately.
+    sandbox::SandboxPolicy policy;
+    policy.grantIndexPath = GrantIndexPath();
+
     // Grant access to the Python directory (so Python can run)
     std::wstring pythonDir = pythonPath.substr(0, pythonPath.find_last_of(L'\\'));
-    GrantAppContainerAccess(appContainerSid, pythonDir);
+    policy.writePaths.push_back(ToUtf8(pythonDir));
     
     // Grant access to the script path (so Python can read the script)
     std::wstring scriptDir = scriptPath.substr(0, scriptPath.find_last_of(L'\\'));
-    GrantAppContainerAccess(appContainerSid, scriptDir);
+    policy.writePaths.push_back(ToUtf8(scriptDir));
     
     // Grant access to each allowed directory
     for (int i = 3; i < argc; i++) {
         std::wstring allowedDir = argv[i];
-        GrantAppContainerAccess(appContainerSid, allowedDir);
+        policy.writePaths.push_back(ToUtf8(allowedDir));
     }
     
     // Grant access to Python directory and parent directories
-    GrantAppContainerAccess(appContainerSid, L"C:\\Users");
-    GrantAppContainerAccess(appContainerSid, L"C:\\Users\\deepa");
-    GrantAppContainerAccess(appContainerSid, L"C:\\Users\\deepa\\AppData");
-    GrantAppContainerAccess(appContainerSid, L"C:\\Users\\deepa\\AppData\\Local");
-    GrantAppContainerAccess(appContainerSid, L"C:\\Users\\deepa\\AppData\\Local\\Programs");
-    GrantAppContainerAccess(appContainerSid, L"C:\\Users\\deepa\\AppData\\Local\\Programs\\Python");
-    GrantAppContainerAccess(appContainerSid, L"C:\\Users\\deepa\\AppData\\Local\\Programs\\Python\\Python312");
+    policy.writePaths.push_back("C:\\Users");
+    policy.writePaths.push_back("C:\\Users\\deepa");
+    policy.writePaths.push_back("C:\\Users\\deepa\\AppData");
+    policy.writePaths.push_back("C:\\Users\\deepa\\AppData\\Local");
+    policy.writePaths.push_back("C:\\Users\\deepa\\AppData\\Local\\Programs");
+    policy.writePaths.push_back("C:\\Users\\deepa\\AppData\\Local\\Programs\\Python");
+    policy.writePaths.push_back("C:\\Users\\deepa\\AppData\\Local\\Programs\\Python\\Python312");
     
     // Grant access to system directories Python might need
-    GrantAppContainerAccess(appContainerSid, L"C:\\Windows\\System32");
+    policy.writePaths.push_back("C:\\Windows\\System32");
+
+    // The import hook a traced Python loads from PYTHONPATH.
+    if (!sandbox::TraceHookDirectory().empty()) {
+        policy.readPaths.push_back(sandbox::TraceHookDirectory());
+    }
+
+    std::string error;
+    std::unique_ptr<sandbox::SandboxLauncher> launcher =
+        sandbox::SandboxLauncher::Create(policy, &error);
+    if (!launcher) {
+        std::cerr << "Failed to set up the AppContainer: " << error << std::endl;
+        return 1;
+    }
     
     // Build the script arguments (all args beyond the allowed directories)
     std::wstring scriptArgs = L"";
     
     if (!TestCreateProcess(pythonPath, scriptPath)) {
         std::cerr << "Failed to create non-AppContainer process." << std::endl;
-        FreeSid(appContainerSid);
         return 1;
     }
     
     // Launch Python in the AppContainer
-    if (!LaunchPythonInAppContainer(appContainerSid, pythonPath, scriptPath, scriptArgs)) {
+    if (!LaunchPythonInAppContainer(*launcher, pythonPath, scriptPath, scriptArgs, logPath,
+                                    limited ? &limits : nullptr)) {
         std::cerr << "Failed to launch Python in AppContainer." << std::endl;
-        FreeSid(appContainerSid);
         return 1;
     }
     
-    // Clean up
-    FreeSid(appContainerSid);
-    
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+# Builds the sandbox launch tools. The worker pool's Linux backend is what CI
+# exercises; on Windows the same pool runs workers inside an AppContainer
+# (see python_container.cc --pool). grantctl drives the grant planner that
+# python_container.cc uses for its AppContainer ACLs. spawn_bench times the
+# Linux SandboxLauncher backend against building the sandbox per launch.
+# dirscan is the tree walker behind the access probe (main.cpp). envinfo
+# prints the runtime environment descriptor, with /sandbox as a child sees it.
+# outrelay runs a command with its output captured into rotated logs.
+# supervise keeps a server running with restarts, hang checks and metrics.
+# jobrun runs a file of sandboxed Python jobs on a bounded set of slots (see
+# job_scheduler.h).
+# limitrun runs a command in its own resource group (cgroup v2 / Job Object)
+# and prints what it used.
+# pyembed runs a script in-process through libpython; it is only built when
+# the Python development files are found.
+# With $env:SANDBOX_TRACE set the tools are built with launch tracing
+# (trace.h), and trace_hook/ is copied next to them for Python children.
+
+$scriptDir = Split-Path -Path $MyInvocation.MyCommand.Path
+$outDir = Join-Path -Path $scriptDir -ChildPath "out"
+
+$LibrarySources = @(
+    "worker_pool.cc",
+    "grant_plan.cc",
+    "grant_backend.cc",
+    "launcher.cc",
+    "dir_scan.cc",
+    "runtime_env.cc",
+    "output_relay.cc",
+    "supervisor.cc",
+    "job_scheduler.cc",
+    "resource_group.cc",
+    "trace.cc"
+)
+
+$Tools = @(
+    "python_pool",
+    "grantctl",
+    "spawn_bench",
+    "dirscan",
+    "envinfo",
+    "outrelay",
+    "supervise",
+    "jobrun",
+    "limitrun"
+)
+
+$compilerFlags = @("-std=c++17", "-O2", "-g")
+if ($env:SANDBOX_TRACE) {
+    $compilerFlags += "-DSANDBOX_TRACE"
+}
+$linkFlags = @()
+if ($IsLinux -or $IsMacOS) {
+    $compilerFlags += "-pthread"
+    $exeSuffix = ""
+} else {
+    $exeSuffix = ".exe"
+    # The supervisor's health probe and process counters.
+    $linkFlags += @("-lws2_32", "-lpsapi", "-luserenv", "-ladvapi32")
+}
+
+New-Item -ItemType Directory -Force -Path $outDir | Out-Null
+
+$librarySourcePaths = $LibrarySources | ForEach-Object { Join-Path $scriptDir $_ }
+
+foreach ($tool in $Tools) {
+    $sourcePath = Join-Path $scriptDir "$tool.cc"
+    $outputPath = Join-Path $outDir "$tool$exeSuffix"
+    Write-Host "Compiling $tool..." -ForegroundColor Yellow
+
+    & clang++ @compilerFlags $sourcePath @librarySourcePaths -o $outputPath @linkFlags
+
+    if ($LASTEXITCODE -ne 0) {
+        Write-Error "Compilation of $tool failed with exit code $LASTEXITCODE"
+        exit $LASTEXITCODE
+    }
+    Write-Host "Successfully compiled to $outputPath" -ForegroundColor Green
+}
+
+# pyembed links libpython: python3-config on Linux and macOS, the import
+# library of the python on PATH on Windows.
+$pythonFlags = @()
+$pythonLinkFlags = @()
+if ($IsLinux -or $IsMacOS) {
+    if (Get-Command python3-config -ErrorAction SilentlyContinue) {
+        $pythonFlags = (& python3-config --includes) -split " "
+        $pythonLinkFlags = (& python3-config --ldflags --embed) -split " "
+    }
+} elseif ($python = Get-Command python -ErrorAction SilentlyContinue) {
+    $pythonInclude = & $python.Source -c "import sysconfig; print(sysconfig.get_paths()['include'])"
+    $pythonLibs = & $python.Source -c "import os, sys; print(os.path.join(sys.base_prefix, 'libs'))"
+    $pythonLib = & $python.Source -c "import sys; print('python%d%d' % sys.version_info[:2])"
+    if (Test-Path (Join-Path $pythonInclude "Python.h")) {
+        $pythonFlags = @("-I$pythonInclude")
+        $pythonLinkFlags = @("-L$pythonLibs", "-l$pythonLib")
+    }
+}
+if ($pythonFlags.Count -gt 0) {
+    $outputPath = Join-Path $outDir "pyembed$exeSuffix"
+    Write-Host "Compiling pyembed..." -ForegroundColor Yellow
+    $embedSources = @("pyembed.cc", "embedded_python.cc", "runtime_env.cc") | ForEach-Object { Join-Path $scriptDir $_ }
+    & clang++ @compilerFlags @pythonFlags @embedSources -o $outputPath @linkFlags @pythonLinkFlags
+    if ($LASTEXITCODE -ne 0) {
+        Write-Error "Compilation of pyembed failed with exit code $LASTEXITCODE"
+        exit $LASTEXITCODE
+    }
+    Write-Host "Successfully compiled to $outputPath" -ForegroundColor Green
+} else {
+    Write-Host "Python development files not found; skipping pyembed." -ForegroundColor Yellow
+}
+
+# Workers are started from the copy next to the tools.
+Copy-Item -Path (Join-Path $scriptDir "python_worker.py") -Destination $outDir -Force
+Copy-Item -Path (Join-Path $scriptDir "trace_hook") -Destination $outDir -Recurse -Force
+
+Write-Host "All sandbox tools built." -ForegroundColor Green
@@ -0,0 +1,472 @@
+#include "dir_scan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace sandbox {
+
+namespace {
+
+enum class EntryType : uint8_t { kFile, kDirectory, kSymlink, kOther };
+
+struct Entry {
+    std::string name;
+    EntryType type;
+};
+
+enum class ListResult { kOk, kDenied, kError };
+
+struct Listing {
+    std::vector<Entry> entries;
+    ListResult result = ListResult::kOk;
+    std::string error;
+};
+
+#ifdef _WIN32
+std::wstring Widen(const std::string& text) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()),
+                                     NULL, 0);
+    std::wstring wide(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &wide[0], length);
+    return wide;
+}
+
+std::string Narrow(const wchar_t* text) {
+    int length = WideCharToMultiByte(CP_UTF8, 0, text, -1, NULL, 0, NULL, NULL);
+    std::string narrow(length > 0 ? length - 1 : 0, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text, -1, &narrow[0], length, NULL, NULL);
+    return narrow;
+}
+
+void ListDirectory(const std::string& path, std::vector<char>&, Listing* listing) {
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileExW(Widen(path + "\\*").c_str(), FindExInfoBasic, &data,
+                                   FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (find == INVALID_HANDLE_VALUE) {
+        DWORD code = GetLastError();
+        listing->result = code == ERROR_ACCESS_DENIED ? ListResult::kDenied : ListResult::kError;
+        listing->error = "error " + std::to_string(code);
+        return;
+    }
+    do {
+        if (wcscmp(data.cFileName, L".") == 0 || wcscmp(data.cFileName, L"..") == 0) {
+            continue;
+        }
+        EntryType type = EntryType::kFile;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+            type = EntryType::kSymlink;
+        } else if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            type = EntryType::kDirectory;
+        }
+        listing->entries.push_back({Narrow(data.cFileName), type});
+    } while (FindNextFileW(find, &data));
+    FindClose(find);
+}
+#else
+EntryType TypeFromMode(mode_t mode) {
+    if (S_ISDIR(mode)) return EntryType::kDirectory;
+    if (S_ISLNK(mode)) return EntryType::kSymlink;
+    if (S_ISREG(mode)) return EntryType::kFile;
+    return EntryType::kOther;
+}
+
+// d_type when the filesystem provides it; one fstatat otherwise.
+EntryType ResolveType(int directoryFd, const char* name, unsigned char type) {
+    switch (type) {
+        case DT_DIR: return EntryType::kDirectory;
+        case DT_LNK: return EntryType::kSymlink;
+        case DT_REG: return EntryType::kFile;
+        case DT_UNKNOWN: {
+            struct stat info;
+            if (fstatat(directoryFd, name, &info, AT_SYMLINK_NOFOLLOW) == 0) {
+                return TypeFromMode(info.st_mode);
+            }
+            return EntryType::kOther;
+        }
+        default: return EntryType::kOther;
+    }
+}
+
+bool IsDotOrDotDot(const char* name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+void ListDirectory(const std::string& path, std::vector<char>& buffer, Listing* listing) {
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        listing->result =
+            errno == EACCES || errno == EPERM ? ListResult::kDenied : ListResult::kError;
+        listing->error = strerror(errno);
+        return;
+    }
+#ifdef __linux__
+    // Raw getdents64: one syscall returns as many entries as fit in the
+    // buffer, with no per-entry allocation as in readdir.
+    struct Dirent64 {
+        uint64_t ino;
+        int64_t off;
+        unsigned short reclen;
+        unsigned char type;
+        char name[1];
+    };
+    for (;;) {
+        long read = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (read < 0) {
+            listing->result =
+                errno == EACCES || errno == EPERM ? ListResult::kDenied : ListResult::kError;
+            listing->error = strerror(errno);
+            break;
+        }
+        if (read == 0) {
+            break;
+        }
+        for (long offset = 0; offset < read;) {
+            const Dirent64* entry = reinterpret_cast<const Dirent64*>(buffer.data() + offset);
+            offset += entry->reclen;
+            if (!IsDotOrDotDot(entry->name)) {
+                listing->entries.push_back(
+                    {entry->name, ResolveType(fd, entry->name, entry->type)});
+            }
+        }
+    }
+    close(fd);
+#else
+    (void)buffer;
+    DIR* directory = fdopendir(fd);
+    if (directory == nullptr) {
+        listing->result = ListResult::kError;
+        listing->error = strerror(errno);
+        close(fd);
+        return;
+    }
+    while (dirent* entry = readdir(directory)) {
+        if (!IsDotOrDotDot(entry->d_name)) {
+            listing->entries.push_back(
+                {entry->d_name, ResolveType(dirfd(directory), entry->d_name, entry->d_type)});
+        }
+    }
+    closedir(directory);
+#endif
+}
+#endif
+
+#ifdef _WIN32
+constexpr char kSeparator = '\\';
+#else
+constexpr char kSeparator = '/';
+#endif
+
+bool GlobMatch(const char* pattern, const char* text) {
+    const char* starPattern = nullptr;
+    const char* starText = nullptr;
+    while (*text) {
+        char p = *pattern;
+        char t = *text;
+#ifdef _WIN32
+        p = static_cast<char>(tolower(static_cast<unsigned char>(p)));
+        t = static_cast<char>(tolower(static_cast<unsigned char>(t)));
+#endif
+        if (p == '*') {
+            starPattern = pattern++;
+            starText = text;
+        } else if (p == '?' || p == t) {
+            pattern++;
+            text++;
+        } else if (starPattern != nullptr) {
+            pattern = starPattern + 1;
+            text = ++starText;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+void AppendJsonString(const std::string& text, std::string* out) {
+    *out += '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            *out += '\\';
+            *out += static_cast<char>(c);
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            *out += escaped;
+        } else {
+            *out += static_cast<char>(c);
+        }
+    }
+    *out += '"';
+}
+
+const char* TypeName(EntryType type) {
+    switch (type) {
+        case EntryType::kFile: return "file";
+        case EntryType::kDirectory: return "dir";
+        case EntryType::kSymlink: return "link";
+        default: return "other";
+    }
+}
+
+struct Node {
+    std::string relative;  // "" for the root
+    int depth = 0;
+    Listing listing;
+    // One per directory entry that is descended into, in entry order.
+    std::vector<std::unique_ptr<Node>> children;
+    bool done = false;
+};
+
+class Scanner {
+public:
+    Scanner(std::string root, const ScanOptions& options, FILE* out)
+        : root_(std::move(root)), options_(options), out_(out) {}
+
+    bool Run(ScanStats* stats, std::string* error) {
+        unsigned threads = options_.threads;
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        queues_.resize(threads);
+        for (auto& queue : queues_) {
+            queue.reset(new WorkQueue());
+        }
+
+        std::unique_ptr<Node> root(new Node());
+        pending_ = 1;
+        queues_[0]->nodes.push_back(root.get());
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < threads; i++) {
+            workers.emplace_back([this, i] { WorkerLoop(i); });
+        }
+
+        WaitDone(root.get());
+        bool ok = root->listing.result == ListResult::kOk;
+        if (!ok) {
+            *error = "Cannot list " + root_ + ": " + root->listing.error;
+        } else {
+            Emit(root.get());
+            Flush();
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        *stats = stats_;
+        return ok;
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Node*> nodes;
+    };
+
+    // Owners take from the back (depth first, close to what the emitter
+    // needs next); thieves take from the front, where the larger subtrees
+    // are.
+    Node* TakeWork(unsigned self) {
+        {
+            WorkQueue& own = *queues_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.nodes.empty()) {
+                Node* node = own.nodes.back();
+                own.nodes.pop_back();
+                return node;
+            }
+        }
+        for (size_t i = 1; i < queues_.size(); i++) {
+            WorkQueue& victim = *queues_[(self + i) % queues_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.nodes.empty()) {
+                Node* node = victim.nodes.front();
+                victim.nodes.pop_front();
+                return node;
+            }
+        }
+        return nullptr;
+    }
+
+    void WorkerLoop(unsigned self) {
+        std::vector<char> buffer(1 << 16);
+        for (;;) {
+            Node* node = TakeWork(self);
+            if (node == nullptr) {
+                std::unique_lock<std::mutex> lock(idleMutex_);
+                if (pending_ == 0) {
+                    return;
+                }
+                workAvailable_.wait_for(lock, std::chrono::milliseconds(1));
+                continue;
+            }
+            Scan(node, buffer, self);
+        }
+    }
+
+    void Scan(Node* node, std::vector<char>& buffer, unsigned self) {
+        std::string path = node->relative.empty() ? root_ : root_ + kSeparator + node->relative;
+        ListDirectory(path, buffer, &node->listing);
+        std::vector<Entry>& entries = node->listing.entries;
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.name < b.name; });
+
+        bool descend = options_.maxDepth < 0 || node->depth < options_.maxDepth;
+        if (descend) {
+            for (const Entry& entry : entries) {
+                if (entry.type != EntryType::kDirectory) {
+                    continue;
+                }
+                std::unique_ptr<Node> child(new Node());
+                child->relative =
+                    node->relative.empty() ? entry.name : node->relative + '/' + entry.name;
+                child->depth = node->depth + 1;
+                node->children.push_back(std::move(child));
+            }
+        }
+        size_t added = node->children.size();
+        if (added > 0) {
+            {
+                std::lock_guard<std::mutex> lock(idleMutex_);
+                pending_ += added;
+            }
+            WorkQueue& own = *queues_[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            // Reversed, so the owner pops the first child first.
+            for (size_t i = added; i-- > 0;) {
+                own.nodes.push_back(node->children[i].get());
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(idleMutex_);
+            node->done = true;
+            pending_--;
+        }
+        if (added > 1 || pending_ == 0) {
+            workAvailable_.notify_all();
+        }
+        doneChanged_.notify_all();
+    }
+
+    void WaitDone(Node* node) {
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        doneChanged_.wait(lock, [node] { return node->done; });
+    }
+
+    void Emit(Node* node) {
+        stats_.directories++;
+        size_t nextChild = 0;
+        for (const Entry& entry : node->listing.entries) {
+            stats_.entries++;
+            std::string relative =
+                node->relative.empty() ? entry.name : node->relative + '/' + entry.name;
+            if (options_.filter.empty() || GlobMatch(options_.filter.c_str(), entry.name.c_str())) {
+                WriteEntry(relative, entry.type);
+            }
+            if (nextChild < node->children.size() &&
+                node->children[nextChild]->relative == relative) {
+                Node* child = node->children[nextChild].get();
+                WaitDone(child);
+                if (child->listing.result == ListResult::kOk) {
+                    Emit(child);
+                } else {
+                    WriteFailure(child);
+                }
+                // Emitted subtrees are released as the walk moves on.
+                node->children[nextChild].reset();
+                nextChild++;
+            }
+        }
+    }
+
+    void WriteEntry(const std::string& relative, EntryType type) {
+        if (options_.json) {
+            buffer_ += "{\"path\":";
+            AppendJsonString(relative, &buffer_);
+            buffer_ += ",\"type\":\"";
+            buffer_ += TypeName(type);
+            buffer_ += "\"}\n";
+        } else {
+            buffer_ += relative;
+            if (type == EntryType::kDirectory) {
+                buffer_ += '/';
+            }
+            buffer_ += '\n';
+        }
+        if (buffer_.size() >= (1 << 16)) {
+            Flush();
+        }
+    }
+
+    void WriteFailure(const Node* node) {
+        bool denied = node->listing.result == ListResult::kDenied;
+        (denied ? stats_.denied : stats_.errors)++;
+        if (options_.json) {
+            buffer_ += "{\"path\":";
+            AppendJsonString(node->relative, &buffer_);
+            buffer_ += ",\"type\":\"dir\",\"error\":";
+            AppendJsonString(denied ? "access denied" : node->listing.error, &buffer_);
+            buffer_ += "}\n";
+        } else if (denied) {
+            buffer_ += "!denied " + node->relative + "\n";
+        } else {
+            buffer_ += "!error " + node->relative + ": " + node->listing.error + "\n";
+        }
+    }
+
+    void Flush() {
+        fwrite(buffer_.data(), 1, buffer_.size(), out_);
+        buffer_.clear();
+    }
+
+    std::string root_;
+    ScanOptions options_;
+    FILE* out_;
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::mutex idleMutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable doneChanged_;
+    std::atomic<size_t> pending_{0};
+    std::string buffer_;
+    ScanStats stats_;
+};
+
+}  // namespace
+
+bool ScanTree(const std::string& root, const ScanOptions& options, FILE* out, ScanStats* stats,
+              std::string* error) {
+    auto start = std::chrono::steady_clock::now();
+    std::string trimmed = root;
+    while (trimmed.size() > 1 && (trimmed.back() == '/' || trimmed.back() == '\\')) {
+        trimmed.pop_back();
+    }
+    Scanner scanner(trimmed, options, out);
+    bool ok = scanner.Run(stats, error);
+    stats->seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return ok;
+}
+
+}  // namespace sandbox
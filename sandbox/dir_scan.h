@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Recursive directory walker for mapping what a (sandboxed) process can see.
+//
+// Directories are listed in parallel by work-stealing threads using the
+// cheapest batched listing each platform has (getdents64 on Linux,
+// FindFirstFileEx with large fetches on Windows) and the entry type the
+// listing already carries, so no entry is stat'ed. The calling thread streams
+// the results in a fixed order while the workers scan ahead: pre-order,
+// entries sorted by name, each directory's contents right after its line.
+namespace sandbox {
+
+struct ScanOptions {
+    // 0 = one per hardware thread.
+    unsigned threads = 0;
+    // Levels below the root to descend into; 0 lists the root only, -1 has
+    // no limit.
+    int maxDepth = -1;
+    // Glob (* and ?) matched against entry names; non-matching entries are
+    // not printed but directories are still descended into.
+    std::string filter;
+    // One JSON object per line instead of plain paths.
+    bool json = false;
+};
+
+struct ScanStats {
+    uint64_t directories = 0;
+    uint64_t entries = 0;
+    // Directories that could not be listed because access was denied; each
+    // one is reported in the output.
+    uint64_t denied = 0;
+    uint64_t errors = 0;
+    double seconds = 0;
+};
+
+// Plain output is one path per line, relative to root, with a trailing '/'
+// on directories and "!denied <path>" / "!error <path>: <reason>" lines for
+// directories that could not be listed. Returns false only when root itself
+// cannot be listed.
+bool ScanTree(const std::string& root, const ScanOptions& options, FILE* out, ScanStats* stats,
+              std::string* error);
+
+}  // namespace sandbox
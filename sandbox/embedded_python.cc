@@ -0,0 +1,259 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "embedded_python.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "runtime_env.h"
+
+namespace sandbox {
+
+namespace {
+
+#ifdef _WIN32
+const char kSeparator = '\\';
+#else
+const char kSeparator = '/';
+#endif
+
+bool IsAbsolute(const std::string& path) {
+#ifdef _WIN32
+    return (path.size() >= 2 && path[1] == ':') || (!path.empty() && (path[0] == '\\' || path[0] == '/'));
+#else
+    return !path.empty() && path[0] == '/';
+#endif
+}
+
+std::string DirectoryOf(const std::string& path) {
+    size_t end = path.find_last_of(kSeparator == '/' ? "/" : "\\/");
+    return end == std::string::npos ? std::string(".") : path.substr(0, end);
+}
+
+std::string StatusMessage(const PyStatus& status, const char* what) {
+    std::string message = what;
+    if (status.func != nullptr) {
+        message += std::string(": ") + status.func;
+    }
+    if (status.err_msg != nullptr) {
+        message += std::string(": ") + status.err_msg;
+    }
+    return message;
+}
+
+// _sandbox.environment(): the launcher's RuntimeEnvironment as a dict.
+PyObject* SandboxEnvironment(PyObject*, PyObject*) {
+    const RuntimeEnvironment& environment = CurrentEnvironment();
+    PyObject* capabilities = PyList_New(0);
+    if (capabilities == nullptr) {
+        return nullptr;
+    }
+    for (uint32_t i = 0; i < environment.capabilityCount; i++) {
+        PyObject* capability = PyUnicode_FromString(environment.capabilities[i]);
+        if (capability == nullptr || PyList_Append(capabilities, capability) != 0) {
+            Py_XDECREF(capability);
+            Py_DECREF(capabilities);
+            return nullptr;
+        }
+        Py_DECREF(capability);
+    }
+    return Py_BuildValue("{s:I,s:I,s:s,s:s,s:s,s:s,s:s,s:N}",
+                         "flags", environment.flags,
+                         "landlock_abi", environment.landlockAbi,
+                         "package_full_name", environment.packageFullName,
+                         "package_family_name", environment.packageFamilyName,
+                         "package_root", environment.packageRoot,
+                         "container", environment.container,
+                         "cgroup", environment.cgroup,
+                         "capabilities", capabilities);
+}
+
+PyMethodDef kSandboxMethods[] = {
+    {"environment", SandboxEnvironment, METH_NOARGS,
+     "The sandbox this process runs in, as described by its launcher."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyModuleDef kSandboxModule = {
+    PyModuleDef_HEAD_INIT, "_sandbox", "Launcher state shared with the embedded interpreter.",
+    -1, kSandboxMethods, nullptr, nullptr, nullptr, nullptr,
+};
+
+PyObject* InitSandboxModule() {
+    return PyModule_Create(&kSandboxModule);
+}
+
+// Paths are UTF-8 throughout the launcher; UTF-8 mode makes
+// Py_DecodeLocale() decode them as such on every platform.
+bool AppendPath(PyWideStringList* list, const std::string& path, std::string* error) {
+    wchar_t* wide = Py_DecodeLocale(path.c_str(), nullptr);
+    if (wide == nullptr) {
+        *error = "Cannot decode path " + path;
+        return false;
+    }
+    PyStatus status = PyWideStringList_Append(list, wide);
+    PyMem_RawFree(wide);
+    if (PyStatus_Exception(status)) {
+        *error = StatusMessage(status, "Cannot set sys.path");
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+bool ReadPathFile(const std::string& path, EmbeddedPythonOptions* options, std::string* error) {
+    std::ifstream file(path);
+    if (!file) {
+        *error = "Cannot open " + path + ": " + strerror(errno);
+        return false;
+    }
+    std::string directory = DirectoryOf(path);
+    if (options->home.empty()) {
+        options->home = directory;
+    }
+    options->searchPaths.clear();
+    options->importSite = false;
+    options->isolated = true;
+    options->safePath = true;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t end = line.find_last_not_of(" \t\r");
+        line.erase(end == std::string::npos ? 0 : end + 1);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line == "import site") {
+            options->importSite = true;
+        } else if (IsAbsolute(line)) {
+            options->searchPaths.push_back(line);
+        } else if (line == ".") {
+            options->searchPaths.push_back(directory);
+        } else {
+            options->searchPaths.push_back(directory + kSeparator + line);
+        }
+    }
+    return true;
+}
+
+bool FindPathFile(const std::string& directory, std::string* path) {
+#ifdef _WIN32
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((directory + "\\python*._pth").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    FindClose(find);
+    *path = directory + "\\" + data.cFileName;
+    return true;
+#else
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr) {
+        return false;
+    }
+    bool found = false;
+    while (dirent* entry = readdir(dir)) {
+        size_t length = strlen(entry->d_name);
+        if (strncmp(entry->d_name, "python", 6) == 0 && length > 10 &&
+            strcmp(entry->d_name + length - 5, "._pth") == 0) {
+            *path = directory + "/" + entry->d_name;
+            found = true;
+            break;
+        }
+    }
+    closedir(dir);
+    return found;
+#endif
+}
+
+int RunEmbeddedPython(const EmbeddedPythonOptions& options, std::string* error) {
+    if (options.argv.empty()) {
+        *error = "No script to run";
+        return -1;
+    }
+
+    PyPreConfig preconfig;
+    if (options.isolated) {
+        PyPreConfig_InitIsolatedConfig(&preconfig);
+    } else {
+        PyPreConfig_InitPythonConfig(&preconfig);
+    }
+    preconfig.utf8_mode = 1;
+    PyStatus status = Py_PreInitialize(&preconfig);
+    if (PyStatus_Exception(status)) {
+        *error = StatusMessage(status, "Cannot pre-initialize Python");
+        return -1;
+    }
+
+    if (PyImport_AppendInittab("_sandbox", InitSandboxModule) != 0) {
+        *error = "Cannot register the _sandbox module";
+        return -1;
+    }
+
+    PyConfig config;
+    if (options.isolated) {
+        PyConfig_InitIsolatedConfig(&config);
+    } else {
+        PyConfig_InitPythonConfig(&config);
+    }
+    // The launcher's own command line is not the interpreter's.
+    config.parse_argv = 0;
+    config.site_import = options.importSite ? 1 : 0;
+#if PY_VERSION_HEX >= 0x030B0000
+    config.safe_path = options.safePath ? 1 : 0;
+#endif
+
+    std::vector<char*> argv;
+    for (const std::string& arg : options.argv) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    bool ok = true;
+    status = PyConfig_SetBytesArgv(&config, static_cast<Py_ssize_t>(argv.size()), argv.data());
+    if (!PyStatus_Exception(status)) {
+        status = PyConfig_SetBytesString(&config, &config.run_filename, argv[0]);
+    }
+    if (!PyStatus_Exception(status) && !options.home.empty()) {
+        status = PyConfig_SetBytesString(&config, &config.home, options.home.c_str());
+    }
+    if (PyStatus_Exception(status)) {
+        *error = StatusMessage(status, "Cannot configure Python");
+        ok = false;
+    }
+    if (ok && !options.searchPaths.empty()) {
+        config.module_search_paths_set = 1;
+        for (const std::string& path : options.searchPaths) {
+            if (!AppendPath(&config.module_search_paths, path, error)) {
+                ok = false;
+                break;
+            }
+        }
+    }
+    if (!ok) {
+        PyConfig_Clear(&config);
+        return -1;
+    }
+
+    status = Py_InitializeFromConfig(&config);
+    PyConfig_Clear(&config);
+    if (PyStatus_IsExit(status)) {
+        return status.exitcode;
+    }
+    if (PyStatus_Exception(status)) {
+        *error = StatusMessage(status, "Cannot initialize Python");
+        return -1;
+    }
+    // Runs run_filename as __main__, reports an uncaught exception the way
+    // python.exe does and finalizes.
+    return Py_RunMain();
+}
+
+}  // namespace sandbox
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Runs a Python script inside this process instead of starting python.exe.
+//
+// Exec'ing the interpreter costs a second process creation and a second
+// loader pass (python.exe, pythonXY.dll and their imports) on top of the
+// launcher's own. Linking libpython and initializing it through PyConfig
+// skips both, and the script runs with the launcher's stdio, environment
+// variables and cached RuntimeEnvironment: the built-in _sandbox module
+// returns CurrentEnvironment() without probing again.
+//
+// Only for launches that need no sandbox of their own; a process cannot
+// move itself into an AppContainer or a fresh namespace set.
+namespace sandbox {
+
+struct EmbeddedPythonOptions {
+    // sys.prefix; the directory holding python.exe (and pythonXY._pth) for
+    // the Windows embeddable distribution. Empty uses the compiled-in
+    // prefix.
+    std::string home;
+    // sys.path, replacing the computed one. Empty keeps the computed path.
+    std::vector<std::string> searchPaths;
+    bool importSite = true;
+    // Ignores PYTHON* variables and the user site directory.
+    bool isolated = false;
+    // Keeps the script's directory out of sys.path, as python.exe does
+    // when a ._pth file is present.
+    bool safePath = false;
+    // argv[0] is the script, run as __main__.
+    std::vector<std::string> argv;
+};
+
+// Applies a ._pth file the way python.exe does: every line that is not a
+// comment is a sys.path entry relative to the file's directory, and
+// "import site" turns site back on. A ._pth file also implies isolated mode
+// and a safe path.
+bool ReadPathFile(const std::string& path, EmbeddedPythonOptions* options, std::string* error);
+
+// The first python*._pth file in directory, if any.
+bool FindPathFile(const std::string& directory, std::string* path);
+
+// Initializes the interpreter, runs options.argv[0] and finalizes. Returns
+// the script's exit status: the SystemExit code, or 1 after an uncaught
+// exception. Returns -1 with error set when the interpreter cannot start.
+// Call at most once per process.
+int RunEmbeddedPython(const EmbeddedPythonOptions& options, std::string* error);
+
+}  // namespace sandbox
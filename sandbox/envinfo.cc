@@ -0,0 +1,138 @@
+// Prints the runtime environment descriptor this process sees. With
+// /sandbox it relaunches itself through SandboxLauncher, to show what a
+// sandboxed child receives.
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "launcher.h"
+#include "runtime_env.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "Options:\n"
+              << "  /sandbox         Print what a sandboxed child sees instead\n"
+              << "  /read <dir>      Extra read-only directory for /sandbox (this program's\n"
+              << "                   directory and the system libraries always are)\n"
+              << "  /network         Keep the host network for /sandbox (Linux)\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+// Absolute path of this executable, so the sandboxed relaunch depends on
+// neither argv[0] nor PATH.
+std::string ExecutablePath(const char* argv0) {
+#ifdef _WIN32
+    char buffer[MAX_PATH];
+    DWORD length = GetModuleFileNameA(NULL, buffer, MAX_PATH);
+    return length > 0 && length < MAX_PATH ? std::string(buffer, length) : std::string(argv0);
+#else
+    char buffer[4096];
+    ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+    return length > 0 ? std::string(buffer, length) : std::string(argv0);
+#endif
+}
+
+void Print(const sandbox::RuntimeEnvironment& environment) {
+    const struct {
+        uint32_t flag;
+        const char* name;
+    } flags[] = {
+        {sandbox::kEnvPackaged, "packaged"},
+        {sandbox::kEnvAppContainer, "appcontainer"},
+        {sandbox::kEnvUserNamespace, "user-ns"},
+        {sandbox::kEnvMountNamespace, "mount-ns"},
+        {sandbox::kEnvNetworkNamespace, "net-ns"},
+        {sandbox::kEnvIpcNamespace, "ipc-ns"},
+        {sandbox::kEnvUtsNamespace, "uts-ns"},
+        {sandbox::kEnvLandlock, "landlock"},
+        {sandbox::kEnvSeccomp, "seccomp"},
+        {sandbox::kEnvNoNewPrivs, "no-new-privs"},
+        {sandbox::kEnvCgroupV2, "cgroup2"},
+        {sandbox::kEnvInherited, "inherited"},
+    };
+    printf("flags:");
+    for (const auto& flag : flags) {
+        if (environment.Has(flag.flag)) {
+            printf(" %s", flag.name);
+        }
+    }
+    printf("\nlandlock abi:   %u\n", environment.landlockAbi);
+    printf("package:        %s\n", environment.packageFullName);
+    printf("package family: %s\n", environment.packageFamilyName);
+    printf("package root:   %s\n", environment.packageRoot);
+    printf("container:      %s\n", environment.container);
+    printf("cgroup:         %s\n", environment.cgroup);
+    for (uint32_t i = 0; i < environment.capabilityCount; i++) {
+        printf("capability:     %s\n", environment.capabilities[i]);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    bool sandboxed = false;
+    sandbox::SandboxPolicy policy;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (IsFlag(arg, "sandbox")) {
+            sandboxed = true;
+        } else if (IsFlag(arg, "read") && i + 1 < argc) {
+            policy.readPaths.push_back(argv[++i]);
+        } else if (IsFlag(arg, "network")) {
+            policy.network = true;
+        } else {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (!sandboxed) {
+        Print(sandbox::CurrentEnvironment());
+        return 0;
+    }
+
+    // The child is this program, so it needs its own directory and, on
+    // Linux, the dynamic loader and the libraries it maps; without them the
+    // exec fails with EACCES.
+    std::string self = ExecutablePath(argv[0]);
+    size_t slash = self.find_last_of("/\\");
+    if (slash != std::string::npos) {
+        policy.readPaths.push_back(self.substr(0, slash == 0 ? 1 : slash));
+    }
+#ifdef __linux__
+    for (const char* path : {"/lib", "/lib64", "/usr/lib", "/usr/lib64", "/etc/ld.so.cache"}) {
+        if (access(path, F_OK) == 0) {
+            policy.readPaths.push_back(path);
+        }
+    }
+#endif
+
+    std::string error;
+    std::unique_ptr<sandbox::SandboxLauncher> launcher =
+        sandbox::SandboxLauncher::Create(policy, &error);
+    if (!launcher) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    sandbox::LaunchCommand command;
+    command.argv.push_back(self);
+    sandbox::LaunchedProcess process;
+    int exitCode = 0;
+    if (!launcher->Spawn(command, &process, &error) ||
+        !launcher->Wait(&process, &exitCode, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    return exitCode;
+}
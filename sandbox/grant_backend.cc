@@ -0,0 +1,428 @@
+// Platform GrantBackends: DACL entries for an AppContainer SID on Windows,
+// POSIX.1e ACL entries for a uid (system.posix_acl_* xattrs) elsewhere.
+#include "grant_plan.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <aclapi.h>
+#include <sddl.h>
+#else
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <cerrno>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace sandbox {
+
+namespace {
+
+std::string GenericKey(const std::string& path, bool foldCase) {
+    std::string key = fs::u8path(path).lexically_normal().generic_u8string();
+    while (key.size() > 1 && key.back() == '/' && !(key.size() == 3 && key[1] == ':')) {
+        key.pop_back();
+    }
+    if (foldCase) {
+        std::transform(key.begin(), key.end(), key.begin(), [](char c) {
+            return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+        });
+    }
+    return key;
+}
+
+#ifdef _WIN32
+
+std::wstring Widen(const std::string& text) {
+    if (text.empty()) {
+        return std::wstring();
+    }
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()),
+                                     NULL, 0);
+    std::wstring wide(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &wide[0], length);
+    return wide;
+}
+
+DWORD AccessMask(uint32_t access) {
+    if (access == kGrantAll) {
+        return FILE_ALL_ACCESS;
+    }
+    DWORD mask = 0;
+    if (access & kGrantRead) mask |= FILE_GENERIC_READ;
+    if (access & kGrantWrite) mask |= FILE_GENERIC_WRITE;
+    if (access & kGrantExecute) mask |= FILE_GENERIC_EXECUTE;
+    return mask;
+}
+
+class WindowsGrantBackend : public GrantBackend {
+public:
+    std::string PathKey(const std::string& path) const override {
+        return GenericKey(path, true);
+    }
+
+    bool Stamp(const std::string& path, std::string* stamp) const override {
+        HANDLE file = CreateFileW(Widen(path).c_str(), FILE_READ_ATTRIBUTES,
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                                  OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        BY_HANDLE_FILE_INFORMATION info;
+        FILE_BASIC_INFO basic;
+        bool ok = GetFileInformationByHandle(file, &info) &&
+                  GetFileInformationByHandleEx(file, FileBasicInfo, &basic, sizeof(basic));
+        CloseHandle(file);
+        if (!ok) {
+            return false;
+        }
+        // ChangeTime moves on any metadata update, including the DACL.
+        *stamp = std::to_string(info.dwVolumeSerialNumber) + ":" +
+                 std::to_string((uint64_t(info.nFileIndexHigh) << 32) | info.nFileIndexLow) + ":" +
+                 std::to_string(basic.ChangeTime.QuadPart);
+        return true;
+    }
+
+    bool HasGrant(const std::string& principal, const Grant& grant,
+                  std::string* error) const override {
+        PSID sid = NULL;
+        if (!ConvertStringSidToSidA(principal.c_str(), &sid)) {
+            *error = "Invalid SID " + principal;
+            return false;
+        }
+        PACL dacl = NULL;
+        PSECURITY_DESCRIPTOR descriptor = NULL;
+        DWORD result = GetNamedSecurityInfoW(Widen(grant.path).c_str(), SE_FILE_OBJECT,
+                                             DACL_SECURITY_INFORMATION, NULL, NULL, &dacl, NULL,
+                                             &descriptor);
+        bool found = false;
+        if (result == ERROR_SUCCESS && dacl != NULL) {
+            DWORD wanted = AccessMask(grant.access);
+            BYTE inheritFlags = OBJECT_INHERIT_ACE | CONTAINER_INHERIT_ACE;
+            for (DWORD i = 0; i < dacl->AceCount && !found; i++) {
+                ACE_HEADER* header = NULL;
+                if (!GetAce(dacl, i, reinterpret_cast<void**>(&header)) ||
+                    header->AceType != ACCESS_ALLOWED_ACE_TYPE) {
+                    continue;
+                }
+                auto ace = reinterpret_cast<ACCESS_ALLOWED_ACE*>(header);
+                if (!EqualSid(reinterpret_cast<PSID>(&ace->SidStart), sid) ||
+                    (ace->Mask & wanted) != wanted) {
+                    continue;
+                }
+                found = !grant.inherit || (header->AceFlags & inheritFlags) == inheritFlags;
+            }
+        } else if (result != ERROR_SUCCESS) {
+            *error = "GetNamedSecurityInfo failed for " + grant.path + ": " +
+                     std::to_string(result);
+        }
+        LocalFree(descriptor);
+        LocalFree(sid);
+        return found;
+    }
+
+    bool Apply(const std::string& principal, const Grant& grant, std::string* error) override {
+        PSID sid = NULL;
+        if (!ConvertStringSidToSidA(principal.c_str(), &sid)) {
+            *error = "Invalid SID " + principal;
+            return false;
+        }
+        std::wstring path = Widen(grant.path);
+        PACL oldDacl = NULL;
+        PSECURITY_DESCRIPTOR descriptor = NULL;
+        DWORD result = GetNamedSecurityInfoW(path.c_str(), SE_FILE_OBJECT,
+                                             DACL_SECURITY_INFORMATION, NULL, NULL, &oldDacl,
+                                             NULL, &descriptor);
+        if (result != ERROR_SUCCESS) {
+            *error = "Failed to get security info for " + grant.path + ": " +
+                     std::to_string(result);
+            LocalFree(sid);
+            return false;
+        }
+
+        EXPLICIT_ACCESSW access = {0};
+        access.grfAccessPermissions = AccessMask(grant.access);
+        // GRANT_ACCESS merges with the trustee's other ACEs; SET_ACCESS would
+        // drop them, and Plan() may give one path an inheritable and an
+        // object-only grant.
+        access.grfAccessMode = GRANT_ACCESS;
+        access.grfInheritance = grant.inherit ? SUB_CONTAINERS_AND_OBJECTS_INHERIT : NO_INHERITANCE;
+        access.Trustee.TrusteeForm = TRUSTEE_IS_SID;
+        access.Trustee.TrusteeType = TRUSTEE_IS_USER;
+        access.Trustee.ptstrName = reinterpret_cast<LPWSTR>(sid);
+
+        PACL newDacl = NULL;
+        result = SetEntriesInAclW(1, &access, oldDacl, &newDacl);
+        if (result == ERROR_SUCCESS) {
+            result = SetNamedSecurityInfoW(&path[0], SE_FILE_OBJECT, DACL_SECURITY_INFORMATION,
+                                           NULL, NULL, newDacl, NULL);
+            if (result == ERROR_SUCCESS) {
+                aclWrites_++;
+            } else {
+                *error = "Failed to set security info for " + grant.path + ": " +
+                         std::to_string(result);
+            }
+        } else {
+            *error = "Failed to create new ACL for " + grant.path + ": " + std::to_string(result);
+        }
+        LocalFree(newDacl);
+        LocalFree(descriptor);
+        LocalFree(sid);
+        return result == ERROR_SUCCESS;
+    }
+};
+
+#else
+
+// On-disk layout of system.posix_acl_access / system.posix_acl_default.
+constexpr uint32_t kAclVersion = 2;
+constexpr uint16_t kAclUserObj = 0x01;
+constexpr uint16_t kAclUser = 0x02;
+constexpr uint16_t kAclGroupObj = 0x04;
+constexpr uint16_t kAclGroup = 0x08;
+constexpr uint16_t kAclMask = 0x10;
+constexpr uint16_t kAclOther = 0x20;
+constexpr uint32_t kAclUndefinedId = 0xFFFFFFFF;
+const char* const kAccessAclName = "system.posix_acl_access";
+const char* const kDefaultAclName = "system.posix_acl_default";
+
+struct AclEntry {
+    uint16_t tag;
+    uint16_t perm;
+    uint32_t id;
+};
+
+uint16_t PosixPerm(uint32_t access) {
+    return static_cast<uint16_t>(((access & kGrantRead) ? 4 : 0) |
+                                 ((access & kGrantWrite) ? 2 : 0) |
+                                 ((access & kGrantExecute) ? 1 : 0));
+}
+
+// Reads an ACL xattr. A missing ACL is returned as the three entries that
+// the file mode implies.
+bool ReadAcl(const std::string& path, const char* name, mode_t mode, std::vector<AclEntry>* acl) {
+    acl->clear();
+    ssize_t length = getxattr(path.c_str(), name, nullptr, 0);
+    std::vector<uint8_t> buffer(length > 0 ? static_cast<size_t>(length) : 0);
+    if (length > 0) {
+        length = getxattr(path.c_str(), name, buffer.data(), buffer.size());
+    }
+    if (length < 0) {
+        if (errno != ENODATA) {
+            return false;
+        }
+        acl->push_back({kAclUserObj, static_cast<uint16_t>((mode >> 6) & 7), kAclUndefinedId});
+        acl->push_back({kAclGroupObj, static_cast<uint16_t>((mode >> 3) & 7), kAclUndefinedId});
+        acl->push_back({kAclOther, static_cast<uint16_t>(mode & 7), kAclUndefinedId});
+        return true;
+    }
+    uint32_t version = 0;
+    if (length >= 4) {
+        memcpy(&version, buffer.data(), 4);
+    }
+    if (version != kAclVersion || (length - 4) % 8 != 0) {
+        errno = EINVAL;
+        return false;
+    }
+    for (ssize_t offset = 4; offset < length; offset += 8) {
+        AclEntry entry;
+        memcpy(&entry.tag, &buffer[offset], 2);
+        memcpy(&entry.perm, &buffer[offset + 2], 2);
+        memcpy(&entry.id, &buffer[offset + 4], 4);
+        acl->push_back(entry);
+    }
+    return true;
+}
+
+bool WriteAcl(const std::string& path, const char* name, const std::vector<AclEntry>& acl) {
+    std::vector<uint8_t> buffer(4 + 8 * acl.size());
+    memcpy(buffer.data(), &kAclVersion, 4);
+    for (size_t i = 0; i < acl.size(); i++) {
+        memcpy(buffer.data() + 4 + i * 8, &acl[i].tag, 2);
+        memcpy(buffer.data() + 6 + i * 8, &acl[i].perm, 2);
+        memcpy(buffer.data() + 8 + i * 8, &acl[i].id, 4);
+    }
+    return setxattr(path.c_str(), name, buffer.data(), buffer.size(), 0) == 0;
+}
+
+const AclEntry* FindUser(const std::vector<AclEntry>& acl, uint32_t uid) {
+    for (const AclEntry& entry : acl) {
+        if (entry.tag == kAclUser && entry.id == uid) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool AclGrants(const std::vector<AclEntry>& acl, uint32_t uid, uint16_t perm) {
+    const AclEntry* user = FindUser(acl, uid);
+    if (user == nullptr || (user->perm & perm) != perm) {
+        return false;
+    }
+    for (const AclEntry& entry : acl) {
+        if (entry.tag == kAclMask) {
+            return (entry.perm & perm) == perm;
+        }
+    }
+    return true;
+}
+
+// Adds perm for uid and recomputes the mask the way setfacl does: the union
+// of the group class (owning group, named users and named groups).
+void AddUser(std::vector<AclEntry>* acl, uint32_t uid, uint16_t perm) {
+    bool found = false;
+    for (AclEntry& entry : *acl) {
+        if (entry.tag == kAclUser && entry.id == uid) {
+            entry.perm |= perm;
+            found = true;
+        }
+    }
+    if (!found) {
+        acl->push_back({kAclUser, perm, uid});
+    }
+    uint16_t mask = 0;
+    bool haveMask = false;
+    for (const AclEntry& entry : *acl) {
+        if (entry.tag == kAclUser || entry.tag == kAclGroup || entry.tag == kAclGroupObj) {
+            mask |= entry.perm;
+        }
+        haveMask = haveMask || entry.tag == kAclMask;
+    }
+    if (!haveMask) {
+        acl->push_back({kAclMask, mask, kAclUndefinedId});
+    }
+    for (AclEntry& entry : *acl) {
+        if (entry.tag == kAclMask) {
+            entry.perm = mask;
+        }
+    }
+    // The kernel requires entries ordered by tag, then id.
+    std::sort(acl->begin(), acl->end(), [](const AclEntry& a, const AclEntry& b) {
+        return a.tag != b.tag ? a.tag < b.tag : a.id < b.id;
+    });
+}
+
+class PosixGrantBackend : public GrantBackend {
+public:
+    std::string PathKey(const std::string& path) const override {
+        return GenericKey(path, false);
+    }
+
+    bool Stamp(const std::string& path, std::string* stamp) const override {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            return false;
+        }
+        // st_ctim moves on every ACL (and other metadata) change.
+        *stamp = std::to_string(st.st_dev) + ":" + std::to_string(st.st_ino) + ":" +
+                 std::to_string(st.st_ctim.tv_sec) + "." + std::to_string(st.st_ctim.tv_nsec);
+        return true;
+    }
+
+    bool HasGrant(const std::string& principal, const Grant& grant,
+                  std::string* error) const override {
+        uint32_t uid = static_cast<uint32_t>(strtoul(principal.c_str(), nullptr, 10));
+        uint16_t perm = PosixPerm(grant.access);
+        struct stat st;
+        std::vector<AclEntry> acl;
+        if (stat(grant.path.c_str(), &st) != 0 ||
+            !ReadAcl(grant.path, kAccessAclName, st.st_mode, &acl)) {
+            *error = "Failed to read ACL of " + grant.path + ": " + strerror(errno);
+            return false;
+        }
+        if (!AclGrants(acl, uid, perm)) {
+            return false;
+        }
+        if (!grant.inherit || !S_ISDIR(st.st_mode)) {
+            return true;
+        }
+        std::vector<AclEntry> defaults;
+        ssize_t present = getxattr(grant.path.c_str(), kDefaultAclName, nullptr, 0);
+        return present > 0 && ReadAcl(grant.path, kDefaultAclName, st.st_mode, &defaults) &&
+               AclGrants(defaults, uid, perm);
+    }
+
+    bool Apply(const std::string& principal, const Grant& grant, std::string* error) override {
+        uint32_t uid = static_cast<uint32_t>(strtoul(principal.c_str(), nullptr, 10));
+        uint16_t perm = PosixPerm(grant.access);
+        if (!ApplyOne(grant.path, uid, perm, grant.inherit, error)) {
+            return false;
+        }
+        if (!grant.inherit) {
+            return true;
+        }
+        // Default ACLs only reach files created later; existing descendants
+        // get the entry explicitly, as SetNamedSecurityInfo's propagation does.
+        // A walk that stops early must fail: the planner would otherwise
+        // index the subtree as granted when part of it was never reached.
+        std::error_code ec;
+        fs::recursive_directory_iterator it(grant.path, ec), end;
+        while (!ec && it != end) {
+            bool symlink = it->is_symlink(ec);
+            if (ec) {
+                break;
+            }
+            if (!symlink && !ApplyOne(it->path().string(), uid, perm, true, error)) {
+                return false;
+            }
+            it.increment(ec);
+        }
+        if (ec) {
+            *error = "Failed to walk " + grant.path + ": " + ec.message();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool ApplyOne(const std::string& path, uint32_t uid, uint16_t perm, bool inherit,
+                  std::string* error) {
+        struct stat st;
+        std::vector<AclEntry> acl;
+        if (stat(path.c_str(), &st) != 0 || !ReadAcl(path, kAccessAclName, st.st_mode, &acl)) {
+            *error = "Failed to read ACL of " + path + ": " + strerror(errno);
+            return false;
+        }
+        AddUser(&acl, uid, perm);
+        if (!WriteAcl(path, kAccessAclName, acl)) {
+            *error = "Failed to set ACL of " + path + ": " + strerror(errno);
+            return false;
+        }
+        aclWrites_++;
+        if (inherit && S_ISDIR(st.st_mode)) {
+            std::vector<AclEntry> defaults;
+            ssize_t present = getxattr(path.c_str(), kDefaultAclName, nullptr, 0);
+            if (present > 0) {
+                ReadAcl(path, kDefaultAclName, st.st_mode, &defaults);
+            } else {
+                // Seed the default ACL from the access ACL, as setfacl -d does.
+                defaults = acl;
+            }
+            AddUser(&defaults, uid, perm);
+            if (!WriteAcl(path, kDefaultAclName, defaults)) {
+                *error = "Failed to set default ACL of " + path + ": " + strerror(errno);
+                return false;
+            }
+            aclWrites_++;
+        }
+        return true;
+    }
+};
+
+#endif
+
+}  // namespace
+
+std::unique_ptr<GrantBackend> CreatePlatformGrantBackend() {
+#ifdef _WIN32
+    return std::unique_ptr<GrantBackend>(new WindowsGrantBackend());
+#else
+    return std::unique_ptr<GrantBackend>(new PosixGrantBackend());
+#endif
+}
+
+}  // namespace sandbox
@@ -0,0 +1,211 @@
+#include "grant_plan.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace sandbox {
+
+namespace {
+
+bool IsSameOrDescendant(const std::string& key, const std::string& ancestorKey) {
+    if (key.size() < ancestorKey.size() || key.compare(0, ancestorKey.size(), ancestorKey) != 0) {
+        return false;
+    }
+    return key.size() == ancestorKey.size() || key[ancestorKey.size()] == '/' ||
+           (!ancestorKey.empty() && ancestorKey.back() == '/');
+}
+
+}  // namespace
+
+GrantPlanner::GrantPlanner(GrantBackend& backend, std::string principal, std::string indexPath)
+    : backend_(backend), principal_(std::move(principal)), indexPath_(std::move(indexPath)) {}
+
+void GrantPlanner::Add(const std::string& path, uint32_t access, bool inherit) {
+    if (path.empty()) {
+        return;
+    }
+    Grant grant;
+    grant.path = path;
+    grant.access = access;
+    grant.inherit = inherit;
+    requests_.push_back(grant);
+}
+
+std::vector<Grant> GrantPlanner::Plan() const {
+    // Merge requests for the same object first, keeping what the subtree
+    // inherits apart from what only the object itself needs: OR-ing both
+    // into one inheritable grant would pass object-only access down.
+    struct Merged {
+        std::string path;
+        uint32_t inheritAccess = 0;
+        uint32_t objectAccess = 0;
+    };
+    std::map<std::string, Merged> merged;
+    for (const Grant& request : requests_) {
+        Merged& entry = merged[backend_.PathKey(request.path)];
+        if (entry.path.empty()) {
+            entry.path = request.path;
+        }
+        (request.inherit ? entry.inheritAccess : entry.objectAccess) |= request.access;
+    }
+
+    // Keys sort parents before children, and a path's inheritable grant
+    // comes before its object-only one, so every potential cover of a grant
+    // has already been kept or dropped when the grant is reached.
+    std::vector<std::pair<std::string, Grant>> kept;
+    auto keep = [&kept](const std::string& key, const std::string& path, uint32_t access,
+                        bool inherit) {
+        for (const auto& ancestor : kept) {
+            if (ancestor.second.inherit && IsSameOrDescendant(key, ancestor.first) &&
+                (access & ~ancestor.second.access) == 0) {
+                return;
+            }
+        }
+        Grant grant;
+        grant.path = path;
+        grant.access = access;
+        grant.inherit = inherit;
+        kept.emplace_back(key, grant);
+    };
+    for (const auto& entry : merged) {
+        if (entry.second.inheritAccess != 0) {
+            keep(entry.first, entry.second.path, entry.second.inheritAccess, true);
+        }
+        if (entry.second.objectAccess != 0) {
+            keep(entry.first, entry.second.path, entry.second.objectAccess, false);
+        }
+    }
+
+    std::vector<Grant> plan;
+    plan.reserve(kept.size());
+    for (auto& entry : kept) {
+        plan.push_back(std::move(entry.second));
+    }
+    return plan;
+}
+
+bool GrantPlanner::Execute(GrantPlanStats* stats, std::string* error) {
+    *stats = GrantPlanStats();
+    stats->requested = requests_.size();
+    std::vector<Grant> plan = Plan();
+    stats->planned = plan.size();
+    requests_.clear();
+    LoadIndex();
+
+    bool indexChanged = false;
+    for (const Grant& grant : plan) {
+        std::string key = backend_.PathKey(grant.path);
+        std::string stamp;
+        bool haveStamp = backend_.Stamp(grant.path, &stamp);
+
+        IndexEntry* entry = FindIndexEntry(key);
+        uint32_t indexed = entry == nullptr ? 0
+                           : grant.inherit ? entry->inheritAccess
+                                           : entry->access;
+        if (entry != nullptr && haveStamp && entry->stamp == stamp &&
+            (grant.access & ~indexed) == 0) {
+            stats->indexed++;
+            continue;
+        }
+
+        std::string checkError;
+        if (backend_.HasGrant(principal_, grant, &checkError)) {
+            stats->alreadyPresent++;
+        } else {
+            if (!backend_.Apply(principal_, grant, error)) {
+                return false;
+            }
+            stats->applied++;
+            // The ACL write moved the change time.
+            haveStamp = backend_.Stamp(grant.path, &stamp);
+        }
+        if (!haveStamp) {
+            continue;
+        }
+        if (entry == nullptr) {
+            index_.push_back(IndexEntry());
+            entry = &index_.back();
+            entry->principal = principal_;
+            entry->key = key;
+        }
+        entry->access |= grant.access;
+        if (grant.inherit) {
+            entry->inheritAccess |= grant.access;
+        }
+        entry->stamp = stamp;
+        indexChanged = true;
+    }
+    return !indexChanged || SaveIndex(error);
+}
+
+GrantPlanner::IndexEntry* GrantPlanner::FindIndexEntry(const std::string& key) {
+    for (IndexEntry& entry : index_) {
+        if (entry.principal == principal_ && entry.key == key) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+// Index format, one object per line:
+//   principal \t access \t inherited access \t stamp \t key
+void GrantPlanner::LoadIndex() {
+    if (indexLoaded_ || indexPath_.empty()) {
+        return;
+    }
+    indexLoaded_ = true;
+    std::ifstream in(indexPath_);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (fields.size() < 4 && std::getline(stream, field, '\t')) {
+            fields.push_back(field);
+        }
+        std::getline(stream, field);
+        if (fields.size() != 4 || field.empty()) {
+            continue;
+        }
+        IndexEntry entry;
+        entry.principal = fields[0];
+        entry.access = static_cast<uint32_t>(strtoul(fields[1].c_str(), nullptr, 10));
+        entry.inheritAccess = static_cast<uint32_t>(strtoul(fields[2].c_str(), nullptr, 10));
+        entry.stamp = fields[3];
+        entry.key = field;
+        index_.push_back(std::move(entry));
+    }
+}
+
+bool GrantPlanner::SaveIndex(std::string* error) const {
+    if (indexPath_.empty()) {
+        return true;
+    }
+    // Write-then-rename so a crash never leaves a truncated index.
+    std::string temporary = indexPath_ + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        for (const IndexEntry& entry : index_) {
+            out << entry.principal << '\t' << entry.access << '\t' << entry.inheritAccess
+                << '\t' << entry.stamp << '\t' << entry.key << '\n';
+        }
+        if (!out) {
+            *error = "Failed to write " + temporary;
+            return false;
+        }
+    }
+#ifdef _WIN32
+    std::remove(indexPath_.c_str());
+#endif
+    if (std::rename(temporary.c_str(), indexPath_.c_str()) != 0) {
+        *error = "Failed to replace " + indexPath_;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace sandbox
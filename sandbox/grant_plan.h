@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Plans and applies the filesystem grants a sandboxed launch needs. Requests
+// are collapsed (a subtree grant covers everything below it) and diffed
+// against a persisted index of grants already in place, so repeat launches
+// read at most a few ACLs and write none.
+namespace sandbox {
+
+enum GrantAccess : uint32_t {
+    kGrantRead = 1,
+    kGrantWrite = 2,
+    kGrantExecute = 4,
+    kGrantAll = kGrantRead | kGrantWrite | kGrantExecute,
+};
+
+struct Grant {
+    std::string path;
+    uint32_t access = kGrantAll;
+    // Applies to the whole subtree (SUB_CONTAINERS_AND_OBJECTS_INHERIT, or a
+    // default ACL plus existing descendants on POSIX).
+    bool inherit = true;
+};
+
+// ACL operations for one platform. The principal is an SID string on
+// Windows and a numeric uid on POSIX.
+class GrantBackend {
+public:
+    virtual ~GrantBackend() = default;
+
+    // Comparison key for a path: '/' separators, no trailing separator, and
+    // case-folded where the filesystem is case-insensitive.
+    virtual std::string PathKey(const std::string& path) const = 0;
+
+    // Cheap identity of the object's current security state (file id plus
+    // change time). When it matches the index, the ACL is not even read.
+    virtual bool Stamp(const std::string& path, std::string* stamp) const = 0;
+
+    // Whether the ACL already grants at least grant.access to the principal,
+    // inheritably when grant.inherit is set.
+    virtual bool HasGrant(const std::string& principal, const Grant& grant,
+                          std::string* error) const = 0;
+
+    virtual bool Apply(const std::string& principal, const Grant& grant, std::string* error) = 0;
+
+    // ACL writes issued so far, counting every object touched while
+    // propagating an inheritable grant.
+    uint64_t AclWrites() const { return aclWrites_; }
+
+protected:
+    uint64_t aclWrites_ = 0;
+};
+
+std::unique_ptr<GrantBackend> CreatePlatformGrantBackend();
+
+struct GrantPlanStats {
+    size_t requested = 0;
+    size_t planned = 0;        // after collapsing
+    size_t indexed = 0;        // skipped on the index alone
+    size_t alreadyPresent = 0; // ACL read, nothing to do
+    size_t applied = 0;
+};
+
+class GrantPlanner {
+public:
+    // indexPath may be empty to run without a persisted index.
+    GrantPlanner(GrantBackend& backend, std::string principal, std::string indexPath);
+
+    void Add(const std::string& path, uint32_t access = kGrantAll, bool inherit = true);
+
+    // Merges duplicate paths and drops every request already covered by an
+    // inheritable request for the path or an ancestor with at least the same
+    // access. A path's inheritable and object-only access stay apart, so it
+    // can come out as two grants; neither widens what the other passes down.
+    std::vector<Grant> Plan() const;
+
+    // Applies the plan, touching only ACLs that are missing the grant, and
+    // updates the index. Requests are cleared afterwards so the planner can
+    // be reused for later grants.
+    bool Execute(GrantPlanStats* stats, std::string* error);
+
+private:
+    struct IndexEntry {
+        std::string principal;
+        std::string key;
+        uint32_t access = 0;         // on the object itself
+        uint32_t inheritAccess = 0;  // also passed down to the subtree
+        std::string stamp;
+    };
+
+    void LoadIndex();
+    bool SaveIndex(std::string* error) const;
+    IndexEntry* FindIndexEntry(const std::string& key);
+
+    GrantBackend& backend_;
+    std::string principal_;
+    std::string indexPath_;
+    std::vector<Grant> requests_;
+    std::vector<IndexEntry> index_;
+    bool indexLoaded_ = false;
+};
+
+}  // namespace sandbox
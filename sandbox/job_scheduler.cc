@@ -0,0 +1,491 @@
+#include "job_scheduler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "supervisor.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+#endif
+
+namespace sandbox {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double SecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int Milliseconds(double seconds) {
+    return static_cast<int>(std::min(seconds * 1000, 2e9));
+}
+
+// The CPUs this process may run on, in order.
+std::vector<int> UsableCpus() {
+    std::vector<int> cpus;
+#if defined(_WIN32)
+    DWORD_PTR processMask = 0, systemMask = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+        for (int cpu = 0; cpu < static_cast<int>(sizeof(DWORD_PTR) * 8); cpu++) {
+            if (processMask & (static_cast<DWORD_PTR>(1) << cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
+
+std::string DirectoryOf(const std::string& path) {
+    size_t end = path.find_last_of("/\\");
+    if (end == std::string::npos) {
+        return ".";
+    }
+    return end == 0 ? path.substr(0, 1) : path.substr(0, end);
+}
+
+#ifdef _WIN32
+std::wstring Widen(const std::string& text) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, NULL, 0);
+    std::wstring wide(length > 0 ? length - 1 : 0, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, &wide[0], length);
+    return wide;
+}
+#endif
+
+// The job's output file, handed to the child as stdout and stderr.
+class JobOutput {
+public:
+    ~JobOutput() {
+#ifdef _WIN32
+        if (handle_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(handle_);
+        }
+#else
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+#endif
+    }
+
+    bool Open(const std::string& path, std::string* error) {
+#ifdef _WIN32
+        SECURITY_ATTRIBUTES attributes = {sizeof(attributes), NULL, TRUE};
+        handle_ = CreateFileW(Widen(path).c_str(), GENERIC_WRITE, FILE_SHARE_READ, &attributes,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (handle_ == INVALID_HANDLE_VALUE) {
+            *error = "Cannot create " + path + ": error " + std::to_string(GetLastError());
+            return false;
+        }
+#else
+        // Close-on-exec: only the dup2'd copies reach this job, none leak
+        // into jobs started concurrently from other slots.
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            *error = "Cannot create " + path + ": " + strerror(errno);
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    void Attach(LaunchCommand* command) const {
+#ifdef _WIN32
+        command->stdOutput = handle_;
+        command->stdError = handle_;
+#else
+        command->stdoutFd = fd_;
+        command->stderrFd = fd_;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+};
+
+}  // namespace
+
+bool ParseJobSpec(const std::string& line, JobSpec* spec, bool* empty, std::string* error) {
+    std::vector<std::string> tokens;
+    std::string token;
+    bool inToken = false;
+    bool quoted = false;
+    for (char c : line) {
+        if (c == '"') {
+            quoted = !quoted;
+            inToken = true;
+        } else if ((c == ' ' || c == '\t' || c == '\r' || c == '\n') && !quoted) {
+            if (inToken) {
+                tokens.push_back(token);
+                token.clear();
+                inToken = false;
+            }
+        } else {
+            token += c;
+            inToken = true;
+        }
+    }
+    if (quoted) {
+        *error = "Unterminated quote";
+        return false;
+    }
+    if (inToken) {
+        tokens.push_back(token);
+    }
+    *empty = tokens.empty() || tokens[0][0] == '#';
+    if (*empty) {
+        return true;
+    }
+
+    size_t i = 0;
+    for (; i < tokens.size(); i++) {
+        size_t equals = tokens[i].find('=');
+        if (equals == std::string::npos) {
+            break;
+        }
+        std::string key = tokens[i].substr(0, equals);
+        std::string value = tokens[i].substr(equals + 1);
+        if (key == "name") {
+            spec->name = value;
+        } else if (key == "priority") {
+            spec->priority = atoi(value.c_str());
+        } else if (key == "timeout") {
+            spec->timeoutSeconds = atof(value.c_str());
+        } else if (key == "read") {
+            spec->readPaths.push_back(value);
+        } else if (key == "write") {
+            spec->writePaths.push_back(value);
+        } else if (key == "cwd") {
+            spec->cwd = value;
+        } else if (key == "python") {
+            spec->interpreter = value;
+        } else if (key == "output") {
+            spec->outputPath = value;
+        } else {
+            break;  // a script path that contains '='
+        }
+    }
+    if (i == tokens.size()) {
+        *error = "No script";
+        return false;
+    }
+    spec->script = tokens[i];
+    spec->args.assign(tokens.begin() + static_cast<ptrdiff_t>(i) + 1, tokens.end());
+    return true;
+}
+
+struct JobScheduler::Job {
+    size_t id = 0;
+    JobSpec spec;
+    Clock::time_point submitted;
+    uint64_t generation = 0;  // cancelGeneration_ when it was taken
+    JobResult result;
+};
+
+struct JobScheduler::Slot {
+    unsigned index = 0;
+    int cpu = -1;
+    std::mutex mutex;  // the running process
+    LaunchedProcess process;
+    bool running = false;
+    bool cancelled = false;
+};
+
+JobScheduler::JobScheduler() = default;
+
+JobScheduler::~JobScheduler() {
+    Cancel();
+    Stop();
+}
+
+bool JobScheduler::Start(const SchedulerOptions& options, std::string* error) {
+    if (!threads_.empty()) {
+        *error = "The scheduler is already running";
+        return false;
+    }
+    options_ = options;
+    std::vector<int> cpus = UsableCpus();
+    unsigned count = options_.slots;
+    if (count == 0) {
+        count = !cpus.empty() ? static_cast<unsigned>(cpus.size())
+                              : std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < count; i++) {
+        std::unique_ptr<Slot> slot(new Slot());
+        slot->index = i;
+        if (options_.pinSlots && !cpus.empty()) {
+            slot->cpu = cpus[i % cpus.size()];
+        }
+        slots_.push_back(std::move(slot));
+    }
+    // A launcher for the base policy up front, so a policy that cannot be
+    // set up fails here instead of in every job.
+    if (options_.sandboxed && LauncherFor(JobSpec(), error) == nullptr) {
+        slots_.clear();
+        return false;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        threads_.emplace_back([this, i] { SlotLoop(i); });
+    }
+    return true;
+}
+
+size_t JobScheduler::Submit(JobSpec spec) {
+    std::unique_ptr<Job> job(new Job());
+    job->spec = std::move(spec);
+    job->submitted = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    job->id = jobs_.size();
+    Job* queued = job.get();
+    jobs_.push_back(std::move(job));
+    unfinished_++;
+    queue_.emplace(std::make_pair(-queued->spec.priority, queued->id), queued);
+    workAvailable_.notify_one();
+    return queued->id;
+}
+
+void JobScheduler::Wait(std::vector<JobResult>* results) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobEnded_.wait(lock, [this] { return unfinished_ == 0; });
+    results->clear();
+    for (const std::unique_ptr<Job>& job : jobs_) {
+        results->push_back(job->result);
+    }
+}
+
+void JobScheduler::Cancel() {
+    std::vector<Job*> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelGeneration_++;
+        for (const auto& entry : queue_) {
+            dropped.push_back(entry.second);
+        }
+        queue_.clear();
+        for (const std::unique_ptr<Slot>& slot : slots_) {
+            std::lock_guard<std::mutex> slotLock(slot->mutex);
+            // The slot clears `running` before it reaps the process, so the
+            // pid is still ours here.
+            if (slot->running) {
+                slot->cancelled = true;
+                KillProcess(slot->process, true);
+            }
+        }
+    }
+    for (Job* job : dropped) {
+        job->result.outcome = JobOutcome::kCancelled;
+        job->result.error = "Cancelled";
+        Finish(*job);
+    }
+}
+
+void JobScheduler::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    workAvailable_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+}
+
+// The most urgent job, waiting for one; nullptr once the scheduler stops
+// and the queue is empty.
+JobScheduler::Job* JobScheduler::TakeJob() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    workAvailable_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+    if (queue_.empty()) {
+        return nullptr;
+    }
+    Job* job = queue_.begin()->second;
+    queue_.erase(queue_.begin());
+    job->generation = cancelGeneration_.load();
+    return job;
+}
+
+void JobScheduler::SlotLoop(unsigned index) {
+    Slot& slot = *slots_[index];
+#ifdef __linux__
+    // Children are cloned from this thread and inherit its mask.
+    if (slot.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(slot.cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+#endif
+    for (;;) {
+        Job* job = TakeJob();
+        if (job == nullptr) {
+            return;
+        }
+        RunJob(slot, *job);
+        Finish(*job);
+    }
+}
+
+SandboxLauncher* JobScheduler::LauncherFor(const JobSpec& spec, std::string* error) {
+    std::vector<std::string> readPaths = spec.readPaths;
+    if (!spec.script.empty()) {
+        readPaths.push_back(DirectoryOf(spec.script));
+    }
+    std::vector<std::string> writePaths = spec.writePaths;
+    std::sort(readPaths.begin(), readPaths.end());
+    readPaths.erase(std::unique(readPaths.begin(), readPaths.end()), readPaths.end());
+    std::sort(writePaths.begin(), writePaths.end());
+    writePaths.erase(std::unique(writePaths.begin(), writePaths.end()), writePaths.end());
+    std::string key;
+    for (const std::string& path : readPaths) {
+        key += "r" + path + '\n';
+    }
+    for (const std::string& path : writePaths) {
+        key += "w" + path + '\n';
+    }
+
+    std::lock_guard<std::mutex> lock(launchersMutex_);
+    std::unique_ptr<SandboxLauncher>& launcher = launchers_[key];
+    if (launcher == nullptr) {
+        SandboxPolicy policy = options_.basePolicy;
+        policy.readPaths.insert(policy.readPaths.end(), readPaths.begin(), readPaths.end());
+        policy.writePaths.insert(policy.writePaths.end(), writePaths.begin(), writePaths.end());
+        if (!key.empty()) {
+            // One AppContainer profile per directory set: grants go to the
+            // profile's SID, so sharing one would share every job's grants.
+            char suffix[24];
+            snprintf(suffix, sizeof(suffix), ".%016llx",
+                     (unsigned long long)std::hash<std::string>()(key));
+            policy.name += suffix;
+        }
+        launcher = SandboxLauncher::Create(policy, error);
+        if (launcher == nullptr) {
+            launchers_.erase(key);
+            return nullptr;
+        }
+    }
+    return launcher.get();
+}
+
+void JobScheduler::RunJob(Slot& slot, Job& job) {
+    const JobSpec& spec = job.spec;
+    JobResult& result = job.result;
+    result.slot = slot.index;
+    result.cpu = slot.cpu;
+
+    LaunchCommand command;
+    command.argv.push_back(spec.interpreter);
+    command.argv.push_back(spec.script);
+    command.argv.insert(command.argv.end(), spec.args.begin(), spec.args.end());
+    command.cwd = spec.cwd;
+#ifdef _WIN32
+    command.creationFlags = CREATE_NO_WINDOW;
+#endif
+    JobOutput output;
+    if (!spec.outputPath.empty()) {
+        if (!output.Open(spec.outputPath, &result.error)) {
+            return;
+        }
+        output.Attach(&command);
+    }
+    SandboxLauncher* launcher = nullptr;
+    if (options_.sandboxed && (launcher = LauncherFor(spec, &result.error)) == nullptr) {
+        return;
+    }
+
+    Clock::time_point start = Clock::now();
+    result.queuedSeconds = std::chrono::duration<double>(start - job.submitted).count();
+    LaunchedProcess process;
+    bool started = launcher != nullptr ? launcher->Spawn(command, &process, &result.error)
+                                       : SpawnProcess(command, &process, &result.error);
+    if (!started) {
+        return;
+    }
+#ifdef _WIN32
+    if (slot.cpu >= 0) {
+        SetProcessAffinityMask(process.process, static_cast<DWORD_PTR>(1) << slot.cpu);
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.process = process;
+        slot.running = true;
+        slot.cancelled = job.generation != cancelGeneration_.load();
+        if (slot.cancelled) {
+            KillProcess(process, true);
+        }
+    }
+
+    bool timedOut = false;
+    if (!AwaitExit(process, spec.timeoutSeconds > 0 ? Milliseconds(spec.timeoutSeconds) : -1)) {
+        timedOut = true;
+        KillProcess(process, false);
+        if (!AwaitExit(process, Milliseconds(options_.killGraceSeconds))) {
+            KillProcess(process, true);
+            AwaitExit(process, -1);
+        }
+    }
+    // Exited but not yet reaped: the final CPU times are still readable.
+    std::string sampleError;
+    std::unique_ptr<ProcessSampler> sampler = ProcessSampler::Create(process, &sampleError);
+    ProcessSample sample;
+    if (sampler != nullptr && sampler->Sample(&sample)) {
+        result.cpuSeconds = sample.cpuSeconds;
+    }
+    sampler.reset();
+    bool cancelled;
+    {
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        slot.running = false;
+        cancelled = slot.cancelled;
+    }
+    bool exited = false;
+    if (!WaitProcess(&process, -1, &exited, &result.exitCode, &result.error)) {
+        return;
+    }
+    result.runSeconds = SecondsSince(start);
+    result.outcome = cancelled  ? JobOutcome::kCancelled
+                     : timedOut ? JobOutcome::kTimedOut
+                                : JobOutcome::kExited;
+}
+
+void JobScheduler::Finish(Job& job) {
+    if (options_.onFinished) {
+        options_.onFinished(job.id, job.spec, job.result);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    unfinished_--;
+    if (unfinished_ == 0) {
+        jobEnded_.notify_all();
+    }
+}
+
+}  // namespace sandbox
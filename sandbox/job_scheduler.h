@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "launcher.h"
+
+// Runs batches of sandboxed scripts, many at a time.
+//
+// A fixed set of slots (one per usable CPU by default) each runs one job
+// process at a time. Jobs wait in one queue ordered by priority, then
+// submission; a slot that becomes free takes the first, so no slot idles
+// while any job waits. A slot holds the queue's lock only to pop a job,
+// which is negligible next to the process launch that follows.
+//
+// Jobs run through a SandboxLauncher built from the base policy plus the
+// job's own directories. Launchers are cached by directory set, so the
+// namespace template / AppContainer profile of a set is prepared once
+// however many jobs use it, and jobs never see each other's directories.
+// With pinning, slot i is tied to the i-th CPU this process may use: on
+// Linux the slot thread pins itself and its children inherit the mask from
+// the clone, on Windows the child's affinity is set after creation.
+namespace sandbox {
+
+struct JobSpec {
+    std::string name;  // for reports; empty = the script's path
+    std::string interpreter = "python3";
+    std::string script;
+    std::vector<std::string> args;
+    // Added to the scheduler's base policy for this job only.
+    std::vector<std::string> readPaths;
+    std::vector<std::string> writePaths;
+    std::string cwd;  // empty = the scheduler's cwd
+    // Higher runs first; equal priorities run in submission order.
+    int priority = 0;
+    // Wall-clock limit; 0 = none. An overdue job gets a termination
+    // request, then is killed after the scheduler's grace period.
+    double timeoutSeconds = 0;
+    // stdout and stderr of the job, truncated first; empty inherits ours.
+    std::string outputPath;
+};
+
+// Parses one line of a job file: options, the script, then its arguments.
+// Tokens are separated by spaces or tabs; double quotes group a token.
+// Options before the script are name=, priority=, timeout=, read=, write=
+// (both repeatable), cwd=, python= (the interpreter) and output=.
+// Fields the line does not set keep the values *spec has, so callers can
+// preset defaults. Blank lines and lines starting with '#' set *empty.
+bool ParseJobSpec(const std::string& line, JobSpec* spec, bool* empty, std::string* error);
+
+enum class JobOutcome {
+    kExited,      // exitCode is the job's own
+    kTimedOut,    // killed after timeoutSeconds
+    kNotStarted,  // error says why
+    kCancelled,   // dropped from the queue or killed by Cancel()
+};
+
+struct JobResult {
+    JobOutcome outcome = JobOutcome::kNotStarted;
+    int exitCode = -1;
+    std::string error;
+    unsigned slot = 0;
+    int cpu = -1;               // the CPU the slot is pinned to, -1 if none
+    double queuedSeconds = 0;   // from Submit() to the launch
+    double runSeconds = 0;      // from the launch to the exit
+    double cpuSeconds = 0;      // user + system time of the job process
+};
+
+struct SchedulerOptions {
+    // Concurrent jobs; 0 = one per CPU this process may use.
+    unsigned slots = 0;
+    bool pinSlots = false;
+    // Paths every job may use (the interpreter, system directories). The
+    // AppContainer profile name is extended per directory set on Windows.
+    SandboxPolicy basePolicy;
+    // false runs jobs as ordinary processes (SpawnProcess).
+    bool sandboxed = true;
+    double killGraceSeconds = 1;
+    // Called on the slot's thread as each job ends, in completion order.
+    std::function<void(size_t id, const JobSpec& spec, const JobResult& result)> onFinished;
+};
+
+class JobScheduler {
+public:
+    JobScheduler();
+    // Cancel()s: queued jobs are dropped and running ones killed, then the
+    // slot threads are joined.
+    ~JobScheduler();
+
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    bool Start(const SchedulerOptions& options, std::string* error);
+
+    unsigned Slots() const { return static_cast<unsigned>(slots_.size()); }
+
+    // Queues a job and returns its id, the index of its result. Safe to
+    // call from any thread after Start(), including from onFinished.
+    size_t Submit(JobSpec spec);
+
+    // Waits until every job submitted so far has ended and copies out the
+    // results, indexed by id.
+    void Wait(std::vector<JobResult>* results);
+
+    // Drops queued jobs and kills running ones; all of them end as
+    // kCancelled. Jobs submitted afterwards run as usual.
+    void Cancel();
+
+private:
+    struct Job;
+    struct Slot;
+
+    void SlotLoop(unsigned index);
+    Job* TakeJob();
+    void RunJob(Slot& slot, Job& job);
+    SandboxLauncher* LauncherFor(const JobSpec& spec, std::string* error);
+    void Finish(Job& job);
+    void Stop();
+
+    SchedulerOptions options_;
+    std::vector<std::unique_ptr<Slot>> slots_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;  // jobs_, queue_, unfinished_ and stopping_
+    std::condition_variable workAvailable_;
+    std::condition_variable jobEnded_;
+    std::vector<std::unique_ptr<Job>> jobs_;
+    // Keyed by (-priority, id): the first entry is the most urgent job.
+    std::map<std::pair<int, size_t>, Job*> queue_;
+    size_t unfinished_ = 0;
+    bool stopping_ = false;
+    // Bumped by Cancel(); a job taken before the bump is cancelled even if
+    // its process starts after Cancel() looked at the slots.
+    std::atomic<uint64_t> cancelGeneration_{0};
+
+    std::mutex launchersMutex_;
+    std::map<std::string, std::unique_ptr<SandboxLauncher>> launchers_;
+};
+
+}  // namespace sandbox
@@ -0,0 +1,227 @@
+// Runs a file of sandboxed Python jobs through JobScheduler, one line per
+// job (see ParseJobSpec in job_scheduler.h), and reports each job's exit
+// code and times as it ends, then the batch throughput.
+//
+// Example line:
+//   name=resize priority=5 timeout=60 read=/data write=/out resize.py --size 512
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "job_scheduler.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] <jobs-file | ->\n"
+              << "Options:\n"
+              << "  /slots <n>       Concurrent jobs (default: one per usable CPU)\n"
+              << "  /pin             Pin each slot, and its jobs, to one CPU\n"
+              << "  /python <exe>    Interpreter for jobs without python= (default: python3)\n"
+              << "  /timeout <s>     Limit for jobs without timeout= (default: none)\n"
+              << "  /logs <dir>      Write each job's output to <dir>/<id>.log\n"
+              << "  /read <dir>      Readable directory for every job (repeatable)\n"
+              << "  /write <dir>     Writable directory for every job (repeatable)\n"
+              << "  /nosandbox       Run jobs as ordinary processes\n"
+              << "  /repeat <n>      Submit the whole file n times\n"
+              << "  /json            One JSON object per finished job\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+const char* OutcomeName(sandbox::JobOutcome outcome) {
+    switch (outcome) {
+        case sandbox::JobOutcome::kExited: return "exited";
+        case sandbox::JobOutcome::kTimedOut: return "timeout";
+        case sandbox::JobOutcome::kCancelled: return "cancelled";
+        default: return "not-started";
+    }
+}
+
+void AppendJsonString(const std::string& text, std::string* out) {
+    *out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            *out += '\\';
+            *out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            *out += escape;
+        } else {
+            *out += c;
+        }
+    }
+    *out += '"';
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    sandbox::SchedulerOptions options;
+    sandbox::JobSpec defaults;
+    std::string logDir;
+    unsigned repeat = 1;
+    bool json = false;
+    int first = 1;
+    for (; first < argc; first++) {
+        const char* arg = argv[first];
+        bool hasValue = first + 1 < argc;
+        if (IsFlag(arg, "slots") && hasValue) {
+            options.slots = static_cast<unsigned>(atoi(argv[++first]));
+        } else if (IsFlag(arg, "pin")) {
+            options.pinSlots = true;
+        } else if (IsFlag(arg, "python") && hasValue) {
+            defaults.interpreter = argv[++first];
+        } else if (IsFlag(arg, "timeout") && hasValue) {
+            defaults.timeoutSeconds = atof(argv[++first]);
+        } else if (IsFlag(arg, "logs") && hasValue) {
+            logDir = argv[++first];
+        } else if (IsFlag(arg, "read") && hasValue) {
+            options.basePolicy.readPaths.push_back(argv[++first]);
+        } else if (IsFlag(arg, "write") && hasValue) {
+            options.basePolicy.writePaths.push_back(argv[++first]);
+        } else if (IsFlag(arg, "nosandbox")) {
+            options.sandboxed = false;
+        } else if (IsFlag(arg, "repeat") && hasValue) {
+            repeat = static_cast<unsigned>(atoi(argv[++first]));
+        } else if (IsFlag(arg, "json")) {
+            json = true;
+        } else {
+            break;
+        }
+    }
+    if (first + 1 != argc || repeat == 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::vector<sandbox::JobSpec> specs;
+    {
+        std::string path = argv[first];
+        std::ifstream file;
+        if (path != "-") {
+            file.open(path);
+            if (!file) {
+                std::cerr << "Cannot open " << path << std::endl;
+                return 1;
+            }
+        }
+        std::istream& in = path == "-" ? std::cin : file;
+        std::string line;
+        for (int number = 1; std::getline(in, line); number++) {
+            sandbox::JobSpec spec = defaults;
+            bool empty = false;
+            std::string error;
+            if (!sandbox::ParseJobSpec(line, &spec, &empty, &error)) {
+                std::cerr << path << ":" << number << ": " << error << std::endl;
+                return 1;
+            }
+            if (!empty) {
+                specs.push_back(std::move(spec));
+            }
+        }
+    }
+
+#ifndef _WIN32
+    if (options.sandboxed && options.basePolicy.readPaths.empty()) {
+        for (const char* path : {"/usr", "/lib", "/lib64", "/bin", "/etc"}) {
+            if (access(path, F_OK) == 0) {
+                options.basePolicy.readPaths.push_back(path);
+            }
+        }
+    }
+#endif
+
+    if (!logDir.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::u8path(logDir), ec);
+        if (ec) {
+            std::cerr << "Cannot create " << logDir << ": " << ec.message() << std::endl;
+            return 1;
+        }
+    }
+
+    std::mutex printMutex;
+    options.onFinished = [&](size_t id, const sandbox::JobSpec& spec,
+                             const sandbox::JobResult& result) {
+        const std::string& name = spec.name.empty() ? spec.script : spec.name;
+        std::lock_guard<std::mutex> lock(printMutex);
+        if (json) {
+            std::string line = "{\"id\":" + std::to_string(id) + ",\"name\":";
+            AppendJsonString(name, &line);
+            char fields[256];
+            snprintf(fields, sizeof(fields),
+                     ",\"outcome\":\"%s\",\"exit\":%d,\"slot\":%u,\"cpu\":%d,"
+                     "\"queued_ms\":%.3f,\"run_ms\":%.3f,\"cpu_ms\":%.3f",
+                     OutcomeName(result.outcome), result.exitCode, result.slot, result.cpu,
+                     result.queuedSeconds * 1000, result.runSeconds * 1000,
+                     result.cpuSeconds * 1000);
+            line += fields;
+            if (!result.error.empty()) {
+                line += ",\"error\":";
+                AppendJsonString(result.error, &line);
+            }
+            printf("%s}\n", line.c_str());
+        } else {
+            printf("[%zu] %s: %s %d, run %.1f ms, queued %.1f ms, cpu %.1f ms, slot %u%s%s\n",
+                   id, name.c_str(), OutcomeName(result.outcome), result.exitCode,
+                   result.runSeconds * 1000, result.queuedSeconds * 1000,
+                   result.cpuSeconds * 1000, result.slot, result.error.empty() ? "" : ": ",
+                   result.error.c_str());
+        }
+        fflush(stdout);
+    };
+
+    sandbox::JobScheduler scheduler;
+    std::string error;
+    if (!scheduler.Start(options, &error)) {
+        std::cerr << "Failed to start the scheduler: " << error << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned round = 0; round < repeat; round++) {
+        for (const sandbox::JobSpec& spec : specs) {
+            sandbox::JobSpec job = spec;
+            if (!logDir.empty() && job.outputPath.empty()) {
+                job.outputPath = logDir + "/" + std::to_string(round * specs.size() +
+                                                               (&spec - specs.data())) + ".log";
+            }
+            scheduler.Submit(std::move(job));
+        }
+    }
+    std::vector<sandbox::JobResult> results;
+    scheduler.Wait(&results);
+    double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failed = 0, timedOut = 0;
+    double cpuSeconds = 0;
+    for (const sandbox::JobResult& result : results) {
+        if (result.outcome == sandbox::JobOutcome::kTimedOut) {
+            timedOut++;
+        } else if (result.outcome != sandbox::JobOutcome::kExited || result.exitCode != 0) {
+            failed++;
+        }
+        cpuSeconds += result.cpuSeconds;
+    }
+    fprintf(stderr,
+            "%zu jobs on %u slots in %.2f s (%.1f jobs/s): %zu failed, %zu timed out; "
+            "jobs kept the slots %.0f%% busy on CPU\n",
+            results.size(), scheduler.Slots(), seconds, seconds > 0 ? results.size() / seconds : 0,
+            failed, timedOut, seconds > 0 ? 100 * cpuSeconds / (seconds * scheduler.Slots()) : 0);
+    return failed + timedOut == 0 ? 0 : 1;
+}
@@ -0,0 +1,1392 @@
+#include "launcher.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "grant_plan.h"
+#include "runtime_env.h"
+#include "trace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sddl.h>
+#include <userenv.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/landlock.h>
+#include <linux/seccomp.h>
+#include <linux/securebits.h>
+#include <sched.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#ifndef _WIN32
+extern char** environ;
+#endif
+
+namespace sandbox {
+
+namespace {
+
+#ifdef _WIN32
+std::wstring Widen(const std::string& text) {
+    if (text.empty()) {
+        return std::wstring();
+    }
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()),
+                                     NULL, 0);
+    std::wstring wide(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &wide[0], length);
+    return wide;
+}
+
+// Quotes one argument the way CommandLineToArgvW splits it back.
+void AppendQuoted(const std::wstring& argument, std::wstring* commandLine) {
+    if (!commandLine->empty()) {
+        *commandLine += L' ';
+    }
+    if (!argument.empty() && argument.find_first_of(L" \t\n\v\"") == std::wstring::npos) {
+        *commandLine += argument;
+        return;
+    }
+    *commandLine += L'"';
+    size_t backslashes = 0;
+    for (wchar_t c : argument) {
+        if (c == L'\\') {
+            backslashes++;
+            continue;
+        }
+        commandLine->append(c == L'"' ? backslashes * 2 + 1 : backslashes, L'\\');
+        backslashes = 0;
+        *commandLine += c;
+    }
+    commandLine->append(backslashes * 2, L'\\');
+    *commandLine += L'"';
+}
+
+std::string Win32Error(const char* what) {
+    return std::string(what) + " failed with error " + std::to_string(GetLastError());
+}
+
+// The child's stdio for STARTF_USESTDHANDLES. Slots the command leaves
+// empty fall back to inheritable duplicates of this process's own handles:
+// PROC_THREAD_ATTRIBUTE_HANDLE_LIST only passes handles it lists, and only
+// inheritable ones, so the raw GetStdHandle() values would either be left
+// out (the child gets invalid stdio) or fail the launch.
+class StdioHandles {
+public:
+    explicit StdioHandles(const LaunchCommand& command)
+        : handles_{command.stdInput, command.stdOutput, command.stdError} {
+        redirected_ = handles_[0] != NULL || handles_[1] != NULL || handles_[2] != NULL;
+        if (!redirected_) {
+            return;
+        }
+        const DWORD ids[3] = {STD_INPUT_HANDLE, STD_OUTPUT_HANDLE, STD_ERROR_HANDLE};
+        for (int i = 0; i < 3; i++) {
+            HANDLE own = GetStdHandle(ids[i]);
+            if (handles_[i] != NULL || own == NULL || own == INVALID_HANDLE_VALUE) {
+                continue;
+            }
+            if (DuplicateHandle(GetCurrentProcess(), own, GetCurrentProcess(), &handles_[i], 0,
+                                TRUE, DUPLICATE_SAME_ACCESS)) {
+                owned_.push_back(handles_[i]);
+            } else {
+                handles_[i] = NULL;
+            }
+        }
+    }
+    ~StdioHandles() {
+        for (HANDLE handle : owned_) {
+            CloseHandle(handle);
+        }
+    }
+
+    StdioHandles(const StdioHandles&) = delete;
+    StdioHandles& operator=(const StdioHandles&) = delete;
+
+    // Adds the handles to a handle list, each once: the list rejects
+    // duplicates, and stdout and stderr are often the same handle.
+    void AddTo(std::vector<HANDLE>* inherited) const {
+        for (HANDLE handle : handles_) {
+            if (handle != NULL &&
+                std::find(inherited->begin(), inherited->end(), handle) == inherited->end()) {
+                inherited->push_back(handle);
+            }
+        }
+    }
+
+    void Apply(STARTUPINFOW* startup) const {
+        if (redirected_) {
+            startup->dwFlags |= STARTF_USESTDHANDLES;
+            startup->hStdInput = handles_[0];
+            startup->hStdOutput = handles_[1];
+            startup->hStdError = handles_[2];
+        }
+    }
+
+private:
+    HANDLE handles_[3];
+    bool redirected_ = false;
+    std::vector<HANDLE> owned_;
+};
+
+// The jobs a launch starts in (PROC_THREAD_ATTRIBUTE_JOB_LIST): the
+// command's, then for a processTree launch a kill-on-close job of its own,
+// which nests inside the first. The tree's job is closed, killing the
+// process, unless Release() hands it over.
+class LaunchJobs {
+public:
+    LaunchJobs() = default;
+    ~LaunchJobs() {
+        if (tree_ != NULL) {
+            CloseHandle(tree_);
+        }
+    }
+
+    LaunchJobs(const LaunchJobs&) = delete;
+    LaunchJobs& operator=(const LaunchJobs&) = delete;
+
+    bool Init(const LaunchCommand& command, std::string* error) {
+        if (command.job != nullptr) {
+            jobs_.push_back(command.job);
+        }
+        if (!command.processTree) {
+            return true;
+        }
+        tree_ = CreateJobObjectW(NULL, NULL);
+        JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+        limits.BasicLimitInformation.LimitFlags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+        if (tree_ == NULL || !SetInformationJobObject(tree_, JobObjectExtendedLimitInformation,
+                                                      &limits, sizeof(limits))) {
+            *error = Win32Error("CreateJobObject");
+            return false;
+        }
+        jobs_.push_back(tree_);
+        return true;
+    }
+
+    bool Empty() const { return jobs_.empty(); }
+
+    bool AddTo(LPPROC_THREAD_ATTRIBUTE_LIST attributes) {
+        return jobs_.empty() ||
+               UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_JOB_LIST,
+                                         jobs_.data(), jobs_.size() * sizeof(HANDLE), NULL, NULL);
+    }
+
+    HANDLE Release() {
+        HANDLE tree = tree_;
+        tree_ = NULL;
+        return tree;
+    }
+
+private:
+    std::vector<HANDLE> jobs_;
+    HANDLE tree_ = NULL;
+};
+
+// Closes the handles of a process that has exited. Closing its processTree
+// job kills whatever the process left running.
+void ReleaseProcess(LaunchedProcess* process) {
+    CloseHandle(process->process);
+    process->process = nullptr;
+    if (process->job != nullptr) {
+        CloseHandle(process->job);
+        process->job = nullptr;
+    }
+}
+
+// This process's environment block with the descriptor variable replaced.
+// Built per launch so variables the caller sets later are passed on.
+std::wstring BuildEnvironmentBlock(const std::string& variable) {
+    std::wstring prefix = Widen(std::string(kRuntimeEnvVariable) + "=");
+    std::wstring block;
+    LPWCH strings = GetEnvironmentStringsW();
+    for (LPWCH entry = strings; *entry != L'\0'; entry += wcslen(entry) + 1) {
+        if (_wcsnicmp(entry, prefix.c_str(), prefix.size()) != 0) {
+            block.append(entry, wcslen(entry) + 1);
+        }
+    }
+    FreeEnvironmentStringsW(strings);
+    block += Widen(variable);
+    block += L'\0';
+    return block;
+}
+#else
+// The two functions below run in the child between fork/clone and exec, so
+// they only make async-signal-safe system calls and never allocate.
+
+// Moves the caller's stdio choices onto 0-2. Every source is first copied
+// above 2, so swapped or overlapping choices (stdout=2, stderr=1) do not
+// read a slot that an earlier dup2 already replaced.
+bool RedirectStdio(const int stdio[3]) {
+    int sources[3] = {-1, -1, -1};
+    for (int target = 0; target < 3; target++) {
+        if (stdio[target] >= 0 && stdio[target] != target &&
+            (sources[target] = fcntl(stdio[target], F_DUPFD_CLOEXEC, 3)) < 0) {
+            return false;
+        }
+    }
+    for (int target = 0; target < 3; target++) {
+        if (sources[target] >= 0) {
+            if (dup2(sources[target], target) < 0) {
+                return false;
+            }
+            close(sources[target]);
+        }
+    }
+    return true;
+}
+
+// Marks every descriptor above 2 close-on-exec except the `count` in
+// `keep`, so a child inherits only what it was explicitly given and none
+// of the launcher's own files, sockets and pipes.
+bool KeepOnlyFds(const int* keep, size_t count) {
+    bool marked = false;
+#if defined(__linux__) && defined(SYS_close_range)
+    constexpr unsigned kCloseRangeCloexec = 1U << 2;  // CLOSE_RANGE_CLOEXEC, Linux 5.11
+    marked = syscall(SYS_close_range, 3U, ~0U, kCloseRangeCloexec) == 0;
+#endif
+    if (!marked) {
+        rlimit limit;
+        int last = getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+                           limit.rlim_cur < 65536
+                       ? static_cast<int>(limit.rlim_cur)
+                       : 65536;
+        for (int fd = 3; fd < last; fd++) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (keep[i] > 2 && fcntl(keep[i], F_SETFD, 0) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Waits for the leader of a processTree launch to exit and kills what is
+// left of its group. Done before the leader is reaped: until then its
+// zombie keeps the group id from being reused.
+void EndProcessGroup(const LaunchedProcess& process) {
+    if (process.processGroup && process.pid > 0) {
+        AwaitExit(process, -1);
+        kill(-process.pid, SIGKILL);
+    }
+}
+
+// The descriptors a child keeps: the command's own and, while a trace is
+// running, the trace sink.
+std::vector<int> InheritedFds(const LaunchCommand& command) {
+    std::vector<int> fds = command.inheritFds;
+    if (TraceSinkFd() >= 0) {
+        fds.push_back(TraceSinkFd());
+    }
+    return fds;
+}
+#endif
+
+#ifdef __linux__
+#ifndef LANDLOCK_ACCESS_FS_REFER
+#define LANDLOCK_ACCESS_FS_REFER (1ULL << 13)
+#endif
+#ifndef LANDLOCK_ACCESS_FS_TRUNCATE
+#define LANDLOCK_ACCESS_FS_TRUNCATE (1ULL << 14)
+#endif
+
+constexpr uint64_t kLandlockRead = LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_READ_FILE |
+                                   LANDLOCK_ACCESS_FS_READ_DIR;
+constexpr uint64_t kLandlockWrite =
+    LANDLOCK_ACCESS_FS_WRITE_FILE | LANDLOCK_ACCESS_FS_REMOVE_DIR |
+    LANDLOCK_ACCESS_FS_REMOVE_FILE | LANDLOCK_ACCESS_FS_MAKE_CHAR | LANDLOCK_ACCESS_FS_MAKE_DIR |
+    LANDLOCK_ACCESS_FS_MAKE_REG | LANDLOCK_ACCESS_FS_MAKE_SOCK | LANDLOCK_ACCESS_FS_MAKE_FIFO |
+    LANDLOCK_ACCESS_FS_MAKE_BLOCK | LANDLOCK_ACCESS_FS_MAKE_SYM | LANDLOCK_ACCESS_FS_REFER |
+    LANDLOCK_ACCESS_FS_TRUNCATE;
+
+// Access rights the running kernel understands; rules may not name others.
+uint64_t LandlockHandledAccess() {
+    long abi = syscall(SYS_landlock_create_ruleset, nullptr, 0, LANDLOCK_CREATE_RULESET_VERSION);
+    if (abi < 1) {
+        return 0;
+    }
+    uint64_t handled = kLandlockRead | kLandlockWrite;
+    if (abi < 2) {
+        handled &= ~LANDLOCK_ACCESS_FS_REFER;
+    }
+    if (abi < 3) {
+        handled &= ~LANDLOCK_ACCESS_FS_TRUNCATE;
+    }
+    return handled;
+}
+
+#if defined(__x86_64__)
+constexpr uint32_t kAuditArch = AUDIT_ARCH_X86_64;
+#elif defined(__aarch64__)
+constexpr uint32_t kAuditArch = AUDIT_ARCH_AARCH64;
+#else
+constexpr uint32_t kAuditArch = 0;
+#endif
+
+// Syscalls that only matter for escaping or attacking the sandbox. They fail
+// with EPERM instead of killing the process, so runtimes that probe for them
+// keep working.
+const long kDeniedSyscalls[] = {
+    SYS_ptrace, SYS_mount, SYS_umount2, SYS_pivot_root, SYS_unshare, SYS_setns,
+    SYS_kexec_load, SYS_bpf, SYS_perf_event_open, SYS_userfaultfd, SYS_init_module,
+    SYS_finit_module, SYS_delete_module, SYS_swapon, SYS_swapoff, SYS_reboot, SYS_add_key,
+    SYS_keyctl, SYS_request_key, SYS_open_by_handle_at, SYS_process_vm_writev,
+#ifdef SYS_kexec_file_load
+    SYS_kexec_file_load,
+#endif
+#ifdef SYS_open_tree
+    SYS_open_tree, SYS_move_mount, SYS_fsopen, SYS_fsconfig, SYS_fsmount, SYS_fspick,
+#endif
+};
+
+constexpr uint32_t kNamespaceCloneFlags = CLONE_NEWNS | CLONE_NEWUSER | CLONE_NEWNET |
+                                          CLONE_NEWPID | CLONE_NEWIPC | CLONE_NEWUTS |
+                                          CLONE_NEWCGROUP;
+
+std::vector<sock_filter> BuildSeccompFilter() {
+    std::vector<sock_filter> filter;
+    auto statement = [&](uint16_t code, uint32_t k) {
+        filter.push_back(BPF_STMT(code, k));
+    };
+    auto jump = [&](uint16_t code, uint32_t k, uint8_t jt, uint8_t jf) {
+        filter.push_back(BPF_JUMP(code, k, jt, jf));
+    };
+    const uint32_t deny = SECCOMP_RET_ERRNO | EPERM;
+
+    statement(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch));
+    jump(BPF_JMP | BPF_JEQ | BPF_K, kAuditArch, 1, 0);
+    statement(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS);
+    statement(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr));
+#ifdef __x86_64__
+    // x32 syscall numbers alias the x86-64 ones with a high bit set.
+    jump(BPF_JMP | BPF_JGE | BPF_K, 0x40000000, 0, 1);
+    statement(BPF_RET | BPF_K, deny);
+#endif
+    for (long nr : kDeniedSyscalls) {
+        jump(BPF_JMP | BPF_JEQ | BPF_K, static_cast<uint32_t>(nr), 0, 1);
+        statement(BPF_RET | BPF_K, deny);
+    }
+    // clone3 passes its flags in memory the filter cannot see; ENOSYS makes
+    // libc fall back to clone, whose flags are checked below.
+#ifdef SYS_clone3
+    jump(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone3, 0, 1);
+    statement(BPF_RET | BPF_K, SECCOMP_RET_ERRNO | ENOSYS);
+#endif
+    jump(BPF_JMP | BPF_JEQ | BPF_K, SYS_clone, 0, 3);
+    statement(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, args[0]));
+    jump(BPF_JMP | BPF_JSET | BPF_K, kNamespaceCloneFlags, 0, 1);
+    statement(BPF_RET | BPF_K, deny);
+    statement(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    return filter;
+}
+
+bool WriteProcFile(const std::string& path, const std::string& contents, std::string* error) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        *error = "Failed to open " + path + ": " + strerror(errno);
+        return false;
+    }
+    bool ok = write(fd, contents.data(), contents.size()) ==
+              static_cast<ssize_t>(contents.size());
+    if (!ok) {
+        *error = "Failed to write " + path + ": " + strerror(errno);
+    }
+    close(fd);
+    return ok;
+}
+
+// Namespaces the template holds, in the order they must be joined: the user
+// namespace first, so the others are joined with its capabilities.
+const struct {
+    const char* name;
+    int flag;
+} kTemplateNamespaces[] = {
+    {"user", CLONE_NEWUSER}, {"mnt", CLONE_NEWNS}, {"ipc", CLONE_NEWIPC},
+    {"uts", CLONE_NEWUTS},   {"net", CLONE_NEWNET},
+};
+
+// Creates the namespaces once in a short-lived helper and keeps them alive
+// through /proc/<pid>/ns descriptors after it exits.
+bool CreateNamespaceTemplate(bool network, std::vector<int>* namespaceFds, std::string* error) {
+    int flags = CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWUTS;
+    if (!network) {
+        flags |= CLONE_NEWNET;
+    }
+    int toParent[2];
+    int toChild[2];
+    if (pipe2(toParent, O_CLOEXEC) != 0) {
+        *error = std::string("pipe2 failed: ") + strerror(errno);
+        return false;
+    }
+    if (pipe2(toChild, O_CLOEXEC) != 0) {
+        *error = std::string("pipe2 failed: ") + strerror(errno);
+        close(toParent[0]);
+        close(toParent[1]);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(toParent[0]);
+        close(toChild[1]);
+        char byte = 0;
+        if (unshare(flags) != 0) {
+            _exit(errno);
+        }
+        if (write(toParent[1], &byte, 1) != 1 || read(toChild[0], &byte, 1) != 1) {
+            _exit(0);
+        }
+        // Mounts made inside the sandbox must not propagate to the host.
+        if (mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) != 0 ||
+            sethostname("sandbox", 7) != 0) {
+            _exit(errno);
+        }
+        if (write(toParent[1], &byte, 1) != 1) {
+            _exit(0);
+        }
+        // Stay alive until the parent has opened the namespace files.
+        read(toChild[0], &byte, 1);
+        _exit(0);
+    }
+    close(toParent[1]);
+    close(toChild[0]);
+    if (pid < 0) {
+        *error = std::string("fork failed: ") + strerror(errno);
+        close(toParent[0]);
+        close(toChild[1]);
+        return false;
+    }
+
+    char byte = 0;
+    bool ok = read(toParent[0], &byte, 1) == 1 && WriteIdMaps(pid, error) &&
+              write(toChild[1], &byte, 1) == 1 && read(toParent[0], &byte, 1) == 1;
+    if (ok) {
+        for (const auto& ns : kTemplateNamespaces) {
+            if ((flags & ns.flag) == 0) {
+                continue;
+            }
+            std::string path = "/proc/" + std::to_string(pid) + "/ns/" + ns.name;
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                *error = "Failed to open " + path + ": " + strerror(errno);
+                ok = false;
+                break;
+            }
+            namespaceFds->push_back(fd);
+        }
+    }
+    close(toChild[1]);
+    close(toParent[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!ok && error->empty()) {
+        int code = WIFEXITED(status) ? WEXITSTATUS(status) : 0;
+        *error = std::string("Failed to create sandbox namespaces: ") +
+                 (code != 0 ? strerror(code) : "helper exited early");
+    }
+    if (!ok) {
+        for (int fd : *namespaceFds) {
+            close(fd);
+        }
+        namespaceFds->clear();
+    }
+    return ok;
+}
+
+std::string FindInPath(const std::string& program) {
+    if (program.find('/') != std::string::npos) {
+        return program;
+    }
+    const char* path = getenv("PATH");
+    std::string directories = path != nullptr ? path : "/usr/local/bin:/usr/bin:/bin";
+    size_t start = 0;
+    while (start <= directories.size()) {
+        size_t end = directories.find(':', start);
+        if (end == std::string::npos) {
+            end = directories.size();
+        }
+        std::string candidate = directories.substr(start, end - start);
+        candidate = (candidate.empty() ? "." : candidate) + "/" + program;
+        if (access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+        start = end + 1;
+    }
+    return program;
+}
+
+// environ with the descriptor variable replaced; the pointers stay owned by
+// environ and `variable`.
+std::vector<char*> BuildEnvp(const std::string& variable) {
+    std::vector<char*> envp;
+    size_t prefix = strlen(kRuntimeEnvVariable);
+    for (char** entry = environ; *entry != nullptr; entry++) {
+        if (strncmp(*entry, kRuntimeEnvVariable, prefix) != 0 || (*entry)[prefix] != '=') {
+            envp.push_back(*entry);
+        }
+    }
+    envp.push_back(const_cast<char*>(variable.c_str()));
+    envp.push_back(nullptr);
+    return envp;
+}
+
+// Everything the clone child needs, prepared by the parent: the child shares
+// the parent's memory and must not allocate.
+struct ChildContext {
+    int cgroupProcsFd;
+    bool processGroup;
+    const int* namespaceFds;
+    size_t namespaceCount;
+    const char* cwd;
+    int stdio[3];
+    int landlockRuleset;
+    const sock_fprog* seccomp;
+    const char* program;
+    char* const* argv;
+    char* const* envp;
+    // The only descriptors above 2 kept open across exec: the runtime
+    // environment descriptor and the command's inheritFds.
+    const int* keepFds;
+    size_t keepCount;
+    // Written by the child when a step fails; read by the parent after the
+    // vfork-style clone returns.
+    const char* failedStep;
+    int failedErrno;
+};
+
+int Fail(ChildContext* context, const char* step) {
+    context->failedErrno = errno;
+    context->failedStep = step;
+    _exit(127);
+}
+
+int SandboxChildMain(void* argument) {
+    ChildContext* context = static_cast<ChildContext*>(argument);
+    // Writing 0 moves the writer; done while the child still has our
+    // namespaces and credentials, which the cgroup's permissions are for.
+    if (context->cgroupProcsFd >= 0 && write(context->cgroupProcsFd, "0", 1) != 1) {
+        return Fail(context, "cgroup.procs");
+    }
+    if (context->processGroup && setpgid(0, 0) != 0) {
+        return Fail(context, "setpgid");
+    }
+    for (size_t i = 0; i < context->namespaceCount; i++) {
+        if (setns(context->namespaceFds[i], 0) != 0) {
+            return Fail(context, "setns");
+        }
+    }
+    // Joining the mount namespace moved the cwd to its root.
+    if (chdir(context->cwd) != 0) {
+        return Fail(context, "chdir");
+    }
+    if (!RedirectStdio(context->stdio)) {
+        return Fail(context, "dup2");
+    }
+    if (!KeepOnlyFds(context->keepFds, context->keepCount)) {
+        return Fail(context, "fcntl");
+    }
+    // uid 0 inside the namespace must not regain capabilities on exec.
+    if (context->namespaceCount > 0 &&
+        prctl(PR_SET_SECUREBITS, SECBIT_NOROOT | SECBIT_NOROOT_LOCKED) != 0) {
+        return Fail(context, "PR_SET_SECUREBITS");
+    }
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+        return Fail(context, "PR_SET_NO_NEW_PRIVS");
+    }
+    if (context->landlockRuleset >= 0 &&
+        syscall(SYS_landlock_restrict_self, context->landlockRuleset, 0) != 0) {
+        return Fail(context, "landlock_restrict_self");
+    }
+    if (context->seccomp != nullptr &&
+        syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, context->seccomp) != 0) {
+        return Fail(context, "seccomp");
+    }
+    execve(context->program, context->argv, context->envp);
+    return Fail(context, "execve");
+}
+#endif
+
+}  // namespace
+
+#ifdef __linux__
+int CreateLandlockRuleset(const SandboxPolicy& policy, std::string* error) {
+    uint64_t handled = LandlockHandledAccess();
+    if (handled == 0) {
+        *error = "Landlock is not available on this kernel";
+        return -1;
+    }
+    landlock_ruleset_attr attributes = {};
+    attributes.handled_access_fs = handled;
+    int ruleset = static_cast<int>(syscall(SYS_landlock_create_ruleset, &attributes,
+                                           sizeof(attributes), 0));
+    if (ruleset < 0) {
+        *error = std::string("landlock_create_ruleset failed: ") + strerror(errno);
+        return -1;
+    }
+    for (const std::string& path : policy.readPaths) {
+        if (!AddLandlockPath(ruleset, path, false, error)) {
+            close(ruleset);
+            return -1;
+        }
+    }
+    for (const std::string& path : policy.writePaths) {
+        if (!AddLandlockPath(ruleset, path, true, error)) {
+            close(ruleset);
+            return -1;
+        }
+    }
+    return ruleset;
+}
+
+bool AddLandlockPath(int ruleset, const std::string& path, bool write, std::string* error) {
+    int fd = open(path.c_str(), O_PATH | O_CLOEXEC);
+    if (fd < 0) {
+        *error = "Failed to open " + path + ": " + strerror(errno);
+        return false;
+    }
+    struct stat info;
+    fstat(fd, &info);
+    landlock_path_beneath_attr rule = {};
+    rule.parent_fd = fd;
+    rule.allowed_access = (write ? kLandlockRead | kLandlockWrite : kLandlockRead) &
+                          LandlockHandledAccess();
+    // Directory-only rights are rejected on files.
+    if (!S_ISDIR(info.st_mode)) {
+        rule.allowed_access &= LANDLOCK_ACCESS_FS_EXECUTE | LANDLOCK_ACCESS_FS_READ_FILE |
+                               LANDLOCK_ACCESS_FS_WRITE_FILE | LANDLOCK_ACCESS_FS_TRUNCATE;
+    }
+    bool ok = syscall(SYS_landlock_add_rule, ruleset, LANDLOCK_RULE_PATH_BENEATH, &rule, 0) == 0;
+    if (!ok) {
+        *error = "landlock_add_rule failed for " + path + ": " + strerror(errno);
+    }
+    close(fd);
+    return ok;
+}
+
+bool InstallSeccompFilter(std::string* error) {
+    if (kAuditArch == 0) {
+        *error = "seccomp filter not available on this architecture";
+        return false;
+    }
+    std::vector<sock_filter> filter = BuildSeccompFilter();
+    sock_fprog program = {static_cast<unsigned short>(filter.size()), filter.data()};
+    if (syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, &program) != 0) {
+        *error = std::string("seccomp failed: ") + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool WriteIdMaps(int pid, std::string* error) {
+    std::string proc = "/proc/" + std::to_string(pid) + "/";
+    std::string uid = std::to_string(getuid());
+    std::string gid = std::to_string(getgid());
+    return WriteProcFile(proc + "setgroups", "deny", error) &&
+           WriteProcFile(proc + "uid_map", uid + " " + uid + " 1", error) &&
+           WriteProcFile(proc + "gid_map", gid + " " + gid + " 1", error);
+}
+#endif
+
+struct SandboxLauncher::State {
+    RuntimeEnvironment childEnvironment;
+    std::unique_ptr<PublishedEnvironment> publishedEnvironment;
+#ifdef _WIN32
+    PSID sid = NULL;
+    std::unique_ptr<GrantBackend> grantBackend;
+    std::unique_ptr<GrantPlanner> grants;
+    SECURITY_CAPABILITIES capabilities = {};
+    // The handles every launch inherits: the descriptor mapping and, while a
+    // trace is active, its sink.
+    std::vector<HANDLE> baseHandles;
+    // Attribute list holding the capabilities and baseHandles, reused by
+    // every launch that inherits no other handles.
+    std::vector<char> attributeBuffer;
+
+    ~State() {
+        if (!attributeBuffer.empty()) {
+            DeleteProcThreadAttributeList(
+                reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributeBuffer.data()));
+        }
+        if (sid != NULL) {
+            FreeSid(sid);
+        }
+    }
+#elif defined(__linux__)
+    std::vector<int> namespaceFds;
+    int landlockRuleset = -1;
+    std::vector<sock_filter> seccompFilter;
+    sock_fprog seccompProgram = {};
+    std::string cwd;
+
+    ~State() {
+        for (int fd : namespaceFds) {
+            close(fd);
+        }
+        if (landlockRuleset >= 0) {
+            close(landlockRuleset);
+        }
+    }
+#endif
+};
+
+SandboxLauncher::SandboxLauncher() : state_(new State()) {}
+
+SandboxLauncher::~SandboxLauncher() = default;
+
+#ifdef _WIN32
+std::unique_ptr<SandboxLauncher> SandboxLauncher::Create(const SandboxPolicy& policy,
+                                                         std::string* error) {
+    TRACE_SPAN("Create sandbox");
+    std::unique_ptr<SandboxLauncher> launcher(new SandboxLauncher());
+    State& state = *launcher->state_;
+
+    std::wstring name = Widen(policy.name);
+    HRESULT hr;
+    {
+        TRACE_SPAN("AppContainer SID");
+        hr = CreateAppContainerProfile(name.c_str(), name.c_str(), name.c_str(), NULL, 0,
+                                       &state.sid);
+        if (hr == HRESULT_FROM_WIN32(ERROR_ALREADY_EXISTS)) {
+            hr = DeriveAppContainerSidFromAppContainerName(name.c_str(), &state.sid);
+        }
+    }
+    if (FAILED(hr)) {
+        *error = "Failed to get AppContainer SID for " + policy.name + ", HRESULT " +
+                 std::to_string(static_cast<unsigned long>(hr));
+        return nullptr;
+    }
+
+    LPSTR sidString = NULL;
+    if (!ConvertSidToStringSidA(state.sid, &sidString)) {
+        *error = Win32Error("ConvertSidToStringSid");
+        return nullptr;
+    }
+    state.grantBackend = CreatePlatformGrantBackend();
+    state.grants.reset(new GrantPlanner(*state.grantBackend, sidString, policy.grantIndexPath));
+    LocalFree(sidString);
+    for (const std::string& path : policy.readPaths) {
+        state.grants->Add(path, kGrantRead | kGrantExecute);
+    }
+    for (const std::string& path : policy.writePaths) {
+        state.grants->Add(path, kGrantAll);
+    }
+    GrantPlanStats stats;
+    bool granted;
+    {
+        TRACE_SPAN("Grant ACLs");
+        granted = state.grants->Execute(&stats, error);
+    }
+    if (!granted) {
+        return nullptr;
+    }
+
+    // Children keep this process's package identity and get no
+    // capabilities.
+    RuntimeEnvironment& child = state.childEnvironment;
+    child = CurrentEnvironment();
+    child.flags = (child.flags & kEnvPackaged) | kEnvAppContainer | kEnvInherited;
+    child.capabilityCount = 0;
+    memset(child.capabilities, 0, sizeof(child.capabilities));
+    LPSTR containerSid = NULL;
+    if (ConvertSidToStringSidA(state.sid, &containerSid)) {
+        CopyField(child.container, containerSid);
+        LocalFree(containerSid);
+    }
+    state.publishedEnvironment = PublishedEnvironment::Create(child, error);
+    if (!state.publishedEnvironment) {
+        return nullptr;
+    }
+    state.baseHandles.push_back(state.publishedEnvironment->Handle());
+    if (TraceSinkHandle() != NULL) {
+        state.baseHandles.push_back(TraceSinkHandle());
+    }
+
+    state.capabilities.AppContainerSid = state.sid;
+    SIZE_T size = 0;
+    InitializeProcThreadAttributeList(NULL, 2, 0, &size);
+    state.attributeBuffer.resize(size);
+    auto attributes = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(state.attributeBuffer.data());
+    if (!InitializeProcThreadAttributeList(attributes, 2, 0, &size)) {
+        state.attributeBuffer.clear();
+        *error = Win32Error("InitializeProcThreadAttributeList");
+        return nullptr;
+    }
+    if (!UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_SECURITY_CAPABILITIES,
+                                   &state.capabilities, sizeof(state.capabilities), NULL, NULL) ||
+        !UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                                   state.baseHandles.data(),
+                                   state.baseHandles.size() * sizeof(HANDLE), NULL, NULL)) {
+        *error = Win32Error("UpdateProcThreadAttribute");
+        return nullptr;
+    }
+    return launcher;
+}
+
+bool SandboxLauncher::AllowPath(const std::string& path, bool write, std::string* error) {
+    state_->grants->Add(path, write ? kGrantAll : kGrantRead | kGrantExecute);
+    GrantPlanStats stats;
+    return state_->grants->Execute(&stats, error);
+}
+
+bool SandboxLauncher::Spawn(const LaunchCommand& command, LaunchedProcess* process,
+                            std::string* error) {
+    TRACE_SPAN("Spawn");
+    std::wstring commandLine = command.commandLine;
+    if (commandLine.empty()) {
+        for (const std::string& argument : command.argv) {
+            AppendQuoted(Widen(argument), &commandLine);
+        }
+    }
+    std::wstring cwd = Widen(command.cwd);
+    std::wstring environment = BuildEnvironmentBlock(state_->publishedEnvironment->Variable());
+
+    // Launches that inherit more handles, or start in a job, need an
+    // attribute list of their own.
+    std::vector<char> launchAttributeBuffer;
+    auto attributes = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(state_->attributeBuffer.data());
+    std::vector<HANDLE> inherited(command.inheritHandles.begin(), command.inheritHandles.end());
+    StdioHandles stdio(command);
+    stdio.AddTo(&inherited);
+    LaunchJobs jobs;
+    if (!jobs.Init(command, error)) {
+        return false;
+    }
+    if (!inherited.empty() || !jobs.Empty()) {
+        inherited.insert(inherited.end(), state_->baseHandles.begin(), state_->baseHandles.end());
+        SIZE_T size = 0;
+        InitializeProcThreadAttributeList(NULL, 3, 0, &size);
+        launchAttributeBuffer.resize(size);
+        attributes = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(launchAttributeBuffer.data());
+        if (!InitializeProcThreadAttributeList(attributes, 3, 0, &size)) {
+            *error = Win32Error("InitializeProcThreadAttributeList");
+            return false;
+        }
+        if (!UpdateProcThreadAttribute(attributes, 0,
+                                       PROC_THREAD_ATTRIBUTE_SECURITY_CAPABILITIES,
+                                       &state_->capabilities, sizeof(state_->capabilities), NULL,
+                                       NULL) ||
+            !UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST,
+                                       inherited.data(), inherited.size() * sizeof(HANDLE), NULL,
+                                       NULL) ||
+            !jobs.AddTo(attributes)) {
+            *error = Win32Error("UpdateProcThreadAttribute");
+            DeleteProcThreadAttributeList(attributes);
+            return false;
+        }
+    }
+
+    STARTUPINFOEXW startup = {};
+    startup.StartupInfo.cb = sizeof(startup);
+    startup.lpAttributeList = attributes;
+    stdio.Apply(&startup.StartupInfo);
+    PROCESS_INFORMATION info = {};
+    BOOL ok = CreateProcessW(
+        NULL, &commandLine[0], NULL, NULL, TRUE,
+        EXTENDED_STARTUPINFO_PRESENT | CREATE_UNICODE_ENVIRONMENT | command.creationFlags,
+        &environment[0], cwd.empty() ? NULL : cwd.c_str(), &startup.StartupInfo, &info);
+    if (!launchAttributeBuffer.empty()) {
+        DeleteProcThreadAttributeList(attributes);
+    }
+    if (!ok) {
+        *error = Win32Error("CreateProcessW");
+        return false;
+    }
+    CloseHandle(info.hThread);
+    process->process = info.hProcess;
+    process->job = jobs.Release();
+    return true;
+}
+
+bool SandboxLauncher::Wait(LaunchedProcess* process, int* exitCode, std::string* error) {
+    DWORD code = 0;
+    if (WaitForSingleObject(process->process, INFINITE) != WAIT_OBJECT_0 ||
+        !GetExitCodeProcess(process->process, &code)) {
+        *error = Win32Error("WaitForSingleObject");
+        return false;
+    }
+    ReleaseProcess(process);
+    *exitCode = static_cast<int>(code);
+    return true;
+}
+
+bool SandboxLauncher::HasLandlock() const { return false; }
+
+bool SandboxLauncher::HasSeccomp() const { return false; }
+
+#elif defined(__linux__)
+std::unique_ptr<SandboxLauncher> SandboxLauncher::Create(const SandboxPolicy& policy,
+                                                         std::string* error) {
+    TRACE_SPAN("Create sandbox");
+    std::unique_ptr<SandboxLauncher> launcher(new SandboxLauncher());
+    State& state = *launcher->state_;
+
+    bool created;
+    {
+        TRACE_SPAN("Namespace template");
+        created = CreateNamespaceTemplate(policy.network, &state.namespaceFds, error);
+    }
+    if (!created) {
+        return nullptr;
+    }
+
+    std::string landlockError;
+    {
+        TRACE_SPAN("Landlock ruleset");
+        state.landlockRuleset = CreateLandlockRuleset(policy, &landlockError);
+    }
+    if (state.landlockRuleset < 0 && (policy.requireLandlock || LandlockHandledAccess() != 0)) {
+        // A missing kernel feature is tolerated unless required; a bad path
+        // in the policy never is.
+        *error = landlockError;
+        return nullptr;
+    }
+
+    if (kAuditArch != 0) {
+        state.seccompFilter = BuildSeccompFilter();
+        state.seccompProgram.len = static_cast<unsigned short>(state.seccompFilter.size());
+        state.seccompProgram.filter = state.seccompFilter.data();
+    }
+
+    char cwd[4096];
+    if (getcwd(cwd, sizeof(cwd)) != nullptr) {
+        state.cwd = cwd;
+    } else {
+        state.cwd = "/";
+    }
+
+    // Children stay in this process's cgroup unless the command names a
+    // resource group, for which Spawn() publishes a copy naming the group;
+    // everything else is what the template and the restrictions above give
+    // them.
+    RuntimeEnvironment& child = state.childEnvironment;
+    child = CurrentEnvironment();
+    child.flags = (child.flags & kEnvCgroupV2) | kEnvUserNamespace | kEnvMountNamespace |
+                  kEnvIpcNamespace | kEnvUtsNamespace | kEnvNoNewPrivs | kEnvInherited;
+    if (!policy.network) {
+        child.flags |= kEnvNetworkNamespace;
+    }
+    if (state.landlockRuleset >= 0) {
+        child.flags |= kEnvLandlock;
+    }
+    if (!state.seccompFilter.empty()) {
+        child.flags |= kEnvSeccomp;
+    }
+    child.capabilityCount = 0;
+    memset(child.capabilities, 0, sizeof(child.capabilities));
+    if (policy.network) {
+        child.AddCapability("network");
+    }
+    char link[64];
+    std::string userNamespace = "/proc/self/fd/" + std::to_string(state.namespaceFds[0]);
+    ssize_t length = readlink(userNamespace.c_str(), link, sizeof(link) - 1);
+    CopyField(child.container, length > 0 ? std::string(link, length) : std::string());
+    state.publishedEnvironment = PublishedEnvironment::Create(child, error);
+    if (!state.publishedEnvironment) {
+        return nullptr;
+    }
+    return launcher;
+}
+
+bool SandboxLauncher::AllowPath(const std::string& path, bool write, std::string* error) {
+    // Rules added to the ruleset apply to every later landlock_restrict_self.
+    if (state_->landlockRuleset < 0) {
+        return true;
+    }
+    return AddLandlockPath(state_->landlockRuleset, path, write, error);
+}
+
+bool SandboxLauncher::Spawn(const LaunchCommand& command, LaunchedProcess* process,
+                            std::string* error) {
+    TRACE_SPAN("Spawn");
+    if (command.argv.empty()) {
+        *error = "Empty command";
+        return false;
+    }
+    std::string program = FindInPath(command.argv[0]);
+    std::vector<char*> argv;
+    for (const std::string& argument : command.argv) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+    // A command attached to a resource group gets the same descriptor with
+    // the group's cgroup, published for this launch only.
+    const PublishedEnvironment* published = state_->publishedEnvironment.get();
+    std::unique_ptr<PublishedEnvironment> groupEnvironment;
+    if (!command.cgroup.empty() && command.cgroup != state_->childEnvironment.cgroup) {
+        RuntimeEnvironment environment = state_->childEnvironment;
+        CopyField(environment.cgroup, command.cgroup);
+        groupEnvironment = PublishedEnvironment::Create(environment, error);
+        if (!groupEnvironment) {
+            return false;
+        }
+        published = groupEnvironment.get();
+    }
+    std::vector<char*> envp = BuildEnvp(published->Variable());
+
+    ChildContext context = {};
+    context.cgroupProcsFd = command.cgroupProcsFd;
+    context.processGroup = command.processTree;
+    context.namespaceFds = state_->namespaceFds.data();
+    context.namespaceCount = state_->namespaceFds.size();
+    context.cwd = command.cwd.empty() ? state_->cwd.c_str() : command.cwd.c_str();
+    context.stdio[0] = command.stdinFd;
+    context.stdio[1] = command.stdoutFd;
+    context.stdio[2] = command.stderrFd;
+    context.landlockRuleset = state_->landlockRuleset;
+    context.seccomp = state_->seccompFilter.empty() ? nullptr : &state_->seccompProgram;
+    context.program = program.c_str();
+    context.argv = argv.data();
+    context.envp = envp.data();
+    std::vector<int> keepFds = InheritedFds(command);
+    keepFds.push_back(published->Fd());
+    context.keepFds = keepFds.data();
+    context.keepCount = keepFds.size();
+
+    // CLONE_VM | CLONE_VFORK: no page tables are copied and this thread
+    // sleeps until the child has exec'd, so a small stack of our own is
+    // enough and the child can report failures through `context`.
+    // glibc's clone() is used instead of a raw clone3 because a child that
+    // shares our memory needs the wrapper's stack switch.
+    constexpr size_t kStackSize = 64 * 1024;
+    std::unique_ptr<char[]> stack(new char[kStackSize]);
+    int pidfd = -1;
+    pid_t pid = clone(SandboxChildMain, stack.get() + kStackSize,
+                      CLONE_VM | CLONE_VFORK | CLONE_PIDFD | SIGCHLD, &context, &pidfd);
+    if (pid < 0) {
+        *error = std::string("clone failed: ") + strerror(errno);
+        return false;
+    }
+    if (context.failedStep != nullptr) {
+        int status;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        close(pidfd);
+        *error = std::string("Sandboxed launch of ") + program + " failed in " +
+                 context.failedStep + ": " + strerror(context.failedErrno);
+        return false;
+    }
+    process->pid = pid;
+    process->pidfd = pidfd;
+    process->processGroup = command.processTree;
+    return true;
+}
+
+bool SandboxLauncher::Wait(LaunchedProcess* process, int* exitCode, std::string* error) {
+    EndProcessGroup(*process);
+    int status = 0;
+    pid_t result;
+    do {
+        result = waitpid(process->pid, &status, 0);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+        *error = std::string("waitpid failed: ") + strerror(errno);
+        return false;
+    }
+    if (process->pidfd >= 0) {
+        close(process->pidfd);
+    }
+    process->pid = -1;
+    process->pidfd = -1;
+    *exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return true;
+}
+
+bool SandboxLauncher::HasLandlock() const { return state_->landlockRuleset >= 0; }
+
+bool SandboxLauncher::HasSeccomp() const { return !state_->seccompFilter.empty(); }
+
+#else
+std::unique_ptr<SandboxLauncher> SandboxLauncher::Create(const SandboxPolicy&,
+                                                         std::string* error) {
+    *error = "Sandboxed launch is not supported on this platform";
+    return nullptr;
+}
+
+bool SandboxLauncher::AllowPath(const std::string&, bool, std::string*) { return true; }
+
+bool SandboxLauncher::Spawn(const LaunchCommand&, LaunchedProcess*, std::string* error) {
+    *error = "Sandboxed launch is not supported on this platform";
+    return false;
+}
+
+bool SandboxLauncher::Wait(LaunchedProcess*, int*, std::string* error) {
+    *error = "Sandboxed launch is not supported on this platform";
+    return false;
+}
+
+bool SandboxLauncher::HasLandlock() const { return false; }
+
+bool SandboxLauncher::HasSeccomp() const { return false; }
+#endif
+
+const RuntimeEnvironment& SandboxLauncher::ChildEnvironment() const {
+    return state_->childEnvironment;
+}
+
+#ifdef _WIN32
+bool SpawnProcess(const LaunchCommand& command, LaunchedProcess* process, std::string* error) {
+    TRACE_SPAN("SpawnProcess");
+    std::wstring commandLine = command.commandLine;
+    if (commandLine.empty()) {
+        for (const std::string& argument : command.argv) {
+            AppendQuoted(Widen(argument), &commandLine);
+        }
+    }
+    std::wstring cwd = Widen(command.cwd);
+
+    std::vector<HANDLE> inherited(command.inheritHandles.begin(), command.inheritHandles.end());
+    StdioHandles stdio(command);
+    stdio.AddTo(&inherited);
+    if (TraceSinkHandle() != NULL) {
+        inherited.push_back(TraceSinkHandle());
+    }
+    STARTUPINFOEXW startup = {};
+    startup.StartupInfo.cb = sizeof(startup);
+    std::vector<char> attributeBuffer;
+    LaunchJobs jobs;
+    if (!jobs.Init(command, error)) {
+        return false;
+    }
+    if (!inherited.empty() || !jobs.Empty()) {
+        SIZE_T size = 0;
+        InitializeProcThreadAttributeList(NULL, 2, 0, &size);
+        attributeBuffer.resize(size);
+        startup.lpAttributeList =
+            reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributeBuffer.data());
+        if (!InitializeProcThreadAttributeList(startup.lpAttributeList, 2, 0, &size) ||
+            (!inherited.empty() &&
+             !UpdateProcThreadAttribute(startup.lpAttributeList, 0,
+                                        PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherited.data(),
+                                        inherited.size() * sizeof(HANDLE), NULL, NULL)) ||
+            !jobs.AddTo(startup.lpAttributeList)) {
+            *error = Win32Error("UpdateProcThreadAttribute");
+            return false;
+        }
+    }
+    stdio.Apply(&startup.StartupInfo);
+    PROCESS_INFORMATION info = {};
+    BOOL ok = CreateProcessW(
+        NULL, &commandLine[0], NULL, NULL, inherited.empty() ? FALSE : TRUE,
+        (attributeBuffer.empty() ? 0 : EXTENDED_STARTUPINFO_PRESENT) | command.creationFlags, NULL,
+        cwd.empty() ? NULL : cwd.c_str(), &startup.StartupInfo, &info);
+    if (startup.lpAttributeList != NULL) {
+        DeleteProcThreadAttributeList(startup.lpAttributeList);
+    }
+    if (!ok) {
+        *error = Win32Error("CreateProcessW");
+        return false;
+    }
+    CloseHandle(info.hThread);
+    process->process = info.hProcess;
+    process->job = jobs.Release();
+    return true;
+}
+
+bool WaitProcess(LaunchedProcess* process, int timeoutMs, bool* exited, int* exitCode,
+                 std::string* error) {
+    DWORD result = WaitForSingleObject(process->process, timeoutMs < 0 ? INFINITE : timeoutMs);
+    *exited = false;
+    if (result == WAIT_TIMEOUT) {
+        return true;
+    }
+    DWORD code = 0;
+    if (result != WAIT_OBJECT_0 || !GetExitCodeProcess(process->process, &code)) {
+        *error = Win32Error("WaitForSingleObject");
+        return false;
+    }
+    ReleaseProcess(process);
+    *exited = true;
+    *exitCode = static_cast<int>(code);
+    return true;
+}
+
+bool AwaitExit(const LaunchedProcess& process, int timeoutMs) {
+    return WaitForSingleObject(process.process, timeoutMs < 0 ? INFINITE : timeoutMs) ==
+           WAIT_OBJECT_0;
+}
+
+void KillProcess(const LaunchedProcess& process, bool) {
+    if (process.job != nullptr) {
+        TerminateJobObject(process.job, 1);
+    } else {
+        ::TerminateProcess(process.process, 1);
+    }
+}
+#else
+bool SpawnProcess(const LaunchCommand& command, LaunchedProcess* process, std::string* error) {
+    TRACE_SPAN("SpawnProcess");
+    if (command.argv.empty()) {
+        *error = "Empty command";
+        return false;
+    }
+    std::vector<char*> argv;
+    for (const std::string& argument : command.argv) {
+        argv.push_back(const_cast<char*>(argument.c_str()));
+    }
+    argv.push_back(nullptr);
+    const int stdio[3] = {command.stdinFd, command.stdoutFd, command.stderrFd};
+    std::vector<int> keepFds = InheritedFds(command);
+    // The child reports a failed exec through this pipe, which exec closes.
+    int report[2];
+    if (pipe(report) != 0 || fcntl(report[1], F_SETFD, FD_CLOEXEC) != 0) {
+        *error = std::string("pipe failed: ") + strerror(errno);
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(report[0]);
+        if (command.cgroupProcsFd >= 0 && write(command.cgroupProcsFd, "0", 1) != 1) {
+            int code = errno;
+            (void)!write(report[1], &code, sizeof(code));
+            _exit(127);
+        }
+        if ((command.processTree && setpgid(0, 0) != 0) || !RedirectStdio(stdio) ||
+            !KeepOnlyFds(keepFds.data(), keepFds.size())) {
+            int code = errno;
+            (void)!write(report[1], &code, sizeof(code));
+            _exit(127);
+        }
+        if (command.cwd.empty() || chdir(command.cwd.c_str()) == 0) {
+            execvp(argv[0], argv.data());
+        }
+        int code = errno;
+        (void)!write(report[1], &code, sizeof(code));
+        _exit(127);
+    }
+    close(report[1]);
+    if (pid < 0) {
+        *error = std::string("fork failed: ") + strerror(errno);
+        close(report[0]);
+        return false;
+    }
+    int code = 0;
+    ssize_t reported;
+    while ((reported = read(report[0], &code, sizeof(code))) < 0 && errno == EINTR) {
+    }
+    close(report[0]);
+    if (reported == sizeof(code)) {
+        int status;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+        }
+        *error = "Launch of " + command.argv[0] + " failed: " + strerror(code);
+        return false;
+    }
+    process->pid = pid;
+#ifdef __linux__
+    process->pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#endif
+    process->processGroup = command.processTree;
+    return true;
+}
+
+bool WaitProcess(LaunchedProcess* process, int timeoutMs, bool* exited, int* exitCode,
+                 std::string* error) {
+    *exited = false;
+    if (process->processGroup) {
+        if (!AwaitExit(*process, timeoutMs) && timeoutMs >= 0) {
+            return true;
+        }
+        EndProcessGroup(*process);
+        timeoutMs = -1;
+    }
+    int status = 0;
+    pid_t result;
+#ifdef __linux__
+    // A pidfd becomes readable when the process exits, so the wait needs
+    // no polling.
+    if (process->pidfd >= 0 && timeoutMs >= 0) {
+        pollfd fd = {process->pidfd, POLLIN, 0};
+        int ready;
+        while ((ready = poll(&fd, 1, timeoutMs)) < 0 && errno == EINTR) {
+        }
+        if (ready == 0) {
+            return true;
+        }
+        timeoutMs = -1;
+    }
+#endif
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        result = waitpid(process->pid, &status, timeoutMs < 0 ? 0 : WNOHANG);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result != 0 || std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+        usleep(5000);
+    }
+    if (result == 0) {
+        return true;
+    }
+    if (result < 0) {
+        *error = std::string("waitpid failed: ") + strerror(errno);
+        return false;
+    }
+    if (process->pidfd >= 0) {
+        close(process->pidfd);
+    }
+    process->pid = -1;
+    process->pidfd = -1;
+    *exited = true;
+    *exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return true;
+}
+
+bool AwaitExit(const LaunchedProcess& process, int timeoutMs) {
+    if (process.pidfd >= 0) {
+        pollfd fd = {process.pidfd, POLLIN, 0};
+        int ready;
+        while ((ready = poll(&fd, 1, timeoutMs)) < 0 && errno == EINTR) {
+        }
+        return ready > 0;
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    for (;;) {
+        siginfo_t info = {};
+        int result = waitid(P_PID, static_cast<id_t>(process.pid), &info,
+                            WEXITED | WNOHANG | WNOWAIT);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0 || info.si_pid != 0) {
+            return result == 0;
+        }
+        if (timeoutMs >= 0 && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        usleep(5000);
+    }
+}
+
+void KillProcess(const LaunchedProcess& process, bool force) {
+    if (process.pid > 0) {
+        kill(process.processGroup ? -process.pid : process.pid, force ? SIGKILL : SIGTERM);
+    }
+}
+#endif
+
+}  // namespace sandbox
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "runtime_env.h"
+
+// Launches processes inside a sandbox whose expensive parts are prepared
+// once, so each launch costs one process creation.
+//
+// On Windows the sandbox is an AppContainer profile: the SID, the directory
+// grants (through GrantPlanner) and the SECURITY_CAPABILITIES attribute list
+// are set up in Create(), and Spawn() is a single CreateProcessW.
+//
+// On Linux Create() builds a user/mount/net namespace template, a Landlock
+// ruleset and a seccomp filter. Spawn() is one clone(CLONE_VM | CLONE_VFORK)
+// whose child joins the template namespaces with setns(), restricts itself
+// with the cached ruleset and filter, and execs. Every process launched from
+// the same launcher shares the template namespaces, the way processes in one
+// AppContainer share its SID.
+//
+// Create() also describes the children's environment once (see
+// runtime_env.h) and every child inherits it read-only, so sandboxed code
+// learns where it runs without probing.
+namespace sandbox {
+
+struct SandboxPolicy {
+    // AppContainer profile name (Windows).
+    std::string name = "PythonSandbox";
+    // Directories the sandbox may read and execute from, and directories it
+    // may also write to. On Windows both are granted through GrantPlanner.
+    std::vector<std::string> readPaths;
+    std::vector<std::string> writePaths;
+    // Linux: keep the host network namespace instead of an empty one.
+    bool network = false;
+    // Linux: fail Create() when the kernel lacks Landlock, instead of
+    // launching with namespaces and seccomp only.
+    bool requireLandlock = false;
+    // Windows: GrantPlanner index; empty disables the index.
+    std::string grantIndexPath;
+};
+
+struct LaunchCommand {
+    // argv[0] is the program. On POSIX it is looked up in PATH when it has no
+    // '/'; on Windows the command line is built with the usual quoting.
+    std::vector<std::string> argv;
+    std::string cwd;  // empty = the caller's cwd
+    // Launches the child as the root of a process tree that is handled as
+    // one: a process group on POSIX, a kill-on-close Job Object of its own
+    // on Windows (nested in `job` when that is set). KillProcess() then
+    // reaches everything the child started, ProcessSampler sums over it,
+    // and whatever is left of it is killed once the child has exited and
+    // is waited for.
+    bool processTree = false;
+#ifdef _WIN32
+    // Used verbatim instead of argv when set.
+    std::wstring commandLine;
+    // Handles the child inherits (PROC_THREAD_ATTRIBUTE_HANDLE_LIST); none
+    // are inherited when empty.
+    std::vector<void*> inheritHandles;
+    unsigned long creationFlags = 0;
+    // Inheritable handles for the child's stdio (STARTF_USESTDHANDLES),
+    // added to the inherited handles. nullptr keeps the caller's.
+    void* stdInput = nullptr;
+    void* stdOutput = nullptr;
+    void* stdError = nullptr;
+    // Job Object the child is created in (PROC_THREAD_ATTRIBUTE_JOB_LIST),
+    // so it is limited before it runs. See ResourceGroup::Attach().
+    void* job = nullptr;
+#else
+    // Descriptors for the child's stdio; -1 keeps the caller's.
+    int stdinFd = -1;
+    int stdoutFd = -1;
+    int stderrFd = -1;
+    // Descriptors the child inherits at the same numbers. Every other
+    // descriptor above 2 is closed on exec, whether or not it was opened
+    // close-on-exec.
+    std::vector<int> inheritFds;
+    // Linux: a cgroup.procs file the child moves itself into first, before
+    // it joins the sandbox. See ResourceGroup::Attach().
+    int cgroupProcsFd = -1;
+    // That cgroup relative to the cgroup v2 root, for the child's
+    // RuntimeEnvironment; empty leaves the launcher's own there.
+    std::string cgroup;
+#endif
+};
+
+struct LaunchedProcess {
+#ifdef _WIN32
+    void* process = nullptr;  // HANDLE
+    void* job = nullptr;      // HANDLE of the processTree job, if any
+#else
+    int pid = -1;
+    int pidfd = -1;
+    // Leads a process group of the same id (processTree).
+    bool processGroup = false;
+#endif
+};
+
+class SandboxLauncher {
+public:
+    ~SandboxLauncher();
+
+    SandboxLauncher(const SandboxLauncher&) = delete;
+    SandboxLauncher& operator=(const SandboxLauncher&) = delete;
+
+    static std::unique_ptr<SandboxLauncher> Create(const SandboxPolicy& policy, std::string* error);
+
+    // Extends the policy for later launches.
+    bool AllowPath(const std::string& path, bool write, std::string* error);
+
+    bool Spawn(const LaunchCommand& command, LaunchedProcess* process, std::string* error);
+
+    // Waits for the process, releases its handles and returns its exit code
+    // (128 + signal on POSIX when it was killed).
+    bool Wait(LaunchedProcess* process, int* exitCode, std::string* error);
+
+    // What Create() managed to set up, for diagnostics.
+    bool HasLandlock() const;
+    bool HasSeccomp() const;
+
+    // The descriptor children inherit. One attached to a resource group
+    // gets a copy that names the group's cgroup.
+    const RuntimeEnvironment& ChildEnvironment() const;
+
+private:
+    struct State;
+
+    SandboxLauncher();
+
+    std::unique_ptr<State> state_;
+};
+
+// Launches without a sandbox, so ordinary processes can be supervised the
+// same way as sandboxed ones.
+bool SpawnProcess(const LaunchCommand& command, LaunchedProcess* process, std::string* error);
+
+// Waits up to timeoutMs (-1: forever) for a process from SpawnProcess() or
+// SandboxLauncher::Spawn(). Once it has exited, *exited is set and the
+// process is released as by SandboxLauncher::Wait().
+bool WaitProcess(LaunchedProcess* process, int timeoutMs, bool* exited, int* exitCode,
+                 std::string* error);
+
+// Waits up to timeoutMs (-1: forever) for the process to exit without
+// releasing it, so its final resource use can still be read (a POSIX
+// zombie keeps its /proc entry). Returns whether it has exited.
+bool AwaitExit(const LaunchedProcess& process, int timeoutMs);
+
+// Asks the process to exit (SIGTERM); kills it outright with force, and
+// always on Windows. Reaches the whole tree of a processTree launch.
+void KillProcess(const LaunchedProcess& process, bool force);
+
+#ifdef __linux__
+// The pieces Create() prepares once, exposed so spawn_bench can time the
+// same sandbox built from scratch on every launch.
+
+// Landlock ruleset fd for the policy's paths, or -1 with *error set (also
+// when the kernel has no Landlock).
+int CreateLandlockRuleset(const SandboxPolicy& policy, std::string* error);
+bool AddLandlockPath(int ruleset, const std::string& path, bool write, std::string* error);
+
+// Builds and installs the seccomp filter on the calling thread. Requires
+// no_new_privs or CAP_SYS_ADMIN.
+bool InstallSeccompFilter(std::string* error);
+
+// Maps the caller's uid and gid to themselves in the user namespace of pid,
+// which must have just unshared it.
+bool WriteIdMaps(int pid, std::string* error);
+#endif
+
+}  // namespace sandbox
@@ -0,0 +1,146 @@
+// Runs a command in a resource group of its own (see resource_group.h),
+// optionally sandboxed, and prints what the group used once it exits:
+// CPU time, peak memory, I/O and pressure stalls.
+//
+// Example:
+//   limitrun /limits memory=4G,cpu=2,pids=256 /sandbox python3 workflow.py
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "launcher.h"
+#include "resource_group.h"
+#include "trace.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] command [args...]\n"
+              << "Options:\n"
+              << "  /limits <list>    memory=<size>,cpu=<cpus>,weight=<1-10000>,pids=<n>,\n"
+              << "                    cpuset=<cpus>,numa=<nodes>,\n"
+              << "                    device=<path>,rbps=<size>,wbps=<size>,riops=<n>,wiops=<n>\n"
+              << "                    besteffort (run even if some cannot be applied)\n"
+              << "  /parent <dir>     cgroup to create the group in (default: our own)\n"
+              << "  /sandbox          Run the command through SandboxLauncher\n"
+              << "  /read <dir>       Readable directory for /sandbox (repeatable)\n"
+              << "  /write <dir>      Writable directory for /sandbox (repeatable)\n"
+              << "  /trace <file>     Write a Chrome trace of the launch (SANDBOX_TRACE builds)\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    sandbox::ResourceLimits limits;
+    sandbox::SandboxPolicy policy;
+    std::string parent;
+    bool sandboxed = false;
+    std::string error;
+    int first = 1;
+    for (; first < argc; first++) {
+        const char* arg = argv[first];
+        bool hasValue = first + 1 < argc;
+        if (IsFlag(arg, "limits") && hasValue) {
+            if (!sandbox::ParseResourceLimits(argv[++first], &limits, &error)) {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+        } else if (IsFlag(arg, "parent") && hasValue) {
+            parent = argv[++first];
+        } else if (IsFlag(arg, "sandbox")) {
+            sandboxed = true;
+        } else if (IsFlag(arg, "read") && hasValue) {
+            policy.readPaths.push_back(argv[++first]);
+        } else if (IsFlag(arg, "write") && hasValue) {
+            policy.writePaths.push_back(argv[++first]);
+        } else if (IsFlag(arg, "trace") && hasValue) {
+            if (!sandbox::StartTrace(argv[++first], &error)) {
+                fprintf(stderr, "%s\n", error.c_str());
+                return 1;
+            }
+        } else {
+            break;
+        }
+    }
+    if (first >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::unique_ptr<sandbox::SandboxLauncher> launcher;
+    if (sandboxed) {
+#ifndef _WIN32
+        if (policy.readPaths.empty()) {
+            for (const char* path : {"/usr", "/lib", "/lib64", "/bin", "/etc"}) {
+                if (access(path, F_OK) == 0) {
+                    policy.readPaths.push_back(path);
+                }
+            }
+        }
+#endif
+        if (!sandbox::TraceHookDirectory().empty()) {
+            policy.readPaths.push_back(sandbox::TraceHookDirectory());
+        }
+        launcher = sandbox::SandboxLauncher::Create(policy, &error);
+        if (!launcher) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    std::unique_ptr<sandbox::ResourceGroup> group;
+    {
+        TRACE_SPAN("Resource group");
+        group = sandbox::ResourceGroup::Create("limitrun", limits, parent, &error);
+    }
+    if (!group) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    for (const std::string& reason : group->Unapplied()) {
+        fprintf(stderr, "limit not applied: %s\n", reason.c_str());
+    }
+
+    sandbox::LaunchCommand command;
+    command.argv.assign(argv + first, argv + argc);
+    group->Attach(&command);
+    sandbox::LaunchedProcess process;
+    bool started = launcher ? launcher->Spawn(command, &process, &error)
+                            : sandbox::SpawnProcess(command, &process, &error);
+    if (!started) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    bool exited = false;
+    int exitCode = 0;
+    bool waited;
+    {
+        TRACE_SPAN("Wait");
+        waited = sandbox::WaitProcess(&process, -1, &exited, &exitCode, &error);
+    }
+    if (!waited) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    // The group outlives its last process, so everything it started is
+    // counted, including children that exited before the command did.
+    sandbox::ResourceUsage usage;
+    if (!group->ReadUsage(&usage, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return exitCode;
+    }
+    fprintf(stderr, "exit %d: %s\n", exitCode, sandbox::FormatResourceUsage(usage).c_str());
+    return exitCode;
+}
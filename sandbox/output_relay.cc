@@ -0,0 +1,654 @@
+#include "output_relay.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace sandbox {
+
+namespace {
+
+constexpr size_t kChunk = 64 * 1024;
+constexpr int kStdout = 0;
+constexpr int kStderr = 1;
+// The writer sleeps at most this long when the rings are empty.
+constexpr auto kWriterIdle = std::chrono::milliseconds(20);
+// Log output is written out once this much is formatted.
+constexpr size_t kLogBuffer = 256 * 1024;
+
+uint64_t WallClockNanoseconds() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::system_clock::now().time_since_epoch())
+                                     .count());
+}
+
+size_t RoundUpPowerOfTwo(size_t value) {
+    size_t result = 4096;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+// Single-producer / single-consumer ring of timestamped lines. Records are
+// a header and the text, 8-byte aligned, never split across the end of the
+// buffer: a record that does not fit before the end is preceded by a wrap
+// marker (or, with less room than a header, by nothing) and starts at 0.
+class LineRing {
+public:
+    struct Record {
+        uint64_t timeNs;
+        uint32_t length;
+        uint32_t flags;
+    };
+    static constexpr uint32_t kWrap = 1;
+    static constexpr uint32_t kPartial = 2;
+
+    explicit LineRing(size_t capacity)
+        : buffer_(RoundUpPowerOfTwo(capacity)), mask_(buffer_.size() - 1) {}
+
+    size_t MaxText() const { return buffer_.size() / 2 - sizeof(Record); }
+
+    // Producer. False when the ring has no room; nothing is written then.
+    bool Push(uint64_t timeNs, const char* text, size_t length, uint32_t flags) {
+        size_t need = Align(sizeof(Record) + length);
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        uint64_t head = head_.load(std::memory_order_acquire);
+        size_t offset = static_cast<size_t>(tail & mask_);
+        size_t toEnd = buffer_.size() - offset;
+        size_t skip = toEnd < need ? toEnd : 0;
+        if (length > MaxText() || buffer_.size() - (tail - head) < skip + need) {
+            return false;
+        }
+        if (skip > 0) {
+            if (skip >= sizeof(Record)) {
+                Record wrap = {0, 0, kWrap};
+                memcpy(&buffer_[offset], &wrap, sizeof(wrap));
+            }
+            tail += skip;
+            offset = 0;
+        }
+        Record record = {timeNs, static_cast<uint32_t>(length), flags};
+        memcpy(&buffer_[offset], &record, sizeof(record));
+        memcpy(&buffer_[offset + sizeof(record)], text, length);
+        tail_.store(tail + need, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer. The oldest record, valid until Pop().
+    bool Front(Record* record, const char** text) {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t tail = tail_.load(std::memory_order_acquire);
+        while (head != tail) {
+            size_t offset = static_cast<size_t>(head & mask_);
+            size_t toEnd = buffer_.size() - offset;
+            if (toEnd >= sizeof(Record)) {
+                memcpy(record, &buffer_[offset], sizeof(Record));
+                if ((record->flags & kWrap) == 0) {
+                    *text = &buffer_[offset + sizeof(Record)];
+                    frontEnd_ = head + Align(sizeof(Record) + record->length);
+                    return true;
+                }
+            }
+            head += toEnd;
+            head_.store(head, std::memory_order_release);
+        }
+        return false;
+    }
+
+    void Pop() { head_.store(frontEnd_, std::memory_order_release); }
+
+private:
+    static size_t Align(size_t size) { return (size + 7) & ~size_t(7); }
+
+    std::vector<char> buffer_;
+    size_t mask_;
+    uint64_t frontEnd_ = 0;
+    alignas(64) std::atomic<uint64_t> head_{0};
+    alignas(64) std::atomic<uint64_t> tail_{0};
+};
+
+#ifdef _WIN32
+using PipeHandle = HANDLE;
+const PipeHandle kNoPipe = NULL;
+
+void ClosePipe(PipeHandle* pipe) {
+    if (*pipe != kNoPipe) {
+        CloseHandle(*pipe);
+        *pipe = kNoPipe;
+    }
+}
+#else
+using PipeHandle = int;
+constexpr PipeHandle kNoPipe = -1;
+
+void ClosePipe(PipeHandle* pipe) {
+    if (*pipe != kNoPipe) {
+        close(*pipe);
+        *pipe = kNoPipe;
+    }
+}
+
+bool WriteAll(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+#endif
+
+// Appends `text` to `out` as the body of a JSON string.
+void AppendJsonEscaped(const char* text, size_t length, std::string* out) {
+    static const char kHex[] = "0123456789abcdef";
+    size_t plain = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out->append(text + plain, i - plain);
+        plain = i + 1;
+        switch (c) {
+        case '"':
+            *out += "\\\"";
+            break;
+        case '\\':
+            *out += "\\\\";
+            break;
+        case '\t':
+            *out += "\\t";
+            break;
+        case '\r':
+            *out += "\\r";
+            break;
+        default:
+            *out += "\\u00";
+            *out += kHex[c >> 4];
+            *out += kHex[c & 15];
+        }
+    }
+    out->append(text + plain, length - plain);
+}
+
+}  // namespace
+
+struct OutputRelay::State {
+    struct Stream {
+        explicit Stream(size_t ringBytes) : ring(ringBytes) {}
+
+        int index = kStdout;
+        PipeHandle read = kNoPipe;
+        PipeHandle write = kNoPipe;  // the child's end
+#ifndef _WIN32
+        // Side pipe the tee()d copy of the output goes through; -1 when the
+        // echo is not spliced.
+        int teeRead = -1;
+        int teeWrite = -1;
+#endif
+        LineRing ring;
+        std::string partial;
+        std::thread thread;
+    };
+
+    OutputRelayOptions options;
+    std::unique_ptr<Stream> streams[2];
+    std::thread writer;
+
+    std::atomic<uint64_t> bytes[2] = {{0}, {0}};
+    std::atomic<uint64_t> lines{0};
+    std::atomic<uint64_t> droppedLines{0};
+    std::atomic<uint64_t> splicedBytes{0};
+    std::atomic<uint64_t> loggedBytes{0};
+    std::atomic<unsigned> rotations{0};
+
+    // Only for waking the writer; lines never pass through the lock.
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<bool> writerSleeping{false};
+    std::atomic<int> openStreams{2};
+    bool finished = false;
+
+    FILE* log = nullptr;
+    uint64_t logSize = 0;
+    std::string logBuffer;
+    time_t formattedSecond = -1;
+    char formattedPrefix[32] = {};
+
+    void WakeWriter() {
+        if (writerSleeping.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wake.notify_one();
+        }
+    }
+
+    void PushLine(Stream& stream, uint64_t timeNs, const char* text, size_t length,
+                  uint32_t flags) {
+        if (length > 0 && text[length - 1] == '\r') {
+            length--;
+        }
+        while (length > options.maxLine) {
+            PushLine(stream, timeNs, text, options.maxLine, LineRing::kPartial);
+            text += options.maxLine;
+            length -= options.maxLine;
+        }
+        if (stream.ring.Push(timeNs, text, length, flags)) {
+            lines.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            droppedLines.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Cuts a chunk of output into lines; the tail without a newline waits
+    // for the next chunk (or end-of-file).
+    void Feed(Stream& stream, const char* data, size_t length) {
+        bytes[stream.index].fetch_add(length, std::memory_order_relaxed);
+        uint64_t now = WallClockNanoseconds();
+        const char* end = data + length;
+        while (data < end) {
+            const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+            if (newline == nullptr) {
+                stream.partial.append(data, end);
+                break;
+            }
+            if (stream.partial.empty()) {
+                PushLine(stream, now, data, newline - data, 0);
+            } else {
+                stream.partial.append(data, newline);
+                PushLine(stream, now, stream.partial.data(), stream.partial.size(), 0);
+                stream.partial.clear();
+            }
+            data = newline + 1;
+        }
+        while (stream.partial.size() >= options.maxLine) {
+            PushLine(stream, now, stream.partial.data(), options.maxLine, LineRing::kPartial);
+            stream.partial.erase(0, options.maxLine);
+        }
+        WakeWriter();
+    }
+
+    void EndOfStream(Stream& stream) {
+        if (!stream.partial.empty()) {
+            PushLine(stream, WallClockNanoseconds(), stream.partial.data(), stream.partial.size(),
+                     0);
+            stream.partial.clear();
+        }
+        openStreams.fetch_sub(1, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        wake.notify_one();
+    }
+
+#ifdef _WIN32
+    void ReadStream(Stream& stream) {
+        HANDLE echo = GetStdHandle(stream.index == kStdout ? STD_OUTPUT_HANDLE : STD_ERROR_HANDLE);
+        std::vector<char> buffer(kChunk);
+        DWORD received = 0;
+        while (ReadFile(stream.read, buffer.data(), static_cast<DWORD>(buffer.size()), &received,
+                        NULL) &&
+               received > 0) {
+            if (options.echo && echo != NULL && echo != INVALID_HANDLE_VALUE) {
+                DWORD written;
+                WriteFile(echo, buffer.data(), received, &written, NULL);
+            }
+            Feed(stream, buffer.data(), received);
+        }
+        EndOfStream(stream);
+    }
+#else
+    // Splices `length` bytes that are at the head of the child's pipe to the
+    // echo descriptor. False (with nothing moved) when the target does not
+    // support splice.
+    bool SpliceEcho(Stream& stream, int echo, size_t length) {
+        bool moved = false;
+        while (length > 0) {
+            ssize_t spliced = splice(stream.read, nullptr, echo, nullptr, length, 0);
+            if (spliced <= 0) {
+                if (spliced < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (!moved) {
+                    return false;
+                }
+                // The echo target went away mid-chunk; drop the rest of it
+                // from the pipe, the tee()d copy still has it.
+                char discard[4096];
+                while (length > 0) {
+                    ssize_t n = read(stream.read, discard, std::min(length, sizeof(discard)));
+                    if (n <= 0) {
+                        break;
+                    }
+                    length -= static_cast<size_t>(n);
+                }
+                return true;
+            }
+            moved = true;
+            length -= static_cast<size_t>(spliced);
+            splicedBytes.fetch_add(static_cast<uint64_t>(spliced), std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void ReadStream(Stream& stream) {
+        int echo = options.echo ? (stream.index == kStdout ? STDOUT_FILENO : STDERR_FILENO) : -1;
+        std::vector<char> buffer(kChunk);
+#ifdef __linux__
+        // tee() duplicates what the child wrote into the side pipe without
+        // consuming it; the original is then spliced to the echo target and
+        // the copy read for the line splitter.
+        while (stream.teeRead >= 0) {
+            ssize_t teed = tee(stream.read, stream.teeWrite, kChunk, 0);
+            if (teed < 0 && errno == EINTR) {
+                continue;
+            }
+            if (teed <= 0) {
+                if (teed == 0) {
+                    EndOfStream(stream);
+                    return;
+                }
+                break;
+            }
+            size_t length = static_cast<size_t>(teed);
+            bool spliced = SpliceEcho(stream, echo, length);
+            size_t copied = 0;
+            while (copied < length) {
+                ssize_t n = read(stream.teeRead, buffer.data(), std::min(length - copied, kChunk));
+                if (n <= 0) {
+                    if (n < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    break;
+                }
+                copied += static_cast<size_t>(n);
+                Feed(stream, buffer.data(), static_cast<size_t>(n));
+            }
+            if (!spliced) {
+                // The bytes are still in the child's pipe: echo them with
+                // read/write from now on.
+                ClosePipe(&stream.teeRead);
+                ClosePipe(&stream.teeWrite);
+                while (length > 0) {
+                    ssize_t n = read(stream.read, buffer.data(), std::min(length, kChunk));
+                    if (n <= 0) {
+                        break;
+                    }
+                    WriteAll(echo, buffer.data(), static_cast<size_t>(n));
+                    length -= static_cast<size_t>(n);
+                }
+            }
+        }
+#endif
+        for (;;) {
+            ssize_t received = read(stream.read, buffer.data(), buffer.size());
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                break;
+            }
+            if (echo >= 0) {
+                WriteAll(echo, buffer.data(), static_cast<size_t>(received));
+            }
+            Feed(stream, buffer.data(), static_cast<size_t>(received));
+        }
+        EndOfStream(stream);
+    }
+#endif
+
+    // Writer thread ----------------------------------------------------------
+
+    bool OpenLog() {
+        log = fopen(options.logPath.c_str(), "ab");
+        if (log == nullptr) {
+            return false;
+        }
+        fseek(log, 0, SEEK_END);
+        long size = ftell(log);
+        logSize = size > 0 ? static_cast<uint64_t>(size) : 0;
+        return true;
+    }
+
+    void Rotate() {
+        fclose(log);
+        log = nullptr;
+        const std::string& path = options.logPath;
+        if (options.keepFiles == 0) {
+            remove(path.c_str());
+        } else {
+            remove((path + "." + std::to_string(options.keepFiles)).c_str());
+            for (unsigned i = options.keepFiles - 1; i >= 1; i--) {
+                rename((path + "." + std::to_string(i)).c_str(),
+                       (path + "." + std::to_string(i + 1)).c_str());
+            }
+            rename(path.c_str(), (path + ".1").c_str());
+        }
+        rotations.fetch_add(1, std::memory_order_relaxed);
+        OpenLog();
+    }
+
+    void WriteLog() {
+        if (logBuffer.empty()) {
+            return;
+        }
+        if (log != nullptr) {
+            fwrite(logBuffer.data(), 1, logBuffer.size(), log);
+            fflush(log);
+            logSize += logBuffer.size();
+            loggedBytes.fetch_add(logBuffer.size(), std::memory_order_relaxed);
+        }
+        logBuffer.clear();
+    }
+
+    void FormatRecord(int index, const LineRing::Record& record, const char* text) {
+        time_t second = static_cast<time_t>(record.timeNs / 1000000000);
+        if (second != formattedSecond) {
+            tm utc;
+#ifdef _WIN32
+            gmtime_s(&utc, &second);
+#else
+            gmtime_r(&second, &utc);
+#endif
+            strftime(formattedPrefix, sizeof(formattedPrefix), "%Y-%m-%dT%H:%M:%S", &utc);
+            formattedSecond = second;
+        }
+        char fraction[16];
+        snprintf(fraction, sizeof(fraction), ".%06u",
+                 static_cast<unsigned>(record.timeNs % 1000000000 / 1000));
+        size_t start = logBuffer.size();
+        logBuffer += "{\"time\":\"";
+        logBuffer += formattedPrefix;
+        logBuffer += fraction;
+        logBuffer += index == kStdout ? "Z\",\"stream\":\"stdout\",\"text\":\""
+                                      : "Z\",\"stream\":\"stderr\",\"text\":\"";
+        AppendJsonEscaped(text, record.length, &logBuffer);
+        logBuffer += (record.flags & LineRing::kPartial) != 0 ? "\",\"partial\":true}\n" : "\"}\n";
+        // A line that would push the file past its limit starts the next one.
+        if (log != nullptr && logSize > 0 &&
+            logSize + logBuffer.size() > options.maxFileBytes) {
+            std::string line = logBuffer.substr(start);
+            logBuffer.resize(start);
+            WriteLog();
+            Rotate();
+            logBuffer = line;
+        }
+        if (logBuffer.size() >= kLogBuffer) {
+            WriteLog();
+        }
+    }
+
+    // Moves every queued line to the log, oldest first across both streams.
+    bool Drain() {
+        bool any = false;
+        LineRing::Record records[2];
+        const char* texts[2];
+        bool ready[2] = {
+            streams[0]->ring.Front(&records[0], &texts[0]),
+            streams[1]->ring.Front(&records[1], &texts[1]),
+        };
+        while (ready[0] || ready[1]) {
+            int index = !ready[1] || (ready[0] && records[0].timeNs <= records[1].timeNs) ? 0 : 1;
+            FormatRecord(index, records[index], texts[index]);
+            streams[index]->ring.Pop();
+            ready[index] = streams[index]->ring.Front(&records[index], &texts[index]);
+            any = true;
+        }
+        WriteLog();
+        return any;
+    }
+
+    void RunWriter() {
+        for (;;) {
+            bool done = openStreams.load(std::memory_order_acquire) == 0;
+            if (Drain()) {
+                continue;
+            }
+            if (done) {
+                break;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            writerSleeping.store(true, std::memory_order_release);
+            wake.wait_for(lock, kWriterIdle);
+            writerSleeping.store(false, std::memory_order_relaxed);
+        }
+        if (log != nullptr) {
+            fclose(log);
+            log = nullptr;
+        }
+    }
+};
+
+OutputRelay::OutputRelay() : state_(new State()) {}
+
+OutputRelay::~OutputRelay() {
+    ChildStarted();
+    Finish();
+}
+
+std::unique_ptr<OutputRelay> OutputRelay::Create(const OutputRelayOptions& options,
+                                                 std::string* error) {
+    std::unique_ptr<OutputRelay> relay(new OutputRelay());
+    State& state = *relay->state_;
+    state.options = options;
+    state.options.maxLine = std::max<size_t>(options.maxLine, 256);
+    state.options.ringBytes = std::max(options.ringBytes, state.options.maxLine * 4);
+    if (!options.logPath.empty() && !state.OpenLog()) {
+        *error = "Cannot open log file " + options.logPath + ": " + strerror(errno);
+        return nullptr;
+    }
+
+    for (int index = 0; index < 2; index++) {
+        state.streams[index].reset(new State::Stream(state.options.ringBytes));
+        State::Stream& stream = *state.streams[index];
+        stream.index = index;
+#ifdef _WIN32
+        SECURITY_ATTRIBUTES inheritable = {static_cast<DWORD>(sizeof(inheritable)), NULL, TRUE};
+        if (!CreatePipe(&stream.read, &stream.write, &inheritable, 1 << 20) ||
+            !SetHandleInformation(stream.read, HANDLE_FLAG_INHERIT, 0)) {
+            *error = "CreatePipe failed with error " + std::to_string(GetLastError());
+            return nullptr;
+        }
+#else
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            *error = std::string("pipe2 failed: ") + strerror(errno);
+            return nullptr;
+        }
+        stream.read = fds[0];
+        stream.write = fds[1];
+#ifdef __linux__
+        // Room for a burst while the relay is busy; the default is 64 KB.
+        fcntl(stream.read, F_SETPIPE_SZ, 1 << 20);
+        if (options.echo && pipe2(fds, O_CLOEXEC) == 0) {
+            stream.teeRead = fds[0];
+            stream.teeWrite = fds[1];
+            fcntl(stream.teeWrite, F_SETPIPE_SZ, 1 << 20);
+        }
+#endif
+#endif
+    }
+    for (auto& stream : state.streams) {
+        State::Stream* current = stream.get();
+        stream->thread = std::thread([&state, current] { state.ReadStream(*current); });
+    }
+    state.writer = std::thread([&state] { state.RunWriter(); });
+    return relay;
+}
+
+void OutputRelay::Attach(LaunchCommand* command) {
+#ifdef _WIN32
+    command->stdOutput = state_->streams[kStdout]->write;
+    command->stdError = state_->streams[kStderr]->write;
+#else
+    command->stdoutFd = state_->streams[kStdout]->write;
+    command->stderrFd = state_->streams[kStderr]->write;
+#endif
+}
+
+void OutputRelay::ChildStarted() {
+    for (auto& stream : state_->streams) {
+        if (stream) {
+            ClosePipe(&stream->write);
+        }
+    }
+}
+
+void OutputRelay::Finish() {
+    State& state = *state_;
+    if (state.finished) {
+        return;
+    }
+    state.finished = true;
+    for (auto& stream : state.streams) {
+        if (stream && stream->thread.joinable()) {
+            stream->thread.join();
+        }
+    }
+    if (state.writer.joinable()) {
+        state.writer.join();
+    }
+    for (auto& stream : state.streams) {
+        if (stream) {
+            ClosePipe(&stream->read);
+#ifndef _WIN32
+            ClosePipe(&stream->teeRead);
+            ClosePipe(&stream->teeWrite);
+#endif
+        }
+    }
+}
+
+OutputRelayStats OutputRelay::Stats() const {
+    const State& state = *state_;
+    OutputRelayStats stats;
+    stats.bytes[kStdout] = state.bytes[kStdout].load(std::memory_order_relaxed);
+    stats.bytes[kStderr] = state.bytes[kStderr].load(std::memory_order_relaxed);
+    stats.lines = state.lines.load(std::memory_order_relaxed);
+    stats.droppedLines = state.droppedLines.load(std::memory_order_relaxed);
+    stats.splicedBytes = state.splicedBytes.load(std::memory_order_relaxed);
+    stats.loggedBytes = state.loggedBytes.load(std::memory_order_relaxed);
+    stats.rotations = state.rotations.load(std::memory_order_relaxed);
+    return stats;
+}
+
+}  // namespace sandbox
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "launcher.h"
+
+// Captures a child's stdout and stderr over pipes instead of letting it
+// inherit the console (or, with CREATE_NO_WINDOW, lose its output).
+//
+// One reader per stream drains the pipe as fast as the child writes, echoes
+// the bytes to this process's own stdout / stderr and cuts them into
+// timestamped lines. On Linux the echo is spliced pipe-to-fd after a tee()
+// into a side pipe the line splitter reads, so the passthrough never goes
+// through user space; targets splice cannot write to fall back to
+// read/write.
+//
+// Lines go into a lock-free single-producer ring per stream. A separate
+// writer thread drains the rings into JSON-lines log files rotated by size.
+// A reader never waits for the writer: when the disk falls behind and a ring
+// fills, lines are dropped and counted instead, so a slow disk cannot stall
+// the child.
+namespace sandbox {
+
+struct OutputRelayOptions {
+    // Log file; rotated to <logPath>.1 ... .<keepFiles>. Empty keeps lines
+    // in memory (and echoes them) only.
+    std::string logPath;
+    uint64_t maxFileBytes = 16ull << 20;
+    unsigned keepFiles = 4;
+    // Per-stream line ring.
+    size_t ringBytes = 4u << 20;
+    // Longer lines are logged in pieces of this size.
+    size_t maxLine = 16u << 10;
+    // Passes the child's output through to this process's stdout / stderr.
+    bool echo = true;
+};
+
+struct OutputRelayStats {
+    uint64_t bytes[2] = {};  // stdout, stderr
+    uint64_t lines = 0;
+    uint64_t droppedLines = 0;
+    uint64_t splicedBytes = 0;
+    uint64_t loggedBytes = 0;
+    unsigned rotations = 0;
+};
+
+class OutputRelay {
+public:
+    ~OutputRelay();
+
+    OutputRelay(const OutputRelay&) = delete;
+    OutputRelay& operator=(const OutputRelay&) = delete;
+
+    static std::unique_ptr<OutputRelay> Create(const OutputRelayOptions& options,
+                                               std::string* error);
+
+    // Points the command's stdout and stderr at the relay's pipes. Call
+    // ChildStarted() once the child is spawned (or failed to spawn), so the
+    // relay drops its copies of the write ends and sees end-of-file when
+    // the child exits.
+    void Attach(LaunchCommand* command);
+    void ChildStarted();
+
+    // Waits until both streams reach end-of-file and every line is logged.
+    void Finish();
+
+    // Safe to call while the relay runs.
+    OutputRelayStats Stats() const;
+
+private:
+    struct State;
+
+    OutputRelay();
+
+    std::unique_ptr<State> state_;
+};
+
+}  // namespace sandbox
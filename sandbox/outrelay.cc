@@ -0,0 +1,115 @@
+// Runs a command through SandboxLauncher with its stdout and stderr
+// captured by OutputRelay: echoed here and logged as timestamped JSON lines
+// to rotated files.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "launcher.h"
+#include "output_relay.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] command [args...]\n"
+              << "Options:\n"
+              << "  /log <file>      Log file (default: none, echo only)\n"
+              << "  /max <MB>        Rotate the log at this size (default: 16)\n"
+              << "  /keep <n>        Rotated files kept (default: 4)\n"
+              << "  /quiet           Do not echo the command's output\n"
+              << "  /stats           Print relay statistics at exit\n"
+              << "  /read <dir>      Readable directory (repeatable)\n"
+              << "  /write <dir>     Writable directory (repeatable)\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    sandbox::OutputRelayOptions options;
+    sandbox::SandboxPolicy policy;
+    bool printStats = false;
+    int first = 1;
+    for (; first < argc; first++) {
+        const char* arg = argv[first];
+        bool hasValue = first + 1 < argc;
+        if (IsFlag(arg, "log") && hasValue) {
+            options.logPath = argv[++first];
+        } else if (IsFlag(arg, "max") && hasValue) {
+            options.maxFileBytes = strtoull(argv[++first], nullptr, 10) << 20;
+        } else if (IsFlag(arg, "keep") && hasValue) {
+            options.keepFiles = static_cast<unsigned>(atoi(argv[++first]));
+        } else if (IsFlag(arg, "quiet")) {
+            options.echo = false;
+        } else if (IsFlag(arg, "stats")) {
+            printStats = true;
+        } else if (IsFlag(arg, "read") && hasValue) {
+            policy.readPaths.push_back(argv[++first]);
+        } else if (IsFlag(arg, "write") && hasValue) {
+            policy.writePaths.push_back(argv[++first]);
+        } else {
+            break;
+        }
+    }
+    if (first >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+#ifndef _WIN32
+    if (policy.readPaths.empty()) {
+        for (const char* path : {"/usr", "/lib", "/lib64", "/bin", "/etc"}) {
+            if (access(path, F_OK) == 0) {
+                policy.readPaths.push_back(path);
+            }
+        }
+    }
+#endif
+
+    std::string error;
+    std::unique_ptr<sandbox::SandboxLauncher> launcher =
+        sandbox::SandboxLauncher::Create(policy, &error);
+    if (!launcher) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    std::unique_ptr<sandbox::OutputRelay> relay = sandbox::OutputRelay::Create(options, &error);
+    if (!relay) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    sandbox::LaunchCommand command;
+    command.argv.assign(argv + first, argv + argc);
+    relay->Attach(&command);
+    sandbox::LaunchedProcess process;
+    bool started = launcher->Spawn(command, &process, &error);
+    relay->ChildStarted();
+    int exitCode = 1;
+    if (!started || !launcher->Wait(&process, &exitCode, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+    }
+    relay->Finish();
+
+    if (printStats) {
+        sandbox::OutputRelayStats stats = relay->Stats();
+        fprintf(stderr,
+                "relay: %llu stdout + %llu stderr bytes, %llu lines (%llu dropped), "
+                "%llu spliced, %llu logged, %u rotations\n",
+                static_cast<unsigned long long>(stats.bytes[0]),
+                static_cast<unsigned long long>(stats.bytes[1]),
+                static_cast<unsigned long long>(stats.lines),
+                static_cast<unsigned long long>(stats.droppedLines),
+                static_cast<unsigned long long>(stats.splicedBytes),
+                static_cast<unsigned long long>(stats.loggedBytes), stats.rotations);
+    }
+    return exitCode;
+}
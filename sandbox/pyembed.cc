@@ -0,0 +1,78 @@
+// Runs a Python script in this process through the embedded interpreter,
+// e.g. to compare its startup against exec'ing python.
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "embedded_python.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] script [args...]\n"
+              << "Options:\n"
+              << "  /home <dir>      Python prefix; a python*._pth file in it is applied\n"
+              << "  /pth <file>      ._pth file to take sys.path and site from\n"
+              << "  /path <dir>      sys.path entry (repeatable; replaces the default path)\n"
+              << "  /no-site         Do not import site\n"
+              << "  /isolated        Ignore PYTHON* variables and the user site directory\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    sandbox::EmbeddedPythonOptions options;
+    std::string pthPath;
+    std::vector<std::string> paths;
+    bool noSite = false;
+    int first = 1;
+    for (; first < argc; first++) {
+        const char* arg = argv[first];
+        bool hasValue = first + 1 < argc;
+        if (IsFlag(arg, "home") && hasValue) {
+            options.home = argv[++first];
+        } else if (IsFlag(arg, "pth") && hasValue) {
+            pthPath = argv[++first];
+        } else if (IsFlag(arg, "path") && hasValue) {
+            paths.push_back(argv[++first]);
+        } else if (IsFlag(arg, "no-site")) {
+            noSite = true;
+        } else if (IsFlag(arg, "isolated")) {
+            options.isolated = true;
+        } else {
+            break;
+        }
+    }
+    if (first >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::string error;
+    if (pthPath.empty() && !options.home.empty()) {
+        sandbox::FindPathFile(options.home, &pthPath);
+    }
+    if (!pthPath.empty() && !sandbox::ReadPathFile(pthPath, &options, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    if (!paths.empty()) {
+        options.searchPaths = paths;
+    }
+    if (noSite) {
+        options.importSite = false;
+    }
+    options.argv.assign(argv + first, argv + argc);
+
+    int status = sandbox::RunEmbeddedPython(options, &error);
+    if (status < 0) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    return status;
+}
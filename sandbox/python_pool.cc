@@ -0,0 +1,201 @@
+// Runs a Python script repeatedly through a warm WorkerPool and reports how
+// long each run took to reach the first line of user code.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "launcher.h"
+#include "worker_pool.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " <script.py> [script args...] [options]\n"
+              << "Options:\n"
+              << "  /python <exe>       Interpreter (default: python3)\n"
+              << "  /worker <path>      python_worker.py (default: next to this program)\n"
+              << "  /w <count>          Warm workers (default: 4)\n"
+              << "  /jobs <count>       Jobs per worker before it is recycled (default: 1)\n"
+              << "  /preload <a,b,...>  Modules imported once in the fork server\n"
+              << "  /n <runs>           Number of runs (default: 1)\n"
+              << "  /quiet              Discard the script's stdout\n"
+              << "  /sandbox            Start the workers through SandboxLauncher\n"
+              << "  /read <dir>         Readable directory for /sandbox (repeatable)\n"
+              << "  /write <dir>        Writable directory for /sandbox (repeatable)\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+std::string DefaultWorkerScript(const char* program) {
+    std::string path = program;
+    size_t slash = path.find_last_of("/\\");
+    return (slash == std::string::npos ? std::string() : path.substr(0, slash + 1)) +
+           "python_worker.py";
+}
+
+std::string DirectoryOf(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+double Percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    sandbox::WorkerPoolOptions options;
+    options.workerScript = DefaultWorkerScript(argv[0]);
+    sandbox::PythonJob job;
+    int runs = 1;
+    bool quiet = false;
+    bool sandboxed = false;
+    sandbox::SandboxPolicy policy;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (IsFlag(arg, "python") && hasValue) {
+            options.python = argv[++i];
+        } else if (IsFlag(arg, "worker") && hasValue) {
+            options.workerScript = argv[++i];
+        } else if (IsFlag(arg, "w") && hasValue) {
+            options.workers = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "jobs") && hasValue) {
+            options.jobsPerWorker = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (IsFlag(arg, "preload") && hasValue) {
+            std::string list = argv[++i];
+            size_t start = 0;
+            while (start < list.size()) {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos) {
+                    comma = list.size();
+                }
+                if (comma > start) {
+                    options.preloadModules.push_back(list.substr(start, comma - start));
+                }
+                start = comma + 1;
+            }
+        } else if (IsFlag(arg, "n") && hasValue) {
+            runs = atoi(argv[++i]);
+        } else if (IsFlag(arg, "quiet")) {
+            quiet = true;
+        } else if (IsFlag(arg, "sandbox")) {
+            sandboxed = true;
+        } else if (IsFlag(arg, "read") && hasValue) {
+            policy.readPaths.push_back(argv[++i]);
+        } else if (IsFlag(arg, "write") && hasValue) {
+            policy.writePaths.push_back(argv[++i]);
+        } else if (job.script.empty()) {
+            job.script = arg;
+        } else {
+            job.args.push_back(arg);
+        }
+    }
+    if (job.script.empty() || runs <= 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+#ifndef _WIN32
+    int devNull = -1;
+    if (quiet) {
+        devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        job.stdoutFd = devNull;
+    }
+#else
+    (void)quiet;
+#endif
+
+    std::string error;
+    std::unique_ptr<sandbox::SandboxLauncher> launcher;
+    if (sandboxed) {
+#ifndef _WIN32
+        if (policy.readPaths.empty()) {
+            for (const char* path : {"/usr", "/lib", "/lib64", "/bin", "/etc"}) {
+                if (access(path, F_OK) == 0) {
+                    policy.readPaths.push_back(path);
+                }
+            }
+        }
+#endif
+        // Fixed before the workers start: the zygote cannot be granted more.
+        policy.readPaths.push_back(DirectoryOf(options.workerScript));
+        policy.readPaths.push_back(DirectoryOf(job.script));
+        launcher = sandbox::SandboxLauncher::Create(policy, &error);
+        if (!launcher) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+#ifdef _WIN32
+        sandbox::SandboxLauncher* workerLauncher = launcher.get();
+        options.spawnWorker = [workerLauncher](const std::wstring& commandLine,
+                                               void* const handles[2]) -> void* {
+            sandbox::LaunchCommand command;
+            command.commandLine = commandLine;
+            command.inheritHandles.assign(handles, handles + 2);
+            sandbox::LaunchedProcess process;
+            std::string spawnError;
+            if (!workerLauncher->Spawn(command, &process, &spawnError)) {
+                std::cerr << spawnError << std::endl;
+                return nullptr;
+            }
+            return process.process;
+        };
+#else
+        options.launcher = launcher.get();
+#endif
+    }
+
+    sandbox::WorkerPool pool;
+    if (!pool.Start(options, &error)) {
+        std::cerr << "Failed to start worker pool: " << error << std::endl;
+        return 1;
+    }
+
+    std::vector<double> startTimes;
+    std::vector<double> totalTimes;
+    int lastExitCode = 0;
+    for (int run = 0; run < runs; run++) {
+        sandbox::PythonJobResult result;
+        if (!pool.Run(job, &result, &error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        lastExitCode = result.exitCode;
+        startTimes.push_back(result.startSeconds * 1000);
+        totalTimes.push_back(result.totalSeconds * 1000);
+    }
+    pool.Stop();
+#ifndef _WIN32
+    if (devNull >= 0) {
+        close(devNull);
+    }
+#endif
+
+    fprintf(stderr, "%d runs, %u workers, %u jobs/worker\n", runs, options.workers,
+            options.jobsPerWorker);
+    fprintf(stderr, "%-16s %8s %8s %8s\n", "ms", "p50", "p95", "p99");
+    fprintf(stderr, "%-16s %8.2f %8.2f %8.2f\n", "to user code", Percentile(startTimes, 0.5),
+            Percentile(startTimes, 0.95), Percentile(startTimes, 0.99));
+    fprintf(stderr, "%-16s %8.2f %8.2f %8.2f\n", "to exit", Percentile(totalTimes, 0.5),
+            Percentile(totalTimes, 0.95), Percentile(totalTimes, 0.99));
+    return lastExitCode;
+}
@@ -0,0 +1,220 @@
+"""Warm Python worker for sandbox::WorkerPool (worker_pool.h).
+
+On POSIX this runs as a fork server ("zygote"): it imports the preload
+modules once, then forks a ready worker every time the pool asks for one.
+Each worker serves jobs over its own SOCK_SEQPACKET socket and receives the
+job's stdin/stdout/stderr as passed file descriptors.
+
+On Windows there is no fork, so the pool starts every worker directly with
+--pipes; jobs then arrive as netstrings on an inherited pipe and run with the
+worker's own console.
+
+Messages are NUL-separated fields:
+    pool -> zygote:  spawn
+    zygote -> pool:  ready | worker <pid>            (+ worker socket)
+    pool -> worker:  run <script> <cwd> <arg>...     (+ stdin/stdout/stderr)
+    worker -> pool:  started | exit <code>
+"""
+import os
+import pkgutil  # noqa: F401 - runpy.run_path imports it lazily; keep it warm
+import runpy
+import signal
+import socket
+import sys
+import traceback
+
+
+class SeqpacketChannel:
+    def __init__(self, sock):
+        self.sock = sock
+
+    def send(self, fields, fds=()):
+        message = b"\0".join(fields)
+        if fds:
+            socket.send_fds(self.sock, [message], list(fds))
+        else:
+            self.sock.send(message)
+
+    def receive(self):
+        message, fds, _, _ = socket.recv_fds(self.sock, 1 << 16, 3)
+        if not message:
+            return None, []
+        return message.split(b"\0"), fds
+
+
+class PipeChannel:
+    """Netstring framing over a pair of inherited Windows pipe handles."""
+
+    def __init__(self, read_handle, write_handle):
+        import msvcrt
+        self.reader = os.fdopen(msvcrt.open_osfhandle(read_handle, os.O_RDONLY), "rb", 0)
+        self.writer = os.fdopen(msvcrt.open_osfhandle(write_handle, 0), "wb", 0)
+
+    def send(self, fields, fds=()):
+        message = b"\0".join(fields)
+        self.writer.write(b"%d:%s," % (len(message), message))
+
+    def receive(self):
+        length = b""
+        while True:
+            c = self.reader.read(1)
+            if not c:
+                return None, []
+            if c == b":":
+                break
+            length += c
+        message = self._read_exact(int(length))
+        if message is None or self._read_exact(1) != b",":
+            return None, []
+        return message.split(b"\0"), []
+
+    def _read_exact(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.reader.read(n - len(data))
+            if not chunk:
+                return None
+            data += chunk
+        return data
+
+
+def preload(modules):
+    for name in modules:
+        try:
+            __import__(name)
+        except Exception as e:
+            print(f"python_worker: failed to preload {name}: {e}", file=sys.stderr)
+
+
+def run_job(channel, fields, fds):
+    script = os.fsdecode(fields[1])
+    cwd = os.fsdecode(fields[2])
+    argv = [script] + [os.fsdecode(a) for a in fields[3:]]
+
+    sys.stdout.flush()
+    sys.stderr.flush()
+    for target, fd in enumerate(fds[:3]):
+        os.dup2(fd, target)
+        os.close(fd)
+
+    sys.argv = argv
+    sys.path[0] = os.path.dirname(os.path.abspath(script))
+    if cwd:
+        os.chdir(cwd)
+
+    channel.send([b"started"])
+    code = 0
+    try:
+        runpy.run_path(script, run_name="__main__")
+    except SystemExit as e:
+        if e.code is None:
+            code = 0
+        elif isinstance(e.code, int):
+            code = e.code
+        else:
+            print(e.code, file=sys.stderr)
+            code = 1
+    except BaseException:
+        traceback.print_exc()
+        code = 1
+    finally:
+        try:
+            sys.stdout.flush()
+            sys.stderr.flush()
+        except Exception:
+            pass
+    return code
+
+
+def serve_worker(channel, max_jobs):
+    # Baseline restored between jobs when a worker is reused.
+    saved_fds = [os.dup(fd) for fd in range(3)]
+    base_cwd = os.getcwd()
+    base_path = list(sys.path)
+    base_modules = set(sys.modules)
+
+    jobs = 0
+    while max_jobs == 0 or jobs < max_jobs:
+        fields, fds = channel.receive()
+        if fields is None:
+            return
+        if fields[0] != b"run" or len(fields) < 3:
+            for fd in fds:
+                os.close(fd)
+            continue
+        code = run_job(channel, fields, fds)
+        jobs += 1
+
+        for target, fd in enumerate(saved_fds):
+            os.dup2(fd, target)
+        os.chdir(base_cwd)
+        sys.path[:] = base_path
+        for name in set(sys.modules) - base_modules:
+            del sys.modules[name]
+        channel.send([b"exit", b"%d" % code])
+
+
+def serve_zygote(control, max_jobs):
+    # Workers are reaped automatically; the pool learns their exit codes
+    # from the protocol, not from waitpid.
+    signal.signal(signal.SIGCHLD, signal.SIG_IGN)
+    channel = SeqpacketChannel(control)
+    channel.send([b"ready"])
+    while True:
+        fields, fds = channel.receive()
+        if fields is None:
+            return
+        for fd in fds:
+            os.close(fd)
+        if fields[0] != b"spawn":
+            continue
+        parent, child = socket.socketpair(socket.AF_UNIX, socket.SOCK_SEQPACKET)
+        pid = os.fork()
+        if pid == 0:
+            control.close()
+            parent.close()
+            signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+            try:
+                serve_worker(SeqpacketChannel(child), max_jobs)
+            finally:
+                os._exit(0)
+        child.close()
+        channel.send([b"worker", b"%d" % pid], [parent.fileno()])
+        parent.close()
+
+
+def main():
+    args = sys.argv[1:]
+    max_jobs = 1
+    modules = []
+    mode = None
+    while args:
+        arg = args.pop(0)
+        if arg == "--zygote":
+            mode = ("zygote", int(args.pop(0)))
+        elif arg == "--pipes":
+            mode = ("pipes", int(args.pop(0)), int(args.pop(0)))
+        elif arg == "--jobs":
+            max_jobs = int(args.pop(0))
+        elif arg == "--preload":
+            modules = [m for m in args.pop(0).split(",") if m]
+        else:
+            print(f"python_worker: unknown argument {arg}", file=sys.stderr)
+            return 2
+    if mode is None:
+        print("usage: python_worker.py (--zygote FD | --pipes IN OUT) [--jobs N] [--preload a,b]",
+              file=sys.stderr)
+        return 2
+
+    preload(modules)
+    if mode[0] == "zygote":
+        serve_zygote(socket.socket(fileno=mode[1]), max_jobs)
+    else:
+        channel = PipeChannel(mode[1], mode[2])
+        channel.send([b"ready"])
+        serve_worker(channel, max_jobs)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,859 @@
+#include "resource_group.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+#endif
+
+namespace sandbox {
+
+namespace {
+
+// "512", "8G", "1.5M": a byte count with an optional power-of-1024 suffix.
+bool ParseSize(const std::string& text, uint64_t* size) {
+    char* end = nullptr;
+    double value = strtod(text.c_str(), &end);
+    if (end == text.c_str() || value < 0) {
+        return false;
+    }
+    static const char kSuffixes[] = "KMGT";
+    if (*end != '\0') {
+        const char* suffix = strchr(kSuffixes, toupper(static_cast<unsigned char>(*end)));
+        if (suffix == nullptr || end[1] != '\0') {
+            return false;
+        }
+        value = std::ldexp(value, 10 * static_cast<int>(suffix - kSuffixes + 1));
+    }
+    *size = static_cast<uint64_t>(value);
+    return true;
+}
+
+std::string FormatBytes(uint64_t bytes) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f MiB", bytes / (1024.0 * 1024.0));
+    return text;
+}
+
+// A limit that was asked for and not applied fails Create(), unless the
+// caller settled for whatever the system allows.
+bool CheckApplied(const ResourceLimits& limits, const std::vector<std::string>& unapplied,
+                  std::string* error) {
+    if (limits.bestEffort || unapplied.empty()) {
+        return true;
+    }
+    *error = "Cannot apply the requested limits; add besteffort to run without them:";
+    for (const std::string& reason : unapplied) {
+        *error += "\n  " + reason;
+    }
+    return false;
+}
+
+#ifdef _WIN32
+std::string Win32Error(const char* what) {
+    return std::string(what) + " failed with error " + std::to_string(GetLastError());
+}
+
+// "0-3,8" -> bit mask of processor group 0.
+bool ParseCpuMask(const std::string& list, KAFFINITY* mask) {
+    *mask = 0;
+    const char* cursor = list.c_str();
+    while (*cursor != '\0') {
+        char* end = nullptr;
+        unsigned long first = strtoul(cursor, &end, 10);
+        unsigned long last = first;
+        if (end == cursor) {
+            return false;
+        }
+        if (*end == '-') {
+            cursor = end + 1;
+            last = strtoul(cursor, &end, 10);
+            if (end == cursor || last < first) {
+                return false;
+            }
+        }
+        if (last >= sizeof(KAFFINITY) * 8) {
+            return false;
+        }
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            *mask |= static_cast<KAFFINITY>(1) << cpu;
+        }
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return false;
+        }
+        cursor = end;
+    }
+    return *mask != 0;
+}
+#elif defined(__linux__)
+bool ReadControl(const std::string& path, std::string* contents) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    contents->clear();
+    char buffer[4096];
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        contents->append(buffer, static_cast<size_t>(length));
+    }
+    close(fd);
+    return length == 0;
+}
+
+// Sets *missing instead of failing when the file does not exist, which is
+// how cgroup v2 shows a controller that is not enabled for the group.
+bool WriteControl(const std::string& path, const std::string& value, bool* missing,
+                  std::string* error) {
+    *missing = false;
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+        *missing = true;
+        return true;
+    }
+    if (fd < 0 || write(fd, value.data(), value.size()) != static_cast<ssize_t>(value.size())) {
+        *error = "Cannot write \"" + value + "\" to " + path + ": " + strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+// The value after `key ` (or `key=` inside a line) in a flat-keyed or
+// nested-keyed cgroup file.
+uint64_t ControlValue(const std::string& contents, const std::string& key) {
+    size_t position = 0;
+    while ((position = contents.find(key, position)) != std::string::npos) {
+        bool starts = position == 0 || contents[position - 1] == '\n' ||
+                      contents[position - 1] == ' ';
+        size_t end = position + key.size();
+        if (starts && end < contents.size() && (contents[end] == ' ' || contents[end] == '=')) {
+            return strtoull(contents.c_str() + end + 1, nullptr, 10);
+        }
+        position = end;
+    }
+    return 0;
+}
+
+// One "some ..." or "full ..." line of a PSI file.
+void ParsePressureLine(const std::string& contents, const char* kind, double* avg10,
+                       double* seconds) {
+    size_t line = contents.find(kind);
+    if (line == std::string::npos) {
+        return;
+    }
+    size_t end = contents.find('\n', line);
+    std::string text = contents.substr(line, end == std::string::npos ? end : end - line);
+    size_t avg = text.find("avg10=");
+    size_t total = text.find("total=");
+    if (avg != std::string::npos) {
+        *avg10 = strtod(text.c_str() + avg + 6, nullptr);
+    }
+    if (total != std::string::npos) {
+        *seconds = strtoull(text.c_str() + total + 6, nullptr, 10) / 1e6;
+    }
+}
+
+bool ReadPressure(const std::string& path, PressureStall* stall) {
+    std::string contents;
+    if (!ReadControl(path, &contents)) {
+        return false;
+    }
+    ParsePressureLine(contents, "some ", &stall->someAvg10, &stall->someSeconds);
+    ParsePressureLine(contents, "full ", &stall->fullAvg10, &stall->fullSeconds);
+    return true;
+}
+
+// Mount point of the cgroup v2 hierarchy: /sys/fs/cgroup on unified
+// systems, /sys/fs/cgroup/unified on hybrid ones.
+std::string CgroupMount() {
+    FILE* mounts = fopen("/proc/self/mounts", "re");
+    if (mounts == nullptr) {
+        return std::string();
+    }
+    std::string mount;
+    char device[256], point[4096], type[64];
+    while (fscanf(mounts, "%255s %4095s %63s %*[^\n]", device, point, type) == 3) {
+        if (strcmp(type, "cgroup2") == 0) {
+            mount = point;
+            break;
+        }
+    }
+    fclose(mounts);
+    return mount;
+}
+
+// This process's cgroup relative to the mount ("0::/user.slice/...").
+std::string OwnCgroup() {
+    std::string contents;
+    if (!ReadControl("/proc/self/cgroup", &contents)) {
+        return std::string();
+    }
+    size_t line = contents.rfind("0::", 0) == 0 ? 0 : contents.find("\n0::");
+    if (line == std::string::npos) {
+        return std::string();
+    }
+    line += contents[line] == '\n' ? 4 : 3;
+    std::string path = contents.substr(line, contents.find('\n', line) - line);
+    return path == "/" ? std::string() : path;
+}
+
+// A cgroup other than the root cannot pass controllers down while it has
+// processes of its own (cgroup.subtree_control fails with EBUSY), and a
+// group created in our own cgroup has us in it. The first Create() that
+// needs a controller there moves this process into a leaf of its own,
+// launcher-<pid>, provided nothing else is in that cgroup; later groups
+// still go next to it. Once the last of them is gone, the controllers
+// enabled for them are turned off, the process moves back and the leaf is
+// removed.
+struct HostCgroup {
+    std::string path;  // where the process came from
+    std::string leaf;
+    std::vector<std::string> enabled;
+    unsigned groups = 0;
+};
+
+std::mutex hostMutex;
+HostCgroup host;
+
+bool OnlyProcessIn(const std::string& cgroup) {
+    std::string procs;
+    if (!ReadControl(cgroup + "/cgroup.procs", &procs)) {
+        return false;
+    }
+    std::string self = std::to_string(getpid());
+    size_t start = 0;
+    while (start < procs.size()) {
+        size_t end = procs.find('\n', start);
+        if (end == std::string::npos) {
+            end = procs.size();
+        }
+        if (end > start && procs.compare(start, end - start, self) != 0) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+bool MoveToLeaf(const std::string& cgroup, std::string* error) {
+    if (!OnlyProcessIn(cgroup)) {
+        *error = "other processes share " + cgroup + "; give a delegated parent";
+        return false;
+    }
+    std::string leaf = cgroup + "/launcher-" + std::to_string(getpid());
+    if (mkdir(leaf.c_str(), 0755) != 0 && errno != EEXIST) {
+        *error = "Cannot create " + leaf + ": " + strerror(errno);
+        return false;
+    }
+    // "0" is the writing process, with all its threads.
+    bool missing;
+    if (!WriteControl(leaf + "/cgroup.procs", "0", &missing, error)) {
+        rmdir(leaf.c_str());
+        return false;
+    }
+    host.path = cgroup;
+    host.leaf = leaf;
+    return true;
+}
+
+// Undoes MoveToLeaf() when the last group in the host cgroup is removed.
+// Should moving back fail, groups keep going to host.path.
+void ReleaseHost() {
+    if (--host.groups > 0 || host.leaf.empty()) {
+        return;
+    }
+    bool missing;
+    std::string ignored;
+    for (auto it = host.enabled.rbegin(); it != host.enabled.rend(); ++it) {
+        WriteControl(host.path + "/cgroup.subtree_control", "-" + *it, &missing, &ignored);
+    }
+    host.enabled.clear();
+    if (WriteControl(host.path + "/cgroup.procs", "0", &missing, &ignored)) {
+        rmdir(host.leaf.c_str());
+        host = HostCgroup();
+    }
+}
+
+// io.max takes the "major:minor" of a whole disk; a path names the device
+// it lives on, and a partition is replaced by its disk.
+bool ResolveIoDevice(const std::string& device, std::string* number, std::string* error) {
+    unsigned first = 0, second = 0;
+    char rest;
+    if (sscanf(device.c_str(), "%u:%u%c", &first, &second, &rest) == 2) {
+        *number = device;
+        return true;
+    }
+    struct stat info;
+    if (stat(device.c_str(), &info) != 0) {
+        *error = "Cannot stat " + device + ": " + strerror(errno);
+        return false;
+    }
+    dev_t id = S_ISBLK(info.st_mode) ? info.st_rdev : info.st_dev;
+    if (major(id) == 0) {
+        *error = device + " is not on a block device";
+        return false;
+    }
+    *number = std::to_string(major(id)) + ":" + std::to_string(minor(id));
+    std::string sysfs = "/sys/dev/block/" + *number;
+    std::string disk;
+    if (access((sysfs + "/partition").c_str(), F_OK) == 0 &&
+        ReadControl(sysfs + "/../dev", &disk)) {
+        *number = disk.substr(0, disk.find('\n'));
+    }
+    return true;
+}
+#endif
+
+}  // namespace
+
+bool ParseResourceLimits(const std::string& text, ResourceLimits* limits, std::string* error) {
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        std::string item = text.substr(start, end == std::string::npos ? end : end - start);
+        start = end == std::string::npos ? text.size() : end + 1;
+        if (item.empty()) {
+            continue;
+        }
+        size_t equals = item.find('=');
+        std::string key = item.substr(0, equals);
+        std::string value = equals == std::string::npos ? std::string() : item.substr(equals + 1);
+        uint64_t number = 0;
+        bool ok = !value.empty();
+        if (key == "besteffort") {
+            limits->bestEffort = true;
+            ok = value.empty();
+        } else if (key == "memory") {
+            ok = ok && ParseSize(value, &limits->memoryMax);
+        } else if (key == "cpu") {
+            limits->cpuMax = atof(value.c_str());
+            ok = ok && limits->cpuMax > 0;
+        } else if (key == "weight") {
+            limits->cpuWeight = static_cast<unsigned>(atoi(value.c_str()));
+            ok = ok && limits->cpuWeight >= 1 && limits->cpuWeight <= 10000;
+        } else if (key == "pids") {
+            limits->pidsMax = strtoull(value.c_str(), nullptr, 10);
+            ok = ok && limits->pidsMax > 0;
+        } else if (key == "cpuset") {
+            limits->cpus = value;
+        } else if (key == "numa") {
+            limits->mems = value;
+        } else if (key == "device") {
+            limits->io.push_back(IoLimit());
+            limits->io.back().device = value;
+        } else if (key == "rbps" || key == "wbps" || key == "riops" || key == "wiops") {
+            if (limits->io.empty()) {
+                *error = key + "= needs a device= before it";
+                return false;
+            }
+            IoLimit& io = limits->io.back();
+            ok = ok && ParseSize(value, &number);
+            (key == "rbps"    ? io.readBps
+             : key == "wbps"  ? io.writeBps
+             : key == "riops" ? io.readIops
+                              : io.writeIops) = number;
+        } else {
+            *error = "Unknown limit " + key;
+            return false;
+        }
+        if (!ok) {
+            *error = "Invalid value for " + key + ": " + value;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string FormatResourceUsage(const ResourceUsage& usage) {
+    char text[512];
+    snprintf(text, sizeof(text), "cpu %.3f s (user %.3f, system %.3f, throttled %.3f)",
+             usage.cpuSeconds, usage.userSeconds, usage.systemSeconds, usage.throttledSeconds);
+    std::string line = text;
+    if (usage.memoryPeak > 0) {
+        line += ", memory peak " + FormatBytes(usage.memoryPeak);
+    }
+    if (usage.memoryLimitHits > 0 || usage.oomKills > 0) {
+        line += ", memory limit hit " + std::to_string(usage.memoryLimitHits) +
+                " times, oom kills " + std::to_string(usage.oomKills);
+    }
+    line += ", read " + FormatBytes(usage.readBytes) + ", written " +
+            FormatBytes(usage.writeBytes);
+    if (usage.pidsPeak > 0) {
+        line += ", processes peak " + std::to_string(usage.pidsPeak);
+    }
+    if (usage.hasPressure) {
+        snprintf(text, sizeof(text),
+                 ", stalled on cpu %.3f s, memory %.3f s (full %.3f), io %.3f s (full %.3f)",
+                 usage.cpuPressure.someSeconds, usage.memoryPressure.someSeconds,
+                 usage.memoryPressure.fullSeconds, usage.ioPressure.someSeconds,
+                 usage.ioPressure.fullSeconds);
+        line += text;
+    }
+    return line;
+}
+
+struct ResourceGroup::State {
+    std::vector<std::string> unapplied;
+    std::string path;
+#ifdef _WIN32
+    HANDLE job = NULL;
+#else
+    int procsFd = -1;
+    // path relative to the cgroup v2 mount, as /proc/<pid>/cgroup shows it.
+    std::string cgroup;
+    // Counted in the host cgroup's groups; see MoveToLeaf().
+    bool hosted = false;
+#endif
+};
+
+ResourceGroup::ResourceGroup() : state_(new State) {}
+
+const std::vector<std::string>& ResourceGroup::Unapplied() const { return state_->unapplied; }
+
+const std::string& ResourceGroup::Path() const { return state_->path; }
+
+#ifdef _WIN32
+ResourceGroup::~ResourceGroup() {
+    // JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE ends whatever is still running.
+    if (state_->job != NULL) {
+        CloseHandle(state_->job);
+    }
+}
+
+std::unique_ptr<ResourceGroup> ResourceGroup::Create(const std::string&,
+                                                     const ResourceLimits& limits,
+                                                     const std::string&, std::string* error) {
+    std::unique_ptr<ResourceGroup> group(new ResourceGroup());
+    State& state = *group->state_;
+    state.job = CreateJobObjectW(NULL, NULL);
+    if (state.job == NULL) {
+        *error = Win32Error("CreateJobObject");
+        return nullptr;
+    }
+
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION info = {};
+    DWORD& flags = info.BasicLimitInformation.LimitFlags;
+    flags = JOB_OBJECT_LIMIT_KILL_ON_JOB_CLOSE;
+    if (limits.memoryMax > 0) {
+        flags |= JOB_OBJECT_LIMIT_JOB_MEMORY;
+        info.JobMemoryLimit = static_cast<SIZE_T>(limits.memoryMax);
+    }
+    if (limits.pidsMax > 0) {
+        flags |= JOB_OBJECT_LIMIT_ACTIVE_PROCESS;
+        info.BasicLimitInformation.ActiveProcessLimit = static_cast<DWORD>(limits.pidsMax);
+    }
+    // A job cannot bind memory to a node; keeping its threads on the
+    // node's processors keeps their allocations local by default.
+    KAFFINITY affinity = 0;
+    if (!limits.cpus.empty() && !ParseCpuMask(limits.cpus, &affinity)) {
+        *error = "Invalid or out of processor group 0: cpuset=" + limits.cpus;
+        return nullptr;
+    }
+    if (!limits.mems.empty()) {
+        KAFFINITY nodes = 0;
+        KAFFINITY list = 0;
+        if (!ParseCpuMask(limits.mems, &list)) {
+            *error = "Invalid numa=" + limits.mems;
+            return nullptr;
+        }
+        for (USHORT node = 0; node < sizeof(KAFFINITY) * 8; node++) {
+            GROUP_AFFINITY processors = {};
+            if ((list >> node & 1) != 0 && GetNumaNodeProcessorMaskEx(node, &processors) &&
+                processors.Group == 0) {
+                nodes |= processors.Mask;
+            }
+        }
+        affinity = affinity != 0 ? affinity & nodes : nodes;
+        if (affinity == 0) {
+            *error = "No processors of group 0 in numa=" + limits.mems;
+            return nullptr;
+        }
+    }
+    if (affinity != 0) {
+        flags |= JOB_OBJECT_LIMIT_AFFINITY;
+        info.BasicLimitInformation.Affinity = static_cast<ULONG_PTR>(affinity);
+    }
+    if (!SetInformationJobObject(state.job, JobObjectExtendedLimitInformation, &info,
+                                 sizeof(info))) {
+        *error = Win32Error("SetInformationJobObject");
+        return nullptr;
+    }
+
+    // A job has either a hard CPU cap or a weight. cgroup's default weight
+    // of 100 maps to the job default of 5.
+    JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate = {};
+    if (limits.cpuMax > 0) {
+        DWORD processors = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+        double share = limits.cpuMax / (processors > 0 ? processors : 1);
+        rate.ControlFlags = JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP;
+        rate.CpuRate = static_cast<DWORD>(std::min(10000.0, std::max(1.0, share * 10000)));
+        if (limits.cpuWeight > 0) {
+            state.unapplied.push_back("weight: a Job Object with a CPU cap has no weight");
+        }
+    } else if (limits.cpuWeight > 0) {
+        rate.ControlFlags =
+            JOB_OBJECT_CPU_RATE_CONTROL_ENABLE | JOB_OBJECT_CPU_RATE_CONTROL_WEIGHT_BASED;
+        rate.Weight = limits.cpuWeight <= 100 ? 1 + (limits.cpuWeight - 1) * 4 / 99
+                                              : 5 + (limits.cpuWeight - 100) * 4 / 9900;
+    }
+    if (rate.ControlFlags != 0 &&
+        !SetInformationJobObject(state.job, JobObjectCpuRateControlInformation, &rate,
+                                 sizeof(rate))) {
+        *error = Win32Error("SetInformationJobObject");
+        return nullptr;
+    }
+    for (const IoLimit& io : limits.io) {
+        state.unapplied.push_back("device=" + io.device +
+                                  ": Job Objects have no I/O limit by device");
+    }
+    if (!CheckApplied(limits, state.unapplied, error)) {
+        return nullptr;
+    }
+    return group;
+}
+
+void ResourceGroup::Attach(LaunchCommand* command) const { command->job = state_->job; }
+
+bool ResourceGroup::Add(const LaunchedProcess& process, std::string* error) {
+    if (!AssignProcessToJobObject(state_->job, process.process)) {
+        *error = Win32Error("AssignProcessToJobObject");
+        return false;
+    }
+    return true;
+}
+
+bool ResourceGroup::ReadUsage(ResourceUsage* usage, std::string* error) const {
+    JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION accounting = {};
+    JOBOBJECT_EXTENDED_LIMIT_INFORMATION limits = {};
+    if (!QueryInformationJobObject(state_->job, JobObjectBasicAndIoAccountingInformation,
+                                   &accounting, sizeof(accounting), NULL) ||
+        !QueryInformationJobObject(state_->job, JobObjectExtendedLimitInformation, &limits,
+                                   sizeof(limits), NULL)) {
+        *error = Win32Error("QueryInformationJobObject");
+        return false;
+    }
+    *usage = ResourceUsage();
+    // 100 ns units.
+    usage->userSeconds = accounting.BasicInfo.TotalUserTime.QuadPart / 1e7;
+    usage->systemSeconds = accounting.BasicInfo.TotalKernelTime.QuadPart / 1e7;
+    usage->cpuSeconds = usage->userSeconds + usage->systemSeconds;
+    usage->memoryPeak = limits.PeakJobMemoryUsed;
+    usage->readBytes = accounting.IoInfo.ReadTransferCount;
+    usage->writeBytes = accounting.IoInfo.WriteTransferCount;
+    return true;
+}
+
+void ResourceGroup::Kill() { TerminateJobObject(state_->job, 1); }
+#elif defined(__linux__)
+ResourceGroup::~ResourceGroup() {
+    if (state_->procsFd >= 0) {
+        close(state_->procsFd);
+    }
+    if (state_->path.empty()) {
+        return;
+    }
+    std::string events;
+    if (ReadControl(state_->path + "/cgroup.events", &events) &&
+        ControlValue(events, "populated") != 0) {
+        Kill();
+    }
+    // The directory can only go once the last process has exited.
+    for (int attempt = 0; attempt < 1000; attempt++) {
+        if (rmdir(state_->path.c_str()) == 0 || errno != EBUSY) {
+            break;
+        }
+        usleep(1000);
+    }
+    if (state_->hosted) {
+        std::lock_guard<std::mutex> lock(hostMutex);
+        ReleaseHost();
+    }
+}
+
+std::unique_ptr<ResourceGroup> ResourceGroup::Create(const std::string& name,
+                                                     const ResourceLimits& limits,
+                                                     const std::string& parent,
+                                                     std::string* error) {
+    std::string mount = CgroupMount();
+    std::string own = OwnCgroup();
+    std::unique_lock<std::mutex> lock(hostMutex);
+    std::string base = parent;
+    if (base.empty()) {
+        if (mount.empty()) {
+            *error = "No cgroup v2 hierarchy is mounted";
+            return nullptr;
+        }
+        base = host.path.empty() ? mount + own : host.path;
+    }
+    while (base.size() > 1 && base.back() == '/') {
+        base.pop_back();
+    }
+    static std::atomic<unsigned> created{0};
+    std::string path = base + "/" + name + "-" + std::to_string(getpid()) + "-" +
+                       std::to_string(created++);
+    if (mkdir(path.c_str(), 0755) != 0) {
+        *error = "Cannot create " + path + ": " + strerror(errno);
+        return nullptr;
+    }
+    std::unique_ptr<ResourceGroup> group(new ResourceGroup());
+    State& state = *group->state_;
+    state.path = path;
+    if (!mount.empty() && path.compare(0, mount.size() + 1, mount + "/") == 0) {
+        state.cgroup = path.substr(mount.size());
+    }
+
+    // Controllers appear in the group once the parent passes them down.
+    // That needs the parent to have no processes of its own, so we leave
+    // our own cgroup first (MoveToLeaf()); it still fails while other
+    // processes are in it, which a delegated parent avoids, and for
+    // controllers bound to a v1 hierarchy. The limit files are then
+    // missing and reported below. memory, io and pids are asked for even
+    // without limits, for their accounting.
+    auto controlList = [](const std::string& file) {
+        std::string contents;
+        ReadControl(file, &contents);
+        contents = " " + contents + " ";
+        std::replace(contents.begin(), contents.end(), '\n', ' ');
+        return contents;
+    };
+    std::string available = controlList(base + "/cgroup.controllers");
+    std::string enabled = controlList(base + "/cgroup.subtree_control");
+    std::vector<std::string> controllers = {"memory", "cpu", "io", "pids"};
+    if (!limits.cpus.empty() || !limits.mems.empty()) {
+        controllers.push_back("cpuset");
+    }
+    std::map<std::string, std::string> notEnabled;
+    for (const std::string& controller : controllers) {
+        if (available.find(" " + controller + " ") == std::string::npos) {
+            notEnabled[controller] = "the parent does not have it";
+            continue;
+        }
+        if (enabled.find(" " + controller + " ") != std::string::npos) {
+            continue;
+        }
+        std::string reason;
+        if (host.path.empty() && base == mount + own && !own.empty() &&
+            !MoveToLeaf(base, &reason)) {
+            notEnabled[controller] = reason;
+            continue;
+        }
+        bool missing;
+        if (!WriteControl(base + "/cgroup.subtree_control", "+" + controller, &missing,
+                          &reason)) {
+            notEnabled[controller] = reason;
+        } else if (base == host.path) {
+            host.enabled.push_back(controller);
+        }
+    }
+    state.hosted = !host.path.empty() && base == host.path;
+    if (state.hosted) {
+        host.groups++;
+    }
+    // The group's destructor takes the lock when it fails below.
+    lock.unlock();
+
+    auto apply = [&](const char* file, const std::string& value) {
+        bool missing;
+        if (!WriteControl(path + "/" + file, value, &missing, error)) {
+            return false;
+        }
+        if (missing) {
+            std::string controller(file, strchr(file, '.') - file);
+            std::string reason = std::string(file) + ": the " + controller +
+                                 " controller is not enabled below " + base;
+            auto found = notEnabled.find(controller);
+            if (found != notEnabled.end()) {
+                reason += " (" + found->second + ")";
+            }
+            state.unapplied.push_back(reason);
+        }
+        return true;
+    };
+    if (limits.memoryMax > 0) {
+        if (!apply("memory.max", std::to_string(limits.memoryMax))) {
+            return nullptr;
+        }
+        // An OOM kill takes the whole container rather than leaving it
+        // half running.
+        bool missing;
+        std::string ignored;
+        WriteControl(path + "/memory.oom.group", "1", &missing, &ignored);
+    }
+    if (limits.cpuMax > 0) {
+        const long long kPeriod = 100000;
+        long long quota = std::max(1000LL, std::llround(limits.cpuMax * kPeriod));
+        if (!apply("cpu.max", std::to_string(quota) + " " + std::to_string(kPeriod))) {
+            return nullptr;
+        }
+    }
+    if (limits.cpuWeight > 0 && !apply("cpu.weight", std::to_string(limits.cpuWeight))) {
+        return nullptr;
+    }
+    if (limits.pidsMax > 0 && !apply("pids.max", std::to_string(limits.pidsMax))) {
+        return nullptr;
+    }
+    for (const IoLimit& io : limits.io) {
+        std::string device;
+        std::string reason;
+        if (!ResolveIoDevice(io.device, &device, &reason)) {
+            state.unapplied.push_back("device=" + io.device + ": " + reason);
+            continue;
+        }
+        std::string value = device;
+        const std::pair<const char*, uint64_t> keys[] = {{"rbps", io.readBps},
+                                                         {"wbps", io.writeBps},
+                                                         {"riops", io.readIops},
+                                                         {"wiops", io.writeIops}};
+        for (const auto& key : keys) {
+            if (key.second > 0) {
+                value += std::string(" ") + key.first + "=" + std::to_string(key.second);
+            }
+        }
+        if (value != device && !apply("io.max", value)) {
+            return nullptr;
+        }
+    }
+    if (!limits.cpus.empty() && !apply("cpuset.cpus", limits.cpus)) {
+        return nullptr;
+    }
+    if (!limits.mems.empty() && !apply("cpuset.mems", limits.mems)) {
+        return nullptr;
+    }
+    if (!CheckApplied(limits, state.unapplied, error)) {
+        return nullptr;
+    }
+
+    state.procsFd = open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if (state.procsFd < 0) {
+        *error = "Cannot open " + path + "/cgroup.procs: " + strerror(errno);
+        return nullptr;
+    }
+    return group;
+}
+
+void ResourceGroup::Attach(LaunchCommand* command) const {
+    command->cgroupProcsFd = state_->procsFd;
+    command->cgroup = state_->cgroup;
+}
+
+bool ResourceGroup::Add(const LaunchedProcess& process, std::string* error) {
+    std::string pid = std::to_string(process.pid);
+    if (write(state_->procsFd, pid.data(), pid.size()) != static_cast<ssize_t>(pid.size())) {
+        *error = "Cannot move " + pid + " to " + state_->path + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool ResourceGroup::ReadUsage(ResourceUsage* usage, std::string* error) const {
+    const std::string& path = state_->path;
+    std::string contents;
+    if (!ReadControl(path + "/cpu.stat", &contents)) {
+        *error = "Cannot read " + path + "/cpu.stat: " + strerror(errno);
+        return false;
+    }
+    *usage = ResourceUsage();
+    usage->cpuSeconds = ControlValue(contents, "usage_usec") / 1e6;
+    usage->userSeconds = ControlValue(contents, "user_usec") / 1e6;
+    usage->systemSeconds = ControlValue(contents, "system_usec") / 1e6;
+    usage->throttledSeconds = ControlValue(contents, "throttled_usec") / 1e6;
+    if (ReadControl(path + "/memory.peak", &contents)) {
+        usage->memoryPeak = strtoull(contents.c_str(), nullptr, 10);
+    }
+    if (ReadControl(path + "/memory.events", &contents)) {
+        usage->memoryLimitHits = ControlValue(contents, "max");
+        usage->oomKills = ControlValue(contents, "oom_kill");
+    }
+    if (ReadControl(path + "/io.stat", &contents)) {
+        for (size_t line = 0; line < contents.size();) {
+            size_t end = contents.find('\n', line);
+            std::string text = " " + contents.substr(line, end - line);
+            usage->readBytes += ControlValue(text, "rbytes");
+            usage->writeBytes += ControlValue(text, "wbytes");
+            line = end == std::string::npos ? contents.size() : end + 1;
+        }
+    }
+    if (ReadControl(path + "/pids.peak", &contents)) {
+        usage->pidsPeak = strtoull(contents.c_str(), nullptr, 10);
+    }
+    usage->hasPressure = ReadPressure(path + "/cpu.pressure", &usage->cpuPressure);
+    ReadPressure(path + "/memory.pressure", &usage->memoryPressure);
+    ReadPressure(path + "/io.pressure", &usage->ioPressure);
+    return true;
+}
+
+void ResourceGroup::Kill() {
+    bool missing;
+    std::string error;
+    if (WriteControl(state_->path + "/cgroup.kill", "1", &missing, &error) && !missing) {
+        return;
+    }
+    // Before Linux 5.14: signal what is listed until nothing is, since a
+    // process may fork while the list is read.
+    std::string pids;
+    for (int round = 0; round < 100; round++) {
+        if (!ReadControl(state_->path + "/cgroup.procs", &pids) || pids.empty()) {
+            return;
+        }
+        for (const char* cursor = pids.c_str(); *cursor != '\0';) {
+            char* end;
+            long pid = strtol(cursor, &end, 10);
+            if (end == cursor) {
+                break;
+            }
+            kill(static_cast<pid_t>(pid), SIGKILL);
+            cursor = end;
+        }
+        usleep(1000);
+    }
+}
+#else
+ResourceGroup::~ResourceGroup() {}
+
+std::unique_ptr<ResourceGroup> ResourceGroup::Create(const std::string&, const ResourceLimits&,
+                                                     const std::string&, std::string* error) {
+    *error = "Resource groups need cgroup v2 or Job Objects";
+    return nullptr;
+}
+
+void ResourceGroup::Attach(LaunchCommand*) const {}
+
+bool ResourceGroup::Add(const LaunchedProcess&, std::string* error) {
+    *error = "Resource groups need cgroup v2 or Job Objects";
+    return false;
+}
+
+bool ResourceGroup::ReadUsage(ResourceUsage*, std::string* error) const {
+    *error = "Resource groups need cgroup v2 or Job Objects";
+    return false;
+}
+
+void ResourceGroup::Kill() {}
+#endif
+
+}  // namespace sandbox
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "launcher.h"
+
+// Gives a container its own share of the machine, so one heavy workflow
+// cannot starve everything else, and reports what it used when it ends.
+//
+// On Linux a group is a cgroup v2 directory created below the caller's own
+// cgroup (or a given parent) with memory.max, cpu.max, cpu.weight, io.max,
+// pids.max and cpuset.cpus/mems written once. Attach() hands the child the
+// group's cgroup.procs, which it writes before it joins the sandbox, so the
+// process and everything it starts are charged to the group from its first
+// instruction. A parent cgroup can only enable controllers for its children
+// while it has no processes of its own (the cgroup v2 "no internal
+// processes" rule), so when the group goes in the caller's own cgroup the
+// caller, if it is alone there, first moves itself into a leaf next to
+// it, and back once its last group is gone. Controllers still cannot be
+// enabled when other processes share that cgroup (give a delegated
+// parent instead) or a hybrid hierarchy keeps them on v1.
+// Create() then fails, unless the limits are besteffort: those it could
+// not apply are listed in Unapplied() and the group still accounts CPU
+// time and pressure stalls.
+//
+// On Windows a group is a Job Object: memory and process-count limits, a
+// CPU rate cap or weight, and an affinity mask from the CPU list or NUMA
+// nodes. Attach() has the child created inside the job
+// (PROC_THREAD_ATTRIBUTE_JOB_LIST). Job Objects have no pressure stall
+// information and no I/O limit by device.
+namespace sandbox {
+
+struct IoLimit {
+    // "major:minor" or any path on the device (Linux); a partition is
+    // resolved to its disk, which is what io.max takes.
+    std::string device;
+    // 0 = unlimited.
+    uint64_t readBps = 0;
+    uint64_t writeBps = 0;
+    uint64_t readIops = 0;
+    uint64_t writeIops = 0;
+};
+
+struct ResourceLimits {
+    // 0 or empty leaves the corresponding limit unset.
+    uint64_t memoryMax = 0;  // bytes
+    double cpuMax = 0;       // CPUs worth of time, e.g. 1.5
+    unsigned cpuWeight = 0;  // 1..10000, the default share is 100
+    uint64_t pidsMax = 0;
+    std::vector<IoLimit> io;
+    std::string cpus;  // CPU list such as "0-3,8"
+    std::string mems;  // NUMA node list; the group's CPUs and memory stay there
+    // Create() succeeds even when some of these cannot be applied.
+    bool bestEffort = false;
+};
+
+// Parses a comma-separated limit list, e.g.
+//   memory=8G,cpu=2.5,weight=50,pids=512,cpuset=0-7,numa=0,
+//   device=/var/lib/comfy,rbps=200M,wbps=100M
+// Sizes take K, M, G or T (powers of 1024). device= starts an I/O limit
+// that the rbps=, wbps=, riops= and wiops= after it apply to. besteffort
+// sets bestEffort.
+bool ParseResourceLimits(const std::string& text, ResourceLimits* limits, std::string* error);
+
+struct PressureStall {
+    // Share of the last 10 s some / all non-idle tasks of the group were
+    // stalled on the resource, in percent, and the total stall time.
+    double someAvg10 = 0;
+    double fullAvg10 = 0;
+    double someSeconds = 0;
+    double fullSeconds = 0;
+};
+
+struct ResourceUsage {
+    double cpuSeconds = 0;  // user + system
+    double userSeconds = 0;
+    double systemSeconds = 0;
+    double throttledSeconds = 0;  // held back by cpuMax
+    // 0 when the system does not report it (memory.peak needs Linux 5.19
+    // and the memory controller).
+    uint64_t memoryPeak = 0;
+    uint64_t memoryLimitHits = 0;  // times memoryMax was reached
+    uint64_t oomKills = 0;
+    uint64_t readBytes = 0;
+    uint64_t writeBytes = 0;
+    uint64_t pidsPeak = 0;  // most processes at once, where reported
+    bool hasPressure = false;
+    PressureStall cpuPressure;
+    PressureStall memoryPressure;
+    PressureStall ioPressure;
+};
+
+// One line with the fields the system reported, for logs and tool output.
+std::string FormatResourceUsage(const ResourceUsage& usage);
+
+class ResourceGroup {
+public:
+    // Kills what is left in the group and removes it.
+    ~ResourceGroup();
+
+    ResourceGroup(const ResourceGroup&) = delete;
+    ResourceGroup& operator=(const ResourceGroup&) = delete;
+
+    // name is made unique per process. parent (Linux) is the cgroup
+    // directory to create the group in, for a delegated subtree; empty is
+    // the caller's own cgroup, which may move the caller into a leaf below it.
+    // Fails when a limit cannot be applied, unless limits.bestEffort.
+    static std::unique_ptr<ResourceGroup> Create(const std::string& name,
+                                                 const ResourceLimits& limits,
+                                                 const std::string& parent, std::string* error);
+
+    // Limits that could not be applied, with the reason (bestEffort only).
+    const std::vector<std::string>& Unapplied() const;
+
+    // The cgroup directory, or empty on Windows.
+    const std::string& Path() const;
+
+    // Makes processes launched with this command start inside the group.
+    // Several commands may be attached; the group must outlive the launches.
+    void Attach(LaunchCommand* command) const;
+
+    // Moves an already running process (and not its existing children) in.
+    bool Add(const LaunchedProcess& process, std::string* error);
+
+    // Totals since Create(); still valid after every process has exited.
+    bool ReadUsage(ResourceUsage* usage, std::string* error) const;
+
+    // Kills every process in the group.
+    void Kill();
+
+private:
+    struct State;
+
+    ResourceGroup();
+
+    std::unique_ptr<State> state_;
+};
+
+}  // namespace sandbox
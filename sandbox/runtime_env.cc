@@ -0,0 +1,339 @@
+#include "runtime_env.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <appmodel.h>
+#include <sddl.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/landlock.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace sandbox {
+
+namespace {
+
+#ifdef _WIN32
+std::string Narrow(const wchar_t* text) {
+    int length = WideCharToMultiByte(CP_UTF8, 0, text, -1, NULL, 0, NULL, NULL);
+    std::string narrow(length > 0 ? length - 1 : 0, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text, -1, &narrow[0], length, NULL, NULL);
+    return narrow;
+}
+
+// Calls one of the GetCurrentPackage* functions, which all share the
+// (length, buffer) protocol.
+template <typename Function>
+std::string PackageString(Function function) {
+    UINT32 length = 0;
+    if (function(&length, NULL) != ERROR_INSUFFICIENT_BUFFER) {
+        return std::string();
+    }
+    std::wstring value(length, L'\0');
+    if (function(&length, &value[0]) != ERROR_SUCCESS) {
+        return std::string();
+    }
+    return Narrow(value.c_str());
+}
+
+std::string SidString(PSID sid) {
+    LPSTR text = NULL;
+    if (!ConvertSidToStringSidA(sid, &text)) {
+        return std::string();
+    }
+    std::string result = text;
+    LocalFree(text);
+    return result;
+}
+
+std::vector<char> TokenInformation(HANDLE token, TOKEN_INFORMATION_CLASS type) {
+    DWORD size = 0;
+    GetTokenInformation(token, type, NULL, 0, &size);
+    std::vector<char> buffer(size);
+    if (size == 0 || !GetTokenInformation(token, type, buffer.data(), size, &size)) {
+        buffer.clear();
+    }
+    return buffer;
+}
+
+const RuntimeEnvironment* MapInherited() {
+    const char* value = getenv(kRuntimeEnvVariable);
+    if (value == nullptr) {
+        return nullptr;
+    }
+    HANDLE mapping = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(strtoull(value, NULL, 10)));
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(RuntimeEnvironment));
+    if (view == NULL) {
+        return nullptr;
+    }
+    auto environment = static_cast<const RuntimeEnvironment*>(view);
+    if (environment->magic != RuntimeEnvironment::kMagic ||
+        environment->version != RuntimeEnvironment::kVersion) {
+        UnmapViewOfFile(view);
+        return nullptr;
+    }
+    return environment;
+}
+#else
+std::string ReadSmallFile(const char* path) {
+    std::string contents;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return contents;
+    }
+    char buffer[4096];
+    ssize_t read;
+    while ((read = ::read(fd, buffer, sizeof(buffer))) > 0) {
+        contents.append(buffer, read);
+    }
+    close(fd);
+    return contents;
+}
+
+std::string ReadLink(const std::string& path) {
+    char target[256];
+    ssize_t length = readlink(path.c_str(), target, sizeof(target) - 1);
+    return length > 0 ? std::string(target, length) : std::string();
+}
+
+// Value of a "Name:\tvalue" line in /proc/self/status.
+std::string StatusField(const std::string& status, const char* name) {
+    std::string key = std::string("\n") + name + ":";
+    size_t start = status.find(key);
+    if (start == std::string::npos) {
+        return std::string();
+    }
+    start = status.find_first_not_of(" \t", start + key.size());
+    size_t end = status.find('\n', start);
+    return start == std::string::npos ? std::string() : status.substr(start, end - start);
+}
+
+const RuntimeEnvironment* MapInherited() {
+    const char* value = getenv(kRuntimeEnvVariable);
+    if (value == nullptr) {
+        return nullptr;
+    }
+    int fd = atoi(value);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 ||
+        info.st_size < static_cast<off_t>(sizeof(RuntimeEnvironment))) {
+        return nullptr;
+    }
+    // The fd stays open so children started without the launcher (plain
+    // fork/exec inside the sandbox) can map the same descriptor.
+    void* view = mmap(nullptr, sizeof(RuntimeEnvironment), PROT_READ, MAP_SHARED, fd, 0);
+    if (view == MAP_FAILED) {
+        return nullptr;
+    }
+    auto environment = static_cast<const RuntimeEnvironment*>(view);
+    if (environment->magic != RuntimeEnvironment::kMagic ||
+        environment->version != RuntimeEnvironment::kVersion) {
+        munmap(view, sizeof(RuntimeEnvironment));
+        return nullptr;
+    }
+    return environment;
+}
+#endif
+
+const RuntimeEnvironment* LoadEnvironment() {
+    if (const RuntimeEnvironment* inherited = MapInherited()) {
+        return inherited;
+    }
+    static RuntimeEnvironment probed;
+    ProbeEnvironment(&probed);
+    return &probed;
+}
+
+}  // namespace
+
+bool RuntimeEnvironment::AddCapability(const std::string& capability) {
+    if (capabilityCount >= static_cast<uint32_t>(kMaxCapabilities)) {
+        return false;
+    }
+    CopyField(capabilities[capabilityCount++], capability);
+    return true;
+}
+
+const RuntimeEnvironment& CurrentEnvironment() {
+    static const RuntimeEnvironment* environment = LoadEnvironment();
+    return *environment;
+}
+
+#ifdef _WIN32
+void ProbeEnvironment(RuntimeEnvironment* environment) {
+    *environment = RuntimeEnvironment();
+    std::string fullName = PackageString(GetCurrentPackageFullName);
+    if (!fullName.empty()) {
+        environment->flags |= kEnvPackaged;
+        CopyField(environment->packageFullName, fullName);
+        CopyField(environment->packageFamilyName, PackageString(GetCurrentPackageFamilyName));
+        CopyField(environment->packageRoot, PackageString(GetCurrentPackagePath));
+    } else if (const char* family = getenv("PACKAGE_FAMILY_NAME")) {
+        // Set for processes the package launched outside its identity.
+        environment->flags |= kEnvPackaged;
+        CopyField(environment->packageFamilyName, family);
+    }
+
+    HANDLE token = NULL;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+        return;
+    }
+    DWORD isAppContainer = 0;
+    DWORD size = sizeof(isAppContainer);
+    if (GetTokenInformation(token, TokenIsAppContainer, &isAppContainer, size, &size) &&
+        isAppContainer != 0) {
+        environment->flags |= kEnvAppContainer;
+        std::vector<char> container = TokenInformation(token, TokenAppContainerSid);
+        if (!container.empty()) {
+            auto info = reinterpret_cast<TOKEN_APPCONTAINER_INFORMATION*>(container.data());
+            CopyField(environment->container, SidString(info->TokenAppContainer));
+        }
+        std::vector<char> capabilities = TokenInformation(token, TokenCapabilities);
+        if (!capabilities.empty()) {
+            auto groups = reinterpret_cast<TOKEN_GROUPS*>(capabilities.data());
+            for (DWORD i = 0; i < groups->GroupCount; i++) {
+                environment->AddCapability(SidString(groups->Groups[i].Sid));
+            }
+        }
+    }
+    CloseHandle(token);
+}
+
+std::unique_ptr<PublishedEnvironment> PublishedEnvironment::Create(
+    const RuntimeEnvironment& environment, std::string* error) {
+    HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0,
+                                        sizeof(environment), NULL);
+    if (mapping == NULL) {
+        *error = "CreateFileMapping failed with error " + std::to_string(GetLastError());
+        return nullptr;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(environment));
+    if (view == NULL) {
+        *error = "MapViewOfFile failed with error " + std::to_string(GetLastError());
+        CloseHandle(mapping);
+        return nullptr;
+    }
+    memcpy(view, &environment, sizeof(environment));
+    UnmapViewOfFile(view);
+
+    // Children only ever get a read-only handle; the writable one is closed.
+    HANDLE readOnly = NULL;
+    BOOL ok = DuplicateHandle(GetCurrentProcess(), mapping, GetCurrentProcess(), &readOnly,
+                              FILE_MAP_READ, TRUE, 0);
+    CloseHandle(mapping);
+    if (!ok) {
+        *error = "DuplicateHandle failed with error " + std::to_string(GetLastError());
+        return nullptr;
+    }
+    std::unique_ptr<PublishedEnvironment> published(new PublishedEnvironment());
+    published->handle_ = readOnly;
+    published->variable_ = std::string(kRuntimeEnvVariable) + "=" +
+                           std::to_string(reinterpret_cast<uintptr_t>(readOnly));
+    return published;
+}
+
+PublishedEnvironment::~PublishedEnvironment() {
+    if (handle_ != nullptr) {
+        CloseHandle(handle_);
+    }
+}
+#else
+void ProbeEnvironment(RuntimeEnvironment* environment) {
+    *environment = RuntimeEnvironment();
+#ifdef __linux__
+    // A user namespace maps a subset of ids; the initial one maps them all.
+    std::string uidMap = ReadSmallFile("/proc/self/uid_map");
+    if (!uidMap.empty() && uidMap.find("4294967295") == std::string::npos) {
+        environment->flags |= kEnvUserNamespace;
+        CopyField(environment->container, ReadLink("/proc/self/ns/user"));
+    }
+    // Other namespaces are only detectable by comparing with init, which a
+    // sandboxed process usually may not inspect.
+    const struct {
+        const char* name;
+        uint32_t flag;
+    } namespaces[] = {
+        {"mnt", kEnvMountNamespace},
+        {"net", kEnvNetworkNamespace},
+        {"ipc", kEnvIpcNamespace},
+        {"uts", kEnvUtsNamespace},
+    };
+    for (const auto& ns : namespaces) {
+        std::string self = ReadLink(std::string("/proc/self/ns/") + ns.name);
+        std::string init = ReadLink(std::string("/proc/1/ns/") + ns.name);
+        if (!self.empty() && !init.empty() && self != init) {
+            environment->flags |= ns.flag;
+        } else if (!self.empty() && self == init && ns.flag == kEnvNetworkNamespace) {
+            environment->AddCapability("network");
+        }
+    }
+
+    std::string status = ReadSmallFile("/proc/self/status");
+    std::string seccomp = StatusField(status, "Seccomp");
+    if (!seccomp.empty() && seccomp != "0") {
+        environment->flags |= kEnvSeccomp;
+    }
+    if (StatusField(status, "NoNewPrivs") == "1") {
+        environment->flags |= kEnvNoNewPrivs;
+    }
+
+    long abi = syscall(SYS_landlock_create_ruleset, nullptr, 0, LANDLOCK_CREATE_RULESET_VERSION);
+    environment->landlockAbi = abi > 0 ? static_cast<uint32_t>(abi) : 0;
+
+    std::string cgroups = ReadSmallFile("/proc/self/cgroup");
+    size_t unified = cgroups.rfind("0::", std::string::npos);
+    if (unified != std::string::npos && (unified == 0 || cgroups[unified - 1] == '\n')) {
+        environment->flags |= kEnvCgroupV2;
+        size_t end = cgroups.find('\n', unified);
+        CopyField(environment->cgroup, cgroups.substr(unified + 3, end - unified - 3));
+    }
+#endif
+}
+
+std::unique_ptr<PublishedEnvironment> PublishedEnvironment::Create(
+    const RuntimeEnvironment& environment, std::string* error) {
+#ifdef __linux__
+    int fd = memfd_create("sandbox-runtime-env", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        *error = std::string("memfd_create failed: ") + strerror(errno);
+        return nullptr;
+    }
+    // Sealed after the write, so neither a child nor anyone else holding the
+    // fd can change what later children read.
+    if (write(fd, &environment, sizeof(environment)) !=
+            static_cast<ssize_t>(sizeof(environment)) ||
+        fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        *error = std::string("Failed to seal runtime environment: ") + strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+    std::unique_ptr<PublishedEnvironment> published(new PublishedEnvironment());
+    published->fd_ = fd;
+    published->variable_ = std::string(kRuntimeEnvVariable) + "=" + std::to_string(fd);
+    return published;
+#else
+    (void)environment;
+    *error = "Publishing the runtime environment is not supported on this platform";
+    return nullptr;
+#endif
+}
+
+PublishedEnvironment::~PublishedEnvironment() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+#endif
+
+}  // namespace sandbox
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// What a process knows about the sandbox it runs in: package identity,
+// container status, capabilities, and on Linux the namespaces, Landlock and
+// cgroup it was placed in.
+//
+// Probing this takes several syscalls (package APIs and token queries on
+// Windows, /proc on Linux), and a sandboxed child often cannot see enough to
+// answer at all. SandboxLauncher therefore describes each child's
+// environment once and hands it down as a sealed read-only segment named by
+// kRuntimeEnvVariable. CurrentEnvironment() maps that segment on first use
+// and only probes when no launcher provided one.
+namespace sandbox {
+
+// Holds the inherited descriptor: a memfd number on POSIX, a file mapping
+// handle value on Windows.
+constexpr char kRuntimeEnvVariable[] = "SANDBOX_RUNTIME_ENV";
+
+enum RuntimeFlag : uint32_t {
+    // The process has package identity (MSIX / Desktop Bridge).
+    kEnvPackaged = 1u << 0,
+    kEnvAppContainer = 1u << 1,
+    kEnvUserNamespace = 1u << 2,
+    kEnvMountNamespace = 1u << 3,
+    kEnvNetworkNamespace = 1u << 4,
+    kEnvIpcNamespace = 1u << 5,
+    kEnvUtsNamespace = 1u << 6,
+    // Restricted by a Landlock ruleset. The kernel cannot be asked this, so
+    // only launcher-provided descriptors set it.
+    kEnvLandlock = 1u << 7,
+    kEnvSeccomp = 1u << 8,
+    kEnvNoNewPrivs = 1u << 9,
+    kEnvCgroupV2 = 1u << 10,
+    // Filled in by the launcher rather than probed.
+    kEnvInherited = 1u << 31,
+};
+
+// Fixed layout with no pointers so it can be shared as raw bytes.
+struct RuntimeEnvironment {
+    static constexpr uint32_t kMagic = 0x56454e52;  // "RNEV"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr int kMaxCapabilities = 16;
+
+    uint32_t magic = kMagic;
+    uint32_t version = kVersion;
+    uint32_t flags = 0;
+    // Landlock ABI version the kernel supports; 0 without Landlock.
+    uint32_t landlockAbi = 0;
+    uint32_t capabilityCount = 0;
+    char packageFullName[256] = {};
+    char packageFamilyName[256] = {};
+    // Install directory of the package.
+    char packageRoot[1024] = {};
+    // AppContainer SID on Windows, user namespace ("user:[inode]") on Linux.
+    char container[192] = {};
+    // cgroup v2 path, relative to the cgroup root.
+    char cgroup[512] = {};
+    // Capability SIDs on Windows; "network" on Linux when the sandbox keeps
+    // the host network.
+    char capabilities[kMaxCapabilities][128] = {};
+
+    bool Has(uint32_t flag) const { return (flags & flag) != 0; }
+    bool AddCapability(const std::string& capability);
+};
+
+// The environment of this process, computed on first call and immutable
+// afterwards.
+const RuntimeEnvironment& CurrentEnvironment();
+
+// Probes this process without looking for an inherited descriptor. Namespaces
+// are only reported when /proc/1 can be compared against.
+void ProbeEnvironment(RuntimeEnvironment* environment);
+
+// Copies text into a fixed field, truncating it.
+template <size_t N>
+void CopyField(char (&field)[N], const std::string& text) {
+    size_t length = text.size() < N - 1 ? text.size() : N - 1;
+    text.copy(field, length);
+    field[length] = '\0';
+}
+
+// A sealed, read-only copy of a descriptor that child processes inherit.
+class PublishedEnvironment {
+public:
+    static std::unique_ptr<PublishedEnvironment> Create(const RuntimeEnvironment& environment,
+                                                        std::string* error);
+    ~PublishedEnvironment();
+
+    // "SANDBOX_RUNTIME_ENV=<fd or handle>" for the child's environment.
+    const std::string& Variable() const { return variable_; }
+#ifdef _WIN32
+    // Inheritable handle to a read-only mapping.
+    void* Handle() const { return handle_; }
+#else
+    // The child must clear FD_CLOEXEC on this before exec.
+    int Fd() const { return fd_; }
+#endif
+
+private:
+    PublishedEnvironment() = default;
+
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+    std::string variable_;
+};
+
+}  // namespace sandbox
@@ -0,0 +1,250 @@
+// Compares sandboxed launches through SandboxLauncher, whose namespaces,
+// Landlock ruleset and seccomp filter are prepared once, against building
+// the same sandbox on every launch (fork + unshare + id maps + ruleset +
+// filter + exec), and against an unsandboxed fork + exec.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mount.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "launcher.h"
+
+namespace {
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [command args...]\n"
+              << "Options:\n"
+              << "  /n <launches>     Launches per mode (default: 200)\n"
+              << "  /read <dir>       Readable directory (repeatable; default: /usr /lib\n"
+              << "                    /lib64 /bin /etc)\n"
+              << "  /write <dir>      Writable directory (repeatable)\n"
+              << "  /mode <name>      Only run one of: launcher, unshare, plain\n"
+              << "The command defaults to /bin/true.\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+double Percentile(std::vector<double> values, double fraction) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(fraction * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+#ifdef __linux__
+int WaitForExit(pid_t pid) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+// The sandbox built from scratch for one launch, the way a launcher without
+// templates has to: the child unshares and waits while the parent writes its
+// id maps, then applies Landlock and seccomp and execs.
+pid_t LaunchUnshared(const sandbox::SandboxPolicy& policy, char* const* argv, int devNull,
+                     std::string* error) {
+    int toParent[2];
+    int toChild[2];
+    if (pipe2(toParent, O_CLOEXEC) != 0 || pipe2(toChild, O_CLOEXEC) != 0) {
+        *error = std::string("pipe2 failed: ") + strerror(errno);
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        char byte = 0;
+        if (unshare(CLONE_NEWUSER | CLONE_NEWNS | CLONE_NEWIPC | CLONE_NEWUTS | CLONE_NEWNET) !=
+                0 ||
+            write(toParent[1], &byte, 1) != 1 || read(toChild[0], &byte, 1) != 1 ||
+            mount(nullptr, "/", nullptr, MS_REC | MS_PRIVATE, nullptr) != 0 ||
+            sethostname("sandbox", 7) != 0 || prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0) {
+            _exit(126);
+        }
+        std::string childError;
+        int ruleset = sandbox::CreateLandlockRuleset(policy, &childError);
+        if ((ruleset >= 0 && syscall(SYS_landlock_restrict_self, ruleset, 0) != 0) ||
+            !sandbox::InstallSeccompFilter(&childError)) {
+            _exit(126);
+        }
+        dup2(devNull, 1);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(toParent[1]);
+    close(toChild[0]);
+    char byte = 0;
+    bool ok = pid > 0 && read(toParent[0], &byte, 1) == 1 && sandbox::WriteIdMaps(pid, error) &&
+              write(toChild[1], &byte, 1) == 1;
+    close(toParent[0]);
+    close(toChild[1]);
+    if (pid > 0 && !ok) {
+        WaitForExit(pid);
+        if (error->empty()) {
+            *error = "unshare baseline child failed";
+        }
+        return -1;
+    }
+    if (pid < 0) {
+        *error = std::string("fork failed: ") + strerror(errno);
+    }
+    return pid;
+}
+
+using Clock = std::chrono::steady_clock;
+
+void Report(const char* mode, const std::vector<double>& latencies, double seconds) {
+    fprintf(stderr, "%-10s %10.0f %8.3f %8.3f %8.3f\n", mode, latencies.size() / seconds,
+            Percentile(latencies, 0.5), Percentile(latencies, 0.95), Percentile(latencies, 0.99));
+}
+#endif
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+#ifdef __linux__
+    sandbox::SandboxPolicy policy;
+    std::vector<std::string> command;
+    std::string onlyMode;
+    int launches = 200;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (command.empty() && IsFlag(arg, "n") && hasValue) {
+            launches = atoi(argv[++i]);
+        } else if (command.empty() && IsFlag(arg, "read") && hasValue) {
+            policy.readPaths.push_back(argv[++i]);
+        } else if (command.empty() && IsFlag(arg, "write") && hasValue) {
+            policy.writePaths.push_back(argv[++i]);
+        } else if (command.empty() && IsFlag(arg, "mode") && hasValue) {
+            onlyMode = argv[++i];
+        } else if (command.empty() && (IsFlag(arg, "?") || IsFlag(arg, "help"))) {
+            PrintUsage(argv[0]);
+            return 0;
+        } else {
+            command.push_back(arg);
+        }
+    }
+    if (launches <= 0) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (command.empty()) {
+        command.push_back("/bin/true");
+    }
+    if (policy.readPaths.empty()) {
+        for (const char* path : {"/usr", "/lib", "/lib64", "/bin", "/etc"}) {
+            if (access(path, F_OK) == 0) {
+                policy.readPaths.push_back(path);
+            }
+        }
+    }
+    std::vector<char*> childArgv;
+    for (std::string& argument : command) {
+        childArgv.push_back(&argument[0]);
+    }
+    childArgv.push_back(nullptr);
+    int devNull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    fprintf(stderr, "%d launches of %s\n", launches, command[0].c_str());
+    fprintf(stderr, "%-10s %10s %8s %8s %8s\n", "mode", "spawns/s", "p50 ms", "p95 ms",
+            "p99 ms");
+    int failures = 0;
+
+    if (onlyMode.empty() || onlyMode == "launcher") {
+        std::string error;
+        auto setupStart = Clock::now();
+        std::unique_ptr<sandbox::SandboxLauncher> launcher =
+            sandbox::SandboxLauncher::Create(policy, &error);
+        if (!launcher) {
+            std::cerr << "Failed to create launcher: " << error << std::endl;
+            return 1;
+        }
+        double setupMs =
+            std::chrono::duration<double, std::milli>(Clock::now() - setupStart).count();
+
+        sandbox::LaunchCommand launch;
+        launch.argv = command;
+        launch.stdoutFd = devNull;
+        std::vector<double> latencies;
+        auto start = Clock::now();
+        for (int i = 0; i < launches; i++) {
+            auto launchStart = Clock::now();
+            sandbox::LaunchedProcess process;
+            int exitCode = 0;
+            if (!launcher->Spawn(launch, &process, &error) ||
+                !launcher->Wait(&process, &exitCode, &error)) {
+                std::cerr << error << std::endl;
+                return 1;
+            }
+            failures += exitCode != 0;
+            latencies.push_back(
+                std::chrono::duration<double, std::milli>(Clock::now() - launchStart).count());
+        }
+        Report("launcher", latencies,
+               std::chrono::duration<double>(Clock::now() - start).count());
+        fprintf(stderr, "           one-time setup %.3f ms (landlock: %s, seccomp: %s)\n", setupMs,
+                launcher->HasLandlock() ? "yes" : "no", launcher->HasSeccomp() ? "yes" : "no");
+    }
+
+    for (const char* mode : {"unshare", "plain"}) {
+        if (!onlyMode.empty() && onlyMode != mode) {
+            continue;
+        }
+        bool unshared = strcmp(mode, "unshare") == 0;
+        std::vector<double> latencies;
+        auto start = Clock::now();
+        for (int i = 0; i < launches; i++) {
+            auto launchStart = Clock::now();
+            std::string error;
+            pid_t pid;
+            if (unshared) {
+                pid = LaunchUnshared(policy, childArgv.data(), devNull, &error);
+            } else {
+                pid = fork();
+                if (pid == 0) {
+                    dup2(devNull, 1);
+                    execvp(childArgv[0], childArgv.data());
+                    _exit(127);
+                }
+            }
+            if (pid < 0) {
+                std::cerr << (error.empty() ? "fork failed" : error) << std::endl;
+                return 1;
+            }
+            failures += WaitForExit(pid) != 0;
+            latencies.push_back(
+                std::chrono::duration<double, std::milli>(Clock::now() - launchStart).count());
+        }
+        Report(mode, latencies, std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    if (failures > 0) {
+        fprintf(stderr, "%d launches exited with a non-zero code\n", failures);
+    }
+    close(devNull);
+    return failures > 0 ? 1 : 0;
+#else
+    (void)argc;
+    PrintUsage(argv[0]);
+    std::cerr << "spawn_bench compares Linux sandbox backends and only runs on Linux."
+              << std::endl;
+    return 1;
+#endif
+}
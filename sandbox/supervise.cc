@@ -0,0 +1,122 @@
+// Runs a command under Supervisor: restarts it by policy, restarts it when
+// its HTTP health check stops answering, and keeps a metrics file with its
+// resource use.
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "launcher.h"
+#include "supervisor.h"
+
+namespace {
+
+sandbox::Supervisor* g_supervisor = nullptr;
+
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] command [args...]\n"
+              << "Options:\n"
+              << "  /restart <policy>   never, on-failure or always (default: on-failure)\n"
+              << "  /max-restarts <n>   Give up after n restarts (default: no limit)\n"
+              << "  /health <port>      Probe http://127.0.0.1:<port>/ for hangs\n"
+              << "  /health-path <path> Path the probe requests (default: /)\n"
+              << "  /startup <s>        Time the server has to answer first (default: 120)\n"
+              << "  /metrics <file>     Metrics file, Prometheus text format\n"
+              << "  /interval <s>       Sampling interval (default: 1)\n"
+              << "  /sandbox            Run the command through SandboxLauncher\n"
+              << "  /read <dir>         Readable directory for /sandbox (repeatable)\n"
+              << "  /write <dir>        Writable directory for /sandbox (repeatable)\n";
+}
+
+bool IsFlag(const char* arg, const char* name) {
+    return (arg[0] == '/' || arg[0] == '-') && strcmp(arg + 1, name) == 0;
+}
+
+void HandleStop(int) {
+    if (g_supervisor != nullptr) {
+        g_supervisor->Stop();
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    sandbox::SupervisorOptions options;
+    sandbox::SandboxPolicy policy;
+    bool sandboxed = false;
+    int first = 1;
+    for (; first < argc; first++) {
+        const char* arg = argv[first];
+        bool hasValue = first + 1 < argc;
+        if (IsFlag(arg, "restart") && hasValue) {
+            std::string name = argv[++first];
+            if (name == "never") {
+                options.restart = sandbox::RestartPolicy::kNever;
+            } else if (name == "always") {
+                options.restart = sandbox::RestartPolicy::kAlways;
+            } else if (name == "on-failure") {
+                options.restart = sandbox::RestartPolicy::kOnFailure;
+            } else {
+                PrintUsage(argv[0]);
+                return 1;
+            }
+        } else if (IsFlag(arg, "max-restarts") && hasValue) {
+            options.maxRestarts = static_cast<unsigned>(atoi(argv[++first]));
+        } else if (IsFlag(arg, "health") && hasValue) {
+            options.healthPort = atoi(argv[++first]);
+        } else if (IsFlag(arg, "health-path") && hasValue) {
+            options.healthPath = argv[++first];
+        } else if (IsFlag(arg, "startup") && hasValue) {
+            options.startupSeconds = atof(argv[++first]);
+        } else if (IsFlag(arg, "metrics") && hasValue) {
+            options.metricsPath = argv[++first];
+        } else if (IsFlag(arg, "interval") && hasValue) {
+            options.sampleIntervalSeconds = atof(argv[++first]);
+        } else if (IsFlag(arg, "sandbox")) {
+            sandboxed = true;
+        } else if (IsFlag(arg, "read") && hasValue) {
+            policy.readPaths.push_back(argv[++first]);
+        } else if (IsFlag(arg, "write") && hasValue) {
+            policy.writePaths.push_back(argv[++first]);
+        } else {
+            break;
+        }
+    }
+    if (first >= argc) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    std::unique_ptr<sandbox::SandboxLauncher> launcher;
+    if (sandboxed) {
+#ifndef _WIN32
+        if (policy.readPaths.empty()) {
+            for (const char* path : {"/usr", "/lib", "/lib64", "/bin", "/etc"}) {
+                if (access(path, F_OK) == 0) {
+                    policy.readPaths.push_back(path);
+                }
+            }
+        }
+#endif
+        std::string error;
+        launcher = sandbox::SandboxLauncher::Create(policy, &error);
+        if (!launcher) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+    sandbox::LaunchCommand command;
+    command.argv.assign(argv + first, argv + argc);
+    sandbox::Supervisor supervisor(options, launcher.get());
+    g_supervisor = &supervisor;
+    signal(SIGINT, HandleStop);
+    signal(SIGTERM, HandleStop);
+    return supervisor.Run(command);
+}
@@ -0,0 +1,677 @@
+#include "supervisor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace sandbox {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double SecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+Clock::duration Seconds(double seconds) {
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+#ifdef _WIN32
+using Socket = SOCKET;
+const Socket kInvalidSocket = INVALID_SOCKET;
+
+void CloseSocket(Socket socket) { closesocket(socket); }
+
+int PollSocket(Socket socket, short events, int timeoutMs) {
+    WSAPOLLFD fd = {socket, events, 0};
+    return WSAPoll(&fd, 1, timeoutMs);
+}
+
+bool StartSockets() {
+    static const bool started = [] {
+        WSADATA data;
+        return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+    }();
+    return started;
+}
+
+bool SetNonBlocking(Socket socket) {
+    u_long on = 1;
+    return ioctlsocket(socket, FIONBIO, &on) == 0;
+}
+
+double FileTimeSeconds(const FILETIME& time) {
+    return (static_cast<uint64_t>(time.dwHighDateTime) << 32 | time.dwLowDateTime) / 1e7;
+}
+
+// The processes in a job; retried with a larger list while it grows.
+std::vector<DWORD> JobProcessIds(HANDLE job) {
+    std::vector<DWORD> ids;
+    std::vector<char> buffer(sizeof(JOBOBJECT_BASIC_PROCESS_ID_LIST) + 63 * sizeof(ULONG_PTR));
+    for (;;) {
+        auto list = reinterpret_cast<JOBOBJECT_BASIC_PROCESS_ID_LIST*>(buffer.data());
+        if (!QueryInformationJobObject(job, JobObjectBasicProcessIdList, list,
+                                       static_cast<DWORD>(buffer.size()), NULL) &&
+            GetLastError() != ERROR_MORE_DATA) {
+            return ids;
+        }
+        if (list->NumberOfProcessIdsInList < list->NumberOfAssignedProcesses) {
+            buffer.resize(sizeof(JOBOBJECT_BASIC_PROCESS_ID_LIST) +
+                          (list->NumberOfAssignedProcesses + 16) * sizeof(ULONG_PTR));
+            continue;
+        }
+        for (DWORD i = 0; i < list->NumberOfProcessIdsInList; i++) {
+            ids.push_back(static_cast<DWORD>(list->ProcessIdList[i]));
+        }
+        return ids;
+    }
+}
+#else
+using Socket = int;
+constexpr Socket kInvalidSocket = -1;
+
+void CloseSocket(Socket socket) { close(socket); }
+
+int PollSocket(Socket socket, short events, int timeoutMs) {
+    pollfd fd = {socket, events, 0};
+    int ready;
+    while ((ready = poll(&fd, 1, timeoutMs)) < 0 && errno == EINTR) {
+    }
+    return ready;
+}
+
+bool StartSockets() { return true; }
+
+bool SetNonBlocking(Socket socket) {
+    int flags = fcntl(socket, F_GETFL);
+    return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+#endif
+
+int RemainingMs(Clock::time_point deadline) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+    return static_cast<int>(std::max<long long>(0, left.count()));
+}
+
+// True when an HTTP server on 127.0.0.1:port starts answering a GET within
+// the timeout. Accepting the connection is not enough: the kernel accepts
+// into the backlog even when the server process is stuck.
+bool ProbeHttp(int port, const std::string& path, double timeoutSeconds) {
+    if (!StartSockets()) {
+        return false;
+    }
+    Clock::time_point deadline = Clock::now() + Seconds(timeoutSeconds);
+    Socket socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (socket == kInvalidSocket) {
+        return false;
+    }
+    bool ok = false;
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (SetNonBlocking(socket)) {
+        connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        int socketError = 0;
+        socklen_t length = sizeof(socketError);
+        if (PollSocket(socket, POLLOUT, RemainingMs(deadline)) > 0 &&
+            getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&socketError),
+                       &length) == 0 &&
+            socketError == 0) {
+            std::string request =
+                "GET " + path + " HTTP/1.0\r\nHost: 127.0.0.1\r\nConnection: close\r\n\r\n";
+            char response[5];
+            size_t received = 0;
+            if (send(socket, request.data(), static_cast<int>(request.size()), 0) ==
+                static_cast<int>(request.size())) {
+                while (received < sizeof(response) &&
+                       PollSocket(socket, POLLIN, RemainingMs(deadline)) > 0) {
+                    auto n = recv(socket, response + received,
+                                  static_cast<int>(sizeof(response) - received), 0);
+                    if (n <= 0) {
+                        break;
+                    }
+                    received += static_cast<size_t>(n);
+                }
+            }
+            ok = received == sizeof(response) && memcmp(response, "HTTP/", 5) == 0;
+        }
+    }
+    CloseSocket(socket);
+    return ok;
+}
+
+#ifdef __linux__
+// Re-reads a /proc file through a descriptor kept open between samples.
+bool ReadProcFile(int fd, char* buffer, size_t size) {
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t length = pread(fd, buffer, size - 1, 0);
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+    return true;
+}
+
+uint64_t FieldAfter(const char* text, const char* label) {
+    const char* found = strstr(text, label);
+    return found != nullptr ? strtoull(found + strlen(label), nullptr, 10) : 0;
+}
+
+// Fields 3 to 24 of a /proc/<pid>/stat line into fields[0..21]. They follow
+// the parenthesised command name, which may contain spaces: the process
+// group is field 5, utime and stime 14 and 15, the same for waited-for
+// children 16 and 17, num_threads 20 and rss 24.
+bool ParseProcStat(const char* text, uint64_t fields[22]) {
+    const char* cursor = strrchr(text, ')');
+    if (cursor == nullptr || cursor[1] == '\0') {
+        return false;
+    }
+    cursor += 2;
+    for (int field = 3; field <= 24 && *cursor != '\0'; field++) {
+        char* end;
+        fields[field - 3] = strtoull(cursor, &end, 10);
+        cursor = *end == ' ' ? end + 1 : end;
+        if (field == 3) {
+            // The state is a letter, not a number.
+            cursor = strchr(cursor, ' ');
+            cursor = cursor != nullptr ? cursor + 1 : "";
+        }
+    }
+    return true;
+}
+#endif
+
+}  // namespace
+
+struct ProcessSampler::State {
+    Clock::time_point lastTime;
+    double lastCpu = -1;
+    double lastHostBusy = -1;
+    double lastHostTotal = 0;
+#ifdef _WIN32
+    HANDLE process = NULL;
+    DWORD pid = 0;
+    HANDLE job = NULL;  // the processTree job, sampled instead of process
+#else
+    // Set for a processTree launch: the group is found in /proc on every
+    // sample instead of reading the leader's files.
+    int processGroup = -1;
+    int statFd = -1;
+    int ioFd = -1;
+    int hostStatFd = -1;
+    int memInfoFd = -1;
+    double tick = 0.01;
+    uint64_t pageSize = 4096;
+#endif
+
+    // Fills the cpuPercent fields from the running totals.
+    void Rates(ProcessSample* sample, double hostBusy, double hostTotal) {
+        Clock::time_point now = Clock::now();
+        if (lastCpu >= 0) {
+            double elapsed = std::chrono::duration<double>(now - lastTime).count();
+            if (elapsed > 0) {
+                sample->cpuPercent = 100 * (sample->cpuSeconds - lastCpu) / elapsed;
+            }
+        }
+        if (lastHostBusy >= 0 && hostTotal > lastHostTotal) {
+            sample->hostCpuPercent = 100 * (hostBusy - lastHostBusy) / (hostTotal - lastHostTotal);
+        }
+        lastTime = now;
+        lastCpu = sample->cpuSeconds;
+        lastHostBusy = hostBusy;
+        lastHostTotal = hostTotal;
+    }
+
+#ifdef __linux__
+    // Sums the members of processGroup, found by a scan of /proc. A
+    // member's children that it has waited for have left the group; their
+    // time is in its cutime and cstime, their I/O is lost.
+    bool SampleGroup(ProcessSample* sample) const {
+        DIR* proc = opendir("/proc");
+        if (proc == nullptr) {
+            return false;
+        }
+        uint64_t ticks = 0, threads = 0, pages = 0, readBytes = 0, writeBytes = 0;
+        bool found = false;
+        char path[64];
+        char buffer[4096];
+        while (dirent* entry = readdir(proc)) {
+            char* end;
+            long pid = strtol(entry->d_name, &end, 10);
+            if (pid <= 0 || *end != '\0') {
+                continue;
+            }
+            snprintf(path, sizeof(path), "/proc/%ld/stat", pid);
+            int fd = open(path, O_RDONLY | O_CLOEXEC);
+            uint64_t values[22] = {};
+            bool member = ReadProcFile(fd, buffer, sizeof(buffer)) &&
+                          ParseProcStat(buffer, values) &&
+                          values[5 - 3] == static_cast<uint64_t>(processGroup);
+            if (fd >= 0) {
+                close(fd);
+            }
+            if (!member) {
+                continue;
+            }
+            found = true;
+            ticks += values[14 - 3] + values[15 - 3] + values[16 - 3] + values[17 - 3];
+            threads += values[20 - 3];
+            pages += values[24 - 3];
+            snprintf(path, sizeof(path), "/proc/%ld/io", pid);
+            fd = open(path, O_RDONLY | O_CLOEXEC);
+            if (ReadProcFile(fd, buffer, sizeof(buffer))) {
+                readBytes += FieldAfter(buffer, "read_bytes: ");
+                writeBytes += FieldAfter(buffer, "\nwrite_bytes: ");
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        closedir(proc);
+        if (!found) {
+            return false;
+        }
+        sample->cpuSeconds = static_cast<double>(ticks) * tick;
+        sample->threads = static_cast<unsigned>(threads);
+        sample->rssBytes = pages * pageSize;
+        sample->readBytes = readBytes;
+        sample->writeBytes = writeBytes;
+        return true;
+    }
+#endif
+};
+
+ProcessSampler::ProcessSampler() : state_(new State()) {}
+
+ProcessSampler::~ProcessSampler() {
+#ifndef _WIN32
+    for (int fd : {state_->statFd, state_->ioFd, state_->hostStatFd, state_->memInfoFd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+#ifdef _WIN32
+std::unique_ptr<ProcessSampler> ProcessSampler::Create(const LaunchedProcess& process,
+                                                       std::string* error) {
+    std::unique_ptr<ProcessSampler> sampler(new ProcessSampler());
+    sampler->state_->process = process.process;
+    sampler->state_->job = process.job;
+    sampler->state_->pid = GetProcessId(process.process);
+    if (sampler->state_->pid == 0) {
+        *error = "GetProcessId failed with error " + std::to_string(GetLastError());
+        return nullptr;
+    }
+    return sampler;
+}
+
+bool ProcessSampler::Sample(ProcessSample* sample) {
+    State& state = *state_;
+    std::vector<DWORD> pids;
+    if (state.job != NULL) {
+        // The job's totals include the processes of the tree that have
+        // already exited; memory is summed over the ones still running.
+        JOBOBJECT_BASIC_AND_IO_ACCOUNTING_INFORMATION accounting = {};
+        if (!QueryInformationJobObject(state.job, JobObjectBasicAndIoAccountingInformation,
+                                       &accounting, sizeof(accounting), NULL)) {
+            return false;
+        }
+        sample->cpuSeconds = (accounting.BasicInfo.TotalUserTime.QuadPart +
+                              accounting.BasicInfo.TotalKernelTime.QuadPart) /
+                             1e7;
+        sample->readBytes = accounting.IoInfo.ReadTransferCount;
+        sample->writeBytes = accounting.IoInfo.WriteTransferCount;
+        sample->rssBytes = 0;
+        pids = JobProcessIds(state.job);
+        for (DWORD pid : pids) {
+            HANDLE member = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+            if (member == NULL) {
+                continue;
+            }
+            PROCESS_MEMORY_COUNTERS memory = {};
+            if (GetProcessMemoryInfo(member, &memory, sizeof(memory))) {
+                sample->rssBytes += memory.WorkingSetSize;
+            }
+            CloseHandle(member);
+        }
+    } else {
+        FILETIME created, exited, kernel, user;
+        if (!GetProcessTimes(state.process, &created, &exited, &kernel, &user)) {
+            return false;
+        }
+        sample->cpuSeconds = FileTimeSeconds(kernel) + FileTimeSeconds(user);
+        PROCESS_MEMORY_COUNTERS memory = {};
+        if (GetProcessMemoryInfo(state.process, &memory, sizeof(memory))) {
+            sample->rssBytes = memory.WorkingSetSize;
+        }
+        IO_COUNTERS io = {};
+        if (GetProcessIoCounters(state.process, &io)) {
+            sample->readBytes = io.ReadTransferCount;
+            sample->writeBytes = io.WriteTransferCount;
+        }
+        pids.push_back(state.pid);
+    }
+    // The process snapshot is the documented way to a thread count; it
+    // lists every process, which is still well under a millisecond.
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    if (snapshot != INVALID_HANDLE_VALUE) {
+        sample->threads = 0;
+        PROCESSENTRY32W entry = {};
+        entry.dwSize = sizeof(entry);
+        for (BOOL more = Process32FirstW(snapshot, &entry); more;
+             more = Process32NextW(snapshot, &entry)) {
+            if (std::find(pids.begin(), pids.end(), entry.th32ProcessID) != pids.end()) {
+                sample->threads += entry.cntThreads;
+            }
+        }
+        CloseHandle(snapshot);
+    }
+    FILETIME idle, hostKernel, hostUser;
+    double busy = 0, total = 0;
+    if (GetSystemTimes(&idle, &hostKernel, &hostUser)) {
+        // Kernel time includes idle time.
+        total = FileTimeSeconds(hostKernel) + FileTimeSeconds(hostUser);
+        busy = total - FileTimeSeconds(idle);
+    }
+    MEMORYSTATUSEX status = {};
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status)) {
+        sample->hostMemoryAvailable = status.ullAvailPhys;
+    }
+    state.Rates(sample, busy, total);
+    return true;
+}
+#elif defined(__linux__)
+std::unique_ptr<ProcessSampler> ProcessSampler::Create(const LaunchedProcess& process,
+                                                       std::string* error) {
+    std::unique_ptr<ProcessSampler> sampler(new ProcessSampler());
+    State& state = *sampler->state_;
+    state.hostStatFd = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+    state.memInfoFd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+    state.tick = 1.0 / static_cast<double>(sysconf(_SC_CLK_TCK));
+    state.pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    if (process.processGroup) {
+        state.processGroup = process.pid;
+        return sampler;
+    }
+    std::string directory = "/proc/" + std::to_string(process.pid) + "/";
+    state.statFd = open((directory + "stat").c_str(), O_RDONLY | O_CLOEXEC);
+    if (state.statFd < 0) {
+        *error = "Cannot open " + directory + "stat: " + strerror(errno);
+        return nullptr;
+    }
+    // Needs ptrace access to the child; sampled without I/O otherwise.
+    state.ioFd = open((directory + "io").c_str(), O_RDONLY | O_CLOEXEC);
+    return sampler;
+}
+
+bool ProcessSampler::Sample(ProcessSample* sample) {
+    State& state = *state_;
+    char buffer[4096];
+    if (state.processGroup >= 0) {
+        if (!state.SampleGroup(sample)) {
+            return false;
+        }
+    } else {
+        uint64_t values[22] = {};
+        if (!ReadProcFile(state.statFd, buffer, sizeof(buffer)) ||
+            !ParseProcStat(buffer, values)) {
+            return false;
+        }
+        sample->cpuSeconds = static_cast<double>(values[14 - 3] + values[15 - 3]) * state.tick;
+        sample->threads = static_cast<unsigned>(values[20 - 3]);
+        sample->rssBytes = values[24 - 3] * state.pageSize;
+        if (ReadProcFile(state.ioFd, buffer, sizeof(buffer))) {
+            sample->readBytes = FieldAfter(buffer, "read_bytes: ");
+            sample->writeBytes = FieldAfter(buffer, "\nwrite_bytes: ");
+        }
+    }
+    double busy = 0, total = 0;
+    if (ReadProcFile(state.hostStatFd, buffer, sizeof(buffer)) && strncmp(buffer, "cpu ", 4) == 0) {
+        // user nice system idle iowait irq softirq steal
+        char* cursor = buffer + 4;
+        for (int column = 0; column < 8; column++) {
+            double value = static_cast<double>(strtoull(cursor, &cursor, 10));
+            total += value;
+            if (column != 3 && column != 4) {
+                busy += value;
+            }
+        }
+    }
+    if (ReadProcFile(state.memInfoFd, buffer, sizeof(buffer))) {
+        sample->hostMemoryAvailable = FieldAfter(buffer, "MemAvailable:") * 1024;
+    }
+    state.Rates(sample, busy, total);
+    return true;
+}
+#else
+std::unique_ptr<ProcessSampler> ProcessSampler::Create(const LaunchedProcess&,
+                                                       std::string* error) {
+    *error = "Process sampling is not supported on this platform";
+    return nullptr;
+}
+
+bool ProcessSampler::Sample(ProcessSample*) { return false; }
+#endif
+
+Supervisor::Supervisor(const SupervisorOptions& options, SandboxLauncher* launcher)
+    : options_(options), launcher_(launcher) {}
+
+bool Supervisor::Launch(const LaunchCommand& command, LaunchedProcess* process,
+                        std::string* error) {
+    return launcher_ != nullptr ? launcher_->Spawn(command, process, error)
+                                : SpawnProcess(command, process, error);
+}
+
+void Supervisor::Stop() { stopping_.store(true, std::memory_order_release); }
+
+void Supervisor::WriteMetrics(bool up, const ProcessSample& sample) {
+    if (options_.metricsPath.empty()) {
+        return;
+    }
+    const struct {
+        const char* name;
+        const char* type;
+        double value;
+    } metrics[] = {
+        {"supervisor_up", "gauge", up ? 1.0 : 0.0},
+        {"supervisor_restarts_total", "counter", static_cast<double>(restarts_)},
+        {"supervisor_hangs_total", "counter", static_cast<double>(hangs_)},
+        {"supervisor_last_exit_code", "gauge", static_cast<double>(lastExitCode_)},
+        {"process_cpu_seconds_total", "counter", sample.cpuSeconds},
+        {"process_cpu_percent", "gauge", sample.cpuPercent},
+        {"process_resident_memory_bytes", "gauge", static_cast<double>(sample.rssBytes)},
+        {"process_read_bytes_total", "counter", static_cast<double>(sample.readBytes)},
+        {"process_write_bytes_total", "counter", static_cast<double>(sample.writeBytes)},
+        {"process_threads", "gauge", static_cast<double>(sample.threads)},
+        {"host_cpu_percent", "gauge", sample.hostCpuPercent},
+        {"host_memory_available_bytes", "gauge", static_cast<double>(sample.hostMemoryAvailable)},
+    };
+    std::string text;
+    char line[160];
+    for (const auto& metric : metrics) {
+        snprintf(line, sizeof(line), "# TYPE %s %s\n%s %.17g\n", metric.name, metric.type,
+                 metric.name, metric.value);
+        text += line;
+    }
+    // Written aside and renamed over, so a scraper never reads half a file.
+    std::string temporary = options_.metricsPath + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr) {
+        return;
+    }
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    written = fclose(file) == 0 && written;
+#ifdef _WIN32
+    written = written && MoveFileExA(temporary.c_str(), options_.metricsPath.c_str(),
+                                     MOVEFILE_REPLACE_EXISTING);
+#else
+    written = written && rename(temporary.c_str(), options_.metricsPath.c_str()) == 0;
+#endif
+    if (!written) {
+        remove(temporary.c_str());
+    }
+}
+
+int Supervisor::Run(const LaunchCommand& command) {
+    // The command is often a stub that starts the real server (a venv's
+    // python.exe redirector): stopping, killing and sampling must reach
+    // everything it starts.
+    LaunchCommand tree = command;
+    tree.processTree = true;
+    unsigned consecutiveRestarts = 0;
+    ProcessSample sample;
+    while (!stopping_.load(std::memory_order_acquire)) {
+        Clock::time_point started = Clock::now();
+        LaunchedProcess process;
+        std::string error;
+        bool hung = false;
+        if (!Launch(tree, &process, &error)) {
+            fprintf(stderr, "supervisor: %s\n", error.c_str());
+            lastExitCode_ = 127;
+        } else {
+            std::unique_ptr<ProcessSampler> sampler = ProcessSampler::Create(process, &error);
+            if (!sampler) {
+                fprintf(stderr, "supervisor: no telemetry: %s\n", error.c_str());
+            }
+            sample = ProcessSample();
+            bool probing = options_.healthPort > 0;
+            bool healthy = false;
+            unsigned failures = 0;
+            Clock::time_point nextSample = started;
+            Clock::time_point nextProbe = started + Seconds(options_.probeIntervalSeconds);
+            // Set once the child is being stopped: by Stop() or a failed
+            // health check, first politely, then by force.
+            bool terminating = false;
+            Clock::time_point forceAt;
+            for (;;) {
+                Clock::time_point now = Clock::now();
+                if (!terminating && stopping_.load(std::memory_order_acquire)) {
+                    terminating = true;
+                    forceAt = now + Seconds(options_.stopGraceSeconds);
+                    KillProcess(process, false);
+                }
+                if (terminating && now >= forceAt) {
+                    KillProcess(process, true);
+                    forceAt = Clock::time_point::max();
+                }
+                // Woken at least every 100 ms to notice Stop().
+                Clock::time_point wakeAt = now + std::chrono::milliseconds(100);
+                if (sampler) {
+                    wakeAt = std::min(wakeAt, nextSample);
+                }
+                if (probing && !terminating) {
+                    wakeAt = std::min(wakeAt, nextProbe);
+                }
+                if (terminating) {
+                    wakeAt = std::min(wakeAt, forceAt);
+                }
+                bool exited = false;
+                if (!WaitProcess(&process, RemainingMs(wakeAt), &exited, &lastExitCode_, &error)) {
+                    fprintf(stderr, "supervisor: %s\n", error.c_str());
+                    return lastExitCode_;
+                }
+                if (exited) {
+                    break;
+                }
+                now = Clock::now();
+                if (sampler && now >= nextSample) {
+                    if (sampler->Sample(&sample)) {
+                        WriteMetrics(true, sample);
+                    }
+                    nextSample += Seconds(options_.sampleIntervalSeconds);
+                    if (nextSample < now) {
+                        nextSample = now + Seconds(options_.sampleIntervalSeconds);
+                    }
+                }
+                if (probing && !terminating && now >= nextProbe) {
+                    // Probes start on a fixed schedule, so a server that
+                    // times out every probe is caught after
+                    // failuresToRestart intervals.
+                    nextProbe = now + Seconds(options_.probeIntervalSeconds);
+                    if (ProbeHttp(options_.healthPort, options_.healthPath,
+                                  options_.probeTimeoutSeconds)) {
+                        healthy = true;
+                        failures = 0;
+                    } else if (healthy) {
+                        failures++;
+                    }
+                    bool stuck = healthy ? failures >= options_.failuresToRestart
+                                         : SecondsSince(started) > options_.startupSeconds;
+                    if (stuck) {
+                        fprintf(stderr, "supervisor: %s, stopping it\n",
+                                healthy ? "health check failed" : "server never came up");
+                        // A server that stopped answering will not shut
+                        // down cleanly either.
+                        hangs_++;
+                        hung = true;
+                        terminating = true;
+                        forceAt = Clock::time_point::max();
+                        KillProcess(process, true);
+                    }
+                }
+            }
+        }
+        WriteMetrics(false, sample);
+        if (stopping_.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        bool failed = hung || lastExitCode_ != 0;
+        if (options_.restart == RestartPolicy::kNever ||
+            (options_.restart == RestartPolicy::kOnFailure && !failed)) {
+            break;
+        }
+        if (options_.maxRestarts != 0 && restarts_ >= options_.maxRestarts) {
+            fprintf(stderr, "supervisor: giving up after %u restarts\n", restarts_);
+            break;
+        }
+        if (SecondsSince(started) >= options_.resetAfterSeconds) {
+            consecutiveRestarts = 0;
+        }
+        double delay = std::min(options_.backoffMaxSeconds,
+                                options_.backoffInitialSeconds *
+                                    std::pow(options_.backoffFactor, consecutiveRestarts));
+        consecutiveRestarts++;
+        fprintf(stderr, "supervisor: exited with %d%s, restarting in %.2f s\n", lastExitCode_,
+                hung ? " (hung)" : "", delay);
+        Clock::time_point restartAt = Clock::now() + Seconds(delay);
+        while (!stopping_.load(std::memory_order_acquire) && Clock::now() < restartAt) {
+            std::this_thread::sleep_for(
+                std::min<Clock::duration>(restartAt - Clock::now(), std::chrono::milliseconds(50)));
+        }
+        restarts_++;
+    }
+    return lastExitCode_;
+}
+
+}  // namespace sandbox
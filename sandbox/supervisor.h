@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "launcher.h"
+
+// Keeps a long-running child (the ComfyUI server) alive: restarts it by
+// policy with exponential backoff, restarts it when a health probe says it
+// hangs, and samples its resource use into a metrics file. The child is
+// launched as a process tree (LaunchCommand::processTree), so stopping it
+// and its telemetry cover everything it starts, and nothing it started
+// outlives it.
+//
+// Sampling is cheap enough to run every second: for a single process the
+// /proc files are opened once per run and re-read with pread() on Linux,
+// and on Windows it is a handful of queries on the process handle. A tree
+// costs a scan of /proc for its process group, or a query of its Job
+// Object's accounting.
+namespace sandbox {
+
+enum class RestartPolicy {
+    kNever,
+    kOnFailure,  // non-zero exit, signal, or a failed health check
+    kAlways,
+};
+
+struct SupervisorOptions {
+    RestartPolicy restart = RestartPolicy::kOnFailure;
+    // Restarts before giving up; 0 = no limit.
+    unsigned maxRestarts = 0;
+    // Delay before restart n is backoffInitial * backoffFactor^(n-1),
+    // capped at backoffMax. A run that lasted resetAfterSeconds starts the
+    // sequence over.
+    double backoffInitialSeconds = 0.1;
+    double backoffFactor = 2;
+    double backoffMaxSeconds = 30;
+    double resetAfterSeconds = 60;
+
+    double sampleIntervalSeconds = 1;
+    // Prometheus text format, replaced after every sample. Empty disables.
+    std::string metricsPath;
+
+    // HTTP health probe on 127.0.0.1:healthPort (0 disables): a GET of
+    // healthPath that gets no response within probeTimeoutSeconds fails.
+    // After the first success, failuresToRestart failures in a row restart
+    // the child; before it, the child has startupSeconds to come up.
+    int healthPort = 0;
+    std::string healthPath = "/";
+    double probeIntervalSeconds = 0.25;
+    double probeTimeoutSeconds = 0.25;
+    unsigned failuresToRestart = 3;
+    double startupSeconds = 120;
+    // SIGTERM grace before SIGKILL on Stop() (POSIX). A hung child is
+    // killed right away.
+    double stopGraceSeconds = 0.5;
+};
+
+struct ProcessSample {
+    double cpuSeconds = 0;   // user + system
+    double cpuPercent = 0;   // since the previous sample; 100 = one core
+    uint64_t rssBytes = 0;
+    uint64_t readBytes = 0;  // storage I/O where the OS reports it
+    uint64_t writeBytes = 0;
+    unsigned threads = 0;
+    double hostCpuPercent = 0;  // all cores busy = 100
+    uint64_t hostMemoryAvailable = 0;
+};
+
+// Resource sampler for one process, or for the whole tree of a
+// processTree launch.
+class ProcessSampler {
+public:
+    ~ProcessSampler();
+
+    ProcessSampler(const ProcessSampler&) = delete;
+    ProcessSampler& operator=(const ProcessSampler&) = delete;
+
+    static std::unique_ptr<ProcessSampler> Create(const LaunchedProcess& process,
+                                                  std::string* error);
+
+    bool Sample(ProcessSample* sample);
+
+private:
+    struct State;
+
+    ProcessSampler();
+
+    std::unique_ptr<State> state_;
+};
+
+class Supervisor {
+public:
+    // launcher may be null: the child then runs unsandboxed (SpawnProcess).
+    Supervisor(const SupervisorOptions& options, SandboxLauncher* launcher);
+
+    // Runs the command until the restart policy lets it stay down or Stop()
+    // is called. Returns the last exit code.
+    int Run(const LaunchCommand& command);
+
+    // Stops the child and Run(); may be called from any thread.
+    void Stop();
+
+private:
+    bool Launch(const LaunchCommand& command, LaunchedProcess* process, std::string* error);
+    void WriteMetrics(bool up, const ProcessSample& sample);
+
+    SupervisorOptions options_;
+    SandboxLauncher* launcher_;
+    std::atomic<bool> stopping_{false};
+    unsigned restarts_ = 0;
+    unsigned hangs_ = 0;
+    int lastExitCode_ = 0;
+};
+
+}  // namespace sandbox
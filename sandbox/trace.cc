@@ -0,0 +1,406 @@
+#include "trace.h"
+
+#ifdef SANDBOX_TRACE
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
+
+namespace sandbox {
+
+#ifdef SANDBOX_TRACE
+namespace {
+
+// Per thread; a launcher records a few dozen spans, a long-lived pool far
+// more, of which the latest are the interesting ones.
+constexpr size_t kRingSize = 4096;
+
+struct SpanRecord {
+    const char* name;
+    int64_t start;
+    int64_t end;
+};
+
+struct ThreadRing {
+    uint64_t tid = 0;
+    // Spans ever recorded; the ring holds the last kRingSize of them.
+    std::atomic<uint64_t> written{0};
+    SpanRecord spans[kRingSize];
+};
+
+struct Tracer {
+    std::atomic<bool> enabled{false};
+    std::mutex mutex;  // everything below
+    std::vector<ThreadRing*> rings;
+    bool root = false;
+    std::string outputPath;
+    std::string sinkPath;
+    std::string hookDirectory;
+#ifdef _WIN32
+    HANDLE sink = NULL;
+#else
+    int sink = -1;
+#endif
+};
+
+int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+uint64_t ProcessId() {
+#ifdef _WIN32
+    return GetCurrentProcessId();
+#else
+    return static_cast<uint64_t>(getpid());
+#endif
+}
+
+uint64_t ThreadId() {
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#elif defined(__linux__)
+    return static_cast<uint64_t>(syscall(SYS_gettid));
+#else
+    return std::hash<std::thread::id>()(std::this_thread::get_id());
+#endif
+}
+
+std::string ExecutablePath() {
+#ifdef _WIN32
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(NULL, path, MAX_PATH);
+    return length > 0 && length < MAX_PATH ? std::string(path, length) : std::string();
+#else
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    return length > 0 ? std::string(path, static_cast<size_t>(length)) : std::string();
+#endif
+}
+
+bool WriteSink(Tracer& tracer, const std::string& text) {
+#ifdef _WIN32
+    DWORD written = 0;
+    return WriteFile(tracer.sink, text.data(), static_cast<DWORD>(text.size()), &written, NULL) &&
+           written == text.size();
+#else
+    // One write per flush: O_APPEND keeps processes from interleaving.
+    size_t offset = 0;
+    while (offset < text.size()) {
+        ssize_t written = write(tracer.sink, text.data() + offset, text.size() - offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        offset += static_cast<size_t>(written);
+    }
+    return true;
+#endif
+}
+
+void AppendJsonString(const char* text, std::string* out) {
+    *out += '"';
+    for (; *text != '\0'; text++) {
+        if (*text == '"' || *text == '\\') {
+            *out += '\\';
+        }
+        if (static_cast<unsigned char>(*text) >= 0x20) {
+            *out += *text;
+        }
+    }
+    *out += '"';
+}
+
+// One Chrome trace event per line: the sink is a list of them, merged into
+// the output's traceEvents array at the end.
+std::string FormatSpans(Tracer& tracer) {
+    uint64_t pid = ProcessId();
+    std::string text = "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + std::to_string(pid) +
+                       ",\"args\":{\"name\":";
+    std::string executable = ExecutablePath();
+    size_t slash = executable.find_last_of("\\/");
+    AppendJsonString(executable.c_str() + (slash == std::string::npos ? 0 : slash + 1), &text);
+    text += "}}\n";
+    char event[160];
+    for (ThreadRing* ring : tracer.rings) {
+        uint64_t written = ring->written.load(std::memory_order_acquire);
+        uint64_t first = written > kRingSize ? written - kRingSize : 0;
+        if (first > 0) {
+            snprintf(event, sizeof(event),
+                     "{\"name\":\"%llu older spans dropped\",\"ph\":\"i\",\"s\":\"t\","
+                     "\"ts\":%.3f,\"pid\":%llu,\"tid\":%llu}\n",
+                     static_cast<unsigned long long>(first),
+                     ring->spans[first % kRingSize].start / 1000.0,
+                     static_cast<unsigned long long>(pid),
+                     static_cast<unsigned long long>(ring->tid));
+            text += event;
+        }
+        for (uint64_t i = first; i < written; i++) {
+            const SpanRecord& span = ring->spans[i % kRingSize];
+            text += "{\"name\":";
+            AppendJsonString(span.name, &text);
+            snprintf(event, sizeof(event),
+                     ",\"cat\":\"launch\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%llu,"
+                     "\"tid\":%llu}\n",
+                     span.start / 1000.0, (span.end - span.start) / 1000.0,
+                     static_cast<unsigned long long>(pid),
+                     static_cast<unsigned long long>(ring->tid));
+            text += event;
+        }
+    }
+    return text;
+}
+
+bool ReadWholeFile(const std::string& path, std::string* contents) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    char buffer[65536];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents->append(buffer, length);
+    }
+    fclose(file);
+    return true;
+}
+
+void WriteMergedTrace(const Tracer& tracer) {
+    std::string events;
+    if (!ReadWholeFile(tracer.sinkPath, &events)) {
+        return;
+    }
+    FILE* output = fopen(tracer.outputPath.c_str(), "wb");
+    if (output == nullptr) {
+        return;
+    }
+    fputs("{\"traceEvents\":[\n", output);
+    bool first = true;
+    for (size_t line = 0; line < events.size();) {
+        size_t end = events.find('\n', line);
+        if (end == std::string::npos) {
+            end = events.size();
+        }
+        if (end > line) {
+            fputs(first ? "" : ",\n", output);
+            fwrite(events.data() + line, 1, end - line, output);
+            first = false;
+        }
+        line = end + 1;
+    }
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", output);
+    fclose(output);
+    remove(tracer.sinkPath.c_str());
+}
+
+void FinishAtExit() { FinishTrace(); }
+
+// A process started inside a trace joins it on its first span.
+Tracer* JoinInheritedTrace() {
+    Tracer* tracer = new Tracer();
+    const char* value = getenv(kTraceSinkVariable);
+    if (value == nullptr || *value == '\0') {
+        return tracer;
+    }
+#ifdef _WIN32
+    HANDLE sink = reinterpret_cast<HANDLE>(static_cast<uintptr_t>(_strtoui64(value, nullptr, 10)));
+    DWORD flags;
+    if (!GetHandleInformation(sink, &flags)) {
+        return tracer;
+    }
+#else
+    int sink = atoi(value);
+    if (fcntl(sink, F_GETFD) < 0) {
+        return tracer;
+    }
+#endif
+    tracer->sink = sink;
+    tracer->enabled.store(true, std::memory_order_relaxed);
+    atexit(FinishAtExit);
+    return tracer;
+}
+
+Tracer& GetTracer() {
+    static Tracer* tracer = JoinInheritedTrace();
+    return *tracer;
+}
+
+ThreadRing* CurrentRing(Tracer& tracer) {
+    thread_local ThreadRing* ring = nullptr;
+    if (ring == nullptr) {
+        ring = new ThreadRing();
+        ring->tid = ThreadId();
+        std::lock_guard<std::mutex> lock(tracer.mutex);
+        tracer.rings.push_back(ring);
+    }
+    return ring;
+}
+
+}  // namespace
+
+bool StartTrace(const std::string& outputPath, std::string* error) {
+    Tracer& tracer = GetTracer();
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    if (tracer.enabled.load(std::memory_order_relaxed)) {
+        // Started by our launcher: our spans belong to its trace.
+        return true;
+    }
+    tracer.outputPath = outputPath;
+    tracer.sinkPath = outputPath + ".events";
+    std::string sinkValue;
+#ifdef _WIN32
+    // Inheritable, and append-only so every process's writes land at the
+    // end whatever the others did.
+    SECURITY_ATTRIBUTES inherit = {sizeof(inherit), NULL, TRUE};
+    tracer.sink = CreateFileA(tracer.sinkPath.c_str(), FILE_APPEND_DATA | SYNCHRONIZE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, &inherit,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (tracer.sink == INVALID_HANDLE_VALUE) {
+        tracer.sink = NULL;
+        *error = "Cannot create " + tracer.sinkPath + ": error " + std::to_string(GetLastError());
+        return false;
+    }
+    sinkValue = std::to_string(reinterpret_cast<uintptr_t>(tracer.sink));
+    SetEnvironmentVariableA(kTraceSinkVariable, sinkValue.c_str());
+    const char kPathSeparator = ';';
+#else
+    // Without O_CLOEXEC: every child inherits it across exec.
+    tracer.sink = open(tracer.sinkPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (tracer.sink < 0) {
+        *error = "Cannot create " + tracer.sinkPath + ": " + strerror(errno);
+        return false;
+    }
+    sinkValue = std::to_string(tracer.sink);
+    setenv(kTraceSinkVariable, sinkValue.c_str(), 1);
+    const char kPathSeparator = ':';
+#endif
+
+    std::string executable = ExecutablePath();
+    size_t slash = executable.find_last_of("\\/");
+    if (slash != std::string::npos) {
+        std::string hook = executable.substr(0, slash + 1) + "trace_hook";
+#ifdef _WIN32
+        DWORD attributes = GetFileAttributesA(hook.c_str());
+        bool found = attributes != INVALID_FILE_ATTRIBUTES &&
+                     (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+        struct stat info;
+        bool found = stat(hook.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+        if (found) {
+            tracer.hookDirectory = hook;
+            const char* path = getenv("PYTHONPATH");
+            std::string pythonPath = hook;
+            if (path != nullptr && *path != '\0') {
+                pythonPath += kPathSeparator;
+                pythonPath += path;
+            }
+#ifdef _WIN32
+            SetEnvironmentVariableA("PYTHONPATH", pythonPath.c_str());
+            _putenv_s("PYTHONPATH", pythonPath.c_str());
+#else
+            setenv("PYTHONPATH", pythonPath.c_str(), 1);
+#endif
+        }
+    }
+    tracer.root = true;
+    tracer.enabled.store(true, std::memory_order_relaxed);
+    atexit(FinishAtExit);
+    return true;
+}
+
+const std::string& TraceHookDirectory() { return GetTracer().hookDirectory; }
+
+#ifdef _WIN32
+void* TraceSinkHandle() {
+    Tracer& tracer = GetTracer();
+    return tracer.enabled.load(std::memory_order_relaxed) ? tracer.sink : nullptr;
+}
+#else
+int TraceSinkFd() {
+    Tracer& tracer = GetTracer();
+    return tracer.enabled.load(std::memory_order_relaxed) ? tracer.sink : -1;
+}
+#endif
+
+void FinishTrace() {
+    Tracer& tracer = GetTracer();
+    if (!tracer.enabled.exchange(false)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    WriteSink(tracer, FormatSpans(tracer));
+    if (!tracer.root) {
+        return;
+    }
+    // Children still running now append to a sink nobody reads.
+#ifdef _WIN32
+    CloseHandle(tracer.sink);
+    tracer.sink = NULL;
+#else
+    close(tracer.sink);
+    tracer.sink = -1;
+#endif
+    WriteMergedTrace(tracer);
+}
+
+TraceSpan::TraceSpan(const char* name)
+    : name_(name),
+      start_(GetTracer().enabled.load(std::memory_order_relaxed) ? NowNs() : 0) {}
+
+TraceSpan::~TraceSpan() {
+    Tracer& tracer = GetTracer();
+    if (start_ == 0 || !tracer.enabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    ThreadRing* ring = CurrentRing(tracer);
+    uint64_t index = ring->written.load(std::memory_order_relaxed);
+    ring->spans[index % kRingSize] = {name_, start_, NowNs()};
+    ring->written.store(index + 1, std::memory_order_release);
+}
+#else
+bool StartTrace(const std::string&, std::string* error) {
+    *error = "Tracing is not compiled in; build with -DSANDBOX_TRACE";
+    return false;
+}
+
+const std::string& TraceHookDirectory() {
+    static const std::string none;
+    return none;
+}
+
+#ifdef _WIN32
+void* TraceSinkHandle() { return nullptr; }
+#else
+int TraceSinkFd() { return -1; }
+#endif
+
+void FinishTrace() {}
+
+TraceSpan::TraceSpan(const char* name) : name_(name), start_(0) {}
+
+TraceSpan::~TraceSpan() {}
+#endif
+
+}  // namespace sandbox
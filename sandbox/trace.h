@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Launch tracing: where the seconds of a slow start went (SID derivation,
+// ACL grants, process creation, interpreter startup, imports), as one Chrome
+// trace JSON per launch that Perfetto or chrome://tracing opens.
+//
+// Spans are compiled in only with -DSANDBOX_TRACE; without it TRACE_SPAN
+// expands to nothing and StartTrace() fails. Compiled in but not started,
+// a span costs one relaxed atomic load.
+//
+// Each thread records finished spans into a ring buffer of its own (no lock
+// and no allocation per span; the oldest spans are overwritten once it is
+// full). The launcher that starts a trace opens an append-only sink next to
+// the output file and names it in kTraceSinkVariable; children inherit both
+// and append their own spans at exit, including Python children through the
+// import hook in trace_hook/sitecustomize.py. When the launcher exits it
+// merges everything in the sink into the output file. Every process stamps
+// spans with the monotonic clock Python's time.perf_counter_ns() also reads
+// (CLOCK_MONOTONIC, QueryPerformanceCounter), so they line up. The gap
+// between a Spawn span and the child's first span is process creation, DLL
+// loading and interpreter initialization.
+namespace sandbox {
+
+// Holds the inherited sink: an fd number on POSIX, a handle value on
+// Windows.
+constexpr char kTraceSinkVariable[] = "SANDBOX_TRACE_SINK";
+
+// Starts a trace that is written to outputPath when this process exits (or
+// calls FinishTrace()). Children started afterwards join it. When a
+// trace_hook directory sits next to the executable it is put first on
+// PYTHONPATH, so Python children add import spans.
+bool StartTrace(const std::string& outputPath, std::string* error);
+
+// The trace_hook directory StartTrace() put on PYTHONPATH, or empty.
+// Sandboxed Python children need read access to it.
+const std::string& TraceHookDirectory();
+
+// The sink children must inherit, or -1 / nullptr when no trace is active.
+// On Windows SandboxLauncher and SpawnProcess() add it to the handle list
+// of every child; the POSIX descriptor is simply left open across exec.
+#ifdef _WIN32
+void* TraceSinkHandle();
+#else
+int TraceSinkFd();
+#endif
+
+// Appends this process's spans to the sink and, in the process that
+// started the trace, writes the merged output. Runs at exit; later spans
+// are dropped.
+void FinishTrace();
+
+// Records [construction, destruction) as a complete event on the calling
+// thread. name must outlive the trace (a string literal).
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    int64_t start_;
+};
+
+}  // namespace sandbox
+
+#ifdef SANDBOX_TRACE
+#define SANDBOX_TRACE_JOIN2(a, b) a##b
+#define SANDBOX_TRACE_JOIN(a, b) SANDBOX_TRACE_JOIN2(a, b)
+#define TRACE_SPAN(name) ::sandbox::TraceSpan SANDBOX_TRACE_JOIN(traceSpan, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) static_cast<void>(0)
+#endif
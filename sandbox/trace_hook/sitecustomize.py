@@ -0,0 +1,92 @@
+"""Import spans for the launch trace (sandbox/trace.h).
+
+A launcher that traces puts this directory first on PYTHONPATH, so site
+imports this module at interpreter startup. When SANDBOX_TRACE_SINK names
+the trace sink the launcher handed down, every import that takes a
+noticeable time becomes a span, and so does the run from here to exit; the
+spans are appended to the sink at exit as Chrome trace events, one per
+line. time.perf_counter_ns() reads the same monotonic clock the launchers
+stamp their spans with.
+
+Any other sitecustomize on sys.path (a virtualenv's, say) still runs.
+"""
+import builtins
+import os
+import sys
+import time
+
+# Cached imports take about a microsecond; only real loading is kept.
+_MIN_IMPORT_NS = 20000
+
+
+def _chain_sitecustomize():
+    import importlib.machinery
+    import importlib.util
+
+    here = os.path.dirname(os.path.abspath(__file__))
+    path = [entry for entry in sys.path if os.path.abspath(entry or os.curdir) != here]
+    spec = importlib.machinery.PathFinder.find_spec("sitecustomize", path)
+    if spec is not None and spec.loader is not None:
+        module = importlib.util.module_from_spec(spec)
+        sys.modules["sitecustomize"] = module
+        spec.loader.exec_module(module)
+
+
+def _open_sink(value):
+    if sys.platform == "win32":
+        import msvcrt
+
+        return msvcrt.open_osfhandle(int(value), os.O_APPEND | os.O_WRONLY)
+    return int(value)
+
+
+def _install(sink):
+    import atexit
+    import json
+    import threading
+
+    pid = os.getpid()
+    started = time.perf_counter_ns()
+    spans = []
+    original_import = builtins.__import__
+
+    def traced_import(name, globals=None, locals=None, fromlist=(), level=0):
+        start = time.perf_counter_ns()
+        try:
+            return original_import(name, globals, locals, fromlist, level)
+        finally:
+            end = time.perf_counter_ns()
+            if end - start >= _MIN_IMPORT_NS:
+                spans.append(("import " + "." * level + name, start, end,
+                              threading.get_native_id()))
+
+    def flush():
+        builtins.__import__ = original_import
+        spans.append(("python " + os.path.basename(sys.argv[0] if sys.argv else ""),
+                      started, time.perf_counter_ns(), threading.main_thread().native_id))
+        events = [{"name": "process_name", "ph": "M", "pid": pid,
+                   "args": {"name": "python " + os.path.basename(sys.executable)}}]
+        for name, start, end, tid in spans:
+            events.append({"name": name, "cat": "python", "ph": "X", "ts": start / 1000,
+                           "dur": (end - start) / 1000, "pid": pid, "tid": tid})
+        text = "".join(json.dumps(event, separators=(",", ":")) + "\n" for event in events)
+        try:
+            os.write(sink, text.encode())
+        except OSError:
+            pass
+
+    builtins.__import__ = traced_import
+    atexit.register(flush)
+
+
+def _main():
+    value = os.environ.get("SANDBOX_TRACE_SINK")
+    if value:
+        try:
+            _install(_open_sink(value))
+        except (OSError, ValueError):
+            pass
+    _chain_sitecustomize()
+
+
+_main()
@@ -0,0 +1,547 @@
+#include "worker_pool.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "launcher.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+#endif
+
+namespace sandbox {
+
+namespace {
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string JoinFields(const std::vector<std::string>& fields) {
+    std::string message;
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (i > 0) {
+            message += '\0';
+        }
+        message += fields[i];
+    }
+    return message;
+}
+
+std::vector<std::string> SplitFields(const char* data, size_t length) {
+    std::vector<std::string> fields(1);
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] == '\0') {
+            fields.emplace_back();
+        } else {
+            fields.back() += data[i];
+        }
+    }
+    return fields;
+}
+
+#ifndef _WIN32
+// One SOCK_SEQPACKET message per call, with optional SCM_RIGHTS descriptors.
+bool SendFields(int fd, const std::vector<std::string>& fields, const std::vector<int>& fds) {
+    std::string message = JoinFields(fields);
+    iovec iov = {&message[0], message.size()};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 3)];
+    if (!fds.empty()) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr* header = CMSG_FIRSTHDR(&msg);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+    }
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent == static_cast<ssize_t>(message.size());
+}
+
+bool ReceiveFields(int fd, std::vector<std::string>* fields, std::vector<int>* fds) {
+    char buffer[1 << 16];
+    iovec iov = {buffer, sizeof(buffer)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 3)];
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t received;
+    do {
+        received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) {
+        return false;
+    }
+    for (cmsghdr* header = CMSG_FIRSTHDR(&msg); header != nullptr;
+         header = CMSG_NXTHDR(&msg, header)) {
+        if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* received_fds = reinterpret_cast<const int*>(CMSG_DATA(header));
+        for (size_t i = 0; i < count; i++) {
+            if (fds != nullptr) {
+                fds->push_back(received_fds[i]);
+            } else {
+                close(received_fds[i]);
+            }
+        }
+    }
+    *fields = SplitFields(buffer, static_cast<size_t>(received));
+    return true;
+}
+#endif
+
+// Message channel to python_worker.py; see the protocol notes there.
+class Channel {
+public:
+    Channel() = default;
+    ~Channel() { Close(); }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+#ifdef _WIN32
+    Channel(HANDLE in, HANDLE out) : in_(in), out_(out) {}
+
+    bool Send(const std::vector<std::string>& fields) {
+        std::string message = JoinFields(fields);
+        std::string framed = std::to_string(message.size()) + ":" + message + ",";
+        DWORD written = 0;
+        return WriteFile(out_, framed.data(), static_cast<DWORD>(framed.size()), &written, NULL) &&
+               written == framed.size();
+    }
+
+    bool Receive(std::vector<std::string>* fields) {
+        std::string length;
+        char c = 0;
+        for (;;) {
+            if (!ReadExact(&c, 1)) {
+                return false;
+            }
+            if (c == ':') {
+                break;
+            }
+            length += c;
+        }
+        std::string message(strtoul(length.c_str(), nullptr, 10), '\0');
+        if (!ReadExact(&message[0], message.size()) || !ReadExact(&c, 1) || c != ',') {
+            return false;
+        }
+        *fields = SplitFields(message.data(), message.size());
+        return true;
+    }
+
+    void Close() {
+        if (in_ != NULL) {
+            CloseHandle(in_);
+            in_ = NULL;
+        }
+        if (out_ != NULL) {
+            CloseHandle(out_);
+            out_ = NULL;
+        }
+    }
+
+private:
+    bool ReadExact(char* buffer, size_t length) {
+        while (length > 0) {
+            DWORD bytesRead = 0;
+            if (!ReadFile(in_, buffer, static_cast<DWORD>(length), &bytesRead, NULL) ||
+                bytesRead == 0) {
+                return false;
+            }
+            buffer += bytesRead;
+            length -= bytesRead;
+        }
+        return true;
+    }
+
+    HANDLE in_ = NULL;
+    HANDLE out_ = NULL;
+#else
+    explicit Channel(int fd) : fd_(fd) {}
+
+    bool Send(const std::vector<std::string>& fields, const std::vector<int>& fds = {}) {
+        return SendFields(fd_, fields, fds);
+    }
+
+    bool Receive(std::vector<std::string>* fields, std::vector<int>* fds = nullptr) {
+        return ReceiveFields(fd_, fields, fds);
+    }
+
+    void Close() {
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+private:
+    int fd_ = -1;
+#endif
+};
+
+#ifdef _WIN32
+std::wstring Widen(const std::string& text) {
+    if (text.empty()) {
+        return std::wstring();
+    }
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()),
+                                     NULL, 0);
+    std::wstring wide(length, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &wide[0], length);
+    return wide;
+}
+
+// CreateProcessW that lets the child inherit exactly the two pipe ends.
+void* SpawnPlainWorker(const std::wstring& commandLine, void* const handles[2]) {
+    SIZE_T size = 0;
+    InitializeProcThreadAttributeList(NULL, 1, 0, &size);
+    std::vector<char> attributeBuffer(size);
+    auto attributes = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributeBuffer.data());
+    if (!InitializeProcThreadAttributeList(attributes, 1, 0, &size)) {
+        return nullptr;
+    }
+    HANDLE inherited[2] = {handles[0], handles[1]};
+    if (!UpdateProcThreadAttribute(attributes, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherited,
+                                   sizeof(inherited), NULL, NULL)) {
+        DeleteProcThreadAttributeList(attributes);
+        return nullptr;
+    }
+    STARTUPINFOEXW startup = {};
+    startup.StartupInfo.cb = sizeof(startup);
+    startup.lpAttributeList = attributes;
+    PROCESS_INFORMATION process = {};
+    std::wstring mutableCommandLine = commandLine;
+    BOOL ok = CreateProcessW(NULL, &mutableCommandLine[0], NULL, NULL, TRUE,
+                             EXTENDED_STARTUPINFO_PRESENT, NULL, NULL, &startup.StartupInfo,
+                             &process);
+    DeleteProcThreadAttributeList(attributes);
+    if (!ok) {
+        return nullptr;
+    }
+    CloseHandle(process.hThread);
+    return process.hProcess;
+}
+#endif
+
+}  // namespace
+
+struct WorkerPool::Worker {
+    Channel channel;
+    unsigned jobs = 0;
+#ifdef _WIN32
+    HANDLE process = NULL;
+
+    Worker(HANDLE in, HANDLE out) : channel(in, out) {}
+    ~Worker() {
+        if (process != NULL) {
+            CloseHandle(process);
+        }
+    }
+#else
+    pid_t pid = -1;
+
+    explicit Worker(int fd) : channel(fd) {}
+#endif
+};
+
+WorkerPool::WorkerPool() = default;
+
+WorkerPool::~WorkerPool() {
+    Stop();
+}
+
+bool WorkerPool::Start(const WorkerPoolOptions& options, std::string* error) {
+    options_ = options;
+    if (options_.workerScript.empty()) {
+        *error = "No worker script given";
+        return false;
+    }
+    if (options_.workers == 0) {
+        options_.workers = 1;
+    }
+    std::string preload;
+    for (const std::string& module : options_.preloadModules) {
+        preload += (preload.empty() ? "" : ",") + module;
+    }
+
+#ifndef _WIN32
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0) {
+        *error = std::string("socketpair failed: ") + strerror(errno);
+        return false;
+    }
+
+    // The zygote keeps its end of the socket at the same number.
+    std::vector<std::string> args = {options_.python, options_.workerScript, "--zygote",
+                                     std::to_string(sockets[1]), "--jobs",
+                                     std::to_string(options_.jobsPerWorker)};
+    if (!preload.empty()) {
+        args.push_back("--preload");
+        args.push_back(preload);
+    }
+
+    pid_t pid;
+    if (options_.launcher != nullptr) {
+        // Confined before the interpreter starts, so the preload imports
+        // and every forked worker run under the launcher's policy. The
+        // zygote exits when its socket closes; Stop() reaps it by pid.
+        LaunchCommand command;
+        command.argv = args;
+        command.inheritFds.push_back(sockets[1]);
+        LaunchedProcess process;
+        if (!options_.launcher->Spawn(command, &process, error)) {
+            close(sockets[0]);
+            close(sockets[1]);
+            return false;
+        }
+        if (process.pidfd >= 0) {
+            close(process.pidfd);
+        }
+        pid = process.pid;
+    } else {
+        // Everything the child needs is prepared before fork.
+        std::vector<char*> argv;
+        for (std::string& arg : args) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+
+        pid = fork();
+        if (pid < 0) {
+            close(sockets[0]);
+            close(sockets[1]);
+            *error = std::string("fork failed: ") + strerror(errno);
+            return false;
+        }
+        if (pid == 0) {
+            if (fcntl(sockets[1], F_SETFD, 0) != 0) {
+                _exit(127);
+            }
+            setsid();
+#ifdef __linux__
+            // Workers forked from the zygote inherit both: no privilege gain
+            // through setuid binaries, and no orphans if the pool dies.
+            prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+            prctl(PR_SET_PDEATHSIG, SIGKILL, 0, 0, 0);
+#endif
+            execvp(argv[0], argv.data());
+            _exit(127);
+        }
+    }
+    close(sockets[1]);
+    zygoteSocket_ = sockets[0];
+    zygotePid_ = pid;
+
+    std::vector<std::string> fields;
+    if (!ReceiveFields(zygoteSocket_, &fields, nullptr) || fields[0] != "ready") {
+        *error = "Python fork server failed to start (" + options_.python + " " +
+                 options_.workerScript + ")";
+        Stop();
+        return false;
+    }
+#endif
+
+    stopping_ = false;
+    for (unsigned i = 0; i < options_.workers; i++) {
+        std::unique_ptr<Worker> worker = SpawnWorker(error);
+        if (worker == nullptr) {
+            Stop();
+            return false;
+        }
+        idle_.push_back(std::move(worker));
+    }
+    refill_ = std::thread([this] { RefillLoop(); });
+    return true;
+}
+
+std::unique_ptr<WorkerPool::Worker> WorkerPool::SpawnWorker(std::string* error) {
+#ifdef _WIN32
+    SECURITY_ATTRIBUTES inheritable = {sizeof(inheritable), NULL, TRUE};
+    HANDLE jobRead = NULL, jobWrite = NULL, replyRead = NULL, replyWrite = NULL;
+    if (!CreatePipe(&jobRead, &jobWrite, &inheritable, 0) ||
+        !CreatePipe(&replyRead, &replyWrite, &inheritable, 0)) {
+        *error = "CreatePipe failed: " + std::to_string(GetLastError());
+        return nullptr;
+    }
+    // Only the child's ends stay inheritable.
+    SetHandleInformation(jobWrite, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(replyRead, HANDLE_FLAG_INHERIT, 0);
+
+    std::wstring commandLine = L"\"" + Widen(options_.python) + L"\" \"" +
+                               Widen(options_.workerScript) + L"\" --pipes " +
+                               std::to_wstring(reinterpret_cast<uintptr_t>(jobRead)) + L" " +
+                               std::to_wstring(reinterpret_cast<uintptr_t>(replyWrite)) +
+                               L" --jobs " + std::to_wstring(options_.jobsPerWorker);
+    std::wstring preload;
+    for (const std::string& module : options_.preloadModules) {
+        preload += (preload.empty() ? L"" : L",") + Widen(module);
+    }
+    if (!preload.empty()) {
+        commandLine += L" --preload " + preload;
+    }
+
+    void* const childHandles[2] = {jobRead, replyWrite};
+    void* process = options_.spawnWorker ? options_.spawnWorker(commandLine, childHandles)
+                                         : SpawnPlainWorker(commandLine, childHandles);
+    CloseHandle(jobRead);
+    CloseHandle(replyWrite);
+    std::unique_ptr<Worker> worker(new Worker(replyRead, jobWrite));
+    if (process == nullptr) {
+        *error = "Failed to start Python worker: " + std::to_string(GetLastError());
+        return nullptr;
+    }
+    worker->process = static_cast<HANDLE>(process);
+
+    std::vector<std::string> fields;
+    if (!worker->channel.Receive(&fields) || fields[0] != "ready") {
+        *error = "Python worker exited during startup";
+        return nullptr;
+    }
+    return worker;
+#else
+    std::lock_guard<std::mutex> lock(zygoteMutex_);
+    std::vector<std::string> fields;
+    std::vector<int> fds;
+    if (!SendFields(zygoteSocket_, {"spawn"}, {}) || !ReceiveFields(zygoteSocket_, &fields, &fds)) {
+        *error = "Python fork server exited";
+        return nullptr;
+    }
+    if (fields.size() < 2 || fields[0] != "worker" || fds.size() != 1) {
+        for (int fd : fds) {
+            close(fd);
+        }
+        *error = "Unexpected reply from the Python fork server";
+        return nullptr;
+    }
+    std::unique_ptr<Worker> worker(new Worker(fds[0]));
+    worker->pid = static_cast<pid_t>(strtol(fields[1].c_str(), nullptr, 10));
+    return worker;
+#endif
+}
+
+void WorkerPool::RefillLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        changed_.wait(lock, [this] { return stopping_ || missing_ > 0; });
+        if (stopping_) {
+            return;
+        }
+        missing_--;
+        lock.unlock();
+        std::string error;
+        std::unique_ptr<Worker> worker = SpawnWorker(&error);
+        lock.lock();
+        if (worker != nullptr) {
+            idle_.push_back(std::move(worker));
+            changed_.notify_all();
+            continue;
+        }
+        std::cerr << "WorkerPool: " << error << std::endl;
+        missing_++;
+        // Back off instead of spinning on a broken interpreter.
+        changed_.wait_for(lock, std::chrono::milliseconds(200), [this] { return stopping_; });
+    }
+}
+
+bool WorkerPool::Run(const PythonJob& job, PythonJobResult* result, std::string* error) {
+    auto start = std::chrono::steady_clock::now();
+    std::unique_ptr<Worker> worker;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] { return stopping_ || !idle_.empty(); });
+        if (stopping_) {
+            *error = "Worker pool is stopped";
+            return false;
+        }
+        worker = std::move(idle_.front());
+        idle_.pop_front();
+    }
+
+    std::vector<std::string> fields = {"run", job.script, job.cwd};
+    fields.insert(fields.end(), job.args.begin(), job.args.end());
+#ifdef _WIN32
+    bool sent = worker->channel.Send(fields);
+#else
+    std::vector<int> stdio = {job.stdinFd >= 0 ? job.stdinFd : 0,
+                              job.stdoutFd >= 0 ? job.stdoutFd : 1,
+                              job.stderrFd >= 0 ? job.stderrFd : 2};
+    bool sent = worker->channel.Send(fields, stdio);
+#endif
+
+    std::vector<std::string> reply;
+    bool ok = sent && worker->channel.Receive(&reply) && reply[0] == "started";
+    if (ok) {
+        result->startSeconds = SecondsSince(start);
+        ok = worker->channel.Receive(&reply) && reply[0] == "exit" && reply.size() == 2;
+    }
+    result->totalSeconds = SecondsSince(start);
+    if (ok) {
+        result->exitCode = static_cast<int>(strtol(reply[1].c_str(), nullptr, 10));
+        worker->jobs++;
+    } else {
+        *error = "Python worker exited while running " + job.script;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ok && (options_.jobsPerWorker == 0 || worker->jobs < options_.jobsPerWorker)) {
+        idle_.push_back(std::move(worker));
+    } else {
+        // The worker exits on its own after its last job (or has died);
+        // dropping it closes our end of its channel.
+        worker.reset();
+        missing_++;
+    }
+    changed_.notify_all();
+    return ok;
+}
+
+void WorkerPool::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    changed_.notify_all();
+    if (refill_.joinable()) {
+        refill_.join();
+    }
+    idle_.clear();
+    missing_ = 0;
+#ifndef _WIN32
+    if (zygoteSocket_ >= 0) {
+        close(zygoteSocket_);
+        zygoteSocket_ = -1;
+    }
+    if (zygotePid_ > 0) {
+        int status = 0;
+        waitpid(zygotePid_, &status, 0);
+        zygotePid_ = -1;
+    }
+#endif
+}
+
+}  // namespace sandbox
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Pool of pre-started Python interpreters that run scripts on demand, so a
+// job pays for a message round trip instead of interpreter startup and
+// sandbox setup. The Python side is python_worker.py.
+//
+// On Linux the pool starts one fork server ("zygote") that has already
+// imported the preload modules and forks ready workers from it, optionally
+// inside a SandboxLauncher's sandbox. On Windows each worker is started
+// directly (optionally inside an AppContainer via spawnWorker) and kept
+// waiting on a pipe.
+namespace sandbox {
+
+class SandboxLauncher;
+
+struct WorkerPoolOptions {
+    std::string python = "python3";
+    std::string workerScript;  // path to python_worker.py
+    unsigned workers = 4;
+    // Jobs a worker serves before it is replaced. 1 gives every job a fresh
+    // pre-warmed interpreter; larger values reuse it, resetting only argv,
+    // cwd, sys.path and modules the job imported.
+    unsigned jobsPerWorker = 1;
+    std::vector<std::string> preloadModules;
+#ifdef _WIN32
+    // Starts one worker. handles are the two pipe ends the worker must
+    // inherit; returns the process handle or nullptr. Defaults to a plain
+    // CreateProcessW.
+    std::function<void*(const std::wstring& commandLine, void* const handles[2])> spawnWorker;
+#else
+    // Starts the zygote through this launcher, so it and every worker it
+    // forks are inside the namespaces, Landlock ruleset and seccomp filter
+    // before the first job arrives. Landlock rules cannot be widened once the
+    // zygote runs: the policy must already cover python, the worker script
+    // and every job script. nullptr starts the zygote unconfined.
+    SandboxLauncher* launcher = nullptr;
+#endif
+};
+
+struct PythonJob {
+    std::string script;
+    std::vector<std::string> args;
+    std::string cwd;  // empty = the worker's cwd
+    // POSIX only: descriptors handed to the job as its stdio. -1 uses the
+    // pool's own. Windows workers write to their inherited console.
+    int stdinFd = -1;
+    int stdoutFd = -1;
+    int stderrFd = -1;
+};
+
+struct PythonJobResult {
+    int exitCode = -1;
+    // From Run() being called to the worker entering the script, including
+    // any wait for an idle worker.
+    double startSeconds = 0;
+    double totalSeconds = 0;
+};
+
+class WorkerPool {
+public:
+    WorkerPool();
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Starts the zygote (POSIX) and the initial workers, and returns once
+    // they are all idle.
+    bool Start(const WorkerPoolOptions& options, std::string* error);
+
+    // Runs one script on an idle worker and waits for it. Safe to call from
+    // several threads; each call occupies one worker.
+    bool Run(const PythonJob& job, PythonJobResult* result, std::string* error);
+
+    void Stop();
+
+private:
+    struct Worker;
+
+    std::unique_ptr<Worker> SpawnWorker(std::string* error);
+    void RefillLoop();
+
+    WorkerPoolOptions options_;
+#ifndef _WIN32
+    int zygoteSocket_ = -1;
+    int zygotePid_ = -1;
+    std::mutex zygoteMutex_;
+#endif
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::deque<std::unique_ptr<Worker>> idle_;
+    unsigned missing_ = 0;  // retired workers not yet replaced
+    bool stopping_ = false;
+    std::thread refill_;
+};
+
+}  // namespace sandbox